@@ -0,0 +1,239 @@
+#include "DeltaPatch.h"
+
+#include <InflateReader.h>
+#include <Logging.h>
+#include <mbedtls/sha256.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+namespace {
+constexpr uint8_t MAGIC[4] = {'C', 'P', 'D', 'P'};
+constexpr uint8_t VERSION = 1;
+constexpr size_t FIXED_HEADER_SIZE = 80;
+constexpr size_t CHUNK_SIZE = 2048;
+constexpr size_t READ_BUFFER_SIZE = 1024;
+
+uint32_t readLe32(const uint8_t* p) {
+  return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16 |
+         static_cast<uint32_t>(p[3]) << 24;
+}
+
+bool readExact(const DeltaPatch::PatchReader& patch, uint8_t* buffer, size_t size) {
+  while (size > 0) {
+    const int read = patch(buffer, size);
+    if (read <= 0) return false;
+    buffer += read;
+    size -= read;
+  }
+  return true;
+}
+
+struct PatchInflateCtx {
+  InflateReader reader;  // Must be first, see InflateReader
+  const DeltaPatch::PatchReader* patch = nullptr;
+  uint8_t readBuf[READ_BUFFER_SIZE];
+  bool readFailed = false;
+};
+static_assert(std::is_standard_layout<PatchInflateCtx>::value, "PatchInflateCtx is cast from uzlib_uncomp*");
+
+int patchReadCallback(uzlib_uncomp* uncomp) {
+  auto* ctx = reinterpret_cast<PatchInflateCtx*>(uncomp);
+  const int read = (*ctx->patch)(ctx->readBuf, sizeof(ctx->readBuf));
+  if (read <= 0) {
+    ctx->readFailed = read < 0;
+    return -1;
+  }
+  uncomp->source = ctx->readBuf + 1;
+  uncomp->source_limit = ctx->readBuf + read;
+  return ctx->readBuf[0];
+}
+
+bool readVarint(PatchInflateCtx& ctx, uint64_t& value) {
+  value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    uint8_t byte;
+    if (!ctx.reader.read(&byte, 1)) return false;
+    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) return true;
+  }
+  return false;
+}
+
+// Hashes with mbedtls, which uses the SHA accelerator on the device
+class Sha256 {
+ public:
+  Sha256() {
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+  }
+  ~Sha256() { mbedtls_sha256_free(&ctx); }
+  void update(const uint8_t* data, const size_t size) { mbedtls_sha256_update(&ctx, data, size); }
+  void finish(uint8_t* out) { mbedtls_sha256_finish(&ctx, out); }
+
+ private:
+  mbedtls_sha256_context ctx;
+};
+}  // namespace
+
+DeltaPatch::Error DeltaPatch::begin(const SignatureCheck& checkSignature) {
+  uint8_t fixed[FIXED_HEADER_SIZE];
+  if (!readExact(patch, fixed, sizeof(fixed))) {
+    return Error::BAD_HEADER;
+  }
+  if (memcmp(fixed, MAGIC, sizeof(MAGIC)) != 0 || fixed[4] != VERSION) {
+    LOG_ERR("DPATCH", "Not a version %d patch", VERSION);
+    return Error::BAD_HEADER;
+  }
+  head.sourceSize = readLe32(fixed + 8);
+  head.targetSize = readLe32(fixed + 12);
+  memcpy(head.sourceHash, fixed + 16, HASH_SIZE);
+  memcpy(head.targetHash, fixed + 16 + HASH_SIZE, HASH_SIZE);
+
+  Sha256 sha;
+  sha.update(fixed, sizeof(fixed));
+  sha.finish(head.digest);
+
+  uint8_t sizeBytes[2];
+  if (!readExact(patch, sizeBytes, sizeof(sizeBytes))) {
+    return Error::BAD_HEADER;
+  }
+  head.signatureSize = static_cast<uint16_t>(sizeBytes[0] | sizeBytes[1] << 8);
+  if (head.signatureSize > MAX_SIGNATURE_SIZE || !readExact(patch, head.signature, head.signatureSize)) {
+    return Error::BAD_HEADER;
+  }
+
+  if (head.signatureSize == 0 || !checkSignature ||
+      !checkSignature(head.digest, head.signature, head.signatureSize)) {
+    LOG_ERR("DPATCH", "Patch signature rejected");
+    return Error::BAD_SIGNATURE;
+  }
+  return Error::OK;
+}
+
+DeltaPatch::Error DeltaPatch::checkSource(const SourceReader& source) const {
+  auto* buffer = static_cast<uint8_t*>(malloc(CHUNK_SIZE));
+  if (!buffer) {
+    return Error::NO_MEMORY;
+  }
+
+  Sha256 sha;
+  Error result = Error::OK;
+  for (size_t offset = 0; offset < head.sourceSize; offset += CHUNK_SIZE) {
+    const size_t size = head.sourceSize - offset < CHUNK_SIZE ? head.sourceSize - offset : CHUNK_SIZE;
+    if (!source(offset, buffer, size)) {
+      result = Error::READ_ERROR;
+      break;
+    }
+    sha.update(buffer, size);
+  }
+  free(buffer);
+  if (result != Error::OK) {
+    return result;
+  }
+
+  uint8_t hash[HASH_SIZE];
+  sha.finish(hash);
+  if (memcmp(hash, head.sourceHash, HASH_SIZE) != 0) {
+    LOG_ERR("DPATCH", "Running image doesn't match the patch source");
+    return Error::SOURCE_MISMATCH;
+  }
+  return Error::OK;
+}
+
+DeltaPatch::Error DeltaPatch::apply(const SourceReader& source, const TargetWriter& target,
+                                    const ProgressCallback& progress) {
+  auto* ctx = new (std::nothrow) PatchInflateCtx();
+  auto* sourceBuf = static_cast<uint8_t*>(malloc(CHUNK_SIZE));
+  auto* outBuf = static_cast<uint8_t*>(malloc(CHUNK_SIZE));
+  if (!ctx || !sourceBuf || !outBuf || !ctx->reader.init(true)) {
+    LOG_ERR("DPATCH", "Failed to allocate patch buffers");
+    delete ctx;
+    free(sourceBuf);
+    free(outBuf);
+    return Error::NO_MEMORY;
+  }
+  ctx->patch = &patch;
+  ctx->reader.setReadCallback(patchReadCallback);
+
+  Sha256 sha;
+  size_t written = 0;
+  int64_t sourcePos = 0;
+  Error result = Error::OK;
+
+  // Inflate `size` bytes of the current record into outBuf
+  const auto inflate = [&](const size_t size) {
+    if (ctx->reader.read(outBuf, size)) return true;
+    result = ctx->readFailed ? Error::READ_ERROR : Error::CORRUPT;
+    return false;
+  };
+  const auto emit = [&](const size_t size) {
+    sha.update(outBuf, size);
+    if (!target(outBuf, size)) {
+      result = Error::WRITE_ERROR;
+      return false;
+    }
+    written += size;
+    if (progress) {
+      progress(written, head.targetSize);
+    }
+    return true;
+  };
+
+  while (result == Error::OK && written < head.targetSize) {
+    uint64_t addSize;
+    uint64_t insertSize;
+    uint64_t seek;
+    if (!readVarint(*ctx, addSize) || !readVarint(*ctx, insertSize) || !readVarint(*ctx, seek)) {
+      result = ctx->readFailed ? Error::READ_ERROR : Error::CORRUPT;
+      break;
+    }
+    if (addSize > head.targetSize - written || insertSize > head.targetSize - written - addSize ||
+        (addSize > 0 && (sourcePos < 0 || static_cast<uint64_t>(sourcePos) + addSize > head.sourceSize))) {
+      LOG_ERR("DPATCH", "Record at %zu points outside the images", written);
+      result = Error::CORRUPT;
+      break;
+    }
+
+    while (result == Error::OK && addSize > 0) {
+      const size_t size = addSize < CHUNK_SIZE ? addSize : CHUNK_SIZE;
+      if (!source(sourcePos, sourceBuf, size)) {
+        result = Error::READ_ERROR;
+        break;
+      }
+      if (!inflate(size)) break;
+      for (size_t i = 0; i < size; i++) {
+        outBuf[i] += sourceBuf[i];
+      }
+      if (!emit(size)) break;
+      sourcePos += size;
+      addSize -= size;
+    }
+
+    while (result == Error::OK && insertSize > 0) {
+      const size_t size = insertSize < CHUNK_SIZE ? insertSize : CHUNK_SIZE;
+      if (!inflate(size) || !emit(size)) break;
+      insertSize -= size;
+    }
+
+    // Zigzag: the low bit is the sign
+    sourcePos += static_cast<int64_t>(seek >> 1) ^ -static_cast<int64_t>(seek & 1);
+  }
+
+  delete ctx;
+  free(sourceBuf);
+  free(outBuf);
+  if (result != Error::OK) {
+    return result;
+  }
+
+  uint8_t hash[HASH_SIZE];
+  sha.finish(hash);
+  if (memcmp(hash, head.targetHash, HASH_SIZE) != 0) {
+    LOG_ERR("DPATCH", "Rebuilt image doesn't match the patch target");
+    return Error::TARGET_MISMATCH;
+  }
+  return Error::OK;
+}
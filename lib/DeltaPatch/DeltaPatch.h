@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+
+/**
+ * Streaming applier for delta firmware patches made by scripts/make_delta_patch.py.
+ *
+ * A patch rebuilds the new image from the running one. It starts with a fixed header:
+ *
+ *   0   "CPDP", version (1), 3 reserved bytes
+ *   8   source size, target size (u32 little endian)
+ *   16  SHA-256 of the source image, SHA-256 of the target image
+ *   80  signature length (u16), then the signature of SHA-256(header bytes 0-79)
+ *
+ * and continues with a raw deflate stream of bsdiff-style records: varint add length, varint insert length,
+ * zigzag varint source seek, then the add bytes (added to the source bytes at the current source position) and
+ * the insert bytes (copied as they are).
+ *
+ * Memory use is the 32KB inflate window plus two small buffers, whatever the image size. The target hash is
+ * checked as the image is written, so a patch applied to the wrong source, or damaged in transit, is reported
+ * before anything switches partitions.
+ */
+class DeltaPatch {
+ public:
+  enum class Error {
+    OK,
+    BAD_HEADER,       // Not a patch, or an unsupported version
+    BAD_SIGNATURE,    // Unsigned, or the signature doesn't match the header
+    SOURCE_MISMATCH,  // The running image isn't the one the patch was made from
+    CORRUPT,          // Records point outside the images or the stream ends early
+    READ_ERROR,
+    WRITE_ERROR,
+    TARGET_MISMATCH,  // The rebuilt image doesn't hash to the expected value
+    NO_MEMORY,
+  };
+
+  static constexpr size_t HASH_SIZE = 32;
+  static constexpr size_t MAX_SIGNATURE_SIZE = 128;
+
+  struct Header {
+    uint32_t sourceSize = 0;
+    uint32_t targetSize = 0;
+    uint8_t sourceHash[HASH_SIZE] = {};
+    uint8_t targetHash[HASH_SIZE] = {};
+    uint8_t digest[HASH_SIZE] = {};  // SHA-256 of the signed header bytes
+    uint16_t signatureSize = 0;
+    uint8_t signature[MAX_SIGNATURE_SIZE] = {};
+  };
+
+  // Next bytes of the patch file: count read, 0 at the end, negative on error
+  using PatchReader = std::function<int(uint8_t* buffer, size_t size)>;
+  // `size` bytes of the running image from `offset`
+  using SourceReader = std::function<bool(size_t offset, uint8_t* buffer, size_t size)>;
+  // Next bytes of the new image
+  using TargetWriter = std::function<bool(const uint8_t* data, size_t size)>;
+  // True if `signature` signs `digest`
+  using SignatureCheck = std::function<bool(const uint8_t* digest, const uint8_t* signature, size_t size)>;
+  using ProgressCallback = std::function<void(size_t written, size_t total)>;
+
+  explicit DeltaPatch(PatchReader patch) : patch(std::move(patch)) {}
+
+  // Read the header and check its signature. Must be called first.
+  Error begin(const SignatureCheck& checkSignature);
+  const Header& header() const { return head; }
+
+  // Hash the first `header().sourceSize` bytes of the running image against the patch
+  Error checkSource(const SourceReader& source) const;
+
+  // Rebuild the target image into `target`. OK only if every byte was written and the image hashes as expected.
+  Error apply(const SourceReader& source, const TargetWriter& target, const ProgressCallback& progress = nullptr);
+
+ private:
+  PatchReader patch;
+  Header head;
+};
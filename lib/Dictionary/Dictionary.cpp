@@ -0,0 +1,842 @@
+#include "Dictionary.h"
+
+#include <Arduino.h>
+#include <InflateReader.h>
+#include <Logging.h>
+#include <Utf8.h>
+#include <esp_task_wdt.h>
+
+#include <algorithm>
+#include <cstring>
+
+struct ChunkInflateCtx {
+  InflateReader reader;  // Must be first — callback casts uzlib_uncomp* to ChunkInflateCtx*
+  FsFile* file = nullptr;
+  uint32_t fileRemaining = 0;
+  uint8_t readBuf[256] = {};
+};
+
+namespace {
+constexpr char DICTIONARY_DIR[] = "/dictionaries";
+constexpr char CACHE_DIR[] = "/.crosspoint/dictionaries";
+constexpr uint32_t SAMPLE_MAGIC = 0x504D5344;  // "DSMP"
+constexpr uint8_t SAMPLE_VERSION = 1;
+
+// Every SAMPLE_INTERVAL-th headword's .idx offset goes into the sample file, every KEY_INTERVAL-th sample's headword
+// into RAM
+constexpr uint32_t SAMPLE_INTERVAL = 32;
+constexpr uint32_t KEY_INTERVAL = 64;
+constexpr size_t MAX_HEADWORD_BYTES = 256;
+constexpr size_t MAX_DEFINITION_BYTES = 4096;
+constexpr size_t IO_BUFFER_SIZE = 512;
+
+struct SampleHeader {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t offsetBytes;
+  uint16_t reserved;
+  uint32_t idxSize;
+  uint32_t entryCount;
+  uint32_t sampleCount;
+  uint32_t keyCount;
+  uint32_t keyBytes;
+};
+
+void feedWatchdog() {
+  yield();
+  esp_task_wdt_reset();
+}
+
+// g_ascii_strcasecmp, the first key of StarDict's order
+int asciiCaseCompare(const char* a, const char* b) {
+  while (true) {
+    auto ca = static_cast<uint8_t>(*a++);
+    auto cb = static_cast<uint8_t>(*b++);
+    if (ca >= 'A' && ca <= 'Z') ca += 'a' - 'A';
+    if (cb >= 'A' && cb <= 'Z') cb += 'a' - 'A';
+    if (ca != cb || ca == 0) return ca - cb;
+  }
+}
+
+uint32_t readBigEndian(const uint8_t* bytes, const int count) {
+  uint32_t value = 0;
+  for (int i = 0; i < count; i++) value = (value << 8) | bytes[i];
+  return value;
+}
+
+// Sequential reader of .idx entries: NUL-terminated headword, big-endian offset (4 or 8 bytes) and size
+class IdxReader {
+  FsFile& file;
+  uint8_t buffer[IO_BUFFER_SIZE];
+  size_t pos = 0;
+  size_t filled = 0;
+  uint32_t bufferStart = 0;
+
+  bool nextByte(uint8_t& byte) {
+    if (pos == filled) {
+      bufferStart += filled;
+      const int got = file.read(buffer, sizeof(buffer));
+      if (got <= 0) return false;
+      filled = static_cast<size_t>(got);
+      pos = 0;
+    }
+    byte = buffer[pos++];
+    return true;
+  }
+
+ public:
+  IdxReader(FsFile& file, const uint32_t start) : file(file), bufferStart(start) { file.seekSet(start); }
+
+  uint32_t position() const { return bufferStart + pos; }
+
+  bool next(const uint8_t offsetBytes, std::string& word, uint64_t& offset, uint32_t& size) {
+    word.clear();
+    uint8_t byte;
+    while (true) {
+      if (!nextByte(byte)) return false;
+      if (byte == 0) break;
+      if (word.size() >= MAX_HEADWORD_BYTES) return false;
+      word += static_cast<char>(byte);
+    }
+    uint8_t tail[12];
+    for (int i = 0; i < offsetBytes + 4; i++) {
+      if (!nextByte(tail[i])) return false;
+    }
+    offset = offsetBytes == 8 ? (static_cast<uint64_t>(readBigEndian(tail, 4)) << 32) | readBigEndian(tail + 4, 4)
+                              : readBigEndian(tail, 4);
+    size = readBigEndian(tail + offsetBytes, 4);
+    return true;
+  }
+};
+
+// Headword at `offset` of the .idx file
+bool readHeadword(FsFile& idx, const uint32_t offset, char (&word)[MAX_HEADWORD_BYTES + 1]) {
+  if (!idx.seekSet(offset)) return false;
+  const int got = idx.read(word, MAX_HEADWORD_BYTES);
+  if (got <= 0) return false;
+  word[got] = '\0';
+  return strlen(word) < static_cast<size_t>(got);
+}
+
+int dictzipReadCallback(uzlib_uncomp* uncomp) {
+  auto* ctx = reinterpret_cast<ChunkInflateCtx*>(uncomp);
+  if (ctx->fileRemaining == 0) return -1;
+
+  const size_t toRead = std::min<size_t>(ctx->fileRemaining, sizeof(ctx->readBuf));
+  const int bytesRead = ctx->file->read(ctx->readBuf, toRead);
+  if (bytesRead <= 0) return -1;
+  ctx->fileRemaining -= bytesRead;
+
+  uncomp->source = ctx->readBuf + 1;
+  uncomp->source_limit = ctx->readBuf + bytesRead;
+  return ctx->readBuf[0];
+}
+
+void appendUtf8(std::string& out, const uint32_t cp) {
+  if (cp < 0x80) {
+    out += static_cast<char>(cp);
+  } else if (cp < 0x800) {
+    out += static_cast<char>(0xC0 | (cp >> 6));
+    out += static_cast<char>(0x80 | (cp & 0x3F));
+  } else if (cp < 0x10000) {
+    out += static_cast<char>(0xE0 | (cp >> 12));
+    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (cp & 0x3F));
+  } else {
+    out += static_cast<char>(0xF0 | (cp >> 18));
+    out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (cp & 0x3F));
+  }
+}
+
+// HTML, Pango and XDXF markup to text: tags dropped, block tags turned into line breaks, entities decoded
+std::string stripMarkup(const std::string& markup) {
+  static const char* const BREAK_TAGS[] = {"br", "p", "div", "li", "tr", "h1", "h2", "h3", "h4", "blockquote", "def"};
+  std::string text;
+  bool space = false;
+  for (size_t i = 0; i < markup.size(); i++) {
+    const char c = markup[i];
+    if (c == '<') {
+      const size_t end = markup.find('>', i);
+      if (end == std::string::npos) break;
+      size_t nameStart = i + 1;
+      if (nameStart < end && markup[nameStart] == '/') nameStart++;
+      size_t nameEnd = nameStart;
+      while (nameEnd < end && isalnum(static_cast<unsigned char>(markup[nameEnd]))) nameEnd++;
+      const std::string name = markup.substr(nameStart, nameEnd - nameStart);
+      for (const char* tag : BREAK_TAGS) {
+        if (strcasecmp(name.c_str(), tag) == 0) {
+          if (!text.empty() && text.back() != '\n') text += '\n';
+          space = false;
+          break;
+        }
+      }
+      i = end;
+      continue;
+    }
+    if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+      space = !text.empty() && text.back() != '\n';
+      continue;
+    }
+    if (space) {
+      text += ' ';
+      space = false;
+    }
+    if (c == '&') {
+      const size_t end = markup.find(';', i);
+      if (end != std::string::npos && end - i <= 10) {
+        const std::string entity = markup.substr(i + 1, end - i - 1);
+        uint32_t cp = 0;
+        if (entity == "amp") cp = '&';
+        else if (entity == "lt") cp = '<';
+        else if (entity == "gt") cp = '>';
+        else if (entity == "quot") cp = '"';
+        else if (entity == "apos") cp = '\'';
+        else if (entity == "nbsp") cp = ' ';
+        else if (entity.size() > 1 && entity[0] == '#') {
+          cp = entity[1] == 'x' || entity[1] == 'X' ? strtoul(entity.c_str() + 2, nullptr, 16)
+                                                    : strtoul(entity.c_str() + 1, nullptr, 10);
+        }
+        if (cp != 0) {
+          appendUtf8(text, cp);
+          i = end;
+          continue;
+        }
+      }
+    }
+    text += c;
+  }
+  while (!text.empty() && text.back() == '\n') text.pop_back();
+  return text;
+}
+
+// Lower case for the Latin, Greek and Cyrillic letters books use
+uint32_t toLower(const uint32_t cp) {
+  if (cp >= 'A' && cp <= 'Z') return cp + 0x20;
+  if ((cp >= 0xC0 && cp <= 0xDE) && cp != 0xD7) return cp + 0x20;
+  if (cp >= 0x100 && cp <= 0x17F) {
+    if ((cp >= 0x139 && cp <= 0x148) || (cp >= 0x179 && cp <= 0x17E)) return cp % 2 == 1 ? cp + 1 : cp;
+    if (cp == 0x178) return 0xFF;
+    if (cp != 0x130 && cp != 0x138 && cp != 0x149 && cp != 0x17F) return cp % 2 == 0 ? cp + 1 : cp;
+    return cp;
+  }
+  if (cp >= 0x391 && cp <= 0x3A9 && cp != 0x3A2) return cp + 0x20;
+  if (cp >= 0x410 && cp <= 0x42F) return cp + 0x20;
+  if (cp >= 0x400 && cp <= 0x40F) return cp + 0x50;
+  return cp;
+}
+
+std::string lowerCase(const std::string& word) {
+  std::string lower;
+  const auto* p = reinterpret_cast<const unsigned char*>(word.c_str());
+  while (*p) appendUtf8(lower, toLower(utf8NextCodepoint(&p)));
+  return lower;
+}
+
+bool isWordCodepoint(const uint32_t cp) {
+  if (cp < 0x80) return isalnum(static_cast<int>(cp)) || cp == '\'' || cp == '-';
+  // Latin-1 punctuation, general punctuation, CJK punctuation
+  return !(cp < 0xC0 || cp == 0xD7 || cp == 0xF7 || (cp >= 0x2000 && cp <= 0x206F) || (cp >= 0x3000 && cp <= 0x303F));
+}
+
+// Inflection that the lookup undoes: the word ends in `suffix`, with at least `minStem` bytes before it, and the
+// headword ends in `replacement` instead
+struct SuffixRule {
+  const char* suffix;
+  const char* replacement;
+  uint8_t minStem;
+};
+
+// Most specific rules first; the base form is usually found by one of the first few
+const SuffixRule ENGLISH_RULES[] = {
+    {"ies", "y", 2}, {"ied", "y", 2}, {"ier", "y", 2}, {"iest", "y", 2}, {"ily", "y", 2}, {"ves", "f", 2},
+    {"ves", "fe", 2}, {"ing", "", 2}, {"ing", "e", 2}, {"ed", "", 2}, {"ed", "e", 2}, {"es", "", 2},
+    {"s", "", 2}, {"er", "", 2}, {"er", "e", 2}, {"est", "", 2}, {"est", "e", 2}, {"ly", "", 3},
+    {"ness", "", 3}, {"ment", "", 3}, {"", "", 0}};
+const SuffixRule GERMAN_RULES[] = {{"ern", "", 3}, {"em", "", 3},  {"en", "", 3}, {"er", "", 3}, {"es", "", 3},
+                                   {"est", "", 3}, {"st", "", 3},  {"e", "", 3},  {"n", "", 3},  {"s", "", 3},
+                                   {"t", "en", 3}, {"te", "en", 3}, {"", "", 0}};
+const SuffixRule FRENCH_RULES[] = {{"eaux", "eau", 2}, {"aux", "al", 2}, {"ées", "er", 2}, {"és", "er", 2},
+                                   {"ée", "er", 2},    {"é", "er", 2},   {"ait", "er", 2}, {"aient", "er", 2},
+                                   {"ent", "er", 2},   {"es", "", 2},    {"es", "e", 2},   {"s", "", 2},
+                                   {"x", "", 2},       {"e", "", 2},     {"", "", 0}};
+const SuffixRule SPANISH_RULES[] = {{"ces", "z", 2}, {"es", "", 2},   {"s", "", 2},    {"as", "o", 2},
+                                    {"a", "o", 2},   {"ando", "ar", 2}, {"iendo", "er", 2}, {"iendo", "ir", 2},
+                                    {"ado", "ar", 2}, {"ido", "er", 2}, {"ido", "ir", 2}, {"", "", 0}};
+const SuffixRule ITALIAN_RULES[] = {{"i", "o", 2}, {"i", "e", 2}, {"e", "a", 2}, {"he", "a", 2}, {"hi", "o", 2},
+                                    {"ando", "are", 2}, {"endo", "ere", 2}, {"ato", "are", 2}, {"", "", 0}};
+const SuffixRule PORTUGUESE_RULES[] = {{"ões", "ão", 2}, {"ães", "ão", 2}, {"ns", "m", 2}, {"is", "l", 2},
+                                       {"es", "", 2},     {"s", "", 2},     {"a", "o", 2},  {"as", "o", 2},
+                                       {"ando", "ar", 2}, {"ado", "ar", 2}, {"", "", 0}};
+
+struct LanguageRules {
+  const char* language;
+  const SuffixRule* rules;
+};
+const LanguageRules LANGUAGE_RULES[] = {{"en", ENGLISH_RULES}, {"de", GERMAN_RULES},  {"fr", FRENCH_RULES},
+                                        {"es", SPANISH_RULES}, {"it", ITALIAN_RULES}, {"pt", PORTUGUESE_RULES}};
+
+bool endsWith(const std::string& word, const char* suffix) {
+  const size_t length = strlen(suffix);
+  return word.size() >= length && word.compare(word.size() - length, length, suffix) == 0;
+}
+
+bool isVowel(const char c) { return strchr("aeiouy", c) != nullptr; }
+}  // namespace
+
+int StarDict::compare(const char* a, const char* b) {
+  const int order = asciiCaseCompare(a, b);
+  return order != 0 ? order : strcmp(a, b);
+}
+
+bool StarDict::readInfo() {
+  FsFile file;
+  if (!Storage.openFileForRead("DIC", basePath + ".ifo", file)) {
+    return false;
+  }
+  char buffer[2048];
+  const int got = file.read(buffer, sizeof(buffer) - 1);
+  file.close();
+  if (got <= 0) {
+    return false;
+  }
+  buffer[got] = '\0';
+  if (strncmp(buffer, "StarDict's dict ifo file", 24) != 0) {
+    LOG_ERR("DIC", "%s.ifo is not a StarDict info file", basePath.c_str());
+    return false;
+  }
+
+  name = basePath.substr(basePath.find_last_of('/') + 1);
+  for (char* line = strtok(buffer, "\r\n"); line; line = strtok(nullptr, "\r\n")) {
+    char* value = strchr(line, '=');
+    if (!value) continue;
+    *value++ = '\0';
+    if (strcmp(line, "bookname") == 0) {
+      name = value;
+    } else if (strcmp(line, "wordcount") == 0) {
+      wordCount = strtoul(value, nullptr, 10);
+    } else if (strcmp(line, "idxfilesize") == 0) {
+      idxSize = strtoul(value, nullptr, 10);
+    } else if (strcmp(line, "sametypesequence") == 0) {
+      sameTypeSequence = value;
+    } else if (strcmp(line, "idxoffsetbits") == 0) {
+      offsetBytes = strcmp(value, "64") == 0 ? 8 : 4;
+    }
+  }
+  return true;
+}
+
+bool StarDict::openData() {
+  if (Storage.exists((basePath + ".dict").c_str())) {
+    dataPath = basePath + ".dict";
+    dictzip = false;
+    return true;
+  }
+  dataPath = basePath + ".dict.dz";
+  dictzip = true;
+
+  // gzip header with the dictzip random access field (RA): chunk length, then the compressed size of each chunk
+  FsFile file;
+  if (!Storage.openFileForRead("DIC", dataPath, file)) {
+    LOG_ERR("DIC", "No .dict or .dict.dz file for %s", basePath.c_str());
+    return false;
+  }
+  uint8_t header[12];
+  if (file.read(header, sizeof(header)) != sizeof(header) || header[0] != 0x1F || header[1] != 0x8B ||
+      header[2] != 8 || !(header[3] & 0x04)) {
+    LOG_ERR("DIC", "%s is not dictzip compressed", dataPath.c_str());
+    file.close();
+    return false;
+  }
+  const uint8_t flags = header[3];
+  const uint16_t extraLength = header[10] | (header[11] << 8);
+  std::vector<uint8_t> extra(extraLength);
+  if (file.read(extra.data(), extraLength) != extraLength) {
+    file.close();
+    return false;
+  }
+  for (size_t pos = 0; pos + 4 <= extra.size();) {
+    const uint16_t fieldLength = extra[pos + 2] | (extra[pos + 3] << 8);
+    if (extra[pos] == 'R' && extra[pos + 1] == 'A' && fieldLength >= 6 && pos + 4 + fieldLength <= extra.size()) {
+      const uint8_t* field = extra.data() + pos + 4;
+      chunkLength = field[2] | (field[3] << 8);
+      const uint16_t chunkCount = field[4] | (field[5] << 8);
+      if (6u + chunkCount * 2u > fieldLength) break;
+      chunkOffsets.resize(chunkCount + 1);
+      for (uint16_t i = 0; i < chunkCount; i++) {
+        chunkOffsets[i + 1] = chunkOffsets[i] + (field[6 + i * 2] | (field[7 + i * 2] << 8));
+      }
+      break;
+    }
+    pos += 4 + fieldLength;
+  }
+  // Optional file name, comment and header CRC come before the data
+  for (const uint8_t flag : {0x08, 0x10}) {
+    if (flags & flag) {
+      int c;
+      do {
+        c = file.read();
+      } while (c > 0);
+    }
+  }
+  if (flags & 0x02) {
+    uint8_t crc[2];
+    file.read(crc, sizeof(crc));
+  }
+  const auto dataStart = static_cast<uint32_t>(file.position());
+  file.close();
+
+  if (chunkOffsets.empty() || chunkLength == 0) {
+    LOG_ERR("DIC", "%s has no dictzip chunk table", dataPath.c_str());
+    return false;
+  }
+  for (auto& offset : chunkOffsets) offset += dataStart;
+  return true;
+}
+
+bool StarDict::open(const std::string& cacheDir, const std::function<void()>& building) {
+  if (!readInfo() || !openData()) {
+    return false;
+  }
+  FsFile idx;
+  if (!Storage.openFileForRead("DIC", basePath + ".idx", idx)) {
+    LOG_ERR("DIC", "No .idx file for %s (compressed .idx.gz is not supported)", basePath.c_str());
+    return false;
+  }
+  idxSize = static_cast<uint32_t>(idx.size());
+  idx.close();
+
+  samplePath = cacheDir + "/" + std::to_string(std::hash<std::string>{}(basePath)) + ".smp";
+  if (loadSample()) {
+    return true;
+  }
+  if (building) building();
+  Storage.mkdir(cacheDir.c_str());
+  return buildSample() && loadSample();
+}
+
+bool StarDict::loadSample() {
+  FsFile file;
+  if (!Storage.exists(samplePath.c_str()) || !Storage.openFileForRead("DIC", samplePath, file)) {
+    return false;
+  }
+  SampleHeader header = {};
+  bool ok = file.read(&header, sizeof(header)) == sizeof(header) && header.magic == SAMPLE_MAGIC &&
+            header.version == SAMPLE_VERSION && header.idxSize == idxSize && header.offsetBytes == offsetBytes &&
+            header.keyCount == (header.sampleCount + KEY_INTERVAL - 1) / KEY_INTERVAL;
+  if (ok) {
+    keyStarts.resize(header.keyCount);
+    keys.resize(header.keyBytes);
+    const size_t startsBytes = header.keyCount * sizeof(uint32_t);
+    ok = file.seekSet(sizeof(header) + header.sampleCount * sizeof(uint32_t)) &&
+         file.read(keyStarts.data(), startsBytes) == static_cast<int>(startsBytes) &&
+         file.read(keys.data(), header.keyBytes) == static_cast<int>(header.keyBytes);
+    sampleCount = header.sampleCount;
+  }
+  file.close();
+  if (!ok) {
+    keyStarts.clear();
+    keys.clear();
+    sampleCount = 0;
+  }
+  return ok;
+}
+
+bool StarDict::buildSample() {
+  FsFile idx;
+  FsFile out;
+  const std::string tempPath = samplePath + ".tmp";
+  if (!Storage.openFileForRead("DIC", basePath + ".idx", idx) ||
+      !Storage.openFileForWrite("DIC", tempPath, out)) {
+    return false;
+  }
+
+  SampleHeader header = {};
+  out.write(&header, sizeof(header));
+  keyStarts.clear();
+  keys.clear();
+
+  IdxReader reader(idx, 0);
+  std::vector<uint32_t> pending;
+  pending.reserve(IO_BUFFER_SIZE / sizeof(uint32_t));
+  std::string word;
+  std::string previous;
+  uint64_t offset;
+  uint32_t size;
+  uint32_t entries = 0;
+  bool ok = true;
+  while (ok) {
+    const uint32_t entryOffset = reader.position();
+    if (entryOffset >= idxSize || !reader.next(offsetBytes, word, offset, size)) break;
+    if (entries > 0 && compare(previous.c_str(), word.c_str()) > 0) {
+      LOG_ERR("DIC", "%s.idx is not sorted at '%s'", basePath.c_str(), word.c_str());
+      ok = false;
+      break;
+    }
+    if (entries % SAMPLE_INTERVAL == 0) {
+      if (header.sampleCount % KEY_INTERVAL == 0) {
+        keyStarts.push_back(static_cast<uint32_t>(keys.size()));
+        keys.append(word.c_str(), word.size() + 1);
+      }
+      pending.push_back(entryOffset);
+      header.sampleCount++;
+      if (pending.size() == pending.capacity()) {
+        ok = out.write(pending.data(), pending.size() * sizeof(uint32_t)) == pending.size() * sizeof(uint32_t);
+        pending.clear();
+      }
+    }
+    previous = word;
+    if (++entries % 1024 == 0) feedWatchdog();
+  }
+  ok = ok && out.write(pending.data(), pending.size() * sizeof(uint32_t)) == pending.size() * sizeof(uint32_t) &&
+       out.write(keyStarts.data(), keyStarts.size() * sizeof(uint32_t)) == keyStarts.size() * sizeof(uint32_t) &&
+       out.write(keys.data(), keys.size()) == keys.size();
+  idx.close();
+
+  header.magic = SAMPLE_MAGIC;
+  header.version = SAMPLE_VERSION;
+  header.offsetBytes = offsetBytes;
+  header.idxSize = idxSize;
+  header.entryCount = entries;
+  header.keyCount = static_cast<uint32_t>(keyStarts.size());
+  header.keyBytes = static_cast<uint32_t>(keys.size());
+  ok = ok && entries > 0 && out.seekSet(0) && out.write(&header, sizeof(header)) == sizeof(header);
+  out.close();
+  keyStarts.clear();
+  keys.clear();
+
+  if (!ok) {
+    Storage.remove(tempPath.c_str());
+    return false;
+  }
+  if (wordCount != 0 && wordCount != entries) {
+    LOG_DBG("DIC", "%s: .ifo says %u words, .idx has %u", basePath.c_str(), wordCount, entries);
+  }
+  Storage.remove(samplePath.c_str());
+  Storage.rename(tempPath.c_str(), samplePath.c_str());
+  LOG_DBG("DIC", "Sampled %u headwords of %s", entries, name.c_str());
+  return true;
+}
+
+bool StarDict::lookup(const std::string& word, Entry& entry) const {
+  if (word.empty() || word.size() > MAX_HEADWORD_BYTES || keyStarts.empty()) {
+    return false;
+  }
+  const char* target = word.c_str();
+
+  // RAM keys: the run of samples that starts at or before the word
+  size_t low = 0;
+  size_t high = keyStarts.size();
+  while (low < high) {
+    const size_t mid = (low + high) / 2;
+    if (asciiCaseCompare(keys.c_str() + keyStarts[mid], target) < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  const uint32_t first = static_cast<uint32_t>(low > 0 ? low - 1 : 0) * KEY_INTERVAL;
+  const uint32_t count = std::min(KEY_INTERVAL, sampleCount - first);
+
+  FsFile sample;
+  uint32_t offsets[KEY_INTERVAL];
+  if (!Storage.openFileForRead("DIC", samplePath, sample)) {
+    return false;
+  }
+  const bool read = sample.seekSet(sizeof(SampleHeader) + first * sizeof(uint32_t)) &&
+                    sample.read(offsets, count * sizeof(uint32_t)) == static_cast<int>(count * sizeof(uint32_t));
+  sample.close();
+  if (!read) {
+    return false;
+  }
+
+  // Sample headwords from the card: the last sample before the word. The run's first sample is its RAM key, already
+  // known to come before the word unless the word precedes the whole dictionary.
+  FsFile idx;
+  if (!Storage.openFileForRead("DIC", basePath + ".idx", idx)) {
+    return false;
+  }
+  char headword[MAX_HEADWORD_BYTES + 1];
+  low = 1;
+  high = count;
+  while (low < high) {
+    const size_t mid = (low + high) / 2;
+    if (!readHeadword(idx, offsets[mid], headword)) {
+      idx.close();
+      return false;
+    }
+    if (asciiCaseCompare(headword, target) < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  // Entries from there on: case variants of the word sit next to each other
+  IdxReader reader(idx, offsets[low - 1]);
+  std::string candidate;
+  uint64_t offset = 0;
+  uint32_t size = 0;
+  bool found = false;
+  uint64_t foundOffset = 0;
+  uint32_t foundSize = 0;
+  for (uint32_t scanned = 0; scanned < SAMPLE_INTERVAL * 4 && reader.position() < idxSize; scanned++) {
+    if (!reader.next(offsetBytes, candidate, offset, size)) break;
+    const int order = asciiCaseCompare(candidate.c_str(), target);
+    if (order < 0) continue;
+    if (order > 0) break;
+    if (!found || candidate == word) {
+      found = true;
+      entry.headword = candidate;
+      foundOffset = offset;
+      foundSize = size;
+      if (candidate == word) break;
+    }
+  }
+  idx.close();
+
+  return found && readDefinition(foundOffset, foundSize, entry.definition);
+}
+
+bool StarDict::readDefinition(const uint64_t offset, uint32_t size, std::string& out) const {
+  size = std::min<uint32_t>(size, MAX_DEFINITION_BYTES);
+  std::string data;
+  if (dictzip) {
+    if (!readCompressed(offset, size, data)) {
+      return false;
+    }
+  } else {
+    FsFile file;
+    if (!Storage.openFileForRead("DIC", dataPath, file)) {
+      return false;
+    }
+    data.resize(size);
+    const bool ok = file.seekSet(offset) && file.read(data.data(), size) == static_cast<int>(size);
+    file.close();
+    if (!ok) {
+      return false;
+    }
+  }
+  out = toText(data);
+  out.resize(utf8SafeTruncateBuffer(out.data(), static_cast<int>(out.size())));
+  return true;
+}
+
+bool StarDict::readCompressed(const uint64_t offset, const uint32_t size, std::string& out) const {
+  FsFile file;
+  if (!Storage.openFileForRead("DIC", dataPath, file)) {
+    return false;
+  }
+  out.clear();
+  out.reserve(size);
+  ChunkInflateCtx ctx;
+  ctx.file = &file;
+  uint8_t buffer[IO_BUFFER_SIZE];
+
+  // Chunks are compressed independently, so reading starts at the chunk holding the definition
+  size_t chunk = offset / chunkLength;
+  uint32_t skip = offset % chunkLength;
+  bool ok = true;
+  while (ok && out.size() < size) {
+    if (chunk + 1 >= chunkOffsets.size() || !ctx.reader.init(true) || !file.seekSet(chunkOffsets[chunk])) {
+      ok = false;
+      break;
+    }
+    ctx.fileRemaining = chunkOffsets[chunk + 1] - chunkOffsets[chunk];
+    ctx.reader.setReadCallback(dictzipReadCallback);
+    uint32_t produced = 0;
+    while (out.size() < size && produced < chunkLength) {
+      // Never ask past the chunk's end: the inflater would read on into the next chunk's blocks
+      const size_t want = std::min<size_t>({sizeof(buffer), chunkLength - produced, skip + size - out.size()});
+      size_t got = 0;
+      const InflateStatus status = ctx.reader.readAtMost(buffer, want, &got);
+      if (status == InflateStatus::Error) {
+        ok = false;
+        break;
+      }
+      const uint32_t skipped = std::min<uint32_t>(skip, got);
+      out.append(reinterpret_cast<const char*>(buffer) + skipped, got - skipped);
+      skip -= skipped;
+      produced += got;
+      if (status == InflateStatus::Done || got == 0) break;
+    }
+    chunk++;
+    if (produced < chunkLength) break;
+  }
+  ctx.reader.deinit();
+  file.close();
+  if (!ok) {
+    LOG_ERR("DIC", "Failed to inflate %s at %llu", dataPath.c_str(), static_cast<unsigned long long>(offset));
+  }
+  return ok && out.size() == size;
+}
+
+std::string StarDict::toText(const std::string& data) const {
+  // Fields are typed by a letter: lower case ones are text ending in NUL, upper case ones binary with a size. With a
+  // sametypesequence the letters are left out, and so is the terminator or size of the last field.
+  std::string text;
+  size_t pos = 0;
+  for (size_t field = 0; pos < data.size(); field++) {
+    char type;
+    if (!sameTypeSequence.empty()) {
+      if (field >= sameTypeSequence.size()) break;
+      type = sameTypeSequence[field];
+    } else {
+      type = data[pos++];
+    }
+    const bool last = !sameTypeSequence.empty() && field + 1 == sameTypeSequence.size();
+    size_t length;
+    if (last) {
+      length = data.size() - pos;
+    } else if (islower(static_cast<unsigned char>(type))) {
+      const size_t end = data.find('\0', pos);
+      length = (end == std::string::npos ? data.size() : end) - pos;
+    } else {
+      if (pos + 4 > data.size()) break;
+      length = readBigEndian(reinterpret_cast<const uint8_t*>(data.data()) + pos, 4);
+      pos += 4;
+    }
+    length = std::min(length, data.size() - pos);
+    const std::string value = data.substr(pos, length);
+    pos += length + (islower(static_cast<unsigned char>(type)) && !last ? 1 : 0);
+
+    std::string part;
+    switch (type) {
+      case 'm':  // plain text
+      case 'l':  // plain text in the locale's encoding, UTF-8 in practice
+      case 'y':  // readings
+        part = value;
+        break;
+      case 't':  // phonetics
+        part = "[" + value + "]";
+        break;
+      case 'g':  // Pango markup
+      case 'h':  // HTML
+      case 'x':  // XDXF
+      case 'k':  // KingSoft XML
+      case 'w':  // MediaWiki
+        part = stripMarkup(value);
+        break;
+      default:  // pictures, sounds and other binary fields
+        break;
+    }
+    if (!part.empty()) {
+      if (!text.empty()) text += '\n';
+      text += part;
+    }
+  }
+  return text;
+}
+
+bool Dictionary::open(const std::function<void(const std::string&)>& progress) {
+  dictionaries.clear();
+  FsFile dir = Storage.open(DICTIONARY_DIR);
+  if (!dir || !dir.isDirectory()) {
+    return false;
+  }
+  std::vector<std::string> names;
+  char name[256];
+  for (FsFile file = dir.openNextFile(); file; file = dir.openNextFile()) {
+    file.getName(name, sizeof(name));
+    const std::string fileName = name;
+    file.close();
+    if (fileName[0] != '.' && fileName.size() > 4 && fileName.compare(fileName.size() - 4, 4, ".ifo") == 0) {
+      names.push_back(fileName.substr(0, fileName.size() - 4));
+    }
+  }
+  dir.close();
+  std::sort(names.begin(), names.end());
+
+  for (const auto& baseName : names) {
+    auto dictionary = std::make_unique<StarDict>(std::string(DICTIONARY_DIR) + "/" + baseName);
+    if (dictionary->open(CACHE_DIR, [&progress, &baseName] {
+          if (progress) progress(baseName);
+        })) {
+      dictionaries.push_back(std::move(dictionary));
+    }
+    feedWatchdog();
+  }
+  return !dictionaries.empty();
+}
+
+bool Dictionary::lookup(const std::string& word, const std::string& language, Result& result) const {
+  const auto forms = candidates(word, language);
+  for (const auto& form : forms) {
+    for (const auto& dictionary : dictionaries) {
+      StarDict::Entry entry;
+      if (dictionary->lookup(form, entry)) {
+        result.headword = std::move(entry.headword);
+        result.definition = std::move(entry.definition);
+        result.dictionary = dictionary->getName();
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+std::vector<std::string> Dictionary::candidates(const std::string& word, const std::string& language) {
+  std::vector<std::string> forms;
+  const auto add = [&forms](const std::string& form) {
+    if (!form.empty() && std::find(forms.begin(), forms.end(), form) == forms.end()) forms.push_back(form);
+  };
+
+  // Drop surrounding punctuation and invisible break hints; curly apostrophes become straight ones
+  std::string cleaned;
+  const auto* p = reinterpret_cast<const unsigned char*>(word.c_str());
+  while (*p) {
+    uint32_t cp = utf8NextCodepoint(&p);
+    if (cp == 0x00AD || (cp >= 0x200B && cp <= 0x200D)) continue;
+    if (cp == 0x2019) cp = '\'';
+    if (!isWordCodepoint(cp)) {
+      if (!cleaned.empty()) cleaned += '\x01';  // inner punctuation, kept for now
+      continue;
+    }
+    appendUtf8(cleaned, cp);
+  }
+  while (!cleaned.empty() && (cleaned.back() == '\x01' || cleaned.back() == '\'' || cleaned.back() == '-')) {
+    cleaned.pop_back();
+  }
+  while (!cleaned.empty() && (cleaned.front() == '\'' || cleaned.front() == '-')) cleaned.erase(0, 1);
+  if (cleaned.find('\x01') != std::string::npos) {
+    // Punctuation inside a selection ("end.Next") splits it; the first part is meant
+    cleaned.erase(cleaned.find('\x01'));
+  }
+  if (cleaned.empty()) {
+    return forms;
+  }
+
+  const std::string lang = lowerCase(language.substr(0, 2));
+  std::vector<std::string> bases = {cleaned};
+  // Elided articles and pronouns (l'homme, dell'arte) and English possessives
+  const size_t apostrophe = cleaned.find('\'');
+  if (apostrophe != std::string::npos) {
+    if ((lang == "fr" || lang == "it") && apostrophe <= 4) bases.push_back(cleaned.substr(apostrophe + 1));
+    if (endsWith(cleaned, "'s")) bases.push_back(cleaned.substr(0, cleaned.size() - 2));
+  }
+  for (const auto& base : bases) {
+    add(base);
+    add(lowerCase(base));
+  }
+
+  const SuffixRule* rules = nullptr;
+  for (const auto& entry : LANGUAGE_RULES) {
+    if (lang == entry.language) rules = entry.rules;
+  }
+  if (!rules) {
+    return forms;
+  }
+  const std::string lower = lowerCase(bases.back());
+  for (const SuffixRule* rule = rules; rule->suffix[0] != '\0'; rule++) {
+    if (!endsWith(lower, rule->suffix) || lower.size() < strlen(rule->suffix) + rule->minStem) continue;
+    const std::string stem = lower.substr(0, lower.size() - strlen(rule->suffix));
+    add(stem + rule->replacement);
+    // English doubles a final consonant before -ing, -ed, -er and -est: stopped, running, bigger
+    if (lang == "en" && rule->replacement[0] == '\0' && stem.size() >= 3 && stem.back() == stem[stem.size() - 2] &&
+        !isVowel(stem.back()) && strchr("lsz", stem.back()) == nullptr) {
+      add(stem.substr(0, stem.size() - 1));
+    }
+  }
+  return forms;
+}
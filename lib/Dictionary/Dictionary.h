@@ -0,0 +1,94 @@
+#pragma once
+
+#include <HalStorage.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// One StarDict dictionary: `<name>.ifo`, `<name>.idx` and `<name>.dict` or dictzip-compressed `<name>.dict.dz`.
+//
+// The .idx file lists the headwords in StarDict order (ASCII case-insensitive, then byte order), each with the offset
+// and size of its definition in the .dict file. Lookups never read it whole: a sample file in the cache directory holds
+// the .idx offset of every 32nd headword, and RAM holds every 64th of those samples' headwords. A lookup binary
+// searches the RAM keys, reads one run of 64 sample offsets, binary searches those by reading their headwords, and
+// scans at most 32 entries, so it costs about ten small reads whatever the size of the dictionary. The sample file is
+// written on first open by one pass over the .idx file.
+class StarDict {
+ public:
+  struct Entry {
+    std::string headword;
+    std::string definition;  // plain text; markup is reduced to line breaks
+  };
+
+  // `basePath` is the path of the files without extension
+  explicit StarDict(std::string basePath) : basePath(std::move(basePath)) {}
+  StarDict(const StarDict&) = delete;
+  StarDict& operator=(const StarDict&) = delete;
+
+  // Reads the .ifo file and loads the sample from `cacheDir`, building it if missing or stale. `building` is called
+  // before a sample is built.
+  bool open(const std::string& cacheDir, const std::function<void()>& building = nullptr);
+  const std::string& getName() const { return name; }
+  uint32_t getWordCount() const { return wordCount; }
+
+  // Case-insensitive for ASCII letters; an entry spelled exactly like `word` wins over other case variants
+  bool lookup(const std::string& word, Entry& entry) const;
+
+  // StarDict headword order
+  static int compare(const char* a, const char* b);
+
+ private:
+  std::string basePath;
+  std::string name;
+  std::string sameTypeSequence;
+  uint32_t wordCount = 0;
+  uint32_t idxSize = 0;
+  uint8_t offsetBytes = 4;  // 8 with idxoffsetbits=64
+
+  std::string samplePath;
+  uint32_t sampleCount = 0;
+  // Headword of every KEY_INTERVAL-th sample, NUL-terminated and packed
+  std::string keys;
+  std::vector<uint32_t> keyStarts;
+
+  std::string dataPath;
+  bool dictzip = false;
+  uint32_t chunkLength = 0;
+  std::vector<uint32_t> chunkOffsets;  // file offset of each compressed chunk, then of the data end
+
+  bool readInfo();
+  bool openData();
+  bool loadSample();
+  bool buildSample();
+  bool readDefinition(uint64_t offset, uint32_t size, std::string& out) const;
+  bool readCompressed(uint64_t offset, uint32_t size, std::string& out) const;
+  std::string toText(const std::string& data) const;
+};
+
+// Every StarDict dictionary in /dictionaries, with word forms tried in turn so inflected words find their headword.
+class Dictionary {
+ public:
+  struct Result {
+    std::string headword;
+    std::string definition;
+    std::string dictionary;
+  };
+
+  // Opens the dictionaries, building their samples as needed; false if there are none. `progress` gets the
+  // dictionary being prepared when a sample has to be built, which takes a while for a large one.
+  bool open(const std::function<void(const std::string&)>& progress = nullptr);
+  bool empty() const { return dictionaries.empty(); }
+
+  // Looks `word` up as selected in a book written in `language` (BCP 47, e.g. "en-US")
+  bool lookup(const std::string& word, const std::string& language, Result& result) const;
+
+  // Forms of `word` to look up, most likely first: the word cleaned of punctuation, lower-cased, then stripped of
+  // common inflections of the language
+  static std::vector<std::string> candidates(const std::string& word, const std::string& language);
+
+ private:
+  std::vector<std::unique_ptr<StarDict>> dictionaries;
+};
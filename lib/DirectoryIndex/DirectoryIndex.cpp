@@ -0,0 +1,737 @@
+#include "DirectoryIndex.h"
+
+#include <Arduino.h>
+#include <Logging.h>
+#include <Serialization.h>
+#include <esp_task_wdt.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <vector>
+
+namespace {
+constexpr uint32_t MAGIC = 0x58444944;  // "DIDX"
+constexpr uint8_t VERSION = 3;
+constexpr char INDEX_DIR[] = "/.crosspoint/dirindex";
+constexpr char GENERATION_FILE[] = "/.crosspoint/dirindex/generation.bin";
+
+// RAM budget of the on-card sort: records held while sorting a run, and the read buffers of a merge
+constexpr size_t RUN_BYTES = 12 * 1024;
+constexpr size_t MERGE_WAYS = 8;
+constexpr size_t IO_BUFFER_SIZE = 512;
+// Bookkeeping a std::string in a run costs beyond its characters
+constexpr size_t RECORD_OVERHEAD = sizeof(std::string) + 16;
+
+constexpr uint8_t FLAG_DIRECTORY = 0x01;
+constexpr uint8_t FLAG_LEADING = 0x02;
+
+struct Header {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t filterId;
+  uint16_t reserved;
+  uint32_t count;
+  uint32_t dirCount;
+  uint32_t leadingCount;  // files in the leading group, ranked right after the folders
+  uint64_t totalSize;
+  uint32_t generation;
+  uint32_t recordsOffset;
+  uint32_t namesOffset;
+  uint32_t modifiedOrderOffset;
+  uint32_t sizeOrderOffset;
+  uint64_t contentHash;  // sum of entryHash() over the listed entries
+};
+
+// Fixed-size entry record; records are stored in name order, so a record's index is its name rank
+struct Record {
+  uint32_t nameOffset;
+  uint32_t size;
+  uint32_t modified;
+  uint16_t nameLength;
+  uint8_t flags;
+  uint8_t reserved;
+};
+static_assert(sizeof(Record) == 16, "Record layout is part of the file format");
+
+// Scanned entries while sorting: flags, size, modified, then the name
+constexpr size_t RAW_PREFIX = 9;
+
+// Indexes validated against their directory since boot, keyed by index path and generation
+constexpr size_t VALIDATED_SLOTS = 16;
+uint64_t validatedKeys[VALIDATED_SLOTS] = {};
+size_t nextValidatedSlot = 0;
+
+uint64_t validationKey(const std::string& indexPath, const uint32_t generation) {
+  return static_cast<uint64_t>(std::hash<std::string>{}(indexPath)) * 1099511628211ull + generation;
+}
+
+void feedWatchdog() {
+  yield();
+  esp_task_wdt_reset();
+}
+
+void putU32(char* out, const uint32_t value) { memcpy(out, &value, sizeof(value)); }
+uint32_t getU32(const char* in) {
+  uint32_t value;
+  memcpy(&value, in, sizeof(value));
+  return value;
+}
+
+// FNV-1a over everything the index stores about an entry. Summed, so the fingerprint of a directory doesn't depend
+// on the order its entries are read in.
+uint64_t entryHash(const char* name, const bool isDirectory, const uint32_t size, const uint32_t modified) {
+  uint64_t hash = 14695981039346656037ull;
+  const auto mix = [&hash](const void* data, const size_t length) {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < length; i++) {
+      hash ^= bytes[i];
+      hash *= 1099511628211ull;
+    }
+  };
+  mix(name, strlen(name));
+  mix(&isDirectory, sizeof(isDirectory));
+  mix(&size, sizeof(size));
+  mix(&modified, sizeof(modified));
+  return hash;
+}
+
+// Calls `visit(name, isDirectory, size, modified)` for every entry of `dir` the filter lists
+template <typename Visit>
+void scanEntries(FsFile& dir, const DirectoryIndex::Filter& filter, Visit&& visit) {
+  char name[500];
+  uint32_t scannedCount = 0;
+  for (auto entry = dir.openNextFile(); entry; entry = dir.openNextFile()) {
+    entry.getName(name, sizeof(name));
+    const bool isDirectory = entry.isDirectory();
+    if (!filter.include || filter.include(name, isDirectory)) {
+      uint16_t date = 0;
+      uint16_t time = 0;
+      entry.getModifyDateTime(&date, &time);
+      const uint32_t size = isDirectory ? 0 : static_cast<uint32_t>(entry.fileSize());
+      visit(name, isDirectory, size, static_cast<uint32_t>(date) << 16 | time);
+    }
+    entry.close();
+    if (++scannedCount % 64 == 0) feedWatchdog();
+  }
+}
+
+// Buffered writer of length-prefixed records (or raw bytes)
+class RecordWriter {
+  FsFile& file;
+  std::vector<uint8_t> buffer;
+  size_t used = 0;
+  bool ok = true;
+
+ public:
+  explicit RecordWriter(FsFile& file) : file(file), buffer(IO_BUFFER_SIZE) {}
+
+  void write(const void* data, size_t length) {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    while (length > 0) {
+      const size_t chunk = std::min(length, buffer.size() - used);
+      memcpy(buffer.data() + used, bytes, chunk);
+      used += chunk;
+      bytes += chunk;
+      length -= chunk;
+      if (used == buffer.size()) flush();
+    }
+  }
+
+  void writeRecord(const std::string& record) {
+    const auto length = static_cast<uint16_t>(record.size());
+    write(&length, sizeof(length));
+    write(record.data(), record.size());
+  }
+
+  bool flush() {
+    if (used > 0 && file.write(buffer.data(), used) != used) ok = false;
+    used = 0;
+    return ok;
+  }
+};
+
+// Buffered reader of the length-prefixed records in [start, end) of a file; `end` may lie past the end of the file
+class RecordReader {
+  FsFile file;
+  std::vector<uint8_t> buffer;
+  size_t pos = 0;
+  size_t filled = 0;
+  uint32_t remaining = 0;
+
+  bool readBytes(void* out, size_t length) {
+    auto* bytes = static_cast<uint8_t*>(out);
+    while (length > 0) {
+      if (pos == filled) {
+        const size_t want = std::min<size_t>(buffer.size(), remaining);
+        if (want == 0) return false;
+        const int got = file.read(buffer.data(), want);
+        if (got <= 0) return false;
+        filled = static_cast<size_t>(got);
+        remaining -= filled;
+        pos = 0;
+      }
+      const size_t chunk = std::min(length, filled - pos);
+      memcpy(bytes, buffer.data() + pos, chunk);
+      pos += chunk;
+      bytes += chunk;
+      length -= chunk;
+    }
+    return true;
+  }
+
+ public:
+  bool open(const std::string& path, const uint32_t start, const uint32_t end) {
+    buffer.resize(IO_BUFFER_SIZE);
+    pos = filled = 0;
+    remaining = end - start;
+    return Storage.openFileForRead("DIX", path, file) && file.seekSet(start);
+  }
+
+  bool next(std::string& record) {
+    uint16_t length = 0;
+    if (!readBytes(&length, sizeof(length))) return false;
+    record.resize(length);
+    return readBytes(record.data(), length);
+  }
+};
+
+using RecordLess = std::function<bool(const std::string&, const std::string&)>;
+
+// Sorts the length-prefixed records of `input` into `output` in bounded memory: sorted runs first, then rounds of
+// MERGE_WAYS-way merges between two scratch files. `input` is consumed.
+bool sortRecords(const std::string& input, const std::string& output, const std::string& scratch,
+                 const RecordLess& less) {
+  const std::string scratchFiles[2] = {scratch + ".a", scratch + ".b"};
+  std::vector<uint32_t> runs;  // Start offsets of the runs in the current file, then its end
+
+  // Sorted runs
+  {
+    RecordReader reader;
+    FsFile out;
+    if (!reader.open(input, 0, UINT32_MAX) || !Storage.openFileForWrite("DIX", scratchFiles[0], out)) {
+      return false;
+    }
+
+    RecordWriter writer(out);
+    std::vector<std::string> run;
+    size_t runBytes = 0;
+    uint32_t offset = 0;
+    std::string record;
+    bool more = true;
+    while (more) {
+      more = reader.next(record);
+      if (more) {
+        runBytes += record.size() + RECORD_OVERHEAD;
+        run.push_back(std::move(record));
+      }
+      if (!run.empty() && (!more || runBytes >= RUN_BYTES)) {
+        std::sort(run.begin(), run.end(), less);
+        runs.push_back(offset);
+        for (const auto& sorted : run) {
+          writer.writeRecord(sorted);
+          offset += sizeof(uint16_t) + sorted.size();
+        }
+        run.clear();
+        runBytes = 0;
+        feedWatchdog();
+      }
+    }
+    runs.push_back(offset);
+    if (!writer.flush()) return false;
+    out.close();
+  }
+  Storage.remove(input.c_str());
+
+  // Merge rounds; the last one writes straight to `output`
+  int current = 0;
+  while (true) {
+    const size_t runCount = runs.size() - 1;
+    const bool last = runCount <= MERGE_WAYS;
+    const std::string& target = last ? output : scratchFiles[1 - current];
+
+    FsFile out;
+    if (!Storage.openFileForWrite("DIX", target, out)) return false;
+    RecordWriter writer(out);
+    std::vector<uint32_t> merged;
+    uint32_t offset = 0;
+
+    for (size_t first = 0; first < std::max<size_t>(runCount, 1); first += MERGE_WAYS) {
+      const size_t ways = std::min(MERGE_WAYS, runCount - first);
+      std::vector<RecordReader> readers(ways);
+      std::vector<std::string> heads(ways);
+      std::vector<bool> live(ways);
+      for (size_t i = 0; i < ways; i++) {
+        if (!readers[i].open(scratchFiles[current], runs[first + i], runs[first + i + 1])) return false;
+        live[i] = readers[i].next(heads[i]);
+      }
+      merged.push_back(offset);
+      size_t written = 0;
+      while (true) {
+        int best = -1;
+        for (size_t i = 0; i < ways; i++) {
+          if (live[i] && (best < 0 || less(heads[i], heads[best]))) best = static_cast<int>(i);
+        }
+        if (best < 0) break;
+        writer.writeRecord(heads[best]);
+        offset += sizeof(uint16_t) + heads[best].size();
+        live[best] = readers[best].next(heads[best]);
+        if (++written % 256 == 0) feedWatchdog();
+      }
+    }
+    merged.push_back(offset);
+    if (!writer.flush()) return false;
+    out.close();
+
+    if (last) break;
+    runs = std::move(merged);
+    current = 1 - current;
+  }
+  Storage.remove(scratchFiles[0].c_str());
+  Storage.remove(scratchFiles[1].c_str());
+  return true;
+}
+
+// Folders, then leading files, then the other files
+int rawGroup(const std::string& raw) {
+  if (raw[0] & FLAG_DIRECTORY) return 0;
+  return raw[0] & FLAG_LEADING ? 1 : 2;
+}
+
+bool rawNameLess(const std::string& a, const std::string& b) {
+  const int aGroup = rawGroup(a);
+  const int bGroup = rawGroup(b);
+  if (aGroup != bGroup) return aGroup < bGroup;
+  return DirectoryIndex::nameLess(a.data() + RAW_PREFIX, a.size() - RAW_PREFIX, b.data() + RAW_PREFIX,
+                                  b.size() - RAW_PREFIX);
+}
+
+uint32_t nextGeneration() {
+  uint32_t generation = 0;
+  FsFile f;
+  if (Storage.openFileForRead("DIX", GENERATION_FILE, f)) {
+    serialization::readPod(f, generation);
+    f.close();
+  }
+  generation++;
+  if (Storage.openFileForWrite("DIX", GENERATION_FILE, f)) {
+    serialization::writePod(f, generation);
+    f.close();
+  }
+  return generation;
+}
+}  // namespace
+
+bool DirectoryIndex::nameLess(const char* a, const size_t aLength, const char* b, const size_t bLength) {
+  const char* aEnd = a + aLength;
+  const char* bEnd = b + bLength;
+  while (a < aEnd && b < bEnd) {
+    if (isdigit(static_cast<unsigned char>(*a)) && isdigit(static_cast<unsigned char>(*b))) {
+      // Compare numbers by value: skip leading zeros, then the longer number is larger
+      while (a < aEnd && *a == '0') a++;
+      while (b < bEnd && *b == '0') b++;
+      size_t aDigits = 0;
+      size_t bDigits = 0;
+      while (a + aDigits < aEnd && isdigit(static_cast<unsigned char>(a[aDigits]))) aDigits++;
+      while (b + bDigits < bEnd && isdigit(static_cast<unsigned char>(b[bDigits]))) bDigits++;
+      if (aDigits != bDigits) return aDigits < bDigits;
+      for (size_t i = 0; i < aDigits; i++) {
+        if (a[i] != b[i]) return a[i] < b[i];
+      }
+      a += aDigits;
+      b += bDigits;
+    } else {
+      const char ca = static_cast<char>(tolower(static_cast<unsigned char>(*a)));
+      const char cb = static_cast<char>(tolower(static_cast<unsigned char>(*b)));
+      if (ca != cb) return ca < cb;
+      a++;
+      b++;
+    }
+  }
+  return a == aEnd && b != bEnd;
+}
+
+uint32_t DirectoryIndex::fatToUnixTime(const uint32_t modified) {
+  const uint16_t date = modified >> 16;
+  const uint16_t time = modified & 0xFFFF;
+  int year = 1980 + (date >> 9);
+  const unsigned month = (date >> 5) & 0x0F;
+  const unsigned day = date & 0x1F;
+  if (month < 1 || month > 12 || day < 1) {
+    return 0;
+  }
+  // Days from civil date (proleptic Gregorian)
+  year -= month <= 2;
+  const int era = year / 400;
+  const unsigned yearOfEra = static_cast<unsigned>(year - era * 400);
+  const unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  const unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  const uint32_t days = era * 146097 + dayOfEra - 719468;
+  return days * 86400 + (time >> 11) * 3600 + ((time >> 5) & 0x3F) * 60 + (time & 0x1F) * 2;
+}
+
+std::string DirectoryIndex::normalize(const std::string& dirPath) {
+  std::string path = dirPath.empty() || dirPath[0] != '/' ? "/" + dirPath : dirPath;
+  while (path.size() > 1 && path.back() == '/') path.pop_back();
+  return path;
+}
+
+std::string DirectoryIndex::indexPathFor(const std::string& dirPath, const uint8_t filterId) {
+  return std::string(INDEX_DIR) + "/" + std::to_string(std::hash<std::string>{}(dirPath)) + "_" +
+         std::to_string(filterId) + ".bin";
+}
+
+void DirectoryIndex::invalidate(const std::string& dirPath) {
+  const std::string path = normalize(dirPath);
+  for (uint8_t id = 0; id <= MAX_FILTER_ID; id++) {
+    const std::string indexPath = indexPathFor(path, id);
+    if (Storage.exists(indexPath.c_str())) {
+      Storage.remove(indexPath.c_str());
+    }
+  }
+}
+
+void DirectoryIndex::invalidateParent(const std::string& path) {
+  const std::string normalized = normalize(path);
+  const size_t slash = normalized.find_last_of('/');
+  invalidate(slash == 0 ? "/" : normalized.substr(0, slash));
+}
+
+bool DirectoryIndex::open(const std::string& dirPath, const Filter& filter, const bool validate) {
+  close();
+  count = dirCount = leadingCount = 0;
+  totalSize = 0;
+  const std::string path = normalize(dirPath);
+  const std::string indexPath = indexPathFor(path, filter.id);
+  if (load(indexPath, path)) {
+    const uint64_t key = validationKey(indexPath, generation);
+    if (!validate || std::find(std::begin(validatedKeys), std::end(validatedKeys), key) != std::end(validatedKeys)) {
+      return true;
+    }
+    uint32_t entries = 0;
+    uint64_t hash = 0;
+    if (!fingerprint(path, filter, entries, hash)) {
+      close();
+      return false;
+    }
+    if (entries == count && hash == contentHash) {
+      validatedKeys[nextValidatedSlot++ % VALIDATED_SLOTS] = key;
+      return true;
+    }
+    LOG_DBG("DIX", "%s changed since it was indexed", path.c_str());
+    close();
+  }
+
+  [[maybe_unused]] const unsigned long start = millis();
+  if (!build(indexPath, path, filter)) {
+    LOG_ERR("DIX", "Failed to index %s", path.c_str());
+    return false;
+  }
+  if (!load(indexPath, path)) {
+    return false;
+  }
+  LOG_DBG("DIX", "Indexed %s: %u entries in %lu ms", path.c_str(), count, millis() - start);
+  if (validate) {
+    validatedKeys[nextValidatedSlot++ % VALIDATED_SLOTS] = validationKey(indexPath, generation);
+  }
+  return true;
+}
+
+bool DirectoryIndex::load(const std::string& indexPath, const std::string& dirPath) {
+  if (!Storage.exists(indexPath.c_str()) || !Storage.openFileForRead("DIX", indexPath, file)) {
+    return false;
+  }
+  Header header = {};
+  std::string indexedPath;
+  serialization::readPod(file, header);
+  serialization::readString(file, indexedPath);
+  if (header.magic != MAGIC || header.version != VERSION || indexedPath != dirPath ||
+      file.fileSize() != header.sizeOrderOffset + static_cast<size_t>(header.count) * sizeof(uint32_t)) {
+    LOG_DBG("DIX", "Ignoring stale index for %s", dirPath.c_str());
+    file.close();
+    return false;
+  }
+  count = header.count;
+  dirCount = header.dirCount;
+  leadingCount = header.leadingCount;
+  totalSize = header.totalSize;
+  generation = header.generation;
+  recordsOffset = header.recordsOffset;
+  namesOffset = header.namesOffset;
+  modifiedOrderOffset = header.modifiedOrderOffset;
+  sizeOrderOffset = header.sizeOrderOffset;
+  contentHash = header.contentHash;
+  return true;
+}
+
+bool DirectoryIndex::fingerprint(const std::string& dirPath, const Filter& filter, uint32_t& entries, uint64_t& hash) {
+  FsFile dir = Storage.open(dirPath.c_str());
+  if (!dir || !dir.isDirectory()) {
+    return false;
+  }
+  entries = 0;
+  hash = 0;
+  scanEntries(dir, filter, [&](const char* name, bool isDirectory, uint32_t size, uint32_t modified) {
+    entries++;
+    hash += entryHash(name, isDirectory, size, modified);
+  });
+  dir.close();
+  return true;
+}
+
+bool DirectoryIndex::build(const std::string& indexPath, const std::string& dirPath, const Filter& filter) {
+  FsFile dir = Storage.open(dirPath.c_str());
+  if (!dir || !dir.isDirectory()) {
+    return false;
+  }
+  Storage.mkdir(INDEX_DIR);
+  const std::string scratch = indexPath + ".tmp";
+  const std::string scannedPath = scratch + ".scan";
+  const std::string sortedPath = scratch + ".sorted";
+
+  // Scan the directory into unsorted raw records
+  Header header = {};
+  header.magic = MAGIC;
+  header.version = VERSION;
+  header.filterId = filter.id;
+  {
+    FsFile scanned;
+    if (!Storage.openFileForWrite("DIX", scannedPath, scanned)) {
+      return false;
+    }
+    RecordWriter writer(scanned);
+    std::string record;
+    scanEntries(dir, filter, [&](const char* name, bool isDirectory, uint32_t size, uint32_t modified) {
+      const size_t nameLength = std::min<size_t>(strlen(name), UINT16_MAX - RAW_PREFIX);
+      record.resize(RAW_PREFIX + nameLength);
+      const bool leading = !isDirectory && filter.leading && filter.leading(name);
+      record[0] = static_cast<char>(isDirectory ? FLAG_DIRECTORY : leading ? FLAG_LEADING : 0);
+      putU32(&record[1], size);
+      putU32(&record[5], modified);
+      memcpy(&record[RAW_PREFIX], name, nameLength);
+      writer.writeRecord(record);
+
+      header.count++;
+      header.dirCount += isDirectory;
+      header.leadingCount += leading;
+      header.totalSize += size;
+      header.contentHash += entryHash(name, isDirectory, size, modified);
+    });
+    dir.close();
+    if (!writer.flush()) {
+      return false;
+    }
+  }
+
+  if (!sortRecords(scannedPath, sortedPath, scratch, rawNameLess)) {
+    return false;
+  }
+
+  // Write records and names in name order, collecting (key, rank) pairs for the other orders
+  const std::string newIndexPath = indexPath + ".new";
+  const std::string keyPaths[2] = {scratch + ".modified", scratch + ".size"};
+  FsFile out;
+  if (!Storage.openFileForWrite("DIX", newIndexPath, out)) {
+    return false;
+  }
+  serialization::writePod(out, header);
+  serialization::writeString(out, dirPath);
+  header.recordsOffset = out.position();
+  header.namesOffset = header.recordsOffset + header.count * sizeof(Record);
+  {
+    FsFile keyFiles[2];
+    if (!Storage.openFileForWrite("DIX", keyPaths[0], keyFiles[0]) ||
+        !Storage.openFileForWrite("DIX", keyPaths[1], keyFiles[1])) {
+      return false;
+    }
+    RecordWriter keyWriters[2] = {RecordWriter(keyFiles[0]), RecordWriter(keyFiles[1])};
+    RecordReader reader;
+    if (!reader.open(sortedPath, 0, UINT32_MAX)) {
+      return false;
+    }
+
+    // Records are batched and written at their own offset; names stream out behind them
+    constexpr size_t RECORD_BATCH = IO_BUFFER_SIZE / sizeof(Record);
+    Record batch[RECORD_BATCH];
+    size_t batched = 0;
+    uint32_t rank = 0;
+    uint32_t nameOffset = 0;
+    bool ok = out.seekSet(header.namesOffset);
+    RecordWriter names(out);
+    std::string raw;
+    std::string key(2 * sizeof(uint32_t), '\0');
+    while (ok && reader.next(raw)) {
+      Record& record = batch[batched++];
+      record.flags = static_cast<uint8_t>(raw[0]);
+      record.size = getU32(&raw[1]);
+      record.modified = getU32(&raw[5]);
+      record.nameLength = static_cast<uint16_t>(raw.size() - RAW_PREFIX);
+      record.nameOffset = nameOffset;
+      record.reserved = 0;
+      names.write(raw.data() + RAW_PREFIX, record.nameLength);
+      nameOffset += record.nameLength;
+
+      putU32(&key[0], record.modified);
+      putU32(&key[4], rank);
+      keyWriters[0].writeRecord(key);
+      putU32(&key[0], record.size);
+      keyWriters[1].writeRecord(key);
+      rank++;
+
+      if (batched == RECORD_BATCH || rank == header.count) {
+        const uint32_t namesEnd = header.namesOffset + nameOffset;
+        ok = names.flush() && out.seekSet(header.recordsOffset + (rank - batched) * sizeof(Record)) &&
+             out.write(batch, batched * sizeof(Record)) == batched * sizeof(Record) && out.seekSet(namesEnd);
+        batched = 0;
+        feedWatchdog();
+      }
+    }
+    ok = ok && names.flush() && keyWriters[0].flush() && keyWriters[1].flush() && rank == header.count;
+    Storage.remove(sortedPath.c_str());
+    if (!ok) {
+      out.close();
+      Storage.remove(newIndexPath.c_str());
+      return false;
+    }
+    header.modifiedOrderOffset = header.namesOffset + nameOffset;
+    header.sizeOrderOffset = header.modifiedOrderOffset + header.count * sizeof(uint32_t);
+  }
+
+  // Sort the keys and append the resulting rank permutations. The groups keep their place: folders are ranks
+  // [0, dirCount) and leading files the ranks right after them.
+  const uint32_t dirCount = header.dirCount;
+  const uint32_t filesEnd = header.dirCount + header.leadingCount;
+  const RecordLess keyLess = [dirCount, filesEnd](const std::string& a, const std::string& b) {
+    const uint32_t aRank = getU32(&a[4]);
+    const uint32_t bRank = getU32(&b[4]);
+    const int aGroup = aRank < dirCount ? 0 : aRank < filesEnd ? 1 : 2;
+    const int bGroup = bRank < dirCount ? 0 : bRank < filesEnd ? 1 : 2;
+    if (aGroup != bGroup) return aGroup < bGroup;
+    const uint32_t aKey = getU32(&a[0]);
+    const uint32_t bKey = getU32(&b[0]);
+    return aKey != bKey ? aKey < bKey : aRank < bRank;
+  };
+  bool ok = out.seekSet(header.modifiedOrderOffset);
+  RecordWriter orders(out);
+  for (const auto& keyPath : keyPaths) {
+    const std::string sortedKeys = keyPath + ".sorted";
+    RecordReader reader;
+    ok = ok && sortRecords(keyPath, sortedKeys, scratch, keyLess) && reader.open(sortedKeys, 0, UINT32_MAX);
+    std::string key;
+    while (ok && reader.next(key)) {
+      orders.write(&key[4], sizeof(uint32_t));
+    }
+    Storage.remove(sortedKeys.c_str());
+  }
+
+  // The header goes in last, so an interrupted build never looks complete
+  header.generation = nextGeneration();
+  ok = ok && orders.flush() && out.seekSet(0);
+  if (ok) {
+    serialization::writePod(out, header);
+  }
+  out.close();
+  if (!ok) {
+    Storage.remove(newIndexPath.c_str());
+    return false;
+  }
+  if (Storage.exists(indexPath.c_str())) {
+    Storage.remove(indexPath.c_str());
+  }
+  return Storage.rename(newIndexPath.c_str(), indexPath.c_str());
+}
+
+uint32_t DirectoryIndex::rankAt(const SortKey key, const uint32_t position) {
+  if (key == SortKey::Name) {
+    return position;
+  }
+  uint32_t rank = 0;
+  file.seekSet((key == SortKey::Modified ? modifiedOrderOffset : sizeOrderOffset) + position * sizeof(uint32_t));
+  serialization::readPod(file, rank);
+  return rank;
+}
+
+uint32_t DirectoryIndex::read(const SortKey key, const bool descending, const uint32_t position, const uint32_t limit,
+                              const std::function<void(const Entry&)>& callback) {
+  if (!file) {
+    return 0;
+  }
+  Entry entry;
+  uint32_t delivered = 0;
+  for (uint32_t p = position; p < count && delivered < limit; p++, delivered++) {
+    // Descending reverses each group separately, so the groups keep their order
+    uint32_t physical = p;
+    if (descending) {
+      const uint32_t leadingEnd = dirCount + leadingCount;
+      if (p < dirCount) {
+        physical = dirCount - 1 - p;
+      } else if (p < leadingEnd) {
+        physical = dirCount + (leadingEnd - 1 - p);
+      } else {
+        physical = leadingEnd + (count - 1 - p);
+      }
+    }
+    if (!readEntry(rankAt(key, physical), entry)) {
+      break;
+    }
+    callback(entry);
+  }
+  return delivered;
+}
+
+bool DirectoryIndex::readEntry(const uint32_t rank, Entry& entry) {
+  Record record = {};
+  if (rank >= count || !file.seekSet(recordsOffset + rank * sizeof(Record)) ||
+      file.read(&record, sizeof(record)) != static_cast<int>(sizeof(record)) ||
+      !file.seekSet(namesOffset + record.nameOffset)) {
+    return false;
+  }
+  entry.name.resize(record.nameLength);
+  if (file.read(entry.name.data(), record.nameLength) != static_cast<int>(record.nameLength)) {
+    return false;
+  }
+  entry.size = record.size;
+  entry.modified = record.modified;
+  entry.isDirectory = record.flags & FLAG_DIRECTORY;
+  return true;
+}
+
+uint32_t DirectoryIndex::find(const std::string& name, const bool isDirectory) {
+  if (!file) {
+    return count;
+  }
+  if (isDirectory) {
+    return findIn(name, 0, dirCount);
+  }
+  // A file may be in either file group
+  const uint32_t leadingEnd = dirCount + leadingCount;
+  const uint32_t leading = findIn(name, dirCount, leadingEnd);
+  return leading != count ? leading : findIn(name, leadingEnd, count);
+}
+
+uint32_t DirectoryIndex::findIn(const std::string& name, uint32_t low, const uint32_t end) {
+  // Each group is in name order, so a binary search finds the first entry not before `name`
+  uint32_t high = end;
+  Entry entry;
+  while (low < high) {
+    const uint32_t mid = low + (high - low) / 2;
+    if (!readEntry(mid, entry)) {
+      return count;
+    }
+    if (nameLess(entry.name.data(), entry.name.size(), name.data(), name.size())) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  // Names differing only in case or leading zeros sort as equal; step through them for the exact one
+  for (; low < end && readEntry(low, entry); low++) {
+    if (entry.name == name) {
+      return low;
+    }
+    if (nameLess(name.data(), name.size(), entry.name.data(), entry.name.size())) {
+      break;
+    }
+  }
+  return count;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <HalStorage.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Sorted listing of one directory, persisted to the SD card so that large folders can be paged through without
+// rescanning and re-sorting them for every request.
+//
+// The index holds every listed entry in name order plus permutations for the other sort keys, so any window of any
+// order is read with a few small seeks. Folders always come first, then the files the filter lists as leading, then
+// the rest; each sort key orders entries within those groups. Building it sorts on the SD card with a small, fixed
+// amount of RAM, whatever the size of the folder.
+//
+// Code that changes a directory calls invalidate() (or invalidateParent() for the entry it touched), and the next
+// open() rebuilds it. Changes made elsewhere, with the card in a computer, are caught by opening with `validate`: the
+// directory is scanned without sorting or keeping any names and compared to a fingerprint stored in the index. Each
+// build gets a new generation number, which callers use to tell listings apart (ETags, pagination cursors).
+class DirectoryIndex {
+ public:
+  enum class SortKey : uint8_t { Name, Modified, Size };
+
+  struct Entry {
+    std::string name;
+    uint32_t size = 0;
+    uint32_t modified = 0;  // FAT date << 16 | time
+    bool isDirectory = false;
+  };
+
+  // Which entries are listed, and which files go ahead of the others. Indexes built with different filters live side
+  // by side, told apart by `id`.
+  struct Filter {
+    uint8_t id = 0;
+    bool (*include)(const char* name, bool isDirectory) = nullptr;  // nullptr lists everything
+    bool (*leading)(const char* name) = nullptr;                    // nullptr keeps all files in one group
+  };
+  static constexpr uint8_t MAX_FILTER_ID = 3;
+
+  DirectoryIndex() = default;
+  DirectoryIndex(const DirectoryIndex&) = delete;
+  DirectoryIndex& operator=(const DirectoryIndex&) = delete;
+
+  // Open the index of `dirPath`, building it first if there is none. False if the directory cannot be listed.
+  // With `validate`, an index that no longer matches the directory is rebuilt. Each index is checked once per boot;
+  // after that only on-device changes happen to it, and those invalidate it.
+  bool open(const std::string& dirPath, const Filter& filter, bool validate = false);
+  void close() { file.close(); }
+
+  [[nodiscard]] uint32_t size() const { return count; }
+  [[nodiscard]] uint32_t folderCount() const { return dirCount; }
+  [[nodiscard]] uint64_t totalFileSize() const { return totalSize; }
+  [[nodiscard]] uint32_t getGeneration() const { return generation; }
+
+  // Read up to `limit` entries of the given order, starting at `position`. Returns how many were read.
+  uint32_t read(SortKey key, bool descending, uint32_t position, uint32_t limit,
+                const std::function<void(const Entry&)>& callback);
+  // Position of an entry in ascending name order, or size() if it isn't listed
+  uint32_t find(const std::string& name, bool isDirectory);
+
+  // Drop the indexes of `dirPath` after its entries changed
+  static void invalidate(const std::string& dirPath);
+  // Drop the indexes of the directory containing `path`
+  static void invalidateParent(const std::string& path);
+
+  // Folder-browser order: case-insensitive, with runs of digits compared by value ("Vol 2" before "Vol 10")
+  static bool nameLess(const char* a, size_t aLength, const char* b, size_t bLength);
+  // Seconds since 1970 for a FAT timestamp, treating the (local) time as UTC
+  static uint32_t fatToUnixTime(uint32_t modified);
+
+ private:
+  FsFile file;
+  uint32_t count = 0;
+  uint32_t dirCount = 0;
+  uint32_t leadingCount = 0;
+  uint64_t totalSize = 0;
+  uint32_t generation = 0;
+  uint64_t contentHash = 0;
+  uint32_t recordsOffset = 0;
+  uint32_t namesOffset = 0;
+  uint32_t modifiedOrderOffset = 0;
+  uint32_t sizeOrderOffset = 0;
+
+  static std::string normalize(const std::string& dirPath);
+  static std::string indexPathFor(const std::string& dirPath, uint8_t filterId);
+  bool load(const std::string& indexPath, const std::string& dirPath);
+  static bool build(const std::string& indexPath, const std::string& dirPath, const Filter& filter);
+  static bool fingerprint(const std::string& dirPath, const Filter& filter, uint32_t& entries, uint64_t& hash);
+  uint32_t rankAt(SortKey key, uint32_t position);
+  uint32_t findIn(const std::string& name, uint32_t low, uint32_t end);
+  bool readEntry(uint32_t rank, Entry& entry);
+};
@@ -7,6 +7,7 @@
 #include <PngToBmpConverter.h>
 #include <ZipFile.h>
 
+#include "Epub/SearchIndex.h"
 #include "Epub/parsers/ContainerParser.h"
 #include "Epub/parsers/ContentOpfParser.h"
 #include "Epub/parsers/TocNavParser.h"
@@ -76,6 +77,7 @@ bool Epub::parseContentOpf(BookMetadataCache::BookMetadata& bookMetadata) {
   bookMetadata.title = opfParser.title;
   bookMetadata.author = opfParser.author;
   bookMetadata.language = opfParser.language;
+  bookMetadata.series = opfParser.series;
   bookMetadata.coverItemHref = opfParser.coverItemHref;
 
   // Guide-based cover fallback: if no cover found via metadata/properties,
@@ -516,6 +518,15 @@ const std::string& Epub::getLanguage() const {
   return bookMetadataCache->coreMetadata.language;
 }
 
+const std::string& Epub::getSeries() const {
+  static std::string blank;
+  if (!bookMetadataCache || !bookMetadataCache->isLoaded()) {
+    return blank;
+  }
+
+  return bookMetadataCache->coreMetadata.series;
+}
+
 std::string Epub::getCoverBmpPath(bool cropped) const {
   const auto coverFileName = std::string("cover") + (cropped ? "_crop" : "");
   return cachePath + "/" + coverFileName + ".bmp";
@@ -723,6 +734,47 @@ uint8_t* Epub::readItemContentsToBytes(const std::string& itemHref, size_t* size
   return content;
 }
 
+std::string Epub::getSearchIndexPath() const { return cachePath + "/search"; }
+
+bool Epub::buildSearchIndex(const std::function<void(int)>& progress, const std::function<bool()>& stop) const {
+  if (!bookMetadataCache || !bookMetadataCache->isLoaded()) {
+    LOG_ERR("EBP", "Cannot build search index, cache not loaded");
+    return false;
+  }
+
+  const uint32_t start = millis();
+  SearchIndexBuilder builder(getSearchIndexPath());
+  if (!builder.begin()) {
+    return false;
+  }
+  const int spineCount = getSpineItemsCount();
+  for (int i = 0; i < spineCount; i++) {
+    if (stop && stop()) {
+      LOG_DBG("EBP", "Search index build cancelled");
+      builder.abandon();
+      return false;
+    }
+    const std::string href = getSpineItem(i).href;
+    size_t size = 0;
+    // A missing or broken item only leaves its text out of the index
+    if (getItemSize(href, &size) && builder.beginItem(static_cast<uint16_t>(i), size)) {
+      readItemContentsToStream(href, builder, 1024);
+    }
+    if (!builder.endItem()) {
+      builder.finish();
+      return false;
+    }
+    if (progress) {
+      progress((i + 1) * 100 / spineCount);
+    }
+  }
+  if (!builder.finish()) {
+    return false;
+  }
+  LOG_DBG("EBP", "Built search index in %lu ms", millis() - start);
+  return true;
+}
+
 bool Epub::readItemContentsToStream(const std::string& itemHref, Print& out, const size_t chunkSize) const {
   if (itemHref.empty()) {
     LOG_DBG("EBP", "Failed to read item, empty href");
@@ -806,6 +858,13 @@ int Epub::getSpineIndexForTocIndex(const int tocIndex) const {
 
 int Epub::getTocIndexForSpineIndex(const int spineIndex) const { return getSpineItem(spineIndex).tocIndex; }
 
+std::unique_ptr<TocView> Epub::createTocView() const {
+  if (!bookMetadataCache || !bookMetadataCache->isLoaded()) {
+    return nullptr;
+  }
+  return std::unique_ptr<TocView>(new TocView(*bookMetadataCache));
+}
+
 size_t Epub::getBookSize() const {
   if (!bookMetadataCache || !bookMetadataCache->isLoaded() || bookMetadataCache->getSpineCount() == 0) {
     return 0;
@@ -865,18 +924,6 @@ int Epub::resolveHrefToSpineIndex(const std::string& href) const {
   // Same-file reference (anchor-only)
   if (target.empty()) return -1;
 
-  // Extract just the filename for comparison
-  size_t targetSlash = target.find_last_of('/');
-  std::string targetFilename = (targetSlash != std::string::npos) ? target.substr(targetSlash + 1) : target;
-
-  for (int i = 0; i < getSpineItemsCount(); i++) {
-    const auto& spineHref = getSpineItem(i).href;
-    // Try exact match first
-    if (spineHref == target) return i;
-    // Then filename-only match
-    size_t spineSlash = spineHref.find_last_of('/');
-    std::string spineFilename = (spineSlash != std::string::npos) ? spineHref.substr(spineSlash + 1) : spineHref;
-    if (spineFilename == targetFilename) return i;
-  }
-  return -1;
+  // An exact href match is also a file name match, so the first spine item with the same file name is the target
+  return bookMetadataCache->findSpineIndexByFilename(target);
 }
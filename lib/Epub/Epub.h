@@ -2,12 +2,14 @@
 
 #include <Print.h>
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 #include "Epub/BookMetadataCache.h"
+#include "Epub/TocView.h"
 #include "Epub/css/CssParser.h"
 
 class ZipFile;
@@ -51,11 +53,17 @@ class Epub {
   const std::string& getTitle() const;
   const std::string& getAuthor() const;
   const std::string& getLanguage() const;
+  const std::string& getSeries() const;
   std::string getCoverBmpPath(bool cropped = false) const;
   bool generateCoverBmp(bool cropped = false) const;
   std::string getThumbBmpPath() const;
   std::string getThumbBmpPath(int height) const;
   bool generateThumbBmp(int height) const;
+  std::string getSearchIndexPath() const;
+  // Builds the full-text search index (see SearchIndex); `progress` gets the percentage done after each spine item
+  // Stops between spine items once `stop` returns true, leaving no index behind
+  bool buildSearchIndex(const std::function<void(int)>& progress = nullptr,
+                        const std::function<bool()>& stop = nullptr) const;
   uint8_t* readItemContentsToBytes(const std::string& itemHref, size_t* size = nullptr,
                                    bool trailingNullByte = false) const;
   bool readItemContentsToStream(const std::string& itemHref, Print& out, size_t chunkSize) const;
@@ -66,6 +74,8 @@ class Epub {
   int getTocItemsCount() const;
   int getSpineIndexForTocIndex(int tocIndex) const;
   int getTocIndexForSpineIndex(int spineIndex) const;
+  // Windowed view of the TOC for browsing it (see TocView); null if the book isn't loaded. Valid while this Epub lives.
+  std::unique_ptr<TocView> createTocView() const;
   size_t getCumulativeSpineItemSize(int spineIndex) const;
   int getSpineIndexForTextReference() const;
 
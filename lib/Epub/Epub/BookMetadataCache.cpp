@@ -9,10 +9,17 @@
 #include "FsHelpers.h"
 
 namespace {
-constexpr uint8_t BOOK_CACHE_VERSION = 5;
+constexpr uint8_t BOOK_CACHE_VERSION = 7;
 constexpr char bookBinFile[] = "/book.bin";
 constexpr char tmpSpineBinFile[] = "/spine.bin.tmp";
 constexpr char tmpTocBinFile[] = "/toc.bin.tmp";
+// Header field holding the offset of the spine filename index, right after the version and LUT offset
+constexpr uint32_t FILENAME_INDEX_OFFSET_POS = sizeof(BOOK_CACHE_VERSION) + sizeof(uint32_t);
+constexpr uint32_t FILENAME_INDEX_RECORD_SIZE = sizeof(uint64_t) + sizeof(uint16_t) + sizeof(int16_t);
+
+bool filenameIndexLess(const uint64_t hashA, const uint16_t lenA, const uint64_t hashB, const uint16_t lenB) {
+  return hashA < hashB || (hashA == hashB && lenA < lenB);
+}
 }  // namespace
 
 /* ============= WRITING / BUILDING FUNCTIONS ================ */
@@ -113,17 +120,18 @@ bool BookMetadataCache::buildBookBin(const std::string& epubPath, const BookMeta
     return false;
   }
 
-  constexpr uint32_t headerASize =
-      sizeof(BOOK_CACHE_VERSION) + /* LUT Offset */ sizeof(uint32_t) + sizeof(spineCount) + sizeof(tocCount);
+  constexpr uint32_t headerASize = sizeof(BOOK_CACHE_VERSION) + /* LUT Offset */ sizeof(uint32_t) +
+                                   /* Filename index offset */ sizeof(uint32_t) + sizeof(spineCount) + sizeof(tocCount);
   const uint32_t metadataSize = metadata.title.size() + metadata.author.size() + metadata.language.size() +
                                 metadata.coverItemHref.size() + metadata.textReferenceHref.size() +
-                                sizeof(uint32_t) * 5;
+                                metadata.series.size() + sizeof(uint32_t) * 6;
   const uint32_t lutSize = sizeof(uint32_t) * spineCount + sizeof(uint32_t) * tocCount;
   const uint32_t lutOffset = headerASize + metadataSize;
 
   // Header A
   serialization::writePod(bookFile, BOOK_CACHE_VERSION);
   serialization::writePod(bookFile, lutOffset);
+  serialization::writePod(bookFile, static_cast<uint32_t>(0));  // Placeholder for filename index offset (patched later)
   serialization::writePod(bookFile, spineCount);
   serialization::writePod(bookFile, tocCount);
   // Metadata
@@ -132,6 +140,7 @@ bool BookMetadataCache::buildBookBin(const std::string& epubPath, const BookMeta
   serialization::writeString(bookFile, metadata.language);
   serialization::writeString(bookFile, metadata.coverItemHref);
   serialization::writeString(bookFile, metadata.textReferenceHref);
+  serialization::writeString(bookFile, metadata.series);
 
   // Loop through spine entries, writing LUT positions
   spineFile.seek(0);
@@ -265,6 +274,10 @@ bool BookMetadataCache::buildBookBin(const std::string& epubPath, const BookMeta
     writeTocEntry(bookFile, tocEntry);
   }
 
+  if (!writeSpineFilenameIndex()) {
+    LOG_ERR("BMC", "Could not write spine filename index, links will resolve by scanning the spine");
+  }
+
   bookFile.close();
   spineFile.close();
   tocFile.close();
@@ -273,6 +286,38 @@ bool BookMetadataCache::buildBookBin(const std::string& epubPath, const BookMeta
   return true;
 }
 
+// Appends the spine filename index to book.bin and patches its offset into the header. Links into other chapters name
+// them by href, and this lets resolving one take a binary search rather than a read of every spine entry.
+bool BookMetadataCache::writeSpineFilenameIndex() {
+  std::vector<SpineFilenameIndexEntry> index;
+  index.reserve(spineCount);
+  spineFile.seek(0);
+  for (int i = 0; i < spineCount; i++) {
+    const std::string filename = filenameOf(readSpineEntry(spineFile).href);
+    index.push_back({fnvHash64(filename), static_cast<uint16_t>(filename.size()), static_cast<int16_t>(i)});
+  }
+  // Items sharing a file name stay in spine order, so a lookup lands on the first of them
+  std::sort(index.begin(), index.end(), [](const SpineFilenameIndexEntry& a, const SpineFilenameIndexEntry& b) {
+    if (a.filenameHash != b.filenameHash || a.filenameLen != b.filenameLen) {
+      return filenameIndexLess(a.filenameHash, a.filenameLen, b.filenameHash, b.filenameLen);
+    }
+    return a.spineIndex < b.spineIndex;
+  });
+
+  const uint32_t indexOffset = bookFile.position();
+  for (const auto& entry : index) {
+    serialization::writePod(bookFile, entry.filenameHash);
+    serialization::writePod(bookFile, entry.filenameLen);
+    serialization::writePod(bookFile, entry.spineIndex);
+  }
+  if (bookFile.position() != indexOffset + FILENAME_INDEX_RECORD_SIZE * spineCount) {
+    return false;
+  }
+  bookFile.seek(FILENAME_INDEX_OFFSET_POS);
+  serialization::writePod(bookFile, indexOffset);
+  return true;
+}
+
 bool BookMetadataCache::cleanupTmpFiles() const {
   const auto spineBinFile = cachePath + tmpSpineBinFile;
   if (Storage.exists(spineBinFile.c_str())) {
@@ -378,6 +423,7 @@ bool BookMetadataCache::load() {
   }
 
   serialization::readPod(bookFile, lutOffset);
+  serialization::readPod(bookFile, filenameIndexOffset);
   serialization::readPod(bookFile, spineCount);
   serialization::readPod(bookFile, tocCount);
 
@@ -386,6 +432,7 @@ bool BookMetadataCache::load() {
   serialization::readString(bookFile, coreMetadata.language);
   serialization::readString(bookFile, coreMetadata.coverItemHref);
   serialization::readString(bookFile, coreMetadata.textReferenceHref);
+  serialization::readString(bookFile, coreMetadata.series);
 
   loaded = true;
   LOG_DBG("BMC", "Loaded cache data: %d spine, %d TOC entries", spineCount, tocCount);
@@ -411,6 +458,55 @@ BookMetadataCache::SpineEntry BookMetadataCache::getSpineEntry(const int index)
   return readSpineEntry(bookFile);
 }
 
+int BookMetadataCache::findSpineIndexByFilename(const std::string& href) {
+  if (!loaded) {
+    LOG_ERR("BMC", "findSpineIndexByFilename called but cache not loaded");
+    return -1;
+  }
+
+  const std::string filename = filenameOf(href);
+  if (filenameIndexOffset == 0) {
+    for (int i = 0; i < spineCount; i++) {
+      if (filenameOf(getSpineEntry(i).href) == filename) return i;
+    }
+    return -1;
+  }
+
+  const uint64_t targetHash = fnvHash64(filename);
+  const auto targetLen = static_cast<uint16_t>(filename.size());
+  uint64_t hash = 0;
+  uint16_t len = 0;
+  int16_t spineIndex = -1;
+  const auto readRecord = [&](const int i) {
+    bookFile.seek(filenameIndexOffset + FILENAME_INDEX_RECORD_SIZE * i);
+    serialization::readPod(bookFile, hash);
+    serialization::readPod(bookFile, len);
+    serialization::readPod(bookFile, spineIndex);
+  };
+
+  // Lower bound of the target's hash and length
+  int low = 0;
+  int high = spineCount;
+  while (low < high) {
+    const int mid = (low + high) / 2;
+    readRecord(mid);
+    if (filenameIndexLess(hash, len, targetHash, targetLen)) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  // A hash match is confirmed against the spine entry itself
+  for (int i = low; i < spineCount; i++) {
+    readRecord(i);
+    if (hash != targetHash || len != targetLen) break;
+    const int candidate = spineIndex;
+    if (filenameOf(getSpineEntry(candidate).href) == filename) return candidate;
+  }
+  return -1;
+}
+
 BookMetadataCache::TocEntry BookMetadataCache::getTocEntry(const int index) {
   if (!loaded) {
     LOG_ERR("BMC", "getTocEntry called but cache not loaded");
@@ -430,6 +526,31 @@ BookMetadataCache::TocEntry BookMetadataCache::getTocEntry(const int index) {
   return readTocEntry(bookFile);
 }
 
+bool BookMetadataCache::readTocEntries(const int first, const int count,
+                                       const std::function<bool(int index, TocEntry& entry)>& visit) {
+  if (!loaded) {
+    LOG_ERR("BMC", "readTocEntries called but cache not loaded");
+    return false;
+  }
+
+  if (first < 0 || first >= static_cast<int>(tocCount)) {
+    LOG_ERR("BMC", "readTocEntries index %d out of range", first);
+    return false;
+  }
+
+  // TOC entries follow each other in book.bin, so only the first one needs its LUT item
+  bookFile.seek(lutOffset + sizeof(uint32_t) * spineCount + sizeof(uint32_t) * first);
+  uint32_t tocEntryPos;
+  serialization::readPod(bookFile, tocEntryPos);
+  bookFile.seek(tocEntryPos);
+  const int last = std::min(first + count, static_cast<int>(tocCount));
+  for (int i = first; i < last; i++) {
+    TocEntry entry = readTocEntry(bookFile);
+    if (!visit(i, entry)) break;
+  }
+  return true;
+}
+
 BookMetadataCache::SpineEntry BookMetadataCache::readSpineEntry(FsFile& file) const {
   SpineEntry entry;
   serialization::readString(file, entry.href);
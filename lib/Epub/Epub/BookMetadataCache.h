@@ -3,6 +3,7 @@
 #include <HalStorage.h>
 
 #include <algorithm>
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -12,6 +13,7 @@ class BookMetadataCache {
     std::string title;
     std::string author;
     std::string language;
+    std::string series;
     std::string coverItemHref;
     std::string textReferenceHref;
   };
@@ -44,7 +46,8 @@ class BookMetadataCache {
 
  private:
   std::string cachePath;
-  size_t lutOffset;
+  uint32_t lutOffset;
+  uint32_t filenameIndexOffset;
   uint16_t spineCount;
   uint16_t tocCount;
   bool loaded;
@@ -66,6 +69,13 @@ class BookMetadataCache {
 
   static constexpr uint16_t LARGE_SPINE_THRESHOLD = 400;
 
+  // Record of the spine filename index at the end of book.bin, sorted by hash, then spine index
+  struct SpineFilenameIndexEntry {
+    uint64_t filenameHash;
+    uint16_t filenameLen;
+    int16_t spineIndex;
+  };
+
   // FNV-1a 64-bit hash function
   static uint64_t fnvHash64(const std::string& s) {
     uint64_t hash = 14695981039346656037ull;
@@ -76,6 +86,12 @@ class BookMetadataCache {
     return hash;
   }
 
+  static std::string filenameOf(const std::string& href) {
+    const size_t slash = href.find_last_of('/');
+    return slash == std::string::npos ? href : href.substr(slash + 1);
+  }
+
+  bool writeSpineFilenameIndex();
   uint32_t writeSpineEntry(FsFile& file, const SpineEntry& entry) const;
   uint32_t writeTocEntry(FsFile& file, const TocEntry& entry) const;
   SpineEntry readSpineEntry(FsFile& file) const;
@@ -85,7 +101,13 @@ class BookMetadataCache {
   BookMetadata coreMetadata;
 
   explicit BookMetadataCache(std::string cachePath)
-      : cachePath(std::move(cachePath)), lutOffset(0), spineCount(0), tocCount(0), loaded(false), buildMode(false) {}
+      : cachePath(std::move(cachePath)),
+        lutOffset(0),
+        filenameIndexOffset(0),
+        spineCount(0),
+        tocCount(0),
+        loaded(false),
+        buildMode(false) {}
   ~BookMetadataCache() = default;
 
   // Building phase (stream to disk immediately)
@@ -106,6 +128,12 @@ class BookMetadataCache {
   bool load();
   SpineEntry getSpineEntry(int index);
   TocEntry getTocEntry(int index);
+  // Reads up to `count` TOC entries from `first` on in one sequential pass, stopping early when `visit` returns false.
+  // `visit` must not read from the cache itself.
+  bool readTocEntries(int first, int count, const std::function<bool(int index, TocEntry& entry)>& visit);
+  // First spine item whose file name (the part of its href after the last '/') is that of `href`, or -1. Binary
+  // searches the filename index instead of reading every spine entry.
+  int findSpineIndexByFilename(const std::string& href);
   int getSpineCount() const { return spineCount; }
   int getTocCount() const { return tocCount; }
   bool isLoaded() const { return loaded; }
@@ -0,0 +1,946 @@
+#include "SearchIndex.h"
+
+#include <Arduino.h>
+#include <Logging.h>
+#include <Utf8.h>
+#include <esp_task_wdt.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "htmlEntities.h"
+#include "hyphenation/HyphenationCommon.h"
+
+namespace {
+constexpr uint32_t MAGIC = 0x58444953;  // "SIDX"
+constexpr uint8_t VERSION = 1;
+constexpr char TERMS_FILE[] = "/terms.bin";
+constexpr char POSTINGS_FILE[] = "/postings.bin";
+constexpr char TEXT_FILE[] = "/text.bin";
+constexpr char NAMES_FILE[] = "/names.tmp";
+constexpr char RUNS_FILE[] = "/runs.tmp";
+constexpr char MERGE_FILE[] = "/merge.tmp";
+
+// RAM budget of the occurrences collected before they are sorted into a run, and of the merge read buffers
+constexpr size_t RUN_BYTES = 24 * 1024;
+constexpr size_t MERGE_WAYS = 8;
+constexpr size_t IO_BUFFER_SIZE = 512;
+constexpr size_t CURSOR_BUFFER_SIZE = 32;
+// Terms a trailing query word expands to
+constexpr size_t MAX_PREFIX_TERMS = 16;
+constexpr size_t TERM_ENTRY_SIZE = 12;
+
+struct Header {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t reserved[3];
+  uint32_t termCount;
+  uint32_t wordCount;
+  uint32_t namesOffset;
+  uint32_t textSize;
+};
+
+struct Posting {
+  uint32_t word;
+  uint16_t spineIndex;
+  uint32_t charOffset;
+  uint32_t textOffset;
+};
+
+// Latin-1 and Latin Extended-A lower case letters to their base letter; '_' keeps the letter (æ, ð, þ, ĳ, œ)
+constexpr char LATIN1_BASE[] = "aaaaaa_ceeeeiiii_nooooo__uuuuy_y";
+constexpr char LATIN_EXTENDED_A_BASE[] =
+    "aaaaaaccccccccddddeeeeeeeeeegggggggghhhhiiiiiiiiii__jjkkkllllllllllnnnnnnnnnoooooo__rrrrrrssssssssttttttuuuuuuuu"
+    "uuuuwwyyyzzzzzzs";
+static_assert(sizeof(LATIN1_BASE) == 0x20 + 1 && sizeof(LATIN_EXTENDED_A_BASE) == 0x80 + 1,
+              "one letter per code point");
+
+enum class CharKind : uint8_t {
+  Break,   // ends a word
+  Word,    // part of a word
+  Single,  // a word of its own (ideographs, kana)
+  Ignore,  // invisible; words continue across it (soft hyphens, zero-width spaces and joiners, combining marks)
+};
+
+CharKind classify(const uint32_t cp) {
+  if (cp == 0x00AD || (cp >= 0x200B && cp <= 0x200D) || cp == 0x2060 || cp == 0xFEFF || utf8IsCombiningMark(cp)) {
+    return CharKind::Ignore;
+  }
+  if (cp < 0x80) {
+    return (cp >= '0' && cp <= '9') || (cp >= 'a' && cp <= 'z') || (cp >= 'A' && cp <= 'Z') ? CharKind::Word
+                                                                                               : CharKind::Break;
+  }
+  if ((cp >= 0x3040 && cp <= 0x30FF) || (cp >= 0x3400 && cp <= 0x4DBF) || (cp >= 0x4E00 && cp <= 0x9FFF) ||
+      (cp >= 0xF900 && cp <= 0xFAFF)) {
+    return CharKind::Single;
+  }
+  if (cp < 0xC0 || cp == 0xD7 || cp == 0xF7 || (cp >= 0x2000 && cp <= 0x2BFF) || (cp >= 0x3000 && cp <= 0x303F) ||
+      (cp >= 0xFE30 && cp <= 0xFE4F) || (cp >= 0xFF00 && cp <= 0xFF20) || cp >= 0xFFF0) {
+    return CharKind::Break;
+  }
+  return CharKind::Word;
+}
+
+uint32_t fold(uint32_t cp) {
+  cp = toLowerCyrillic(toLowerLatin(cp));
+  if (cp >= 0xE0 && cp <= 0xFF && LATIN1_BASE[cp - 0xE0] != '_') {
+    return LATIN1_BASE[cp - 0xE0];
+  }
+  if (cp >= 0x100 && cp <= 0x17F && LATIN_EXTENDED_A_BASE[cp - 0x100] != '_') {
+    return LATIN_EXTENDED_A_BASE[cp - 0x100];
+  }
+  if (cp >= 0x391 && cp <= 0x3A9 && cp != 0x3A2) {
+    return cp + 0x20;  // Greek capitals
+  }
+  return cp;
+}
+
+// Appends the folded code point unless the term would grow past MAX_TERM_BYTES
+void appendFolded(std::string& term, uint32_t cp) {
+  cp = fold(cp);
+  char bytes[4];
+  size_t length;
+  if (cp < 0x80) {
+    bytes[0] = static_cast<char>(cp);
+    length = 1;
+  } else if (cp < 0x800) {
+    bytes[0] = static_cast<char>(0xC0 | (cp >> 6));
+    bytes[1] = static_cast<char>(0x80 | (cp & 0x3F));
+    length = 2;
+  } else if (cp < 0x10000) {
+    bytes[0] = static_cast<char>(0xE0 | (cp >> 12));
+    bytes[1] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    bytes[2] = static_cast<char>(0x80 | (cp & 0x3F));
+    length = 3;
+  } else {
+    bytes[0] = static_cast<char>(0xF0 | (cp >> 18));
+    bytes[1] = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+    bytes[2] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    bytes[3] = static_cast<char>(0x80 | (cp & 0x3F));
+    length = 4;
+  }
+  if (term.size() + length <= SearchIndex::MAX_TERM_BYTES) {
+    term.append(bytes, length);
+  }
+}
+
+void feedWatchdog() {
+  yield();
+  esp_task_wdt_reset();
+}
+
+void putVarint(std::vector<uint8_t>& out, uint32_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+void encodePosting(std::vector<uint8_t>& out, const Posting& previous, const Posting& posting) {
+  putVarint(out, posting.word - previous.word);
+  putVarint(out, posting.spineIndex - previous.spineIndex);
+  putVarint(out, posting.spineIndex == previous.spineIndex ? posting.charOffset - previous.charOffset
+                                                            : posting.charOffset);
+  putVarint(out, posting.textOffset - previous.textOffset);
+}
+
+// Decodes a posting with `nextByte(uint8_t&)` supplying the bytes
+template <typename NextByte>
+bool decodePosting(NextByte&& nextByte, const Posting& previous, Posting& posting) {
+  uint32_t values[4];
+  for (uint32_t& value : values) {
+    value = 0;
+    uint8_t byte;
+    for (int shift = 0;; shift += 7) {
+      if (shift > 28 || !nextByte(byte)) return false;
+      value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+      if (!(byte & 0x80)) break;
+    }
+  }
+  posting.word = previous.word + values[0];
+  posting.spineIndex = static_cast<uint16_t>(previous.spineIndex + values[1]);
+  posting.charOffset = values[1] == 0 ? previous.charOffset + values[2] : values[2];
+  posting.textOffset = previous.textOffset + values[3];
+  return true;
+}
+
+// Buffered sequential writer; `size` counts everything written
+class BufferedWriter {
+  FsFile& file;
+  std::vector<uint8_t> buffer;
+  size_t used = 0;
+
+ public:
+  uint32_t size = 0;
+  bool ok = true;
+
+  explicit BufferedWriter(FsFile& file) : file(file), buffer(IO_BUFFER_SIZE) {}
+
+  void write(const void* data, size_t length) {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    size += length;
+    while (length > 0) {
+      const size_t chunk = std::min(length, buffer.size() - used);
+      memcpy(buffer.data() + used, bytes, chunk);
+      used += chunk;
+      bytes += chunk;
+      length -= chunk;
+      if (used == buffer.size()) flush();
+    }
+  }
+
+  bool flush() {
+    if (used > 0 && file.write(buffer.data(), used) != used) ok = false;
+    used = 0;
+    return ok;
+  }
+};
+
+// Buffered sequential reader of [start, end) of a file
+class BufferedReader {
+  FsFile file;
+  std::vector<uint8_t> buffer;
+  size_t pos = 0;
+  size_t filled = 0;
+  uint32_t remaining = 0;
+
+ public:
+  bool open(const std::string& path, const uint32_t start, const uint32_t end) {
+    buffer.resize(IO_BUFFER_SIZE);
+    pos = filled = 0;
+    remaining = end - start;
+    return Storage.openFileForRead("SIX", path, file) && file.seekSet(start);
+  }
+
+  bool read(void* out, size_t length) {
+    auto* bytes = static_cast<uint8_t*>(out);
+    while (length > 0) {
+      if (pos == filled) {
+        const size_t want = std::min<size_t>(buffer.size(), remaining);
+        if (want == 0) return false;
+        const int got = file.read(buffer.data(), want);
+        if (got <= 0) return false;
+        filled = static_cast<size_t>(got);
+        remaining -= filled;
+        pos = 0;
+      }
+      const size_t chunk = std::min(length, filled - pos);
+      memcpy(bytes, buffer.data() + pos, chunk);
+      pos += chunk;
+      bytes += chunk;
+      length -= chunk;
+    }
+    return true;
+  }
+};
+
+// A term's postings from one run: u8 term length, term, u16 count, u16 byte length, postings encoded from zero
+struct RunRecord {
+  std::string term;
+  uint16_t count = 0;
+  std::vector<uint8_t> postings;
+
+  bool read(BufferedReader& reader) {
+    uint8_t termLength = 0;
+    uint16_t bytes = 0;
+    if (!reader.read(&termLength, sizeof(termLength))) return false;
+    term.resize(termLength);
+    if (!reader.read(term.data(), termLength) || !reader.read(&count, sizeof(count)) ||
+        !reader.read(&bytes, sizeof(bytes))) {
+      return false;
+    }
+    postings.resize(bytes);
+    return reader.read(postings.data(), bytes);
+  }
+
+  void write(BufferedWriter& writer) const {
+    const auto termLength = static_cast<uint8_t>(term.size());
+    const auto bytes = static_cast<uint16_t>(postings.size());
+    writer.write(&termLength, sizeof(termLength));
+    writer.write(term.data(), term.size());
+    writer.write(&count, sizeof(count));
+    writer.write(&bytes, sizeof(bytes));
+    writer.write(postings.data(), postings.size());
+  }
+};
+
+bool readHeader(FsFile& terms, Header& header) {
+  return terms.read(&header, sizeof(header)) == static_cast<int>(sizeof(header)) && header.magic == MAGIC &&
+         header.version == VERSION;
+}
+
+bool readTerm(FsFile& terms, const Header& header, const uint32_t index, std::string& name, uint32_t& postingsOffset,
+              uint32_t& count) {
+  uint32_t entry[3];
+  if (!terms.seekSet(sizeof(Header) + static_cast<size_t>(index) * TERM_ENTRY_SIZE) ||
+      terms.read(entry, TERM_ENTRY_SIZE) != static_cast<int>(TERM_ENTRY_SIZE)) {
+    return false;
+  }
+  postingsOffset = entry[1];
+  count = entry[2];
+  uint8_t length = 0;
+  if (!terms.seekSet(header.namesOffset + entry[0]) || terms.read(&length, 1) != 1) return false;
+  name.resize(length);
+  return terms.read(name.data(), length) == length;
+}
+
+// Postings of one term, read a few bytes at a time
+class TermCursor {
+  FsFile* file = nullptr;
+  uint32_t pos = 0;
+  uint32_t remaining = 0;
+  uint8_t buffer[CURSOR_BUFFER_SIZE] = {};
+  uint8_t bufferPos = 0;
+  uint8_t bufferLength = 0;
+
+  bool nextByte(uint8_t& byte) {
+    if (bufferPos == bufferLength) {
+      if (!file->seekSet(pos)) return false;
+      const int got = file->read(buffer, sizeof(buffer));
+      if (got <= 0) return false;
+      pos += got;
+      bufferPos = 0;
+      bufferLength = static_cast<uint8_t>(got);
+    }
+    byte = buffer[bufferPos++];
+    return true;
+  }
+
+ public:
+  bool valid = false;
+  Posting current = {};
+
+  void open(FsFile& postings, const uint32_t offset, const uint32_t count) {
+    file = &postings;
+    pos = offset;
+    remaining = count;
+    advance();
+  }
+
+  void advance() {
+    const Posting previous = current;
+    valid = remaining > 0 && decodePosting([this](uint8_t& byte) { return nextByte(byte); }, previous, current);
+    if (remaining > 0) remaining--;
+  }
+};
+
+// Postings of every term one query word matches, merged in book order
+struct WordCursor {
+  std::vector<TermCursor> terms;
+
+  const Posting* head() const {
+    const Posting* best = nullptr;
+    for (const auto& term : terms) {
+      if (term.valid && (!best || term.current.word < best->word)) best = &term.current;
+    }
+    return best;
+  }
+
+  void skipTo(const uint32_t word) {
+    for (auto& term : terms) {
+      while (term.valid && term.current.word < word) term.advance();
+    }
+  }
+};
+}  // namespace
+
+bool SearchIndex::exists(const std::string& dir) {
+  FsFile terms;
+  if (!Storage.exists((dir + TERMS_FILE).c_str()) || !Storage.openFileForRead("SIX", dir + TERMS_FILE, terms)) {
+    return false;
+  }
+  Header header = {};
+  const bool valid = readHeader(terms, header);
+  terms.close();
+  return valid;
+}
+
+std::vector<std::string> SearchIndex::normalize(const std::string& text) {
+  std::vector<std::string> words;
+  std::string word;
+  const auto* p = reinterpret_cast<const unsigned char*>(text.c_str());
+  while (*p) {
+    const uint32_t cp = utf8NextCodepoint(&p);
+    const CharKind kind = classify(cp);
+    if (kind == CharKind::Word) {
+      appendFolded(word, cp);
+    } else if (kind != CharKind::Ignore) {
+      if (!word.empty()) words.push_back(std::move(word));
+      word.clear();
+      if (kind == CharKind::Single) {
+        appendFolded(word, cp);
+        words.push_back(std::move(word));
+        word.clear();
+      }
+    }
+  }
+  if (!word.empty()) words.push_back(std::move(word));
+  return words;
+}
+
+SearchIndex::TermRange SearchIndex::findTerms(FsFile& terms, const uint32_t termCount, const uint32_t namesOffset,
+                                              const std::string& term, const bool prefix) {
+  Header header = {};
+  header.namesOffset = namesOffset;
+  std::string name;
+  uint32_t postingsOffset = 0;
+  uint32_t count = 0;
+  uint32_t low = 0;
+  uint32_t high = termCount;
+  while (low < high) {
+    const uint32_t mid = low + (high - low) / 2;
+    if (!readTerm(terms, header, mid, name, postingsOffset, count)) return {0, 0};
+    if (name < term) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  uint32_t last = low;
+  while (last < termCount && last - low < (prefix ? MAX_PREFIX_TERMS : 1) &&
+         readTerm(terms, header, last, name, postingsOffset, count) &&
+         (prefix ? name.compare(0, term.size(), term) == 0 : name == term)) {
+    last++;
+  }
+  return {low, last};
+}
+
+std::vector<SearchIndex::Hit> SearchIndex::find(const std::string& query, const size_t limit) const {
+  std::vector<Hit> hits;
+  const auto words = normalize(query);
+  if (words.empty() || limit == 0) {
+    return hits;
+  }
+
+  FsFile terms;
+  FsFile postings;
+  Header header = {};
+  if (!Storage.openFileForRead("SIX", dir + TERMS_FILE, terms) || !readHeader(terms, header) ||
+      !Storage.openFileForRead("SIX", dir + POSTINGS_FILE, postings)) {
+    return hits;
+  }
+
+  std::vector<WordCursor> cursors(words.size());
+  for (size_t i = 0; i < words.size(); i++) {
+    const TermRange range = findTerms(terms, header.termCount, header.namesOffset, words[i], i + 1 == words.size());
+    std::string name;
+    uint32_t offset = 0;
+    uint32_t count = 0;
+    for (uint32_t term = range.first; term < range.last; term++) {
+      if (readTerm(terms, header, term, name, offset, count)) {
+        cursors[i].terms.emplace_back();
+        cursors[i].terms.back().open(postings, offset, count);
+      }
+    }
+    if (cursors[i].terms.empty()) {
+      return hits;
+    }
+  }
+
+  // Word numbers of a phrase are consecutive: find a start where every following word is one further on
+  uint32_t target = 0;
+  while (hits.size() < limit) {
+    cursors[0].skipTo(target);
+    const Posting* first = cursors[0].head();
+    if (!first) break;
+    const uint32_t start = first->word;
+    bool matched = true;
+    bool exhausted = false;
+    for (size_t i = 1; i < cursors.size(); i++) {
+      cursors[i].skipTo(start + i);
+      const Posting* next = cursors[i].head();
+      if (!next) {
+        exhausted = true;
+        break;
+      }
+      if (next->word != start + i) {
+        matched = false;
+        target = next->word - i;
+        break;
+      }
+    }
+    if (exhausted) break;
+    if (matched) {
+      hits.push_back({first->spineIndex, first->charOffset, first->textOffset});
+      target = start + 1;
+    }
+  }
+  return hits;
+}
+
+std::string SearchIndex::snippet(const Hit& hit, const size_t before, const size_t after) const {
+  FsFile text;
+  if (!Storage.openFileForRead("SIX", dir + TEXT_FILE, text)) {
+    return "";
+  }
+  const uint32_t start = hit.textOffset > before ? hit.textOffset - before : 0;
+  std::string window(hit.textOffset - start + after, '\0');
+  if (!text.seekSet(start)) {
+    text.close();
+    return "";
+  }
+  const int got = text.read(window.data(), window.size());
+  text.close();
+  if (got <= 0) {
+    return "";
+  }
+  window.resize(utf8SafeTruncateBuffer(window.data(), got));
+
+  // Only whole words, on one line: cut at the last line break before the match and the first one after it
+  size_t from = 0;
+  const size_t match = hit.textOffset - start;
+  const size_t lineStart = window.rfind('\n', match);
+  if (lineStart != std::string::npos) {
+    from = lineStart + 1;
+  } else if (start > 0) {
+    const size_t space = window.find(' ');
+    from = space != std::string::npos && space < match ? space + 1 : match;
+  }
+  size_t to = window.find('\n', match);
+  const bool cutEnd = to == std::string::npos && static_cast<size_t>(got) == hit.textOffset - start + after;
+  if (to == std::string::npos) {
+    to = window.size();
+    if (cutEnd) {
+      const size_t space = window.rfind(' ');
+      if (space != std::string::npos && space > match) to = space;
+    }
+  }
+
+  std::string result;
+  if (from > 0 && window[from - 1] != '\n') result = "\xE2\x80\xA6";
+  result.append(window, from, to - from);
+  if (cutEnd) result += "\xE2\x80\xA6";
+  return result;
+}
+
+SearchIndexBuilder::~SearchIndexBuilder() {
+  freeParser();
+  if (textFile) textFile.close();
+  if (runFile) runFile.close();
+}
+
+void SearchIndexBuilder::removeScratch() const {
+  for (const char* file : {NAMES_FILE, RUNS_FILE, MERGE_FILE}) {
+    Storage.remove((dir + file).c_str());
+  }
+}
+
+bool SearchIndexBuilder::begin() {
+  Storage.mkdir(dir.c_str());
+  // The terms file goes first: without it, a half-written index is never taken for a complete one
+  for (const char* file : {TERMS_FILE, POSTINGS_FILE, TEXT_FILE}) {
+    Storage.remove((dir + file).c_str());
+  }
+  removeScratch();
+  textBuffer.reserve(IO_BUFFER_SIZE);
+  occurrences.reserve(RUN_BYTES / 2 / sizeof(Occurrence));
+  runs.clear();
+  runFileSize = 0;
+  failed = !Storage.openFileForWrite("SIX", dir + TEXT_FILE, textFile) ||
+           !Storage.openFileForWrite("SIX", dir + RUNS_FILE, runFile);
+  return !failed;
+}
+
+void SearchIndexBuilder::freeParser() {
+  if (!parser) return;
+  XML_StopParser(parser, XML_FALSE);
+  XML_SetElementHandler(parser, nullptr, nullptr);
+  XML_SetCharacterDataHandler(parser, nullptr);
+  XML_SetDefaultHandlerExpand(parser, nullptr);
+  XML_ParserFree(parser);
+  parser = nullptr;
+}
+
+bool SearchIndexBuilder::beginItem(const uint16_t index, const size_t size) {
+  if (failed) return false;
+  parser = XML_ParserCreate(nullptr);
+  if (!parser) {
+    LOG_ERR("SIX", "Couldn't allocate memory for parser");
+    return false;
+  }
+  XML_SetUserData(parser, this);
+  XML_SetElementHandler(parser, startElement, endElement);
+  XML_SetCharacterDataHandler(parser, characterData);
+  XML_SetDefaultHandlerExpand(parser, defaultHandlerExpand);
+  offsets.reset(new XPathMap());
+  spineIndex = index;
+  remainingSize = size;
+  bodyDepth = -1;
+  bodyDone = false;
+  return true;
+}
+
+size_t SearchIndexBuilder::write(const uint8_t data) { return write(&data, 1); }
+
+size_t SearchIndexBuilder::write(const uint8_t* buffer, const size_t size) {
+  // A broken item is skipped rather than failing the book; the stream is consumed either way
+  size_t remaining = size;
+  while (parser && remaining > 0) {
+    const size_t chunk = std::min<size_t>(remaining, 1024);
+    void* const buf = XML_GetBuffer(parser, static_cast<int>(chunk));
+    if (!buf) {
+      LOG_ERR("SIX", "Couldn't allocate memory for buffer");
+      freeParser();
+      break;
+    }
+    memcpy(buf, buffer, chunk);
+    remainingSize -= std::min(remainingSize, chunk);
+    if (XML_ParseBuffer(parser, static_cast<int>(chunk), remainingSize == 0) == XML_STATUS_ERROR) {
+      LOG_DBG("SIX", "Parse error in spine item %u at line %lu: %s", spineIndex, XML_GetCurrentLineNumber(parser),
+              XML_ErrorString(XML_GetErrorCode(parser)));
+      freeParser();
+      break;
+    }
+    buffer += chunk;
+    remaining -= chunk;
+  }
+  return size;
+}
+
+bool SearchIndexBuilder::endItem() {
+  freeParser();
+  blockBoundary();
+  offsets.reset();
+  feedWatchdog();
+  return !failed;
+}
+
+void XMLCALL SearchIndexBuilder::startElement(void* userData, const XML_Char* name, const XML_Char**) {
+  auto* self = static_cast<SearchIndexBuilder*>(userData);
+  self->offsets->startElement(name);
+  if (self->bodyDepth < 0) {
+    if (!self->bodyDone && strcmp(name, "body") == 0) self->bodyDepth = 0;
+    return;
+  }
+  self->bodyDepth++;
+  if (XPathMap::isBlock(name)) {
+    self->blockBoundary();
+  } else if (strcmp(name, "br") == 0) {
+    // Snippets show a line break as a space, so they stay one line
+    self->endWord();
+    self->codepointBytes = 0;
+    if (self->lastText != '\n') self->pendingSpace = true;
+  }
+}
+
+void XMLCALL SearchIndexBuilder::endElement(void* userData, const XML_Char* name) {
+  auto* self = static_cast<SearchIndexBuilder*>(userData);
+  self->offsets->endElement();
+  if (self->bodyDepth < 0) return;
+  if (self->bodyDepth == 0) {
+    self->bodyDepth = -1;
+    self->bodyDone = true;
+    self->blockBoundary();
+    return;
+  }
+  self->bodyDepth--;
+  if (XPathMap::isBlock(name)) self->blockBoundary();
+}
+
+void XMLCALL SearchIndexBuilder::characterData(void* userData, const XML_Char* s, const int len) {
+  auto* self = static_cast<SearchIndexBuilder*>(userData);
+  if (self->bodyDepth < 0) return;
+  for (int i = 0; i < len; i++) {
+    self->character(s[i]);
+  }
+}
+
+void XMLCALL SearchIndexBuilder::defaultHandlerExpand(void* userData, const XML_Char* s, const int len) {
+  // HTML entities, expanded as the chapter parser expands them so offsets agree
+  if (len >= 3 && s[0] == '&' && s[len - 1] == ';') {
+    const char* utf8Value = lookupHtmlEntity(s, static_cast<size_t>(len));
+    if (utf8Value != nullptr) {
+      characterData(userData, utf8Value, static_cast<int>(strlen(utf8Value)));
+    } else {
+      characterData(userData, s, len);
+    }
+  }
+}
+
+void SearchIndexBuilder::character(const char c) {
+  offsets->character(c);
+  const auto byte = static_cast<uint8_t>(c);
+
+  if (c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+    endWord();
+    codepointBytes = 0;
+    if (lastText != '\n') pendingSpace = true;
+    return;
+  }
+  if ((byte & 0xC0) == 0x80) {
+    emitText(c);
+    if (codepointBytes > 0) {
+      codepoint = (codepoint << 6) | (byte & 0x3F);
+      if (--codepointBytes == 0) addCodepoint(codepoint);
+    }
+    return;
+  }
+
+  if (pendingSpace) {
+    pendingSpace = false;
+    emitText(' ');
+  }
+  codepointCharOffset = offsets->lastOffset();
+  codepointTextOffset = textOffset;
+  emitText(c);
+  if (byte < 0x80) {
+    codepointBytes = 0;
+    addCodepoint(byte);
+  } else {
+    codepointBytes = byte >= 0xF0 ? 3 : byte >= 0xE0 ? 2 : 1;
+    codepoint = byte & (0x3F >> codepointBytes);
+  }
+}
+
+void SearchIndexBuilder::addCodepoint(const uint32_t cp) {
+  const CharKind kind = classify(cp);
+  if (kind == CharKind::Ignore) return;
+  if (kind == CharKind::Break) {
+    endWord();
+    return;
+  }
+  if (kind == CharKind::Single) endWord();
+  if (word.empty()) {
+    wordCharOffset = codepointCharOffset;
+    wordTextOffset = codepointTextOffset;
+  }
+  appendFolded(word, cp);
+  if (kind == CharKind::Single) endWord();
+}
+
+void SearchIndexBuilder::endWord() {
+  if (word.empty()) return;
+  occurrences.push_back({static_cast<uint32_t>(terms.size()), static_cast<uint8_t>(word.size()), spineIndex,
+                         wordCount++, wordCharOffset, wordTextOffset});
+  terms += word;
+  word.clear();
+  if (terms.size() + occurrences.size() * sizeof(Occurrence) >= RUN_BYTES) {
+    flushRun();
+  }
+}
+
+void SearchIndexBuilder::blockBoundary() {
+  endWord();
+  codepointBytes = 0;
+  pendingSpace = false;
+  if (lastText != '\n') emitText('\n');
+}
+
+void SearchIndexBuilder::emitText(const char c) {
+  textBuffer.push_back(static_cast<uint8_t>(c));
+  textOffset++;
+  lastText = c;
+  if (textBuffer.size() >= IO_BUFFER_SIZE) flushText();
+}
+
+bool SearchIndexBuilder::flushText() {
+  if (!textBuffer.empty() && textFile.write(textBuffer.data(), textBuffer.size()) != textBuffer.size()) {
+    LOG_ERR("SIX", "Failed to write search text");
+    failed = true;
+  }
+  textBuffer.clear();
+  return !failed;
+}
+
+bool SearchIndexBuilder::flushRun() {
+  if (occurrences.empty()) return !failed;
+  const char* base = terms.data();
+  std::sort(occurrences.begin(), occurrences.end(), [base](const Occurrence& a, const Occurrence& b) {
+    const int order = memcmp(base + a.termOffset, base + b.termOffset, std::min(a.termLength, b.termLength));
+    if (order != 0) return order < 0;
+    if (a.termLength != b.termLength) return a.termLength < b.termLength;
+    return a.word < b.word;
+  });
+
+  BufferedWriter writer(runFile);
+  RunRecord record;
+  Posting previous = {};
+  runs.push_back(runFileSize);
+  for (size_t i = 0; i <= occurrences.size(); i++) {
+    const bool sameTerm = i < occurrences.size() && record.count > 0 &&
+                          record.term.compare(0, std::string::npos, base + occurrences[i].termOffset,
+                                              occurrences[i].termLength) == 0;
+    if (!sameTerm && record.count > 0) {
+      record.write(writer);
+      record.count = 0;
+      record.postings.clear();
+      previous = {};
+    }
+    if (i == occurrences.size()) break;
+    const Occurrence& occurrence = occurrences[i];
+    if (record.count == 0) record.term.assign(base + occurrence.termOffset, occurrence.termLength);
+    const Posting posting = {occurrence.word, occurrence.spineIndex, occurrence.charOffset, occurrence.textOffset};
+    encodePosting(record.postings, previous, posting);
+    previous = posting;
+    record.count++;
+  }
+  runFileSize += writer.size;
+  if (!writer.flush()) {
+    LOG_ERR("SIX", "Failed to write search run");
+    failed = true;
+  }
+  occurrences.clear();
+  terms.clear();
+  feedWatchdog();
+  return !failed;
+}
+
+bool SearchIndexBuilder::finish() {
+  endWord();
+  flushText();
+  flushRun();
+  textFile.close();
+  runFile.close();
+  runs.push_back(runFileSize);
+
+  const bool ok = !failed && mergeRuns();
+  removeScratch();
+  if (!ok) {
+    LOG_ERR("SIX", "Failed to build search index in %s", dir.c_str());
+    for (const char* file : {TERMS_FILE, POSTINGS_FILE, TEXT_FILE}) {
+      Storage.remove((dir + file).c_str());
+    }
+    return false;
+  }
+  LOG_DBG("SIX", "Search index: %u words, %u bytes of text", wordCount, textOffset);
+  return true;
+}
+
+void SearchIndexBuilder::abandon() {
+  freeParser();
+  if (textFile) textFile.close();
+  if (runFile) runFile.close();
+  removeScratch();
+  for (const char* file : {TERMS_FILE, POSTINGS_FILE, TEXT_FILE}) {
+    Storage.remove((dir + file).c_str());
+  }
+  failed = true;
+}
+
+bool SearchIndexBuilder::mergeRuns() {
+  const std::string scratchFiles[2] = {dir + RUNS_FILE, dir + MERGE_FILE};
+  int current = 0;
+
+  // Merge rounds keep each term's records in book order, as equal terms are taken from the earliest run first. The
+  // last round joins them into one postings list per term.
+  while (true) {
+    const size_t runCount = runs.size() - 1;
+    const bool last = runCount <= MERGE_WAYS;
+
+    FsFile out;
+    FsFile postingsFile;
+    FsFile namesFile;
+    if (!Storage.openFileForWrite("SIX", last ? dir + TERMS_FILE : scratchFiles[1 - current], out)) return false;
+    if (last && (!Storage.openFileForWrite("SIX", dir + POSTINGS_FILE, postingsFile) ||
+                 !Storage.openFileForWrite("SIX", dir + NAMES_FILE, namesFile))) {
+      return false;
+    }
+    BufferedWriter writer(out);
+    BufferedWriter postingsWriter(postingsFile);
+    BufferedWriter namesWriter(namesFile);
+
+    Header header = {};
+    if (last) {
+      writer.write(&header, sizeof(header));
+    }
+    std::vector<uint32_t> merged;
+    std::string term;
+    uint32_t termPostings = 0;
+    uint32_t termCount = 0;
+    Posting previous = {};
+    const auto endTerm = [&] {
+      if (termCount == 0) return;
+      const uint32_t entry[3] = {namesWriter.size, termPostings, termCount};
+      writer.write(entry, sizeof(entry));
+      const auto length = static_cast<uint8_t>(term.size());
+      namesWriter.write(&length, sizeof(length));
+      namesWriter.write(term.data(), term.size());
+      header.termCount++;
+      termCount = 0;
+    };
+
+    for (size_t first = 0; first < std::max<size_t>(runCount, 1); first += MERGE_WAYS) {
+      const size_t ways = std::min(MERGE_WAYS, runCount - first);
+      std::vector<BufferedReader> readers(ways);
+      std::vector<RunRecord> heads(ways);
+      std::vector<bool> live(ways);
+      for (size_t i = 0; i < ways; i++) {
+        if (!readers[i].open(scratchFiles[current], runs[first + i], runs[first + i + 1])) return false;
+        live[i] = heads[i].read(readers[i]);
+      }
+      merged.push_back(writer.size);
+      size_t written = 0;
+      while (true) {
+        int best = -1;
+        for (size_t i = 0; i < ways; i++) {
+          if (live[i] && (best < 0 || heads[i].term < heads[best].term)) best = static_cast<int>(i);
+        }
+        if (best < 0) break;
+        RunRecord& record = heads[best];
+        if (!last) {
+          record.write(writer);
+        } else {
+          if (termCount == 0 || record.term != term) {
+            endTerm();
+            term = record.term;
+            termPostings = postingsWriter.size;
+            previous = {};
+          }
+          // Re-encode against the term's previous posting, which the run didn't know
+          size_t pos = 0;
+          const auto nextByte = [&record, &pos](uint8_t& byte) {
+            if (pos >= record.postings.size()) return false;
+            byte = record.postings[pos++];
+            return true;
+          };
+          Posting runPrevious = {};
+          std::vector<uint8_t> encoded;
+          for (uint16_t i = 0; i < record.count; i++) {
+            Posting posting;
+            if (!decodePosting(nextByte, runPrevious, posting)) return false;
+            encodePosting(encoded, previous, posting);
+            runPrevious = previous = posting;
+          }
+          postingsWriter.write(encoded.data(), encoded.size());
+          termCount += record.count;
+        }
+        live[best] = heads[best].read(readers[best]);
+        if (++written % 256 == 0) feedWatchdog();
+      }
+    }
+    merged.push_back(writer.size);
+
+    if (!last) {
+      if (!writer.flush()) return false;
+      out.close();
+      runs = std::move(merged);
+      current = 1 - current;
+      continue;
+    }
+
+    endTerm();
+    if (!writer.flush() || !postingsWriter.flush() || !namesWriter.flush()) return false;
+    postingsFile.close();
+    namesFile.close();
+
+    // Names follow the entries; the header goes in last, marking the index complete
+    header.namesOffset = writer.size;
+    BufferedReader names;
+    if (!names.open(dir + NAMES_FILE, 0, namesWriter.size)) return false;
+    uint8_t buffer[IO_BUFFER_SIZE];
+    for (uint32_t remaining = namesWriter.size; remaining > 0;) {
+      const uint32_t chunk = std::min<uint32_t>(remaining, sizeof(buffer));
+      if (!names.read(buffer, chunk)) return false;
+      writer.write(buffer, chunk);
+      remaining -= chunk;
+    }
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.wordCount = wordCount;
+    header.textSize = textOffset;
+    if (!writer.flush() || !out.seekSet(0) || out.write(&header, sizeof(header)) != sizeof(header)) return false;
+    out.close();
+    return true;
+  }
+}
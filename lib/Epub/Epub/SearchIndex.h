@@ -0,0 +1,145 @@
+#pragma once
+#include <HalStorage.h>
+#include <Print.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "XPathMap.h"
+#include "expat.h"
+
+/**
+ * Full-text search over one book, through an inverted index kept in a directory of the book's cache.
+ *
+ * Words are case-folded, stripped of accents and joined across soft hyphens and other invisible break hints, so a
+ * query matches however the publisher hyphenated the text. Each occurrence is recorded with its word number in the
+ * book, its spine item, its character offset within the item (counted as the section's XPath map counts them, so a
+ * section cache of any layout turns it into a page) and its byte offset in a plain text copy of the book used for
+ * snippets. Files:
+ *   - text.bin: the book's body text, whitespace collapsed and one line per block
+ *   - postings.bin: per term, its occurrences in book order as LEB128 varint deltas of the four numbers above; the
+ *     character offset restarts at each spine item
+ *   - terms.bin: header, then one 12-byte entry per term in byte order (u32 name offset, u32 postings offset,
+ *     u32 occurrence count), then the length-prefixed names
+ */
+class SearchIndex {
+ public:
+  struct Hit {
+    uint16_t spineIndex;
+    uint32_t charOffset;
+    uint32_t textOffset;
+  };
+
+  // Longest term stored; longer words are cut, in the index and in queries alike
+  static constexpr size_t MAX_TERM_BYTES = 40;
+
+  explicit SearchIndex(std::string dir) : dir(std::move(dir)) {}
+
+  // True if a complete index exists in `dir`
+  static bool exists(const std::string& dir);
+  // The words of `text` as the index stores them
+  static std::vector<std::string> normalize(const std::string& text);
+
+  // The first `limit` places, in book order, where the words of `query` appear in a row; the last word matches as a
+  // prefix
+  std::vector<Hit> find(const std::string& query, size_t limit) const;
+  // Text around a hit on one line, about `before` bytes ahead of the match and `after` from its start on
+  std::string snippet(const Hit& hit, size_t before = 40, size_t after = 80) const;
+
+ private:
+  std::string dir;
+
+  struct TermRange {
+    uint32_t first;
+    uint32_t last;  // exclusive
+  };
+  // Entries of `term`, or with `prefix` of the terms starting with it
+  static TermRange findTerms(FsFile& terms, uint32_t termCount, uint32_t namesOffset, const std::string& term,
+                             bool prefix);
+};
+
+/**
+ * Builds a SearchIndex from the XHTML of a book's spine items, written to this Print one item after the other.
+ *
+ * Occurrences are collected in a bounded buffer, written out as sorted runs and merged on the card, so memory use
+ * doesn't grow with the book.
+ */
+class SearchIndexBuilder final : public Print {
+ public:
+  explicit SearchIndexBuilder(std::string dir) : dir(std::move(dir)) {}
+  ~SearchIndexBuilder() override;
+  SearchIndexBuilder(const SearchIndexBuilder&) = delete;
+  SearchIndexBuilder& operator=(const SearchIndexBuilder&) = delete;
+
+  bool begin();
+  // The XHTML of spine item `spineIndex`, `size` bytes, is written next
+  bool beginItem(uint16_t spineIndex, size_t size);
+  size_t write(uint8_t) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  bool endItem();
+  // Merges the runs into the index; false if anything failed, in which case no index is left behind
+  bool finish();
+  // Gives up on the build and removes everything written so far
+  void abandon();
+
+ private:
+  struct Occurrence {
+    uint32_t termOffset;  // into `terms`
+    uint8_t termLength;
+    uint16_t spineIndex;
+    uint32_t word;
+    uint32_t charOffset;
+    uint32_t textOffset;
+  };
+
+  std::string dir;
+  bool failed = false;
+  XML_Parser parser = nullptr;
+  size_t remainingSize = 0;
+  std::unique_ptr<XPathMap> offsets;
+  uint16_t spineIndex = 0;
+  int bodyDepth = -1;  // element depth inside <body>, -1 outside
+  bool bodyDone = false;
+
+  // text.bin, buffered
+  FsFile textFile;
+  std::vector<uint8_t> textBuffer;
+  uint32_t textOffset = 0;
+  char lastText = '\n';
+  bool pendingSpace = false;
+
+  // Word being read
+  std::string word;
+  uint32_t wordCharOffset = 0;
+  uint32_t wordTextOffset = 0;
+  uint32_t wordCount = 0;
+  uint32_t codepoint = 0;
+  uint8_t codepointBytes = 0;  // continuation bytes still expected
+  uint32_t codepointCharOffset = 0;
+  uint32_t codepointTextOffset = 0;
+
+  // Current run and the runs written so far
+  std::string terms;
+  std::vector<Occurrence> occurrences;
+  FsFile runFile;
+  std::vector<uint32_t> runs;  // start offsets in the run file, then its end
+  uint32_t runFileSize = 0;
+
+  static void XMLCALL startElement(void* userData, const XML_Char* name, const XML_Char** atts);
+  static void XMLCALL endElement(void* userData, const XML_Char* name);
+  static void XMLCALL characterData(void* userData, const XML_Char* s, int len);
+  static void XMLCALL defaultHandlerExpand(void* userData, const XML_Char* s, int len);
+
+  void freeParser();
+  void blockBoundary();
+  void character(char c);
+  void addCodepoint(uint32_t cp);
+  void endWord();
+  void emitText(char c);
+  bool flushText();
+  bool flushRun();
+  bool mergeRuns();
+  void removeScratch() const;
+};
@@ -3,17 +3,44 @@
 #include <HalStorage.h>
 #include <Logging.h>
 #include <Serialization.h>
+#include <ZipFile.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
 
 #include "Epub/css/CssParser.h"
 #include "Page.h"
+#include "XPathMap.h"
 #include "hyphenation/Hyphenator.h"
 #include "parsers/ChapterHtmlSlimParser.h"
 
 namespace {
-constexpr uint8_t SECTION_FILE_VERSION = 18;
+constexpr uint8_t SECTION_FILE_VERSION = 21;
 constexpr uint32_t HEADER_SIZE = sizeof(uint8_t) + sizeof(int) + sizeof(float) + sizeof(bool) + sizeof(uint8_t) +
                                  sizeof(uint16_t) + sizeof(uint16_t) + sizeof(uint16_t) + sizeof(bool) + sizeof(bool) +
-                                 sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint32_t);
+                                 sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint32_t) +
+                                 sizeof(uint32_t);
+// Version and layout parameters, everything before the page count
+constexpr uint32_t LAYOUT_SIZE = HEADER_SIZE - sizeof(uint16_t) - sizeof(uint32_t) * 4;
+// Header fields holding the offsets of the page LUT and the maps after it
+constexpr uint32_t LUT_OFFSET_POS = LAYOUT_SIZE + sizeof(uint16_t);
+constexpr uint32_t ANCHOR_MAP_OFFSET_POS = LUT_OFFSET_POS + sizeof(uint32_t);
+constexpr uint32_t XPATH_MAP_OFFSET_POS = ANCHOR_MAP_OFFSET_POS + sizeof(uint32_t);
+constexpr uint32_t NOTE_MAP_OFFSET_POS = XPATH_MAP_OFFSET_POS + sizeof(uint32_t);
+
+// Anchor map record: FNV-1a hash and length of the id, then its page. Records are sorted by hash and length, with
+// repeated ids in document order, so the map is binary searched from the card instead of read through.
+struct AnchorRecord {
+  uint64_t hash;
+  uint16_t len;
+  uint16_t page;
+};
+constexpr uint32_t ANCHOR_RECORD_SIZE = sizeof(uint64_t) + sizeof(uint16_t) + sizeof(uint16_t);
+
+bool anchorLess(const uint64_t hashA, const uint16_t lenA, const uint64_t hashB, const uint16_t lenB) {
+  return hashA < hashB || (hashA == hashB && lenA < lenB);
+}
 }  // namespace
 
 uint32_t Section::onPageComplete(std::unique_ptr<Page> page) {
@@ -44,7 +71,8 @@ void Section::writeSectionFileHeader(const int fontId, const float lineCompressi
   static_assert(HEADER_SIZE == sizeof(SECTION_FILE_VERSION) + sizeof(fontId) + sizeof(lineCompression) +
                                    sizeof(extraParagraphSpacing) + sizeof(paragraphAlignment) + sizeof(viewportWidth) +
                                    sizeof(viewportHeight) + sizeof(pageCount) + sizeof(hyphenationEnabled) +
-                                   sizeof(embeddedStyle) + sizeof(imageRendering) + sizeof(uint32_t) + sizeof(uint32_t),
+                                   sizeof(embeddedStyle) + sizeof(imageRendering) + sizeof(uint32_t) +
+                                   sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint32_t),
                 "Header size mismatch");
   serialization::writePod(file, SECTION_FILE_VERSION);
   serialization::writePod(file, fontId);
@@ -59,6 +87,8 @@ void Section::writeSectionFileHeader(const int fontId, const float lineCompressi
   serialization::writePod(file, pageCount);  // Placeholder for page count (will be initially 0, patched later)
   serialization::writePod(file, static_cast<uint32_t>(0));  // Placeholder for LUT offset (patched later)
   serialization::writePod(file, static_cast<uint32_t>(0));  // Placeholder for anchor map offset (patched later)
+  serialization::writePod(file, static_cast<uint32_t>(0));  // Placeholder for XPath map offset (patched later)
+  serialization::writePod(file, static_cast<uint32_t>(0));  // Placeholder for note map offset (patched later)
 }
 
 bool Section::loadSectionFile(const int fontId, const float lineCompression, const bool extraParagraphSpacing,
@@ -111,7 +141,15 @@ bool Section::loadSectionFile(const int fontId, const float lineCompression, con
   }
 
   serialization::readPod(file, pageCount);
+  uint32_t lutOffset = 0;
+  serialization::readPod(file, lutOffset);
   file.close();
+  if (lutOffset == 0) {
+    // Layout stopped part way (the reader left the chapter or lost power); the file is rewritten from the start
+    LOG_DBG("SCT", "Deserialization failed: Section file is partial");
+    pageCount = 0;
+    return false;
+  }
   LOG_DBG("SCT", "Deserialization succeeded: %d pages", pageCount);
   return true;
 }
@@ -132,10 +170,43 @@ bool Section::clearCache() const {
   return true;
 }
 
+// A section file being laid out, from beginSectionFile() until its maps are written or it is abandoned
+struct Section::Build {
+  std::string tmpHtmlPath;  // the parser holds a reference to it
+  std::vector<uint32_t> lut;
+  CssParser* cssParser = nullptr;
+  std::unique_ptr<ChapterHtmlSlimParser> visitor;
+};
+
+Section::Section(const std::shared_ptr<Epub>& epub, const int spineIndex, GfxRenderer& renderer)
+    : epub(epub),
+      spineIndex(spineIndex),
+      renderer(renderer),
+      filePath(epub->getCachePath() + "/sections/" + std::to_string(spineIndex) + ".bin") {}
+
+Section::~Section() {
+  if (build) {
+    LOG_DBG("SCT", "Abandoning section %d after %d pages", spineIndex, pageCount);
+    abandonSectionFile();
+  }
+}
+
 bool Section::createSectionFile(const int fontId, const float lineCompression, const bool extraParagraphSpacing,
                                 const uint8_t paragraphAlignment, const uint16_t viewportWidth,
                                 const uint16_t viewportHeight, const bool hyphenationEnabled, const bool embeddedStyle,
                                 const uint8_t imageRendering, const std::function<void()>& popupFn) {
+  return beginSectionFile(fontId, lineCompression, extraParagraphSpacing, paragraphAlignment, viewportWidth,
+                          viewportHeight, hyphenationEnabled, embeddedStyle, imageRendering, popupFn) &&
+         continueSectionFile(nullptr);
+}
+
+bool Section::beginSectionFile(const int fontId, const float lineCompression, const bool extraParagraphSpacing,
+                               const uint8_t paragraphAlignment, const uint16_t viewportWidth,
+                               const uint16_t viewportHeight, const bool hyphenationEnabled, const bool embeddedStyle,
+                               const uint8_t imageRendering, const std::function<void()>& popupFn) {
+  if (build) {
+    abandonSectionFile();
+  }
   const auto localPath = epub->getSpineItem(spineIndex).href;
   const auto tmpHtmlPath = epub->getCachePath() + "/.tmp_" + std::to_string(spineIndex) + ".html";
 
@@ -182,50 +253,83 @@ bool Section::createSectionFile(const int fontId, const float lineCompression, c
   LOG_DBG("SCT", "Streamed temp HTML to %s (%d bytes)", tmpHtmlPath.c_str(), fileSize);
 
   if (!Storage.openFileForWrite("SCT", filePath, file)) {
+    Storage.remove(tmpHtmlPath.c_str());
     return false;
   }
+  pageCount = 0;
   writeSectionFileHeader(fontId, lineCompression, extraParagraphSpacing, paragraphAlignment, viewportWidth,
                          viewportHeight, hyphenationEnabled, embeddedStyle, imageRendering);
-  std::vector<uint32_t> lut = {};
+  build.reset(new Build());
+  build->tmpHtmlPath = tmpHtmlPath;
 
   // Derive the content base directory and image cache path prefix for the parser
   size_t lastSlash = localPath.find_last_of('/');
   std::string contentBase = (lastSlash != std::string::npos) ? localPath.substr(0, lastSlash + 1) : "";
   std::string imageBasePath = epub->getCachePath() + "/img_" + std::to_string(spineIndex) + "_";
 
-  CssParser* cssParser = nullptr;
   if (embeddedStyle) {
-    cssParser = epub->getCssParser();
-    if (cssParser) {
-      if (!cssParser->loadFromCache()) {
+    build->cssParser = epub->getCssParser();
+    if (build->cssParser) {
+      if (!build->cssParser->loadFromCache()) {
         LOG_ERR("SCT", "Failed to load CSS from cache");
       }
     }
   }
 
-  ChapterHtmlSlimParser visitor(
-      epub, tmpHtmlPath, renderer, fontId, lineCompression, extraParagraphSpacing, paragraphAlignment, viewportWidth,
-      viewportHeight, hyphenationEnabled,
-      [this, &lut](std::unique_ptr<Page> page) { lut.emplace_back(this->onPageComplete(std::move(page))); },
-      embeddedStyle, contentBase, imageBasePath, imageRendering, popupFn, cssParser);
+  build->visitor.reset(new ChapterHtmlSlimParser(
+      epub, build->tmpHtmlPath, renderer, fontId, lineCompression, extraParagraphSpacing, paragraphAlignment,
+      viewportWidth, viewportHeight, hyphenationEnabled,
+      [this](std::unique_ptr<Page> page) { build->lut.emplace_back(this->onPageComplete(std::move(page))); },
+      embeddedStyle, contentBase, imageBasePath, imageRendering, popupFn, build->cssParser));
+  Hyphenator::setPreferredLanguage(epub->getLanguage());
+  if (!build->visitor->beginParsing()) {
+    LOG_ERR("SCT", "Failed to start parsing XML");
+    abandonSectionFile();
+    return false;
+  }
+  return true;
+}
+
+bool Section::continueSectionFile(const std::function<bool()>& stop) {
+  if (!build) {
+    return false;
+  }
+
+  // The hyphenation language is process-wide; another book may have been laid out since the last call
   Hyphenator::setPreferredLanguage(epub->getLanguage());
-  success = visitor.parseAndBuildPages();
+  ChapterHtmlSlimParser::ParseStatus status;
+  do {
+    status = build->visitor->parseNextChunk();
+  } while (status == ChapterHtmlSlimParser::ParseStatus::More && !(stop && stop()));
 
-  Storage.remove(tmpHtmlPath.c_str());
-  if (!success) {
+  if (status == ChapterHtmlSlimParser::ParseStatus::Error) {
     LOG_ERR("SCT", "Failed to parse XML and build pages");
-    file.close();
-    Storage.remove(filePath.c_str());
-    if (cssParser) {
-      cssParser->clear();
-    }
+    abandonSectionFile();
     return false;
   }
+  if (status == ChapterHtmlSlimParser::ParseStatus::More) {
+    return true;
+  }
+  return finishSectionFile();
+}
+
+float Section::layoutProgress() const { return build ? build->visitor->parseProgress() : 1.0f; }
+
+uint16_t Section::estimatedPageCount() const {
+  if (!build) {
+    return pageCount;
+  }
+  // Pages are laid out as the source is parsed, so the share parsed so far scales to the whole chapter
+  const float progress = build->visitor->parseProgress();
+  const float estimate = progress > 0 ? static_cast<float>(pageCount) / progress : 0;
+  return static_cast<uint16_t>(std::min(std::max(estimate, static_cast<float>(pageCount + 1)), 65535.0f));
+}
 
+bool Section::finishSectionFile() {
   const uint32_t lutOffset = file.position();
   bool hasFailedLutRecords = false;
   // Write LUT
-  for (const uint32_t& pos : lut) {
+  for (const uint32_t& pos : build->lut) {
     if (pos == 0) {
       hasFailedLutRecords = true;
       break;
@@ -235,58 +339,130 @@ bool Section::createSectionFile(const int fontId, const float lineCompression, c
 
   if (hasFailedLutRecords) {
     LOG_ERR("SCT", "Failed to write LUT due to invalid page positions");
-    file.close();
-    Storage.remove(filePath.c_str());
+    abandonSectionFile();
     return false;
   }
 
+  ChapterHtmlSlimParser& visitor = *build->visitor;
   // Write anchor-to-page map for fragment navigation (e.g. footnote targets)
   const uint32_t anchorMapOffset = file.position();
   const auto& anchors = visitor.getAnchors();
-  serialization::writePod(file, static_cast<uint16_t>(anchors.size()));
-  for (const auto& [anchor, page] : anchors) {
-    serialization::writeString(file, anchor);
-    serialization::writePod(file, page);
+  const auto anchorCount = static_cast<uint16_t>(std::min<size_t>(anchors.size(), UINT16_MAX));
+  {
+    std::vector<AnchorRecord> records;
+    records.reserve(anchorCount);
+    for (uint16_t i = 0; i < anchorCount; i++) {
+      const auto& [anchor, page] = anchors[i];
+      const uint64_t hash = ZipFile::fnvHash64(anchor.c_str(), anchor.size());
+      records.push_back({hash, static_cast<uint16_t>(anchor.size()), page});
+    }
+    std::stable_sort(records.begin(), records.end(), [](const AnchorRecord& a, const AnchorRecord& b) {
+      return anchorLess(a.hash, a.len, b.hash, b.len);
+    });
+    serialization::writePod(file, anchorCount);
+    for (const auto& record : records) {
+      serialization::writePod(file, record.hash);
+      serialization::writePod(file, record.len);
+      serialization::writePod(file, record.page);
+    }
   }
 
-  // Patch header with final pageCount, lutOffset, and anchorMapOffset
-  file.seek(HEADER_SIZE - sizeof(uint32_t) * 2 - sizeof(pageCount));
+  // Write the text of each note reference's target, so a footnote shows over the page without loading its chapter
+  const uint32_t noteMapOffset = file.position();
+  uint16_t noteCount = 0;
+  serialization::writePod(file, noteCount);
+  visitor.resolveNoteTexts(spineIndex, [this, &noteCount](const std::string& href, const std::string& text) {
+    serialization::writeString(file, href);
+    serialization::writeString(file, text);
+    noteCount++;
+  });
+  Storage.remove(build->tmpHtmlPath.c_str());
+  const uint32_t noteMapEnd = file.position();
+  file.seek(noteMapOffset);
+  serialization::writePod(file, noteCount);
+  file.seek(noteMapEnd);
+
+  // Write the KOReader xpointer map for exact progress sync; 0 leaves sync on percentages
+  uint32_t xpathMapOffset = file.position();
+  if (!visitor.getXPathMap().write(file)) {
+    xpathMapOffset = 0;
+  }
+
+  // Patch header with final pageCount, lutOffset, anchorMapOffset, xpathMapOffset and noteMapOffset
+  file.seek(LAYOUT_SIZE);
   serialization::writePod(file, pageCount);
   serialization::writePod(file, lutOffset);
   serialization::writePod(file, anchorMapOffset);
+  serialization::writePod(file, xpathMapOffset);
+  serialization::writePod(file, noteMapOffset);
   file.close();
-  if (cssParser) {
-    cssParser->clear();
+  if (build->cssParser) {
+    build->cssParser->clear();
   }
+  build.reset();
   return true;
 }
 
+void Section::abandonSectionFile() {
+  // The parser reads the temp file until it is destroyed
+  build->visitor.reset();
+  Storage.remove(build->tmpHtmlPath.c_str());
+  file.close();
+  Storage.remove(filePath.c_str());
+  if (build->cssParser) {
+    build->cssParser->clear();
+  }
+  build.reset();
+}
+
 std::unique_ptr<Page> Section::loadPageFromSectionFile() {
-  if (!Storage.openFileForRead("SCT", filePath, file)) {
+  uint32_t pagePos = 0;
+  if (build) {
+    // Pages of a file still being written are read through a second handle, after the writes so far reach the card
+    if (currentPage < 0 || currentPage >= static_cast<int>(build->lut.size())) {
+      return nullptr;
+    }
+    pagePos = build->lut[currentPage];
+    file.flush();
+  }
+
+  FsFile f;
+  if (!Storage.openFileForRead("SCT", filePath, f)) {
     return nullptr;
   }
 
-  file.seek(HEADER_SIZE - sizeof(uint32_t) * 2);
-  uint32_t lutOffset;
-  serialization::readPod(file, lutOffset);
-  file.seek(lutOffset + sizeof(uint32_t) * currentPage);
-  uint32_t pagePos;
-  serialization::readPod(file, pagePos);
-  file.seek(pagePos);
+  if (!build) {
+    f.seek(LUT_OFFSET_POS);
+    uint32_t lutOffset;
+    serialization::readPod(f, lutOffset);
+    f.seek(lutOffset + sizeof(uint32_t) * currentPage);
+    serialization::readPod(f, pagePos);
+  }
+  f.seek(pagePos);
 
-  auto page = Page::deserialize(file);
-  file.close();
+  auto page = Page::deserialize(f);
+  f.close();
   return page;
 }
 
 std::optional<uint16_t> Section::getPageForAnchor(const std::string& anchor) const {
+  if (build) {
+    // Only anchors on pages laid out in full so far
+    for (const auto& [key, page] : build->visitor->getAnchors()) {
+      if (key == anchor && page < pageCount) {
+        return page;
+      }
+    }
+    return std::nullopt;
+  }
+
   FsFile f;
   if (!Storage.openFileForRead("SCT", filePath, f)) {
     return std::nullopt;
   }
 
   const uint32_t fileSize = f.size();
-  f.seek(HEADER_SIZE - sizeof(uint32_t));
+  f.seek(ANCHOR_MAP_OFFSET_POS);
   uint32_t anchorMapOffset;
   serialization::readPod(f, anchorMapOffset);
   if (anchorMapOffset == 0 || anchorMapOffset >= fileSize) {
@@ -297,17 +473,140 @@ std::optional<uint16_t> Section::getPageForAnchor(const std::string& anchor) con
   f.seek(anchorMapOffset);
   uint16_t count;
   serialization::readPod(f, count);
+  const uint32_t recordsOffset = anchorMapOffset + sizeof(count);
+  if (recordsOffset + ANCHOR_RECORD_SIZE * count > fileSize) {
+    f.close();
+    return std::nullopt;
+  }
+
+  // Lower bound of the anchor's hash and length, which is its first occurrence in the chapter
+  const uint64_t targetHash = ZipFile::fnvHash64(anchor.c_str(), anchor.size());
+  const auto targetLen = static_cast<uint16_t>(anchor.size());
+  AnchorRecord record{};
+  const auto readRecord = [&](const uint32_t i) {
+    f.seek(recordsOffset + ANCHOR_RECORD_SIZE * i);
+    serialization::readPod(f, record.hash);
+    serialization::readPod(f, record.len);
+    serialization::readPod(f, record.page);
+  };
+  uint32_t low = 0;
+  uint32_t high = count;
+  while (low < high) {
+    const uint32_t mid = (low + high) / 2;
+    readRecord(mid);
+    if (anchorLess(record.hash, record.len, targetHash, targetLen)) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  std::optional<uint16_t> page;
+  if (low < count) {
+    readRecord(low);
+    if (record.hash == targetHash && record.len == targetLen) {
+      page = record.page;
+    }
+  }
+  f.close();
+  return page;
+}
+
+std::string Section::getFootnoteText(const std::string& href) const {
+  FsFile f;
+  if (!Storage.openFileForRead("SCT", filePath, f)) {
+    return "";
+  }
+
+  const uint32_t fileSize = f.size();
+  f.seek(NOTE_MAP_OFFSET_POS);
+  uint32_t noteMapOffset = 0;
+  serialization::readPod(f, noteMapOffset);
+  if (noteMapOffset < HEADER_SIZE || noteMapOffset >= fileSize) {
+    f.close();
+    return "";
+  }
+
+  f.seek(noteMapOffset);
+  uint16_t count;
+  serialization::readPod(f, count);
+  std::string key;
+  std::string text;
   for (uint16_t i = 0; i < count; i++) {
-    std::string key;
-    uint16_t page;
     serialization::readString(f, key);
-    serialization::readPod(f, page);
-    if (key == anchor) {
+    serialization::readString(f, text);
+    if (key == href) {
       f.close();
-      return page;
+      return text;
     }
   }
 
   f.close();
-  return std::nullopt;
+  return "";
+}
+
+bool Section::openXPathMap(FsFile& f) const {
+  if (!Storage.openFileForRead("SCT", filePath, f)) {
+    return false;
+  }
+  const uint32_t fileSize = f.size();
+  f.seek(XPATH_MAP_OFFSET_POS);
+  uint32_t xpathMapOffset = 0;
+  serialization::readPod(f, xpathMapOffset);
+  if (xpathMapOffset < HEADER_SIZE || xpathMapOffset >= fileSize) {
+    f.close();
+    return false;
+  }
+  f.seek(xpathMapOffset);
+  return true;
+}
+
+std::optional<uint16_t> Section::getPageForXPath(const std::string& xpath) const {
+  if (XPathMap::spineIndexOf(xpath) != spineIndex) {
+    return std::nullopt;
+  }
+  FsFile f;
+  if (!openXPathMap(f)) {
+    return std::nullopt;
+  }
+  const auto page = XPathMap::findPage(f, xpath);
+  f.close();
+  return page;
+}
+
+std::string Section::getXPathForPage(const uint16_t page) const {
+  FsFile f;
+  if (!openXPathMap(f)) {
+    return "";
+  }
+  std::string xpath = XPathMap::findXPath(f, spineIndex, page);
+  f.close();
+  return xpath;
+}
+
+std::optional<uint16_t> Section::getPageForOffset(const uint32_t offset) const {
+  FsFile f;
+  if (!openXPathMap(f)) {
+    return std::nullopt;
+  }
+  const auto page = XPathMap::findPageForOffset(f, offset);
+  f.close();
+  return page;
+}
+
+bool Section::hasSameLayout(const Section& other) const {
+  uint8_t layout[LAYOUT_SIZE];
+  uint8_t otherLayout[LAYOUT_SIZE];
+  FsFile f;
+  if (!Storage.openFileForRead("SCT", filePath, f)) {
+    return false;
+  }
+  const bool read = f.read(layout, LAYOUT_SIZE) == static_cast<int>(LAYOUT_SIZE);
+  f.close();
+  if (!read || layout[0] != SECTION_FILE_VERSION || !Storage.openFileForRead("SCT", other.filePath, f)) {
+    return false;
+  }
+  const bool otherRead = f.read(otherLayout, LAYOUT_SIZE) == static_cast<int>(LAYOUT_SIZE);
+  f.close();
+  return otherRead && memcmp(layout, otherLayout, LAYOUT_SIZE) == 0;
 }
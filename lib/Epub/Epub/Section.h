@@ -15,22 +15,26 @@ class Section {
   GfxRenderer& renderer;
   std::string filePath;
   FsFile file;
+  // State of a file being laid out, kept between beginSectionFile() and the end of the chapter
+  struct Build;
+  std::unique_ptr<Build> build;
 
   void writeSectionFileHeader(int fontId, float lineCompression, bool extraParagraphSpacing, uint8_t paragraphAlignment,
                               uint16_t viewportWidth, uint16_t viewportHeight, bool hyphenationEnabled,
                               bool embeddedStyle, uint8_t imageRendering);
   uint32_t onPageComplete(std::unique_ptr<Page> page);
+  bool openXPathMap(FsFile& f) const;
+  bool finishSectionFile();
+  void abandonSectionFile();
 
  public:
   uint16_t pageCount = 0;
   int currentPage = 0;
 
-  explicit Section(const std::shared_ptr<Epub>& epub, const int spineIndex, GfxRenderer& renderer)
-      : epub(epub),
-        spineIndex(spineIndex),
-        renderer(renderer),
-        filePath(epub->getCachePath() + "/sections/" + std::to_string(spineIndex) + ".bin") {}
-  ~Section() = default;
+  explicit Section(const std::shared_ptr<Epub>& epub, int spineIndex, GfxRenderer& renderer);
+  // Removes a file still being laid out, which would only be laid out again from the start
+  ~Section();
+  int getSpineIndex() const { return spineIndex; }
   bool loadSectionFile(int fontId, float lineCompression, bool extraParagraphSpacing, uint8_t paragraphAlignment,
                        uint16_t viewportWidth, uint16_t viewportHeight, bool hyphenationEnabled, bool embeddedStyle,
                        uint8_t imageRendering);
@@ -38,8 +42,35 @@ class Section {
   bool createSectionFile(int fontId, float lineCompression, bool extraParagraphSpacing, uint8_t paragraphAlignment,
                          uint16_t viewportWidth, uint16_t viewportHeight, bool hyphenationEnabled, bool embeddedStyle,
                          uint8_t imageRendering, const std::function<void()>& popupFn = nullptr);
+  // createSectionFile() in steps, for showing a page before the whole chapter is laid out. beginSectionFile() opens
+  // the file, then continueSectionFile() lays out pages until `stop` returns true or the chapter ends, when it writes
+  // the maps and completes the header. Pages count into pageCount and load as they complete. Until then the header
+  // has no LUT offset, so a file left part way is rejected by loadSectionFile(). Both return false on failure, which
+  // removes the file.
+  bool beginSectionFile(int fontId, float lineCompression, bool extraParagraphSpacing, uint8_t paragraphAlignment,
+                        uint16_t viewportWidth, uint16_t viewportHeight, bool hyphenationEnabled, bool embeddedStyle,
+                        uint8_t imageRendering, const std::function<void()>& popupFn = nullptr);
+  bool continueSectionFile(const std::function<bool()>& stop);
+  bool isPartial() const { return build != nullptr; }
+  // Share of the chapter laid out so far, 1 once the file is complete
+  float layoutProgress() const;
+  // pageCount, or for a partial file an estimate of the chapter's pages for progress shown before it is complete
+  uint16_t estimatedPageCount() const;
   std::unique_ptr<Page> loadPageFromSectionFile();
 
-  // Look up the page number for an anchor id from the section cache file.
+  // Look up the page number for an anchor id from the section cache file. In a partial file, only anchors on the
+  // pages complete so far are found.
   std::optional<uint16_t> getPageForAnchor(const std::string& anchor) const;
+  // Text of the note a footnote href points to, as found when the section was laid out; empty if unknown.
+  std::string getFootnoteText(const std::string& href) const;
+
+  // KOReader xpointer lookups through the XPath map in the section cache file (see XPathMap).
+  // Page an xpointer into this spine item lands on; nullopt for other spine items or unresolvable paths.
+  std::optional<uint16_t> getPageForXPath(const std::string& xpath) const;
+  // xpointer of the first word on `page`, or empty if the cache file has no map.
+  std::string getXPathForPage(uint16_t page) const;
+  // Page holding the character at `offset`, counted as the XPath map counts them (e.g. a search hit).
+  std::optional<uint16_t> getPageForOffset(uint32_t offset) const;
+  // True if both cache files exist and were laid out with the same settings, so their pages are comparable.
+  bool hasSameLayout(const Section& other) const;
 };
@@ -0,0 +1,93 @@
+#include "TocView.h"
+
+#include <Logging.h>
+#include <Utf8.h>
+
+#include <algorithm>
+
+#include "SearchIndex.h"
+
+namespace {
+// Folded first letter of `text` in a byte: ASCII as is, anything else by the low bits of its code point, which keeps
+// the letters of one alphabet apart
+uint8_t initialOf(const std::string& text) {
+  const auto words = SearchIndex::normalize(text);
+  if (words.empty()) return 0;
+  const auto* p = reinterpret_cast<const unsigned char*>(words.front().c_str());
+  const uint32_t cp = utf8NextCodepoint(&p);
+  return cp < 0x80 ? static_cast<uint8_t>(cp) : static_cast<uint8_t>(0x80 | (cp & 0x7F));
+}
+
+bool startsWith(const std::string& word, const std::string& prefix) {
+  return word.compare(0, prefix.size(), prefix) == 0;
+}
+}  // namespace
+
+const TocView::Item& TocView::item(const int index) {
+  if (index < windowStart || index >= windowStart + static_cast<int>(window.size())) {
+    loadWindow(std::max(0, index - WINDOW_ITEMS / 4));
+  }
+  static const Item none;
+  const int offset = index - windowStart;
+  return offset >= 0 && offset < static_cast<int>(window.size()) ? window[offset] : none;
+}
+
+void TocView::prefetch(const int first, const int count) {
+  const int last = std::min(first + count, size());
+  if (first >= windowStart && last <= windowStart + static_cast<int>(window.size())) {
+    return;
+  }
+  // The window reaches ahead in the direction the list moved, so the next screen that way is read along with this one
+  loadWindow(first >= windowStart ? first : std::max(0, last - WINDOW_ITEMS));
+}
+
+void TocView::loadWindow(const int first) {
+  window.clear();
+  windowStart = first;
+  cache.readTocEntries(first, WINDOW_ITEMS, [this](int, BookMetadataCache::TocEntry& entry) {
+    window.push_back({std::move(entry.title), entry.level, entry.spineIndex});
+    return true;
+  });
+}
+
+bool TocView::loadInitials() {
+  if (!initials.empty() || size() == 0) return !initials.empty();
+  initials.reserve(size());
+  cache.readTocEntries(0, size(), [this](int, BookMetadataCache::TocEntry& entry) {
+    initials.push_back(initialOf(entry.title));
+    return true;
+  });
+  LOG_DBG("TOC", "Read %zu title initials", initials.size());
+  return initials.size() == static_cast<size_t>(size());
+}
+
+int TocView::findInitial(const std::string& query, const int from) {
+  const uint8_t initial = initialOf(query);
+  if (initial == 0 || !loadInitials()) return -1;
+  const int count = static_cast<int>(initials.size());
+  for (int step = 1; step <= count; step++) {
+    const int index = (from + step) % count;
+    if (initials[index] == initial) return index;
+  }
+  return -1;
+}
+
+std::vector<TocView::Match> TocView::search(const std::string& query, const size_t limit) {
+  std::vector<Match> matches;
+  const auto queryWords = SearchIndex::normalize(query);
+  if (queryWords.empty() || size() == 0) return matches;
+
+  cache.readTocEntries(0, size(), [&](const int index, BookMetadataCache::TocEntry& entry) {
+    const auto words = SearchIndex::normalize(entry.title);
+    const bool matched = std::all_of(queryWords.begin(), queryWords.end(), [&words](const std::string& queryWord) {
+      return std::any_of(words.begin(), words.end(),
+                         [&queryWord](const std::string& word) { return startsWith(word, queryWord); });
+    });
+    if (matched) {
+      matches.push_back({index, {std::move(entry.title), entry.level, entry.spineIndex}});
+    }
+    return matches.size() < limit;
+  });
+  LOG_DBG("TOC", "%zu titles match '%s'", matches.size(), query.c_str());
+  return matches;
+}
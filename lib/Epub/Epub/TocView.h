@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "BookMetadataCache.h"
+
+// The table of contents as the chapter list browses it. Entries are decoded a window at a time with one sequential
+// read of book.bin, so drawing a screen of rows touches the card once instead of twice per row. The first letter of
+// every title is kept in RAM, one byte per entry, so jumping to a letter needs no reads once it is known.
+class TocView {
+ public:
+  struct Item {
+    std::string title;
+    uint8_t level = 0;
+    int16_t spineIndex = -1;
+  };
+  struct Match {
+    int tocIndex;
+    Item item;
+  };
+
+  // Entries decoded per read: about two screens of the chapter list
+  static constexpr int WINDOW_ITEMS = 64;
+
+  explicit TocView(BookMetadataCache& cache) : cache(cache) {}
+
+  int size() const { return cache.getTocCount(); }
+  // Makes sure entries `first` to `first + count` are in the window, so drawing them costs at most one read
+  void prefetch(int first, int count);
+  // Entry `index`; the reference holds until the next call
+  const Item& item(int index);
+  // The next entry after `from`, wrapping around, whose title starts with the letter `query` starts with; -1 if none.
+  // The first call reads every title once.
+  int findInitial(const std::string& query, int from);
+  // Entries, in TOC order, with a word starting with each word of `query`, ignoring case and accents
+  std::vector<Match> search(const std::string& query, size_t limit);
+
+ private:
+  BookMetadataCache& cache;
+  int windowStart = 0;
+  std::vector<Item> window;
+  std::vector<uint8_t> initials;
+
+  void loadWindow(int first);
+  bool loadInitials();
+};
@@ -0,0 +1,410 @@
+#include "XPathMap.h"
+
+#include <Logging.h>
+#include <Serialization.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+constexpr char FRAGMENT_PREFIX[] = "/body/DocFragment[";
+constexpr size_t NODE_BATCH = 32;
+constexpr uint16_t MAX_TAGS = 1024;
+constexpr size_t MAX_DEPTH = 256;
+
+// Elements crengine lays out as blocks; whitespace next to their boundaries is dropped rather than collapsed
+const char* BLOCK_TAGS[] = {"body", "html", "p", "div", "h1", "h2", "h3", "h4", "h5", "h6", "li", "ul", "ol", "dl",
+                            "dt", "dd", "table", "thead", "tbody", "tfoot", "tr", "td", "th", "caption", "section",
+                            "article", "aside", "nav", "header", "footer", "figure", "figcaption", "blockquote", "pre",
+                            "hr", "address", "main"};
+
+bool isSpace(const char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; }
+}  // namespace
+
+bool XPathMap::isBlock(const char* name) {
+  for (const char* tag : BLOCK_TAGS) {
+    if (strcmp(name, tag) == 0) return true;
+  }
+  return false;
+}
+
+struct XPathMap::Table {
+  std::vector<std::string> tags;
+  uint32_t nodeCount = 0;
+  size_t nodesStart = 0;
+  std::vector<uint32_t> pages;
+};
+
+XPathMap::~XPathMap() {
+  if (scratchOpen) {
+    scratch.close();
+    Storage.remove(scratchPath.c_str());
+  }
+}
+
+uint16_t XPathMap::tagIndex(const char* name) {
+  for (size_t i = 0; i < tags.size(); i++) {
+    if (tags[i] == name) return static_cast<uint16_t>(i);
+  }
+  if (tags.size() >= MAX_TAGS) {
+    failed = true;
+    return TEXT_NODE;
+  }
+  tags.emplace_back(name);
+  return static_cast<uint16_t>(tags.size() - 1);
+}
+
+void XPathMap::addNode(const uint16_t tag, const uint16_t ordinal) {
+  nodeCount++;
+  if (scratchPath.empty()) return;
+  const uint32_t parent = stack.empty() ? NO_PARENT : stack.back().node;
+  pendingNodes.push_back({charOffset, parent, ordinal, tag});
+  if (pendingNodes.size() >= NODE_BATCH) {
+    flushNodes();
+  }
+}
+
+bool XPathMap::flushNodes() {
+  if (failed) return false;
+  if (pendingNodes.empty()) return true;
+  if (!scratchOpen) {
+    if (!Storage.openFileForWrite("XPM", scratchPath, scratch)) {
+      failed = true;
+      return false;
+    }
+    scratchOpen = true;
+  }
+  const size_t size = pendingNodes.size() * sizeof(Node);
+  if (scratch.write(reinterpret_cast<const uint8_t*>(pendingNodes.data()), size) != size) {
+    LOG_ERR("XPM", "Failed to write XPath nodes");
+    failed = true;
+    return false;
+  }
+  pendingNodes.clear();
+  return true;
+}
+
+void XPathMap::openText() {
+  auto& element = stack.back();
+  if (element.inText) return;
+  element.inText = true;
+  addNode(TEXT_NODE, ++element.textCount);
+}
+
+void XPathMap::flushPendingSpace(const bool keep) {
+  if (!pendingSpace) return;
+  pendingSpace = false;
+  if (keep) {
+    openText();
+    charOffset++;
+  }
+}
+
+void XPathMap::startElement(const char* name) {
+  if (stack.empty()) {
+    if (bodyDone || strcmp(name, "body") != 0) return;
+    addNode(tagIndex(name), 1);
+    stack.push_back({nodeCount - 1, true});
+    atBlockStart = true;
+    return;
+  }
+  if (stack.size() >= MAX_DEPTH) {
+    failed = true;
+    return;
+  }
+
+  const bool block = isBlock(name);
+  flushPendingSpace(!block);
+  if (block) atBlockStart = true;
+
+  auto& parent = stack.back();
+  parent.inText = false;
+  const uint16_t tag = tagIndex(name);
+  uint16_t ordinal = 1;
+  auto count = std::find_if(parent.childCounts.begin(), parent.childCounts.end(),
+                            [tag](const std::pair<uint16_t, uint16_t>& entry) { return entry.first == tag; });
+  if (count == parent.childCounts.end()) {
+    parent.childCounts.emplace_back(tag, 1);
+  } else {
+    ordinal = ++count->second;
+  }
+  addNode(tag, ordinal);
+  stack.push_back({nodeCount - 1, block});
+}
+
+void XPathMap::endElement() {
+  if (stack.empty()) return;
+  const bool block = stack.back().block;
+  flushPendingSpace(!block);
+  if (block) atBlockStart = true;
+  stack.pop_back();
+  if (stack.empty()) {
+    bodyDone = true;
+  } else {
+    stack.back().inText = false;
+  }
+}
+
+void XPathMap::character(const char c) {
+  if (stack.empty()) return;
+  if (isSpace(c)) {
+    // Runs collapse into one space, which is only kept if more inline content follows
+    if (!atBlockStart) pendingSpace = true;
+    return;
+  }
+  // Offsets count code points, so UTF-8 continuation bytes don't advance them
+  if ((static_cast<uint8_t>(c) & 0xC0) == 0x80) return;
+  flushPendingSpace(true);
+  openText();
+  charOffset++;
+  atBlockStart = false;
+}
+
+void XPathMap::text(const char* s, const int len) {
+  for (int i = 0; i < len; i++) {
+    character(s[i]);
+  }
+}
+
+void XPathMap::markPage(const uint16_t page, const uint32_t wordOffset) {
+  if (page < pageOffsets.size()) return;
+  // Pages that never got a word (e.g. a trailing empty page) start where the next one does
+  const uint32_t start = std::max(pageOffsets.empty() ? 0 : pageOffsets.back(), wordOffset);
+  pageOffsets.resize(page + 1, start);
+}
+
+bool XPathMap::write(FsFile& file) {
+  if (!flushNodes() || nodeCount == 0) {
+    return false;
+  }
+  scratch.close();
+  scratchOpen = false;
+
+  serialization::writePod(file, static_cast<uint16_t>(tags.size()));
+  for (const auto& tag : tags) {
+    serialization::writeString(file, tag);
+  }
+  serialization::writePod(file, nodeCount);
+
+  FsFile nodes;
+  bool ok = Storage.openFileForRead("XPM", scratchPath, nodes);
+  uint8_t buffer[NODE_BATCH * sizeof(Node)];
+  size_t remaining = static_cast<size_t>(nodeCount) * sizeof(Node);
+  while (ok && remaining > 0) {
+    const size_t chunk = std::min(remaining, sizeof(buffer));
+    ok = nodes.read(buffer, chunk) == static_cast<int>(chunk) && file.write(buffer, chunk) == chunk;
+    remaining -= chunk;
+  }
+  if (nodes) {
+    nodes.close();
+  }
+  Storage.remove(scratchPath.c_str());
+  if (!ok) {
+    LOG_ERR("XPM", "Failed to copy XPath nodes");
+    return false;
+  }
+
+  serialization::writePod(file, static_cast<uint16_t>(pageOffsets.size()));
+  for (const uint32_t pageOffset : pageOffsets) {
+    serialization::writePod(file, pageOffset);
+  }
+  LOG_DBG("XPM", "XPath map: %u nodes, %u tags, %u pages", nodeCount, static_cast<unsigned>(tags.size()),
+          static_cast<unsigned>(pageOffsets.size()));
+  return true;
+}
+
+bool XPathMap::readTable(FsFile& file, Table& table) {
+  const size_t fileSize = file.size();
+  uint16_t tagCount = 0;
+  serialization::readPod(file, tagCount);
+  if (tagCount > MAX_TAGS) return false;
+  table.tags.resize(tagCount);
+  for (auto& tag : table.tags) {
+    uint32_t length = 0;
+    serialization::readPod(file, length);
+    if (length > 64 || file.position() + length > fileSize) return false;
+    tag.resize(length);
+    if (file.read(&tag[0], length) != static_cast<int>(length)) return false;
+  }
+
+  serialization::readPod(file, table.nodeCount);
+  table.nodesStart = file.position();
+  const size_t nodesEnd = table.nodesStart + static_cast<size_t>(table.nodeCount) * sizeof(Node);
+  if (nodesEnd + sizeof(uint16_t) > fileSize || !file.seek(nodesEnd)) return false;
+
+  uint16_t pageCount = 0;
+  serialization::readPod(file, pageCount);
+  if (nodesEnd + sizeof(uint16_t) + pageCount * sizeof(uint32_t) > fileSize) return false;
+  table.pages.resize(pageCount);
+  const int size = static_cast<int>(pageCount * sizeof(uint32_t));
+  return pageCount == 0 || file.read(table.pages.data(), size) == size;
+}
+
+bool XPathMap::readNodes(FsFile& file, const Table& table, const uint32_t first, Node* nodes, const uint32_t count) {
+  const int size = static_cast<int>(count * sizeof(Node));
+  return file.seek(table.nodesStart + static_cast<size_t>(first) * sizeof(Node)) && file.read(nodes, size) == size;
+}
+
+int XPathMap::spineIndexOf(const std::string& xpath) {
+  constexpr size_t prefixLength = sizeof(FRAGMENT_PREFIX) - 1;
+  if (xpath.compare(0, prefixLength, FRAGMENT_PREFIX) != 0) return -1;
+  char* end;
+  const long fragment = strtol(xpath.c_str() + prefixLength, &end, 10);
+  return *end == ']' && fragment >= 1 ? static_cast<int>(fragment - 1) : -1;
+}
+
+std::optional<uint16_t> XPathMap::findPage(FsFile& file, const std::string& xpath) {
+  if (spineIndexOf(xpath) < 0) return std::nullopt;
+
+  // Split what follows the DocFragment into steps, e.g. body, div[2], p[5], text()[2] and a trailing ".12"
+  struct Step {
+    std::string name;
+    uint16_t ordinal;
+  };
+  std::vector<Step> steps;
+  uint32_t textOffset = 0;
+  size_t pos = xpath.find(']') + 1;
+  while (pos < xpath.size()) {
+    if (xpath[pos] != '/') return std::nullopt;
+    size_t end = xpath.find('/', pos + 1);
+    if (end == std::string::npos) end = xpath.size();
+    std::string step = xpath.substr(pos + 1, end - pos - 1);
+    pos = end;
+    if (pos == xpath.size()) {
+      const size_t dot = step.find_last_of('.');
+      if (dot != std::string::npos && dot + 1 < step.size() &&
+          step.find_first_not_of("0123456789", dot + 1) == std::string::npos) {
+        textOffset = strtoul(step.c_str() + dot + 1, nullptr, 10);
+        step.resize(dot);
+      }
+    }
+    uint16_t ordinal = 1;
+    const size_t bracket = step.find('[');
+    if (bracket != std::string::npos) {
+      ordinal = static_cast<uint16_t>(strtoul(step.c_str() + bracket + 1, nullptr, 10));
+      step.resize(bracket);
+    }
+    if (step.empty() || ordinal == 0) return std::nullopt;
+    steps.push_back({std::move(step), ordinal});
+  }
+  if (steps.empty() || steps.front().name != "body") return std::nullopt;
+
+  Table table;
+  if (!readTable(file, table) || table.pages.empty()) return std::nullopt;
+
+  std::vector<uint16_t> stepTags;
+  for (const auto& step : steps) {
+    if (step.name == "text()") {
+      stepTags.push_back(TEXT_NODE);
+      continue;
+    }
+    const auto tag = std::find(table.tags.begin(), table.tags.end(), step.name);
+    if (tag == table.tags.end()) return std::nullopt;
+    stepTags.push_back(static_cast<uint16_t>(tag - table.tags.begin()));
+  }
+
+  // Nodes come in document order, so each step's node follows the one matched for the step before
+  size_t matched = 0;
+  uint32_t parent = NO_PARENT;
+  uint32_t position = 0;
+  Node batch[NODE_BATCH];
+  for (uint32_t first = 0; first < table.nodeCount && matched < steps.size(); first += NODE_BATCH) {
+    const uint32_t count = std::min<uint32_t>(NODE_BATCH, table.nodeCount - first);
+    if (!readNodes(file, table, first, batch, count)) return std::nullopt;
+    for (uint32_t i = 0; i < count && matched < steps.size(); i++) {
+      const Node& node = batch[i];
+      if (node.parent == parent && node.tag == stepTags[matched] && node.ordinal == steps[matched].ordinal) {
+        parent = first + i;
+        position = node.offset;
+        matched++;
+      }
+    }
+  }
+
+  // Without its text node (crengine kept some whitespace node we dropped) the element start is close enough
+  if (matched == steps.size()) {
+    if (stepTags.back() == TEXT_NODE) position += textOffset;
+  } else if (matched + 1 != steps.size() || stepTags.back() != TEXT_NODE) {
+    LOG_DBG("XPM", "No node for %s", xpath.c_str());
+    return std::nullopt;
+  }
+
+  return pageAt(table, position);
+}
+
+uint16_t XPathMap::pageAt(const Table& table, const uint32_t offset) {
+  const auto page = std::upper_bound(table.pages.begin(), table.pages.end(), offset);
+  return static_cast<uint16_t>(page == table.pages.begin() ? 0 : page - table.pages.begin() - 1);
+}
+
+std::optional<uint16_t> XPathMap::findPageForOffset(FsFile& file, const uint32_t offset) {
+  Table table;
+  if (!readTable(file, table) || table.pages.empty()) return std::nullopt;
+  return pageAt(table, offset);
+}
+
+std::string XPathMap::findXPath(FsFile& file, const int spineIndex, const uint16_t page) {
+  Table table;
+  if (!readTable(file, table) || page >= table.pages.size() || table.nodeCount == 0) return "";
+  const uint32_t target = table.pages[page];
+
+  // Last node starting at or before the page's first word: the text node (or empty element) holding it
+  uint32_t low = 0;
+  uint32_t high = table.nodeCount;
+  while (low < high) {
+    const uint32_t middle = low + (high - low) / 2;
+    Node node;
+    if (!readNodes(file, table, middle, &node, 1)) return "";
+    if (node.offset <= target) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  if (low == 0) return "";
+
+  std::vector<std::pair<uint32_t, Node>> path;  // deepest first
+  for (uint32_t index = low - 1; index != NO_PARENT;) {
+    Node node;
+    if (path.size() >= MAX_DEPTH || !readNodes(file, table, index, &node, 1)) return "";
+    if (node.parent != NO_PARENT && node.parent >= index) return "";
+    path.emplace_back(index, node);
+    index = node.parent;
+  }
+
+  // An index is only written when the parent has several children of that kind. Later siblings come after the
+  // deepest node in document order, so one forward scan settles every first-of-its-kind step.
+  std::vector<bool> indexed(path.size());
+  size_t unsettled = 0;
+  for (size_t i = 0; i + 1 < path.size(); i++) {
+    indexed[i] = path[i].second.ordinal > 1;
+    if (!indexed[i]) unsettled++;
+  }
+  Node batch[NODE_BATCH];
+  for (uint32_t first = path.front().first + 1; first < table.nodeCount && unsettled > 0; first += NODE_BATCH) {
+    const uint32_t count = std::min<uint32_t>(NODE_BATCH, table.nodeCount - first);
+    if (!readNodes(file, table, first, batch, count)) return "";
+    for (uint32_t j = 0; j < count && unsettled > 0; j++) {
+      for (size_t i = 0; i + 1 < path.size(); i++) {
+        if (!indexed[i] && batch[j].parent == path[i].second.parent && batch[j].tag == path[i].second.tag) {
+          indexed[i] = true;
+          unsettled--;
+        }
+      }
+    }
+  }
+
+  std::string xpath = FRAGMENT_PREFIX + std::to_string(spineIndex + 1) + "]";
+  for (size_t i = path.size(); i-- > 0;) {
+    const Node& node = path[i].second;
+    if (node.tag != TEXT_NODE && node.tag >= table.tags.size()) return "";
+    xpath += '/';
+    xpath += node.tag == TEXT_NODE ? "text()" : table.tags[node.tag];
+    if (indexed[i]) xpath += "[" + std::to_string(node.ordinal) + "]";
+  }
+  if (path.front().second.tag == TEXT_NODE) {
+    xpath += "." + std::to_string(target - path.front().second.offset);
+  }
+  return xpath;
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <HalStorage.h>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Maps KOReader xpointers into one spine item to section pages and back.
+ *
+ * KOReader positions are DOM paths into the chapter such as /body/DocFragment[3]/body/div/p[5]/text().12, where
+ * DocFragment is the 1-based spine item, element indices count same-name siblings (left out when there is only one)
+ * and the offset counts characters after crengine's whitespace collapsing. While a section is laid out, every element
+ * and text node inside <body> is recorded with the character offset it starts at, together with the offset of the
+ * first word on each page, so converting a position either way is a lookup instead of a percentage estimate.
+ *
+ * Nodes are streamed to a scratch file during parsing, so memory stays proportional to the nesting depth, and
+ * write() appends the finished table to the section file. Without a scratch path nothing is recorded and the map only
+ * counts offsets, for readers of the document that need positions matching the section's (e.g. search).
+ *   - u16 tag count, then the tag names
+ *   - u32 node count, then 12-byte nodes in document order: u32 offset, u32 parent, u16 sibling ordinal, u16 tag
+ *   - u16 page count, then the u32 offset of the first word on each page
+ */
+class XPathMap {
+ public:
+  XPathMap() = default;
+  explicit XPathMap(std::string scratchPath) : scratchPath(std::move(scratchPath)) {}
+  ~XPathMap();
+  XPathMap(const XPathMap&) = delete;
+  XPathMap& operator=(const XPathMap&) = delete;
+
+  // Document structure, fed from the expat callbacks before the layout filters anything out
+  void startElement(const char* name);
+  void endElement();
+  // One byte of document text; generated text (bullets, table headers, alt text) must not be fed
+  void character(char c);
+  void text(const char* s, int len);
+
+  // Character offset the next document character will get
+  uint32_t offset() const { return charOffset; }
+  // Offset of the document character fed last
+  uint32_t lastOffset() const { return charOffset > 0 ? charOffset - 1 : 0; }
+  // The first word on `page` starts at `wordOffset`; only the first call for a page counts
+  void markPage(uint16_t page, uint32_t wordOffset);
+
+  // Appends the table to `file`. False if recording failed; nothing is written then.
+  bool write(FsFile& file);
+
+  // Whether crengine lays the element out as a block
+  static bool isBlock(const char* name);
+  // 0-based spine index of an xpointer's DocFragment, or -1 if it has none
+  static int spineIndexOf(const std::string& xpath);
+  // Page an xpointer lands on, reading the table at the current position of `file`
+  static std::optional<uint16_t> findPage(FsFile& file, const std::string& xpath);
+  // Page holding the document character at `offset`, reading the table at the current position of `file`
+  static std::optional<uint16_t> findPageForOffset(FsFile& file, uint32_t offset);
+  // xpointer of the first word on `page`, reading the table at the current position of `file`; empty if unknown
+  static std::string findXPath(FsFile& file, int spineIndex, uint16_t page);
+
+ private:
+  static constexpr uint16_t TEXT_NODE = 0xFFFF;
+  static constexpr uint32_t NO_PARENT = 0xFFFFFFFF;
+
+  struct Node {
+    uint32_t offset;
+    uint32_t parent;
+    uint16_t ordinal;  // 1-based among siblings with the same tag
+    uint16_t tag;      // index into the tag names, or TEXT_NODE
+  };
+  static_assert(sizeof(Node) == 12, "Node is stored as is");
+
+  struct OpenElement {
+    uint32_t node;
+    bool block;
+    bool inText = false;  // a text node is open and takes further characters
+    uint16_t textCount = 0;
+    std::vector<std::pair<uint16_t, uint16_t>> childCounts;  // <tag, count>
+  };
+
+  struct Table;
+  static bool readTable(FsFile& file, Table& table);
+  static bool readNodes(FsFile& file, const Table& table, uint32_t first, Node* nodes, uint32_t count);
+  static uint16_t pageAt(const Table& table, uint32_t offset);
+
+  uint16_t tagIndex(const char* name);
+  void addNode(uint16_t tag, uint16_t ordinal);
+  void openText();
+  void flushPendingSpace(bool keep);
+  bool flushNodes();
+
+  std::string scratchPath;
+  FsFile scratch;
+  bool scratchOpen = false;
+  bool failed = false;
+  std::vector<OpenElement> stack;
+  std::vector<std::string> tags;
+  std::vector<Node> pendingNodes;
+  uint32_t nodeCount = 0;
+  uint32_t charOffset = 0;
+  bool atBlockStart = true;
+  bool pendingSpace = false;
+  bool bodyDone = false;  // only the first <body> is mapped
+  std::vector<uint32_t> pageOffsets;
+};
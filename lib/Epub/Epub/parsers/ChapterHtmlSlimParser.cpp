@@ -12,6 +12,7 @@
 #include "../converters/ImageDecoderFactory.h"
 #include "../converters/ImageToFramebufferDecoder.h"
 #include "../htmlEntities.h"
+#include "NoteTextParser.h"
 
 const char* HEADER_TAGS[] = {"h1", "h2", "h3", "h4", "h5", "h6"};
 constexpr int NUM_HEADER_TAGS = sizeof(HEADER_TAGS) / sizeof(HEADER_TAGS[0]);
@@ -35,6 +36,10 @@ constexpr int NUM_UNDERLINE_TAGS = sizeof(UNDERLINE_TAGS) / sizeof(UNDERLINE_TAG
 const char* IMAGE_TAGS[] = {"img"};
 constexpr int NUM_IMAGE_TAGS = sizeof(IMAGE_TAGS) / sizeof(IMAGE_TAGS[0]);
 
+// Note texts are looked up for at most this many references per chapter, in at most this many other chapters
+constexpr size_t MAX_NOTES_PER_CHAPTER = 200;
+constexpr size_t MAX_NOTE_FILES = 3;
+
 const char* SKIP_TAGS[] = {"head"};
 constexpr int NUM_SKIP_TAGS = sizeof(SKIP_TAGS) / sizeof(SKIP_TAGS[0]);
 
@@ -119,7 +124,7 @@ void ChapterHtmlSlimParser::flushPartWordBuffer() {
 
   // flush the buffer
   partWordBuffer[partWordBufferIndex] = '\0';
-  currentTextBlock->addWord(partWordBuffer, fontStyle, false, nextWordContinues);
+  currentTextBlock->addWord(partWordBuffer, fontStyle, false, nextWordContinues, partWordOffset);
   partWordBufferIndex = 0;
   nextWordContinues = false;
 }
@@ -155,6 +160,7 @@ void ChapterHtmlSlimParser::startNewTextBlock(const BlockStyle& blockStyle) {
 
 void XMLCALL ChapterHtmlSlimParser::startElement(void* userData, const XML_Char* name, const XML_Char** atts) {
   auto* self = static_cast<ChapterHtmlSlimParser*>(userData);
+  self->xpathMap.startElement(name);
 
   // Middle of skip
   if (self->skipUntilDepth < self->depth) {
@@ -233,7 +239,9 @@ void XMLCALL ChapterHtmlSlimParser::startElement(void* userData, const XML_Char*
     headerStyle.underline = false;
     self->inlineStyleStack.push_back(headerStyle);
     self->updateEffectiveInlineStyle();
+    self->sourceText = false;
     self->characterData(userData, headerText.c_str(), static_cast<int>(headerText.length()));
+    self->sourceText = true;
     if (self->partWordBufferIndex > 0) {
       self->flushPartWordBuffer();
     }
@@ -410,6 +418,7 @@ void XMLCALL ChapterHtmlSlimParser::startElement(void* userData, const XML_Char*
                   LOG_ERR("EHP", "Failed to create ImageBlock");
                   return;
                 }
+                self->xpathMap.markPage(self->completedPageCount, self->xpathMap.offset());
                 int xPos = (self->viewportWidth - displayWidth) / 2;
                 auto pageImage = std::make_shared<PageImage>(imageBlock, xPos, self->currentPageNextY);
                 if (!pageImage) {
@@ -438,7 +447,9 @@ void XMLCALL ChapterHtmlSlimParser::startElement(void* userData, const XML_Char*
         self->startNewTextBlock(centeredBlockStyle);
         self->italicUntilDepth = std::min(self->italicUntilDepth, self->depth);
         self->depth += 1;
+        self->sourceText = false;
         self->characterData(userData, alt.c_str(), alt.length());
+        self->sourceText = true;
         // Skip any child content (skip until parent as we pre-advanced depth above)
         self->skipUntilDepth = self->depth - 1;
         return;
@@ -498,6 +509,10 @@ void XMLCALL ChapterHtmlSlimParser::startElement(void* userData, const XML_Char*
       self->currentFootnoteLinkHref[sizeof(self->currentFootnoteLinkHref) - 1] = '\0';
       self->currentFootnoteLinkText[0] = '\0';
       self->currentFootnoteLinkTextLen = 0;
+      const char* epubType = getAttribute(atts, "epub:type");
+      const char* role = getAttribute(atts, "role");
+      self->currentFootnoteLinkIsNoteref =
+          (epubType && strstr(epubType, "noteref")) || (role && strcmp(role, "doc-noteref") == 0);
 
       // Apply underline style to visually indicate the link
       self->underlineUntilDepth = std::min(self->underlineUntilDepth, self->depth);
@@ -553,7 +568,7 @@ void XMLCALL ChapterHtmlSlimParser::startElement(void* userData, const XML_Char*
       self->updateEffectiveInlineStyle();
 
       if (strcmp(name, "li") == 0) {
-        self->currentTextBlock->addWord("\xe2\x80\xa2", EpdFontFamily::REGULAR);
+        self->currentTextBlock->addWord("\xe2\x80\xa2", EpdFontFamily::REGULAR, false, false, self->xpathMap.offset());
       }
     }
   } else if (matches(name, UNDERLINE_TAGS, NUM_UNDERLINE_TAGS)) {
@@ -656,6 +671,11 @@ void XMLCALL ChapterHtmlSlimParser::startElement(void* userData, const XML_Char*
 void XMLCALL ChapterHtmlSlimParser::characterData(void* userData, const XML_Char* s, const int len) {
   auto* self = static_cast<ChapterHtmlSlimParser*>(userData);
 
+  // Text that isn't laid out still moves KOReader's character offsets
+  if (self->sourceText && (self->tableDepth > 1 || self->skipUntilDepth < self->depth)) {
+    self->xpathMap.text(s, len);
+  }
+
   // Skip content of nested table
   if (self->tableDepth > 1) {
     return;
@@ -680,6 +700,11 @@ void XMLCALL ChapterHtmlSlimParser::characterData(void* userData, const XML_Char
   }
 
   for (int i = 0; i < len; i++) {
+    // Bytes skipped below are always UTF-8 continuation bytes, which don't move the offsets
+    if (self->sourceText) {
+      self->xpathMap.character(s[i]);
+    }
+
     if (isWhitespace(s[i])) {
       // Currently looking at whitespace, if there's anything in the partWordBuffer, flush it
       if (self->partWordBufferIndex > 0) {
@@ -717,6 +742,7 @@ void XMLCALL ChapterHtmlSlimParser::characterData(void* userData, const XML_Char
       self->partWordBuffer[0] = ' ';
       self->partWordBuffer[1] = '\0';
       self->partWordBufferIndex = 1;
+      self->partWordOffset = self->textOffset();
       self->nextWordContinues = true;  // Attach space to previous word (no break).
       self->flushPartWordBuffer();
 
@@ -736,6 +762,7 @@ void XMLCALL ChapterHtmlSlimParser::characterData(void* userData, const XML_Char
       self->partWordBuffer[0] = ' ';
       self->partWordBuffer[1] = '\0';
       self->partWordBufferIndex = 1;
+      self->partWordOffset = self->textOffset();
       self->nextWordContinues = true;
       self->flushPartWordBuffer();
 
@@ -780,11 +807,15 @@ void XMLCALL ChapterHtmlSlimParser::characterData(void* userData, const XML_Char
           self->partWordBuffer[j] = saved[j];
         }
         self->partWordBufferIndex = overflow;
+        self->partWordOffset = self->textOffset();
       } else {
         self->flushPartWordBuffer();
       }
     }
 
+    if (self->partWordBufferIndex == 0) {
+      self->partWordOffset = self->textOffset();
+    }
     self->partWordBuffer[self->partWordBufferIndex++] = s[i];
   }
 
@@ -822,6 +853,7 @@ void XMLCALL ChapterHtmlSlimParser::defaultHandlerExpand(void* userData, const X
 
 void XMLCALL ChapterHtmlSlimParser::endElement(void* userData, const XML_Char* name) {
   auto* self = static_cast<ChapterHtmlSlimParser*>(userData);
+  self->xpathMap.endElement();
 
   // Check if any style state will change after we decrement depth
   // If so, we MUST flush the partWordBuffer with the CURRENT style first
@@ -876,6 +908,19 @@ void XMLCALL ChapterHtmlSlimParser::endElement(void* userData, const XML_Char* n
       int wordIndex =
           self->wordsExtractedInBlock + (self->currentTextBlock ? static_cast<int>(self->currentTextBlock->size()) : 0);
       self->pendingFootnotes.push_back({wordIndex, entry});
+
+      // Marked note references get their target's text for preview. Only when the chapter marks none are links
+      // labelled like a note ("12", "*", "iv") taken instead; the first marked one drops those guesses.
+      if (self->currentFootnoteLinkIsNoteref && !self->noteHrefsMarked) {
+        self->noteHrefs.clear();
+        self->noteHrefsMarked = true;
+      }
+      const bool noteLike = self->noteHrefsMarked ? self->currentFootnoteLinkIsNoteref
+                                                  : NoteTextParser::looksLikeNoteLabel(entry.number);
+      if (noteLike && strchr(entry.href, '#') && self->noteHrefs.size() < MAX_NOTES_PER_CHAPTER &&
+          std::find(self->noteHrefs.begin(), self->noteHrefs.end(), entry.href) == self->noteHrefs.end()) {
+        self->noteHrefs.emplace_back(entry.href);
+      }
     }
     self->insideFootnoteLink = false;
   }
@@ -944,6 +989,24 @@ void XMLCALL ChapterHtmlSlimParser::endElement(void* userData, const XML_Char* n
 }
 
 bool ChapterHtmlSlimParser::parseAndBuildPages() {
+  if (!beginParsing()) {
+    return false;
+  }
+
+  // Compute the time taken to parse and build pages
+  const uint32_t chapterStartTime = millis();
+  ParseStatus status;
+  do {
+    status = parseNextChunk();
+  } while (status == ParseStatus::More);
+  LOG_DBG("EHP", "Time to parse and build pages: %lu ms", millis() - chapterStartTime);
+
+  return status == ParseStatus::Done;
+}
+
+ChapterHtmlSlimParser::~ChapterHtmlSlimParser() { stopParsing(); }
+
+bool ChapterHtmlSlimParser::beginParsing() {
   auto paragraphAlignmentBlockStyle = BlockStyle();
   paragraphAlignmentBlockStyle.textAlignDefined = true;
   // Resolve None sentinel to Justify for initial block (no CSS context yet)
@@ -953,79 +1016,66 @@ bool ChapterHtmlSlimParser::parseAndBuildPages() {
   paragraphAlignmentBlockStyle.alignment = align;
   startNewTextBlock(paragraphAlignmentBlockStyle);
 
-  const XML_Parser parser = XML_ParserCreate(nullptr);
-  int done;
-
-  if (!parser) {
-    LOG_ERR("EHP", "Couldn't allocate memory for parser");
+  xmlParser = XML_ParserCreate(nullptr);
+  if (!xmlParser) {
+    LOG_ERR("EHP", "Couldn't allocate memory for xmlParser");
     return false;
   }
 
   // Handle HTML entities (like &nbsp;) that aren't in XML spec or DTD
   // Using DefaultHandlerExpand preserves normal entity expansion from DOCTYPE
-  XML_SetDefaultHandlerExpand(parser, defaultHandlerExpand);
+  XML_SetDefaultHandlerExpand(xmlParser, defaultHandlerExpand);
 
-  FsFile file;
-  if (!Storage.openFileForRead("EHP", filepath, file)) {
-    XML_ParserFree(parser);
+  if (!Storage.openFileForRead("EHP", filepath, sourceFile)) {
+    stopParsing();
     return false;
   }
+  fileSize = sourceFile.size();
 
   // Get file size to decide whether to show indexing popup.
-  if (popupFn && file.size() >= MIN_SIZE_FOR_POPUP) {
+  if (popupFn && fileSize >= MIN_SIZE_FOR_POPUP) {
     popupFn();
   }
 
-  XML_SetUserData(parser, this);
-  XML_SetElementHandler(parser, startElement, endElement);
-  XML_SetCharacterDataHandler(parser, characterData);
+  XML_SetUserData(xmlParser, this);
+  XML_SetElementHandler(xmlParser, startElement, endElement);
+  XML_SetCharacterDataHandler(xmlParser, characterData);
+  return true;
+}
 
-  // Compute the time taken to parse and build pages
-  const uint32_t chapterStartTime = millis();
-  do {
-    void* const buf = XML_GetBuffer(parser, PARSE_BUFFER_SIZE);
-    if (!buf) {
-      LOG_ERR("EHP", "Couldn't allocate memory for buffer");
-      XML_StopParser(parser, XML_FALSE);                // Stop any pending processing
-      XML_SetElementHandler(parser, nullptr, nullptr);  // Clear callbacks
-      XML_SetCharacterDataHandler(parser, nullptr);
-      XML_ParserFree(parser);
-      file.close();
-      return false;
-    }
+ChapterHtmlSlimParser::ParseStatus ChapterHtmlSlimParser::parseNextChunk() {
+  if (!xmlParser) {
+    return ParseStatus::Error;
+  }
 
-    const size_t len = file.read(buf, PARSE_BUFFER_SIZE);
+  void* const buf = XML_GetBuffer(xmlParser, PARSE_BUFFER_SIZE);
+  if (!buf) {
+    LOG_ERR("EHP", "Couldn't allocate memory for buffer");
+    stopParsing();
+    return ParseStatus::Error;
+  }
 
-    if (len == 0 && file.available() > 0) {
-      LOG_ERR("EHP", "File read error");
-      XML_StopParser(parser, XML_FALSE);                // Stop any pending processing
-      XML_SetElementHandler(parser, nullptr, nullptr);  // Clear callbacks
-      XML_SetCharacterDataHandler(parser, nullptr);
-      XML_ParserFree(parser);
-      file.close();
-      return false;
-    }
+  const size_t len = sourceFile.read(buf, PARSE_BUFFER_SIZE);
 
-    done = file.available() == 0;
-
-    if (XML_ParseBuffer(parser, static_cast<int>(len), done) == XML_STATUS_ERROR) {
-      LOG_ERR("EHP", "Parse error at line %lu:\n%s", XML_GetCurrentLineNumber(parser),
-              XML_ErrorString(XML_GetErrorCode(parser)));
-      XML_StopParser(parser, XML_FALSE);                // Stop any pending processing
-      XML_SetElementHandler(parser, nullptr, nullptr);  // Clear callbacks
-      XML_SetCharacterDataHandler(parser, nullptr);
-      XML_ParserFree(parser);
-      file.close();
-      return false;
-    }
-  } while (!done);
-  LOG_DBG("EHP", "Time to parse and build pages: %lu ms", millis() - chapterStartTime);
+  if (len == 0 && sourceFile.available() > 0) {
+    LOG_ERR("EHP", "File read error");
+    stopParsing();
+    return ParseStatus::Error;
+  }
+
+  const bool done = sourceFile.available() == 0;
+  bytesParsed += len;
 
-  XML_StopParser(parser, XML_FALSE);                // Stop any pending processing
-  XML_SetElementHandler(parser, nullptr, nullptr);  // Clear callbacks
-  XML_SetCharacterDataHandler(parser, nullptr);
-  XML_ParserFree(parser);
-  file.close();
+  if (XML_ParseBuffer(xmlParser, static_cast<int>(len), done) == XML_STATUS_ERROR) {
+    LOG_ERR("EHP", "Parse error at line %lu:\n%s", XML_GetCurrentLineNumber(xmlParser),
+            XML_ErrorString(XML_GetErrorCode(xmlParser)));
+    stopParsing();
+    return ParseStatus::Error;
+  }
+  if (!done) {
+    return ParseStatus::More;
+  }
+  stopParsing();
 
   // Process last page if there is still text
   if (currentTextBlock) {
@@ -1040,7 +1090,79 @@ bool ChapterHtmlSlimParser::parseAndBuildPages() {
     currentTextBlock.reset();
   }
 
-  return true;
+  return ParseStatus::Done;
+}
+
+void ChapterHtmlSlimParser::stopParsing() {
+  if (xmlParser) {
+    XML_StopParser(xmlParser, XML_FALSE);                // Stop any pending processing
+    XML_SetElementHandler(xmlParser, nullptr, nullptr);  // Clear callbacks
+    XML_SetCharacterDataHandler(xmlParser, nullptr);
+    XML_ParserFree(xmlParser);
+    xmlParser = nullptr;
+  }
+  if (sourceFile) {
+    sourceFile.close();
+  }
+}
+
+void ChapterHtmlSlimParser::resolveNoteTexts(
+    const int spineIndex, const std::function<void(const std::string&, const std::string&)>& onNote) {
+  // Group the references by the chapter they point into, so each is read once
+  struct NoteFile {
+    int spineIndex;
+    std::vector<std::string> ids;
+    std::vector<const std::string*> hrefs;
+  };
+  std::vector<NoteFile> files;
+  for (const auto& href : noteHrefs) {
+    const size_t hash = href.find('#');
+    const int target = hash == 0 ? spineIndex : epub->resolveHrefToSpineIndex(href);
+    if (target < 0) continue;
+    auto file =
+        std::find_if(files.begin(), files.end(), [target](const NoteFile& f) { return f.spineIndex == target; });
+    if (file == files.end()) {
+      if (target != spineIndex && files.size() >= MAX_NOTE_FILES) continue;
+      files.push_back({target, {}, {}});
+      file = files.end() - 1;
+    }
+    file->ids.push_back(href.substr(hash + 1));
+    file->hrefs.push_back(&href);
+  }
+
+  const uint32_t start = millis();
+  size_t resolved = 0;
+  for (const auto& noteFile : files) {
+    NoteTextParser parser(noteFile.ids, [&noteFile, &onNote, &resolved](const std::string& id, std::string text) {
+      for (size_t i = 0; i < noteFile.ids.size(); i++) {
+        if (noteFile.ids[i] == id) {
+          onNote(*noteFile.hrefs[i], text);
+          resolved++;
+        }
+      }
+    });
+    if (!parser.setup()) continue;
+
+    if (noteFile.spineIndex == spineIndex) {
+      // Notes in this chapter: the extracted copy just parsed is still on the card
+      FsFile file;
+      if (Storage.openFileForRead("EHP", filepath, file)) {
+        uint8_t buffer[PARSE_BUFFER_SIZE];
+        int read;
+        while ((read = file.read(buffer, sizeof(buffer))) > 0) {
+          parser.write(buffer, read);
+        }
+        file.close();
+      }
+    } else {
+      epub->readItemContentsToStream(epub->getSpineItem(noteFile.spineIndex).href, parser, PARSE_BUFFER_SIZE);
+    }
+    parser.finish();
+  }
+  LOG_DBG("EHP", "Resolved %zu of %zu note texts from %zu files in %lu ms", resolved, noteHrefs.size(), files.size(),
+          millis() - start);
+  noteHrefs.clear();
+  noteHrefs.shrink_to_fit();
 }
 
 void ChapterHtmlSlimParser::addLineToPage(std::shared_ptr<TextBlock> line) {
@@ -1059,6 +1181,8 @@ void ChapterHtmlSlimParser::addLineToPage(std::shared_ptr<TextBlock> line) {
   }
 
   // Track cumulative words to assign footnotes to the page containing their anchor
+  xpathMap.markPage(completedPageCount, currentTextBlock ? currentTextBlock->getLineOffset() : xpathMap.offset());
+
   wordsExtractedInBlock += line->wordCount();
   auto footnoteIt = pendingFootnotes.begin();
   while (footnoteIt != pendingFootnotes.end() && footnoteIt->first <= wordsExtractedInBlock) {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <HalStorage.h>
 #include <expat.h>
 
 #include <climits>
@@ -10,6 +11,7 @@
 
 #include "../FootnoteEntry.h"
 #include "../ParsedText.h"
+#include "../XPathMap.h"
 #include "../blocks/ImageBlock.h"
 #include "../blocks/TextBlock.h"
 #include "../css/CssParser.h"
@@ -36,6 +38,7 @@ class ChapterHtmlSlimParser {
   // leave one char at end for null pointer
   char partWordBuffer[MAX_WORD_SIZE + 1] = {};
   int partWordBufferIndex = 0;
+  uint32_t partWordOffset = 0;  // source offset of the word in partWordBuffer, for the XPath map
   bool nextWordContinues = false;  // true when next flushed word attaches to previous (inline element boundary)
   std::unique_ptr<ParsedText> currentTextBlock = nullptr;
   std::unique_ptr<Page> currentPage = nullptr;
@@ -75,16 +78,33 @@ class ChapterHtmlSlimParser {
   std::vector<std::pair<std::string, uint16_t>> anchorData;
   std::string pendingAnchorId;  // deferred until after previous text block is flushed
 
+  // KOReader xpointer mapping; generated text (bullets, table headers, alt text) is fed with sourceText cleared
+  XPathMap xpathMap;
+  bool sourceText = true;
+
   // Footnote link tracking
   bool insideFootnoteLink = false;
   int footnoteLinkDepth = -1;
   char currentFootnoteLinkText[24] = {};
   int currentFootnoteLinkTextLen = 0;
   char currentFootnoteLinkHref[64] = {};
+  bool currentFootnoteLinkIsNoteref = false;
   std::vector<std::pair<int, FootnoteEntry>> pendingFootnotes;  // <wordIndex, entry>
+  // Hrefs of the chapter's note references, whose target text resolveNoteTexts() looks up
+  std::vector<std::string> noteHrefs;
+  bool noteHrefsMarked = false;  // noteHrefs holds marked references only, not guesses from link labels
   int wordsExtractedInBlock = 0;
 
+  // Incremental parsing state, between beginParsing() and the end of the document
+  XML_Parser xmlParser = nullptr;
+  FsFile sourceFile;
+  uint32_t fileSize = 0;
+  uint32_t bytesParsed = 0;
+
+  void stopParsing();
   void updateEffectiveInlineStyle();
+  // XPath map offset of the text byte being handled; generated text sits at the next source character
+  uint32_t textOffset() const { return sourceText ? xpathMap.lastOffset() : xpathMap.offset(); }
   void startNewTextBlock(const BlockStyle& blockStyle);
   void flushPartWordBuffer();
   void makePages();
@@ -120,10 +140,25 @@ class ChapterHtmlSlimParser {
         embeddedStyle(embeddedStyle),
         imageRendering(imageRendering),
         contentBase(contentBase),
-        imageBasePath(imageBasePath) {}
+        imageBasePath(imageBasePath),
+        xpathMap(filepath + ".xpath") {}
 
-  ~ChapterHtmlSlimParser() = default;
+  ~ChapterHtmlSlimParser();
   bool parseAndBuildPages();
+
+  // The same layout a piece at a time, so a caller can stop once the page it wants is complete: beginParsing() opens
+  // the document, then each parseNextChunk() parses up to 1 KB of it and completes whatever pages that fills, the
+  // last one when it returns Done.
+  enum class ParseStatus { Error, More, Done };
+  bool beginParsing();
+  ParseStatus parseNextChunk();
+  // Share of the document parsed so far, from 0 to 1
+  float parseProgress() const { return fileSize > 0 ? static_cast<float>(bytesParsed) / fileSize : 1.0f; }
+
   void addLineToPage(std::shared_ptr<TextBlock> line);
   const std::vector<std::pair<std::string, uint16_t>>& getAnchors() const { return anchorData; }
+  // After parseAndBuildPages(): reads the text each note reference points to, in this chapter (spine item
+  // `spineIndex`) or another one, and calls `onNote` with the reference's href (as in FootnoteEntry) and the text.
+  void resolveNoteTexts(int spineIndex, const std::function<void(const std::string&, const std::string&)>& onNote);
+  XPathMap& getXPathMap() { return xpathMap; }
 };
@@ -2,6 +2,8 @@
 
 #include <Logging.h>
 
+#include <cstring>
+
 bool ContainerParser::setup() {
   parser = XML_ParserCreate(nullptr);
   if (!parser) {
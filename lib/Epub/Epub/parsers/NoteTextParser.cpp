@@ -0,0 +1,255 @@
+#include "NoteTextParser.h"
+
+#include <Logging.h>
+#include <Utf8.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "../htmlEntities.h"
+
+namespace {
+constexpr size_t PARSE_BUFFER_SIZE = 1024;
+
+const char* NOTE_BLOCK_TAGS[] = {"p",     "div",   "li",      "dd",     "dt", "aside", "section", "blockquote",
+                                 "h1",    "h2",    "h3",      "h4",     "h5", "h6",    "td",      "th",
+                                 "table", "ol",    "ul",      "dl",     "tr", "body",  "footer",  "article"};
+
+bool isNoteBlock(const char* name) {
+  return std::any_of(std::begin(NOTE_BLOCK_TAGS), std::end(NOTE_BLOCK_TAGS),
+                     [name](const char* tag) { return strcmp(name, tag) == 0; });
+}
+
+const char* attribute(const XML_Char** atts, const char* name) {
+  for (int i = 0; atts && atts[i]; i += 2) {
+    if (strcmp(atts[i], name) == 0) return atts[i + 1];
+  }
+  return nullptr;
+}
+
+// A link back to the note reference, whose arrow or number means nothing in a preview
+bool isBackLink(const char* name, const XML_Char** atts) {
+  if (strcmp(name, "a") != 0) return false;
+  const char* role = attribute(atts, "role");
+  const char* type = attribute(atts, "epub:type");
+  return (role && strcmp(role, "doc-backlink") == 0) || (type && strstr(type, "backlink"));
+}
+
+bool endsWith(const std::string& text, const char* suffix) {
+  const size_t length = strlen(suffix);
+  return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+}
+constexpr size_t MAX_LABEL_DIGITS = 3;
+constexpr size_t MAX_LABEL_NUMERAL = 4;
+constexpr size_t MAX_LABEL_SYMBOLS = 3;
+
+const char* NOTE_SYMBOLS[] = {"*", "†", "‡", "§", "¶"};
+
+size_t noteSymbolLength(const char* s) {
+  for (const char* symbol : NOTE_SYMBOLS) {
+    const size_t length = strlen(symbol);
+    if (strncmp(s, symbol, length) == 0) return length;
+  }
+  return 0;
+}
+}  // namespace
+
+bool NoteTextParser::looksLikeNoteLabel(const char* label) {
+  const char* begin = label;
+  const char* end = label + strlen(label);
+  while (begin < end && strchr(" [(", *begin)) begin++;
+  while (end > begin && strchr(" ])", end[-1])) end--;
+  const auto length = static_cast<size_t>(end - begin);
+  if (length == 0) return false;
+
+  if (std::all_of(begin, end, [](const char c) { return c >= '0' && c <= '9'; })) return length <= MAX_LABEL_DIGITS;
+  if (std::all_of(begin, end, [](const char c) { return c && strchr("ivxlc", c); })) return length <= MAX_LABEL_NUMERAL;
+
+  size_t symbols = 0;
+  for (const char* p = begin; p < end; symbols++) {
+    const size_t symbol = noteSymbolLength(p);
+    if (symbol == 0 || p + symbol > end) return false;
+    p += symbol;
+  }
+  return symbols <= MAX_LABEL_SYMBOLS;
+}
+
+bool NoteTextParser::setup() {
+  parser = XML_ParserCreate(nullptr);
+  if (!parser) {
+    LOG_DBG("NTP", "Couldn't allocate memory for parser");
+    return false;
+  }
+
+  XML_SetUserData(parser, this);
+  XML_SetElementHandler(parser, startElement, endElement);
+  XML_SetCharacterDataHandler(parser, characterData);
+  XML_SetDefaultHandlerExpand(parser, defaultHandlerExpand);
+  return true;
+}
+
+NoteTextParser::~NoteTextParser() { stop(); }
+
+void NoteTextParser::stop() {
+  if (parser) {
+    XML_StopParser(parser, XML_FALSE);
+    XML_SetElementHandler(parser, nullptr, nullptr);
+    XML_SetCharacterDataHandler(parser, nullptr);
+    XML_SetDefaultHandlerExpand(parser, nullptr);
+    XML_ParserFree(parser);
+    parser = nullptr;
+  }
+}
+
+void NoteTextParser::finish() {
+  if (parser && XML_ParseBuffer(parser, 0, XML_TRUE) == XML_STATUS_ERROR) {
+    LOG_DBG("NTP", "Parse error at end: %s", XML_ErrorString(XML_GetErrorCode(parser)));
+  }
+  stop();
+}
+
+size_t NoteTextParser::write(const uint8_t data) { return write(&data, 1); }
+
+size_t NoteTextParser::write(const uint8_t* buffer, const size_t size) {
+  // Once every note is found, or after a parse error, the rest of the stream is accepted unread
+  size_t offset = 0;
+  while (parser && offset < size) {
+    void* const buf = XML_GetBuffer(parser, PARSE_BUFFER_SIZE);
+    if (!buf) {
+      LOG_DBG("NTP", "Couldn't allocate memory for buffer");
+      stop();
+      break;
+    }
+    const size_t toRead = std::min(size - offset, PARSE_BUFFER_SIZE);
+    memcpy(buf, buffer + offset, toRead);
+    if (XML_ParseBuffer(parser, static_cast<int>(toRead), XML_FALSE) == XML_STATUS_ERROR) {
+      LOG_DBG("NTP", "Parse error at line %lu: %s", XML_GetCurrentLineNumber(parser),
+              XML_ErrorString(XML_GetErrorCode(parser)));
+      stop();
+      break;
+    }
+    offset += toRead;
+    if (found >= ids.size()) {
+      stop();
+    }
+  }
+  return size;
+}
+
+void NoteTextParser::appendText(const char* s, const int len) {
+  for (int i = 0; i < len && !truncated; i++) {
+    const char c = s[i];
+    if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+      pendingSpace = !text.empty();
+      continue;
+    }
+    if (pendingBreak && !text.empty()) {
+      text += '\n';
+    } else if (pendingSpace) {
+      text += ' ';
+    }
+    pendingBreak = pendingSpace = false;
+    if (text.size() >= MAX_TEXT_BYTES) {
+      truncated = true;
+      break;
+    }
+    text += c;
+  }
+}
+
+void NoteTextParser::endCapture() {
+  if (truncated) {
+    text.resize(utf8SafeTruncateBuffer(text.data(), static_cast<int>(MAX_TEXT_BYTES - 3)));
+    text += "\xE2\x80\xA6";
+  }
+  // Back links without markup saying so: "↩", "↩︎" or "↑" at the very end
+  while (true) {
+    if (endsWith(text, "\xEF\xB8\x8E")) {
+      text.resize(text.size() - 3);
+    } else if (endsWith(text, "\xE2\x86\xA9") || endsWith(text, "\xE2\x86\x91")) {
+      text.resize(text.size() - 3);
+    } else if (!text.empty() && (text.back() == ' ' || text.back() == '\n')) {
+      text.pop_back();
+    } else {
+      break;
+    }
+  }
+
+  if (!text.empty()) {
+    onNote(captureId, std::move(text));
+  }
+  found++;
+  captureDepth = -1;
+  skipDepth = -1;
+  captureId.clear();
+  text.clear();
+  pendingSpace = pendingBreak = truncated = false;
+}
+
+void XMLCALL NoteTextParser::startElement(void* userData, const XML_Char* name, const XML_Char** atts) {
+  auto* self = static_cast<NoteTextParser*>(userData);
+  self->depth++;
+  const bool block = isNoteBlock(name);
+  self->blockStack.push_back(block);
+
+  if (self->captureDepth >= 0) {
+    if (self->skipDepth < 0 && isBackLink(name, atts)) {
+      self->skipDepth = self->depth;
+    }
+    if (block || strcmp(name, "br") == 0) {
+      self->pendingBreak = true;
+    }
+    return;
+  }
+
+  const char* id = attribute(atts, "id");
+  if (!id || std::find(self->ids.begin(), self->ids.end(), id) == self->ids.end()) {
+    return;
+  }
+  self->captureId = id;
+  self->captureDepth = self->depth;
+  if (!block) {
+    // Inline target: the note is the block around it
+    for (int d = self->depth - 1; d >= 1; d--) {
+      if (self->blockStack[d - 1]) {
+        self->captureDepth = d;
+        break;
+      }
+    }
+  }
+  if (isBackLink(name, atts)) {
+    self->skipDepth = self->depth;
+  }
+}
+
+void XMLCALL NoteTextParser::characterData(void* userData, const XML_Char* s, const int len) {
+  auto* self = static_cast<NoteTextParser*>(userData);
+  if (self->captureDepth >= 0 && self->skipDepth < 0) {
+    self->appendText(s, len);
+  }
+}
+
+void XMLCALL NoteTextParser::defaultHandlerExpand(void* userData, const XML_Char* s, const int len) {
+  if (len >= 3 && s[0] == '&' && s[len - 1] == ';') {
+    const char* utf8Value = lookupHtmlEntity(s, static_cast<size_t>(len));
+    characterData(userData, utf8Value ? utf8Value : s, utf8Value ? static_cast<int>(strlen(utf8Value)) : len);
+  }
+}
+
+void XMLCALL NoteTextParser::endElement(void* userData, const XML_Char* name) {
+  auto* self = static_cast<NoteTextParser*>(userData);
+  if (self->skipDepth == self->depth) {
+    self->skipDepth = -1;
+  }
+  if (self->captureDepth >= 0) {
+    if (self->depth == self->captureDepth) {
+      self->endCapture();
+    } else if (isNoteBlock(name)) {
+      self->pendingBreak = true;
+    }
+  }
+  self->depth--;
+  if (!self->blockStack.empty()) {
+    self->blockStack.pop_back();
+  }
+}
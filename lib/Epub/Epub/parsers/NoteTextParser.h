@@ -0,0 +1,58 @@
+#pragma once
+#include <Print.h>
+#include <expat.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Pulls the text of footnote and endnote targets out of a chapter document streamed through write(). For each wanted
+// id it reports the text of the element carrying the id, e.g. an EPUB 3 <aside epub:type="footnote">. When the id
+// sits on an inline element, as classic endnotes put it on the note number's back link, the text of the enclosing
+// block is reported instead. Texts are cut at MAX_TEXT_BYTES; back-link arrows at the end are dropped.
+class NoteTextParser final : public Print {
+ public:
+  static constexpr size_t MAX_TEXT_BYTES = 768;
+  using NoteFn = std::function<void(const std::string& id, std::string text)>;
+
+  explicit NoteTextParser(std::vector<std::string> ids, NoteFn onNote)
+      : ids(std::move(ids)), onNote(std::move(onNote)) {}
+  ~NoteTextParser() override;
+
+  // Whether a reference link's text reads like a note marker: a short number ("12", "[3]"), a lowercase roman
+  // numeral ("iv") or note symbols ("*", "†"). Used to guess note references in books that do not mark them.
+  static bool looksLikeNoteLabel(const char* label);
+
+  bool setup();
+  // Ends the document. Parsing stops early once every id has been found, so the rest of the stream is ignored.
+  void finish();
+  size_t foundCount() const { return found; }
+
+  size_t write(uint8_t) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+
+ private:
+  std::vector<std::string> ids;
+  NoteFn onNote;
+  XML_Parser parser = nullptr;
+  size_t found = 0;
+
+  int depth = 0;
+  std::vector<bool> blockStack;  // whether the element at each depth is a block
+  int captureDepth = -1;
+  int skipDepth = -1;
+  std::string captureId;
+  std::string text;
+  bool pendingSpace = false;
+  bool pendingBreak = false;
+  bool truncated = false;
+
+  void appendText(const char* s, int len);
+  void endCapture();
+  void stop();
+
+  static void XMLCALL startElement(void* userData, const XML_Char* name, const XML_Char** atts);
+  static void XMLCALL characterData(void* userData, const XML_Char* s, int len);
+  static void XMLCALL defaultHandlerExpand(void* userData, const XML_Char* s, int len);
+  static void XMLCALL endElement(void* userData, const XML_Char* name);
+};
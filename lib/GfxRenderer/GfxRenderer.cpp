@@ -553,6 +553,93 @@ void GfxRenderer::fillRoundedRect(const int x, const int y, const int width, con
   }
 }
 
+// Transpose an 8x8 bit block: out[k] collects bit (7 - k) of every input byte, MSB from in[0].
+// Adapted from Hacker's Delight (transpose8), `stride` is the distance between input rows.
+static inline void transpose8x8(const uint8_t* in, const int stride, uint8_t out[8]) {
+  uint32_t x = static_cast<uint32_t>(in[0]) << 24 | static_cast<uint32_t>(in[stride]) << 16 |
+               static_cast<uint32_t>(in[2 * stride]) << 8 | in[3 * stride];
+  uint32_t y = static_cast<uint32_t>(in[4 * stride]) << 24 | static_cast<uint32_t>(in[5 * stride]) << 16 |
+               static_cast<uint32_t>(in[6 * stride]) << 8 | in[7 * stride];
+  uint32_t t = (x ^ (x >> 7)) & 0x00AA00AA;
+  x = x ^ t ^ (t << 7);
+  t = (y ^ (y >> 7)) & 0x00AA00AA;
+  y = y ^ t ^ (t << 7);
+  t = (x ^ (x >> 14)) & 0x0000CCCC;
+  x = x ^ t ^ (t << 14);
+  t = (y ^ (y >> 14)) & 0x0000CCCC;
+  y = y ^ t ^ (t << 14);
+  t = (x & 0xF0F0F0F0) | ((y >> 4) & 0x0F0F0F0F);
+  y = ((x << 4) & 0xF0F0F0F0) | (y & 0x0F0F0F0F);
+  x = t;
+  out[0] = x >> 24;
+  out[1] = x >> 16;
+  out[2] = x >> 8;
+  out[3] = x;
+  out[4] = y >> 24;
+  out[5] = y >> 16;
+  out[6] = y >> 8;
+  out[7] = y;
+}
+
+static inline uint8_t reverseBits(uint8_t b) {
+  b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
+  b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
+  return (b & 0xAA) >> 1 | (b & 0x55) << 1;
+}
+
+void GfxRenderer::blitRaster(const RasterRotation rotation, const RasterRowReader& readRow) const {
+  if (fontCacheManager_ && fontCacheManager_->isScanning()) return;
+  constexpr int panelRows = HalDisplay::DISPLAY_HEIGHT;
+  constexpr int panelRowBytes = HalDisplay::DISPLAY_WIDTH_BYTES;
+
+  if (rotation == RasterRotation::None) {
+    for (int row = 0; row < panelRows; row++) {
+      readRow(row, frameBuffer + row * panelRowBytes);
+    }
+    return;
+  }
+
+  if (rotation == RasterRotation::UpsideDown) {
+    uint8_t rowBuffer[panelRowBytes];
+    for (int row = 0; row < panelRows; row++) {
+      readRow(row, rowBuffer);
+      uint8_t* dst = frameBuffer + (panelRows - 1 - row) * panelRowBytes;
+      for (int b = 0; b < panelRowBytes; b++) {
+        dst[b] = reverseBits(rowBuffer[panelRowBytes - 1 - b]);
+      }
+    }
+    return;
+  }
+
+  // Quarter turns: the source is DISPLAY_WIDTH rows of DISPLAY_HEIGHT pixels. Read it in bands of 8 rows and
+  // transpose 8x8 blocks, so each block becomes one byte in each of 8 consecutive panel rows.
+  constexpr int srcRows = HalDisplay::DISPLAY_WIDTH;
+  constexpr int srcRowBytes = HalDisplay::DISPLAY_HEIGHT / 8;
+  uint8_t band[8 * srcRowBytes];
+  uint8_t block[8];
+  for (int srcRow = 0; srcRow < srcRows; srcRow += 8) {
+    for (int i = 0; i < 8; i++) {
+      readRow(srcRow + i, band + i * srcRowBytes);
+    }
+    for (int srcByte = 0; srcByte < srcRowBytes; srcByte++) {
+      transpose8x8(band + srcByte, srcRowBytes, block);
+      if (rotation == RasterRotation::Clockwise) {
+        // Source (row, col) -> panel (col, width - 1 - row): band rows run right to left within the byte
+        uint8_t* dst = frameBuffer + srcByte * 8 * panelRowBytes + (panelRowBytes - 1 - srcRow / 8);
+        for (int k = 0; k < 8; k++) {
+          dst[k * panelRowBytes] = reverseBits(block[k]);
+        }
+      } else {
+        // Source (row, col) -> panel (height - 1 - col, row)
+        uint8_t* dst = frameBuffer + (panelRows - 1 - srcByte * 8) * panelRowBytes + srcRow / 8;
+        for (int k = 0; k < 8; k++) {
+          dst[-k * panelRowBytes] = block[k];
+        }
+      }
+    }
+  }
+}
+
 void GfxRenderer::drawImage(const uint8_t bitmap[], const int x, const int y, const int width, const int height) const {
   int rotatedX = 0;
   int rotatedY = 0;
@@ -831,6 +918,7 @@ void GfxRenderer::displayBuffer(const HalDisplay::RefreshMode refreshMode) const
   auto elapsed = millis() - start_ms;
   LOG_DBG("GFX", "Time = %lu ms from clearScreen to displayBuffer", elapsed);
   display.displayBuffer(refreshMode, fadingFix);
+  framesDisplayed++;
 }
 
 std::string GfxRenderer::truncatedText(const int fontId, const char* text, const int maxWidth,
@@ -918,7 +1006,11 @@ std::vector<std::string> GfxRenderer::wrappedText(const int fontId, const char*
 }
 
 // Note: Internal driver treats screen in command orientation; this library exposes a logical orientation
-int GfxRenderer::getScreenWidth() const {
+int GfxRenderer::getScreenWidth() const { return getScreenWidth(orientation); }
+
+int GfxRenderer::getScreenHeight() const { return getScreenHeight(orientation); }
+
+int GfxRenderer::getScreenWidth(const Orientation orientation) {
   switch (orientation) {
     case Portrait:
     case PortraitInverted:
@@ -932,7 +1024,7 @@ int GfxRenderer::getScreenWidth() const {
   return HalDisplay::DISPLAY_HEIGHT;
 }
 
-int GfxRenderer::getScreenHeight() const {
+int GfxRenderer::getScreenHeight(const Orientation orientation) {
   switch (orientation) {
     case Portrait:
     case PortraitInverted:
@@ -1104,7 +1196,10 @@ void GfxRenderer::copyGrayscaleLsbBuffers() const { display.copyGrayscaleLsbBuff
 
 void GfxRenderer::copyGrayscaleMsbBuffers() const { display.copyGrayscaleMsbBuffers(frameBuffer); }
 
-void GfxRenderer::displayGrayBuffer() const { display.displayGrayBuffer(fadingFix); }
+void GfxRenderer::displayGrayBuffer() const {
+  display.displayGrayBuffer(fadingFix);
+  framesDisplayed++;
+}
 
 void GfxRenderer::freeBwBufferChunks() {
   for (auto& bwBufferChunk : bwBufferChunks) {
@@ -1190,6 +1285,11 @@ void GfxRenderer::cleanupGrayscaleWithFrameBuffer() const {
 }
 
 void GfxRenderer::getOrientedViewableTRBL(int* outTop, int* outRight, int* outBottom, int* outLeft) const {
+  getOrientedViewableTRBL(orientation, outTop, outRight, outBottom, outLeft);
+}
+
+void GfxRenderer::getOrientedViewableTRBL(const Orientation orientation, int* outTop, int* outRight, int* outBottom,
+                                          int* outLeft) {
   switch (orientation) {
     case Portrait:
       *outTop = VIEWABLE_MARGIN_TOP;
@@ -6,6 +6,7 @@
 class FontCacheManager;
 
 #include <cstring>
+#include <functional>
 #include <map>
 #include <string>
 #include <vector>
@@ -20,6 +21,12 @@ class GfxRenderer {
  public:
   enum RenderMode { BW, GRAYSCALE_LSB, GRAYSCALE_MSB };
 
+  // Rotation applied by blitRaster() to map a source raster onto the physical panel
+  enum class RasterRotation { None, Clockwise, UpsideDown, CounterClockwise };
+
+  // Writes source row `row` of a raster into `out` (packed 1-bit, MSB first)
+  using RasterRowReader = std::function<void(int row, uint8_t* out)>;
+
   // Logical screen orientation from the perspective of callers
   enum Orientation {
     Portrait,                  // 480x800 logical coordinates (current default)
@@ -46,6 +53,8 @@ class GfxRenderer {
   // recording to the (non-const) FontCacheManager. Same pragmatic compromise
   // as before, concentrated in a single pointer instead of four fields.
   mutable FontCacheManager* fontCacheManager_ = nullptr;
+  // Frames handed to the panel; mutable for the same reason, displayBuffer() is const
+  mutable uint32_t framesDisplayed = 0;
 
   void renderChar(const EpdFontFamily& fontFamily, uint32_t cp, int* x, int* y, bool pixelState,
                   EpdFontFamily::Style style) const;
@@ -83,11 +92,18 @@ class GfxRenderer {
   int getScreenWidth() const;
   int getScreenHeight() const;
   void displayBuffer(HalDisplay::RefreshMode refreshMode = HalDisplay::FAST_REFRESH) const;
+  // Increases with every BW or grayscale frame displayed, so callers can tell whether the screen changed since
+  uint32_t getFramesDisplayed() const { return framesDisplayed; }
   // EXPERIMENTAL: Windowed update - display only a rectangular region
   // void displayWindow(int x, int y, int width, int height) const;
   void invertScreen() const;
   void clearScreen(uint8_t color = 0xFF) const;
   void getOrientedViewableTRBL(int* outTop, int* outRight, int* outBottom, int* outLeft) const;
+  // Same as above for an orientation other than the current one, e.g. to lay out a book while the UI is shown
+  static int getScreenWidth(Orientation orientation);
+  static int getScreenHeight(Orientation orientation);
+  static void getOrientedViewableTRBL(Orientation orientation, int* outTop, int* outRight, int* outBottom,
+                                      int* outLeft);
 
   // Drawing
   void drawPixel(int x, int y, bool state = true) const;
@@ -110,6 +126,10 @@ class GfxRenderer {
                   float cropY = 0) const;
   void drawBitmap1Bit(const Bitmap& bitmap, int x, int y, int maxWidth, int maxHeight) const;
   void fillPolygon(const int* xPoints, const int* yPoints, int numPoints, bool state = true) const;
+  // Replace the whole frame buffer with a full-panel 1-bit raster already in frame buffer polarity, bypassing
+  // drawPixel. The raster is rotated onto the panel, so it must be DISPLAY_WIDTH x DISPLAY_HEIGHT pixels for
+  // None/UpsideDown and DISPLAY_HEIGHT x DISPLAY_WIDTH for Clockwise/CounterClockwise.
+  void blitRaster(RasterRotation rotation, const RasterRowReader& readRow) const;
 
   // Text
   int getTextWidth(int fontId, const char* text, EpdFontFamily::Style style = EpdFontFamily::REGULAR) const;
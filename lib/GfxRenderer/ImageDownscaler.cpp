@@ -0,0 +1,282 @@
+#include "ImageDownscaler.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#include "BitmapHelpers.h"
+
+ImageDownscaler::ImageDownscaler(const int srcWidth, const int srcHeight, const int dstWidth, const int dstHeight,
+                                 const OutputFormat format, const Dither dither)
+    : srcWidth(srcWidth),
+      srcHeight(srcHeight),
+      dstWidth(dstWidth),
+      dstHeight(dstHeight),
+      format(format),
+      dither(dither),
+      identity(srcWidth == dstWidth && srcHeight == dstHeight) {}
+
+ImageDownscaler::~ImageDownscaler() {
+  delete[] hSpans;
+  free(grayRow);
+  free(hRow);
+  free(vAccum);
+  free(outGray);
+  free(packedRow);
+  delete atkinsonDitherer;
+  delete fsDitherer;
+  delete atkinson1BitDitherer;
+}
+
+int ImageDownscaler::packedRowBytes(const int width, const OutputFormat format) {
+  switch (format) {
+    case OutputFormat::OneBit:
+      return (width + 7) / 8;
+    case OutputFormat::TwoBit:
+      return (width + 3) / 4;
+    case OutputFormat::EightBit:
+      return width;
+  }
+  return width;
+}
+
+int ImageDownscaler::getOutputRowBytes() const { return packedRowBytes(dstWidth, format); }
+
+void ImageDownscaler::computeOutputSize(const int srcWidth, const int srcHeight, const int targetWidth,
+                                        const int targetHeight, const bool crop, int& outWidth, int& outHeight) {
+  outWidth = srcWidth;
+  outHeight = srcHeight;
+  if (targetWidth <= 0 || targetHeight <= 0 || srcWidth <= 0 || srcHeight <= 0) return;
+  if (srcWidth == targetWidth && srcHeight == targetHeight) return;
+
+  // Compare targetWidth/srcWidth against targetHeight/srcHeight by cross-multiplying (no float needed).
+  // Crop fills the box (larger scale), fit keeps the whole image inside it (smaller scale).
+  const uint64_t widthRatio = static_cast<uint64_t>(targetWidth) * srcHeight;
+  const uint64_t heightRatio = static_cast<uint64_t>(targetHeight) * srcWidth;
+  const bool scaleByWidth = crop ? (widthRatio >= heightRatio) : (widthRatio <= heightRatio);
+  if (scaleByWidth) {
+    outWidth = targetWidth;
+    outHeight = static_cast<int>(static_cast<uint64_t>(srcHeight) * targetWidth / srcWidth);
+  } else {
+    outHeight = targetHeight;
+    outWidth = static_cast<int>(static_cast<uint64_t>(srcWidth) * targetHeight / srcHeight);
+  }
+  if (outWidth < 1) outWidth = 1;
+  if (outHeight < 1) outHeight = 1;
+}
+
+// Work in units where a source pixel is dstSize wide and an output pixel is srcSize wide, so both grids are
+// integral. Output pixel `outIndex` covers [outIndex * srcSize, (outIndex + 1) * srcSize).
+ImageDownscaler::Span ImageDownscaler::computeSpan(const int outIndex, const int srcSize, const int dstSize,
+                                                   const uint16_t interiorWeight) {
+  const uint32_t begin = static_cast<uint32_t>(outIndex) * srcSize;
+  const uint32_t end = begin + srcSize;
+  const uint32_t first = begin / dstSize;
+  const uint32_t last = (end - 1) / dstSize;
+
+  Span span;
+  span.start = static_cast<uint16_t>(first);
+  span.count = static_cast<uint16_t>(last - first + 1);
+  if (span.count == 1) {
+    span.firstWeight = WEIGHT_ONE;
+    span.lastWeight = 0;
+    return span;
+  }
+
+  const uint32_t firstCoverage = (first + 1) * dstSize - begin;
+  span.firstWeight = static_cast<uint16_t>((firstCoverage << WEIGHT_SHIFT) / srcSize);
+  // The last weight absorbs all rounding so every span sums to exactly WEIGHT_ONE
+  span.lastWeight = static_cast<uint16_t>(WEIGHT_ONE - span.firstWeight - interiorWeight * (span.count - 2));
+  return span;
+}
+
+uint16_t ImageDownscaler::sourceWeight(const Span& span, const int srcIndex, const uint16_t interiorWeight) {
+  if (span.count == 1) return WEIGHT_ONE;
+  if (srcIndex == span.start) return span.firstWeight;
+  if (srcIndex == span.start + span.count - 1) return span.lastWeight;
+  return interiorWeight;
+}
+
+bool ImageDownscaler::begin(RowSink rowSink) {
+  if (srcWidth <= 0 || srcHeight <= 0 || dstWidth <= 0 || dstHeight <= 0) return false;
+  if (srcWidth > UINT16_MAX || srcHeight > UINT16_MAX || dstWidth > UINT16_MAX || dstHeight > UINT16_MAX) {
+    return false;
+  }
+  sink = std::move(rowSink);
+
+  grayRow = static_cast<uint8_t*>(malloc(srcWidth));
+  outGray = static_cast<uint8_t*>(malloc(dstWidth));
+  packedRow = static_cast<uint8_t*>(malloc(getOutputRowBytes()));
+  if (!grayRow || !outGray || !packedRow) return false;
+
+  if (!identity) {
+    hSpans = new (std::nothrow) Span[dstWidth];
+    hRow = static_cast<uint16_t*>(malloc(dstWidth * sizeof(uint16_t)));
+    vAccum = static_cast<uint32_t*>(calloc(dstWidth, sizeof(uint32_t)));
+    if (!hSpans || !hRow || !vAccum) return false;
+
+    // Interior source pixels are fully covered: weight = dstSize / srcSize (only meaningful when downscaling)
+    hInteriorWeight = dstWidth >= srcWidth
+                          ? WEIGHT_ONE
+                          : static_cast<uint16_t>((static_cast<uint32_t>(dstWidth) << WEIGHT_SHIFT) / srcWidth);
+    vInteriorWeight = dstHeight >= srcHeight
+                          ? WEIGHT_ONE
+                          : static_cast<uint16_t>((static_cast<uint32_t>(dstHeight) << WEIGHT_SHIFT) / srcHeight);
+    for (int x = 0; x < dstWidth; x++) {
+      hSpans[x] = computeSpan(x, srcWidth, dstWidth, hInteriorWeight);
+    }
+    vSpan = computeSpan(0, srcHeight, dstHeight, vInteriorWeight);
+  }
+
+  if (format == OutputFormat::OneBit) {
+    if (dither != Dither::None) atkinson1BitDitherer = new (std::nothrow) Atkinson1BitDitherer(dstWidth);
+    if (dither != Dither::None && !atkinson1BitDitherer) return false;
+  } else if (format == OutputFormat::TwoBit) {
+    if (dither == Dither::Atkinson) {
+      atkinsonDitherer = new (std::nothrow) AtkinsonDitherer(dstWidth);
+      if (!atkinsonDitherer) return false;
+    } else if (dither == Dither::FloydSteinberg) {
+      fsDitherer = new (std::nothrow) FloydSteinbergDitherer(dstWidth);
+      if (!fsDitherer) return false;
+    }
+  }
+
+  nextSrcY = 0;
+  nextOutY = 0;
+  return true;
+}
+
+void ImageDownscaler::toGray(const uint8_t* src, const SourceFormat format, const int width, uint8_t* grayOut) {
+  switch (format) {
+    case SourceFormat::Gray8:
+      memcpy(grayOut, src, width);
+      break;
+    case SourceFormat::Gray1:
+      for (int x = 0; x < width; x++) {
+        grayOut[x] = (src[x >> 3] & (0x80 >> (x & 7))) ? 255 : 0;
+      }
+      break;
+    case SourceFormat::Gray2:
+      for (int x = 0; x < width; x++) {
+        grayOut[x] = ((src[x >> 2] >> (6 - ((x & 3) * 2))) & 0x03) * 85;
+      }
+      break;
+    case SourceFormat::Rgb888:
+      for (int x = 0; x < width; x++, src += 3) grayOut[x] = luma(src[0], src[1], src[2]);
+      break;
+    case SourceFormat::Bgr888:
+      for (int x = 0; x < width; x++, src += 3) grayOut[x] = luma(src[2], src[1], src[0]);
+      break;
+    case SourceFormat::Rgba8888:
+      for (int x = 0; x < width; x++, src += 4) grayOut[x] = luma(src[0], src[1], src[2]);
+      break;
+    case SourceFormat::Bgra8888:
+      for (int x = 0; x < width; x++, src += 4) grayOut[x] = luma(src[2], src[1], src[0]);
+      break;
+  }
+}
+
+// Horizontal pass: grayRow (srcWidth, 8-bit) -> hRow (dstWidth, Q8)
+void ImageDownscaler::filterRowHorizontally() {
+  const uint16_t interior = hInteriorWeight;
+  for (int x = 0; x < dstWidth; x++) {
+    const Span& span = hSpans[x];
+    const uint8_t* src = grayRow + span.start;
+    uint32_t sum;
+    if (span.count == 1) {
+      sum = static_cast<uint32_t>(src[0]) << WEIGHT_SHIFT;
+    } else {
+      sum = src[0] * static_cast<uint32_t>(span.firstWeight);
+      const int lastIndex = span.count - 1;
+      for (int i = 1; i < lastIndex; i++) sum += src[i] * static_cast<uint32_t>(interior);
+      sum += src[lastIndex] * static_cast<uint32_t>(span.lastWeight);
+    }
+    // Q14 -> Q8 with rounding: max 255 << 8 fits in 16 bits
+    hRow[x] = static_cast<uint16_t>((sum + (1u << (WEIGHT_SHIFT - 9))) >> (WEIGHT_SHIFT - 8));
+  }
+}
+
+bool ImageDownscaler::pushRow(const uint8_t* row, const SourceFormat sourceFormat) {
+  if (nextSrcY >= srcHeight || !grayRow) return false;
+  const int y = nextSrcY++;
+
+  toGray(row, sourceFormat, srcWidth, grayRow);
+
+  if (identity) {
+    emitRow(grayRow);
+    return true;
+  }
+
+  filterRowHorizontally();
+
+  // Vertical pass: a source row contributes to every output row whose span includes it. When downscaling that is
+  // at most two rows (the one it finishes and the one it starts); when upscaling it may complete several.
+  while (nextOutY < dstHeight && vSpan.start <= y) {
+    const uint32_t weight = sourceWeight(vSpan, y, vInteriorWeight);
+    for (int x = 0; x < dstWidth; x++) vAccum[x] += hRow[x] * weight;
+
+    if (vSpan.start + vSpan.count - 1 > y) break;  // Output row still needs more source rows
+
+    // Q22 -> 8-bit with rounding
+    constexpr int shift = WEIGHT_SHIFT + 8;
+    for (int x = 0; x < dstWidth; x++) {
+      const uint32_t value = (vAccum[x] + (1u << (shift - 1))) >> shift;
+      outGray[x] = static_cast<uint8_t>(value > 255 ? 255 : value);
+    }
+    memset(vAccum, 0, dstWidth * sizeof(uint32_t));
+    emitRow(outGray);
+    if (nextOutY < dstHeight) vSpan = computeSpan(nextOutY, srcHeight, dstHeight, vInteriorWeight);
+  }
+
+  return true;
+}
+
+void ImageDownscaler::emitRow(const uint8_t* gray) {
+  const int y = nextOutY;
+  if (y >= dstHeight) return;
+
+  switch (format) {
+    case OutputFormat::EightBit:
+      for (int x = 0; x < dstWidth; x++) packedRow[x] = static_cast<uint8_t>(adjustPixel(gray[x]));
+      break;
+
+    case OutputFormat::OneBit: {
+      memset(packedRow, 0, getOutputRowBytes());
+      for (int x = 0; x < dstWidth; x++) {
+        // Atkinson1BitDitherer applies adjustPixel itself, as does quantize1bit
+        const uint8_t bit =
+            atkinson1BitDitherer ? atkinson1BitDitherer->processPixel(gray[x], x) : quantize1bit(gray[x], x, y);
+        packedRow[x >> 3] |= bit << (7 - (x & 7));
+      }
+      if (atkinson1BitDitherer) atkinson1BitDitherer->nextRow();
+      break;
+    }
+
+    case OutputFormat::TwoBit: {
+      memset(packedRow, 0, getOutputRowBytes());
+      if (fsDitherer) {
+        // Serpentine scan: odd rows run right to left, matching the ditherer's mirrored error kernel
+        const bool reverse = fsDitherer->isReverseRow();
+        for (int i = 0; i < dstWidth; i++) {
+          const int x = reverse ? dstWidth - 1 - i : i;
+          const uint8_t value = fsDitherer->processPixel(adjustPixel(gray[x]), x);
+          packedRow[x >> 2] |= value << (6 - ((x & 3) * 2));
+        }
+        fsDitherer->nextRow();
+      } else {
+        for (int x = 0; x < dstWidth; x++) {
+          const int adjusted = adjustPixel(gray[x]);
+          const uint8_t value =
+              atkinsonDitherer ? atkinsonDitherer->processPixel(adjusted, x) : quantize(adjusted, x, y);
+          packedRow[x >> 2] |= value << (6 - ((x & 3) * 2));
+        }
+        if (atkinsonDitherer) atkinsonDitherer->nextRow();
+      }
+      break;
+    }
+  }
+
+  nextOutY++;
+  if (sink) sink(packedRow, y);
+}
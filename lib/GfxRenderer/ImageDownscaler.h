@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+class AtkinsonDitherer;
+class Atkinson1BitDitherer;
+class FloydSteinbergDitherer;
+
+// Row-streaming area-average (box filter) image scaler shared by the image converters.
+//
+// Source rows are pushed top to bottom in any of the supported decoder formats. Each output row is emitted
+// through the row sink as soon as all source rows covering it have been seen, already quantized and packed
+// (MSB first) to the requested output depth. Memory use is O(width): one grayscale source row, one horizontally
+// filtered row and one vertical accumulator row, plus the ditherer's error rows.
+//
+// Filter weights are precomputed per output column in Q14 fixed point and always sum to exactly 1.0, so the
+// hot loops are multiply/add/shift only (no per-pixel division; the ESP32-C3 has no FPU or fast divider).
+// Upscaling is supported and degrades gracefully to pixel replication with fractional edge blending.
+class ImageDownscaler {
+ public:
+  enum class SourceFormat : uint8_t {
+    Gray8,     // 1 byte per pixel, 0 = black
+    Gray1,     // 1 bit per pixel, MSB first, 1 = white
+    Gray2,     // 2 bits per pixel, MSB first, 0 = black, 3 = white
+    Rgb888,    // R, G, B
+    Bgr888,    // B, G, R (24-bit BMP)
+    Rgba8888,  // R, G, B, A (alpha ignored)
+    Bgra8888,  // B, G, R, A (32-bit BMP, alpha ignored)
+  };
+
+  enum class OutputFormat : uint8_t {
+    OneBit,    // 8 pixels per byte, 0 = black, 1 = white
+    TwoBit,    // 4 pixels per byte, 0 = black ... 3 = white
+    EightBit,  // 1 byte per pixel (brightness/contrast adjusted, not quantized)
+  };
+
+  enum class Dither : uint8_t {
+    None,            // Threshold quantization (noise dithering for 1-bit, see BitmapHelpers)
+    Atkinson,        // 6/8 error diffusion, cleanest on e-ink
+    FloydSteinberg,  // Serpentine Floyd-Steinberg (2-bit output only, falls back to Atkinson for 1-bit)
+  };
+
+  // Receives one packed output row. `row` is valid until the callback returns.
+  using RowSink = std::function<void(const uint8_t* row, int y)>;
+
+  ImageDownscaler(int srcWidth, int srcHeight, int dstWidth, int dstHeight, OutputFormat format, Dither dither);
+  ~ImageDownscaler();
+
+  ImageDownscaler(const ImageDownscaler&) = delete;
+  ImageDownscaler& operator=(const ImageDownscaler&) = delete;
+
+  // Allocate the row buffers and weight tables. Must succeed before pushRow() is called.
+  bool begin(RowSink sink);
+
+  // Feed the next source row. Returns false if more rows are pushed than the source height.
+  bool pushRow(const uint8_t* row, SourceFormat format);
+
+  int getOutputWidth() const { return dstWidth; }
+  int getOutputHeight() const { return dstHeight; }
+  int getRowsEmitted() const { return nextOutY; }
+  bool isComplete() const { return nextOutY >= dstHeight; }
+
+  // Packed bytes per output row, without any container padding
+  int getOutputRowBytes() const;
+  static int packedRowBytes(int width, OutputFormat format);
+
+  // Shared luminance approximation (ITU-R BT.601, 8-bit fixed point)
+  static uint8_t luma(uint8_t r, uint8_t g, uint8_t b) {
+    return static_cast<uint8_t>((77u * r + 150u * g + 29u * b) >> 8);
+  }
+
+  // Convert one source row to 8-bit grayscale
+  static void toGray(const uint8_t* src, SourceFormat format, int width, uint8_t* grayOut);
+
+  // Compute the output size for fitting (crop = false) or filling (crop = true) a target box while
+  // preserving aspect ratio. Non-positive targets keep the source size.
+  static void computeOutputSize(int srcWidth, int srcHeight, int targetWidth, int targetHeight, bool crop,
+                                int& outWidth, int& outHeight);
+
+ private:
+  static constexpr int WEIGHT_SHIFT = 14;
+  static constexpr uint32_t WEIGHT_ONE = 1u << WEIGHT_SHIFT;
+
+  // Box filter footprint of one output column (or row): `count` source pixels starting at `start`, where the
+  // first and last source pixels are partially covered and every interior pixel carries `interiorWeight`.
+  struct Span {
+    uint16_t start;
+    uint16_t count;
+    uint16_t firstWeight;
+    uint16_t lastWeight;
+  };
+
+  static Span computeSpan(int outIndex, int srcSize, int dstSize, uint16_t interiorWeight);
+  static uint16_t sourceWeight(const Span& span, int srcIndex, uint16_t interiorWeight);
+
+  void filterRowHorizontally();
+  void emitRow(const uint8_t* gray);
+
+  int srcWidth;
+  int srcHeight;
+  int dstWidth;
+  int dstHeight;
+  OutputFormat format;
+  Dither dither;
+  bool identity;
+
+  uint16_t hInteriorWeight = 0;
+  uint16_t vInteriorWeight = 0;
+
+  Span* hSpans = nullptr;        // dstWidth entries
+  uint8_t* grayRow = nullptr;    // srcWidth, current source row in 8-bit gray
+  uint16_t* hRow = nullptr;      // dstWidth, horizontally filtered row in Q8
+  uint32_t* vAccum = nullptr;    // dstWidth, vertical accumulator in Q22
+  uint8_t* outGray = nullptr;    // dstWidth, averaged output row before quantization
+  uint8_t* packedRow = nullptr;  // packed output row
+
+  int nextSrcY = 0;
+  int nextOutY = 0;
+  Span vSpan = {};
+
+  AtkinsonDitherer* atkinsonDitherer = nullptr;
+  FloydSteinbergDitherer* fsDitherer = nullptr;
+  Atkinson1BitDitherer* atkinson1BitDitherer = nullptr;
+
+  RowSink sink;
+};
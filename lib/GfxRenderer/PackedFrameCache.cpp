@@ -0,0 +1,252 @@
+#include "PackedFrameCache.h"
+
+#include <HalDisplay.h>
+#include <Logging.h>
+#include <Serialization.h>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+namespace {
+constexpr size_t CHUNK_SIZE = 512;
+constexpr size_t MAX_PACKBITS_RUN = 128;
+
+// PackBits: a control byte n < 128 is followed by n + 1 literal bytes, n > 128 by one byte repeated 257 - n times.
+// Runs shorter than three bytes are cheaper as literals. `emit` receives the coded bytes in order.
+template <typename EmitFn>
+void packBits(const uint8_t* data, const size_t size, EmitFn&& emit) {
+  size_t i = 0;
+  while (i < size) {
+    size_t run = 1;
+    while (i + run < size && run < MAX_PACKBITS_RUN && data[i + run] == data[i]) run++;
+    if (run >= 3) {
+      const uint8_t code[2] = {static_cast<uint8_t>(257 - run), data[i]};
+      emit(code, 2);
+      i += run;
+      continue;
+    }
+
+    const size_t start = i;
+    while (i < size && i - start < MAX_PACKBITS_RUN &&
+           !(i + 2 < size && data[i] == data[i + 1] && data[i] == data[i + 2])) {
+      i++;
+    }
+    const uint8_t control = static_cast<uint8_t>(i - start - 1);
+    emit(&control, 1);
+    emit(data + start, i - start);
+  }
+}
+}  // namespace
+
+PackedFrameCache::~PackedFrameCache() { close(); }
+
+std::string PackedFrameCache::pathFor(const std::string& cacheDir, const std::string& sourcePath) {
+  return cacheDir + "/frame_" + std::to_string(std::hash<std::string>{}(sourcePath)) + ".bin";
+}
+
+bool PackedFrameCache::stampSource(FsFile& sourceFile) {
+  uint16_t date = 0;
+  uint16_t time = 0;
+  if (!sourceFile || !sourceFile.getModifyDateTime(&date, &time)) {
+    return false;
+  }
+  sourceSize = sourceFile.fileSize();
+  sourceModified = static_cast<uint32_t>(date) << 16 | time;
+  stamped = true;
+  return true;
+}
+
+bool PackedFrameCache::open() {
+  close();
+  if (!stamped || !Storage.exists(cachePath.c_str())) {
+    return false;
+  }
+  if (!Storage.openFileForRead("PFC", cachePath, file)) {
+    return false;
+  }
+
+  Header header = {};
+  serialization::readPod(file, header);
+  if (header.magic != MAGIC || header.version != VERSION || header.planeSize != HalDisplay::BUFFER_SIZE ||
+      header.planeCount == 0 || header.planeCount > MAX_PLANES || (header.flags & ~FLAG_PACKBITS) != 0) {
+    LOG_DBG("PFC", "Ignoring malformed cache: %s", cachePath.c_str());
+    close();
+    return false;
+  }
+  if (header.sourceSize != sourceSize || header.sourceModified != sourceModified || header.variant != variant) {
+    LOG_DBG("PFC", "Stale cache: %s", cachePath.c_str());
+    close();
+    return false;
+  }
+  // Packed planes vary in size; each one's length is checked as it is read
+  const bool isPacked = header.flags & FLAG_PACKBITS;
+  const size_t planeBytes = isPacked ? sizeof(uint32_t) : HalDisplay::BUFFER_SIZE;
+  if (isPacked ? file.fileSize() < sizeof(Header) + header.planeCount * planeBytes
+               : file.fileSize() != sizeof(Header) + header.planeCount * planeBytes) {
+    LOG_DBG("PFC", "Truncated cache: %s", cachePath.c_str());
+    close();
+    return false;
+  }
+
+  planeCount = header.planeCount;
+  planesDone = 0;
+  packed = isPacked;
+  return true;
+}
+
+bool PackedFrameCache::readPlane(uint8_t* frameBuffer) {
+  if (!file || writing || planesDone >= planeCount) {
+    return false;
+  }
+  if (packed ? !readPackedPlane(frameBuffer)
+             : file.read(frameBuffer, HalDisplay::BUFFER_SIZE) != static_cast<int>(HalDisplay::BUFFER_SIZE)) {
+    LOG_ERR("PFC", "Short read on plane %u of %s", planesDone, cachePath.c_str());
+    return false;
+  }
+  planesDone++;
+  return true;
+}
+
+bool PackedFrameCache::readPackedPlane(uint8_t* frameBuffer) {
+  uint32_t remaining = 0;
+  if (file.read(reinterpret_cast<uint8_t*>(&remaining), sizeof(remaining)) != sizeof(remaining)) {
+    return false;
+  }
+
+  uint8_t chunk[CHUNK_SIZE];
+  size_t chunkLength = 0;
+  size_t chunkPos = 0;
+  const auto fill = [&]() {
+    if (chunkPos < chunkLength) return true;
+    if (remaining == 0) return false;
+    chunkLength = std::min<size_t>(remaining, CHUNK_SIZE);
+    chunkPos = 0;
+    remaining -= chunkLength;
+    return file.read(chunk, chunkLength) == static_cast<int>(chunkLength);
+  };
+
+  // Codes that would run past the frame or past the plane's encoded length mean a corrupt file
+  size_t out = 0;
+  while (out < HalDisplay::BUFFER_SIZE) {
+    if (!fill()) return false;
+    const uint8_t control = chunk[chunkPos++];
+    if (control < 128) {
+      size_t literal = control + 1;
+      if (out + literal > HalDisplay::BUFFER_SIZE) return false;
+      while (literal > 0) {
+        if (!fill()) return false;
+        const size_t n = std::min(literal, chunkLength - chunkPos);
+        memcpy(frameBuffer + out, chunk + chunkPos, n);
+        chunkPos += n;
+        out += n;
+        literal -= n;
+      }
+    } else if (control > 128) {
+      const size_t run = 257 - control;
+      if (out + run > HalDisplay::BUFFER_SIZE || !fill()) return false;
+      memset(frameBuffer + out, chunk[chunkPos++], run);
+      out += run;
+    }
+  }
+  return remaining == 0 && chunkPos == chunkLength;
+}
+
+bool PackedFrameCache::beginWrite(const uint8_t planes, const bool compress) {
+  close();
+  if (!stamped || planes == 0 || planes > MAX_PLANES) {
+    return false;
+  }
+  if (!Storage.openFileForWrite("PFC", tempPath(), file)) {
+    return false;
+  }
+
+  const uint8_t flags = compress ? FLAG_PACKBITS : 0;
+  const Header header = {MAGIC, VERSION, planes, flags, HalDisplay::BUFFER_SIZE, sourceSize, sourceModified, variant};
+  serialization::writePod(file, header);
+  writing = true;
+  packed = compress;
+  planeCount = planes;
+  planesDone = 0;
+  return true;
+}
+
+bool PackedFrameCache::writePlane(const uint8_t* frameBuffer) {
+  if (!file || !writing || planesDone >= planeCount) {
+    return false;
+  }
+  if (packed ? !writePackedPlane(frameBuffer)
+             : file.write(frameBuffer, HalDisplay::BUFFER_SIZE) != HalDisplay::BUFFER_SIZE) {
+    LOG_ERR("PFC", "Short write on plane %u of %s", planesDone, cachePath.c_str());
+    close();
+    return false;
+  }
+  planesDone++;
+  return true;
+}
+
+bool PackedFrameCache::writePackedPlane(const uint8_t* frameBuffer) {
+  // Sizing the codes first costs another pass over the frame but keeps the file strictly sequential
+  uint32_t encodedSize = 0;
+  packBits(frameBuffer, HalDisplay::BUFFER_SIZE, [&](const uint8_t*, const size_t n) { encodedSize += n; });
+  if (file.write(reinterpret_cast<const uint8_t*>(&encodedSize), sizeof(encodedSize)) != sizeof(encodedSize)) {
+    return false;
+  }
+
+  uint8_t chunk[CHUNK_SIZE];
+  size_t chunkLength = 0;
+  bool ok = true;
+  packBits(frameBuffer, HalDisplay::BUFFER_SIZE, [&](const uint8_t* bytes, size_t n) {
+    while (n > 0 && ok) {
+      const size_t take = std::min(n, CHUNK_SIZE - chunkLength);
+      memcpy(chunk + chunkLength, bytes, take);
+      chunkLength += take;
+      bytes += take;
+      n -= take;
+      if (chunkLength == CHUNK_SIZE) {
+        ok = file.write(chunk, chunkLength) == chunkLength;
+        chunkLength = 0;
+      }
+    }
+  });
+  return ok && (chunkLength == 0 || file.write(chunk, chunkLength) == chunkLength);
+}
+
+bool PackedFrameCache::commit() {
+  if (!file || !writing || planesDone != planeCount) {
+    close();
+    return false;
+  }
+  file.close();
+  writing = false;
+
+  const std::string tmp = tempPath();
+  if (Storage.exists(cachePath.c_str())) {
+    Storage.remove(cachePath.c_str());
+  }
+  if (!Storage.rename(tmp.c_str(), cachePath.c_str())) {
+    LOG_ERR("PFC", "Failed to move cache into place: %s", cachePath.c_str());
+    Storage.remove(tmp.c_str());
+    return false;
+  }
+  LOG_DBG("PFC", "Wrote %u %s plane(s) to %s", planeCount, packed ? "packed" : "raw", cachePath.c_str());
+  return true;
+}
+
+void PackedFrameCache::close() {
+  if (file) {
+    file.close();
+  }
+  if (writing) {
+    writing = false;
+    Storage.remove(tempPath().c_str());
+  }
+  planesDone = 0;
+}
+
+bool PackedFrameCache::invalidate() const {
+  if (!Storage.exists(cachePath.c_str())) {
+    return true;
+  }
+  return Storage.remove(cachePath.c_str());
+}
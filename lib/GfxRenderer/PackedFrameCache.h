@@ -0,0 +1,91 @@
+#pragma once
+
+#include <HalStorage.h>
+
+#include <cstdint>
+#include <string>
+
+// On-disk cache of a fully rendered screen, stored exactly as the panel frame buffer expects it.
+//
+// A cache file holds a small header followed by one to three planes of HalDisplay::BUFFER_SIZE bytes each: the BW
+// frame and, for grayscale images, the LSB and MSB frames in the order they are handed to the display. Showing a
+// cached image is a straight read into the frame buffer per plane; no BMP decoding, scaling or per-pixel rotation.
+//
+// Each file is stamped with the size and FAT modification time of the source image plus a caller-defined variant
+// (orientation and any settings the rendered output depends on). A mismatch on any of them is treated as a miss.
+// Writes go to a temporary file that is only renamed into place once every plane has been written, so an
+// interrupted write (e.g. power loss while entering sleep) never leaves a truncated cache behind.
+//
+// Planes can optionally be stored PackBits run-length coded, each as a u32 encoded length followed by the codes. The
+// margins and line gaps of a page of text pack well; a dithered image hardly shrinks at all, so sleep images stay raw.
+class PackedFrameCache {
+ public:
+  enum Plane : uint8_t { BW = 0, GRAYSCALE_LSB = 1, GRAYSCALE_MSB = 2 };
+  static constexpr uint8_t MAX_PLANES = 3;
+
+  // `cachePath` is the cache file to use, see pathFor(). `variant` is folded into the stamp.
+  PackedFrameCache(std::string cachePath, uint32_t variant) : cachePath(std::move(cachePath)), variant(variant) {}
+  ~PackedFrameCache();
+
+  PackedFrameCache(const PackedFrameCache&) = delete;
+  PackedFrameCache& operator=(const PackedFrameCache&) = delete;
+
+  // Cache file location for a given source image, inside `cacheDir`. Files are never reclaimed here: stale ones stay
+  // until Clear Cache, which removes every frame_* file (and its .tmp) in /.crosspoint.
+  static std::string pathFor(const std::string& cacheDir, const std::string& sourcePath);
+
+  // Record the identity of the source image. Must be called before open() or beginWrite().
+  bool stampSource(FsFile& sourceFile);
+
+  // Open an existing cache file for reading. Returns false if it is missing, malformed or stale.
+  bool open();
+  uint8_t getPlaneCount() const { return planeCount; }
+  // Read the next plane (BW, then LSB, then MSB) into a frame buffer of HalDisplay::BUFFER_SIZE bytes
+  bool readPlane(uint8_t* frameBuffer);
+
+  // Start writing a new cache file with `planes` planes (1 for BW only, 3 with grayscale), PackBits coded if `compress`
+  bool beginWrite(uint8_t planes, bool compress = false);
+  bool writePlane(const uint8_t* frameBuffer);
+  // Finish the write and move the file into place. Fails if fewer planes than announced were written.
+  bool commit();
+
+  // Close any open file, discarding a write in progress
+  void close();
+
+  // Remove the cache file, e.g. when the source image is deleted
+  bool invalidate() const;
+
+ private:
+  static constexpr uint32_t MAGIC = 0x46504350;  // "PCPF" little-endian
+  static constexpr uint16_t VERSION = 1;
+  static constexpr uint8_t FLAG_PACKBITS = 0x01;
+
+#pragma pack(push, 1)
+  struct Header {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t planeCount;
+    uint8_t flags;
+    uint32_t planeSize;
+    uint32_t sourceSize;
+    uint32_t sourceModified;  // FAT date << 16 | FAT time
+    uint32_t variant;
+  };
+#pragma pack(pop)
+
+  std::string tempPath() const { return cachePath + ".tmp"; }
+  bool readPackedPlane(uint8_t* frameBuffer);
+  bool writePackedPlane(const uint8_t* frameBuffer);
+
+  std::string cachePath;
+  uint32_t variant;
+  uint32_t sourceSize = 0;
+  uint32_t sourceModified = 0;
+  bool stamped = false;
+
+  FsFile file;
+  bool writing = false;
+  bool packed = false;
+  uint8_t planeCount = 0;
+  uint8_t planesDone = 0;
+};
@@ -44,6 +44,14 @@ const char* I18n::getLanguageName(Language lang) const {
   return LANGUAGE_NAMES[index];
 }
 
+const char* I18n::getLanguageCode(Language lang) {
+  const auto index = static_cast<size_t>(lang);
+  if (index >= static_cast<size_t>(Language::_COUNT)) {
+    return "";
+  }
+  return LANGUAGE_CODES[index];
+}
+
 void I18n::saveSettings() {
   Storage.mkdir("/.crosspoint");
 
@@ -23,6 +23,8 @@ class I18n {
   Language getLanguage() const { return _language; }
   void setLanguage(Language lang);
   const char* getLanguageName(Language lang) const;
+  // Lowercase ISO 639-1 code, e.g. for picking hyphenation rules
+  static const char* getLanguageCode(Language lang);
 
   void saveSettings();
   void loadSettings();
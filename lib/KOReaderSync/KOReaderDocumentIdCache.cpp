@@ -0,0 +1,256 @@
+#include "KOReaderDocumentIdCache.h"
+
+#include <FsHelpers.h>
+#include <HalStorage.h>
+#include <Logging.h>
+
+#include <cstring>
+#include <vector>
+
+#include "KOReaderDocumentId.h"
+
+namespace {
+constexpr char CACHE_FILE[] = "/.crosspoint/koreader_ids.bin";
+constexpr uint8_t CACHE_VERSION = 1;
+// 64KB file, created once; far more books than fit on a typical card's library screen
+constexpr uint32_t SLOT_COUNT = 2048;
+// Slots a path may land in, starting at its home slot; read in one go
+constexpr uint32_t PROBE_SLOTS = 8;
+constexpr size_t HEADER_SIZE = 8;
+constexpr size_t ID_SIZE = 16;
+
+// u64 path hash (0 = empty), u32 size, u32 modify stamp, 16-byte MD5
+struct Slot {
+  uint64_t key;
+  uint32_t size;
+  uint32_t modified;
+  uint8_t id[ID_SIZE];
+};
+static_assert(sizeof(Slot) == 32, "Slot is stored as is");
+
+// FNV-1a, as used for other path keys; never 0 so empty slots stay distinguishable
+uint64_t pathKey(const std::string& path) {
+  uint64_t hash = 14695981039346656037ull;
+  for (const char c : path) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 1099511628211ull;
+  }
+  return hash == 0 ? 1 : hash;
+}
+
+// First slot of the probe window; windows never wrap, so each is one contiguous read
+uint32_t homeSlot(const uint64_t key) { return static_cast<uint32_t>(key % (SLOT_COUNT - PROBE_SLOTS + 1)); }
+
+size_t slotOffset(const uint32_t slot) { return HEADER_SIZE + static_cast<size_t>(slot) * sizeof(Slot); }
+
+bool readHeader(FsFile& file) {
+  uint8_t header[HEADER_SIZE];
+  if (file.read(header, sizeof(header)) != static_cast<int>(sizeof(header))) return false;
+  uint32_t slots;
+  memcpy(&slots, header + 4, sizeof(slots));
+  return header[0] == CACHE_VERSION && slots == SLOT_COUNT && file.size() == slotOffset(SLOT_COUNT);
+}
+
+bool readWindow(FsFile& file, const uint32_t home, Slot* window) {
+  const int size = static_cast<int>(PROBE_SLOTS * sizeof(Slot));
+  return file.seekSet(slotOffset(home)) && file.read(window, size) == size;
+}
+
+// Writes an empty table; existing IDs are lost, which only costs recomputing them
+bool createCache() {
+  Storage.mkdir("/.crosspoint");
+  FsFile file;
+  if (!Storage.openFileForWrite("KOID", CACHE_FILE, file)) {
+    return false;
+  }
+  uint8_t header[HEADER_SIZE] = {CACHE_VERSION};
+  memcpy(header + 4, &SLOT_COUNT, sizeof(SLOT_COUNT));
+  bool ok = file.write(header, sizeof(header)) == sizeof(header);
+  uint8_t zeros[512] = {};
+  for (size_t remaining = SLOT_COUNT * sizeof(Slot); ok && remaining > 0; remaining -= sizeof(zeros)) {
+    ok = file.write(zeros, sizeof(zeros)) == sizeof(zeros);
+  }
+  file.close();
+  if (!ok) {
+    LOG_ERR("KOID", "Failed to create %s", CACHE_FILE);
+    Storage.remove(CACHE_FILE);
+  }
+  return ok;
+}
+
+bool parseHex(const std::string& hex, uint8_t* out) {
+  if (hex.size() != ID_SIZE * 2) return false;
+  for (size_t i = 0; i < ID_SIZE; i++) {
+    const char* digits = hex.c_str() + i * 2;
+    char* end;
+    const char pair[3] = {digits[0], digits[1], '\0'};
+    out[i] = static_cast<uint8_t>(strtoul(pair, &end, 16));
+    if (end != pair + 2) return false;
+  }
+  return true;
+}
+
+std::string toHex(const uint8_t* id) {
+  static constexpr char DIGITS[] = "0123456789abcdef";
+  std::string hex(ID_SIZE * 2, '0');
+  for (size_t i = 0; i < ID_SIZE; i++) {
+    hex[i * 2] = DIGITS[id[i] >> 4];
+    hex[i * 2 + 1] = DIGITS[id[i] & 0x0F];
+  }
+  return hex;
+}
+}  // namespace
+
+bool KOReaderDocumentIdCache::stat(const std::string& filePath, Stamp& stamp) {
+  FsFile file;
+  if (!Storage.openFileForRead("KOID", filePath, file)) {
+    return false;
+  }
+  uint16_t date = 0;
+  uint16_t time = 0;
+  file.getModifyDateTime(&date, &time);
+  stamp.size = static_cast<uint32_t>(file.fileSize());
+  stamp.modified = static_cast<uint32_t>(date) << 16 | time;
+  file.close();
+  return true;
+}
+
+std::string KOReaderDocumentIdCache::find(const std::string& filePath, const Stamp& stamp) {
+  FsFile file;
+  if (!Storage.exists(CACHE_FILE) || !Storage.openFileForRead("KOID", CACHE_FILE, file)) {
+    return "";
+  }
+  const uint64_t key = pathKey(filePath);
+  Slot window[PROBE_SLOTS];
+  const bool read = readHeader(file) && readWindow(file, homeSlot(key), window);
+  file.close();
+  if (!read) {
+    return "";
+  }
+  for (const auto& slot : window) {
+    if (slot.key == key && slot.size == stamp.size && slot.modified == stamp.modified) {
+      return toHex(slot.id);
+    }
+  }
+  return "";
+}
+
+void KOReaderDocumentIdCache::store(const std::string& filePath, const Stamp& stamp, const std::string& id) {
+  Slot entry = {pathKey(filePath), stamp.size, stamp.modified, {}};
+  if (!parseHex(id, entry.id)) {
+    return;
+  }
+
+  FsFile file;
+  if (Storage.exists(CACHE_FILE)) {
+    file = Storage.open(CACHE_FILE, O_RDWR);
+  }
+  if (!file || !readHeader(file)) {
+    if (file) {
+      file.close();
+    }
+    if (!createCache()) {
+      return;
+    }
+    file = Storage.open(CACHE_FILE, O_RDWR);
+    if (!file) {
+      return;
+    }
+  }
+
+  const uint32_t home = homeSlot(entry.key);
+  Slot window[PROBE_SLOTS];
+  if (!readWindow(file, home, window)) {
+    file.close();
+    return;
+  }
+  // Same path first, then a free slot, else evict one picked by the upper hash bits
+  uint32_t target = PROBE_SLOTS;
+  for (uint32_t i = 0; i < PROBE_SLOTS && target == PROBE_SLOTS; i++) {
+    if (window[i].key == entry.key) target = i;
+  }
+  for (uint32_t i = 0; i < PROBE_SLOTS && target == PROBE_SLOTS; i++) {
+    if (window[i].key == 0) target = i;
+  }
+  if (target == PROBE_SLOTS) {
+    target = static_cast<uint32_t>(entry.key >> 32) % PROBE_SLOTS;
+  }
+
+  if (!file.seekSet(slotOffset(home + target)) || file.write(&entry, sizeof(entry)) != sizeof(entry)) {
+    LOG_ERR("KOID", "Failed to store ID for %s", filePath.c_str());
+  }
+  file.close();
+}
+
+std::string KOReaderDocumentIdCache::lookup(const std::string& filePath) {
+  Stamp stamp;
+  if (!stat(filePath, stamp)) {
+    return "";
+  }
+  return find(filePath, stamp);
+}
+
+std::string KOReaderDocumentIdCache::get(const std::string& filePath) {
+  Stamp stamp;
+  if (!stat(filePath, stamp)) {
+    return "";
+  }
+  std::string id = find(filePath, stamp);
+  if (!id.empty()) {
+    LOG_DBG("KOID", "Cached ID for %s", filePath.c_str());
+    return id;
+  }
+  id = KOReaderDocumentId::calculate(filePath);
+  if (!id.empty()) {
+    store(filePath, stamp, id);
+  }
+  return id;
+}
+
+size_t KOReaderDocumentIdCache::precompute(const std::string& root, const ProgressCallback& progress) {
+  size_t seen = 0;
+  size_t computed = 0;
+  std::vector<std::string> directories = {root};
+  char name[256];
+
+  while (!directories.empty()) {
+    const std::string directory = std::move(directories.back());
+    directories.pop_back();
+    auto dir = Storage.open(directory.c_str());
+    if (!dir || !dir.isDirectory()) {
+      continue;
+    }
+    const std::string prefix = directory == "/" ? "/" : directory + "/";
+
+    for (auto entry = dir.openNextFile(); entry; entry = dir.openNextFile()) {
+      entry.getName(name, sizeof(name));
+      const bool isDirectory = entry.isDirectory();
+      entry.close();
+      if (name[0] == '.') continue;
+      if (isDirectory) {
+        directories.push_back(prefix + name);
+        continue;
+      }
+      const std::string path = prefix + name;
+      if (!FsHelpers::hasEpubExtension(path)) continue;
+
+      Stamp stamp;
+      if (stat(path, stamp) && find(path, stamp).empty()) {
+        const std::string id = KOReaderDocumentId::calculate(path);
+        if (!id.empty()) {
+          store(path, stamp, id);
+          computed++;
+        }
+      }
+      seen++;
+      if (progress && !progress(seen, path)) {
+        dir.close();
+        return computed;
+      }
+    }
+    dir.close();
+  }
+
+  LOG_DBG("KOID", "Precomputed %zu of %zu document IDs", computed, seen);
+  return computed;
+}
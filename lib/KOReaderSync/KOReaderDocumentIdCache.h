@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+/**
+ * Persistent store of KOReader binary document IDs, so a sync never has to read the book.
+ *
+ * IDs live in one fixed-size file on the SD card, an open-addressed table of 32-byte slots keyed by a hash of the
+ * path. A slot also records the file size and FAT modify stamp it was computed for, so a replaced book is never
+ * matched with its old ID. A lookup is a single small read and only stats the book.
+ *
+ * Entries are written when a book is opened or uploaded, and precompute() fills the table for a whole library.
+ * When the probe window for a path is full, an older entry is evicted; a miss only means the ID is computed again.
+ *
+ * Not thread safe: callers run on one task at a time (reader, upload pre-indexer, settings).
+ */
+class KOReaderDocumentIdCache {
+ public:
+  // Called after each book with the number of books seen so far; return false to stop
+  using ProgressCallback = std::function<bool(size_t done, const std::string& path)>;
+
+  // Cached ID of `filePath` if it is current, otherwise empty. Never reads the book's contents.
+  static std::string lookup(const std::string& filePath);
+
+  // ID of `filePath`, computed with KOReaderDocumentId::calculate() and stored when no current entry exists.
+  // Empty if the file can't be read.
+  static std::string get(const std::string& filePath);
+
+  // Make sure every EPUB under `root` (hidden directories excluded) has a current entry. Returns the number of IDs
+  // that had to be computed.
+  static size_t precompute(const std::string& root, const ProgressCallback& progress = nullptr);
+
+ private:
+  struct Stamp {
+    uint32_t size = 0;
+    uint32_t modified = 0;  // FAT date << 16 | time
+  };
+
+  static bool stat(const std::string& filePath, Stamp& stamp);
+  static std::string find(const std::string& filePath, const Stamp& stamp);
+  static void store(const std::string& filePath, const Stamp& stamp, const std::string& id);
+};
@@ -1,10 +1,13 @@
 #include "ProgressMapper.h"
 
+#include <Epub/Section.h>
+#include <Epub/XPathMap.h>
 #include <Logging.h>
 
 #include <cmath>
 
-KOReaderPosition ProgressMapper::toKOReader(const std::shared_ptr<Epub>& epub, const CrossPointPosition& pos) {
+KOReaderPosition ProgressMapper::toKOReader(const std::shared_ptr<Epub>& epub, GfxRenderer& renderer,
+                                            const CrossPointPosition& pos) {
   KOReaderPosition result;
 
   // Calculate page progress within current spine item
@@ -16,8 +19,12 @@ KOReaderPosition ProgressMapper::toKOReader(const std::shared_ptr<Epub>& epub, c
   // Calculate overall book progress (0.0-1.0)
   result.percentage = epub->calculateProgress(pos.spineIndex, intraSpineProgress);
 
-  // Generate XPath with estimated paragraph position based on page
-  result.xpath = generateXPath(pos.spineIndex, pos.pageNumber, pos.totalPages);
+  // Exact xpointer of the page's first word when the section has an XPath map
+  const Section section(epub, pos.spineIndex, renderer);
+  result.xpath = section.getXPathForPage(static_cast<uint16_t>(pos.pageNumber));
+  if (result.xpath.empty()) {
+    result.xpath = generateXPath(pos.spineIndex, pos.pageNumber, pos.totalPages);
+  }
 
   // Get chapter info for logging
   const int tocIndex = epub->getTocIndexForSpineIndex(pos.spineIndex);
@@ -29,13 +36,31 @@ KOReaderPosition ProgressMapper::toKOReader(const std::shared_ptr<Epub>& epub, c
   return result;
 }
 
-CrossPointPosition ProgressMapper::toCrossPoint(const std::shared_ptr<Epub>& epub, const KOReaderPosition& koPos,
-                                                int currentSpineIndex, int totalPagesInCurrentSpine) {
+CrossPointPosition ProgressMapper::toCrossPoint(const std::shared_ptr<Epub>& epub, GfxRenderer& renderer,
+                                                const KOReaderPosition& koPos, int currentSpineIndex,
+                                                int totalPagesInCurrentSpine) {
   CrossPointPosition result;
   result.spineIndex = 0;
   result.pageNumber = 0;
   result.totalPages = 0;
 
+  // Exact page through the XPath map, as long as the target section's pages match the current layout
+  const int xpathSpineIndex = XPathMap::spineIndexOf(koPos.xpath);
+  if (xpathSpineIndex >= 0 && xpathSpineIndex < epub->getSpineItemsCount() && currentSpineIndex >= 0) {
+    const Section target(epub, xpathSpineIndex, renderer);
+    const Section current(epub, currentSpineIndex, renderer);
+    if (xpathSpineIndex == currentSpineIndex || target.hasSameLayout(current)) {
+      if (const auto page = target.getPageForXPath(koPos.xpath)) {
+        result.spineIndex = xpathSpineIndex;
+        result.pageNumber = *page;
+        result.totalPages = xpathSpineIndex == currentSpineIndex ? totalPagesInCurrentSpine : 0;
+        LOG_DBG("ProgressMapper", "KOReader -> CrossPoint: %s -> spine=%d, page=%d (exact)", koPos.xpath.c_str(),
+                result.spineIndex, result.pageNumber);
+        return result;
+      }
+    }
+  }
+
   const size_t bookSize = epub->getBookSize();
   if (bookSize == 0) {
     return result;
@@ -107,8 +132,8 @@ CrossPointPosition ProgressMapper::toCrossPoint(const std::shared_ptr<Epub>& epu
 }
 
 std::string ProgressMapper::generateXPath(int spineIndex, int pageNumber, int totalPages) {
-  // Use 0-based DocFragment indices for KOReader
+  // DocFragment indices are 1-based like any XPath index
   // Use a simple xpath pointing to the DocFragment - KOReader will use the percentage for fine positioning within it
   // Avoid specifying paragraph numbers as they may not exist in the target document
-  return "/body/DocFragment[" + std::to_string(spineIndex) + "]/body";
+  return "/body/DocFragment[" + std::to_string(spineIndex + 1) + "]/body";
 }
@@ -4,6 +4,8 @@
 #include <memory>
 #include <string>
 
+class GfxRenderer;
+
 /**
  * CrossPoint position representation.
  */
@@ -27,9 +29,9 @@ struct KOReaderPosition {
  * CrossPoint tracks position as (spineIndex, pageNumber).
  * KOReader uses XPath-like strings + percentage.
  *
- * Since CrossPoint discards HTML structure during parsing, we generate
- * synthetic XPath strings based on spine index, using percentage as the
- * primary sync mechanism.
+ * When the spine item's section cache holds an XPath map (see XPathMap), positions convert exactly in both
+ * directions. Otherwise we fall back to a synthetic XPath pointing at the spine item and use the percentage
+ * for positioning.
  */
 class ProgressMapper {
  public:
@@ -37,31 +39,35 @@ class ProgressMapper {
    * Convert CrossPoint position to KOReader format.
    *
    * @param epub The EPUB book
+   * @param renderer Renderer the section caches were laid out for
    * @param pos CrossPoint position
    * @return KOReader position
    */
-  static KOReaderPosition toKOReader(const std::shared_ptr<Epub>& epub, const CrossPointPosition& pos);
+  static KOReaderPosition toKOReader(const std::shared_ptr<Epub>& epub, GfxRenderer& renderer,
+                                     const CrossPointPosition& pos);
 
   /**
    * Convert KOReader position to CrossPoint format.
    *
-   * Note: The returned pageNumber may be approximate since different
-   * rendering settings produce different page counts.
+   * The page is exact when the xpointer's spine item has a section cache laid out like the current one;
+   * otherwise it is estimated from the percentage, since different rendering settings produce different page counts.
    *
    * @param epub The EPUB book
+   * @param renderer Renderer the section caches were laid out for
    * @param koPos KOReader position
    * @param currentSpineIndex Index of the currently open spine item (for density estimation)
    * @param totalPagesInCurrentSpine Total pages in the current spine item (for density estimation)
    * @return CrossPoint position
    */
-  static CrossPointPosition toCrossPoint(const std::shared_ptr<Epub>& epub, const KOReaderPosition& koPos,
-                                         int currentSpineIndex = -1, int totalPagesInCurrentSpine = 0);
+  static CrossPointPosition toCrossPoint(const std::shared_ptr<Epub>& epub, GfxRenderer& renderer,
+                                         const KOReaderPosition& koPos, int currentSpineIndex = -1,
+                                         int totalPagesInCurrentSpine = 0);
 
  private:
   /**
-   * Generate XPath for KOReader compatibility.
+   * Generate XPath for KOReader compatibility when the section has no XPath map.
    * Format: /body/DocFragment[spineIndex+1]/body
-   * Since CrossPoint doesn't preserve HTML structure, we rely on percentage for positioning.
+   * KOReader then relies on the percentage for positioning within the spine item.
    */
   static std::string generateXPath(int spineIndex, int pageNumber, int totalPages);
 };
@@ -0,0 +1,515 @@
+#include "LibraryDb.h"
+
+#include <DirectoryIndex.h>
+#include <HalStorage.h>
+#include <Logging.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+namespace {
+constexpr char LIBRARY_DIR[] = "/.crosspoint/library";
+constexpr char BOOKS_FILE[] = "/.crosspoint/library/books.bin";
+constexpr uint32_t MAGIC = 0x4244424C;  // "LBDB"
+constexpr uint8_t VERSION = 1;
+constexpr uint32_t NO_SLOT = 0xFFFFFFFF;
+constexpr uint8_t FLAG_LIVE = 0x01;
+
+struct Header {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t dirty;  // set while an update runs; the indexes may not match the records
+  uint16_t reserved;
+  uint32_t slots;     // records in the file, live or free
+  uint32_t live;      // books, and entries in every index
+  uint32_t freeSlot;  // first slot of the free list
+  uint32_t lastOpened;
+};
+
+// Text fields are NUL-terminated; UTF-8 sequences are never cut
+struct Record {
+  uint8_t flags;
+  uint8_t progressPercent;
+  uint16_t reserved;
+  uint32_t lastOpened;
+  uint32_t nextFree;  // next slot of the free list, for free records
+  uint32_t reserved2;
+  uint64_t pathKey;
+  char path[256];
+  char title[128];
+  char author[96];
+  char series[96];
+  char language[16];
+  char coverBmpPath[64];
+  char thumbBmpPath[64];
+};
+static_assert(sizeof(Record) == 744, "Record layout is part of the file format");
+
+enum Index : uint8_t { BY_PATH, BY_TITLE, BY_AUTHOR, BY_SERIES, BY_OPENED, INDEX_COUNT };
+const char* const INDEX_FILES[INDEX_COUNT] = {
+    "/.crosspoint/library/path.idx", "/.crosspoint/library/title.idx", "/.crosspoint/library/author.idx",
+    "/.crosspoint/library/series.idx", "/.crosspoint/library/opened.idx"};
+
+// Index entry: a number compared first (path hash or last-opened order; 0 in the text orders), then the slot.
+// Stored packed in ENTRY_SIZE bytes.
+struct Entry {
+  uint64_t number;
+  uint32_t slot;
+};
+constexpr size_t ENTRY_SIZE = 12;
+// Entries moved per read and write while shifting an index
+constexpr size_t SHIFT_ENTRIES = 42;
+
+std::atomic<uint32_t> revision{0};
+
+class Lock {
+  static SemaphoreHandle_t mutex() {
+    static SemaphoreHandle_t handle = xSemaphoreCreateMutex();
+    return handle;
+  }
+
+ public:
+  Lock() { xSemaphoreTake(mutex(), portMAX_DELAY); }
+  ~Lock() { xSemaphoreGive(mutex()); }
+};
+
+// FNV-1a, as used for other path keys
+uint64_t pathKey(const std::string& path) {
+  uint64_t hash = 14695981039346656037ull;
+  for (const char c : path) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+template <size_t N>
+bool copyField(char (&field)[N], const std::string& value) {
+  size_t length = std::min(value.size(), N - 1);
+  while (length > 0 && length < value.size() && (static_cast<uint8_t>(value[length]) & 0xC0) == 0x80) {
+    length--;
+  }
+  memcpy(field, value.data(), length);
+  memset(field + length, 0, N - length);
+  return length == value.size();
+}
+
+template <size_t N>
+std::string fieldText(const char (&field)[N]) {
+  return std::string(field, strnlen(field, N));
+}
+
+bool textLess(const char* a, const char* b) { return DirectoryIndex::nameLess(a, strlen(a), b, strlen(b)); }
+
+Entry entryFor(const Index index, const uint32_t slot, const Record& record) {
+  switch (index) {
+    case BY_PATH:
+      return {record.pathKey, slot};
+    case BY_OPENED:
+      return {record.lastOpened, slot};
+    default:
+      return {0, slot};
+  }
+}
+
+// Index order; the text orders fall back to the title, then all of them to the slot
+bool entryLess(const Index index, const Entry& a, const Record* ra, const Entry& b, const Record* rb) {
+  if (a.number != b.number) return a.number < b.number;
+  if (ra && rb) {
+    const char* pa = index == BY_AUTHOR ? ra->author : index == BY_SERIES ? ra->series : ra->title;
+    const char* pb = index == BY_AUTHOR ? rb->author : index == BY_SERIES ? rb->series : rb->title;
+    if (textLess(pa, pb)) return true;
+    if (textLess(pb, pa)) return false;
+    if (index != BY_TITLE) {
+      if (textLess(ra->title, rb->title)) return true;
+      if (textLess(rb->title, ra->title)) return false;
+    }
+  }
+  return a.slot < b.slot;
+}
+
+bool needsRecord(const Index index) { return index == BY_TITLE || index == BY_AUTHOR || index == BY_SERIES; }
+
+// Whether a change from `before` to `after` moves the book in `index`
+bool keyChanged(const Index index, const Record& before, const Record& after) {
+  switch (index) {
+    case BY_PATH:
+      return before.pathKey != after.pathKey;
+    case BY_OPENED:
+      return before.lastOpened != after.lastOpened;
+    case BY_TITLE:
+      return strcmp(before.title, after.title) != 0;
+    default:
+      return strcmp(before.title, after.title) != 0 ||
+             strcmp(index == BY_AUTHOR ? before.author : before.series,
+                    index == BY_AUTHOR ? after.author : after.series) != 0;
+  }
+}
+
+// The database while one operation runs: books.bin with its header, and index files opened on demand
+class Db {
+  FsFile books;
+  FsFile indexes[INDEX_COUNT];
+
+  static size_t recordOffset(const uint32_t slot) {
+    return sizeof(Header) + static_cast<size_t>(slot) * sizeof(Record);
+  }
+
+  FsFile* index(const Index which) {
+    if (!indexes[which]) {
+      indexes[which] = Storage.open(INDEX_FILES[which], O_RDWR);
+    }
+    return indexes[which] ? &indexes[which] : nullptr;
+  }
+
+  bool readEntry(FsFile& file, const uint32_t position, Entry& entry) {
+    uint8_t bytes[ENTRY_SIZE];
+    if (!file.seekSet(static_cast<size_t>(position) * ENTRY_SIZE) ||
+        file.read(bytes, ENTRY_SIZE) != static_cast<int>(ENTRY_SIZE)) {
+      return false;
+    }
+    memcpy(&entry.number, bytes, sizeof(entry.number));
+    memcpy(&entry.slot, bytes + sizeof(entry.number), sizeof(entry.slot));
+    return true;
+  }
+
+  bool writeEntry(FsFile& file, const uint32_t position, const Entry& entry) {
+    uint8_t bytes[ENTRY_SIZE];
+    memcpy(bytes, &entry.number, sizeof(entry.number));
+    memcpy(bytes + sizeof(entry.number), &entry.slot, sizeof(entry.slot));
+    return file.seekSet(static_cast<size_t>(position) * ENTRY_SIZE) && file.write(bytes, ENTRY_SIZE) == ENTRY_SIZE;
+  }
+
+  // Moves `count` entries from `from` to `to`, in chunks ordered so that no entry is overwritten before it moved
+  static bool shift(FsFile& file, const uint32_t from, const uint32_t to, const uint32_t count) {
+    uint8_t buffer[SHIFT_ENTRIES * ENTRY_SIZE];
+    for (uint32_t done = 0; done < count;) {
+      const uint32_t chunk = std::min<uint32_t>(SHIFT_ENTRIES, count - done);
+      // Moving up copies from the end, moving down from the start
+      const uint32_t offset = to > from ? count - done - chunk : done;
+      const size_t bytes = chunk * ENTRY_SIZE;
+      if (!file.seekSet((from + offset) * ENTRY_SIZE) || file.read(buffer, bytes) != static_cast<int>(bytes) ||
+          !file.seekSet((to + offset) * ENTRY_SIZE) || file.write(buffer, bytes) != bytes) {
+        return false;
+      }
+      done += chunk;
+    }
+    return true;
+  }
+
+  // First position in `index` not ordered before (`target`, `record`), among `count` entries
+  bool lowerBound(const Index which, const Entry& target, const Record* record, const uint32_t count,
+                  uint32_t& position) {
+    FsFile* file = index(which);
+    if (!file) return false;
+    uint32_t low = 0;
+    uint32_t high = count;
+    Entry entry = {};
+    Record other = {};
+    while (low < high) {
+      const uint32_t mid = low + (high - low) / 2;
+      if (!readEntry(*file, mid, entry)) return false;
+      if (record && entry.number == target.number && !readRecord(entry.slot, other)) return false;
+      const bool before = entryLess(which, entry, record ? &other : nullptr, target, record);
+      if (before) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    position = low;
+    return true;
+  }
+
+ public:
+  Header header = {};
+
+  ~Db() {
+    for (auto& file : indexes) {
+      if (file) file.close();
+    }
+    if (books) books.close();
+  }
+
+  // Opens the database, creating it with `create`. Rebuilds the indexes if an update was interrupted.
+  bool open(const bool create) {
+    if (Storage.exists(BOOKS_FILE)) {
+      books = Storage.open(BOOKS_FILE, O_RDWR);
+    }
+    if (books && books.read(&header, sizeof(header)) == static_cast<int>(sizeof(header)) && header.magic == MAGIC &&
+        header.version == VERSION && books.size() >= recordOffset(header.slots)) {
+      return !header.dirty || rebuildIndexes();
+    }
+    if (books) {
+      books.close();
+      LOG_ERR("LDB", "Library database unreadable, starting over");
+    } else if (!create) {
+      return false;
+    }
+
+    Storage.mkdir("/.crosspoint");
+    Storage.mkdir(LIBRARY_DIR);
+    FsFile file;
+    for (const char* path : INDEX_FILES) {
+      if (!Storage.openFileForWrite("LDB", path, file)) return false;
+      file.close();
+    }
+    header = {MAGIC, VERSION, 0, 0, 0, 0, NO_SLOT, 0};
+    if (!Storage.openFileForWrite("LDB", BOOKS_FILE, file)) return false;
+    const bool written = file.write(&header, sizeof(header)) == sizeof(header);
+    file.close();
+    books = Storage.open(BOOKS_FILE, O_RDWR);
+    return written && books;
+  }
+
+  bool writeHeader() { return books.seekSet(0) && books.write(&header, sizeof(header)) == sizeof(header); }
+
+  bool setDirty(const bool dirty) {
+    header.dirty = dirty;
+    return writeHeader();
+  }
+
+  bool readRecord(const uint32_t slot, Record& record) {
+    return slot < header.slots && books.seekSet(recordOffset(slot)) &&
+           books.read(&record, sizeof(record)) == static_cast<int>(sizeof(record));
+  }
+
+  bool writeRecord(const uint32_t slot, const Record& record) {
+    return books.seekSet(recordOffset(slot)) && books.write(&record, sizeof(record)) == sizeof(record);
+  }
+
+  // Slot of the live book at `path`, or NO_SLOT
+  uint32_t findSlot(const std::string& path, Record& record) {
+    const uint64_t key = pathKey(path);
+    uint32_t position = 0;
+    FsFile* file = index(BY_PATH);
+    if (!file || !lowerBound(BY_PATH, {key, 0}, nullptr, header.live, position)) return NO_SLOT;
+    Entry entry = {};
+    for (; position < header.live && readEntry(*file, position, entry) && entry.number == key; position++) {
+      if (readRecord(entry.slot, record) && (record.flags & FLAG_LIVE) && path == record.path) {
+        return entry.slot;
+      }
+    }
+    return NO_SLOT;
+  }
+
+  bool insert(const Index which, const uint32_t slot, const Record& record, const uint32_t count) {
+    const Entry entry = entryFor(which, slot, record);
+    uint32_t position = 0;
+    FsFile* file = index(which);
+    return file && lowerBound(which, entry, needsRecord(which) ? &record : nullptr, count, position) &&
+           shift(*file, position, position + 1, count - position) && writeEntry(*file, position, entry);
+  }
+
+  bool erase(const Index which, const uint32_t slot, const Record& record, const uint32_t count) {
+    const Entry entry = entryFor(which, slot, record);
+    uint32_t position = 0;
+    FsFile* file = index(which);
+    Entry found = {};
+    if (!file || !lowerBound(which, entry, needsRecord(which) ? &record : nullptr, count, position) ||
+        position >= count || !readEntry(*file, position, found) || found.slot != slot) {
+      LOG_ERR("LDB", "Slot %u missing from index %u", slot, which);
+      return false;
+    }
+    return shift(*file, position + 1, position, count - position - 1);
+  }
+
+  // Re-enters every live book into empty indexes
+  bool rebuildIndexes() {
+    LOG_DBG("LDB", "Rebuilding library indexes for %u books", header.live);
+    uint32_t live = 0;
+    Record record = {};
+    for (uint32_t slot = 0; slot < header.slots; slot++) {
+      if (!readRecord(slot, record)) return false;
+      if (!(record.flags & FLAG_LIVE)) continue;
+      for (uint8_t i = 0; i < INDEX_COUNT; i++) {
+        if (!insert(static_cast<Index>(i), slot, record, live)) return false;
+      }
+      live++;
+    }
+    header.live = live;
+    return setDirty(false);
+  }
+
+  bool entryAt(const Index which, const uint32_t position, Entry& entry) {
+    FsFile* file = index(which);
+    return file && position < header.live && readEntry(*file, position, entry);
+  }
+};
+
+LibraryDb::Book toBook(const Record& record) {
+  LibraryDb::Book book;
+  book.path = fieldText(record.path);
+  book.title = fieldText(record.title);
+  book.author = fieldText(record.author);
+  book.series = fieldText(record.series);
+  book.language = fieldText(record.language);
+  book.coverBmpPath = fieldText(record.coverBmpPath);
+  book.thumbBmpPath = fieldText(record.thumbBmpPath);
+  book.progressPercent = record.progressPercent;
+  book.lastOpened = record.lastOpened;
+  return book;
+}
+
+// Writes `updated` over the book in `slot`, moving it in the indexes whose keys changed. The old entries are found
+// while the old record is still on disk, the new ones placed after it was replaced.
+bool update(Db& db, const uint32_t slot, const Record& current, const Record& updated) {
+  bool ok = db.setDirty(true);
+  for (uint8_t i = 0; ok && i < INDEX_COUNT; i++) {
+    const auto which = static_cast<Index>(i);
+    ok = !keyChanged(which, current, updated) || db.erase(which, slot, current, db.header.live);
+  }
+  ok = ok && db.writeRecord(slot, updated);
+  for (uint8_t i = 0; ok && i < INDEX_COUNT; i++) {
+    const auto which = static_cast<Index>(i);
+    ok = !keyChanged(which, current, updated) || db.insert(which, slot, updated, db.header.live - 1);
+  }
+  return ok && db.setDirty(false);
+}
+}  // namespace
+
+bool LibraryDb::put(const Book& book, const bool opened) {
+  Record updated = {};
+  updated.flags = FLAG_LIVE;
+  updated.nextFree = NO_SLOT;
+  updated.pathKey = pathKey(book.path);
+  if (!copyField(updated.path, book.path) || !copyField(updated.coverBmpPath, book.coverBmpPath) ||
+      !copyField(updated.thumbBmpPath, book.thumbBmpPath)) {
+    LOG_ERR("LDB", "Path too long for the library: %s", book.path.c_str());
+    return false;
+  }
+  copyField(updated.title, book.title);
+  copyField(updated.author, book.author);
+  copyField(updated.series, book.series);
+  copyField(updated.language, book.language);
+
+  Lock lock;
+  Db db;
+  if (!db.open(true)) {
+    return false;
+  }
+  if (opened) {
+    db.header.lastOpened++;
+  }
+
+  Record current = {};
+  uint32_t slot = db.findSlot(book.path, current);
+  bool ok;
+  if (slot != NO_SLOT) {
+    updated.progressPercent = current.progressPercent;
+    updated.lastOpened = opened ? db.header.lastOpened : current.lastOpened;
+    ok = update(db, slot, current, updated);
+  } else {
+    updated.lastOpened = opened ? db.header.lastOpened : 0;
+    ok = db.setDirty(true);
+    if (db.header.freeSlot != NO_SLOT) {
+      slot = db.header.freeSlot;
+      ok = ok && db.readRecord(slot, current);
+      db.header.freeSlot = current.nextFree;
+    } else {
+      slot = db.header.slots++;
+    }
+    ok = ok && db.writeRecord(slot, updated);
+    for (uint8_t i = 0; ok && i < INDEX_COUNT; i++) {
+      ok = db.insert(static_cast<Index>(i), slot, updated, db.header.live);
+    }
+    db.header.live++;
+    ok = ok && db.setDirty(false);
+  }
+  ++revision;
+  if (!ok) {
+    LOG_ERR("LDB", "Failed to store %s", book.path.c_str());
+  }
+  return ok;
+}
+
+bool LibraryDb::setProgress(const std::string& path, const uint8_t percent) {
+  Lock lock;
+  Db db;
+  Record record = {};
+  if (!db.open(false)) {
+    return false;
+  }
+  const uint32_t slot = db.findSlot(path, record);
+  if (slot == NO_SLOT) {
+    return false;
+  }
+  if (record.progressPercent == percent) {
+    return true;
+  }
+  // Progress isn't indexed: the record is all that changes
+  record.progressPercent = percent;
+  ++revision;
+  return db.writeRecord(slot, record);
+}
+
+bool LibraryDb::remove(const std::string& path) {
+  Lock lock;
+  Db db;
+  Record record = {};
+  if (!db.open(false)) {
+    return false;
+  }
+  const uint32_t slot = db.findSlot(path, record);
+  if (slot == NO_SLOT) {
+    return false;
+  }
+  bool ok = db.setDirty(true);
+  for (uint8_t i = 0; ok && i < INDEX_COUNT; i++) {
+    ok = db.erase(static_cast<Index>(i), slot, record, db.header.live);
+  }
+  record.flags = 0;
+  record.nextFree = db.header.freeSlot;
+  ok = ok && db.writeRecord(slot, record);
+  db.header.freeSlot = slot;
+  db.header.live--;
+  ok = ok && db.setDirty(false);
+  ++revision;
+  LOG_DBG("LDB", "Removed %s from the library", path.c_str());
+  return ok;
+}
+
+bool LibraryDb::find(const std::string& path, Book& book) {
+  Lock lock;
+  Db db;
+  Record record = {};
+  if (!db.open(false) || db.findSlot(path, record) == NO_SLOT) {
+    return false;
+  }
+  book = toBook(record);
+  return true;
+}
+
+uint32_t LibraryDb::count() {
+  Lock lock;
+  Db db;
+  return db.open(false) ? db.header.live : 0;
+}
+
+uint32_t LibraryDb::query(const SortKey key, const bool descending, const uint32_t position, const uint32_t limit,
+                          const std::function<void(const Book&)>& callback) {
+  static constexpr Index INDEX_FOR_KEY[] = {BY_TITLE, BY_AUTHOR, BY_SERIES, BY_OPENED};
+  const Index which = INDEX_FOR_KEY[static_cast<uint8_t>(key)];
+
+  Lock lock;
+  Db db;
+  if (!db.open(false)) {
+    return 0;
+  }
+  uint32_t delivered = 0;
+  Entry entry = {};
+  Record record = {};
+  for (uint32_t p = position; p < db.header.live && delivered < limit; p++, delivered++) {
+    const uint32_t physical = descending ? db.header.live - 1 - p : p;
+    if (!db.entryAt(which, physical, entry) || !db.readRecord(entry.slot, record)) {
+      break;
+    }
+    callback(toBook(record));
+  }
+  return delivered;
+}
+
+uint32_t LibraryDb::getRevision() { return revision; }
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Metadata of every book the device knows about, kept on the SD card so that the home screen, the recent books list
+// and library views read one small database instead of opening each book's cache.
+//
+// Books are fixed-size records in /.crosspoint/library/books.bin, updated in place; a deleted book's slot is reused.
+// Next to it, one index file per order holds the slots sorted by path hash, title, author, series and last opened.
+// Indexes are kept sorted on every change with a binary search and a shift of the entries behind the change, so a
+// query is a seek into the index plus one record read per book, whatever the size of the library. An update
+// interrupted by a power loss is detected on the next access and the indexes are rebuilt from the records.
+//
+// All functions are safe to call from several tasks.
+class LibraryDb {
+ public:
+  enum class SortKey : uint8_t { Title, Author, Series, LastOpened };
+
+  struct Book {
+    std::string path;
+    std::string title;
+    std::string author;
+    std::string series;
+    std::string language;
+    std::string coverBmpPath;
+    std::string thumbBmpPath;  // may contain the [HEIGHT] placeholder
+    uint8_t progressPercent = 0;
+    uint32_t lastOpened = 0;  // order of the last open, larger is more recent; 0 if never opened
+  };
+
+  // Add a book or replace its metadata. Progress and last-opened order of a known book are kept; with `opened`, the
+  // book becomes the most recently opened one. Text fields are cut to fit their record; a path that doesn't fit is
+  // refused.
+  static bool put(const Book& book, bool opened = false);
+  static bool setProgress(const std::string& path, uint8_t percent);
+  // Drop a book, e.g. after it was deleted or replaced; true if it was known
+  static bool remove(const std::string& path);
+  static bool find(const std::string& path, Book& book);
+
+  static uint32_t count();
+  // Read up to `limit` books of the given order starting at `position`. Returns how many were read.
+  static uint32_t query(SortKey key, bool descending, uint32_t position, uint32_t limit,
+                        const std::function<void(const Book&)>& callback);
+
+  // Bumped by every change, so views can tell when to read again
+  static uint32_t getRevision();
+};
@@ -0,0 +1,76 @@
+#include "OpdsEntryWindow.h"
+
+#include <cstring>
+#include <initializer_list>
+
+namespace {
+constexpr size_t MAX_ARENA_SIZE = UINT16_MAX;
+}  // namespace
+
+OpdsEntryWindow::OpdsEntryWindow(const size_t capacity, const size_t arenaSize)
+    : capacity(capacity), arenaSize(arenaSize < MAX_ARENA_SIZE ? arenaSize : MAX_ARENA_SIZE) {
+  slots.reserve(capacity);
+  arena.reserve(this->arenaSize);
+}
+
+void OpdsEntryWindow::reset(const size_t first) {
+  firstIndex = first;
+  slots.clear();
+  arena.clear();
+}
+
+bool OpdsEntryWindow::add(const OpdsEntry& entry) {
+  if (slots.size() >= capacity) {
+    return false;
+  }
+
+  const size_t arenaBefore = arena.size();
+  Slot slot{};
+  slot.type = entry.type;
+  if (!intern(entry.title, slot.title) || !intern(entry.author, slot.author) || !intern(entry.href, slot.href)) {
+    // Drop what this entry already added so the arena only holds complete entries
+    arena.resize(arenaBefore);
+    return false;
+  }
+  slots.push_back(slot);
+  return true;
+}
+
+OpdsEntry OpdsEntryWindow::at(const size_t index) const {
+  const Slot& slot = slots[index - firstIndex];
+  OpdsEntry entry;
+  entry.type = slot.type;
+  entry.title.assign(arena, slot.title.offset, slot.title.length);
+  entry.author.assign(arena, slot.author.offset, slot.author.length);
+  entry.href.assign(arena, slot.href.offset, slot.href.length);
+  return entry;
+}
+
+bool OpdsEntryWindow::matches(const Text& text, const std::string& value) const {
+  return text.length == value.size() && memcmp(arena.data() + text.offset, value.data(), value.size()) == 0;
+}
+
+bool OpdsEntryWindow::intern(const std::string& value, Text& out) {
+  if (value.empty()) {
+    out = Text{};
+    return true;
+  }
+
+  // The window is small, so a linear scan of what is stored finds repeats cheaply
+  for (const Slot& slot : slots) {
+    for (const Text* text : {&slot.author, &slot.href, &slot.title}) {
+      if (matches(*text, value)) {
+        out = *text;
+        return true;
+      }
+    }
+  }
+
+  if (arena.size() + value.size() > arenaSize) {
+    return false;
+  }
+  out.offset = static_cast<uint16_t>(arena.size());
+  out.length = static_cast<uint16_t>(value.size());
+  arena.append(value);
+  return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "OpdsParser.h"
+
+/**
+ * Fixed-size window of feed entries, indexed by their position in the feed.
+ *
+ * Strings are packed into one arena allocated up front, and a value that repeats (the author of every book on an
+ * author's page, a shared link) is stored once, so the window costs the same memory whatever the feed holds.
+ * Entry ids are not kept.
+ */
+class OpdsEntryWindow {
+ public:
+  // `arenaSize` is capped at 64KB
+  OpdsEntryWindow(size_t capacity, size_t arenaSize);
+
+  // Empty the window; the next entry added gets feed position `first`
+  void reset(size_t first);
+  // Append the entry at the next position. False once the window or its arena is full.
+  bool add(const OpdsEntry& entry);
+
+  size_t first() const { return firstIndex; }
+  size_t size() const { return slots.size(); }
+  bool contains(size_t index) const { return index >= firstIndex && index - firstIndex < slots.size(); }
+  size_t arenaUsed() const { return arena.size(); }
+
+  // Entry at feed position `index`, which must be in the window
+  OpdsEntry at(size_t index) const;
+
+ private:
+  struct Text {
+    uint16_t offset = 0;
+    uint16_t length = 0;
+  };
+  struct Slot {
+    OpdsEntryType type;
+    Text title;
+    Text author;
+    Text href;
+  };
+
+  size_t capacity;
+  size_t arenaSize;
+  size_t firstIndex = 0;
+  std::vector<Slot> slots;
+  std::string arena;
+
+  bool intern(const std::string& value, Text& out);
+  bool matches(const Text& text, const std::string& value) const;
+};
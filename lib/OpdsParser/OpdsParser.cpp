@@ -78,6 +78,11 @@ bool OpdsParser::error() const { return errorOccured; }
 
 void OpdsParser::clear() {
   entries.clear();
+  entryCount = 0;
+  entryOffset = 0;
+  prologEnd = 0;
+  nextLink.clear();
+  previousLink.clear();
   currentEntry = OpdsEntry{};
   currentText.clear();
   inEntry = false;
@@ -109,14 +114,34 @@ const char* OpdsParser::findAttribute(const XML_Char** atts, const char* name) {
 void XMLCALL OpdsParser::startElement(void* userData, const XML_Char* name, const XML_Char** atts) {
   auto* self = static_cast<OpdsParser*>(userData);
 
+  if (self->prologEnd == 0) {
+    // The root element
+    self->prologEnd = XML_GetCurrentByteIndex(self->parser) + XML_GetCurrentByteCount(self->parser);
+  }
+
   // Check for entry element (with or without namespace prefix)
   if (strcmp(name, "entry") == 0 || strstr(name, ":entry") != nullptr) {
     self->inEntry = true;
     self->currentEntry = OpdsEntry{};
+    self->entryOffset = XML_GetCurrentByteIndex(self->parser);
     return;
   }
 
-  if (!self->inEntry) return;
+  if (!self->inEntry) {
+    // Feed-level pagination links
+    if (strcmp(name, "link") == 0 || strstr(name, ":link") != nullptr) {
+      const char* rel = findAttribute(atts, "rel");
+      const char* href = findAttribute(atts, "href");
+      if (rel && href) {
+        if (strcmp(rel, "next") == 0) {
+          self->nextLink = href;
+        } else if (strcmp(rel, "previous") == 0 || strcmp(rel, "prev") == 0) {
+          self->previousLink = href;
+        }
+      }
+    }
+    return;
+  }
 
   // Check for title element
   if (strcmp(name, "title") == 0 || strstr(name, ":title") != nullptr) {
@@ -177,7 +202,12 @@ void XMLCALL OpdsParser::endElement(void* userData, const XML_Char* name) {
   if (strcmp(name, "entry") == 0 || strstr(name, ":entry") != nullptr) {
     // Only add entry if it has required fields (title and href)
     if (!self->currentEntry.title.empty() && !self->currentEntry.href.empty()) {
-      self->entries.push_back(self->currentEntry);
+      if (self->entryHandler) {
+        self->entryHandler(self->entryCount, self->currentEntry);
+      } else {
+        self->entries.push_back(self->currentEntry);
+      }
+      self->entryCount++;
     }
     self->inEntry = false;
     self->currentEntry = OpdsEntry{};
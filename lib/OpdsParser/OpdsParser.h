@@ -2,6 +2,7 @@
 #include <Print.h>
 #include <expat.h>
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -74,6 +75,35 @@ class OpdsParser final : public Print {
    */
   std::vector<OpdsEntry> getBooks() const;
 
+  /**
+   * Hand each complete entry to `handler` instead of collecting it, so a feed of any size can be parsed in bounded
+   * memory. `index` counts the entries of the document from 0.
+   */
+  using EntryHandler = std::function<void(size_t index, const OpdsEntry& entry)>;
+  void setEntryHandler(EntryHandler handler) { entryHandler = std::move(handler); }
+
+  /**
+   * Number of entries parsed so far, whether collected or handed to the entry handler.
+   */
+  size_t getEntryCount() const { return entryCount; }
+
+  /**
+   * Byte offset in the document of the entry being handed to the entry handler, for resuming a later parse there.
+   */
+  size_t getEntryOffset() const { return entryOffset; }
+
+  /**
+   * Byte offset just past the root element's start tag, 0 until it has been parsed. Entries are children of the
+   * root, so the document up to here followed by the bytes from an entry's offset parses as that entry onwards.
+   */
+  size_t getPrologEnd() const { return prologEnd; }
+
+  /**
+   * Feed-level pagination links (rel="next" / rel="previous"), empty when the feed has none.
+   */
+  const std::string& getNextLink() const { return nextLink; }
+  const std::string& getPreviousLink() const { return previousLink; }
+
   /**
    * Clear all parsed entries.
    */
@@ -90,6 +120,12 @@ class OpdsParser final : public Print {
 
   XML_Parser parser = nullptr;
   std::vector<OpdsEntry> entries;
+  EntryHandler entryHandler;
+  size_t entryCount = 0;
+  size_t entryOffset = 0;
+  size_t prologEnd = 0;
+  std::string nextLink;
+  std::string previousLink;
   OpdsEntry currentEntry;
   std::string currentText;
 
@@ -0,0 +1,150 @@
+#include "TxtLineBreaker.h"
+
+#include <Epub/hyphenation/Hyphenator.h>
+#include <GfxRenderer.h>
+#include <Logging.h>
+#include <Utf8.h>
+
+namespace {
+constexpr auto STYLE = EpdFontFamily::REGULAR;
+// Longer "words" (URLs, runs of symbols) are beyond the Liang pattern matcher and are split by width instead
+constexpr size_t MAX_HYPHENATED_WORD_BYTES = 160;
+}  // namespace
+
+TxtLineBreaker::LineBreak TxtLineBreaker::nextBreak(const EpdFontFamily& font, const char* text, const size_t start,
+                                                    const size_t length) const {
+  const char* const lineStart = text + start;
+  const char* const end = text + length;
+  const char* p = lineStart;
+
+  int32_t widthFP = 0;  // 12.4 fixed-point advance from the line start
+  uint32_t prevCp = 0;
+
+  // Last space run after some content: the line can end before it and the next one start after it
+  bool haveSpaceBreak = false;
+  bool inSpaceRun = false;
+  LineBreak spaceBreak = {start, start, false};
+
+  // Word currently being measured, in case it has to be hyphenated
+  size_t wordStart = start;
+  int32_t wordStartFP = 0;
+
+  while (p < end) {
+    const char* const cpStart = p;
+    uint32_t cp = utf8NextCodepoint(reinterpret_cast<const unsigned char**>(&p));
+    if (cp == 0) {
+      // Embedded NUL: utf8NextCodepoint does not step over it
+      p++;
+      continue;
+    }
+    if (utf8IsCombiningMark(cp)) {
+      continue;
+    }
+
+    if (cp == ' ') {
+      if (!inSpaceRun && cpStart > lineStart) {
+        haveSpaceBreak = true;
+        spaceBreak.contentEnd = cpStart - text;
+      }
+      inSpaceRun = true;
+      spaceBreak.nextStart = p - text;
+    } else if (inSpaceRun) {
+      inSpaceRun = false;
+      wordStart = cpStart - text;
+      wordStartFP = widthFP;
+    }
+
+    if (cp != ' ') {
+      cp = font.applyLigatures(cp, p, STYLE);
+    }
+    const EpdGlyph* glyph = font.getGlyph(cp, STYLE);
+    int32_t advanceFP = glyph ? glyph->advanceX : 0;
+    if (prevCp != 0) {
+      advanceFP += font.getKerning(prevCp, cp, STYLE);
+    }
+
+    // Spaces never overflow: they hang into the margin and are dropped at the break
+    if (cp != ' ' && cpStart > lineStart && fp4::toPixel(widthFP + advanceFP) > maxWidth) {
+      LineBreak hyphenBreak;
+      if (hyphenationEnabled &&
+          hyphenateWord(text, wordStart, length, maxWidth - fp4::toPixel(wordStartFP), !haveSpaceBreak, hyphenBreak) &&
+          hyphenBreak.contentEnd > start) {
+        return hyphenBreak;
+      }
+      if (haveSpaceBreak) {
+        return spaceBreak;
+      }
+      const size_t overflowAt = cpStart - text;
+      return {overflowAt, overflowAt, false};
+    }
+
+    widthFP += advanceFP;
+    prevCp = cp;
+  }
+
+  return {length, length, false};
+}
+
+bool TxtLineBreaker::hyphenateWord(const char* text, const size_t wordStart, const size_t length,
+                                   const int availableWidth, const bool allowFallback, LineBreak& out) const {
+  if (availableWidth <= 0) {
+    return false;
+  }
+
+  size_t wordEnd = wordStart;
+  while (wordEnd < length && text[wordEnd] != ' ') {
+    if (wordEnd - wordStart > MAX_HYPHENATED_WORD_BYTES) {
+      return false;
+    }
+    wordEnd++;
+  }
+
+  const std::string word(text + wordStart, wordEnd - wordStart);
+  Hyphenator::setPreferredLanguage(hyphenationLanguage);
+  const auto breaks = Hyphenator::breakOffsets(word, allowFallback);
+
+  // Breaks come in ascending order; take the longest prefix that still fits
+  std::string prefix;
+  for (auto it = breaks.rbegin(); it != breaks.rend(); ++it) {
+    if (it->byteOffset == 0 || it->byteOffset >= word.size()) {
+      continue;
+    }
+    prefix.assign(word, 0, it->byteOffset);
+    if (it->requiresInsertedHyphen) {
+      prefix.push_back('-');
+    }
+    if (renderer.getTextAdvanceX(fontId, prefix.c_str(), STYLE) <= availableWidth) {
+      out = {wordStart + it->byteOffset, wordStart + it->byteOffset, it->requiresInsertedHyphen};
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t TxtLineBreaker::wrap(const char* text, const size_t length, const size_t maxLines, const bool moreFollows,
+                            std::vector<std::string>& outLines) const {
+  const auto& fontMap = renderer.getFontMap();
+  const auto fontIt = fontMap.find(fontId);
+  if (fontIt == fontMap.end()) {
+    LOG_ERR("TXT", "Font %d not found", fontId);
+    return length;
+  }
+
+  size_t pos = 0;
+  size_t emitted = 0;
+  while (pos < length && emitted < maxLines) {
+    const LineBreak lineBreak = nextBreak(fontIt->second, text, pos, length);
+    if (moreFollows && lineBreak.nextStart >= length) {
+      // The rest may continue past the buffer; it is laid out again from here on the next page
+      break;
+    }
+
+    outLines.emplace_back(text + pos, lineBreak.contentEnd - pos);
+    if (lineBreak.insertHyphen) {
+      outLines.back().push_back('-');
+    }
+    emitted++;
+    pos = lineBreak.nextStart;
+  }
+  return pos;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class EpdFontFamily;
+class GfxRenderer;
+
+// Greedy single-pass line wrapping for plain text.
+//
+// Each display line is measured codepoint by codepoint with a running 12.4 fixed-point advance (kerning and
+// ligatures included, exactly as GfxRenderer::getTextAdvanceX measures it), remembering the last space as the
+// break opportunity. When the next glyph would overflow, the line is cut at that space, or - with hyphenation
+// enabled - inside the overflowing word using the same Hyphenator breaks as the EPUB layout. A word that starts a
+// line and still does not fit is split at a codepoint boundary. Plain text carries no language, so the caller picks
+// the hyphenation patterns; they are selected for each break, as the Hyphenator's language is shared with the EPUB
+// layout.
+//
+// Only the word that overflows a line is measured again on the next line, so wrapping is linear in the input
+// length. Apart from the output strings, only hyphenation allocates.
+class TxtLineBreaker {
+  const GfxRenderer& renderer;
+  int fontId;
+  int maxWidth;
+  bool hyphenationEnabled;
+  std::string hyphenationLanguage;
+
+  struct LineBreak {
+    size_t contentEnd;  // End of the visible line content (trailing break spaces excluded)
+    size_t nextStart;   // Where the following display line starts
+    bool insertHyphen;  // Line was split inside a word and needs a visible '-'
+  };
+
+  LineBreak nextBreak(const EpdFontFamily& font, const char* text, size_t start, size_t length) const;
+  bool hyphenateWord(const char* text, size_t wordStart, size_t length, int availableWidth, bool allowFallback,
+                     LineBreak& out) const;
+
+ public:
+  // `hyphenationLanguage` is a language tag such as "en"; without one only explicit hyphens and the fallback split
+  // of overlong words apply
+  TxtLineBreaker(const GfxRenderer& renderer, int fontId, int maxWidth, bool hyphenationEnabled,
+                 std::string hyphenationLanguage = "")
+      : renderer(renderer),
+        fontId(fontId),
+        maxWidth(maxWidth),
+        hyphenationEnabled(hyphenationEnabled),
+        hyphenationLanguage(std::move(hyphenationLanguage)) {}
+
+  // Wrap one source line (without its line terminator) and append at most `maxLines` display lines to `outLines`.
+  // Set `moreFollows` when the text was cut off by the read buffer: the final, possibly incomplete display line is
+  // then held back instead of emitted. Returns the number of bytes consumed; the next page starts after them.
+  size_t wrap(const char* text, size_t length, size_t maxLines, bool moreFollows,
+              std::vector<std::string>& outLines) const;
+};
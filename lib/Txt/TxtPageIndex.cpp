@@ -0,0 +1,131 @@
+#include "TxtPageIndex.h"
+
+#include <HalStorage.h>
+#include <Logging.h>
+#include <Serialization.h>
+
+#include <algorithm>
+
+namespace {
+constexpr uint32_t CACHE_MAGIC = 0x54585449;  // "TXTI"
+constexpr uint8_t CACHE_VERSION = 5;          // Increment when cache format changes
+// magic, version, layout fields, complete flag, page count
+constexpr size_t HEADER_SIZE = 4 + 1 + 4 + 4 + 4 + 4 + 4 + 1 + 1 + 2 + 1 + 4;
+}  // namespace
+
+void TxtPageIndex::reset(const Layout& newLayout) {
+  layout = newLayout;
+  offsets.assign(1, 0);
+  complete = false;
+}
+
+bool TxtPageIndex::load(const Layout& expected) {
+  reset(expected);
+
+  FsFile f;
+  if (!Storage.openFileForRead("TRS", cachePath, f)) {
+    LOG_DBG("TRS", "No page index cache found");
+    return false;
+  }
+
+  uint32_t magic = 0;
+  uint8_t version = 0;
+  serialization::readPod(f, magic);
+  serialization::readPod(f, version);
+  if (magic != CACHE_MAGIC || version != CACHE_VERSION) {
+    LOG_DBG("TRS", "Cache version mismatch (%d != %d), rebuilding", version, CACHE_VERSION);
+    f.close();
+    return false;
+  }
+
+  Layout cached;
+  serialization::readPod(f, cached.fileSize);
+  serialization::readPod(f, cached.viewportWidth);
+  serialization::readPod(f, cached.linesPerPage);
+  serialization::readPod(f, cached.fontId);
+  serialization::readPod(f, cached.screenMargin);
+  serialization::readPod(f, cached.paragraphAlignment);
+  serialization::readPod(f, cached.hyphenation);
+  serialization::readPod(f, cached.hyphenationLanguage);
+  if (cached != expected) {
+    LOG_DBG("TRS", "Cache layout mismatch, rebuilding");
+    f.close();
+    return false;
+  }
+
+  uint8_t cachedComplete = 0;
+  uint32_t numPages = 0;
+  serialization::readPod(f, cachedComplete);
+  serialization::readPod(f, numPages);
+  // A checkpoint interrupted mid-write is shorter than its header claims
+  if (numPages == 0 || f.size() != HEADER_SIZE + static_cast<size_t>(numPages) * sizeof(uint32_t)) {
+    LOG_DBG("TRS", "Cache truncated, rebuilding");
+    f.close();
+    return false;
+  }
+
+  offsets.resize(numPages);
+  const size_t bytes = numPages * sizeof(uint32_t);
+  const bool readOk = f.read(reinterpret_cast<uint8_t*>(offsets.data()), bytes) == static_cast<int>(bytes);
+  f.close();
+  if (!readOk || offsets.front() != 0 || !std::is_sorted(offsets.begin(), offsets.end())) {
+    LOG_DBG("TRS", "Cache corrupt, rebuilding");
+    reset(expected);
+    return false;
+  }
+
+  complete = cachedComplete != 0;
+  LOG_DBG("TRS", "Loaded page index cache: %zu pages%s", offsets.size(), complete ? "" : " (partial)");
+  return true;
+}
+
+bool TxtPageIndex::save() const {
+  FsFile f;
+  if (!Storage.openFileForWrite("TRS", cachePath, f)) {
+    LOG_ERR("TRS", "Failed to save page index cache");
+    return false;
+  }
+
+  serialization::writePod(f, CACHE_MAGIC);
+  serialization::writePod(f, CACHE_VERSION);
+  serialization::writePod(f, layout.fileSize);
+  serialization::writePod(f, layout.viewportWidth);
+  serialization::writePod(f, layout.linesPerPage);
+  serialization::writePod(f, layout.fontId);
+  serialization::writePod(f, layout.screenMargin);
+  serialization::writePod(f, layout.paragraphAlignment);
+  serialization::writePod(f, layout.hyphenation);
+  serialization::writePod(f, layout.hyphenationLanguage);
+  serialization::writePod(f, static_cast<uint8_t>(complete ? 1 : 0));
+  serialization::writePod(f, static_cast<uint32_t>(offsets.size()));
+  const size_t bytes = offsets.size() * sizeof(uint32_t);
+  const bool ok = f.write(reinterpret_cast<const uint8_t*>(offsets.data()), bytes) == bytes;
+  f.close();
+
+  LOG_DBG("TRS", "Saved page index cache: %zu pages%s", offsets.size(), complete ? "" : " (partial)");
+  return ok;
+}
+
+void TxtPageIndex::addPage(const uint32_t offset) {
+  if (complete || offset <= offsets.back()) {
+    return;
+  }
+  offsets.push_back(offset);
+}
+
+size_t TxtPageIndex::pageAtOffset(const uint32_t offset) const {
+  return std::upper_bound(offsets.begin(), offsets.end(), offset) - offsets.begin() - 1;
+}
+
+bool TxtPageIndex::isPageStart(const uint32_t offset) const {
+  return std::binary_search(offsets.begin(), offsets.end(), offset);
+}
+
+size_t TxtPageIndex::estimatedPageCount() const {
+  if (complete || offsets.back() == 0) {
+    return offsets.size();
+  }
+  // Pages before the last known one cover lastPageOffset() bytes; assume the rest of the file is similar
+  const uint64_t estimate = static_cast<uint64_t>(offsets.size() - 1) * layout.fileSize / offsets.back();
+  return std::max<size_t>(offsets.size(), estimate);
+}
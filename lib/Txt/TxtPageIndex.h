@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Start offsets of the pages of a TXT file, built incrementally and checkpointed to the book cache.
+//
+// Pages are only ever appended: the last known page is where indexing continues, so a checkpoint written part way
+// through lets the next session resume instead of starting over. The index does not lay out text itself; the reader
+// pages forward from lastPageOffset() and reports each page break with addPage(), or markComplete() at the end.
+//
+// Not thread safe; callers that index in the background serialise access themselves.
+class TxtPageIndex {
+ public:
+  // Everything pagination depends on. A checkpoint written for a different layout is discarded.
+  struct Layout {
+    uint32_t fileSize = 0;
+    int32_t viewportWidth = 0;
+    int32_t linesPerPage = 0;
+    int32_t fontId = 0;
+    int32_t screenMargin = 0;
+    uint8_t paragraphAlignment = 0;
+    uint8_t hyphenation = 0;
+    uint16_t hyphenationLanguage = 0;  // Two-letter code, first letter in the low byte; 0 without hyphenation
+
+    bool operator==(const Layout& other) const = default;
+  };
+
+  explicit TxtPageIndex(std::string cachePath) : cachePath(std::move(cachePath)) {}
+
+  // Start over with only the first page known
+  void reset(const Layout& newLayout);
+  // Restore a checkpoint written for `expected`; resets and returns false if there is none or it does not match
+  bool load(const Layout& expected);
+  bool save() const;
+
+  // Record that the page after the last known one starts at `offset`
+  void addPage(uint32_t offset);
+  // The last known page runs to the end of the file
+  void markComplete() { complete = true; }
+
+  [[nodiscard]] bool isComplete() const { return complete; }
+  [[nodiscard]] size_t pageCount() const { return offsets.size(); }
+  [[nodiscard]] uint32_t pageOffset(const size_t page) const { return offsets[page]; }
+  [[nodiscard]] uint32_t lastPageOffset() const { return offsets.back(); }
+  // Index of the last known page starting at or before `offset`
+  [[nodiscard]] size_t pageAtOffset(uint32_t offset) const;
+  [[nodiscard]] bool isPageStart(uint32_t offset) const;
+  // Total number of pages; extrapolated from the bytes indexed so far until indexing completes
+  [[nodiscard]] size_t estimatedPageCount() const;
+
+ private:
+  std::string cachePath;
+  Layout layout;
+  std::vector<uint32_t> offsets = {0};
+  bool complete = false;
+};
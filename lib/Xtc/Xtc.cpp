@@ -8,6 +8,7 @@
 #include "Xtc.h"
 
 #include <HalStorage.h>
+#include <ImageDownscaler.h>
 #include <Logging.h>
 
 bool Xtc::load() {
@@ -444,117 +445,52 @@ bool Xtc::generateThumbBmp(int height) const {
   };
   thumbBmp.write(palette, 8);
 
-  // Allocate row buffer for 1-bit output
-  uint8_t* rowBuffer = static_cast<uint8_t*>(malloc(rowSize));
-  if (!rowBuffer) {
+  // Area-average downscale with hash-based noise dithering to 1-bit (0=black, 1=white)
+  ImageDownscaler scaler(pageInfo.width, pageInfo.height, thumbWidth, thumbHeight,
+                         ImageDownscaler::OutputFormat::OneBit, ImageDownscaler::Dither::None);
+  const int packedBytes = scaler.getOutputRowBytes();
+  const bool scalerReady = scaler.begin([&thumbBmp, packedBytes, rowSize](const uint8_t* row, int) {
+    static constexpr uint8_t padding[4] = {0, 0, 0, 0};
+    thumbBmp.write(row, packedBytes);
+    if (rowSize > static_cast<uint32_t>(packedBytes)) thumbBmp.write(padding, rowSize - packedBytes);
+  });
+
+  // XTH pages are column-major, so each source row is gathered into an 8-bit gray row first
+  uint8_t* grayRow = (bitDepth == 2) ? static_cast<uint8_t*>(malloc(pageInfo.width)) : nullptr;
+  if (!scalerReady || (bitDepth == 2 && !grayRow)) {
+    LOG_ERR("XTC", "Failed to allocate thumb scaler buffers");
+    free(grayRow);
     free(pageBuffer);
     thumbBmp.close();
     return false;
   }
 
-  // Fixed-point scale factor (16.16)
-  uint32_t scaleInv_fp = static_cast<uint32_t>(65536.0f / scale);
-
-  // Pre-calculate plane info for 2-bit mode
   const size_t planeSize = (bitDepth == 2) ? ((static_cast<size_t>(pageInfo.width) * pageInfo.height + 7) / 8) : 0;
-  const uint8_t* plane1 = (bitDepth == 2) ? pageBuffer : nullptr;
-  const uint8_t* plane2 = (bitDepth == 2) ? pageBuffer + planeSize : nullptr;
-  const size_t colBytes = (bitDepth == 2) ? ((pageInfo.height + 7) / 8) : 0;
-  const size_t srcRowBytes = (bitDepth == 1) ? ((pageInfo.width + 7) / 8) : 0;
-
-  for (uint16_t dstY = 0; dstY < thumbHeight; dstY++) {
-    memset(rowBuffer, 0xFF, rowSize);  // Start with all white (bit 1)
-
-    // Calculate source Y range with bounds checking
-    uint32_t srcYStart = (static_cast<uint32_t>(dstY) * scaleInv_fp) >> 16;
-    uint32_t srcYEnd = (static_cast<uint32_t>(dstY + 1) * scaleInv_fp) >> 16;
-    if (srcYStart >= pageInfo.height) srcYStart = pageInfo.height - 1;
-    if (srcYEnd > pageInfo.height) srcYEnd = pageInfo.height;
-    if (srcYEnd <= srcYStart) srcYEnd = srcYStart + 1;
-    if (srcYEnd > pageInfo.height) srcYEnd = pageInfo.height;
-
-    for (uint16_t dstX = 0; dstX < thumbWidth; dstX++) {
-      // Calculate source X range with bounds checking
-      uint32_t srcXStart = (static_cast<uint32_t>(dstX) * scaleInv_fp) >> 16;
-      uint32_t srcXEnd = (static_cast<uint32_t>(dstX + 1) * scaleInv_fp) >> 16;
-      if (srcXStart >= pageInfo.width) srcXStart = pageInfo.width - 1;
-      if (srcXEnd > pageInfo.width) srcXEnd = pageInfo.width;
-      if (srcXEnd <= srcXStart) srcXEnd = srcXStart + 1;
-      if (srcXEnd > pageInfo.width) srcXEnd = pageInfo.width;
-
-      // Area averaging: sum grayscale values (0-255 range)
-      uint32_t graySum = 0;
-      uint32_t totalCount = 0;
-
-      for (uint32_t srcY = srcYStart; srcY < srcYEnd && srcY < pageInfo.height; srcY++) {
-        for (uint32_t srcX = srcXStart; srcX < srcXEnd && srcX < pageInfo.width; srcX++) {
-          uint8_t grayValue = 255;  // Default: white
-
-          if (bitDepth == 2) {
-            // XTH 2-bit mode: pixel value 0-3
-            // Bounds check for column index
-            if (srcX < pageInfo.width) {
-              const size_t colIndex = pageInfo.width - 1 - srcX;
-              const size_t byteInCol = srcY / 8;
-              const size_t bitInByte = 7 - (srcY % 8);
-              const size_t byteOffset = colIndex * colBytes + byteInCol;
-              // Bounds check for buffer access
-              if (byteOffset < planeSize) {
-                const uint8_t bit1 = (plane1[byteOffset] >> bitInByte) & 1;
-                const uint8_t bit2 = (plane2[byteOffset] >> bitInByte) & 1;
-                const uint8_t pixelValue = (bit1 << 1) | bit2;
-                // Convert 2-bit (0-3) to grayscale: 0=black, 3=white
-                // pixelValue: 0=white, 1=light gray, 2=dark gray, 3=black (XTC polarity)
-                grayValue = (3 - pixelValue) * 85;  // 0->255, 1->170, 2->85, 3->0
-              }
-            }
-          } else {
-            // 1-bit mode
-            const size_t byteIdx = srcY * srcRowBytes + srcX / 8;
-            const size_t bitIdx = 7 - (srcX % 8);
-            // Bounds check for buffer access
-            if (byteIdx < bitmapSize) {
-              const uint8_t pixelBit = (pageBuffer[byteIdx] >> bitIdx) & 1;
-              // XTC 1-bit polarity: 0=black, 1=white (same as BMP palette)
-              grayValue = pixelBit ? 255 : 0;
-            }
-          }
-
-          graySum += grayValue;
-          totalCount++;
-        }
-      }
-
-      // Calculate average grayscale and quantize to 1-bit with noise dithering
-      uint8_t avgGray = (totalCount > 0) ? static_cast<uint8_t>(graySum / totalCount) : 255;
-
-      // Hash-based noise dithering for 1-bit output
-      uint32_t hash = static_cast<uint32_t>(dstX) * 374761393u + static_cast<uint32_t>(dstY) * 668265263u;
-      hash = (hash ^ (hash >> 13)) * 1274126177u;
-      const int threshold = static_cast<int>(hash >> 24);           // 0-255
-      const int adjustedThreshold = 128 + ((threshold - 128) / 2);  // Range: 64-192
-
-      // Quantize to 1-bit: 0=black, 1=white
-      uint8_t oneBit = (avgGray >= adjustedThreshold) ? 1 : 0;
-
-      // Pack 1-bit value into row buffer (MSB first, 8 pixels per byte)
-      const size_t byteIndex = dstX / 8;
-      const size_t bitOffset = 7 - (dstX % 8);
-      // Bounds check for row buffer access
-      if (byteIndex < rowSize) {
-        if (oneBit) {
-          rowBuffer[byteIndex] |= (1 << bitOffset);  // Set bit for white
-        } else {
-          rowBuffer[byteIndex] &= ~(1 << bitOffset);  // Clear bit for black
-        }
+  const uint8_t* plane1 = pageBuffer;
+  const uint8_t* plane2 = pageBuffer + planeSize;
+  const size_t colBytes = (pageInfo.height + 7) / 8;
+  const size_t srcRowBytes = (pageInfo.width + 7) / 8;
+
+  for (uint16_t srcY = 0; srcY < pageInfo.height; srcY++) {
+    if (bitDepth == 2) {
+      const size_t byteInCol = srcY / 8;
+      const size_t bitInByte = 7 - (srcY % 8);
+      for (uint16_t srcX = 0; srcX < pageInfo.width; srcX++) {
+        // Columns are stored right to left
+        const size_t byteOffset = (pageInfo.width - 1 - srcX) * colBytes + byteInCol;
+        const uint8_t bit1 = (plane1[byteOffset] >> bitInByte) & 1;
+        const uint8_t bit2 = (plane2[byteOffset] >> bitInByte) & 1;
+        // XTC polarity: 0=white, 1=light gray, 2=dark gray, 3=black
+        grayRow[srcX] = (3 - ((bit1 << 1) | bit2)) * 85;
       }
+      scaler.pushRow(grayRow, ImageDownscaler::SourceFormat::Gray8);
+    } else {
+      // XTC 1-bit polarity: 0=black, 1=white (same as BMP palette)
+      scaler.pushRow(pageBuffer + srcY * srcRowBytes, ImageDownscaler::SourceFormat::Gray1);
     }
-
-    // Write row (already padded to 4-byte boundary by rowSize)
-    thumbBmp.write(rowBuffer, rowSize);
   }
 
-  free(rowBuffer);
+  free(grayRow);
   thumbBmp.close();
   free(pageBuffer);
 
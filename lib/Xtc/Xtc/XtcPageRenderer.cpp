@@ -0,0 +1,135 @@
+/**
+ * XtcPageRenderer.cpp
+ *
+ * Draws decoded XTG/XTH page data into the frame buffer
+ * XTC ebook support for CrossPoint Reader
+ */
+
+#include "XtcPageRenderer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace xtc {
+
+namespace {
+
+// Rotation that maps the page's storage order onto the physical panel for the current orientation.
+// XTG stores logical rows; XTH stores logical columns right to left (8 vertical pixels per byte, MSB on top).
+GfxRenderer::RasterRotation pageRotation(const GfxRenderer::Orientation orientation, const uint8_t bitDepth) {
+  using Rotation = GfxRenderer::RasterRotation;
+  if (bitDepth == 2) {
+    switch (orientation) {
+      case GfxRenderer::Portrait:
+        return Rotation::None;
+      case GfxRenderer::PortraitInverted:
+        return Rotation::UpsideDown;
+      case GfxRenderer::LandscapeCounterClockwise:
+        return Rotation::Clockwise;
+      case GfxRenderer::LandscapeClockwise:
+        return Rotation::CounterClockwise;
+    }
+  }
+  switch (orientation) {
+    case GfxRenderer::Portrait:
+      return Rotation::CounterClockwise;
+    case GfxRenderer::PortraitInverted:
+      return Rotation::Clockwise;
+    case GfxRenderer::LandscapeCounterClockwise:
+      return Rotation::None;
+    case GfxRenderer::LandscapeClockwise:
+      return Rotation::UpsideDown;
+  }
+  return Rotation::None;
+}
+
+// XTH pixel value = (bit1 << 1) | bit2: 0 = white, 1 = dark gray, 2 = light gray, 3 = black
+uint8_t pixelValue(const uint8_t* page, const uint16_t width, const uint16_t height, const uint8_t bitDepth,
+                   const uint16_t x, const uint16_t y) {
+  if (bitDepth == 2) {
+    const size_t planeSize = (static_cast<size_t>(width) * height + 7) / 8;
+    const size_t colBytes = (height + 7) / 8;
+    const size_t byteOffset = (width - 1 - x) * colBytes + y / 8;
+    const uint8_t bitInByte = 7 - (y % 8);
+    const uint8_t bit1 = (page[byteOffset] >> bitInByte) & 1;
+    const uint8_t bit2 = (page[planeSize + byteOffset] >> bitInByte) & 1;
+    return (bit1 << 1) | bit2;
+  }
+  // XTG: 0 = black, 1 = white
+  const size_t rowBytes = (width + 7) / 8;
+  return ((page[y * rowBytes + x / 8] >> (7 - (x % 8))) & 1) ? 0 : 3;
+}
+
+void drawPagePixels(const GfxRenderer& renderer, const uint8_t* page, const uint16_t width, const uint16_t height,
+                    const uint8_t bitDepth, const GfxRenderer::RenderMode pass) {
+  // Gray passes mark pixels by setting bits on a cleared buffer ("0 = leave alone")
+  renderer.clearScreen(pass == GfxRenderer::BW ? 0xFF : 0x00);
+  const uint16_t maxX = std::min<int>(width, renderer.getScreenWidth());
+  const uint16_t maxY = std::min<int>(height, renderer.getScreenHeight());
+  for (uint16_t y = 0; y < maxY; y++) {
+    for (uint16_t x = 0; x < maxX; x++) {
+      const uint8_t pv = pixelValue(page, width, height, bitDepth, x, y);
+      if (pass == GfxRenderer::BW && pv >= 1) {
+        renderer.drawPixel(x, y, true);
+      } else if (pass == GfxRenderer::GRAYSCALE_LSB && pv == 1) {
+        renderer.drawPixel(x, y, false);
+      } else if (pass == GfxRenderer::GRAYSCALE_MSB && (pv == 1 || pv == 2)) {
+        renderer.drawPixel(x, y, false);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+size_t pageBufferSize(const uint16_t width, const uint16_t height, const uint8_t bitDepth) {
+  if (bitDepth == 2) {
+    return ((static_cast<size_t>(width) * height + 7) / 8) * 2;
+  }
+  return static_cast<size_t>((width + 7) / 8) * height;
+}
+
+void drawPage(const GfxRenderer& renderer, const uint8_t* page, const uint16_t width, const uint16_t height,
+              const uint8_t bitDepth, const GfxRenderer::RenderMode pass) {
+  if (width != renderer.getScreenWidth() || height != renderer.getScreenHeight() || height % 8 != 0) {
+    drawPagePixels(renderer, page, width, height, bitDepth, pass);
+    return;
+  }
+
+  const GfxRenderer::RasterRotation rotation = pageRotation(renderer.getOrientation(), bitDepth);
+
+  if (bitDepth != 2) {
+    // XTG already uses frame buffer polarity (1 = white); it has no gray levels
+    const size_t rowBytes = (width + 7) / 8;
+    if (pass == GfxRenderer::BW) {
+      renderer.blitRaster(rotation,
+                          [&](const int row, uint8_t* out) { memcpy(out, page + row * rowBytes, rowBytes); });
+    } else {
+      renderer.clearScreen(0x00);
+    }
+    return;
+  }
+
+  // XTH: each stored column is one raster row; combine the two bit planes bytewise for the requested pass
+  const size_t planeSize = (static_cast<size_t>(width) * height + 7) / 8;
+  const size_t colBytes = height / 8;
+  const uint8_t* plane1 = page;
+  const uint8_t* plane2 = page + planeSize;
+  renderer.blitRaster(rotation, [&](const int row, uint8_t* out) {
+    const uint8_t* p1 = plane1 + row * colBytes;
+    const uint8_t* p2 = plane2 + row * colBytes;
+    switch (pass) {
+      case GfxRenderer::BW:  // white only where both bits are clear
+        for (size_t i = 0; i < colBytes; i++) out[i] = ~(p1[i] | p2[i]);
+        break;
+      case GfxRenderer::GRAYSCALE_LSB:  // value 1 (dark gray)
+        for (size_t i = 0; i < colBytes; i++) out[i] = ~p1[i] & p2[i];
+        break;
+      case GfxRenderer::GRAYSCALE_MSB:  // value 1 or 2 (dark or light gray)
+        for (size_t i = 0; i < colBytes; i++) out[i] = p1[i] ^ p2[i];
+        break;
+    }
+  });
+}
+
+}  // namespace xtc
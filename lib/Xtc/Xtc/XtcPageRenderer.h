@@ -0,0 +1,38 @@
+/**
+ * XtcPageRenderer.h
+ *
+ * Draws decoded XTG/XTH page data into the frame buffer
+ * XTC ebook support for CrossPoint Reader
+ */
+
+#pragma once
+
+#include <GfxRenderer.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace xtc {
+
+// Size of the raw page data returned by XtcParser::loadPage()
+// XTG (1-bit): Row-major, ((width+7)/8) * height bytes
+// XTH (2-bit): Two bit planes, column-major, ((width * height + 7) / 8) * 2 bytes
+size_t pageBufferSize(uint16_t width, uint16_t height, uint8_t bitDepth);
+
+/**
+ * Draw one render pass of a page, replacing the whole frame buffer.
+ *
+ * `pass` selects what ends up in the frame buffer, matching the grayscale flow used elsewhere:
+ * - BW: every non-white pixel black
+ * - GRAYSCALE_LSB: dark gray pixels marked (XTH only)
+ * - GRAYSCALE_MSB: light and dark gray pixels marked (XTH only)
+ *
+ * Pages are pre-rendered at panel resolution, so when the page size matches the logical screen the data is
+ * blitted in bulk: XTH planes are column-major, which is the panel's native layout in portrait, and XTG rows are
+ * native in landscape. Other combinations are rotated by 8x8 block transposes. Pages of any other size fall back
+ * to per-pixel drawing.
+ */
+void drawPage(const GfxRenderer& renderer, const uint8_t* page, uint16_t width, uint16_t height, uint8_t bitDepth,
+              GfxRenderer::RenderMode pass);
+
+}  // namespace xtc
@@ -7,10 +7,10 @@
 
 #include "XtcParser.h"
 
-#include <FsHelpers.h>
 #include <HalStorage.h>
 #include <Logging.h>
 
+#include <algorithm>
 #include <cstring>
 
 namespace xtc {
@@ -23,6 +23,9 @@ XtcParser::XtcParser()
       m_hasChapters(false),
       m_lastError(XtcError::OK) {
   memset(&m_header, 0, sizeof(m_header));
+  memset(m_pageTableWindows, 0, sizeof(m_pageTableWindows));
+  m_pageTableClock = 0;
+  m_pageTableWindowLoads = 0;
 }
 
 XtcParser::~XtcParser() { close(); }
@@ -89,7 +92,8 @@ void XtcParser::close() {
     m_file.close();
     m_isOpen = false;
   }
-  m_pageTable.clear();
+  memset(m_pageTableWindows, 0, sizeof(m_pageTableWindows));
+  m_pageTableClock = 0;
   m_chapters.clear();
   m_title.clear();
   m_hasChapters = false;
@@ -169,38 +173,58 @@ XtcError XtcParser::readPageTable() {
     return XtcError::CORRUPTED_HEADER;
   }
 
-  // Seek to page table
-  if (!m_file.seek(m_header.pageTableOffset)) {
-    LOG_DBG("XTC", "Failed to seek to page table at %llu", m_header.pageTableOffset);
+  // Entries are loaded lazily, only check that the whole table is present
+  const uint64_t tableSize = static_cast<uint64_t>(m_header.pageCount) * sizeof(PageTableEntry);
+  const uint64_t tableEnd = m_header.pageTableOffset + tableSize;
+  if (tableEnd > m_file.size()) {
+    LOG_DBG("XTC", "Page table at %llu with %u entries exceeds file size", m_header.pageTableOffset,
+            m_header.pageCount);
     return XtcError::READ_ERROR;
   }
 
-  m_pageTable.resize(m_header.pageCount);
+  // Default dimensions come from the first page
+  const PageTableEntry* first = findPageTableEntry(0);
+  if (!first) {
+    LOG_DBG("XTC", "Failed to read page table at %llu", m_header.pageTableOffset);
+    return XtcError::READ_ERROR;
+  }
+  m_defaultWidth = first->width;
+  m_defaultHeight = first->height;
 
-  // Read page table entries
-  for (uint16_t i = 0; i < m_header.pageCount; i++) {
-    PageTableEntry entry;
-    size_t bytesRead = m_file.read(reinterpret_cast<uint8_t*>(&entry), sizeof(PageTableEntry));
-    if (bytesRead != sizeof(PageTableEntry)) {
-      LOG_DBG("XTC", "Failed to read page table entry %u", i);
-      return XtcError::READ_ERROR;
-    }
+  LOG_DBG("XTC", "Page table: %u entries, %u per window", m_header.pageCount, PAGE_TABLE_WINDOW);
+  return XtcError::OK;
+}
 
-    m_pageTable[i].offset = static_cast<uint32_t>(entry.dataOffset);
-    m_pageTable[i].size = entry.dataSize;
-    m_pageTable[i].width = entry.width;
-    m_pageTable[i].height = entry.height;
-    m_pageTable[i].bitDepth = m_bitDepth;
+const PageTableEntry* XtcParser::findPageTableEntry(const uint32_t pageIndex) const {
+  if (pageIndex >= m_header.pageCount) {
+    return nullptr;
+  }
 
-    // Update default dimensions from first page
-    if (i == 0) {
-      m_defaultWidth = entry.width;
-      m_defaultHeight = entry.height;
+  const uint32_t firstPage = pageIndex - pageIndex % PAGE_TABLE_WINDOW;
+  PageTableWindow* victim = &m_pageTableWindows[0];
+  for (auto& window : m_pageTableWindows) {
+    if (window.lastUsed != 0 && window.firstPage == firstPage) {
+      window.lastUsed = ++m_pageTableClock;
+      return &window.entries[pageIndex - firstPage];
+    }
+    if (window.lastUsed < victim->lastUsed) {
+      victim = &window;
     }
   }
 
-  LOG_DBG("XTC", "Read %u page table entries", m_header.pageCount);
-  return XtcError::OK;
+  // Miss: replace the least recently used window with one read of up to PAGE_TABLE_WINDOW entries
+  const uint32_t count = std::min<uint32_t>(PAGE_TABLE_WINDOW, m_header.pageCount - firstPage);
+  const size_t bytes = count * sizeof(PageTableEntry);
+  victim->lastUsed = 0;
+  if (!m_file.seek(m_header.pageTableOffset + static_cast<uint64_t>(firstPage) * sizeof(PageTableEntry)) ||
+      m_file.read(reinterpret_cast<uint8_t*>(victim->entries), bytes) != static_cast<int>(bytes)) {
+    LOG_DBG("XTC", "Failed to read page table window at page %lu", firstPage);
+    return nullptr;
+  }
+  victim->firstPage = firstPage;
+  victim->lastUsed = ++m_pageTableClock;
+  m_pageTableWindowLoads++;
+  return &victim->entries[pageIndex - firstPage];
 }
 
 XtcError XtcParser::readChapters() {
@@ -310,10 +334,16 @@ XtcError XtcParser::readChapters() {
 }
 
 bool XtcParser::getPageInfo(uint32_t pageIndex, PageInfo& info) const {
-  if (pageIndex >= m_pageTable.size()) {
+  const PageTableEntry* entry = findPageTableEntry(pageIndex);
+  if (!entry) {
     return false;
   }
-  info = m_pageTable[pageIndex];
+  info.offset = static_cast<uint32_t>(entry->dataOffset);
+  info.size = entry->dataSize;
+  info.width = entry->width;
+  info.height = entry->height;
+  info.bitDepth = m_bitDepth;
+  info.padding = 0;
   return true;
 }
 
@@ -328,7 +358,11 @@ size_t XtcParser::loadPage(uint32_t pageIndex, uint8_t* buffer, size_t bufferSiz
     return 0;
   }
 
-  const PageInfo& page = m_pageTable[pageIndex];
+  PageInfo page;
+  if (!getPageInfo(pageIndex, page)) {
+    m_lastError = XtcError::READ_ERROR;
+    return 0;
+  }
 
   // Seek to page data
   if (!m_file.seek(page.offset)) {
@@ -396,7 +430,10 @@ XtcError XtcParser::loadPageStreaming(uint32_t pageIndex,
     return XtcError::PAGE_OUT_OF_RANGE;
   }
 
-  const PageInfo& page = m_pageTable[pageIndex];
+  PageInfo page;
+  if (!getPageInfo(pageIndex, page)) {
+    return XtcError::READ_ERROR;
+  }
 
   // Seek to page data
   if (!m_file.seek(page.offset)) {
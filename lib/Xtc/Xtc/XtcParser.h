@@ -41,7 +41,7 @@ class XtcParser {
   uint16_t getHeight() const { return m_defaultHeight; }
   uint8_t getBitDepth() const { return m_bitDepth; }  // 1 = XTC/XTG, 2 = XTCH/XTH
 
-  // Page information
+  // Page information (page table entries are read on demand, see PAGE_TABLE_WINDOW)
   bool getPageInfo(uint32_t pageIndex, PageInfo& info) const;
 
   /**
@@ -80,11 +80,25 @@ class XtcParser {
   // Error information
   XtcError getLastError() const { return m_lastError; }
 
+  // Page table cache: entries are read from the file in windows of PAGE_TABLE_WINDOW pages, and the
+  // PAGE_TABLE_CACHED_WINDOWS most recently used windows are kept. Memory stays fixed regardless of page count.
+  static constexpr uint16_t PAGE_TABLE_WINDOW = 64;
+  static constexpr uint8_t PAGE_TABLE_CACHED_WINDOWS = 4;
+  uint32_t getPageTableWindowLoads() const { return m_pageTableWindowLoads; }
+
  private:
-  FsFile m_file;
+  struct PageTableWindow {
+    uint32_t firstPage;
+    uint32_t lastUsed;  // LRU stamp, 0 = slot unused
+    PageTableEntry entries[PAGE_TABLE_WINDOW];
+  };
+
+  mutable FsFile m_file;
   bool m_isOpen;
   XtcHeader m_header;
-  std::vector<PageInfo> m_pageTable;
+  mutable PageTableWindow m_pageTableWindows[PAGE_TABLE_CACHED_WINDOWS];
+  mutable uint32_t m_pageTableClock;
+  mutable uint32_t m_pageTableWindowLoads;
   std::vector<ChapterInfo> m_chapters;
   std::string m_title;
   std::string m_author;
@@ -97,6 +111,7 @@ class XtcParser {
   // Internal helper functions
   XtcError readHeader();
   XtcError readPageTable();
+  const PageTableEntry* findPageTableEntry(uint32_t pageIndex) const;
   XtcError readTitle();
   XtcError readAuthor();
   XtcError readChapters();
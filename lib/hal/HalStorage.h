@@ -76,6 +76,8 @@ class HalFile : public Print {
   size_t getName(char* name, size_t len);
   size_t size();
   size_t fileSize();
+  // FAT date/time of the last modification, as packed by the filesystem (see FS_DATE/FS_TIME in SdFat)
+  bool getModifyDateTime(uint16_t* pdate, uint16_t* ptime);
   bool seek(size_t pos);
   bool seekCur(int64_t offset);
   bool seekSet(size_t offset);
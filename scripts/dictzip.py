@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+"""
+Compress a StarDict .dict file to the dictzip format (.dict.dz) the reader opens.
+
+dictzip is gzip with the data cut into chunks that are compressed independently and
+an "RA" extra header field listing the compressed size of each chunk, so a
+definition can be read by inflating just its chunk. Most dictionaries are
+distributed this way already; this is for those that are not, without needing the
+dictzip tool.
+
+Example:
+    python3 scripts/dictzip.py /path/to/mydict.dict
+writes /path/to/mydict.dict.dz; copy it with mydict.ifo and mydict.idx to /dictionaries
+on the SD card.
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+# Largest chunk that keeps the RA field within the 64K gzip extra field limit for the usual sizes
+CHUNK_LENGTH = 58315
+
+
+def compress(data, chunk_length=CHUNK_LENGTH):
+    chunks = []
+    compressor = zlib.compressobj(9, zlib.DEFLATED, -15)
+    for start in range(0, len(data), chunk_length):
+        chunk = compressor.compress(data[start : start + chunk_length])
+        # A full flush ends the chunk on a byte boundary and forgets the window, so each chunk inflates on its own
+        last = start + chunk_length >= len(data)
+        chunk += compressor.flush(zlib.Z_FINISH if last else zlib.Z_FULL_FLUSH)
+        chunks.append(chunk)
+    if not chunks:
+        chunks.append(compressor.flush(zlib.Z_FINISH))
+
+    sizes = [len(chunk) for chunk in chunks]
+    if len(sizes) > 0xFFFF or max(sizes) > 0xFFFF:
+        raise ValueError("data too large for one dictzip file")
+    ra = struct.pack("<HHH", 1, chunk_length, len(sizes)) + b"".join(struct.pack("<H", s) for s in sizes)
+    extra = b"RA" + struct.pack("<H", len(ra)) + ra
+    if len(extra) > 0xFFFF:
+        raise ValueError("too many chunks for one dictzip file")
+
+    # gzip header: deflate, FEXTRA, no time, maximum compression, unknown OS
+    header = struct.pack("<BBBBIBB", 0x1F, 0x8B, 8, 0x04, 0, 2, 255) + struct.pack("<H", len(extra)) + extra
+    trailer = struct.pack("<II", zlib.crc32(data) & 0xFFFFFFFF, len(data) & 0xFFFFFFFF)
+    return header + b"".join(chunks) + trailer
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help=".dict file to compress")
+    parser.add_argument("output", nargs="?", help="output file (default: input + .dz)")
+    args = parser.parse_args()
+
+    with open(args.input, "rb") as f:
+        data = f.read()
+    try:
+        compressed = compress(data)
+    except ValueError as e:
+        print(f"{args.input}: {e}", file=sys.stderr)
+        return 1
+    output = args.output or args.input + ".dz"
+    with open(output, "wb") as f:
+        f.write(compressed)
+    print(f"{output}: {len(data)} -> {len(compressed)} bytes")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -406,6 +406,9 @@ def generate_keys_header(
     lines.append("// Language display names (defined in I18nStrings.cpp)")
     lines.append("extern const char* const LANGUAGE_NAMES[];")
     lines.append("")
+    lines.append("// Language codes, lowercase ISO 639-1 (defined in I18nStrings.cpp)")
+    lines.append("extern const char* const LANGUAGE_CODES[];")
+    lines.append("")
     lines.append("// Character sets for each language (defined in I18nStrings.cpp)")
     lines.append("extern const char* const CHARACTER_SETS[];")
     lines.append("")
@@ -520,6 +523,14 @@ def generate_strings_cpp(
     lines.append("};")
     lines.append("")
 
+    # LANGUAGE_CODES array
+    lines.append("// Language codes")
+    lines.append("const char* const LANGUAGE_CODES[] = {")
+    for code in languages:
+        _append_string_entry(lines, code.lower())
+    lines.append("};")
+    lines.append("")
+
     # CHARACTER_SETS array
     lines.append("// Character sets for each language")
     lines.append("const char* const CHARACTER_SETS[] = {")
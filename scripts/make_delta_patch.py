@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+"""
+Make a delta firmware patch that rebuilds NEW from OLD on the device.
+
+The patch format is described in lib/DeltaPatch/DeltaPatch.h. Matching works like
+bsdiff: exact matches found through an index of the old image are extended with
+approximate matches, so code that only moved keeps most of its bytes as small
+"add" differences, which compress well.
+
+The device only applies signed patches. Pass --key with the ECDSA P-256 private
+key (PEM) whose public half is built into the firmware as OTA_DELTA_PUBLIC_KEY;
+signing uses the openssl command line tool. The build flag value is the base64
+DER public key:
+    openssl pkey -in ota_key.pem -pubout -outform DER | base64 -w0
+
+Releases attach the patch as firmware-from-<old version>.patch next to firmware.bin.
+
+Examples:
+    python3 scripts/make_delta_patch.py old/firmware.bin new/firmware.bin firmware.patch --key ota_key.pem
+    python3 scripts/make_delta_patch.py old.bin new.bin unsigned.patch
+"""
+
+import argparse
+import hashlib
+import struct
+import subprocess
+import sys
+import zlib
+
+MAGIC = b"CPDP"
+VERSION = 1
+KEY_SIZE = 16  # Bytes hashed to find match candidates
+INDEX_STEP = 4  # Old image positions indexed; every new position is looked up
+MIN_MATCH = 24  # Shorter exact matches are sent as literal bytes
+MAX_SLACK = 64  # Approximate extension stops once the score drops this far below its best
+
+
+def build_index(old):
+    index = {}
+    for pos in range(0, len(old) - KEY_SIZE + 1, INDEX_STEP):
+        index.setdefault(old[pos:pos + KEY_SIZE], pos)
+    return index
+
+
+def exact_length(old, old_pos, new, new_pos):
+    """Length of the exact match at old_pos/new_pos, compared in blocks first."""
+    length = 0
+    limit = min(len(old) - old_pos, len(new) - new_pos)
+    while length + 64 <= limit and old[old_pos + length:old_pos + length + 64] == new[new_pos + length:new_pos + length + 64]:
+        length += 64
+    while length < limit and old[old_pos + length] == new[new_pos + length]:
+        length += 1
+    return length
+
+
+def approximate_extension(old, old_pos, new, new_pos, limit):
+    """Extra bytes worth covering with add differences: maximises matches*2 - length, as bsdiff does."""
+    score = best = best_length = 0
+    limit = min(limit, len(old) - old_pos, len(new) - new_pos)
+    for i in range(limit):
+        score += 1 if old[old_pos + i] == new[new_pos + i] else -1
+        if score > best:
+            best, best_length = score, i + 1
+        elif score < best - MAX_SLACK:
+            break
+    return best_length
+
+
+def find_matches(old, new):
+    """Non-overlapping (new_pos, old_pos, length) matches in new order."""
+    index = build_index(old)
+    matches = []
+    pos = 0
+    offset = 0  # old_pos - new_pos of the previous match, tried first since code tends to move in blocks
+    while pos + KEY_SIZE <= len(new):
+        candidates = []
+        if 0 <= pos + offset < len(old):
+            candidates.append(pos + offset)
+        found = index.get(new[pos:pos + KEY_SIZE])
+        if found is not None:
+            candidates.append(found)
+        best_old, best_length = -1, 0
+        for old_pos in candidates:
+            length = exact_length(old, old_pos, new, pos)
+            if length > best_length:
+                best_old, best_length = old_pos, length
+        if best_length < MIN_MATCH:
+            pos += 1
+            continue
+
+        # Let the match run on through small differences, up to the next exact match
+        end = pos + best_length
+        while end < len(new):
+            extra = approximate_extension(old, best_old + end - pos, new, end, len(new) - end)
+            if extra == 0:
+                break
+            end += extra
+            end += exact_length(old, best_old + end - pos, new, end)
+        matches.append((pos, best_old, end - pos))
+        offset = best_old - pos
+        pos = end
+    return matches
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def zigzag(value):
+    return value * 2 if value >= 0 else -value * 2 - 1
+
+
+def build_body(old, new, matches):
+    compressor = zlib.compressobj(9, zlib.DEFLATED, -15, 9)
+    out = []
+    source_pos = 0
+
+    def record(add_new, add_old, add_length, insert_start, insert_length, next_source):
+        nonlocal source_pos
+        out.append(compressor.compress(varint(add_length) + varint(insert_length) +
+                                       varint(zigzag(next_source - (add_old + add_length)))))
+        if add_length:
+            old_part = old[add_old:add_old + add_length]
+            new_part = new[add_new:add_new + add_length]
+            out.append(compressor.compress(bytes((n - o) & 0xFF for n, o in zip(new_part, old_part))))
+        out.append(compressor.compress(new[insert_start:insert_start + insert_length]))
+        source_pos = next_source
+
+    first_new = matches[0][0] if matches else len(new)
+    first_old = matches[0][1] if matches else 0
+    if first_new > 0 or not matches:
+        record(0, 0, 0, 0, first_new, first_old)
+    for i, (new_pos, old_pos, length) in enumerate(matches):
+        next_new = matches[i + 1][0] if i + 1 < len(matches) else len(new)
+        next_old = matches[i + 1][1] if i + 1 < len(matches) else old_pos + length
+        insert_start = new_pos + length
+        record(new_pos, old_pos, length, insert_start, next_new - insert_start, next_old)
+    out.append(compressor.flush())
+    return b"".join(out)
+
+
+def sign(header, key):
+    result = subprocess.run(["openssl", "dgst", "-sha256", "-sign", key], input=header, capture_output=True,
+                            check=True)
+    return result.stdout
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Make a delta firmware patch.")
+    parser.add_argument("old", help="Firmware image running on the device")
+    parser.add_argument("new", help="Firmware image to update to")
+    parser.add_argument("patch", help="Output patch file")
+    parser.add_argument("--key", help="ECDSA P-256 private key (PEM) to sign the patch with")
+    args = parser.parse_args()
+
+    with open(args.old, "rb") as f:
+        old = f.read()
+    with open(args.new, "rb") as f:
+        new = f.read()
+
+    header = MAGIC + bytes([VERSION, 0, 0, 0]) + struct.pack("<II", len(old), len(new))
+    header += hashlib.sha256(old).digest() + hashlib.sha256(new).digest()
+    signature = sign(header, args.key) if args.key else b""
+    if len(signature) > 128:
+        sys.exit("Signature too long; use an ECDSA P-256 key")
+
+    matches = find_matches(old, new)
+    body = build_body(old, new, matches)
+    with open(args.patch, "wb") as f:
+        f.write(header + struct.pack("<H", len(signature)) + signature + body)
+
+    matched = sum(length for _, _, length in matches)
+    print(f"{args.patch}: {len(body) + len(header) + 2 + len(signature)} bytes for a {len(new)} byte image "
+          f"({matched * 100 // max(len(new), 1)}% matched in {len(matches)} runs)"
+          + ("" if signature else ", unsigned"))
+
+
+if __name__ == "__main__":
+    main()
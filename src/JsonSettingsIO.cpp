@@ -293,22 +293,6 @@ bool JsonSettingsIO::loadWifi(WifiCredentialStore& store, const char* json, bool
 
 // ---- RecentBooksStore ----
 
-bool JsonSettingsIO::saveRecentBooks(const RecentBooksStore& store, const char* path) {
-  JsonDocument doc;
-  JsonArray arr = doc["books"].to<JsonArray>();
-  for (const auto& book : store.getBooks()) {
-    JsonObject obj = arr.add<JsonObject>();
-    obj["path"] = book.path;
-    obj["title"] = book.title;
-    obj["author"] = book.author;
-    obj["coverBmpPath"] = book.coverBmpPath;
-  }
-
-  String json;
-  serializeJson(doc, json);
-  return Storage.writeFile(path, json);
-}
-
 bool JsonSettingsIO::loadRecentBooks(RecentBooksStore& store, const char* json) {
   JsonDocument doc;
   auto error = deserializeJson(doc, json);
@@ -320,7 +304,7 @@ bool JsonSettingsIO::loadRecentBooks(RecentBooksStore& store, const char* json)
   store.recentBooks.clear();
   JsonArray arr = doc["books"].as<JsonArray>();
   for (JsonObject obj : arr) {
-    if (store.getCount() >= 10) break;
+    if (store.recentBooks.size() >= 10) break;
     RecentBook book;
     book.path = obj["path"] | std::string("");
     book.title = obj["title"] | std::string("");
@@ -329,6 +313,6 @@ bool JsonSettingsIO::loadRecentBooks(RecentBooksStore& store, const char* json)
     store.recentBooks.push_back(book);
   }
 
-  LOG_DBG("RBS", "Recent books loaded from file (%d entries)", store.getCount());
+  LOG_DBG("RBS", "Recent books loaded from file (%d entries)", static_cast<int>(store.recentBooks.size()));
   return true;
 }
@@ -8,54 +8,43 @@
 #include <Serialization.h>
 #include <Xtc.h>
 
-#include <algorithm>
-
 namespace {
 constexpr uint8_t RECENT_BOOKS_FILE_VERSION = 3;
 constexpr char RECENT_BOOKS_FILE_BIN[] = "/.crosspoint/recent.bin";
 constexpr char RECENT_BOOKS_FILE_JSON[] = "/.crosspoint/recent.json";
 constexpr char RECENT_BOOKS_FILE_BAK[] = "/.crosspoint/recent.bin.bak";
+constexpr char RECENT_BOOKS_FILE_JSON_BAK[] = "/.crosspoint/recent.json.bak";
 constexpr int MAX_RECENT_BOOKS = 10;
 }  // namespace
 
 RecentBooksStore RecentBooksStore::instance;
 
-void RecentBooksStore::addBook(const std::string& path, const std::string& title, const std::string& author,
-                               const std::string& coverBmpPath) {
-  // Remove existing entry if present
-  auto it =
-      std::find_if(recentBooks.begin(), recentBooks.end(), [&](const RecentBook& book) { return book.path == path; });
-  if (it != recentBooks.end()) {
-    recentBooks.erase(it);
-  }
-
-  // Add to front
-  recentBooks.insert(recentBooks.begin(), {path, title, author, coverBmpPath});
-
-  // Trim to max size
-  if (recentBooks.size() > MAX_RECENT_BOOKS) {
-    recentBooks.resize(MAX_RECENT_BOOKS);
-  }
-
-  saveToFile();
-}
+void RecentBooksStore::addBook(const LibraryDb::Book& book) { LibraryDb::put(book, true); }
 
 void RecentBooksStore::updateBook(const std::string& path, const std::string& title, const std::string& author,
                                   const std::string& coverBmpPath) {
-  auto it =
-      std::find_if(recentBooks.begin(), recentBooks.end(), [&](const RecentBook& book) { return book.path == path; });
-  if (it != recentBooks.end()) {
-    RecentBook& book = *it;
+  LibraryDb::Book book;
+  if (LibraryDb::find(path, book)) {
     book.title = title;
     book.author = author;
-    book.coverBmpPath = coverBmpPath;
-    saveToFile();
+    book.thumbBmpPath = coverBmpPath;
+    LibraryDb::put(book);
   }
 }
 
-bool RecentBooksStore::saveToFile() const {
-  Storage.mkdir("/.crosspoint");
-  return JsonSettingsIO::saveRecentBooks(*this, RECENT_BOOKS_FILE_JSON);
+const std::vector<RecentBook>& RecentBooksStore::getBooks() const {
+  const uint32_t revision = LibraryDb::getRevision();
+  if (revision == loadedRevision) {
+    return recentBooks;
+  }
+  loadedRevision = revision;
+  recentBooks.clear();
+  LibraryDb::query(LibraryDb::SortKey::LastOpened, true, 0, MAX_RECENT_BOOKS, [this](const LibraryDb::Book& book) {
+    if (book.lastOpened > 0) {
+      recentBooks.push_back({book.path, book.title, book.author, book.thumbBmpPath});
+    }
+  });
+  return recentBooks;
 }
 
 RecentBook RecentBooksStore::getDataFromBook(std::string path) const {
@@ -86,21 +75,41 @@ RecentBook RecentBooksStore::getDataFromBook(std::string path) const {
   return RecentBook{path, "", "", ""};
 }
 
+void RecentBooksStore::migrateToLibrary() const {
+  // Oldest first, so the last one put is the most recently opened
+  for (auto it = recentBooks.rbegin(); it != recentBooks.rend(); ++it) {
+    LibraryDb::Book book;
+    book.path = it->path;
+    book.title = it->title;
+    book.author = it->author;
+    book.thumbBmpPath = it->coverBmpPath;
+    LibraryDb::put(book, true);
+  }
+  loadedRevision = UINT32_MAX;
+}
+
 bool RecentBooksStore::loadFromFile() {
+  if (LibraryDb::count() > 0) {
+    return true;
+  }
+
   // Try JSON first
   if (Storage.exists(RECENT_BOOKS_FILE_JSON)) {
     String json = Storage.readFile(RECENT_BOOKS_FILE_JSON);
-    if (!json.isEmpty()) {
-      return JsonSettingsIO::loadRecentBooks(*this, json.c_str());
+    if (!json.isEmpty() && JsonSettingsIO::loadRecentBooks(*this, json.c_str())) {
+      migrateToLibrary();
+      Storage.rename(RECENT_BOOKS_FILE_JSON, RECENT_BOOKS_FILE_JSON_BAK);
+      LOG_DBG("RBS", "Migrated recent.json to the library database");
+      return true;
     }
   }
 
   // Fall back to binary migration
   if (Storage.exists(RECENT_BOOKS_FILE_BIN)) {
     if (loadFromBinaryFile()) {
-      saveToFile();
+      migrateToLibrary();
       Storage.rename(RECENT_BOOKS_FILE_BIN, RECENT_BOOKS_FILE_BAK);
-      LOG_DBG("RBS", "Migrated recent.bin to recent.json");
+      LOG_DBG("RBS", "Migrated recent.bin to the library database");
       return true;
     }
   }
@@ -163,10 +172,7 @@ bool RecentBooksStore::loadFromBinaryFile() {
     }
 
     if (omitted > 0) {
-      inputFile.close();
-      saveToFile();
       LOG_DBG("RBS", "Omitted %u recent book(s) with missing title", omitted);
-      return true;
     }
   } else {
     LOG_ERR("RBS", "Deserialization failed: Unknown version %u", version);
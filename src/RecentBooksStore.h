@@ -1,4 +1,6 @@
 #pragma once
+#include <LibraryDb.h>
+
 #include <string>
 #include <vector>
 
@@ -20,7 +22,9 @@ class RecentBooksStore {
   // Static instance
   static RecentBooksStore instance;
 
-  std::vector<RecentBook> recentBooks;
+  // Most recently opened books of the library database, read again when the database changed
+  mutable std::vector<RecentBook> recentBooks;
+  mutable uint32_t loadedRevision = UINT32_MAX;
 
   friend bool JsonSettingsIO::loadRecentBooks(RecentBooksStore&, const char*);
 
@@ -30,26 +34,25 @@ class RecentBooksStore {
   // Get singleton instance
   static RecentBooksStore& getInstance() { return instance; }
 
-  // Add a book to the recent list (moves to front if already exists)
-  void addBook(const std::string& path, const std::string& title, const std::string& author,
-               const std::string& coverBmpPath);
+  // Store the book in the library and move it to the front of the recent list
+  void addBook(const LibraryDb::Book& book);
 
   void updateBook(const std::string& path, const std::string& title, const std::string& author,
                   const std::string& coverBmpPath);
 
   // Get the list of recent books (most recent first)
-  const std::vector<RecentBook>& getBooks() const { return recentBooks; }
+  const std::vector<RecentBook>& getBooks() const;
 
   // Get the count of recent books
-  int getCount() const { return static_cast<int>(recentBooks.size()); }
-
-  bool saveToFile() const;
+  int getCount() const { return static_cast<int>(getBooks().size()); }
 
+  // Moves a recent list of an older firmware into the library database
   bool loadFromFile();
   RecentBook getDataFromBook(std::string path) const;
 
  private:
   bool loadFromBinaryFile();
+  void migrateToLibrary() const;
 };
 
 // Helper macro to access recent books store
@@ -50,8 +50,13 @@ struct FootnoteResult {
   std::string href;
 };
 
+struct SearchResult {
+  int spineIndex = 0;
+  uint32_t charOffset = 0;  // as counted by the section's XPath map
+};
+
 using ResultVariant = std::variant<std::monostate, WifiResult, KeyboardResult, MenuResult, ChapterResult, PercentResult,
-                                   PageResult, SyncResult, NetworkModeResult, FootnoteResult>;
+                                   PageResult, SyncResult, NetworkModeResult, FootnoteResult, SearchResult>;
 
 struct ActivityResult {
   bool isCancelled = false;
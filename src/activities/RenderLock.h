@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+
 class Activity;  // forward declaration
 
 // RAII helper to lock rendering mutex for the duration of a scope.
@@ -9,9 +11,12 @@ class RenderLock {
  public:
   explicit RenderLock();
   explicit RenderLock(Activity&);  // unused for now, but keep for compatibility
+  // Waits at most `timeoutMs`, for background tasks that must stay responsive to being stopped by a lock holder
+  explicit RenderLock(uint32_t timeoutMs);
   RenderLock(const RenderLock&) = delete;
   RenderLock& operator=(const RenderLock&) = delete;
   ~RenderLock();
   void unlock();
+  bool owns() const { return isLocked; }
   static bool peek();
 };
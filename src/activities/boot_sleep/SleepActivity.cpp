@@ -5,6 +5,7 @@
 #include <GfxRenderer.h>
 #include <HalStorage.h>
 #include <I18n.h>
+#include <PackedFrameCache.h>
 #include <Txt.h>
 #include <Xtc.h>
 
@@ -86,18 +87,11 @@ void SleepActivity::renderCustomSleepScreen() const {
       APP_STATE.lastSleepImage = randomFileIndex;
       APP_STATE.saveToFile();
       const auto filename = std::string(sleepDir) + "/" + files[randomFileIndex];
-      FsFile file;
-      if (Storage.openFileForRead("SLP", filename, file)) {
-        LOG_DBG("SLP", "Randomly loading: %s/%s", sleepDir, files[randomFileIndex].c_str());
-        delay(100);
-        Bitmap bitmap(file, true);
-        if (bitmap.parseHeaders() == BmpReaderError::Ok) {
-          renderBitmapSleepScreen(bitmap);
-          file.close();
-          dir.close();
-          return;
-        }
-        file.close();
+      LOG_DBG("SLP", "Randomly loading: %s/%s", sleepDir, files[randomFileIndex].c_str());
+      delay(100);
+      if (renderSleepImage(filename, true)) {
+        dir.close();
+        return;
       }
     }
   }
@@ -105,16 +99,8 @@ void SleepActivity::renderCustomSleepScreen() const {
 
   // Look for sleep.bmp on the root of the sd card to determine if we should
   // render a custom sleep screen instead of the default.
-  FsFile file;
-  if (Storage.openFileForRead("SLP", "/sleep.bmp", file)) {
-    Bitmap bitmap(file, true);
-    if (bitmap.parseHeaders() == BmpReaderError::Ok) {
-      LOG_DBG("SLP", "Loading: /sleep.bmp");
-      renderBitmapSleepScreen(bitmap);
-      file.close();
-      return;
-    }
-    file.close();
+  if (Storage.exists("/sleep.bmp") && renderSleepImage("/sleep.bmp", true)) {
+    return;
   }
 
   renderDefaultSleepScreen();
@@ -137,7 +123,71 @@ void SleepActivity::renderDefaultSleepScreen() const {
   renderer.displayBuffer(HalDisplay::HALF_REFRESH);
 }
 
-void SleepActivity::renderBitmapSleepScreen(const Bitmap& bitmap) const {
+uint32_t SleepActivity::sleepImageVariant(const bool dithering) const {
+  // Everything besides the source file that changes the rendered frame
+  return static_cast<uint32_t>(renderer.getOrientation()) | static_cast<uint32_t>(SETTINGS.sleepScreenCoverMode) << 8 |
+         static_cast<uint32_t>(SETTINGS.sleepScreenCoverFilter) << 16 | static_cast<uint32_t>(dithering) << 24;
+}
+
+bool SleepActivity::renderSleepImage(const std::string& path, const bool dithering) const {
+  FsFile file;
+  if (!Storage.openFileForRead("SLP", path, file)) {
+    return false;
+  }
+
+  PackedFrameCache cache(PackedFrameCache::pathFor("/.crosspoint", path), sleepImageVariant(dithering));
+  const bool stamped = cache.stampSource(file);
+  if (stamped && renderCachedSleepScreen(cache)) {
+    LOG_DBG("SLP", "Rendered cached frame for: %s", path.c_str());
+    file.close();
+    return true;
+  }
+
+  Bitmap bitmap(file, dithering);
+  if (bitmap.parseHeaders() != BmpReaderError::Ok) {
+    LOG_DBG("SLP", "Invalid BMP file: %s", path.c_str());
+    file.close();
+    return false;
+  }
+
+  LOG_DBG("SLP", "Rendering sleep image: %s", path.c_str());
+  renderBitmapSleepScreen(bitmap, stamped ? &cache : nullptr);
+  file.close();
+  return true;
+}
+
+bool SleepActivity::renderCachedSleepScreen(PackedFrameCache& cache) const {
+  if (!cache.open()) {
+    return false;
+  }
+
+  uint8_t* frameBuffer = renderer.getFrameBuffer();
+  if (!cache.readPlane(frameBuffer)) {
+    cache.close();
+    return false;
+  }
+  renderer.displayBuffer(HalDisplay::HALF_REFRESH);
+
+  if (cache.getPlaneCount() == PackedFrameCache::MAX_PLANES) {
+    // BW is already on screen, so a failed grayscale read only loses the gray levels
+    if (!cache.readPlane(frameBuffer)) {
+      cache.close();
+      return true;
+    }
+    renderer.copyGrayscaleLsbBuffers();
+    if (!cache.readPlane(frameBuffer)) {
+      cache.close();
+      return true;
+    }
+    renderer.copyGrayscaleMsbBuffers();
+    renderer.displayGrayBuffer();
+  }
+
+  cache.close();
+  return true;
+}
+
+void SleepActivity::renderBitmapSleepScreen(const Bitmap& bitmap, PackedFrameCache* cache) const {
   int x, y;
   const auto pageWidth = renderer.getScreenWidth();
   const auto pageHeight = renderer.getScreenHeight();
@@ -189,6 +239,13 @@ void SleepActivity::renderBitmapSleepScreen(const Bitmap& bitmap) const {
     renderer.invertScreen();
   }
 
+  // Capture each plane as it is rendered so the next sleep can skip decoding entirely
+  if (cache && cache->beginWrite(hasGreyscale ? PackedFrameCache::MAX_PLANES : 1)) {
+    cache->writePlane(renderer.getFrameBuffer());
+  } else {
+    cache = nullptr;
+  }
+
   renderer.displayBuffer(HalDisplay::HALF_REFRESH);
 
   if (hasGreyscale) {
@@ -196,17 +253,23 @@ void SleepActivity::renderBitmapSleepScreen(const Bitmap& bitmap) const {
     renderer.clearScreen(0x00);
     renderer.setRenderMode(GfxRenderer::GRAYSCALE_LSB);
     renderer.drawBitmap(bitmap, x, y, pageWidth, pageHeight, cropX, cropY);
+    if (cache) cache->writePlane(renderer.getFrameBuffer());
     renderer.copyGrayscaleLsbBuffers();
 
     bitmap.rewindToData();
     renderer.clearScreen(0x00);
     renderer.setRenderMode(GfxRenderer::GRAYSCALE_MSB);
     renderer.drawBitmap(bitmap, x, y, pageWidth, pageHeight, cropX, cropY);
+    if (cache) cache->writePlane(renderer.getFrameBuffer());
     renderer.copyGrayscaleMsbBuffers();
 
     renderer.displayGrayBuffer();
     renderer.setRenderMode(GfxRenderer::BW);
   }
+
+  if (cache) {
+    cache->commit();
+  }
 }
 
 void SleepActivity::renderCoverSleepScreen() const {
@@ -275,16 +338,8 @@ void SleepActivity::renderCoverSleepScreen() const {
     return (this->*renderNoCoverSleepScreen)();
   }
 
-  FsFile file;
-  if (Storage.openFileForRead("SLP", coverBmpPath, file)) {
-    Bitmap bitmap(file);
-    if (bitmap.parseHeaders() == BmpReaderError::Ok) {
-      LOG_DBG("SLP", "Rendering sleep cover: %s", coverBmpPath.c_str());
-      renderBitmapSleepScreen(bitmap);
-      file.close();
-      return;
-    }
-    file.close();
+  if (renderSleepImage(coverBmpPath, false)) {
+    return;
   }
 
   return (this->*renderNoCoverSleepScreen)();
@@ -1,7 +1,10 @@
 #pragma once
+#include <string>
+
 #include "../Activity.h"
 
 class Bitmap;
+class PackedFrameCache;
 
 class SleepActivity final : public Activity {
  public:
@@ -13,6 +16,9 @@ class SleepActivity final : public Activity {
   void renderDefaultSleepScreen() const;
   void renderCustomSleepScreen() const;
   void renderCoverSleepScreen() const;
-  void renderBitmapSleepScreen(const Bitmap& bitmap) const;
+  bool renderSleepImage(const std::string& path, bool dithering) const;
+  bool renderCachedSleepScreen(PackedFrameCache& cache) const;
+  void renderBitmapSleepScreen(const Bitmap& bitmap, PackedFrameCache* cache) const;
+  uint32_t sleepImageVariant(bool dithering) const;
   void renderBlankSleepScreen() const;
 };
@@ -1,10 +1,10 @@
 #include "OpdsBookBrowserActivity.h"
 
+#include <DirectoryIndex.h>
 #include <Epub.h>
 #include <GfxRenderer.h>
 #include <I18n.h>
 #include <Logging.h>
-#include <OpdsStream.h>
 #include <WiFi.h>
 
 #include "CrossPointSettings.h"
@@ -24,7 +24,7 @@ void OpdsBookBrowserActivity::onEnter() {
   Activity::onEnter();
 
   state = BrowserState::CHECK_WIFI;
-  entries.clear();
+  feed.close();
   navigationHistory.clear();
   currentPath = "";  // Root path - user provides full URL in settings
   selectorIndex = 0;
@@ -42,7 +42,7 @@ void OpdsBookBrowserActivity::onExit() {
   // Turn off WiFi when exiting
   WiFi.mode(WIFI_OFF);
 
-  entries.clear();
+  feed.close();
   navigationHistory.clear();
 }
 
@@ -98,40 +98,59 @@ void OpdsBookBrowserActivity::loop() {
 
   // Handle browsing state
   if (state == BrowserState::BROWSING) {
+    // Take in the next page of the feed once it has been prefetched
+    bool grown;
+    {
+      RenderLock lock(*this);
+      grown = feed.poll();
+    }
+    if (grown) {
+      requestUpdate();
+    }
+
     if (mappedInput.wasReleased(MappedInputManager::Button::Confirm)) {
-      if (!entries.empty()) {
-        const auto& entry = entries[selectorIndex];
+      OpdsEntry entry;
+      bool found;
+      {
+        RenderLock lock(*this);
+        found = feed.get(selectorIndex, entry);
+      }
+      if (found) {
         if (entry.type == OpdsEntryType::BOOK) {
           downloadBook(entry);
         } else {
           navigateToEntry(entry);
         }
       }
+      return;
     } else if (mappedInput.wasReleased(MappedInputManager::Button::Back)) {
       navigateBack();
+      return;
     }
 
     // Handle navigation
-    if (!entries.empty()) {
+    if (feed.size() > 0) {
       buttonNavigator.onNextRelease([this] {
-        selectorIndex = ButtonNavigator::nextIndex(selectorIndex, entries.size());
+        selectorIndex = ButtonNavigator::nextIndex(selectorIndex, feed.size());
         requestUpdate();
       });
 
       buttonNavigator.onPreviousRelease([this] {
-        selectorIndex = ButtonNavigator::previousIndex(selectorIndex, entries.size());
+        selectorIndex = ButtonNavigator::previousIndex(selectorIndex, feed.size());
         requestUpdate();
       });
 
       buttonNavigator.onNextContinuous([this] {
-        selectorIndex = ButtonNavigator::nextPageIndex(selectorIndex, entries.size(), PAGE_ITEMS);
+        selectorIndex = ButtonNavigator::nextPageIndex(selectorIndex, feed.size(), PAGE_ITEMS);
         requestUpdate();
       });
 
       buttonNavigator.onPreviousContinuous([this] {
-        selectorIndex = ButtonNavigator::previousPageIndex(selectorIndex, entries.size(), PAGE_ITEMS);
+        selectorIndex = ButtonNavigator::previousPageIndex(selectorIndex, feed.size(), PAGE_ITEMS);
         requestUpdate();
       });
+
+      feed.prefetchNear(selectorIndex);
     }
   }
 }
@@ -188,14 +207,15 @@ void OpdsBookBrowserActivity::render(RenderLock&&) {
 
   // Browsing state
   // Show appropriate button hint based on selected entry type
+  OpdsEntry entry;
   const char* confirmLabel = tr(STR_OPEN);
-  if (!entries.empty() && entries[selectorIndex].type == OpdsEntryType::BOOK) {
+  if (feed.get(selectorIndex, entry) && entry.type == OpdsEntryType::BOOK) {
     confirmLabel = tr(STR_DOWNLOAD);
   }
   const auto labels = mappedInput.mapLabels(tr(STR_BACK), confirmLabel, tr(STR_DIR_UP), tr(STR_DIR_DOWN));
   GUI.drawButtonHints(renderer, labels.btn1, labels.btn2, labels.btn3, labels.btn4);
 
-  if (entries.empty()) {
+  if (feed.size() == 0) {
     renderer.drawCenteredText(UI_10_FONT_ID, pageHeight / 2, tr(STR_NO_ENTRIES));
     renderer.displayBuffer();
     return;
@@ -204,8 +224,10 @@ void OpdsBookBrowserActivity::render(RenderLock&&) {
   const auto pageStartIndex = selectorIndex / PAGE_ITEMS * PAGE_ITEMS;
   renderer.fillRect(0, 60 + (selectorIndex % PAGE_ITEMS) * 30 - 2, pageWidth - 1, 30);
 
-  for (size_t i = pageStartIndex; i < entries.size() && i < static_cast<size_t>(pageStartIndex + PAGE_ITEMS); i++) {
-    const auto& entry = entries[i];
+  for (size_t i = pageStartIndex; i < feed.size() && i < static_cast<size_t>(pageStartIndex + PAGE_ITEMS); i++) {
+    if (!feed.get(i, entry)) {
+      break;
+    }
 
     // Format display text with type indicator
     std::string displayText;
@@ -236,33 +258,27 @@ void OpdsBookBrowserActivity::fetchFeed(const std::string& path) {
     return;
   }
 
-  std::string url = UrlUtils::buildUrl(serverUrl, path);
-  LOG_DBG("OPDS", "Fetching: %s", url.c_str());
-
-  OpdsParser parser;
+  LOG_DBG("OPDS", "Fetching: %s", UrlUtils::buildUrl(serverUrl, path).c_str());
 
   {
-    OpdsParserStream stream{parser};
-    if (!HttpDownloader::fetchUrl(url, stream)) {
-      state = BrowserState::ERROR;
-      errorMessage = tr(STR_FETCH_FEED_FAILED);
-      requestUpdate();
-      return;
-    }
+    // Wait out a render of the previous feed; nothing reads the feed again until the state is back to browsing
+    RenderLock lock(*this);
+    feed.close();
   }
 
-  if (!parser) {
+  const auto result = feed.open(serverUrl, path);
+  if (result != OpdsFeedPages::LoadResult::OK) {
     state = BrowserState::ERROR;
-    errorMessage = tr(STR_PARSE_FEED_FAILED);
+    errorMessage = result == OpdsFeedPages::LoadResult::PARSE_FAILED ? tr(STR_PARSE_FEED_FAILED)
+                                                                      : tr(STR_FETCH_FEED_FAILED);
     requestUpdate();
     return;
   }
 
-  entries = std::move(parser).getEntries();
-  LOG_DBG("OPDS", "Found %d entries", entries.size());
+  LOG_DBG("OPDS", "Found %zu entries", feed.size());
   selectorIndex = 0;
 
-  if (entries.empty()) {
+  if (feed.size() == 0) {
     state = BrowserState::ERROR;
     errorMessage = tr(STR_NO_ENTRIES);
     requestUpdate();
@@ -280,7 +296,6 @@ void OpdsBookBrowserActivity::navigateToEntry(const OpdsEntry& entry) {
 
   state = BrowserState::LOADING;
   statusMessage = tr(STR_LOADING);
-  entries.clear();
   selectorIndex = 0;
   requestUpdate(true);  // Force update to show loading state immediately before fetch
 
@@ -298,7 +313,6 @@ void OpdsBookBrowserActivity::navigateBack() {
 
     state = BrowserState::LOADING;
     statusMessage = tr(STR_LOADING);
-    entries.clear();
     selectorIndex = 0;
     requestUpdate();
 
@@ -331,6 +345,8 @@ void OpdsBookBrowserActivity::downloadBook(const OpdsEntry& book) {
         downloadTotal = total;
         requestUpdate(true);  // Force update to refresh progress bar
       });
+  // A partial download may be left behind too
+  DirectoryIndex::invalidateParent(filename);
 
   if (result == HttpDownloader::OK) {
     LOG_DBG("OPDS", "Download complete: %s", filename.c_str());
@@ -1,11 +1,10 @@
 #pragma once
-#include <OpdsParser.h>
-
 #include <functional>
 #include <string>
 #include <vector>
 
 #include "../Activity.h"
+#include "OpdsFeedPages.h"
 #include "util/ButtonNavigator.h"
 
 /**
@@ -35,7 +34,7 @@ class OpdsBookBrowserActivity final : public Activity {
  private:
   ButtonNavigator buttonNavigator;
   BrowserState state = BrowserState::LOADING;
-  std::vector<OpdsEntry> entries;
+  OpdsFeedPages feed;  // Entries of the current feed, including its rel="next" pages
   std::vector<std::string> navigationHistory;  // Stack of previous feed paths for back navigation
   std::string currentPath;                     // Current feed path being displayed
   int selectorIndex = 0;
@@ -0,0 +1,309 @@
+#include "OpdsFeedPages.h"
+
+#include <HalStorage.h>
+#include <Logging.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <algorithm>
+
+#include "network/HttpDownloader.h"
+#include "util/UrlUtils.h"
+
+namespace {
+constexpr char CACHE_DIR[] = "/.crosspoint/opds";
+
+// Three screens of entries: the one shown and one on either side. The arena fits ~80 entries of typical length.
+constexpr size_t WINDOW_ENTRIES = 69;
+constexpr size_t WINDOW_ARENA = 16 * 1024;
+// Entries kept before the selection when a window is loaded, so scrolling back a screen needs no reload
+constexpr size_t WINDOW_LEAD = WINDOW_ENTRIES / 3;
+// Start fetching the next document this many entries before the end of what is loaded
+constexpr size_t PREFETCH_DISTANCE = 46;
+// Entries between the offsets noted for resuming a parse: a window load parses at most this many entries it doesn't
+// keep, for 4 bytes per checkpoint
+constexpr size_t CHECKPOINT_INTERVAL = 16;
+
+std::atomic<uint32_t> cacheCounter{0};
+
+// Writes the downloaded document to the SD card and feeds it to the parser at the same time. Returning a short
+// write makes HTTPClient stop the transfer, which is how a prefetch is cancelled.
+class CacheWriteStream final : public Stream {
+ public:
+  CacheWriteStream(FsFile& file, OpdsParser& parser, const std::atomic<bool>* cancelled)
+      : file(file), parser(parser), cancelled(cancelled) {}
+
+  size_t write(uint8_t byte) override { return write(&byte, 1); }
+
+  size_t write(const uint8_t* buffer, size_t size) override {
+    if (!writeOk || (cancelled && *cancelled)) {
+      writeOk = false;
+      return 0;
+    }
+    if (file.write(buffer, size) != size) {
+      writeOk = false;
+      return 0;
+    }
+    parser.write(buffer, size);
+    return size;
+  }
+
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+
+  bool ok() const { return writeOk; }
+
+ private:
+  FsFile& file;
+  OpdsParser& parser;
+  const std::atomic<bool>* cancelled;
+  bool writeOk = true;
+};
+}  // namespace
+
+struct OpdsFeedPages::PrefetchJob {
+  Page page;
+  std::string nextLink;
+  LoadResult result = LoadResult::FETCH_FAILED;
+  std::atomic<bool> cancelled{false};
+  std::atomic<bool> done{false};
+};
+
+OpdsFeedPages::OpdsFeedPages() : window(WINDOW_ENTRIES, WINDOW_ARENA) {}
+
+OpdsFeedPages::~OpdsFeedPages() { close(); }
+
+OpdsFeedPages::LoadResult OpdsFeedPages::open(const std::string& server, const std::string& path) {
+  close();
+  serverUrl = server;
+
+  // Clear documents left by an earlier session
+  Storage.mkdir(CACHE_DIR);
+  if (FsFile dir = Storage.open(CACHE_DIR)) {
+    char name[64];
+    std::string stalePath;
+    for (FsFile file = dir.openNextFile(); file; file = dir.openNextFile()) {
+      file.getName(name, sizeof(name));
+      file.close();
+      stalePath = std::string(CACHE_DIR) + "/" + name;
+      Storage.remove(stalePath.c_str());
+    }
+    dir.close();
+  }
+
+  Page page;
+  page.url = UrlUtils::buildUrl(serverUrl, path);
+  page.path = nextCachePath();
+  std::string nextLink;
+  const LoadResult result = fetchPage(page, nextLink, nullptr);
+  if (result != LoadResult::OK) {
+    return result;
+  }
+
+  pages.push_back(page);
+  totalEntries = page.entryCount;
+  setNextLink(nextLink);
+  window.reset(0);
+  LOG_DBG("OPDS", "Feed has %zu entries%s", totalEntries, nextUrl.empty() ? "" : " and a next page");
+  return LoadResult::OK;
+}
+
+void OpdsFeedPages::close() {
+  cancelPrefetch();
+  for (const Page& page : pages) {
+    Storage.remove(page.path.c_str());
+  }
+  pages.clear();
+  totalEntries = 0;
+  nextUrl.clear();
+  prefetchFailed = false;
+  window.reset(0);
+}
+
+bool OpdsFeedPages::get(const size_t index, OpdsEntry& entry) {
+  if (index >= totalEntries) {
+    return false;
+  }
+  if (!window.contains(index) && (!loadWindow(index) || !window.contains(index))) {
+    return false;
+  }
+  entry = window.at(index);
+  return true;
+}
+
+bool OpdsFeedPages::loadWindow(const size_t index) {
+  const size_t first = index > WINDOW_LEAD ? index - WINDOW_LEAD : 0;
+  window.reset(first);
+
+  for (const Page& page : pages) {
+    if (page.firstEntry + page.entryCount <= first) continue;
+    if (page.firstEntry >= first + WINDOW_ENTRIES) break;
+
+    // Start at the last checkpoint before the first entry the window needs from this document
+    const size_t needed = window.first() + window.size() - page.firstEntry;
+    const size_t checkpoint =
+        page.checkpoints.empty() ? 0 : std::min(needed / CHECKPOINT_INTERVAL, page.checkpoints.size() - 1);
+    const size_t skipped = checkpoint * CHECKPOINT_INTERVAL;
+
+    // Entries arrive in order, so the window is filled by taking each one whose position comes next
+    bool full = false;
+    OpdsParser parser;
+    parser.setEntryHandler([this, &page, &full, skipped](const size_t local, const OpdsEntry& entry) {
+      if (!full && page.firstEntry + skipped + local == window.first() + window.size()) {
+        full = !window.add(entry);
+      }
+    });
+    if (!parseCached(page, checkpoint, parser, full) && !full) {
+      LOG_ERR("OPDS", "Failed to read cached feed page %s", page.path.c_str());
+      return false;
+    }
+    if (full) break;
+  }
+  return true;
+}
+
+void OpdsFeedPages::prefetchNear(const size_t index) {
+  if (prefetch || nextUrl.empty() || index + PREFETCH_DISTANCE < totalEntries) return;
+  if (prefetchFailed && index + 1 < totalEntries) return;
+
+  auto job = std::make_unique<PrefetchJob>();
+  job->page.url = nextUrl;
+  job->page.path = nextCachePath();
+  job->page.firstEntry = totalEntries;
+
+  // The job outlives the task: cancelPrefetch() waits for `done` before freeing it
+  const BaseType_t created = xTaskCreate(&prefetchTask, "OpdsPrefetch",
+                                         8192,       // Stack size
+                                         job.get(),  // Parameters
+                                         1,          // Priority
+                                         nullptr);
+  if (created != pdPASS) {
+    LOG_ERR("OPDS", "Failed to start prefetch task");
+    return;
+  }
+  prefetch = std::move(job);
+  prefetchFailed = false;
+  LOG_DBG("OPDS", "Prefetching %s", nextUrl.c_str());
+}
+
+bool OpdsFeedPages::poll() {
+  if (!prefetch || !prefetch->done) return false;
+
+  const std::unique_ptr<PrefetchJob> job = std::move(prefetch);
+  if (job->result != LoadResult::OK) {
+    LOG_ERR("OPDS", "Prefetch of %s failed", job->page.url.c_str());
+    prefetchFailed = true;
+    return false;
+  }
+
+  pages.push_back(job->page);
+  totalEntries += job->page.entryCount;
+  setNextLink(job->nextLink);
+  LOG_DBG("OPDS", "Prefetched %zu entries, %zu in total", job->page.entryCount, totalEntries);
+  return job->page.entryCount > 0;
+}
+
+void OpdsFeedPages::cancelPrefetch() {
+  if (!prefetch) return;
+  // The download stops at its next write; until the task is done it may still be writing its document, which must
+  // not be deleted under it (or by the next open() clearing the cache)
+  prefetch->cancelled = true;
+  while (!prefetch->done) {
+    vTaskDelay(pdMS_TO_TICKS(10));
+  }
+  if (prefetch->result == LoadResult::OK) {
+    Storage.remove(prefetch->page.path.c_str());
+  }
+  prefetch.reset();
+}
+
+void OpdsFeedPages::setNextLink(const std::string& link) {
+  nextUrl = link.empty() ? "" : UrlUtils::buildUrl(serverUrl, link);
+  // Some servers link the last page to itself
+  for (const Page& page : pages) {
+    if (page.url == nextUrl) {
+      nextUrl.clear();
+      break;
+    }
+  }
+}
+
+std::string OpdsFeedPages::nextCachePath() {
+  return std::string(CACHE_DIR) + "/" + std::to_string(cacheCounter++) + ".xml";
+}
+
+OpdsFeedPages::LoadResult OpdsFeedPages::fetchPage(Page& page, std::string& nextLink,
+                                                   const std::atomic<bool>* cancelled) {
+  FsFile file;
+  if (!Storage.openFileForWrite("OPDS", page.path, file)) {
+    return LoadResult::FETCH_FAILED;
+  }
+
+  OpdsParser parser;
+  page.checkpoints.clear();
+  parser.setEntryHandler([&page, &parser](const size_t index, const OpdsEntry&) {
+    if (index % CHECKPOINT_INTERVAL == 0) {
+      page.checkpoints.push_back(static_cast<uint32_t>(parser.getEntryOffset()));
+    }
+  });
+  bool fetched;
+  bool written;
+  {
+    CacheWriteStream stream(file, parser, cancelled);
+    fetched = HttpDownloader::fetchUrl(page.url, stream);
+    written = stream.ok();
+  }
+  file.close();
+  if (!fetched || !written) {
+    Storage.remove(page.path.c_str());
+    return LoadResult::FETCH_FAILED;
+  }
+
+  parser.flush();
+  if (!parser) {
+    Storage.remove(page.path.c_str());
+    return LoadResult::PARSE_FAILED;
+  }
+  page.entryCount = parser.getEntryCount();
+  page.prologEnd = parser.getPrologEnd();
+  nextLink = parser.getNextLink();
+  return LoadResult::OK;
+}
+
+bool OpdsFeedPages::parseCached(const Page& page, const size_t checkpoint, OpdsParser& parser, const bool& stop) {
+  FsFile file;
+  if (!Storage.openFileForRead("OPDS", page.path, file)) {
+    return false;
+  }
+  uint8_t buffer[1024];
+  int read;
+  if (checkpoint > 0) {
+    // The prolog and root start tag put the parser where it was before the entry, then the entry follows
+    size_t remaining = page.prologEnd;
+    while (remaining > 0 && (read = file.read(buffer, std::min(sizeof(buffer), remaining))) > 0) {
+      parser.write(buffer, read);
+      remaining -= read;
+    }
+    if (remaining > 0 || !file.seekSet(page.checkpoints[checkpoint])) {
+      file.close();
+      return false;
+    }
+  }
+  while (!stop && (read = file.read(buffer, sizeof(buffer))) > 0) {
+    parser.write(buffer, read);
+  }
+  file.close();
+  if (stop) {
+    return true;
+  }
+  parser.flush();
+  return static_cast<bool>(parser);
+}
+
+void OpdsFeedPages::prefetchTask(void* param) {
+  auto* job = static_cast<PrefetchJob*>(param);
+  job->result = fetchPage(job->page, job->nextLink, &job->cancelled);
+  job->done = true;  // Last access: the owner may free the job from here on
+  vTaskDelete(nullptr);
+}
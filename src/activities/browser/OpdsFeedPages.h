@@ -0,0 +1,73 @@
+#pragma once
+
+#include <OpdsEntryWindow.h>
+#include <OpdsParser.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * The documents of one paginated OPDS feed: the first URL and every rel="next" page after it, read as one list.
+ *
+ * Documents are downloaded to the SD card and parsed from there, and only a small window of entries around the
+ * selection is kept in memory, so a catalog page of any size can be browsed. When the selection nears the end of
+ * what is loaded, the next document is fetched by a background task. While a document is downloaded the byte offset
+ * of every few entries is noted, so a window is read from the nearest of them instead of from the start.
+ */
+class OpdsFeedPages {
+ public:
+  enum class LoadResult { OK, FETCH_FAILED, PARSE_FAILED };
+
+  OpdsFeedPages();
+  ~OpdsFeedPages();
+
+  OpdsFeedPages(const OpdsFeedPages&) = delete;
+  OpdsFeedPages& operator=(const OpdsFeedPages&) = delete;
+
+  // Drop the current feed and load the first document of `path` on the server; later documents are resolved
+  // against `serverUrl` like every other OPDS link
+  LoadResult open(const std::string& serverUrl, const std::string& path);
+  // Cancel any prefetch, wait for its task to finish, and delete the cached documents
+  void close();
+
+  // Entries across the documents loaded so far
+  size_t size() const { return totalEntries; }
+  // Entry at `index`, reading its window from the cached documents if needed. False on a read error.
+  bool get(size_t index, OpdsEntry& entry);
+
+  // Start fetching the next document when `index` is close to the end of what is loaded
+  void prefetchNear(size_t index);
+  // Take in a finished prefetch; true if entries were added
+  bool poll();
+
+ private:
+  struct Page {
+    std::string url;
+    std::string path;  // Cached document on the SD card
+    size_t firstEntry = 0;
+    size_t entryCount = 0;
+    size_t prologEnd = 0;                // Document up to the end of the root element's start tag
+    std::vector<uint32_t> checkpoints;  // Offset of every CHECKPOINT_INTERVAL-th entry
+  };
+  struct PrefetchJob;
+
+  OpdsEntryWindow window;
+  std::vector<Page> pages;
+  size_t totalEntries = 0;
+  std::string nextUrl;  // Document after the last loaded page, empty at the end of the feed
+  std::string serverUrl;
+  std::unique_ptr<PrefetchJob> prefetch;
+  bool prefetchFailed = false;  // Don't retry until the selection reaches the end
+
+  bool loadWindow(size_t index);
+  void cancelPrefetch();
+  void setNextLink(const std::string& link);
+  static std::string nextCachePath();
+  // Download a document to `page.path`, parsing it on the way to count its entries
+  static LoadResult fetchPage(Page& page, std::string& nextLink, const std::atomic<bool>* cancelled);
+  // Parse a cached document from the entry at checkpoint `checkpoint`; the parser counts entries from there
+  static bool parseCached(const Page& page, size_t checkpoint, OpdsParser& parser, const bool& stop);
+  static void prefetchTask(void* param);
+};
@@ -1,12 +1,14 @@
 #include "FileBrowserActivity.h"
 
+#include <DirectoryIndex.h>
 #include <Epub.h>
 #include <FsHelpers.h>
 #include <GfxRenderer.h>
 #include <HalStorage.h>
 #include <I18n.h>
+#include <LibraryDb.h>
 
-#include <algorithm>
+#include <cstring>
 
 #include "../util/ConfirmationActivity.h"
 #include "CrossPointSettings.h"
@@ -16,93 +18,54 @@
 
 namespace {
 constexpr unsigned long GO_HOME_MS = 1000;
-}  // namespace
-
-void sortFileList(std::vector<std::string>& strs) {
-  std::sort(begin(strs), end(strs), [](const std::string& str1, const std::string& str2) {
-    // Directories first
-    bool isDir1 = str1.back() == '/';
-    bool isDir2 = str2.back() == '/';
-    if (isDir1 != isDir2) return isDir1;
-
-    // Start naive natural sort
-    const char* s1 = str1.c_str();
-    const char* s2 = str2.c_str();
-
-    // Iterate while both strings have characters
-    while (*s1 && *s2) {
-      // Check if both are at the start of a number
-      if (isdigit(*s1) && isdigit(*s2)) {
-        // Skip leading zeros and track them
-        const char* start1 = s1;
-        const char* start2 = s2;
-        while (*s1 == '0') s1++;
-        while (*s2 == '0') s2++;
-
-        // Count digits to compare lengths first
-        int len1 = 0, len2 = 0;
-        while (isdigit(s1[len1])) len1++;
-        while (isdigit(s2[len2])) len2++;
-
-        // Different length so return smaller integer value
-        if (len1 != len2) return len1 < len2;
-
-        // Same length so compare digit by digit
-        for (int i = 0; i < len1; i++) {
-          if (s1[i] != s2[i]) return s1[i] < s2[i];
-        }
-
-        // Numbers equal so advance pointers
-        s1 += len1;
-        s2 += len2;
-      } else {
-        // Regular case-insensitive character comparison
-        char c1 = tolower(*s1);
-        char c2 = tolower(*s2);
-        if (c1 != c2) return c1 < c2;
-        s1++;
-        s2++;
-      }
-    }
+// Entries kept in memory; more than a page of any theme holds
+constexpr size_t WINDOW_SIZE = 32;
+
+// Index filters, one per value of the "show hidden files" setting
+bool listedInBrowser(const char* name, const bool isDirectory) {
+  if (strcmp(name, "System Volume Information") == 0) return false;
+  if (isDirectory) return true;
+  const std::string_view filename{name};
+  return FsHelpers::hasEpubExtension(filename) || FsHelpers::hasXtcExtension(filename) ||
+         FsHelpers::hasTxtExtension(filename) || FsHelpers::hasMarkdownExtension(filename) ||
+         FsHelpers::hasBmpExtension(filename);
+}
+bool listedInBrowserUnlessHidden(const char* name, const bool isDirectory) {
+  return name[0] != '.' && listedInBrowser(name, isDirectory);
+}
 
-    // One string is prefix of other
-    return *s1 == '\0' && *s2 != '\0';
-  });
+DirectoryIndex::Filter browserFilter() {
+  // Ids 0 and 1 are the web listing's
+  if (SETTINGS.showHiddenFiles) {
+    return {3, listedInBrowser};
+  }
+  return {2, listedInBrowserUnlessHidden};
 }
+}  // namespace
 
 void FileBrowserActivity::loadFiles() {
-  files.clear();
-
-  auto root = Storage.open(basepath.c_str());
-  if (!root || !root.isDirectory()) {
-    if (root) root.close();
-    return;
+  RenderLock lock(*this);
+  window.clear();
+  windowStart = 0;
+  // Validated, so books copied over from a computer show up; after the first visit this costs no scan
+  if (!index.open(basepath, browserFilter(), true)) {
+    LOG_ERR("FileBrowser", "Failed to list %s", basepath.c_str());
   }
+}
 
-  root.rewindDirectory();
-
-  char name[500];
-  for (auto file = root.openNextFile(); file; file = root.openNextFile()) {
-    file.getName(name, sizeof(name));
-    if ((!SETTINGS.showHiddenFiles && name[0] == '.') || strcmp(name, "System Volume Information") == 0) {
-      file.close();
-      continue;
-    }
-
-    if (file.isDirectory()) {
-      files.emplace_back(std::string(name) + "/");
-    } else {
-      std::string_view filename{name};
-      if (FsHelpers::hasEpubExtension(filename) || FsHelpers::hasXtcExtension(filename) ||
-          FsHelpers::hasTxtExtension(filename) || FsHelpers::hasMarkdownExtension(filename) ||
-          FsHelpers::hasBmpExtension(filename)) {
-        files.emplace_back(filename);
-      }
+const std::string& FileBrowserActivity::entryAt(const size_t position) {
+  if (position < windowStart || position >= windowStart + window.size()) {
+    window.clear();
+    windowStart = position / WINDOW_SIZE * WINDOW_SIZE;
+    index.read(DirectoryIndex::SortKey::Name, false, windowStart, WINDOW_SIZE, [this](const DirectoryIndex::Entry& e) {
+      window.push_back(e.isDirectory ? e.name + "/" : e.name);
+    });
+    if (position >= windowStart + window.size()) {
+      static const std::string missing;
+      return missing;
     }
-    file.close();
   }
-  root.close();
-  sortFileList(files);
+  return window[position - windowStart];
 }
 
 void FileBrowserActivity::onEnter() {
@@ -116,7 +79,8 @@ void FileBrowserActivity::onEnter() {
 
 void FileBrowserActivity::onExit() {
   Activity::onExit();
-  files.clear();
+  index.close();
+  window.clear();
 }
 
 void FileBrowserActivity::clearFileMetadata(const std::string& fullPath) {
@@ -125,6 +89,7 @@ void FileBrowserActivity::clearFileMetadata(const std::string& fullPath) {
     Epub(fullPath, "/.crosspoint").clearCache();
     LOG_DBG("FileBrowser", "Cleared metadata cache for: %s", fullPath.c_str());
   }
+  LibraryDb::remove(fullPath);
 }
 
 void FileBrowserActivity::loop() {
@@ -140,9 +105,14 @@ void FileBrowserActivity::loop() {
   const int pageItems = UITheme::getInstance().getNumberOfItemsPerPage(renderer, true, false, true, false);
 
   if (mappedInput.wasReleased(MappedInputManager::Button::Confirm)) {
-    if (files.empty()) return;
+    if (index.size() == 0) return;
 
-    const std::string& entry = files[selectorIndex];
+    std::string entry;
+    {
+      RenderLock lock(*this);
+      entry = entryAt(selectorIndex);
+    }
+    if (entry.empty()) return;
     bool isDirectory = (entry.back() == '/');
 
     if (mappedInput.getHeldTime() >= GO_HOME_MS && !isDirectory) {
@@ -156,13 +126,14 @@ void FileBrowserActivity::loop() {
           LOG_DBG("FileBrowser", "Attempting to delete: %s", fullPath.c_str());
           clearFileMetadata(fullPath);
           if (Storage.remove(fullPath.c_str())) {
+            DirectoryIndex::invalidateParent(fullPath);
             LOG_DBG("FileBrowser", "Deleted successfully");
             loadFiles();
-            if (files.empty()) {
+            if (index.size() == 0) {
               selectorIndex = 0;
-            } else if (selectorIndex >= files.size()) {
+            } else if (selectorIndex >= index.size()) {
               // Move selection to the new "last" item
-              selectorIndex = files.size() - 1;
+              selectorIndex = index.size() - 1;
             }
 
             requestUpdate(true);
@@ -206,7 +177,10 @@ void FileBrowserActivity::loop() {
 
         const auto pos = oldPath.find_last_of('/');
         const std::string dirName = oldPath.substr(pos + 1) + "/";
-        selectorIndex = findEntry(dirName);
+        {
+          RenderLock lock(*this);
+          selectorIndex = findEntry(dirName);
+        }
 
         requestUpdate();
       } else {
@@ -215,7 +189,7 @@ void FileBrowserActivity::loop() {
     }
   }
 
-  int listSize = static_cast<int>(files.size());
+  int listSize = static_cast<int>(index.size());
   buttonNavigator.onNextRelease([this, listSize] {
     selectorIndex = ButtonNavigator::nextIndex(static_cast<int>(selectorIndex), listSize);
     requestUpdate();
@@ -257,26 +231,27 @@ void FileBrowserActivity::render(RenderLock&&) {
 
   const int contentTop = metrics.topPadding + metrics.headerHeight + metrics.verticalSpacing;
   const int contentHeight = pageHeight - contentTop - metrics.buttonHintsHeight - metrics.verticalSpacing;
-  if (files.empty()) {
+  const bool empty = index.size() == 0;
+  if (empty) {
     renderer.drawText(UI_10_FONT_ID, metrics.contentSidePadding, contentTop + 20, tr(STR_NO_FILES_FOUND));
   } else {
     GUI.drawList(
-        renderer, Rect{0, contentTop, pageWidth, contentHeight}, files.size(), selectorIndex,
-        [this](int index) { return getFileName(files[index]); }, nullptr,
-        [this](int index) { return UITheme::getFileIcon(files[index]); });
+        renderer, Rect{0, contentTop, pageWidth, contentHeight}, index.size(), selectorIndex,
+        [this](int position) { return getFileName(entryAt(position)); }, nullptr,
+        [this](int position) { return UITheme::getFileIcon(entryAt(position)); });
   }
 
   // Help text
   const auto labels =
-      mappedInput.mapLabels(basepath == "/" ? tr(STR_HOME) : tr(STR_BACK), files.empty() ? "" : tr(STR_OPEN),
-                            files.empty() ? "" : tr(STR_DIR_UP), files.empty() ? "" : tr(STR_DIR_DOWN));
+      mappedInput.mapLabels(basepath == "/" ? tr(STR_HOME) : tr(STR_BACK), empty ? "" : tr(STR_OPEN),
+                            empty ? "" : tr(STR_DIR_UP), empty ? "" : tr(STR_DIR_DOWN));
   GUI.drawButtonHints(renderer, labels.btn1, labels.btn2, labels.btn3, labels.btn4);
 
   renderer.displayBuffer();
 }
 
-size_t FileBrowserActivity::findEntry(const std::string& name) const {
-  for (size_t i = 0; i < files.size(); i++)
-    if (files[i] == name) return i;
-  return 0;
+size_t FileBrowserActivity::findEntry(const std::string& name) {
+  const bool isDirectory = !name.empty() && name.back() == '/';
+  const uint32_t position = index.find(isDirectory ? name.substr(0, name.size() - 1) : name, isDirectory);
+  return position < index.size() ? position : 0;
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <DirectoryIndex.h>
+
 #include <functional>
 #include <string>
 #include <vector>
@@ -17,13 +19,17 @@ class FileBrowserActivity final : public Activity {
 
   size_t selectorIndex = 0;
 
-  // Files state
+  // Files state: the folder's index, and the names of the entries around the selection read from it on demand.
+  // Folder names end in '/'.
   std::string basepath = "/";
-  std::vector<std::string> files;
+  DirectoryIndex index;
+  std::vector<std::string> window;
+  size_t windowStart = 0;
 
   // Data loading
   void loadFiles();
-  size_t findEntry(const std::string& name) const;
+  const std::string& entryAt(size_t position);
+  size_t findEntry(const std::string& name);
 
  public:
   explicit FileBrowserActivity(GfxRenderer& renderer, MappedInputManager& mappedInput, std::string initialPath = "/")
@@ -242,30 +242,41 @@ void CrossPointWebServerActivity::startWebServer() {
 
   // Create the web server instance
   webServer.reset(new CrossPointWebServer());
+  preIndexer.reset(new BookPreIndexer(renderer));
+  webServer->setPreIndexer(preIndexer.get());
   webServer->begin();
 
   if (webServer->isRunning()) {
     state = WebServerActivityState::SERVER_RUNNING;
     LOG_DBG("WEBACT", "Web server started successfully");
 
+    // Prepare uploaded books while the server is idle, including jobs left over from the last session
+    preIndexer->start();
+
     // Force an immediate render since we're transitioning from a subactivity
     // that had its own rendering task. We need to make sure our display is shown.
     requestUpdate();
   } else {
     LOG_ERR("WEBACT", "ERROR: Failed to start web server!");
     webServer.reset();
+    preIndexer.reset();
     // Go back on error
     onGoHome();
   }
 }
 
 void CrossPointWebServerActivity::stopWebServer() {
+  // Leaving the screen cancels pre-indexing; unfinished jobs stay queued for the next session
+  if (preIndexer) {
+    preIndexer->stop();
+  }
   if (webServer && webServer->isRunning()) {
     LOG_DBG("WEBACT", "Stopping web server...");
     webServer->stop();
     LOG_DBG("WEBACT", "Web server stopped");
   }
   webServer.reset();
+  preIndexer.reset();
 }
 
 void CrossPointWebServerActivity::loop() {
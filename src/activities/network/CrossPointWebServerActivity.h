@@ -6,6 +6,7 @@
 
 #include "NetworkModeSelectionActivity.h"
 #include "activities/Activity.h"
+#include "network/BookPreIndexer.h"
 #include "network/CrossPointWebServer.h"
 
 // Web server activity states
@@ -34,6 +35,9 @@ class CrossPointWebServerActivity final : public Activity {
   NetworkMode networkMode = NetworkMode::JOIN_NETWORK;
   bool isApMode = false;
 
+  // Prepares uploaded books in the background; declared first so it outlives webServer, which refers to it
+  std::unique_ptr<BookPreIndexer> preIndexer;
+
   // Web server - owned by this activity
   std::unique_ptr<CrossPointWebServer> webServer;
 
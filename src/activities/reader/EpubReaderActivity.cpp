@@ -7,27 +7,37 @@
 #include <GfxRenderer.h>
 #include <HalStorage.h>
 #include <I18n.h>
+#include <LibraryDb.h>
 #include <Logging.h>
 #include <esp_system.h>
 
+#include <algorithm>
+
 #include "CrossPointSettings.h"
 #include "CrossPointState.h"
 #include "EpubReaderChapterSelectionActivity.h"
 #include "EpubReaderFootnotesActivity.h"
 #include "EpubReaderPercentSelectionActivity.h"
+#include "EpubReaderSearchActivity.h"
+#include "EpubReaderWordSelectActivity.h"
 #include "KOReaderCredentialStore.h"
+#include "KOReaderDocumentIdCache.h"
 #include "KOReaderSyncActivity.h"
 #include "MappedInputManager.h"
 #include "QrDisplayActivity.h"
 #include "ReaderUtils.h"
 #include "RecentBooksStore.h"
+#include "ResumeSnapshot.h"
 #include "components/UITheme.h"
 #include "fontIds.h"
+#include "util/BootProfiler.h"
 #include "util/ScreenshotUtil.h"
 
 namespace {
 // pagesPerRefresh now comes from SETTINGS.getRefreshFrequency()
 constexpr unsigned long skipChapterMs = 700;
+// Time loop() spends laying out the rest of a partial chapter per call
+constexpr unsigned long layoutSliceMs = 40;
 // pages per minute, first item is 1 to prevent division by zero if accessed
 const std::vector<int> PAGE_TURN_LABELS = {1, 1, 3, 6, 12};
 
@@ -81,10 +91,9 @@ void EpubReaderActivity::onEnter() {
     }
   }
 
-  // Save current epub as last opened epub and add to recent books
+  // Save current epub as last opened epub; it goes into the recent books after the first page is shown, see loop()
   APP_STATE.openEpubPath = epub->getPath();
   APP_STATE.saveToFile();
-  RECENT_BOOKS.addBook(epub->getPath(), epub->getTitle(), epub->getAuthor(), epub->getThumbBmpPath());
 
   // Trigger first update
   requestUpdate();
@@ -98,6 +107,15 @@ void EpubReaderActivity::onExit() {
 
   APP_STATE.readerActivityLoadCount = 0;
   APP_STATE.saveToFile();
+  if (epub && !bookOpenRecorded) {
+    recordBookOpened();
+  }
+  if (epub && section && section->pageCount > 0 && epub->getBookSize() > 0) {
+    const float chapterProgress =
+        static_cast<float>(section->currentPage) / static_cast<float>(section->estimatedPageCount());
+    const float bookProgress = epub->calculateProgress(currentSpineIndex, chapterProgress) * 100.0f;
+    LibraryDb::setProgress(epub->getPath(), clampPercent(static_cast<int>(bookProgress + 0.5f)));
+  }
   section.reset();
   epub.reset();
 }
@@ -109,6 +127,32 @@ void EpubReaderActivity::loop() {
     return;
   }
 
+  if (!bookOpenRecorded && firstRenderStarted && !RenderLock::peek()) {
+    RenderLock lock(*this);
+    recordBookOpened();
+  }
+  continueLayout();
+
+  // Any button closes the footnote popup; Confirm goes on to the note itself
+  if (!footnotePreview.text.empty()) {
+    const bool openNote = mappedInput.wasReleased(MappedInputManager::Button::Confirm);
+    const auto [prevTriggered, nextTriggered] = ReaderUtils::detectPageTurn(mappedInput);
+    if (openNote || mappedInput.wasReleased(MappedInputManager::Button::Back) || prevTriggered || nextTriggered) {
+      std::string href;
+      {
+        RenderLock lock(*this);
+        href = std::move(footnotePreview.href);
+        footnotePreview = {};
+      }
+      if (openNote) {
+        navigateToHref(href, true);
+      } else {
+        requestUpdate();
+      }
+    }
+    return;
+  }
+
   if (automaticPageTurnActive) {
     if (mappedInput.wasReleased(MappedInputManager::Button::Confirm) ||
         mappedInput.wasReleased(MappedInputManager::Button::Back)) {
@@ -138,10 +182,11 @@ void EpubReaderActivity::loop() {
   // Enter reader menu activity.
   if (mappedInput.wasReleased(MappedInputManager::Button::Confirm)) {
     const int currentPage = section ? section->currentPage + 1 : 0;
-    const int totalPages = section ? section->pageCount : 0;
+    const int totalPages = section ? section->estimatedPageCount() : 0;
     float bookProgress = 0.0f;
     if (epub->getBookSize() > 0 && section && section->pageCount > 0) {
-      const float chapterProgress = static_cast<float>(section->currentPage) / static_cast<float>(section->pageCount);
+      const float chapterProgress =
+          static_cast<float>(section->currentPage) / static_cast<float>(section->estimatedPageCount());
       bookProgress = epub->calculateProgress(currentSpineIndex, chapterProgress) * 100.0f;
     }
     const int bookProgressPercent = clampPercent(static_cast<int>(bookProgress + 0.5f));
@@ -217,6 +262,40 @@ void EpubReaderActivity::loop() {
   }
 }
 
+void EpubReaderActivity::recordBookOpened() {
+  bookOpenRecorded = true;
+  LibraryDb::Book book;
+  book.path = epub->getPath();
+  book.title = epub->getTitle();
+  book.author = epub->getAuthor();
+  book.series = epub->getSeries();
+  book.language = epub->getLanguage();
+  book.coverBmpPath = epub->getCoverBmpPath();
+  book.thumbBmpPath = epub->getThumbBmpPath();
+  RECENT_BOOKS.addBook(book);
+  // Have the KOReader document ID ready so a sync doesn't have to read the book
+  if (KOREADER_STORE.hasCredentials()) {
+    KOReaderDocumentIdCache::get(epub->getPath());
+  }
+}
+
+void EpubReaderActivity::continueLayout() {
+  // Never holds up a page being drawn
+  if (!section || !section->isPartial() || RenderLock::peek()) {
+    return;
+  }
+  // A slice at a time, so a button press waits at most one slice
+  RenderLock lock(*this);
+  const auto start = millis();
+  if (!section->continueSectionFile([start] { return millis() - start >= layoutSliceMs; })) {
+    LOG_ERR("ERS", "Failed to lay out the rest of section %d", currentSpineIndex);
+    section.reset();
+    requestUpdate();
+  } else if (!section->isPartial()) {
+    LOG_DBG("ERS", "Laid out the rest of section %d: %d pages", currentSpineIndex, section->pageCount);
+  }
+}
+
 // Translate an absolute percent into a spine index plus a normalized position
 // within that spine so we can jump after the section is loaded.
 void EpubReaderActivity::jumpToPercent(int percent) {
@@ -297,12 +376,45 @@ void EpubReaderActivity::onReaderMenuConfirm(EpubReaderMenuActivity::MenuAction
           });
       break;
     }
+    case EpubReaderMenuActivity::MenuAction::SEARCH: {
+      const auto margins = ReaderUtils::epubPageMargins(renderer.getOrientation(), automaticPageTurnActive);
+      const uint16_t viewportWidth = renderer.getScreenWidth() - margins.left - margins.right;
+      const uint16_t viewportHeight = renderer.getScreenHeight() - margins.top - margins.bottom;
+      startActivityForResult(
+          std::make_unique<EpubReaderSearchActivity>(renderer, mappedInput, epub, viewportWidth, viewportHeight),
+          [this](const ActivityResult& result) {
+            if (!result.isCancelled) {
+              const auto& search = std::get<SearchResult>(result.data);
+              RenderLock lock(*this);
+              currentSpineIndex = search.spineIndex;
+              nextPageNumber = 0;
+              pendingCharOffset = search.charOffset;
+              section.reset();
+            }
+          });
+      break;
+    }
+    case EpubReaderMenuActivity::MenuAction::LOOKUP_WORD: {
+      if (section && section->currentPage >= 0 && section->currentPage < section->pageCount) {
+        if (auto p = section->loadPageFromSectionFile()) {
+          const auto margins = ReaderUtils::epubPageMargins(renderer.getOrientation(), automaticPageTurnActive);
+          startActivityForResult(
+              std::make_unique<EpubReaderWordSelectActivity>(renderer, mappedInput, std::move(p),
+                                                             SETTINGS.getReaderFontId(), margins.left, margins.top,
+                                                             epub->getLanguage()),
+              [this](const ActivityResult&) { requestUpdate(); });
+          break;
+        }
+      }
+      requestUpdate();
+      break;
+    }
     case EpubReaderMenuActivity::MenuAction::FOOTNOTES: {
       startActivityForResult(std::make_unique<EpubReaderFootnotesActivity>(renderer, mappedInput, currentPageFootnotes),
                              [this](const ActivityResult& result) {
                                if (!result.isCancelled) {
                                  const auto& footnoteResult = std::get<FootnoteResult>(result.data);
-                                 navigateToHref(footnoteResult.href, true);
+                                 openFootnote(footnoteResult.href);
                                }
                                requestUpdate();
                              });
@@ -311,7 +423,8 @@ void EpubReaderActivity::onReaderMenuConfirm(EpubReaderMenuActivity::MenuAction
     case EpubReaderMenuActivity::MenuAction::GO_TO_PERCENT: {
       float bookProgress = 0.0f;
       if (epub && epub->getBookSize() > 0 && section && section->pageCount > 0) {
-        const float chapterProgress = static_cast<float>(section->currentPage) / static_cast<float>(section->pageCount);
+        const float chapterProgress =
+            static_cast<float>(section->currentPage) / static_cast<float>(section->estimatedPageCount());
         bookProgress = epub->calculateProgress(currentSpineIndex, chapterProgress) * 100.0f;
       }
       const int initialPercent = clampPercent(static_cast<int>(bookProgress + 0.5f));
@@ -362,7 +475,7 @@ void EpubReaderActivity::onReaderMenuConfirm(EpubReaderMenuActivity::MenuAction
         if (epub && section) {
           uint16_t backupSpine = currentSpineIndex;
           uint16_t backupPage = section->currentPage;
-          uint16_t backupPageCount = section->pageCount;
+          uint16_t backupPageCount = section->estimatedPageCount();
           section.reset();
           epub->clearCache();
           epub->setupCacheDir();
@@ -383,7 +496,7 @@ void EpubReaderActivity::onReaderMenuConfirm(EpubReaderMenuActivity::MenuAction
     case EpubReaderMenuActivity::MenuAction::SYNC: {
       if (KOREADER_STORE.hasCredentials()) {
         const int currentPage = section ? section->currentPage : 0;
-        const int totalPages = section ? section->pageCount : 0;
+        const int totalPages = section ? section->estimatedPageCount() : 0;
         startActivityForResult(
             std::make_unique<KOReaderSyncActivity>(renderer, mappedInput, epub, epub->getPath(), currentSpineIndex,
                                                    currentPage, totalPages),
@@ -415,7 +528,7 @@ void EpubReaderActivity::applyOrientation(const uint8_t orientation) {
     RenderLock lock(*this);
     if (section) {
       cachedSpineIndex = currentSpineIndex;
-      cachedChapterTotalPageCount = section->pageCount;
+      cachedChapterTotalPageCount = section->estimatedPageCount();
       nextPageNumber = section->currentPage;
     }
 
@@ -449,7 +562,7 @@ void EpubReaderActivity::toggleAutoPageTurn(const uint8_t selectedPageTurnOption
     RenderLock lock(*this);
     if (section) {
       cachedSpineIndex = currentSpineIndex;
-      cachedChapterTotalPageCount = section->pageCount;
+      cachedChapterTotalPageCount = section->estimatedPageCount();
       nextPageNumber = section->currentPage;
     }
     section.reset();
@@ -458,6 +571,17 @@ void EpubReaderActivity::toggleAutoPageTurn(const uint8_t selectedPageTurnOption
 
 void EpubReaderActivity::pageTurn(bool isForwardTurn) {
   if (isForwardTurn) {
+    if (section->isPartial() && section->currentPage >= section->pageCount - 1) {
+      // Caught up with the layout: lay out the next page now
+      RenderLock lock(*this);
+      const int nextPage = section->currentPage + 1;
+      if (!section->continueSectionFile([this, nextPage] { return section->pageCount > nextPage; })) {
+        LOG_ERR("ERS", "Failed to lay out the rest of section %d", currentSpineIndex);
+        section.reset();
+        requestUpdate();
+        return;
+      }
+    }
     if (section->currentPage < section->pageCount - 1) {
       section->currentPage++;
     } else {
@@ -491,6 +615,7 @@ void EpubReaderActivity::render(RenderLock&& lock) {
   if (!epub) {
     return;
   }
+  firstRenderStarted = true;
 
   // edge case handling for sub-zero spine index
   if (currentSpineIndex < 0) {
@@ -511,26 +636,14 @@ void EpubReaderActivity::render(RenderLock&& lock) {
   }
 
   // Apply screen viewable areas and additional padding
-  int orientedMarginTop, orientedMarginRight, orientedMarginBottom, orientedMarginLeft;
-  renderer.getOrientedViewableTRBL(&orientedMarginTop, &orientedMarginRight, &orientedMarginBottom,
-                                   &orientedMarginLeft);
-  orientedMarginTop += SETTINGS.screenMargin;
-  orientedMarginLeft += SETTINGS.screenMargin;
-  orientedMarginRight += SETTINGS.screenMargin;
-
-  const uint8_t statusBarHeight = UITheme::getInstance().getStatusBarHeight();
-
-  // reserves space for automatic page turn indicator when no status bar or progress bar only
-  if (automaticPageTurnActive &&
-      (statusBarHeight == 0 || statusBarHeight == UITheme::getInstance().getProgressBarHeight())) {
-    orientedMarginBottom +=
-        std::max(SETTINGS.screenMargin,
-                 static_cast<uint8_t>(statusBarHeight + UITheme::getInstance().getMetrics().statusBarVerticalMargin));
-  } else {
-    orientedMarginBottom += std::max(SETTINGS.screenMargin, statusBarHeight);
-  }
+  const auto margins = ReaderUtils::epubPageMargins(renderer.getOrientation(), automaticPageTurnActive);
+  const int orientedMarginTop = margins.top;
+  const int orientedMarginRight = margins.right;
+  const int orientedMarginBottom = margins.bottom;
+  const int orientedMarginLeft = margins.left;
 
   if (!section) {
+    int percentJumpPage = -1;
     const auto filepath = epub->getSpineItem(currentSpineIndex).href;
     LOG_DBG("ERS", "Loading file: %s, index: %d", filepath.c_str(), currentSpineIndex);
     section = std::unique_ptr<Section>(new Section(epub, currentSpineIndex, renderer));
@@ -546,14 +659,37 @@ void EpubReaderActivity::render(RenderLock&& lock) {
 
       const auto popupFn = [this]() { GUI.drawPopup(renderer, tr(STR_INDEXING)); };
 
-      if (!section->createSectionFile(SETTINGS.getReaderFontId(), SETTINGS.getReaderLineCompression(),
-                                      SETTINGS.extraParagraphSpacing, SETTINGS.paragraphAlignment, viewportWidth,
-                                      viewportHeight, SETTINGS.hyphenationEnabled, SETTINGS.embeddedStyle,
-                                      SETTINGS.imageRendering, popupFn)) {
+      // Only the chapter up to the page about to be shown is laid out here; loop() lays out the rest. Going to the
+      // last page, a search hit or a position kept across a layout change needs the whole chapter.
+      std::function<bool()> stop;
+      const bool wholeChapter = nextPageNumber == UINT16_MAX || pendingCharOffset != UINT32_MAX ||
+                                (cachedChapterTotalPageCount > 0 && currentSpineIndex == cachedSpineIndex);
+      if (!wholeChapter && !pendingAnchor.empty()) {
+        stop = [this] { return section->getPageForAnchor(pendingAnchor).has_value(); };
+      } else if (!wholeChapter && pendingPercentJump) {
+        // The jump's byte is on the page being laid out when the parser reaches it
+        stop = [this, &percentJumpPage] {
+          if (percentJumpPage < 0 && section->layoutProgress() >= pendingSpineProgress) {
+            percentJumpPage = section->pageCount;
+          }
+          return percentJumpPage >= 0 && section->pageCount > percentJumpPage;
+        };
+      } else if (!wholeChapter) {
+        stop = [this] { return section->pageCount > nextPageNumber; };
+      }
+
+      const auto start = millis();
+      if (!section->beginSectionFile(SETTINGS.getReaderFontId(), SETTINGS.getReaderLineCompression(),
+                                     SETTINGS.extraParagraphSpacing, SETTINGS.paragraphAlignment, viewportWidth,
+                                     viewportHeight, SETTINGS.hyphenationEnabled, SETTINGS.embeddedStyle,
+                                     SETTINGS.imageRendering, popupFn) ||
+          !section->continueSectionFile(stop)) {
         LOG_ERR("ERS", "Failed to persist page data to SD");
         section.reset();
         return;
       }
+      LOG_DBG("ERS", "Laid out %d pages (%s) in %lums", section->pageCount,
+              section->isPartial() ? "partial" : "complete", millis() - start);
     } else {
       LOG_DBG("ERS", "Cache found, skipping build...");
     }
@@ -574,6 +710,15 @@ void EpubReaderActivity::render(RenderLock&& lock) {
       pendingAnchor.clear();
     }
 
+    if (pendingCharOffset != UINT32_MAX) {
+      if (const auto page = section->getPageForOffset(pendingCharOffset)) {
+        section->currentPage = *page;
+      } else {
+        LOG_DBG("ERS", "No page for offset %u in section %d", pendingCharOffset, currentSpineIndex);
+      }
+      pendingCharOffset = UINT32_MAX;
+    }
+
     // handles changes in reader settings and reset to approximate position based on cached progress
     if (cachedChapterTotalPageCount > 0) {
       // only goes to relative position if spine index matches cached value
@@ -585,9 +730,15 @@ void EpubReaderActivity::render(RenderLock&& lock) {
       cachedChapterTotalPageCount = 0;  // resets to 0 to prevent reading cached progress again
     }
 
+    BootProfiler::mark("section ready");
+
     if (pendingPercentJump && section->pageCount > 0) {
-      // Apply the pending percent jump now that we know the new section's page count.
+      // Apply the pending percent jump now that we know the new section's page count, or the page laid out when the
+      // layout reached the jump's position.
       int newPage = static_cast<int>(pendingSpineProgress * static_cast<float>(section->pageCount));
+      if (percentJumpPage >= 0) {
+        newPage = percentJumpPage;
+      }
       if (newPage >= section->pageCount) {
         newPage = section->pageCount - 1;
       }
@@ -631,11 +782,21 @@ void EpubReaderActivity::render(RenderLock&& lock) {
     // Collect footnotes from the loaded page
     currentPageFootnotes = std::move(p->footnotes);
 
+    if (!footnotePreview.text.empty()) {
+      // The popup goes over the page as it is on screen, so a fast refresh only redraws the box
+      p->render(renderer, SETTINGS.getReaderFontId(), orientedMarginLeft, orientedMarginTop);
+      renderStatusBar();
+      renderFootnotePreview(orientedMarginTop, orientedMarginBottom);
+      renderer.displayBuffer(HalDisplay::FAST_REFRESH);
+      return;
+    }
+
     const auto start = millis();
     renderContents(std::move(p), orientedMarginTop, orientedMarginRight, orientedMarginBottom, orientedMarginLeft);
     LOG_DBG("ERS", "Rendered page in %dms", millis() - start);
   }
-  saveProgress(currentSpineIndex, section->currentPage, section->pageCount);
+  // A partial chapter's page count is not final, so none is saved to rescale the page by on the next load
+  saveProgress(currentSpineIndex, section->currentPage, section->isPartial() ? 0 : section->pageCount);
 
   if (pendingScreenshot) {
     pendingScreenshot = false;
@@ -687,7 +848,10 @@ void EpubReaderActivity::renderContents(std::unique_ptr<Page> page, const int or
   fcm->logStats("bw_render");
   const auto tBwRender = millis();
 
-  if (imagePageWithAA) {
+  if (ResumeSnapshot::isOnScreen(renderer)) {
+    // Woken into this very page: the snapshot shown at boot already put it on screen, only gray levels are missing
+    LOG_DBG("ERS", "Page already on screen from resume snapshot");
+  } else if (imagePageWithAA) {
     // Double FAST_REFRESH with selective image blanking (pablohc's technique):
     // HALF_REFRESH sets particles too firmly for the grayscale LUT to adjust.
     // Instead, blank only the image area and do two fast refreshes.
@@ -712,7 +876,7 @@ void EpubReaderActivity::renderContents(std::unique_ptr<Page> page, const int or
   const auto tDisplay = millis();
 
   // Save bw buffer to reset buffer state after grayscale data sync
-  renderer.storeBwBuffer();
+  const bool bwStored = renderer.storeBwBuffer();
   const auto tBwStore = millis();
 
   // grayscale rendering
@@ -758,12 +922,17 @@ void EpubReaderActivity::renderContents(std::unique_ptr<Page> page, const int or
             tPrewarm - t0, tBwRender - tPrewarm, tDisplay - tBwRender, tBwStore - tDisplay, tBwRestore - tBwStore,
             tEnd - t0);
   }
+
+  // Without the stored copy the grayscale pass leaves its MSB plane in the frame buffer
+  if (bwStored || !SETTINGS.textAntiAliasing) {
+    ResumeSnapshot::pageShown(renderer, epub->getPath());
+  }
 }
 
 void EpubReaderActivity::renderStatusBar() const {
   // Calculate progress in book
   const int currentPage = section->currentPage + 1;
-  const float pageCount = section->pageCount;
+  const float pageCount = section->estimatedPageCount();
   const float sectionChapterProg = (pageCount > 0) ? (static_cast<float>(currentPage) / pageCount) : 0;
   const float bookProgress = epub->calculateProgress(currentSpineIndex, sectionChapterProg) * 100;
 
@@ -797,6 +966,33 @@ void EpubReaderActivity::renderStatusBar() const {
   GUI.drawStatusBar(renderer, bookProgress, currentPage, pageCount, title, 0, textYOffset);
 }
 
+void EpubReaderActivity::openFootnote(const std::string& href) {
+  const std::string text = section ? section->getFootnoteText(href) : "";
+  if (text.empty()) {
+    // Not resolved while indexing (an unusual note layout, an external link, or a chapter whose layout is not
+    // complete yet): show the target in full
+    navigateToHref(href, true);
+    return;
+  }
+
+  RenderLock lock(*this);
+  const auto entry = std::find_if(currentPageFootnotes.begin(), currentPageFootnotes.end(),
+                                  [&href](const FootnoteEntry& footnote) { return href == footnote.href; });
+  footnotePreview = {entry != currentPageFootnotes.end() ? entry->number : "", href, text};
+}
+
+void EpubReaderActivity::renderFootnotePreview(const int orientedMarginTop, const int orientedMarginBottom) const {
+  // Notes sit at the foot of a page, so the sheet grows up from the bottom margin and leaves the page's top visible
+  const int bottom = renderer.getScreenHeight() - std::max(orientedMarginBottom,
+                                                            UITheme::getInstance().getMetrics().buttonHintsHeight);
+  const char* title = footnotePreview.number.empty() ? tr(STR_FOOTNOTES) : footnotePreview.number.c_str();
+  GUI.drawTextSheet(renderer, bottom, true, (bottom - orientedMarginTop) * 2 / 3, title, nullptr,
+                    footnotePreview.text);
+
+  const auto labels = mappedInput.mapLabels(tr(STR_BACK), tr(STR_OPEN_NOTE), "", "");
+  GUI.drawButtonHints(renderer, labels.btn1, labels.btn2, labels.btn3, labels.btn4);
+}
+
 void EpubReaderActivity::navigateToHref(const std::string& hrefStr, const bool savePosition) {
   if (!epub) return;
 
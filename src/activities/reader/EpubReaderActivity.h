@@ -14,6 +14,8 @@ class EpubReaderActivity final : public Activity {
   // Set when navigating to a footnote href with a fragment (e.g. #note1).
   // Cleared on the next render after the new section loads and resolves it to a page.
   std::string pendingAnchor;
+  // Set when jumping to a search hit; the character offset is resolved to a page once the section loads.
+  uint32_t pendingCharOffset = UINT32_MAX;
   int pagesUntilFullRefresh = 0;
   int cachedSpineIndex = 0;
   int cachedChapterTotalPageCount = 0;
@@ -27,6 +29,9 @@ class EpubReaderActivity final : public Activity {
   bool pendingScreenshot = false;
   bool skipNextButtonCheck = false;  // Skip button processing for one frame after subactivity exit
   bool automaticPageTurnActive = false;
+  // Opening the book is recorded in the library once the first render has the page on screen
+  bool firstRenderStarted = false;
+  bool bookOpenRecorded = false;
 
   // Footnote support
   std::vector<FootnoteEntry> currentPageFootnotes;
@@ -37,10 +42,18 @@ class EpubReaderActivity final : public Activity {
   static constexpr int MAX_FOOTNOTE_DEPTH = 3;
   SavedPosition savedPositions[MAX_FOOTNOTE_DEPTH] = {};
   int footnoteDepth = 0;
+  // Footnote shown in a popup over the current page; no popup while text is empty
+  struct FootnotePreview {
+    std::string number;
+    std::string href;
+    std::string text;
+  };
+  FootnotePreview footnotePreview;
 
   void renderContents(std::unique_ptr<Page> page, int orientedMarginTop, int orientedMarginRight,
                       int orientedMarginBottom, int orientedMarginLeft);
   void renderStatusBar() const;
+  void renderFootnotePreview(int orientedMarginTop, int orientedMarginBottom) const;
   void saveProgress(int spineIndex, int currentPage, int pageCount);
   // Jump to a percentage of the book (0-100), mapping it to spine and page.
   void jumpToPercent(int percent);
@@ -48,8 +61,13 @@ class EpubReaderActivity final : public Activity {
   void applyOrientation(uint8_t orientation);
   void toggleAutoPageTurn(uint8_t selectedPageTurnOption);
   void pageTurn(bool isForwardTurn);
+  // Adds the book to the recent books and prepares its KOReader document ID
+  void recordBookOpened();
+  // Lays out more of a chapter opened before its layout was complete, see Section::beginSectionFile()
+  void continueLayout();
 
   // Footnote navigation
+  void openFootnote(const std::string& href);
   void navigateToHref(const std::string& href, bool savePosition = false);
   void restoreSavedPosition();
 
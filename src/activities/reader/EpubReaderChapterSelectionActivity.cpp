@@ -2,12 +2,25 @@
 
 #include <GfxRenderer.h>
 #include <I18n.h>
+#include <Logging.h>
+#include <Utf8.h>
 
 #include "MappedInputManager.h"
+#include "activities/util/KeyboardEntryActivity.h"
 #include "components/UITheme.h"
 #include "fontIds.h"
 
-int EpubReaderChapterSelectionActivity::getTotalItems() const { return epub->getTocItemsCount(); }
+namespace {
+constexpr unsigned long SEARCH_HOLD_MS = 700;
+constexpr size_t MAX_MATCHES = 200;
+}  // namespace
+
+int EpubReaderChapterSelectionActivity::getTotalItems() const {
+  if (!matches.empty()) {
+    return static_cast<int>(matches.size());
+  }
+  return toc ? toc->size() : 0;
+}
 
 int EpubReaderChapterSelectionActivity::getPageItems() const {
   // Layout constants used in renderScreen
@@ -32,6 +45,7 @@ void EpubReaderChapterSelectionActivity::onEnter() {
     return;
   }
 
+  toc = epub->createTocView();
   selectorIndex = epub->getTocIndexForSpineIndex(currentSpineIndex);
   if (selectorIndex == -1) {
     selectorIndex = 0;
@@ -41,47 +55,124 @@ void EpubReaderChapterSelectionActivity::onEnter() {
   requestUpdate();
 }
 
-void EpubReaderChapterSelectionActivity::onExit() { Activity::onExit(); }
+void EpubReaderChapterSelectionActivity::onExit() {
+  Activity::onExit();
+  matches.clear();
+  toc.reset();
+}
+
+void EpubReaderChapterSelectionActivity::askQuery() {
+  startActivityForResult(
+      std::make_unique<KeyboardEntryActivity>(renderer, mappedInput, tr(STR_SEARCH_TITLES), query, 64),
+      [this](const ActivityResult& result) {
+        if (!result.isCancelled && !std::get<KeyboardResult>(result.data).text.empty()) {
+          query = std::get<KeyboardResult>(result.data).text;
+          queryPending = true;
+        }
+      });
+}
+
+void EpubReaderChapterSelectionActivity::runQuery() {
+  if (!toc) {
+    return;
+  }
+
+  // The TOC view reads the book file that render() pages titles in from, so it is only used under the lock
+  RenderLock lock(*this);
+  const auto* rest = reinterpret_cast<const unsigned char*>(query.c_str());
+  utf8NextCodepoint(&rest);
+  if (*rest == '\0') {
+    // A single letter jumps through the list, which suits the alphabetical TOCs of dictionaries and anthologies
+    const int from = matches.empty() ? selectorIndex : matches[matchIndex].tocIndex;
+    const int found = toc->findInitial(query, from);
+    matches.clear();
+    noMatches = found < 0;
+    if (found >= 0) {
+      selectorIndex = found;
+    }
+    return;
+  }
+
+  GUI.drawPopup(renderer, tr(STR_LOADING_POPUP));
+  matches = toc->search(query, MAX_MATCHES);
+  matchIndex = 0;
+  noMatches = matches.empty();
+}
+
+void EpubReaderChapterSelectionActivity::select(const int tocIndex) {
+  const auto newSpineIndex = epub->getSpineIndexForTocIndex(tocIndex);
+  if (newSpineIndex == -1) {
+    ActivityResult result;
+    result.isCancelled = true;
+    setResult(std::move(result));
+    finish();
+  } else {
+    setResult(ChapterResult{newSpineIndex});
+    finish();
+  }
+}
 
 void EpubReaderChapterSelectionActivity::loop() {
+  if (queryPending) {
+    queryPending = false;
+    runQuery();
+    requestUpdate();
+    return;
+  }
+
   const int pageItems = getPageItems();
   const int totalItems = getTotalItems();
 
   if (mappedInput.wasReleased(MappedInputManager::Button::Confirm)) {
-    const auto newSpineIndex = epub->getSpineIndexForTocIndex(selectorIndex);
-    if (newSpineIndex == -1) {
-      ActivityResult result;
-      result.isCancelled = true;
-      setResult(std::move(result));
-      finish();
-    } else {
-      setResult(ChapterResult{newSpineIndex});
-      finish();
+    if (mappedInput.getHeldTime() >= SEARCH_HOLD_MS) {
+      askQuery();
+    } else if (!matches.empty()) {
+      select(matches[matchIndex].tocIndex);
+    } else if (totalItems > 0) {
+      select(selectorIndex);
     }
+    return;
   } else if (mappedInput.wasReleased(MappedInputManager::Button::Back)) {
+    if (!matches.empty() || noMatches) {
+      // Back from the search to the whole list, at the title that was chosen there
+      RenderLock lock(*this);
+      if (!matches.empty()) {
+        selectorIndex = matches[matchIndex].tocIndex;
+      }
+      matches.clear();
+      noMatches = false;
+      requestUpdate();
+      return;
+    }
     ActivityResult result;
     result.isCancelled = true;
     setResult(std::move(result));
     finish();
   }
 
-  buttonNavigator.onNextRelease([this, totalItems] {
-    selectorIndex = ButtonNavigator::nextIndex(selectorIndex, totalItems);
+  int& index = matches.empty() ? selectorIndex : matchIndex;
+
+  buttonNavigator.onNextRelease([this, &index, totalItems] {
+    index = ButtonNavigator::nextIndex(index, totalItems);
+    noMatches = false;
     requestUpdate();
   });
 
-  buttonNavigator.onPreviousRelease([this, totalItems] {
-    selectorIndex = ButtonNavigator::previousIndex(selectorIndex, totalItems);
+  buttonNavigator.onPreviousRelease([this, &index, totalItems] {
+    index = ButtonNavigator::previousIndex(index, totalItems);
+    noMatches = false;
     requestUpdate();
   });
 
-  buttonNavigator.onNextContinuous([this, totalItems, pageItems] {
-    selectorIndex = ButtonNavigator::nextPageIndex(selectorIndex, totalItems, pageItems);
+  buttonNavigator.onNextContinuous([this, &index, totalItems, pageItems] {
+    index = ButtonNavigator::nextPageIndex(index, totalItems, pageItems);
+    noMatches = false;
     requestUpdate();
   });
 
-  buttonNavigator.onPreviousContinuous([this, totalItems, pageItems] {
-    selectorIndex = ButtonNavigator::previousPageIndex(selectorIndex, totalItems, pageItems);
+  buttonNavigator.onPreviousContinuous([this, &index, totalItems, pageItems] {
+    index = ButtonNavigator::previousPageIndex(index, totalItems, pageItems);
+    noMatches = false;
     requestUpdate();
   });
 }
@@ -106,21 +197,42 @@ void EpubReaderChapterSelectionActivity::render(RenderLock&&) {
   const int totalItems = getTotalItems();
 
   // Manual centering to honor content gutters.
+  const std::string title = matches.empty() ? std::string(tr(STR_SELECT_CHAPTER))
+                                            : renderer.truncatedText(UI_12_FONT_ID, query.c_str(), contentWidth - 40,
+                                                                     EpdFontFamily::BOLD);
   const int titleX =
-      contentX + (contentWidth - renderer.getTextWidth(UI_12_FONT_ID, tr(STR_SELECT_CHAPTER), EpdFontFamily::BOLD)) / 2;
-  renderer.drawText(UI_12_FONT_ID, titleX, 15 + contentY, tr(STR_SELECT_CHAPTER), true, EpdFontFamily::BOLD);
+      contentX + (contentWidth - renderer.getTextWidth(UI_12_FONT_ID, title.c_str(), EpdFontFamily::BOLD)) / 2;
+  renderer.drawText(UI_12_FONT_ID, titleX, 15 + contentY, title.c_str(), true, EpdFontFamily::BOLD);
+
+  // Under the title: why a search came up empty, or how to search a TOC longer than a screen
+  const char* subtitle = nullptr;
+  if (noMatches) {
+    subtitle = tr(STR_NO_SEARCH_RESULTS);
+  } else if (matches.empty() && totalItems > pageItems) {
+    subtitle = tr(STR_HOLD_TO_SEARCH_TITLES);
+  }
+  if (subtitle) {
+    const int subtitleX = contentX + (contentWidth - renderer.getTextWidth(SMALL_FONT_ID, subtitle)) / 2;
+    renderer.drawText(SMALL_FONT_ID, subtitleX, 15 + contentY + renderer.getLineHeight(UI_12_FONT_ID), subtitle);
+  }
 
-  const auto pageStartIndex = selectorIndex / pageItems * pageItems;
+  const int selected = matches.empty() ? selectorIndex : matchIndex;
+  const auto pageStartIndex = selected / pageItems * pageItems;
   // Highlight only the content area, not the hint gutters.
-  renderer.fillRect(contentX, 60 + contentY + (selectorIndex % pageItems) * 30 - 2, contentWidth - 1, 30);
+  if (totalItems > 0) {
+    renderer.fillRect(contentX, 60 + contentY + (selected % pageItems) * 30 - 2, contentWidth - 1, 30);
+  }
 
+  if (matches.empty() && toc) {
+    toc->prefetch(pageStartIndex, pageItems);
+  }
   for (int i = 0; i < pageItems; i++) {
     int itemIndex = pageStartIndex + i;
     if (itemIndex >= totalItems) break;
     const int displayY = 60 + contentY + i * 30;
-    const bool isSelected = (itemIndex == selectorIndex);
+    const bool isSelected = (itemIndex == selected);
 
-    auto item = epub->getTocItem(itemIndex);
+    const auto& item = matches.empty() ? toc->item(itemIndex) : matches[itemIndex].item;
 
     // Indent per TOC level while keeping content within the gutter-safe region.
     const int indentSize = contentX + 20 + (item.level - 1) * 15;
@@ -2,17 +2,32 @@
 #include <Epub.h>
 
 #include <memory>
+#include <vector>
 
 #include "../Activity.h"
 #include "util/ButtonNavigator.h"
 
+// Lists the table of contents. Holding Confirm searches the titles: a single letter jumps to the next title starting
+// with it, anything longer lists the matching titles until Back.
 class EpubReaderChapterSelectionActivity final : public Activity {
   std::shared_ptr<Epub> epub;
   std::string epubPath;
+  std::unique_ptr<TocView> toc;
   ButtonNavigator buttonNavigator;
   int currentSpineIndex = 0;
   int selectorIndex = 0;
 
+  std::string query;
+  bool queryPending = false;
+  // Titles matching `query`, listed instead of the whole TOC while not empty
+  std::vector<TocView::Match> matches;
+  int matchIndex = 0;
+  bool noMatches = false;
+
+  void askQuery();
+  void runQuery();
+  void select(int tocIndex);
+
   // Number of items that fit on a page, derived from logical screen height.
   // This adapts automatically when switching between portrait and landscape.
   int getPageItems() const;
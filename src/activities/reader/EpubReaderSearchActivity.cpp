@@ -0,0 +1,198 @@
+#include "EpubReaderSearchActivity.h"
+
+#include <GfxRenderer.h>
+#include <I18n.h>
+#include <Logging.h>
+
+#include "CrossPointSettings.h"
+#include "MappedInputManager.h"
+#include "activities/util/KeyboardEntryActivity.h"
+#include "components/UITheme.h"
+#include "fontIds.h"
+
+void EpubReaderSearchActivity::onEnter() {
+  Activity::onEnter();
+  askQuery();
+}
+
+void EpubReaderSearchActivity::onExit() {
+  Activity::onExit();
+  results.clear();
+}
+
+void EpubReaderSearchActivity::askQuery() {
+  startActivityForResult(std::make_unique<KeyboardEntryActivity>(renderer, mappedInput, tr(STR_SEARCH), query, 64),
+                         [this](const ActivityResult& result) {
+                           if (result.isCancelled || std::get<KeyboardResult>(result.data).text.empty()) {
+                             // Back out of the search altogether unless there are earlier results to return to
+                             cancelled = !searched;
+                             return;
+                           }
+                           query = std::get<KeyboardResult>(result.data).text;
+                           queryPending = true;
+                         });
+}
+
+std::string EpubReaderSearchActivity::locationOf(const SearchIndex::Hit& hit, std::unique_ptr<Section>& section) const {
+  std::string location;
+  const int tocIndex = epub->getTocIndexForSpineIndex(hit.spineIndex);
+  if (tocIndex >= 0) {
+    location = epub->getTocItem(tocIndex).title;
+  }
+
+  // Hits come in book order, so one section is loaded per chapter. Only a chapter already laid out with the reader's
+  // settings has page numbers; laying out every chapter with a hit would take far longer than the search.
+  if (!section || section->getSpineIndex() != hit.spineIndex) {
+    section.reset(new Section(epub, hit.spineIndex, renderer));
+    if (!section->loadSectionFile(SETTINGS.getReaderFontId(), SETTINGS.getReaderLineCompression(),
+                                  SETTINGS.extraParagraphSpacing, SETTINGS.paragraphAlignment, viewportWidth,
+                                  viewportHeight, SETTINGS.hyphenationEnabled, SETTINGS.embeddedStyle,
+                                  SETTINGS.imageRendering)) {
+      section->pageCount = 0;
+    }
+  }
+  if (section->pageCount > 0) {
+    if (const auto page = section->getPageForOffset(hit.charOffset)) {
+      char pageStr[24];
+      snprintf(pageStr, sizeof(pageStr), tr(STR_SEARCH_PAGE_FORMAT), *page + 1);
+      location += location.empty() ? pageStr : std::string(" \xC2\xB7 ") + pageStr;
+    }
+  }
+  return location;
+}
+
+void EpubReaderSearchActivity::runSearch() {
+  const std::string indexPath = epub->getSearchIndexPath();
+  if (!SearchIndex::exists(indexPath)) {
+    // The popups draw into the frame buffer the render task uses, so each draw holds the lock
+    Rect popupRect;
+    {
+      RenderLock lock(*this);
+      popupRect = GUI.drawPopup(renderer, tr(STR_BUILDING_SEARCH_INDEX));
+      GUI.fillPopupProgress(renderer, popupRect, 0);
+    }
+    int shown = 0;
+    const bool built = epub->buildSearchIndex([this, &popupRect, &shown](const int percent) {
+      // Every refresh costs e-ink time, so only whole steps of ten are drawn
+      if (percent / 10 != shown / 10) {
+        shown = percent;
+        RenderLock lock(*this);
+        GUI.fillPopupProgress(renderer, popupRect, percent);
+      }
+    });
+    if (!built) {
+      LOG_ERR("ERSR", "Failed to build search index");
+    }
+  }
+
+  {
+    RenderLock lock(*this);
+    GUI.drawPopup(renderer, tr(STR_LOADING_POPUP));
+  }
+  const uint32_t start = millis();
+  const SearchIndex index(indexPath);
+  const auto hits = index.find(query, MAX_RESULTS);
+
+  std::vector<Result> found;
+  found.reserve(hits.size());
+  std::unique_ptr<Section> section;
+  for (const auto& hit : hits) {
+    found.push_back({hit, index.snippet(hit), locationOf(hit, section)});
+  }
+  LOG_DBG("ERSR", "%zu results for '%s' in %lu ms", found.size(), query.c_str(), millis() - start);
+
+  RenderLock lock(*this);
+  results = std::move(found);
+  selectorIndex = 0;
+  searched = true;
+}
+
+void EpubReaderSearchActivity::loop() {
+  if (cancelled) {
+    ActivityResult result;
+    result.isCancelled = true;
+    setResult(std::move(result));
+    finish();
+    return;
+  }
+
+  if (queryPending) {
+    queryPending = false;
+    runSearch();
+    requestUpdate();
+    return;
+  }
+
+  if (mappedInput.wasReleased(MappedInputManager::Button::Back)) {
+    ActivityResult result;
+    result.isCancelled = true;
+    setResult(std::move(result));
+    finish();
+    return;
+  }
+
+  if (mappedInput.wasReleased(MappedInputManager::Button::Confirm)) {
+    if (results.empty()) {
+      askQuery();
+    } else {
+      const auto& hit = results[selectorIndex].hit;
+      setResult(SearchResult{hit.spineIndex, hit.charOffset});
+      finish();
+    }
+    return;
+  }
+
+  const int pageItems = UITheme::getInstance().getNumberOfItemsPerPage(renderer, true, false, true, true);
+  const int listSize = static_cast<int>(results.size());
+
+  buttonNavigator.onNextRelease([this, listSize] {
+    selectorIndex = ButtonNavigator::nextIndex(selectorIndex, listSize);
+    requestUpdate();
+  });
+
+  buttonNavigator.onPreviousRelease([this, listSize] {
+    selectorIndex = ButtonNavigator::previousIndex(selectorIndex, listSize);
+    requestUpdate();
+  });
+
+  buttonNavigator.onNextContinuous([this, listSize, pageItems] {
+    selectorIndex = ButtonNavigator::nextPageIndex(selectorIndex, listSize, pageItems);
+    requestUpdate();
+  });
+
+  buttonNavigator.onPreviousContinuous([this, listSize, pageItems] {
+    selectorIndex = ButtonNavigator::previousPageIndex(selectorIndex, listSize, pageItems);
+    requestUpdate();
+  });
+}
+
+void EpubReaderSearchActivity::render(RenderLock&&) {
+  if (!searched) {
+    return;
+  }
+  renderer.clearScreen();
+
+  const auto pageWidth = renderer.getScreenWidth();
+  const auto pageHeight = renderer.getScreenHeight();
+  const auto& metrics = UITheme::getInstance().getMetrics();
+
+  GUI.drawHeader(renderer, Rect{0, metrics.topPadding, pageWidth, metrics.headerHeight}, tr(STR_SEARCH),
+                 query.c_str());
+
+  const int contentTop = metrics.topPadding + metrics.headerHeight + metrics.verticalSpacing;
+  const int contentHeight = pageHeight - contentTop - metrics.buttonHintsHeight - metrics.verticalSpacing;
+
+  if (results.empty()) {
+    renderer.drawText(UI_10_FONT_ID, metrics.contentSidePadding, contentTop + 20, tr(STR_NO_SEARCH_RESULTS));
+    const auto labels = mappedInput.mapLabels(tr(STR_BACK), tr(STR_SEARCH), "", "");
+    GUI.drawButtonHints(renderer, labels.btn1, labels.btn2, labels.btn3, labels.btn4);
+  } else {
+    GUI.drawList(
+        renderer, Rect{0, contentTop, pageWidth, contentHeight}, results.size(), selectorIndex,
+        [this](int index) { return results[index].snippet; }, [this](int index) { return results[index].location; });
+    const auto labels = mappedInput.mapLabels(tr(STR_BACK), tr(STR_SELECT), tr(STR_DIR_UP), tr(STR_DIR_DOWN));
+    GUI.drawButtonHints(renderer, labels.btn1, labels.btn2, labels.btn3, labels.btn4);
+  }
+
+  renderer.displayBuffer();
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <Epub.h>
+#include <Epub/SearchIndex.h>
+#include <Epub/Section.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../Activity.h"
+#include "util/ButtonNavigator.h"
+
+// Asks for a query and lists where the book contains it. The search index is built on first use if the pre-indexer
+// hasn't done so. Each hit shows its text and, where the chapter is already laid out with the given viewport, its page.
+class EpubReaderSearchActivity final : public Activity {
+ public:
+  explicit EpubReaderSearchActivity(GfxRenderer& renderer, MappedInputManager& mappedInput,
+                                    const std::shared_ptr<Epub>& epub, const uint16_t viewportWidth,
+                                    const uint16_t viewportHeight)
+      : Activity("EpubReaderSearch", renderer, mappedInput),
+        epub(epub),
+        viewportWidth(viewportWidth),
+        viewportHeight(viewportHeight) {}
+
+  void onEnter() override;
+  void onExit() override;
+  void loop() override;
+  void render(RenderLock&&) override;
+
+ private:
+  static constexpr size_t MAX_RESULTS = 50;
+
+  struct Result {
+    SearchIndex::Hit hit;
+    std::string snippet;
+    std::string location;
+  };
+
+  std::shared_ptr<Epub> epub;
+  uint16_t viewportWidth;
+  uint16_t viewportHeight;
+  std::string query;
+  bool queryPending = false;
+  bool cancelled = false;
+  bool searched = false;
+  std::vector<Result> results;
+  int selectorIndex = 0;
+  ButtonNavigator buttonNavigator;
+
+  void askQuery();
+  void runSearch();
+  std::string locationOf(const SearchIndex::Hit& hit, std::unique_ptr<Section>& section) const;
+};
@@ -0,0 +1,192 @@
+#include "EpubReaderWordSelectActivity.h"
+
+#include <GfxRenderer.h>
+#include <I18n.h>
+#include <Logging.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "MappedInputManager.h"
+#include "components/UITheme.h"
+#include "fontIds.h"
+
+namespace {
+constexpr char EM_SPACE[] = "\xe2\x80\x83";
+}  // namespace
+
+void EpubReaderWordSelectActivity::onEnter() {
+  Activity::onEnter();
+  collectWords();
+  requestUpdate();
+}
+
+void EpubReaderWordSelectActivity::onExit() {
+  Activity::onExit();
+  words.clear();
+  page.reset();
+}
+
+void EpubReaderWordSelectActivity::collectWords() {
+  uint16_t line = 0;
+  for (const auto& element : page->elements) {
+    if (element->getTag() != TAG_PageLine) continue;
+    const auto& block = static_cast<const PageLine&>(*element).getBlock();
+    if (!block) continue;
+    const auto& texts = block->getWords();
+    const auto& xpos = block->getWordXpos();
+    const auto& styles = block->getWordStyles();
+    if (texts.size() != xpos.size() || texts.size() != styles.size()) continue;
+
+    bool lineHasWords = false;
+    for (size_t i = 0; i < texts.size(); i++) {
+      // Punctuation and spacing are laid out as words too, but there is nothing to look up in them
+      if (Dictionary::candidates(texts[i], language).empty()) continue;
+      int x = element->xPos + xpos[i];
+      const char* visible = texts[i].c_str();
+      if (texts[i].compare(0, sizeof(EM_SPACE) - 1, EM_SPACE) == 0) {
+        x += renderer.getTextAdvanceX(fontId, EM_SPACE, styles[i]);
+        visible += sizeof(EM_SPACE) - 1;
+      }
+      words.push_back({texts[i], static_cast<int16_t>(x), element->yPos,
+                       static_cast<int16_t>(renderer.getTextWidth(fontId, visible, styles[i])), styles[i], line});
+      lineHasWords = true;
+    }
+    if (lineHasWords) line++;
+  }
+}
+
+int EpubReaderWordSelectActivity::wordOnAdjacentLine(const int direction) const {
+  const Word& current = words[selected];
+  const int targetLine = current.line + direction;
+  const int center = current.x + current.width / 2;
+  int best = selected;
+  int bestDistance = 0;
+  for (int i = 0; i < static_cast<int>(words.size()); i++) {
+    if (words[i].line != targetLine) continue;
+    const int distance = std::abs(words[i].x + words[i].width / 2 - center);
+    if (best == selected || distance < bestDistance) {
+      best = i;
+      bestDistance = distance;
+    }
+  }
+  return best;
+}
+
+void EpubReaderWordSelectActivity::lookUp() {
+  // Held from the first popup on, so the render task cannot draw into the frame buffer while the popups do
+  RenderLock lock(*this);
+  if (!dictionaryOpened) {
+    GUI.drawPopup(renderer, tr(STR_LOADING_POPUP));
+    // Opening a dictionary for the first time samples its index, which takes a few seconds for a large one
+    dictionary.open([this](const std::string& name) {
+      GUI.drawPopup(renderer, (std::string(tr(STR_PREPARING_DICTIONARY)) + ": " + name).c_str());
+    });
+    dictionaryOpened = true;
+  }
+
+  const std::string& word = words[selected].text;
+  Dictionary::Result result;
+  const uint32_t start = millis();
+  const bool found = !dictionary.empty() && dictionary.lookup(word, language, result);
+  LOG_DBG("ERWS", "Lookup of '%s' %s in %lu ms", word.c_str(), found ? "found" : "failed", millis() - start);
+
+  if (found) {
+    headword = std::move(result.headword);
+    definition = std::move(result.definition);
+    source = std::move(result.dictionary);
+  } else {
+    const auto forms = Dictionary::candidates(word, language);
+    headword = forms.empty() ? word : forms.front();
+    definition = dictionary.empty() ? tr(STR_NO_DICTIONARIES) : tr(STR_WORD_NOT_FOUND);
+    source.clear();
+  }
+  showingDefinition = true;
+}
+
+void EpubReaderWordSelectActivity::loop() {
+  if (lookupPending) {
+    lookupPending = false;
+    lookUp();
+    requestUpdate();
+    return;
+  }
+
+  if (mappedInput.wasReleased(MappedInputManager::Button::Back)) {
+    if (showingDefinition) {
+      showingDefinition = false;
+      requestUpdate();
+    } else {
+      finish();
+    }
+    return;
+  }
+
+  if (words.empty()) {
+    return;
+  }
+
+  if (mappedInput.wasReleased(MappedInputManager::Button::Confirm)) {
+    if (showingDefinition) {
+      showingDefinition = false;
+      requestUpdate();
+    } else {
+      lookupPending = true;
+    }
+    return;
+  }
+
+  int next = selected;
+  const int count = static_cast<int>(words.size());
+  if (mappedInput.wasReleased(MappedInputManager::Button::Right) ||
+      mappedInput.wasReleased(MappedInputManager::Button::PageForward)) {
+    next = (selected + 1) % count;
+  } else if (mappedInput.wasReleased(MappedInputManager::Button::Left) ||
+             mappedInput.wasReleased(MappedInputManager::Button::PageBack)) {
+    next = (selected - 1 + count) % count;
+  } else if (mappedInput.wasReleased(MappedInputManager::Button::Down)) {
+    next = wordOnAdjacentLine(1);
+  } else if (mappedInput.wasReleased(MappedInputManager::Button::Up)) {
+    next = wordOnAdjacentLine(-1);
+  }
+  if (next != selected) {
+    RenderLock lock(*this);
+    selected = next;
+    showingDefinition = false;
+    requestUpdate();
+  }
+}
+
+void EpubReaderWordSelectActivity::renderDefinition(const Word& word) const {
+  // The sheet takes the half of the screen the word is not on, so the word stays visible
+  const int wordY = marginTop + word.y;
+  const int wordBottom = wordY + renderer.getLineHeight(fontId);
+  const bool above = wordY > renderer.getScreenHeight() / 2;
+  const int space = above ? wordY : renderer.getScreenHeight() - wordBottom;
+  GUI.drawTextSheet(renderer, above ? wordY : wordBottom, above, space, headword.c_str(), source.c_str(),
+                    definition);
+}
+
+void EpubReaderWordSelectActivity::render(RenderLock&&) {
+  renderer.clearScreen();
+  page->render(renderer, fontId, marginLeft, marginTop);
+
+  if (!words.empty()) {
+    const Word& word = words[selected];
+    const int x = marginLeft + word.x;
+    const int y = marginTop + word.y;
+    const char* visible = word.text.c_str();
+    if (word.text.compare(0, sizeof(EM_SPACE) - 1, EM_SPACE) == 0) visible += sizeof(EM_SPACE) - 1;
+    renderer.fillRect(x - 2, y, word.width + 4, renderer.getLineHeight(fontId), true);
+    renderer.drawText(fontId, x, y, visible, false, word.style);
+
+    if (showingDefinition) {
+      renderDefinition(word);
+    }
+  }
+
+  const auto labels = mappedInput.mapLabels(tr(STR_BACK), showingDefinition ? "" : tr(STR_LOOKUP_WORD),
+                                            tr(STR_DIR_LEFT), tr(STR_DIR_RIGHT));
+  GUI.drawButtonHints(renderer, labels.btn1, labels.btn2, labels.btn3, labels.btn4);
+  renderer.displayBuffer(HalDisplay::FAST_REFRESH);
+}
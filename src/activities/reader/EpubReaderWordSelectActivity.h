@@ -0,0 +1,62 @@
+#pragma once
+#include <Dictionary.h>
+#include <EpdFontFamily.h>
+#include <Epub/Page.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../Activity.h"
+
+// Picks a word on the current page and shows its definition from the StarDict dictionaries on the SD card. The page is
+// drawn as laid out, with the chosen word inverted; left and right move by word, up and down by line. The definition
+// opens in a box on the half of the screen away from the word.
+class EpubReaderWordSelectActivity final : public Activity {
+ public:
+  explicit EpubReaderWordSelectActivity(GfxRenderer& renderer, MappedInputManager& mappedInput,
+                                        std::unique_ptr<Page> page, const int fontId, const int marginLeft,
+                                        const int marginTop, std::string language)
+      : Activity("EpubReaderWordSelect", renderer, mappedInput),
+        page(std::move(page)),
+        fontId(fontId),
+        marginLeft(marginLeft),
+        marginTop(marginTop),
+        language(std::move(language)) {}
+
+  void onEnter() override;
+  void onExit() override;
+  void loop() override;
+  void render(RenderLock&&) override;
+
+ private:
+  struct Word {
+    std::string text;
+    int16_t x;
+    int16_t y;
+    int16_t width;
+    EpdFontFamily::Style style;
+    uint16_t line;
+  };
+
+  std::unique_ptr<Page> page;
+  int fontId;
+  int marginLeft;
+  int marginTop;
+  std::string language;
+  std::vector<Word> words;
+  int selected = 0;
+
+  Dictionary dictionary;
+  bool dictionaryOpened = false;
+  bool lookupPending = false;
+  bool showingDefinition = false;
+  std::string headword;
+  std::string definition;
+  std::string source;
+
+  void collectWords();
+  void lookUp();
+  int wordOnAdjacentLine(int direction) const;
+  void renderDefinition(const Word& word) const;
+};
@@ -8,6 +8,7 @@
 
 #include "KOReaderCredentialStore.h"
 #include "KOReaderDocumentId.h"
+#include "KOReaderDocumentIdCache.h"
 #include "MappedInputManager.h"
 #include "activities/network/WifiSelectionActivity.h"
 #include "components/UITheme.h"
@@ -86,7 +87,7 @@ void KOReaderSyncActivity::performSync() {
   if (KOREADER_STORE.getMatchMethod() == DocumentMatchMethod::FILENAME) {
     documentHash = KOReaderDocumentId::calculateFromFilename(epubPath);
   } else {
-    documentHash = KOReaderDocumentId::calculate(epubPath);
+    documentHash = KOReaderDocumentIdCache::get(epubPath);
   }
   if (documentHash.empty()) {
     {
@@ -133,11 +134,11 @@ void KOReaderSyncActivity::performSync() {
   // Convert remote progress to CrossPoint position
   hasRemoteProgress = true;
   KOReaderPosition koPos = {remoteProgress.progress, remoteProgress.percentage};
-  remotePosition = ProgressMapper::toCrossPoint(epub, koPos, currentSpineIndex, totalPagesInSpine);
+  remotePosition = ProgressMapper::toCrossPoint(epub, renderer, koPos, currentSpineIndex, totalPagesInSpine);
 
   // Calculate local progress in KOReader format (for display)
   CrossPointPosition localPos = {currentSpineIndex, currentPage, totalPagesInSpine};
-  localProgress = ProgressMapper::toKOReader(epub, localPos);
+  localProgress = ProgressMapper::toKOReader(epub, renderer, localPos);
 
   {
     RenderLock lock(*this);
@@ -163,7 +164,7 @@ void KOReaderSyncActivity::performUpload() {
 
   // Convert current position to KOReader format
   CrossPointPosition localPos = {currentSpineIndex, currentPage, totalPagesInSpine};
-  KOReaderPosition koPos = ProgressMapper::toKOReader(epub, localPos);
+  KOReaderPosition koPos = ProgressMapper::toKOReader(epub, renderer, localPos);
 
   KOReaderProgress progress;
   progress.document = documentHash;
@@ -384,7 +385,7 @@ void KOReaderSyncActivity::loop() {
         if (KOREADER_STORE.getMatchMethod() == DocumentMatchMethod::FILENAME) {
           documentHash = KOReaderDocumentId::calculateFromFilename(epubPath);
         } else {
-          documentHash = KOReaderDocumentId::calculate(epubPath);
+          documentHash = KOReaderDocumentIdCache::get(epubPath);
         }
       }
       performUpload();
@@ -12,6 +12,7 @@
 #include "XtcReaderActivity.h"
 #include "activities/util/BmpViewerActivity.h"
 #include "activities/util/FullScreenMessageActivity.h"
+#include "util/BootProfiler.h"
 
 std::string ReaderActivity::extractFolderPath(const std::string& filePath) {
   const auto lastSlash = filePath.find_last_of('/');
@@ -134,6 +135,7 @@ void ReaderActivity::onEnter() {
       onGoBack();
       return;
     }
+    BootProfiler::mark("book loaded");
     onGoToEpubReader(std::move(epub));
   }
 }
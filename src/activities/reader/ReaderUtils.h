@@ -4,29 +4,61 @@
 #include <GfxRenderer.h>
 #include <Logging.h>
 
+#include <algorithm>
+
 #include "MappedInputManager.h"
+#include "components/UITheme.h"
 
 namespace ReaderUtils {
 
 constexpr unsigned long GO_HOME_MS = 1000;
 
-inline void applyOrientation(GfxRenderer& renderer, const uint8_t orientation) {
+inline GfxRenderer::Orientation toRendererOrientation(const uint8_t orientation) {
   switch (orientation) {
-    case CrossPointSettings::ORIENTATION::PORTRAIT:
-      renderer.setOrientation(GfxRenderer::Orientation::Portrait);
-      break;
     case CrossPointSettings::ORIENTATION::LANDSCAPE_CW:
-      renderer.setOrientation(GfxRenderer::Orientation::LandscapeClockwise);
-      break;
+      return GfxRenderer::Orientation::LandscapeClockwise;
     case CrossPointSettings::ORIENTATION::INVERTED:
-      renderer.setOrientation(GfxRenderer::Orientation::PortraitInverted);
-      break;
+      return GfxRenderer::Orientation::PortraitInverted;
     case CrossPointSettings::ORIENTATION::LANDSCAPE_CCW:
-      renderer.setOrientation(GfxRenderer::Orientation::LandscapeCounterClockwise);
-      break;
+      return GfxRenderer::Orientation::LandscapeCounterClockwise;
+    case CrossPointSettings::ORIENTATION::PORTRAIT:
     default:
-      break;
+      return GfxRenderer::Orientation::Portrait;
+  }
+}
+
+inline void applyOrientation(GfxRenderer& renderer, const uint8_t orientation) {
+  renderer.setOrientation(toRendererOrientation(orientation));
+}
+
+struct PageMargins {
+  int top;
+  int right;
+  int bottom;
+  int left;
+};
+
+// EPUB page margins for the current settings. Takes the orientation explicitly so books can be laid out (e.g.
+// pre-indexed after an upload) without switching the renderer away from the UI orientation.
+inline PageMargins epubPageMargins(const GfxRenderer::Orientation orientation, const bool autoPageTurnIndicator) {
+  PageMargins margins{};
+  GfxRenderer::getOrientedViewableTRBL(orientation, &margins.top, &margins.right, &margins.bottom, &margins.left);
+  margins.top += SETTINGS.screenMargin;
+  margins.left += SETTINGS.screenMargin;
+  margins.right += SETTINGS.screenMargin;
+
+  const uint8_t statusBarHeight = UITheme::getInstance().getStatusBarHeight();
+
+  // reserves space for automatic page turn indicator when no status bar or progress bar only
+  if (autoPageTurnIndicator &&
+      (statusBarHeight == 0 || statusBarHeight == UITheme::getInstance().getProgressBarHeight())) {
+    margins.bottom +=
+        std::max(SETTINGS.screenMargin,
+                 static_cast<uint8_t>(statusBarHeight + UITheme::getInstance().getMetrics().statusBarVerticalMargin));
+  } else {
+    margins.bottom += std::max(SETTINGS.screenMargin, statusBarHeight);
   }
+  return margins;
 }
 
 struct PageTurnResult {
@@ -0,0 +1,87 @@
+#include "ResumeSnapshot.h"
+
+#include <GfxRenderer.h>
+#include <HalDisplay.h>
+#include <HalStorage.h>
+#include <Logging.h>
+#include <PackedFrameCache.h>
+#include <ZipFile.h>
+
+#include <functional>
+
+#include "activities/RenderLock.h"
+
+namespace {
+constexpr char SNAPSHOT_PATH[] = "/.crosspoint/resume.bin";
+
+uint32_t variantFor(const std::string& bookPath) {
+  return static_cast<uint32_t>(std::hash<std::string>{}(bookPath));
+}
+
+uint64_t frameHash(const GfxRenderer& renderer) {
+  return ZipFile::fnvHash64(reinterpret_cast<const char*>(renderer.getFrameBuffer()), HalDisplay::BUFFER_SIZE);
+}
+}  // namespace
+
+std::string ResumeSnapshot::pageBook;
+uint32_t ResumeSnapshot::pageFrame = 0;
+uint32_t ResumeSnapshot::shownFrame = 0;
+uint64_t ResumeSnapshot::shownHash = 0;
+bool ResumeSnapshot::shownPending = false;
+
+void ResumeSnapshot::pageShown(const GfxRenderer& renderer, const std::string& bookPath) {
+  pageBook = bookPath;
+  pageFrame = renderer.getFramesDisplayed();
+}
+
+void ResumeSnapshot::saveForSleep(const GfxRenderer& renderer) {
+  // The render task may be halfway through the next frame
+  RenderLock lock;
+  PackedFrameCache cache(SNAPSHOT_PATH, variantFor(pageBook));
+
+  // Anything displayed since, a menu or a footnote popup, means the frame buffer is no longer the page
+  if (pageBook.empty() || renderer.getFramesDisplayed() != pageFrame) {
+    cache.invalidate();
+    return;
+  }
+
+  FsFile book;
+  const bool stamped = Storage.openFileForRead("RSS", pageBook, book) && cache.stampSource(book);
+  book.close();
+  if (!stamped || !cache.beginWrite(1, true) || !cache.writePlane(renderer.getFrameBuffer()) || !cache.commit()) {
+    LOG_ERR("RSS", "Could not save resume snapshot");
+    cache.invalidate();
+    return;
+  }
+  LOG_DBG("RSS", "Saved resume snapshot of %s", pageBook.c_str());
+}
+
+bool ResumeSnapshot::show(const GfxRenderer& renderer, const std::string& bookPath) {
+  PackedFrameCache cache(SNAPSHOT_PATH, variantFor(bookPath));
+  FsFile book;
+  const bool stamped = Storage.openFileForRead("RSS", bookPath, book) && cache.stampSource(book);
+  book.close();
+  const bool loaded = stamped && cache.open() && cache.readPlane(renderer.getFrameBuffer());
+  cache.close();
+  // Shown at most once: should the next sleep not save a new one, this page may no longer be where the book resumes
+  cache.invalidate();
+  if (!loaded) {
+    return false;
+  }
+
+  renderer.displayBuffer(HalDisplay::HALF_REFRESH);
+  shownFrame = renderer.getFramesDisplayed();
+  shownHash = frameHash(renderer);
+  shownPending = true;
+  LOG_DBG("RSS", "Showing resume snapshot of %s", bookPath.c_str());
+  return true;
+}
+
+bool ResumeSnapshot::isOnScreen(const GfxRenderer& renderer) {
+  if (!shownPending) {
+    return false;
+  }
+  shownPending = false;
+  // A loading popup in between has drawn over the snapshot
+  return renderer.getFramesDisplayed() == shownFrame && frameHash(renderer) == shownHash;
+}
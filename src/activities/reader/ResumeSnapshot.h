@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+class GfxRenderer;
+
+// The reader's last page, kept on the card across deep sleep so that waking into a book shows it straight away, before
+// the book is even opened, instead of the boot screen. The snapshot is the BW frame, PackBits-packed in a
+// PackedFrameCache stamped with the book file and path; it is shown once and removed. The reader then opens the book as
+// usual, and if the first page it renders is the one already on screen, it skips that refresh.
+class ResumeSnapshot {
+ public:
+  // The reader displayed a page of `bookPath` and the frame buffer still holds its BW frame
+  static void pageShown(const GfxRenderer& renderer, const std::string& bookPath);
+  // Before deep sleep: saves the frame buffer if the screen still shows the page last passed to pageShown(), otherwise
+  // removes any older snapshot so a stale page is never shown
+  static void saveForSleep(const GfxRenderer& renderer);
+  // On wake: shows the snapshot of `bookPath`. Returns false if there is none or the book file changed since.
+  static bool show(const GfxRenderer& renderer, const std::string& bookPath);
+  // True on the reader's first render after show() if the frame buffer holds the page shown at wake; false after that
+  static bool isOnScreen(const GfxRenderer& renderer);
+
+ private:
+  static std::string pageBook;
+  static uint32_t pageFrame;
+  static uint32_t shownFrame;
+  static uint64_t shownHash;
+  static bool shownPending;
+};
@@ -4,11 +4,13 @@
 #include <GfxRenderer.h>
 #include <HalStorage.h>
 #include <I18n.h>
-#include <Serialization.h>
+#include <LibraryDb.h>
+#include <TxtLineBreaker.h>
 #include <Utf8.h>
 
 #include "CrossPointSettings.h"
 #include "CrossPointState.h"
+#include "EpubReaderPercentSelectionActivity.h"
 #include "MappedInputManager.h"
 #include "ReaderUtils.h"
 #include "RecentBooksStore.h"
@@ -17,9 +19,20 @@
 
 namespace {
 constexpr size_t CHUNK_SIZE = 8 * 1024;  // 8KB chunk for reading
-// Cache file magic and version
-constexpr uint32_t CACHE_MAGIC = 0x54585449;  // "TXTI"
-constexpr uint8_t CACHE_VERSION = 2;          // Increment when cache format changes
+// Pages indexed in the background between checkpoints of the partial page index
+constexpr size_t INDEX_CHECKPOINT_PAGES = 256;
+constexpr uint32_t RENDER_LOCK_WAIT_MS = 50;
+
+// RAII helper for the page index mutex shared with the background indexing task
+class IndexLock {
+  SemaphoreHandle_t mutex;
+
+ public:
+  explicit IndexLock(SemaphoreHandle_t mutex) : mutex(mutex) { xSemaphoreTake(mutex, portMAX_DELAY); }
+  ~IndexLock() { xSemaphoreGive(mutex); }
+  IndexLock(const IndexLock&) = delete;
+  IndexLock& operator=(const IndexLock&) = delete;
+};
 }  // namespace
 
 void TxtReaderActivity::onEnter() {
@@ -32,13 +45,17 @@ void TxtReaderActivity::onEnter() {
   ReaderUtils::applyOrientation(renderer, SETTINGS.orientation);
 
   txt->setupCacheDir();
+  indexMutex = xSemaphoreCreateMutex();
 
   // Save current txt as last opened file and add to recent books
   auto filePath = txt->getPath();
   auto fileName = filePath.substr(filePath.rfind('/') + 1);
   APP_STATE.openEpubPath = filePath;
   APP_STATE.saveToFile();
-  RECENT_BOOKS.addBook(filePath, fileName, "", "");
+  LibraryDb::Book book;
+  book.path = filePath;
+  book.title = fileName;
+  RECENT_BOOKS.addBook(book);
 
   // Trigger first update
   requestUpdate();
@@ -47,17 +64,39 @@ void TxtReaderActivity::onEnter() {
 void TxtReaderActivity::onExit() {
   Activity::onExit();
 
+  // Stops the background indexer after it checkpoints what it has so far
+  stopIndexing();
+
   // Reset orientation back to portrait for the rest of the UI
   renderer.setOrientation(GfxRenderer::Orientation::Portrait);
 
-  pageOffsets.clear();
+  pageIndex.reset();
   currentPageLines.clear();
+  if (indexMutex) {
+    vSemaphoreDelete(indexMutex);
+    indexMutex = nullptr;
+  }
   APP_STATE.readerActivityLoadCount = 0;
   APP_STATE.saveToFile();
+  if (txt && txt->getFileSize() > 0) {
+    LibraryDb::setProgress(txt->getPath(), std::min<size_t>(100, currentPageEnd * 100 / txt->getFileSize()));
+  }
   txt.reset();
 }
 
 void TxtReaderActivity::loop() {
+  // Confirm opens the percent jump; it works before the page index is complete
+  if (mappedInput.wasReleased(MappedInputManager::Button::Confirm) && txt && txt->getFileSize() > 0) {
+    const int initialPercent = static_cast<int>(static_cast<uint64_t>(currentOffset) * 100 / txt->getFileSize());
+    startActivityForResult(std::make_unique<EpubReaderPercentSelectionActivity>(renderer, mappedInput, initialPercent),
+                           [this](const ActivityResult& result) {
+                             if (!result.isCancelled) {
+                               pendingJumpPercent = std::get<PercentResult>(result.data).percent;
+                             }
+                           });
+    return;
+  }
+
   // Long press BACK (1s+) goes to file selection
   if (mappedInput.isPressed(MappedInputManager::Button::Back) && mappedInput.getHeldTime() >= ReaderUtils::GO_HOME_MS) {
     activityManager.goToFileBrowser(txt ? txt->getPath() : "");
@@ -76,11 +115,12 @@ void TxtReaderActivity::loop() {
     return;
   }
 
-  if (prevTriggered && currentPage > 0) {
-    currentPage--;
+  // Turns are resolved by render(), which may have to lay out pages the index has not reached yet
+  if (prevTriggered && currentOffset > 0) {
+    pendingPageTurn--;
     requestUpdate();
-  } else if (nextTriggered && currentPage < totalPages - 1) {
-    currentPage++;
+  } else if (nextTriggered && txt && currentPageEnd < txt->getFileSize()) {
+    pendingPageTurn++;
     requestUpdate();
   }
 }
@@ -94,6 +134,9 @@ void TxtReaderActivity::initializeReader() {
   cachedFontId = SETTINGS.getReaderFontId();
   cachedScreenMargin = SETTINGS.screenMargin;
   cachedParagraphAlignment = SETTINGS.paragraphAlignment;
+  cachedHyphenationEnabled = SETTINGS.hyphenationEnabled;
+  // Plain text has no language of its own; hyphenate it by the UI language
+  cachedHyphenationLanguage = cachedHyphenationEnabled ? I18n::getLanguageCode(I18N.getLanguage()) : "";
 
   // Calculate viewport dimensions
   renderer.getOrientedViewableTRBL(&cachedOrientedMarginTop, &cachedOrientedMarginRight, &cachedOrientedMarginBottom,
@@ -111,62 +154,126 @@ void TxtReaderActivity::initializeReader() {
   linesPerPage = viewportHeight / lineHeight;
   if (linesPerPage < 1) linesPerPage = 1;
 
-  LOG_DBG("TRS", "Viewport: %dx%d, lines per page: %d", viewportWidth, viewportHeight, linesPerPage);
-
-  // Try to load cached page index first
-  if (!loadPageIndexCache()) {
-    // Cache not found, build page index
-    buildPageIndex();
-    // Save to cache for next time
-    savePageIndexCache();
-  }
+  // Resume the page index from its last checkpoint; the reader does not wait for it
+  TxtPageIndex::Layout layout;
+  layout.fileSize = txt->getFileSize();
+  layout.viewportWidth = viewportWidth;
+  layout.linesPerPage = linesPerPage;
+  layout.fontId = cachedFontId;
+  layout.screenMargin = cachedScreenMargin;
+  layout.paragraphAlignment = cachedParagraphAlignment;
+  layout.hyphenation = cachedHyphenationEnabled;
+  if (cachedHyphenationLanguage.size() == 2) {
+    layout.hyphenationLanguage = static_cast<uint8_t>(cachedHyphenationLanguage[0]) |
+                                 static_cast<uint8_t>(cachedHyphenationLanguage[1]) << 8;
+  }
+  pageIndex = std::make_unique<TxtPageIndex>(txt->getCachePath() + "/index.bin");
+  pageIndex->load(layout);
 
   // Load saved progress
   loadProgress();
 
+  if (!pageIndex->isComplete() && txt->getFileSize() > 0) {
+    startIndexing();
+  }
+
   initialized = true;
 }
 
-void TxtReaderActivity::buildPageIndex() {
-  pageOffsets.clear();
-  pageOffsets.push_back(0);  // First page starts at offset 0
-
-  size_t offset = 0;
-  const size_t fileSize = txt->getFileSize();
-
-  LOG_DBG("TRS", "Building page index for %zu bytes...", fileSize);
+void TxtReaderActivity::startIndexing() {
+  indexStopRequested = false;
+  indexTaskRunning = true;
+  const BaseType_t created = xTaskCreate(&indexTaskTrampoline, "TxtPageIndex",
+                                         8192,             // Stack size
+                                         this,             // Parameters
+                                         0,                // Priority: below the main and render tasks
+                                         &indexTaskHandle  // Task handle
+  );
+  if (created != pdPASS) {
+    LOG_ERR("TRS", "Failed to start background page indexing");
+    indexTaskRunning = false;
+    indexTaskHandle = nullptr;
+  }
+}
 
-  GUI.drawPopup(renderer, tr(STR_INDEXING));
+void TxtReaderActivity::stopIndexing() {
+  indexStopRequested = true;
+  while (indexTaskRunning) {
+    vTaskDelay(pdMS_TO_TICKS(5));
+  }
+  indexTaskHandle = nullptr;
+}
 
-  while (offset < fileSize) {
-    std::vector<std::string> tempLines;
-    size_t nextOffset = offset;
+void TxtReaderActivity::indexTaskTrampoline(void* param) {
+  auto* self = static_cast<TxtReaderActivity*>(param);
+  self->indexTaskLoop();
+  // The activity may be destroyed as soon as indexTaskRunning is cleared; nothing after this touches it
+  vTaskDelete(nullptr);
+}
 
-    if (!loadPageAtOffset(offset, tempLines, nextOffset)) {
-      break;
+void TxtReaderActivity::indexTaskLoop() {
+  LOG_DBG("TRS", "Background page indexing started");
+  size_t pagesSinceCheckpoint = 0;
+  bool more = true;
+
+  while (more && !indexStopRequested) {
+    {
+      // Laying out a page measures text with the renderer's fonts, which the render task uses too. onExit() stops
+      // this task while holding the render lock, so the wait is bounded and the stop request checked in between.
+      RenderLock lock(RENDER_LOCK_WAIT_MS);
+      if (!lock.owns()) {
+        continue;
+      }
+      more = indexNextPage();
     }
-
-    if (nextOffset <= offset) {
-      // No progress made, avoid infinite loop
-      break;
+    pagesSinceCheckpoint++;
+    if (!more || pagesSinceCheckpoint >= INDEX_CHECKPOINT_PAGES) {
+      IndexLock lock(indexMutex);
+      pageIndex->save();
+      pagesSinceCheckpoint = 0;
     }
+  }
 
-    offset = nextOffset;
-    if (offset < fileSize) {
-      pageOffsets.push_back(offset);
-    }
+  if (pagesSinceCheckpoint > 0) {
+    // Stopped early (book closed): keep what was indexed so the next session resumes from here
+    IndexLock lock(indexMutex);
+    pageIndex->save();
+  }
 
-    // Yield to other tasks periodically
-    if (pageOffsets.size() % 20 == 0) {
-      vTaskDelay(1);
+  LOG_DBG("TRS", "Background page indexing %s", more ? "paused" : "finished");
+  indexTaskRunning = false;
+}
+
+bool TxtReaderActivity::indexNextPage() {
+  const size_t fileSize = txt->getFileSize();
+  size_t offset;
+  {
+    IndexLock lock(indexMutex);
+    if (pageIndex->isComplete()) {
+      return false;
     }
+    offset = pageIndex->lastPageOffset();
   }
 
-  totalPages = pageOffsets.size();
-  LOG_DBG("TRS", "Built page index: %d pages", totalPages);
+  std::vector<std::string> lines;
+  size_t nextOffset = offset;
+  loadPageAtOffset(offset, lines, nextOffset);
+  if (nextOffset <= offset) {
+    LOG_ERR("TRS", "Page indexing stalled at offset %zu", offset);
+    return false;
+  }
+
+  IndexLock lock(indexMutex);
+  if (nextOffset >= fileSize) {
+    pageIndex->markComplete();
+    return false;
+  }
+  pageIndex->addPage(nextOffset);
+  return true;
 }
 
-bool TxtReaderActivity::loadPageAtOffset(size_t offset, std::vector<std::string>& outLines, size_t& nextOffset) {
+bool TxtReaderActivity::loadPageAtOffset(size_t offset, std::vector<std::string>& outLines,
+                                         size_t& nextOffset) const {
   outLines.clear();
   const size_t fileSize = txt->getFileSize();
 
@@ -189,6 +296,8 @@ bool TxtReaderActivity::loadPageAtOffset(size_t offset, std::vector<std::string>
   buffer[chunkSize] = '\0';
 
   // Parse lines from buffer
+  const TxtLineBreaker lineBreaker(renderer, cachedFontId, viewportWidth, cachedHyphenationEnabled,
+                                   cachedHyphenationLanguage);
   size_t pos = 0;
 
   while (pos < chunkSize && static_cast<int>(outLines.size()) < linesPerPage) {
@@ -201,77 +310,30 @@ bool TxtReaderActivity::loadPageAtOffset(size_t offset, std::vector<std::string>
     // Check if we have a complete line
     bool lineComplete = (lineEnd < chunkSize) || (offset + lineEnd >= fileSize);
 
-    if (!lineComplete && static_cast<int>(outLines.size()) > 0) {
-      // Incomplete line and we already have some lines, stop here
-      break;
-    }
-
     // Calculate the actual length of line content in the buffer (excluding newline)
     size_t lineContentLen = lineEnd - pos;
 
     // Check for carriage return
-    bool hasCR = (lineContentLen > 0 && buffer[pos + lineContentLen - 1] == '\r');
+    bool hasCR = lineComplete && lineContentLen > 0 && buffer[pos + lineContentLen - 1] == '\r';
     size_t displayLen = hasCR ? lineContentLen - 1 : lineContentLen;
 
-    // Extract line content for display (without CR/LF)
-    std::string line(reinterpret_cast<char*>(buffer + pos), displayLen);
-
-    // Track position within this source line (in bytes from pos)
-    size_t lineBytePos = 0;
-
-    // Word wrap if needed
-    while (!line.empty() && static_cast<int>(outLines.size()) < linesPerPage) {
-      int lineWidth = renderer.getTextWidth(cachedFontId, line.c_str());
-
-      if (lineWidth <= viewportWidth) {
-        outLines.push_back(line);
-        lineBytePos = displayLen;  // Consumed entire display content
-        line.clear();
-        break;
-      }
-
-      // Find break point
-      size_t breakPos = line.length();
-      while (breakPos > 0 && renderer.getTextWidth(cachedFontId, line.substr(0, breakPos).c_str()) > viewportWidth) {
-        // Try to break at space
-        size_t spacePos = line.rfind(' ', breakPos - 1);
-        if (spacePos != std::string::npos && spacePos > 0) {
-          breakPos = spacePos;
-        } else {
-          // Break at character boundary for UTF-8
-          breakPos--;
-          // Make sure we don't break in the middle of a UTF-8 sequence
-          while (breakPos > 0 && (line[breakPos] & 0xC0) == 0x80) {
-            breakPos--;
-          }
-        }
-      }
-
-      if (breakPos == 0) {
-        breakPos = 1;
-      }
-
-      outLines.push_back(line.substr(0, breakPos));
-
-      // Skip space at break point
-      size_t skipChars = breakPos;
-      if (breakPos < line.length() && line[breakPos] == ' ') {
-        skipChars++;
-      }
-      lineBytePos += skipChars;
-      line = line.substr(skipChars);
+    // Word wrap; the tail of a line cut off by the chunk is left for the next page
+    const char* line = reinterpret_cast<const char*>(buffer + pos);
+    const size_t maxLines = linesPerPage - outLines.size();
+    size_t consumed = lineBreaker.wrap(line, displayLen, maxLines, !lineComplete, outLines);
+    if (consumed == 0 && outLines.empty()) {
+      // Not even one full line fits in the chunk; show what we have rather than stall
+      consumed = lineBreaker.wrap(line, displayLen, maxLines, false, outLines);
     }
 
-    // Determine how much of the source buffer we consumed
-    if (line.empty()) {
-      // Fully consumed this source line, move past the newline
-      pos = lineEnd + 1;
-    } else {
-      // Partially consumed - page is full mid-line
-      // Move pos to where we stopped in the line (NOT past the line)
-      pos = pos + lineBytePos;
+    if (consumed < displayLen || !lineComplete) {
+      // Page is full mid-line - move pos to where we stopped in the line (NOT past the line)
+      pos += consumed;
       break;
     }
+
+    // Fully consumed this source line, move past the newline
+    pos = lineEnd + 1;
   }
 
   // Ensure we make progress even if calculations go wrong
@@ -292,6 +354,119 @@ bool TxtReaderActivity::loadPageAtOffset(size_t offset, std::vector<std::string>
   return !outLines.empty();
 }
 
+void TxtReaderActivity::applyPendingNavigation() {
+  const size_t fileSize = txt->getFileSize();
+
+  const int jumpPercent = pendingJumpPercent.exchange(-1);
+  if (jumpPercent >= 0) {
+    currentOffset = offsetForPercent(jumpPercent);
+    pendingPageTurn = 0;
+  }
+
+  int turns = pendingPageTurn.exchange(0);
+  while (turns > 0 && currentPageEnd < fileSize) {
+    currentOffset = currentPageEnd;
+    if (--turns > 0) {
+      std::vector<std::string> lines;
+      currentPageEnd = fileSize;
+      loadPageAtOffset(currentOffset, lines, currentPageEnd);
+    }
+  }
+  while (turns < 0 && currentOffset > 0) {
+    currentOffset = previousPageOffset(currentOffset);
+    turns++;
+  }
+
+  // A page laid out ahead of the index may straddle the pages the index later settled on; snap back onto them
+  IndexLock lock(indexMutex);
+  if (currentOffset <= pageIndex->lastPageOffset() && !pageIndex->isPageStart(currentOffset)) {
+    currentOffset = pageIndex->pageOffset(pageIndex->pageAtOffset(currentOffset));
+  }
+}
+
+size_t TxtReaderActivity::previousPageOffset(const size_t offset) const {
+  size_t start;
+  {
+    IndexLock lock(indexMutex);
+    const size_t page = pageIndex->pageAtOffset(offset - 1);
+    start = pageIndex->pageOffset(page);
+    if (page + 1 < pageIndex->pageCount() || pageIndex->isComplete()) {
+      // The page ending at (or containing) offset is indexed
+      return start;
+    }
+  }
+
+  // Beyond the index: lay out locally from the nearest line start and take the last page before offset
+  start = std::max(start, lineStartBefore(offset));
+  size_t previous = start;
+  std::vector<std::string> lines;
+  while (start < offset) {
+    size_t next = start;
+    loadPageAtOffset(start, lines, next);
+    if (next <= start) {
+      break;
+    }
+    previous = start;
+    start = next;
+  }
+  return previous;
+}
+
+size_t TxtReaderActivity::lineStartBefore(const size_t offset) const {
+  // A line starts after a newline at offset - 2 or earlier; search one chunk back
+  if (offset < 2) {
+    return 0;
+  }
+  const size_t windowStart = offset > CHUNK_SIZE ? offset - CHUNK_SIZE : 0;
+  const size_t windowSize = offset - 1 - windowStart;
+  auto* buffer = static_cast<uint8_t*>(malloc(windowSize));
+  if (!buffer) {
+    LOG_ERR("TRS", "Failed to allocate %zu bytes", windowSize);
+    return windowStart;
+  }
+  if (!txt->readContent(buffer, windowStart, windowSize)) {
+    free(buffer);
+    return windowStart;
+  }
+
+  // Prefer a real line start; a single huge paragraph falls back to the nearest word start
+  size_t start = windowStart;
+  for (const uint8_t separator : {static_cast<uint8_t>('\n'), static_cast<uint8_t>(' ')}) {
+    const auto* found = static_cast<const uint8_t*>(memrchr(buffer, separator, windowSize));
+    if (found) {
+      start = windowStart + (found - buffer) + 1;
+      break;
+    }
+  }
+  // Never start inside a UTF-8 sequence
+  while (start > windowStart && start < offset && (buffer[start - windowStart] & 0xC0) == 0x80) {
+    start++;
+  }
+  free(buffer);
+  return start;
+}
+
+size_t TxtReaderActivity::offsetForPercent(int percent) const {
+  const size_t fileSize = txt->getFileSize();
+  percent = std::max(0, std::min(100, percent));
+  // Overflow-safe fileSize * percent / 100
+  const size_t target = std::min(fileSize / 100 * percent + fileSize % 100 * percent / 100, fileSize - 1);
+  if (target == 0) {
+    return 0;
+  }
+
+  size_t knownStart;
+  {
+    IndexLock lock(indexMutex);
+    if (pageIndex->isComplete() || target < pageIndex->lastPageOffset()) {
+      return pageIndex->pageOffset(pageIndex->pageAtOffset(target));
+    }
+    knownStart = pageIndex->lastPageOffset();
+  }
+  // Not indexed yet: start at the nearest line start at or before the target
+  return std::max(knownStart, lineStartBefore(target + 1));
+}
+
 void TxtReaderActivity::render(RenderLock&&) {
   if (!txt) {
     return;
@@ -302,22 +477,20 @@ void TxtReaderActivity::render(RenderLock&&) {
     initializeReader();
   }
 
-  if (pageOffsets.empty()) {
+  if (txt->getFileSize() == 0) {
     renderer.clearScreen();
     renderer.drawCenteredText(UI_12_FONT_ID, 300, tr(STR_EMPTY_FILE), true, EpdFontFamily::BOLD);
     renderer.displayBuffer();
     return;
   }
 
-  // Bounds check
-  if (currentPage < 0) currentPage = 0;
-  if (currentPage >= totalPages) currentPage = totalPages - 1;
+  applyPendingNavigation();
 
   // Load current page content
-  size_t offset = pageOffsets[currentPage];
-  size_t nextOffset;
+  size_t nextOffset = txt->getFileSize();
   currentPageLines.clear();
-  loadPageAtOffset(offset, currentPageLines, nextOffset);
+  loadPageAtOffset(currentOffset, currentPageLines, nextOffset);
+  currentPageEnd = nextOffset;
 
   renderer.clearScreen();
   renderPage();
@@ -384,173 +557,83 @@ void TxtReaderActivity::renderPage() {
 }
 
 void TxtReaderActivity::renderStatusBar() const {
-  const float progress = totalPages > 0 ? (currentPage + 1) * 100.0f / totalPages : 0;
+  const size_t fileSize = txt->getFileSize();
+  const float progress = fileSize > 0 ? static_cast<float>(currentPageEnd) * 100.0f / fileSize : 0;
+
+  // While indexing, the page count is extrapolated and pages past the index are placed by byte offset
+  int page;
+  int pageCount;
+  {
+    IndexLock lock(indexMutex);
+    pageCount = static_cast<int>(pageIndex->estimatedPageCount());
+    if (currentOffset <= pageIndex->lastPageOffset() || pageIndex->isComplete()) {
+      page = static_cast<int>(pageIndex->pageAtOffset(currentOffset));
+    } else {
+      page = std::max(static_cast<int>(pageIndex->pageCount()),
+                      static_cast<int>(static_cast<uint64_t>(currentOffset) * pageCount / fileSize));
+    }
+  }
+
   std::string title;
   if (SETTINGS.statusBarTitle != CrossPointSettings::STATUS_BAR_TITLE::HIDE_TITLE) {
     title = txt->getTitle();
   }
-  GUI.drawStatusBar(renderer, progress, currentPage + 1, totalPages, title);
+  GUI.drawStatusBar(renderer, progress, page + 1, std::max(pageCount, page + 1), title);
 }
 
 void TxtReaderActivity::saveProgress() const {
+  uint32_t page;
+  {
+    IndexLock lock(indexMutex);
+    page = pageIndex->pageAtOffset(currentOffset);
+  }
   FsFile f;
   if (Storage.openFileForWrite("TRS", txt->getCachePath() + "/progress.bin", f)) {
-    uint8_t data[4];
-    data[0] = currentPage & 0xFF;
-    data[1] = (currentPage >> 8) & 0xFF;
+    uint8_t data[8];
+    data[0] = page & 0xFF;
+    data[1] = (page >> 8) & 0xFF;
     data[2] = 0;
     data[3] = 0;
-    f.write(data, 4);
+    // Byte offset of the page, so reading resumes in place even where the index has not reached yet
+    const auto offset = static_cast<uint32_t>(currentOffset);
+    data[4] = offset & 0xFF;
+    data[5] = (offset >> 8) & 0xFF;
+    data[6] = (offset >> 16) & 0xFF;
+    data[7] = (offset >> 24) & 0xFF;
+    f.write(data, 8);
     f.close();
   }
 }
 
 void TxtReaderActivity::loadProgress() {
   FsFile f;
-  if (Storage.openFileForRead("TRS", txt->getCachePath() + "/progress.bin", f)) {
-    uint8_t data[4];
-    if (f.read(data, 4) == 4) {
-      currentPage = data[0] + (data[1] << 8);
-      if (currentPage >= totalPages) {
-        currentPage = totalPages - 1;
-      }
-      if (currentPage < 0) {
-        currentPage = 0;
-      }
-      LOG_DBG("TRS", "Loaded progress: page %d/%d", currentPage, totalPages);
-    }
-    f.close();
-  }
-}
-
-bool TxtReaderActivity::loadPageIndexCache() {
-  // Cache file format (using serialization module):
-  // - uint32_t: magic "TXTI"
-  // - uint8_t: cache version
-  // - uint32_t: file size (to validate cache)
-  // - int32_t: viewport width
-  // - int32_t: lines per page
-  // - int32_t: font ID (to invalidate cache on font change)
-  // - int32_t: screen margin (to invalidate cache on margin change)
-  // - uint8_t: paragraph alignment (to invalidate cache on alignment change)
-  // - uint32_t: total pages count
-  // - N * uint32_t: page offsets
-
-  std::string cachePath = txt->getCachePath() + "/index.bin";
-  FsFile f;
-  if (!Storage.openFileForRead("TRS", cachePath, f)) {
-    LOG_DBG("TRS", "No page index cache found");
-    return false;
-  }
-
-  // Read and validate header using serialization module
-  uint32_t magic;
-  serialization::readPod(f, magic);
-  if (magic != CACHE_MAGIC) {
-    LOG_DBG("TRS", "Cache magic mismatch, rebuilding");
-    f.close();
-    return false;
-  }
-
-  uint8_t version;
-  serialization::readPod(f, version);
-  if (version != CACHE_VERSION) {
-    LOG_DBG("TRS", "Cache version mismatch (%d != %d), rebuilding", version, CACHE_VERSION);
-    f.close();
-    return false;
-  }
-
-  uint32_t fileSize;
-  serialization::readPod(f, fileSize);
-  if (fileSize != txt->getFileSize()) {
-    LOG_DBG("TRS", "Cache file size mismatch, rebuilding");
-    f.close();
-    return false;
-  }
-
-  int32_t cachedWidth;
-  serialization::readPod(f, cachedWidth);
-  if (cachedWidth != viewportWidth) {
-    LOG_DBG("TRS", "Cache viewport width mismatch, rebuilding");
-    f.close();
-    return false;
-  }
-
-  int32_t cachedLines;
-  serialization::readPod(f, cachedLines);
-  if (cachedLines != linesPerPage) {
-    LOG_DBG("TRS", "Cache lines per page mismatch, rebuilding");
-    f.close();
-    return false;
-  }
-
-  int32_t fontId;
-  serialization::readPod(f, fontId);
-  if (fontId != cachedFontId) {
-    LOG_DBG("TRS", "Cache font ID mismatch (%d != %d), rebuilding", fontId, cachedFontId);
-    f.close();
-    return false;
-  }
-
-  int32_t margin;
-  serialization::readPod(f, margin);
-  if (margin != cachedScreenMargin) {
-    LOG_DBG("TRS", "Cache screen margin mismatch, rebuilding");
-    f.close();
-    return false;
-  }
-
-  uint8_t alignment;
-  serialization::readPod(f, alignment);
-  if (alignment != cachedParagraphAlignment) {
-    LOG_DBG("TRS", "Cache paragraph alignment mismatch, rebuilding");
-    f.close();
-    return false;
-  }
-
-  uint32_t numPages;
-  serialization::readPod(f, numPages);
-
-  // Read page offsets
-  pageOffsets.clear();
-  pageOffsets.reserve(numPages);
-
-  for (uint32_t i = 0; i < numPages; i++) {
-    uint32_t offset;
-    serialization::readPod(f, offset);
-    pageOffsets.push_back(offset);
+  if (!Storage.openFileForRead("TRS", txt->getCachePath() + "/progress.bin", f)) {
+    return;
   }
-
+  uint8_t data[8];
+  const int bytesRead = f.read(data, 8);
   f.close();
-  totalPages = pageOffsets.size();
-  LOG_DBG("TRS", "Loaded page index cache: %d pages", totalPages);
-  return true;
-}
 
-void TxtReaderActivity::savePageIndexCache() const {
-  std::string cachePath = txt->getCachePath() + "/index.bin";
-  FsFile f;
-  if (!Storage.openFileForWrite("TRS", cachePath, f)) {
-    LOG_ERR("TRS", "Failed to save page index cache");
-    return;
+  const size_t fileSize = txt->getFileSize();
+  if (bytesRead == 8) {
+    currentOffset = data[4] | (data[5] << 8) | (data[6] << 16) | (static_cast<uint32_t>(data[7]) << 24);
+    if (currentOffset >= fileSize) {
+      currentOffset = 0;
+    }
+  } else if (bytesRead == 4) {
+    // Progress saved before offsets were stored: page forward to it once
+    const size_t page = data[0] + (data[1] << 8);
+    if (page > 0) {
+      GUI.drawPopup(renderer, tr(STR_INDEXING));
+    }
+    while (pageIndex->pageCount() <= page && indexNextPage()) {
+    }
+    currentOffset = pageIndex->pageOffset(std::min(page, pageIndex->pageCount() - 1));
   }
 
-  // Write header using serialization module
-  serialization::writePod(f, CACHE_MAGIC);
-  serialization::writePod(f, CACHE_VERSION);
-  serialization::writePod(f, static_cast<uint32_t>(txt->getFileSize()));
-  serialization::writePod(f, static_cast<int32_t>(viewportWidth));
-  serialization::writePod(f, static_cast<int32_t>(linesPerPage));
-  serialization::writePod(f, static_cast<int32_t>(cachedFontId));
-  serialization::writePod(f, static_cast<int32_t>(cachedScreenMargin));
-  serialization::writePod(f, cachedParagraphAlignment);
-  serialization::writePod(f, static_cast<uint32_t>(pageOffsets.size()));
-
-  // Write page offsets
-  for (size_t offset : pageOffsets) {
-    serialization::writePod(f, static_cast<uint32_t>(offset));
+  // Land on a page boundary where the index already knows them
+  if (currentOffset <= pageIndex->lastPageOffset() && !pageIndex->isPageStart(currentOffset)) {
+    currentOffset = pageIndex->pageOffset(pageIndex->pageAtOffset(currentOffset));
   }
-
-  f.close();
-  LOG_DBG("TRS", "Saved page index cache: %d pages", totalPages);
+  LOG_DBG("TRS", "Loaded progress: offset %zu/%zu", currentOffset, fileSize);
 }
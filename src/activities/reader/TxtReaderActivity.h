@@ -1,7 +1,12 @@
 #pragma once
 
 #include <Txt.h>
+#include <TxtPageIndex.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
 
+#include <atomic>
 #include <vector>
 
 #include "CrossPointSettings.h"
@@ -10,21 +15,32 @@
 class TxtReaderActivity final : public Activity {
   std::unique_ptr<Txt> txt;
 
-  int currentPage = 0;
-  int totalPages = 1;
   int pagesUntilFullRefresh = 0;
 
-  // Streaming text reader - stores file offsets for each page
-  std::vector<size_t> pageOffsets;  // File offset for start of each page
+  // Streaming text reader - the displayed page is identified by its file offset. Page numbers come from the page
+  // index, which is built in the background, so the reader can show any offset before indexing reaches it.
+  size_t currentOffset = 0;
+  size_t currentPageEnd = 0;  // Offset of the page after the displayed one
+  std::atomic<int> pendingPageTurn{0};  // Page turns requested by loop(), applied on the next render
+  std::atomic<int> pendingJumpPercent{-1};
   std::vector<std::string> currentPageLines;
   int linesPerPage = 0;
   int viewportWidth = 0;
   bool initialized = false;
 
+  // Page index, extended by a low-priority background task; guarded by indexMutex
+  std::unique_ptr<TxtPageIndex> pageIndex;
+  SemaphoreHandle_t indexMutex = nullptr;
+  TaskHandle_t indexTaskHandle = nullptr;
+  std::atomic<bool> indexStopRequested{false};
+  std::atomic<bool> indexTaskRunning{false};
+
   // Cached settings for cache validation (different fonts/margins require re-indexing)
   int cachedFontId = 0;
   uint8_t cachedScreenMargin = 0;
   uint8_t cachedParagraphAlignment = CrossPointSettings::LEFT_ALIGN;
+  bool cachedHyphenationEnabled = false;
+  std::string cachedHyphenationLanguage;
   int cachedOrientedMarginTop = 0;
   int cachedOrientedMarginRight = 0;
   int cachedOrientedMarginBottom = 0;
@@ -34,10 +50,16 @@ class TxtReaderActivity final : public Activity {
   void renderStatusBar() const;
 
   void initializeReader();
-  bool loadPageAtOffset(size_t offset, std::vector<std::string>& outLines, size_t& nextOffset);
-  void buildPageIndex();
-  bool loadPageIndexCache();
-  void savePageIndexCache() const;
+  bool loadPageAtOffset(size_t offset, std::vector<std::string>& outLines, size_t& nextOffset) const;
+  void applyPendingNavigation();
+  size_t previousPageOffset(size_t offset) const;
+  size_t lineStartBefore(size_t offset) const;
+  size_t offsetForPercent(int percent) const;
+  void startIndexing();
+  void stopIndexing();
+  static void indexTaskTrampoline(void* param);
+  void indexTaskLoop();
+  bool indexNextPage();
   void saveProgress() const;
   void loadProgress();
 
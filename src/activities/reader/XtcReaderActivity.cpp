@@ -11,6 +11,8 @@
 #include <GfxRenderer.h>
 #include <HalStorage.h>
 #include <I18n.h>
+#include <LibraryDb.h>
+#include <Xtc/XtcPageRenderer.h>
 
 #include "CrossPointSettings.h"
 #include "CrossPointState.h"
@@ -23,6 +25,8 @@
 namespace {
 constexpr unsigned long skipPageMs = 700;
 constexpr unsigned long goHomeMs = 1000;
+// Heap to leave free after allocating the prefetch page buffer (96KB per buffer for XTCH)
+constexpr uint32_t minFreeHeapWithPrefetch = 64 * 1024;
 }  // namespace
 
 void XtcReaderActivity::onEnter() {
@@ -40,7 +44,13 @@ void XtcReaderActivity::onEnter() {
   // Save current XTC as last opened book and add to recent books
   APP_STATE.openEpubPath = xtc->getPath();
   APP_STATE.saveToFile();
-  RECENT_BOOKS.addBook(xtc->getPath(), xtc->getTitle(), xtc->getAuthor(), xtc->getThumbBmpPath());
+  LibraryDb::Book book;
+  book.path = xtc->getPath();
+  book.title = xtc->getTitle();
+  book.author = xtc->getAuthor();
+  book.coverBmpPath = xtc->getCoverBmpPath();
+  book.thumbBmpPath = xtc->getThumbBmpPath();
+  RECENT_BOOKS.addBook(book);
 
   // Trigger first update
   requestUpdate();
@@ -51,6 +61,10 @@ void XtcReaderActivity::onExit() {
 
   APP_STATE.readerActivityLoadCount = 0;
   APP_STATE.saveToFile();
+  if (xtc && xtc->getPageCount() > 0) {
+    LibraryDb::setProgress(xtc->getPath(), (currentPage + 1) * 100 / xtc->getPageCount());
+  }
+  freePageBuffers();
   xtc.reset();
 }
 
@@ -109,6 +123,7 @@ void XtcReaderActivity::loop() {
   const int skipAmount = skipPages ? 10 : 1;
 
   if (prevTriggered) {
+    pageDirection = -1;
     if (currentPage >= static_cast<uint32_t>(skipAmount)) {
       currentPage -= skipAmount;
     } else {
@@ -116,6 +131,7 @@ void XtcReaderActivity::loop() {
     }
     requestUpdate();
   } else if (nextTriggered) {
+    pageDirection = 1;
     currentPage += skipAmount;
     if (currentPage >= xtc->getPageCount()) {
       currentPage = xtc->getPageCount();  // Allow showing "End of book"
@@ -142,184 +158,109 @@ void XtcReaderActivity::render(RenderLock&&) {
   saveProgress();
 }
 
-void XtcReaderActivity::renderPage() {
-  const uint16_t pageWidth = xtc->getPageWidth();
-  const uint16_t pageHeight = xtc->getPageHeight();
-  const uint8_t bitDepth = xtc->getBitDepth();
+uint8_t* XtcReaderActivity::acquirePage(const uint32_t page) {
+  for (int slot = 0; slot < 2; slot++) {
+    if (pageBuffers[slot] && bufferedPage[slot] == page) {
+      shownSlot = slot;
+      return pageBuffers[slot];
+    }
+  }
 
-  // Calculate buffer size for one page
-  // XTG (1-bit): Row-major, ((width+7)/8) * height bytes
-  // XTH (2-bit): Two bit planes, column-major, ((width * height + 7) / 8) * 2 bytes
-  size_t pageBufferSize;
-  if (bitDepth == 2) {
-    pageBufferSize = ((static_cast<size_t>(pageWidth) * pageHeight + 7) / 8) * 2;
-  } else {
-    pageBufferSize = ((pageWidth + 7) / 8) * pageHeight;
+  if (!pageBuffers[0]) {
+    pageBufferSize = xtc::pageBufferSize(xtc->getPageWidth(), xtc->getPageHeight(), xtc->getBitDepth());
+    pageBuffers[0] = static_cast<uint8_t*>(malloc(pageBufferSize));
+    if (!pageBuffers[0]) {
+      LOG_ERR("XTR", "Failed to allocate page buffer (%lu bytes)", pageBufferSize);
+      return nullptr;
+    }
+    // The prefetch buffer is optional: without it every page is read on demand
+    pageBuffers[1] = static_cast<uint8_t*>(malloc(pageBufferSize));
+    if (pageBuffers[1] && ESP.getFreeHeap() < minFreeHeapWithPrefetch) {
+      free(pageBuffers[1]);
+      pageBuffers[1] = nullptr;
+    }
+    LOG_DBG("XTR", "Page buffers: %lu bytes, prefetch %s", pageBufferSize, pageBuffers[1] ? "on" : "off");
   }
 
-  // Allocate page buffer
-  uint8_t* pageBuffer = static_cast<uint8_t*>(malloc(pageBufferSize));
-  if (!pageBuffer) {
-    LOG_ERR("XTR", "Failed to allocate page buffer (%lu bytes)", pageBufferSize);
-    renderer.clearScreen();
-    renderer.drawCenteredText(UI_12_FONT_ID, 300, tr(STR_MEMORY_ERROR), true, EpdFontFamily::BOLD);
-    renderer.displayBuffer();
+  // Keep the page on screen intact until it is replaced, in case the load fails
+  const int slot = pageBuffers[1] ? 1 - shownSlot : 0;
+  bufferedPage[slot] = NO_PAGE;
+  if (xtc->loadPage(page, pageBuffers[slot], pageBufferSize) == 0) {
+    return nullptr;
+  }
+  bufferedPage[slot] = page;
+  shownSlot = slot;
+  return pageBuffers[slot];
+}
+
+void XtcReaderActivity::prefetchPage(const uint32_t page) {
+  const int slot = 1 - shownSlot;
+  if (!pageBuffers[slot] || page >= xtc->getPageCount() || bufferedPage[slot] == page) {
     return;
   }
+  bufferedPage[slot] = NO_PAGE;
+  if (xtc->loadPage(page, pageBuffers[slot], pageBufferSize) != 0) {
+    bufferedPage[slot] = page;
+  }
+}
 
-  // Load page data
-  size_t bytesRead = xtc->loadPage(currentPage, pageBuffer, pageBufferSize);
-  if (bytesRead == 0) {
+void XtcReaderActivity::freePageBuffers() {
+  for (int slot = 0; slot < 2; slot++) {
+    free(pageBuffers[slot]);
+    pageBuffers[slot] = nullptr;
+    bufferedPage[slot] = NO_PAGE;
+  }
+}
+
+void XtcReaderActivity::renderPage() {
+  const uint16_t pageWidth = xtc->getPageWidth();
+  const uint16_t pageHeight = xtc->getPageHeight();
+  const uint8_t bitDepth = xtc->getBitDepth();
+
+  const uint8_t* pageBuffer = acquirePage(currentPage);
+  if (!pageBuffer) {
     LOG_ERR("XTR", "Failed to load page %lu", currentPage);
-    free(pageBuffer);
     renderer.clearScreen();
-    renderer.drawCenteredText(UI_12_FONT_ID, 300, tr(STR_PAGE_LOAD_ERROR), true, EpdFontFamily::BOLD);
+    renderer.drawCenteredText(UI_12_FONT_ID, 300, pageBuffers[0] ? tr(STR_PAGE_LOAD_ERROR) : tr(STR_MEMORY_ERROR),
+                              true, EpdFontFamily::BOLD);
     renderer.displayBuffer();
     return;
   }
 
-  // Clear screen first
-  renderer.clearScreen();
-
-  // Copy page bitmap using GfxRenderer's drawPixel
   // XTC/XTCH pages are pre-rendered with status bar included, so render full page
-  const uint16_t maxSrcY = pageHeight;
+  xtc::drawPage(renderer, pageBuffer, pageWidth, pageHeight, bitDepth, GfxRenderer::BW);
 
-  if (bitDepth == 2) {
-    // XTH 2-bit mode: Two bit planes, column-major order
-    // - Columns scanned right to left (x = width-1 down to 0)
-    // - 8 vertical pixels per byte (MSB = topmost pixel in group)
-    // - First plane: Bit1, Second plane: Bit2
-    // - Pixel value = (bit1 << 1) | bit2
-    // - Grayscale: 0=White, 1=Dark Grey, 2=Light Grey, 3=Black
-
-    const size_t planeSize = (static_cast<size_t>(pageWidth) * pageHeight + 7) / 8;
-    const uint8_t* plane1 = pageBuffer;              // Bit1 plane
-    const uint8_t* plane2 = pageBuffer + planeSize;  // Bit2 plane
-    const size_t colBytes = (pageHeight + 7) / 8;    // Bytes per column (100 for 800 height)
-
-    // Lambda to get pixel value at (x, y)
-    auto getPixelValue = [&](uint16_t x, uint16_t y) -> uint8_t {
-      const size_t colIndex = pageWidth - 1 - x;
-      const size_t byteInCol = y / 8;
-      const size_t bitInByte = 7 - (y % 8);
-      const size_t byteOffset = colIndex * colBytes + byteInCol;
-      const uint8_t bit1 = (plane1[byteOffset] >> bitInByte) & 1;
-      const uint8_t bit2 = (plane2[byteOffset] >> bitInByte) & 1;
-      return (bit1 << 1) | bit2;
-    };
+  // Display with appropriate refresh
+  if (pagesUntilFullRefresh <= 1) {
+    renderer.displayBuffer(HalDisplay::HALF_REFRESH);
+    pagesUntilFullRefresh = SETTINGS.getRefreshFrequency();
+  } else {
+    renderer.displayBuffer();
+    pagesUntilFullRefresh--;
+  }
 
+  if (bitDepth == 2) {
     // Optimized grayscale rendering without storeBwBuffer (saves 48KB peak memory)
     // Flow: BW display → LSB/MSB passes → grayscale display → re-render BW for next frame
-
-    // Count pixel distribution for debugging
-    uint32_t pixelCounts[4] = {0, 0, 0, 0};
-    for (uint16_t y = 0; y < pageHeight; y++) {
-      for (uint16_t x = 0; x < pageWidth; x++) {
-        pixelCounts[getPixelValue(x, y)]++;
-      }
-    }
-    LOG_DBG("XTR", "Pixel distribution: White=%lu, DarkGrey=%lu, LightGrey=%lu, Black=%lu", pixelCounts[0],
-            pixelCounts[1], pixelCounts[2], pixelCounts[3]);
-
-    // Pass 1: BW buffer - draw all non-white pixels as black
-    for (uint16_t y = 0; y < pageHeight; y++) {
-      for (uint16_t x = 0; x < pageWidth; x++) {
-        if (getPixelValue(x, y) >= 1) {
-          renderer.drawPixel(x, y, true);
-        }
-      }
-    }
-
-    // Display BW with conditional refresh based on pagesUntilFullRefresh
-    if (pagesUntilFullRefresh <= 1) {
-      renderer.displayBuffer(HalDisplay::HALF_REFRESH);
-      pagesUntilFullRefresh = SETTINGS.getRefreshFrequency();
-    } else {
-      renderer.displayBuffer();
-      pagesUntilFullRefresh--;
-    }
-
-    // Pass 2: LSB buffer - mark DARK gray only (XTH value 1)
-    // In LUT: 0 bit = apply gray effect, 1 bit = untouched
-    renderer.clearScreen(0x00);
-    for (uint16_t y = 0; y < pageHeight; y++) {
-      for (uint16_t x = 0; x < pageWidth; x++) {
-        if (getPixelValue(x, y) == 1) {  // Dark grey only
-          renderer.drawPixel(x, y, false);
-        }
-      }
-    }
+    xtc::drawPage(renderer, pageBuffer, pageWidth, pageHeight, bitDepth, GfxRenderer::GRAYSCALE_LSB);
     renderer.copyGrayscaleLsbBuffers();
-
-    // Pass 3: MSB buffer - mark LIGHT AND DARK gray (XTH value 1 or 2)
-    // In LUT: 0 bit = apply gray effect, 1 bit = untouched
-    renderer.clearScreen(0x00);
-    for (uint16_t y = 0; y < pageHeight; y++) {
-      for (uint16_t x = 0; x < pageWidth; x++) {
-        const uint8_t pv = getPixelValue(x, y);
-        if (pv == 1 || pv == 2) {  // Dark grey or Light grey
-          renderer.drawPixel(x, y, false);
-        }
-      }
-    }
+    xtc::drawPage(renderer, pageBuffer, pageWidth, pageHeight, bitDepth, GfxRenderer::GRAYSCALE_MSB);
     renderer.copyGrayscaleMsbBuffers();
-
-    // Display grayscale overlay
     renderer.displayGrayBuffer();
 
-    // Pass 4: Re-render BW to framebuffer (restore for next frame, instead of restoreBwBuffer)
-    renderer.clearScreen();
-    for (uint16_t y = 0; y < pageHeight; y++) {
-      for (uint16_t x = 0; x < pageWidth; x++) {
-        if (getPixelValue(x, y) >= 1) {
-          renderer.drawPixel(x, y, true);
-        }
-      }
-    }
-
-    // Cleanup grayscale buffers with current frame buffer
+    // Re-render BW to framebuffer (restore for next frame, instead of restoreBwBuffer)
+    xtc::drawPage(renderer, pageBuffer, pageWidth, pageHeight, bitDepth, GfxRenderer::BW);
     renderer.cleanupGrayscaleWithFrameBuffer();
-
-    free(pageBuffer);
-
-    LOG_DBG("XTR", "Rendered page %lu/%lu (2-bit grayscale)", currentPage + 1, xtc->getPageCount());
-    return;
-  } else {
-    // 1-bit mode: 8 pixels per byte, MSB first
-    const size_t srcRowBytes = (pageWidth + 7) / 8;  // 60 bytes for 480 width
-
-    for (uint16_t srcY = 0; srcY < maxSrcY; srcY++) {
-      const size_t srcRowStart = srcY * srcRowBytes;
-
-      for (uint16_t srcX = 0; srcX < pageWidth; srcX++) {
-        // Read source pixel (MSB first, bit 7 = leftmost pixel)
-        const size_t srcByte = srcRowStart + srcX / 8;
-        const size_t srcBit = 7 - (srcX % 8);
-        const bool isBlack = !((pageBuffer[srcByte] >> srcBit) & 1);  // XTC: 0 = black, 1 = white
-
-        if (isBlack) {
-          renderer.drawPixel(srcX, srcY, true);
-        }
-      }
-    }
   }
-  // White pixels are already cleared by clearScreen()
-
-  free(pageBuffer);
 
-  // XTC pages already have status bar pre-rendered, no need to add our own
+  LOG_DBG("XTR", "Rendered page %lu/%lu (%u-bit)", currentPage + 1, xtc->getPageCount(), bitDepth);
 
-  // Display with appropriate refresh
-  if (pagesUntilFullRefresh <= 1) {
-    renderer.displayBuffer(HalDisplay::HALF_REFRESH);
-    pagesUntilFullRefresh = SETTINGS.getRefreshFrequency();
+  // The panel is done; read the page the reader is most likely to turn to next while they read this one
+  if (pageDirection > 0 || currentPage == 0) {
+    prefetchPage(currentPage + 1);
   } else {
-    renderer.displayBuffer();
-    pagesUntilFullRefresh--;
+    prefetchPage(currentPage - 1);
   }
-
-  LOG_DBG("XTR", "Rendered page %lu/%lu (%u-bit)", currentPage + 1, xtc->getPageCount(), bitDepth);
 }
 
 void XtcReaderActivity::saveProgress() const {
@@ -14,9 +14,21 @@
 class XtcReaderActivity final : public Activity {
   std::shared_ptr<Xtc> xtc;
 
+  static constexpr uint32_t NO_PAGE = UINT32_MAX;
+
   uint32_t currentPage = 0;
   int pagesUntilFullRefresh = 0;
 
+  // Double-buffered page data: the page on screen plus the neighbour prefetched after its refresh
+  uint8_t* pageBuffers[2] = {nullptr, nullptr};
+  uint32_t bufferedPage[2] = {NO_PAGE, NO_PAGE};
+  size_t pageBufferSize = 0;
+  int shownSlot = 0;
+  int pageDirection = 1;
+
+  uint8_t* acquirePage(uint32_t page);
+  void prefetchPage(uint32_t page);
+  void freePageBuffers();
   void renderPage();
   void saveProgress() const;
   void loadProgress();
@@ -94,7 +94,7 @@ void ClearCacheActivity::clearCache() {
     file.getName(name, sizeof(name));
     String itemName(name);
 
-    // Only delete directories starting with epub_ or xtc_
+    // Only delete book cache directories (epub_, xtc_) and cache files in the top level
     if (file.isDirectory() && (itemName.startsWith("epub_") || itemName.startsWith("xtc_"))) {
       String fullPath = "/.crosspoint/" + itemName;
       LOG_DBG("CLEAR_CACHE", "Removing cache: %s", fullPath.c_str());
@@ -107,6 +107,19 @@ void ClearCacheActivity::clearCache() {
         LOG_ERR("CLEAR_CACHE", "Failed to remove: %s", fullPath.c_str());
         failedCount++;
       }
+    } else if (!file.isDirectory() && (itemName.startsWith("frame_") || itemName.endsWith(".tmp"))) {
+      // Packed sleep-image frames (see PackedFrameCache::pathFor) and temp files left by interrupted writes
+      String fullPath = "/.crosspoint/" + itemName;
+      LOG_DBG("CLEAR_CACHE", "Removing cache file: %s", fullPath.c_str());
+
+      file.close();
+
+      if (Storage.remove(fullPath.c_str())) {
+        clearedCount++;
+      } else {
+        LOG_ERR("CLEAR_CACHE", "Failed to remove: %s", fullPath.c_str());
+        failedCount++;
+      }
     } else {
       file.close();
     }
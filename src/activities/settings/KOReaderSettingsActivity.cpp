@@ -7,15 +7,17 @@
 
 #include "KOReaderAuthActivity.h"
 #include "KOReaderCredentialStore.h"
+#include "KOReaderDocumentIdCache.h"
 #include "MappedInputManager.h"
 #include "activities/util/KeyboardEntryActivity.h"
 #include "components/UITheme.h"
 #include "fontIds.h"
 
 namespace {
-constexpr int MENU_ITEMS = 5;
+constexpr int MENU_ITEMS = 6;
+constexpr unsigned long HASH_PROGRESS_INTERVAL_MS = 2000;
 const StrId menuNames[MENU_ITEMS] = {StrId::STR_USERNAME, StrId::STR_PASSWORD, StrId::STR_SYNC_SERVER_URL,
-                                     StrId::STR_DOCUMENT_MATCHING, StrId::STR_AUTHENTICATE};
+                                     StrId::STR_DOCUMENT_MATCHING, StrId::STR_AUTHENTICATE, StrId::STR_HASH_ALL_BOOKS};
 }  // namespace
 
 void KOReaderSettingsActivity::onEnter() {
@@ -108,6 +110,30 @@ void KOReaderSettingsActivity::handleSelection() {
       return;
     }
     startActivityForResult(std::make_unique<KOReaderAuthActivity>(renderer, mappedInput), [](const ActivityResult&) {});
+  } else if (selectedIndex == 5) {
+    // Hash All Books - fill the document ID cache so binary matching never has to read a book during sync. Back
+    // stops it; the IDs computed by then stay cached.
+    {
+      RenderLock lock(*this);
+      const auto labels = mappedInput.mapLabels(tr(STR_CANCEL), "", "", "");
+      GUI.drawButtonHints(renderer, labels.btn1, labels.btn2, labels.btn3, labels.btn4);
+      Rect popupRect = GUI.drawPopup(renderer, tr(STR_CALC_HASH));
+      unsigned long lastShown = millis();
+      const auto onProgress = [this, &popupRect, &lastShown](const size_t done, const std::string&) {
+        // Every refresh costs e-ink time, so the count is redrawn at most once per interval
+        if (millis() - lastShown >= HASH_PROGRESS_INTERVAL_MS) {
+          char message[64];
+          snprintf(message, sizeof(message), tr(STR_HASHING_BOOKS_FORMAT), static_cast<int>(done));
+          renderer.fillRect(popupRect.x - 2, popupRect.y - 2, popupRect.width + 4, popupRect.height + 4, false);
+          popupRect = GUI.drawPopup(renderer, message);
+          lastShown = millis();
+        }
+        mappedInput.update();
+        return !mappedInput.wasPressed(MappedInputManager::Button::Back);
+      };
+      hashedBooks = static_cast<int>(KOReaderDocumentIdCache::precompute("/", onProgress));
+    }
+    requestUpdate();
   }
 }
 
@@ -141,6 +167,11 @@ void KOReaderSettingsActivity::render(RenderLock&&) {
                                                                                   : std::string(tr(STR_BINARY));
         } else if (index == 4) {
           return KOREADER_STORE.hasCredentials() ? "" : std::string("[") + tr(STR_SET_CREDENTIALS_FIRST) + "]";
+        } else if (index == 5) {
+          if (hashedBooks < 0) return std::string();
+          char hashedStr[32];
+          snprintf(hashedStr, sizeof(hashedStr), tr(STR_BOOKS_HASHED_FORMAT), hashedBooks);
+          return std::string(hashedStr);
         }
         return std::string(tr(STR_NOT_SET));
       },
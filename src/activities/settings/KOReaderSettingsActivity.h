@@ -5,7 +5,7 @@
 
 /**
  * Submenu for KOReader Sync settings.
- * Shows username, password, and authenticate options.
+ * Shows username, password, and authenticate options, and hashes the library for binary document matching.
  */
 class KOReaderSettingsActivity final : public Activity {
  public:
@@ -21,6 +21,7 @@ class KOReaderSettingsActivity final : public Activity {
   ButtonNavigator buttonNavigator;
 
   size_t selectedIndex = 0;
+  int hashedBooks = -1;  // IDs computed by the last "Hash All Books", -1 before it runs
 
   void handleSelection();
 };
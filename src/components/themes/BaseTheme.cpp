@@ -5,6 +5,7 @@
 #include <HalStorage.h>
 #include <Logging.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <string>
 
@@ -628,6 +629,56 @@ void BaseTheme::fillPopupProgress(const GfxRenderer& renderer, const Rect& layou
   renderer.displayBuffer(HalDisplay::FAST_REFRESH);
 }
 
+Rect BaseTheme::drawTextSheet(const GfxRenderer& renderer, const int anchorY, const bool above, const int space,
+                              const char* title, const char* note, const std::string& text) const {
+  constexpr int margin = 10;
+  constexpr int padding = 8;
+  const int lineHeight = renderer.getLineHeight(UI_10_FONT_ID);
+  const int titleHeight = renderer.getLineHeight(UI_12_FONT_ID);
+  const int w = renderer.getScreenWidth() - margin * 2;
+  const int textWidth = w - padding * 2;
+  const int maxLines = std::max(1, (space - margin * 2 - titleHeight - padding * 2) / lineHeight);
+
+  std::vector<std::string> lines;
+  size_t start = 0;
+  while (start <= text.size() && static_cast<int>(lines.size()) < maxLines) {
+    size_t end = text.find('\n', start);
+    if (end == std::string::npos) end = text.size();
+    const std::string paragraph = text.substr(start, end - start);
+    if (!paragraph.empty()) {
+      const int remaining = maxLines - static_cast<int>(lines.size());
+      for (auto& line : renderer.wrappedText(UI_10_FONT_ID, paragraph.c_str(), textWidth, remaining)) {
+        lines.push_back(std::move(line));
+      }
+    }
+    start = end + 1;
+  }
+
+  const int h = titleHeight + static_cast<int>(lines.size()) * lineHeight + padding * 2;
+  const int y = above ? anchorY - margin - h : anchorY + margin;
+  renderer.fillRect(margin, y, w, h, false);
+  renderer.drawRect(margin, y, w, h, 2, true);
+
+  int textY = y + padding;
+  const std::string heading = renderer.truncatedText(UI_12_FONT_ID, title, textWidth, EpdFontFamily::BOLD);
+  renderer.drawText(UI_12_FONT_ID, margin + padding, textY, heading.c_str(), true, EpdFontFamily::BOLD);
+  if (note && note[0] != '\0') {
+    const int headingWidth = renderer.getTextWidth(UI_12_FONT_ID, heading.c_str(), EpdFontFamily::BOLD);
+    const int noteWidth = textWidth - headingWidth - padding * 2;
+    if (noteWidth > 0) {
+      const std::string shown = renderer.truncatedText(SMALL_FONT_ID, note, noteWidth);
+      const int noteX = margin + padding + textWidth - renderer.getTextWidth(SMALL_FONT_ID, shown.c_str());
+      renderer.drawText(SMALL_FONT_ID, noteX, textY, shown.c_str());
+    }
+  }
+  textY += titleHeight;
+  for (const auto& line : lines) {
+    renderer.drawText(UI_10_FONT_ID, margin + padding, textY, line.c_str());
+    textY += lineHeight;
+  }
+  return Rect{margin, y, w, h};
+}
+
 void BaseTheme::drawStatusBar(GfxRenderer& renderer, const float bookProgress, const int currentPage,
                               const int pageCount, std::string title, const int paddingBottom,
                               const int textYOffset) const {
@@ -135,6 +135,11 @@ class BaseTheme {
                               const std::function<UIIcon(int index)>& rowIcon) const;
   virtual Rect drawPopup(const GfxRenderer& renderer, const char* message) const;
   virtual void fillPopupProgress(const GfxRenderer& renderer, const Rect& layout, const int progress) const;
+  // Framed full-width sheet over the page: a bold title, an optional small note at its right, and the text's
+  // paragraphs wrapped below. It sits just above anchorY when `above`, otherwise just below, and the text is cut so the
+  // sheet and its margins fit in `space` pixels.
+  virtual Rect drawTextSheet(const GfxRenderer& renderer, int anchorY, bool above, int space, const char* title,
+                             const char* note, const std::string& text) const;
   virtual void drawStatusBar(GfxRenderer& renderer, const float bookProgress, const int currentPage,
                              const int pageCount, std::string title, const int paddingBottom = 0,
                              const int textYOffset = 0) const;
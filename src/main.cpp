@@ -22,8 +22,10 @@
 #include "RecentBooksStore.h"
 #include "activities/Activity.h"
 #include "activities/ActivityManager.h"
+#include "activities/reader/ResumeSnapshot.h"
 #include "components/UITheme.h"
 #include "fontIds.h"
+#include "util/BootProfiler.h"
 #include "util/ButtonNavigator.h"
 #include "util/ScreenshotUtil.h"
 
@@ -185,6 +187,7 @@ void enterDeepSleep() {
   HalPowerManager::Lock powerLock;  // Ensure we are at normal CPU frequency for sleep preparation
   APP_STATE.lastSleepFromReader = activityManager.isReaderActivity();
   APP_STATE.saveToFile();
+  ResumeSnapshot::saveForSleep(renderer);
 
   activityManager.goToSleep();
 
@@ -230,10 +233,12 @@ void setupDisplayAndFonts() {
 
 void setup() {
   t1 = millis();
+  BootProfiler::mark("reset to setup");
 
   HalSystem::begin();
   gpio.begin();
   powerManager.begin();
+  BootProfiler::mark("hal");
 
   // Only start serial if USB connected
   if (gpio.isUsbConnected()) {
@@ -243,6 +248,7 @@ void setup() {
     while (!Serial && (millis() - start) < 3000) {
       delay(10);
     }
+    BootProfiler::mark("serial");
   }
 
   // SD Card Initialization
@@ -253,15 +259,16 @@ void setup() {
     activityManager.goToFullScreenMessage("SD card error", EpdFontFamily::BOLD);
     return;
   }
+  BootProfiler::mark("storage");
 
   HalSystem::checkPanic();
   HalSystem::clearPanic();  // TODO: move this to an activity when we have one to display the panic info
 
   SETTINGS.loadFromFile();
   I18N.loadSettings();
-  KOREADER_STORE.loadFromFile();
   UITheme::getInstance().reload();
   ButtonNavigator::setMappedInputManager(mappedInputManager);
+  BootProfiler::mark("settings");
 
   switch (gpio.getWakeupReason()) {
     case HalGPIO::WakeupReason::PowerButton:
@@ -280,16 +287,28 @@ void setup() {
     default:
       break;
   }
+  BootProfiler::mark("wakeup check");
 
   // First serial output only here to avoid timing inconsistencies for power button press duration verification
   LOG_DBG("MAIN", "Starting CrossPoint version " CROSSPOINT_VERSION);
 
   setupDisplayAndFonts();
-
-  activityManager.goToBoot();
+  BootProfiler::mark("display and fonts");
 
   APP_STATE.loadFromFile();
+  // Waking into the reader shows the page it went to sleep on in place of the boot screen while the book opens
+  const bool wakingIntoReader =
+      !APP_STATE.openEpubPath.empty() && APP_STATE.lastSleepFromReader && APP_STATE.readerActivityLoadCount == 0;
+  if (wakingIntoReader && !mappedInputManager.isPressed(MappedInputManager::Button::Back) &&
+      ResumeSnapshot::show(renderer, APP_STATE.openEpubPath)) {
+    BootProfiler::mark("resume snapshot");
+  } else {
+    activityManager.goToBoot();
+    BootProfiler::mark("boot screen");
+  }
+
   RECENT_BOOKS.loadFromFile();
+  BootProfiler::mark("state");
 
   // Boot to home screen if no book is open, last sleep was not from reader, back button is held, or reader activity
   // crashed (indicated by readerActivityLoadCount > 0)
@@ -307,6 +326,7 @@ void setup() {
 
   // Ensure we're not still holding the power button before leaving setup
   waitForPowerRelease();
+  BootProfiler::mark("setup done");
 }
 
 void loop() {
@@ -336,10 +356,20 @@ void loop() {
         uint8_t* buf = display.getFrameBuffer();
         logSerial.write(buf, HalDisplay::BUFFER_SIZE);
         logSerial.printf("SCREENSHOT_END\n");
+      } else if (cmd == "BOOT_PROFILE") {
+        BootProfiler::report();
       }
     }
   }
 
+  // Nothing before the first screen needs the KOReader credentials, so they are loaded once it is up. Loading them
+  // here keeps it on the main task rather than in a render of the settings that first reads them.
+  static bool deferredInitDone = false;
+  if (!deferredInitDone && BootProfiler::isFinished()) {
+    deferredInitDone = true;
+    KOReaderCredentialStore::getInstance();
+  }
+
   // Check for any user activity (button press or release) or active background work
   static unsigned long lastActivityTime = millis();
   if (gpio.wasAnyPressed() || gpio.wasAnyReleased() || activityManager.preventAutoSleep()) {
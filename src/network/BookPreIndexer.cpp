@@ -0,0 +1,412 @@
+#include "BookPreIndexer.h"
+
+#include <Arduino.h>
+#include <Epub.h>
+#include <Epub/Section.h>
+#include <FsHelpers.h>
+#include <GfxRenderer.h>
+#include <HalStorage.h>
+#include <KOReaderCredentialStore.h>
+#include <KOReaderDocumentIdCache.h>
+#include <LibraryDb.h>
+#include <Logging.h>
+#include <Serialization.h>
+#include <Xtc.h>
+
+#include <algorithm>
+
+#include "CrossPointSettings.h"
+#include "activities/RenderLock.h"
+#include "activities/reader/ReaderUtils.h"
+#include "components/UITheme.h"
+
+namespace {
+constexpr char QUEUE_FILE[] = "/.crosspoint/preindex.bin";
+constexpr uint8_t QUEUE_FILE_VERSION = 1;
+constexpr size_t MAX_QUEUED_BOOKS = 64;
+// Quiet period after the last transfer chunk before a job step may start
+constexpr unsigned long TRANSFER_IDLE_MS = 3000;
+constexpr TickType_t POLL_INTERVAL = pdMS_TO_TICKS(250);
+// Loading an EPUB and laying out a section on top of the running web server needs headroom
+constexpr uint32_t MIN_FREE_HEAP = 64 * 1024;
+// Steps share the renderer's fonts, the image decoders and the hyphenation language with the UI, so they run under
+// the render lock. The wait is bounded because stop() may be called by a lock holder.
+constexpr uint32_t RENDER_LOCK_WAIT_MS = 50;
+// Longest stretch a section layout holds the render lock before letting the UI draw
+constexpr unsigned long LAYOUT_SLICE_MS = 100;
+
+class QueueLock {
+  SemaphoreHandle_t mutex;
+
+ public:
+  explicit QueueLock(SemaphoreHandle_t mutex) : mutex(mutex) { xSemaphoreTake(mutex, portMAX_DELAY); }
+  ~QueueLock() { xSemaphoreGive(mutex); }
+  QueueLock(const QueueLock&) = delete;
+  QueueLock& operator=(const QueueLock&) = delete;
+};
+}  // namespace
+
+BookPreIndexer::BookPreIndexer(GfxRenderer& renderer) : renderer(renderer), mutex(xSemaphoreCreateMutex()) {}
+
+BookPreIndexer::~BookPreIndexer() {
+  stop();
+  vSemaphoreDelete(mutex);
+}
+
+void BookPreIndexer::start() {
+  if (taskRunning) {
+    return;
+  }
+  loadQueue();
+
+  stopRequested = false;
+  taskRunning = true;
+  // Same priority as the main loop: the file transfer screen never blocks it, so a lower priority would starve.
+  // Jobs only run while no transfer is active, which keeps uploads at full speed.
+  const BaseType_t created = xTaskCreate(&taskTrampoline, "BookPreIndexer",
+                                         8192,        // Stack size
+                                         this,        // Parameters
+                                         1,           // Priority
+                                         &taskHandle  // Task handle
+  );
+  if (created != pdPASS) {
+    LOG_ERR("PIX", "Failed to start pre-indexing task");
+    taskRunning = false;
+    taskHandle = nullptr;
+  }
+}
+
+void BookPreIndexer::stop() {
+  if (!taskRunning) {
+    return;
+  }
+  LOG_DBG("PIX", "Cancelling pre-indexing");
+  stopRequested = true;
+  while (taskRunning) {
+    vTaskDelay(pdMS_TO_TICKS(10));
+  }
+  taskHandle = nullptr;
+}
+
+void BookPreIndexer::enqueue(const std::string& path) {
+  if (!FsHelpers::hasEpubExtension(path) && !FsHelpers::hasXtcExtension(path)) {
+    return;
+  }
+
+  QueueLock lock(mutex);
+  // A re-upload of the book being prepared restarts it; the old file's caches were just cleared
+  if (!queue.empty() && queue.front() == path) {
+    currentStep = Step::Metadata;
+    restartCurrent = true;
+  } else if (std::find(queue.begin(), queue.end(), path) == queue.end()) {
+    if (queue.size() >= MAX_QUEUED_BOOKS) {
+      LOG_DBG("PIX", "Queue full, not pre-indexing %s", path.c_str());
+      return;
+    }
+    queue.push_back(path);
+  }
+  revision++;
+  saveQueue();
+  LOG_DBG("PIX", "Queued %s (%zu queued)", path.c_str(), queue.size());
+}
+
+void BookPreIndexer::noteTransferActivity() { lastTransferAt = millis(); }
+
+BookPreIndexer::Status BookPreIndexer::getStatus() const {
+  QueueLock lock(mutex);
+  Status status;
+  if (!queue.empty()) {
+    status.current = queue.front();
+    status.step = currentStep;
+    status.pending = queue.size() - 1;
+  }
+  status.completed = completed;
+  status.waiting = waiting;
+  status.revision = revision;
+  return status;
+}
+
+const char* BookPreIndexer::stepName(const Step step) {
+  switch (step) {
+    case Step::Metadata:
+      return "metadata";
+    case Step::Thumbnail:
+      return "thumbnail";
+    case Step::Section:
+      return "section";
+    case Step::Search:
+      return "search";
+    case Step::Done:
+      break;
+  }
+  return "done";
+}
+
+void BookPreIndexer::taskTrampoline(void* param) {
+  auto* self = static_cast<BookPreIndexer*>(param);
+  self->taskLoop();
+  vTaskDelete(nullptr);
+}
+
+void BookPreIndexer::taskLoop() {
+  while (!stopRequested) {
+    std::string path;
+    Step step = Step::Metadata;
+    {
+      QueueLock lock(mutex);
+      const bool ready = !queue.empty() && readyForWork();
+      if (waiting != (!queue.empty() && !ready)) {
+        waiting = !waiting;
+        revision++;
+      }
+      if (ready) {
+        path = queue.front();
+        step = currentStep;
+        if (restartCurrent) {
+          restartCurrent = false;
+          epub.reset();
+        }
+      }
+    }
+    if (path.empty()) {
+      vTaskDelay(POLL_INTERVAL);
+      continue;
+    }
+
+    const Step next = runStep(path, step);
+
+    QueueLock lock(mutex);
+    if (restartCurrent) {
+      // The file was uploaded again while the step ran; start over with the new file
+      restartCurrent = false;
+      epub.reset();
+      continue;
+    }
+    if (next == Step::Done) {
+      LOG_DBG("PIX", "Prepared %s", path.c_str());
+      queue.pop_front();
+      currentStep = Step::Metadata;
+      completed++;
+      epub.reset();
+      saveQueue();
+    } else {
+      currentStep = next;
+    }
+    revision++;
+  }
+
+  // Cancelled: drop the partially prepared book from memory; its job restarts from the persisted queue
+  epub.reset();
+  {
+    QueueLock lock(mutex);
+    currentStep = Step::Metadata;
+    restartCurrent = false;
+    waiting = false;
+    revision++;
+  }
+  taskRunning = false;
+}
+
+bool BookPreIndexer::readyForWork() const {
+  return millis() - lastTransferAt >= TRANSFER_IDLE_MS && ESP.getFreeHeap() >= MIN_FREE_HEAP;
+}
+
+BookPreIndexer::Step BookPreIndexer::runStep(const std::string& path, const Step step) {
+  if (!Storage.exists(path.c_str())) {
+    LOG_DBG("PIX", "Skipping %s, file no longer exists", path.c_str());
+    return Step::Done;
+  }
+  LOG_DBG("PIX", "%s: %s", path.c_str(), stepName(step));
+  if (FsHelpers::hasEpubExtension(path) && (step == Step::Section || step == Step::Search)) {
+    // The section layout takes the render lock in slices itself; the search index only parses text
+    return runEpubStep(path, step);
+  }
+
+  RenderLock lock(RENDER_LOCK_WAIT_MS);
+  if (!lock.owns()) {
+    // Retried on the next pass, unless the worker is being stopped
+    return step;
+  }
+  if (FsHelpers::hasEpubExtension(path)) {
+    return runEpubStep(path, step);
+  }
+  return runXtcStep(path, step);
+}
+
+BookPreIndexer::Step BookPreIndexer::runEpubStep(const std::string& path, const Step step) {
+  // A cancelled or restarted job begins at a later step without the book in memory; loading it again only reads the
+  // caches the earlier steps wrote
+  if (!epub) {
+    epub = std::make_shared<Epub>(path, "/.crosspoint");
+    if (!epub->load(true, SETTINGS.embeddedStyle == 0)) {
+      LOG_ERR("PIX", "Failed to load %s", path.c_str());
+      return Step::Done;
+    }
+  }
+
+  switch (step) {
+    case Step::Metadata: {
+      LibraryDb::Book book;
+      book.path = path;
+      book.title = epub->getTitle();
+      book.author = epub->getAuthor();
+      book.series = epub->getSeries();
+      book.language = epub->getLanguage();
+      book.coverBmpPath = epub->getCoverBmpPath();
+      book.thumbBmpPath = epub->getThumbBmpPath();
+      LibraryDb::put(book);
+      if (KOREADER_STORE.hasCredentials()) {
+        KOReaderDocumentIdCache::get(path);
+      }
+      return Step::Thumbnail;
+    }
+    case Step::Thumbnail:
+      if (!epub->generateThumbBmp(UITheme::getInstance().getMetrics().homeCoverHeight)) {
+        LOG_DBG("PIX", "No thumbnail for %s", path.c_str());
+      }
+      return Step::Section;
+    case Step::Section:
+      // A cancelled layout is started over when the job resumes
+      if (!indexFirstSection() && stopRequested) {
+        return Step::Section;
+      }
+      return Step::Search;
+    case Step::Search:
+      if (!epub->buildSearchIndex(nullptr, [this] { return stopRequested.load(); })) {
+        if (stopRequested) {
+          return Step::Search;
+        }
+        LOG_ERR("PIX", "Failed to build search index for %s", path.c_str());
+      }
+      return Step::Done;
+    case Step::Done:
+      break;
+  }
+  return Step::Done;
+}
+
+BookPreIndexer::Step BookPreIndexer::runXtcStep(const std::string& path, const Step step) {
+  Xtc xtc(path, "/.crosspoint");
+  if (!xtc.load()) {
+    LOG_ERR("PIX", "Failed to load %s", path.c_str());
+    return Step::Done;
+  }
+  if (step == Step::Metadata) {
+    LibraryDb::Book book;
+    book.path = path;
+    book.title = xtc.getTitle();
+    book.author = xtc.getAuthor();
+    book.coverBmpPath = xtc.getCoverBmpPath();
+    book.thumbBmpPath = xtc.getThumbBmpPath();
+    LibraryDb::put(book);
+    return Step::Thumbnail;
+  }
+  if (!xtc.generateThumbBmp(UITheme::getInstance().getMetrics().homeCoverHeight)) {
+    LOG_DBG("PIX", "No thumbnail for %s", path.c_str());
+  }
+  return Step::Done;
+}
+
+bool BookPreIndexer::indexFirstSection() {
+  epub->setupCacheDir();
+  const int spineIndex = epub->getSpineIndexForTextReference();
+  if (spineIndex < 0 || spineIndex >= epub->getSpineItemsCount()) {
+    return false;
+  }
+
+  // Lay out exactly as EpubReaderActivity will, but for the reader orientation rather than the UI's
+  const auto orientation = ReaderUtils::toRendererOrientation(SETTINGS.orientation);
+  const auto margins = ReaderUtils::epubPageMargins(orientation, false);
+  const uint16_t viewportWidth = GfxRenderer::getScreenWidth(orientation) - margins.left - margins.right;
+  const uint16_t viewportHeight = GfxRenderer::getScreenHeight(orientation) - margins.top - margins.bottom;
+
+  Section section(epub, spineIndex, renderer);
+  if (section.loadSectionFile(SETTINGS.getReaderFontId(), SETTINGS.getReaderLineCompression(),
+                              SETTINGS.extraParagraphSpacing, SETTINGS.paragraphAlignment, viewportWidth,
+                              viewportHeight, SETTINGS.hyphenationEnabled, SETTINGS.embeddedStyle,
+                              SETTINGS.imageRendering)) {
+    return true;
+  }
+
+  // Laid out in slices under the render lock, checking for cancellation in between. A section left part way is
+  // removed when `section` goes out of scope.
+  bool begun = false;
+  while (!stopRequested) {
+    RenderLock lock(RENDER_LOCK_WAIT_MS);
+    if (!lock.owns()) {
+      continue;
+    }
+    if (!begun) {
+      begun = true;
+      if (!section.beginSectionFile(SETTINGS.getReaderFontId(), SETTINGS.getReaderLineCompression(),
+                                    SETTINGS.extraParagraphSpacing, SETTINGS.paragraphAlignment, viewportWidth,
+                                    viewportHeight, SETTINGS.hyphenationEnabled, SETTINGS.embeddedStyle,
+                                    SETTINGS.imageRendering, nullptr)) {
+        break;
+      }
+      continue;
+    }
+    const unsigned long sliceStart = millis();
+    if (!section.continueSectionFile([this, sliceStart] {
+          return stopRequested || millis() - sliceStart >= LAYOUT_SLICE_MS;
+        })) {
+      break;
+    }
+    if (!section.isPartial()) {
+      return true;
+    }
+  }
+  if (!stopRequested) {
+    LOG_ERR("PIX", "Failed to index section %d of %s", spineIndex, epub->getPath().c_str());
+  }
+  return false;
+}
+
+void BookPreIndexer::loadQueue() {
+  QueueLock lock(mutex);
+  queue.clear();
+  currentStep = Step::Metadata;
+
+  FsFile f;
+  if (!Storage.openFileForRead("PIX", QUEUE_FILE, f)) {
+    return;
+  }
+  uint8_t version = 0;
+  uint16_t count = 0;
+  serialization::readPod(f, version);
+  serialization::readPod(f, count);
+  if (version == QUEUE_FILE_VERSION) {
+    for (uint16_t i = 0; i < count && i < MAX_QUEUED_BOOKS; i++) {
+      std::string path;
+      serialization::readString(f, path);
+      if (path.empty()) {
+        break;
+      }
+      queue.push_back(std::move(path));
+    }
+  }
+  f.close();
+  revision++;
+  if (!queue.empty()) {
+    LOG_DBG("PIX", "Resuming %zu queued book(s)", queue.size());
+  }
+}
+
+void BookPreIndexer::saveQueue() const {
+  if (queue.empty()) {
+    Storage.remove(QUEUE_FILE);
+    return;
+  }
+  Storage.mkdir("/.crosspoint");
+  FsFile f;
+  if (!Storage.openFileForWrite("PIX", QUEUE_FILE, f)) {
+    LOG_ERR("PIX", "Failed to save pre-index queue");
+    return;
+  }
+  serialization::writePod(f, QUEUE_FILE_VERSION);
+  serialization::writePod(f, static_cast<uint16_t>(queue.size()));
+  for (const auto& path : queue) {
+    serialization::writeString(f, path);
+  }
+  f.close();
+}
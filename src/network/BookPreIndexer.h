@@ -0,0 +1,88 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+
+class Epub;
+class GfxRenderer;
+
+/**
+ * Prepares freshly uploaded books so their first open on the device is fast.
+ *
+ * The web server and WebDAV handler enqueue every completed EPUB/XTC transfer. Once no transfer has been seen for a
+ * few seconds, a worker task runs the job one step at a time: book metadata cache (and CSS, plus the KOReader
+ * document ID once sync is set up), home screen thumbnail, and for EPUBs the section the reader opens first, laid out
+ * with the current reader settings, and the full-text search index. Transfers arriving mid-job pause it before its
+ * next step. Steps that use the renderer take the render lock, the section layout in short slices, so they never run
+ * alongside the UI drawing.
+ *
+ * The queue is persisted to the SD card, so jobs cancelled by leaving the file transfer screen (or a reboot) resume
+ * the next time the server runs.
+ */
+class BookPreIndexer {
+ public:
+  enum class Step : uint8_t { Metadata, Thumbnail, Section, Search, Done };
+
+  struct Status {
+    std::string current;  // Book being prepared, empty when none
+    Step step = Step::Done;
+    size_t pending = 0;    // Books queued behind the current one
+    size_t completed = 0;  // Books prepared since start()
+    bool waiting = false;  // Work queued but held back by transfers or low memory
+    uint32_t revision = 0;
+  };
+
+  explicit BookPreIndexer(GfxRenderer& renderer);
+  ~BookPreIndexer();
+
+  // Load the persisted queue and start the worker
+  void start();
+  // Cancel the worker; blocks until it reaches its next stopping point, at most a short layout slice or one chapter of
+  // the search index. Unfinished jobs stay queued on the SD card.
+  void stop();
+
+  // Queue a completed upload; ignored for file types that need no preparation
+  void enqueue(const std::string& path);
+  // Hold jobs back while a transfer is running
+  void noteTransferActivity();
+
+  Status getStatus() const;
+  static const char* stepName(Step step);
+
+ private:
+  GfxRenderer& renderer;
+
+  // Guards the queue and status, which are shared with the worker task
+  SemaphoreHandle_t mutex = nullptr;
+  TaskHandle_t taskHandle = nullptr;
+  std::atomic<bool> stopRequested{false};
+  std::atomic<bool> taskRunning{false};
+  std::atomic<unsigned long> lastTransferAt{0};
+
+  std::deque<std::string> queue;  // Front is the current job
+  Step currentStep = Step::Metadata;
+  bool restartCurrent = false;  // Current book was uploaded again while being prepared
+  size_t completed = 0;
+  bool waiting = false;
+  uint32_t revision = 0;
+
+  // Worker-only state carried between the steps of the current EPUB job
+  std::shared_ptr<Epub> epub;
+
+  static void taskTrampoline(void* param);
+  void taskLoop();
+  bool readyForWork() const;
+  Step runStep(const std::string& path, Step step);
+  Step runEpubStep(const std::string& path, Step step);
+  Step runXtcStep(const std::string& path, Step step);
+  bool indexFirstSection();
+
+  void loadQueue();
+  void saveQueue() const;
+};
@@ -1,15 +1,18 @@
 #include "CrossPointWebServer.h"
 
 #include <ArduinoJson.h>
+#include <DirectoryIndex.h>
 #include <Epub.h>
 #include <FsHelpers.h>
 #include <HalStorage.h>
+#include <LibraryDb.h>
 #include <Logging.h>
 #include <WiFi.h>
 #include <esp_task_wdt.h>
 
 #include <algorithm>
 
+#include "BookPreIndexer.h"
 #include "CrossPointSettings.h"
 #include "SettingsList.h"
 #include "WebDAVHandler.h"
@@ -29,7 +32,9 @@ constexpr uint16_t LOCAL_UDP_PORT = 8134;
 CrossPointWebServer* wsInstance = nullptr;
 
 // WebSocket upload state
-FsFile wsUploadFile;
+UploadWriter wsUploadWriter;
+bool wsUploadHasCrc = false;  // The client sent a CRC message for this upload
+uint32_t wsUploadCrc = 0;
 String wsUploadFileName;
 String wsUploadPath;
 size_t wsUploadSize = 0;
@@ -40,6 +45,12 @@ String wsLastCompleteName;
 size_t wsLastCompleteSize = 0;
 unsigned long wsLastCompleteAt = 0;
 
+// Reports why the WebSocket upload failed to the client
+void sendWsUploadError(WebSocketsServer& ws, const uint8_t num) {
+  String message = String("ERROR:") + wsUploadWriter.getError();
+  ws.sendTXT(num, message);
+}
+
 // Helper function to clear epub cache after upload
 void clearEpubCacheIfNeeded(const String& filePath) {
   // Only clear cache for .epub files
@@ -47,6 +58,7 @@ void clearEpubCacheIfNeeded(const String& filePath) {
     Epub(filePath.c_str(), "/.crosspoint").clearCache();
     LOG_DBG("WEB", "Cleared epub cache for: %s", filePath.c_str());
   }
+  LibraryDb::remove(filePath.c_str());
 }
 
 String normalizeWebPath(const String& inputPath) {
@@ -67,6 +79,19 @@ String normalizeWebPath(const String& inputPath) {
   return result;
 }
 
+String preIndexStatusJson(const BookPreIndexer::Status& status) {
+  JsonDocument doc;
+  doc["current"] = status.current;
+  doc["step"] = status.current.empty() ? "idle" : BookPreIndexer::stepName(status.step);
+  doc["pending"] = status.pending;
+  doc["completed"] = status.completed;
+  doc["waiting"] = status.waiting;
+
+  String json;
+  serializeJson(doc, json);
+  return json;
+}
+
 bool isProtectedItemName(const String& name) {
   if (name.startsWith(".")) {
     return true;
@@ -78,6 +103,30 @@ bool isProtectedItemName(const String& name) {
   }
   return false;
 }
+
+bool isHiddenItemName(const char* name) {
+  for (size_t i = 0; i < HIDDEN_ITEMS_COUNT; i++) {
+    if (strcmp(name, HIDDEN_ITEMS[i]) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Directory index filters matching scanFiles(), one per value of the "show hidden files" setting
+bool listVisibleItem(const char* name, bool) { return name[0] != '.' && !isHiddenItemName(name); }
+bool listItemIncludingDotfiles(const char* name, bool) { return !isHiddenItemName(name); }
+// EPUBs are listed ahead of other files, whatever the sort key
+bool listEpubFirst(const char* name) { return FsHelpers::hasEpubExtension(std::string_view{name}); }
+
+DirectoryIndex::Filter webListingFilter() {
+  if (SETTINGS.showHiddenFiles) {
+    return {1, listItemIncludingDotfiles, listEpubFirst};
+  }
+  return {0, listVisibleItem, listEpubFirst};
+}
+
+constexpr uint32_t MAX_PAGE_LIMIT = 200;
 }  // namespace
 
 // File listing page template - now using generated headers:
@@ -134,6 +183,7 @@ void CrossPointWebServer::begin() {
 
   server->on("/api/status", HTTP_GET, [this] { handleStatus(); });
   server->on("/api/files", HTTP_GET, [this] { handleFileListData(); });
+  server->on("/api/preindex", HTTP_GET, [this] { handlePreIndexStatus(); });
   server->on("/download", HTTP_GET, [this] { handleDownload(); });
 
   // Upload endpoint with special handling for multipart form data
@@ -160,9 +210,13 @@ void CrossPointWebServer::begin() {
   LOG_DBG("WEB", "[MEM] Free heap after route setup: %d bytes", ESP.getFreeHeap());
 
   // Collect WebDAV headers and register handler
-  const char* davHeaders[] = {"Depth", "Destination", "Overwrite", "If", "Lock-Token", "Timeout"};
-  server->collectHeaders(davHeaders, 6);
-  server->addHandler(new WebDAVHandler());  // Note: WebDAVHandler will be deleted by WebServer when server is stopped
+  // If-None-Match is also used by the paged file listing
+  const char* davHeaders[] = {"Depth",      "Destination", "Overwrite",         "If",
+                              "Lock-Token", "Timeout",     "If-Match",          "If-None-Match",
+                              "If-Range",   "Range",       "If-Modified-Since", "Content-Range"};
+  server->collectHeaders(davHeaders, sizeof(davHeaders) / sizeof(davHeaders[0]));
+  // Note: WebDAVHandler will be deleted by WebServer when server is stopped
+  server->addHandler(new WebDAVHandler(preIndexer));
   LOG_DBG("WEB", "WebDAV handler initialized");
 
   server->begin();
@@ -199,11 +253,12 @@ void CrossPointWebServer::stop() {
 
   LOG_DBG("WEB", "[MEM] Free heap before stop: %d bytes", ESP.getFreeHeap());
 
-  // Close any in-progress WebSocket upload
-  if (wsUploadInProgress && wsUploadFile) {
-    wsUploadFile.close();
+  // Discard any in-progress uploads
+  if (wsUploadInProgress) {
+    wsUploadWriter.abort();
     wsUploadInProgress = false;
   }
+  upload.writer.abort();
 
   // Stop WebSocket server
   if (wsServer) {
@@ -262,6 +317,7 @@ void CrossPointWebServer::handleClient() {
   // Handle WebSocket events
   if (wsServer) {
     wsServer->loop();
+    broadcastPreIndexStatus();
   }
 
   // Respond to discovery broadcasts
@@ -332,6 +388,28 @@ void CrossPointWebServer::handleStatus() const {
   server->send(200, "application/json", json);
 }
 
+void CrossPointWebServer::handlePreIndexStatus() const {
+  if (!preIndexer) {
+    server->send(404, "text/plain", "Pre-indexing not available");
+    return;
+  }
+  server->send(200, "application/json", preIndexStatusJson(preIndexer->getStatus()));
+}
+
+// Pushes pre-indexing progress to connected WebSocket clients as "INDEX:<json>" whenever it changes
+void CrossPointWebServer::broadcastPreIndexStatus() {
+  if (!preIndexer) {
+    return;
+  }
+  const auto status = preIndexer->getStatus();
+  if (status.revision == preIndexRevisionSent) {
+    return;
+  }
+  preIndexRevisionSent = status.revision;
+  String message = "INDEX:" + preIndexStatusJson(status);
+  wsServer->broadcastTXT(message);
+}
+
 void CrossPointWebServer::scanFiles(const char* path, const std::function<void(FileInfo)>& callback) const {
   FsFile root = Storage.open(path);
   if (!root) {
@@ -411,6 +489,13 @@ void CrossPointWebServer::handleFileListData() const {
     }
   }
 
+  // Paged listings are served from the persisted directory index; without `limit` the whole folder is streamed as a
+  // plain array, as before
+  if (server->hasArg("limit")) {
+    handleFileListPage(currentPath);
+    return;
+  }
+
   server->setContentLength(CONTENT_LENGTH_UNKNOWN);
   server->send(200, "application/json", "");
   server->sendContent("[");
@@ -446,6 +531,98 @@ void CrossPointWebServer::handleFileListData() const {
   LOG_DBG("WEB", "Served file listing page for path: %s", currentPath.c_str());
 }
 
+void CrossPointWebServer::handleFileListPage(const String& currentPath) const {
+  DirectoryIndex::SortKey sortKey = DirectoryIndex::SortKey::Name;
+  const String sort = server->arg("sort");
+  if (sort == "modified") {
+    sortKey = DirectoryIndex::SortKey::Modified;
+  } else if (sort == "size") {
+    sortKey = DirectoryIndex::SortKey::Size;
+  }
+  const bool descending = server->arg("order") == "desc";
+  const long requestedLimit = server->arg("limit").toInt();
+  const uint32_t limit =
+      requestedLimit < 1 ? 1 : (requestedLimit > static_cast<long>(MAX_PAGE_LIMIT) ? MAX_PAGE_LIMIT : requestedLimit);
+
+  DirectoryIndex index;
+  if (!index.open(currentPath.c_str(), webListingFilter())) {
+    server->send(404, "text/plain", "Folder not found");
+    return;
+  }
+  const uint32_t generation = index.getGeneration();
+
+  // Cursor is "<generation>.<position>"; a cursor into an older listing would skip or repeat entries
+  uint32_t position = 0;
+  if (server->hasArg("cursor")) {
+    const String cursor = server->arg("cursor");
+    const int dot = cursor.indexOf('.');
+    if (dot <= 0 || strtoul(cursor.substring(0, dot).c_str(), nullptr, 10) != generation) {
+      index.close();
+      server->send(410, "text/plain", "Listing changed, reload");
+      return;
+    }
+    position = strtoul(cursor.c_str() + dot + 1, nullptr, 10);
+  }
+
+  // A page is fully determined by the generation and the query string, so the generation serves as the ETag
+  const String etag = "\"" + String(generation) + "\"";
+  server->sendHeader("ETag", etag);
+  server->sendHeader("Cache-Control", "no-cache");
+  if (server->header("If-None-Match") == etag) {
+    index.close();
+    server->send(304);
+    return;
+  }
+
+  server->setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server->send(200, "application/json", "");
+
+  char output[512];
+  constexpr size_t outputSize = sizeof(output);
+  snprintf(output, outputSize, "{\"generation\":%lu,\"total\":%lu,\"folders\":%lu,\"totalSize\":%llu,\"entries\":[",
+           static_cast<unsigned long>(generation), static_cast<unsigned long>(index.size()),
+           static_cast<unsigned long>(index.folderCount()), static_cast<unsigned long long>(index.totalFileSize()));
+  server->sendContent(output);
+
+  bool seenFirst = false;
+  JsonDocument doc;
+  const uint32_t count = index.read(
+      sortKey, descending, position, limit, [this, &output, &doc, &seenFirst](const DirectoryIndex::Entry& entry) {
+        doc.clear();
+        doc["name"] = entry.name;
+        doc["size"] = entry.size;
+        doc["isDirectory"] = entry.isDirectory;
+        doc["isEpub"] = !entry.isDirectory && FsHelpers::hasEpubExtension(entry.name);
+        doc["modified"] = DirectoryIndex::fatToUnixTime(entry.modified);
+
+        const size_t written = serializeJson(doc, output, outputSize);
+        if (written >= outputSize) {
+          LOG_DBG("WEB", "Skipping file entry with oversized JSON for name: %s", entry.name.c_str());
+          return;
+        }
+        if (seenFirst) {
+          server->sendContent(",");
+        } else {
+          seenFirst = true;
+        }
+        server->sendContent(output);
+      });
+  const uint32_t next = position + count;
+  const uint32_t total = index.size();
+  index.close();
+
+  if (count > 0 && next < total) {
+    snprintf(output, outputSize, "],\"next\":\"%lu.%lu\"}", static_cast<unsigned long>(generation),
+             static_cast<unsigned long>(next));
+  } else {
+    snprintf(output, outputSize, "],\"next\":null}");
+  }
+  server->sendContent(output);
+  server->sendContent("");
+  LOG_DBG("WEB", "Served %lu listing entries of %s from %lu", static_cast<unsigned long>(count), currentPath.c_str(),
+          static_cast<unsigned long>(position));
+}
+
 void CrossPointWebServer::handleDownload() const {
   if (!server->hasArg("path")) {
     server->send(400, "text/plain", "Missing path");
@@ -509,29 +686,8 @@ void CrossPointWebServer::handleDownload() const {
   file.close();
 }
 
-// Diagnostic counters for upload performance analysis
+// Diagnostic counter for upload performance analysis
 static unsigned long uploadStartTime = 0;
-static unsigned long totalWriteTime = 0;
-static size_t writeCount = 0;
-
-static bool flushUploadBuffer(CrossPointWebServer::UploadState& state) {
-  if (state.bufferPos > 0 && state.file) {
-    esp_task_wdt_reset();  // Reset watchdog before potentially slow SD write
-    const unsigned long writeStart = millis();
-    const size_t written = state.file.write(state.buffer.data(), state.bufferPos);
-    totalWriteTime += millis() - writeStart;
-    writeCount++;
-    esp_task_wdt_reset();  // Reset watchdog after SD write
-
-    if (written != state.bufferPos) {
-      LOG_DBG("WEB", "[UPLOAD] Buffer flush failed: expected %d, wrote %d", state.bufferPos, written);
-      state.bufferPos = 0;
-      return false;
-    }
-    state.bufferPos = 0;
-  }
-  return true;
-}
 
 void CrossPointWebServer::handleUpload(UploadState& state) const {
   static size_t lastLoggedSize = 0;
@@ -557,9 +713,6 @@ void CrossPointWebServer::handleUpload(UploadState& state) const {
     state.error = "";
     uploadStartTime = millis();
     lastLoggedSize = 0;
-    state.bufferPos = 0;
-    totalWriteTime = 0;
-    writeCount = 0;
 
     // Get upload path from query parameter (defaults to root if not specified)
     // Note: We use query parameter instead of form data because multipart form
@@ -578,6 +731,7 @@ void CrossPointWebServer::handleUpload(UploadState& state) const {
       state.path = "/";
     }
 
+    if (preIndexer) preIndexer->noteTransferActivity();
     LOG_DBG("WEB", "[UPLOAD] START: %s to path: %s", state.fileName.c_str(), state.path.c_str());
     LOG_DBG("WEB", "[UPLOAD] Free heap: %d bytes", ESP.getFreeHeap());
 
@@ -596,8 +750,8 @@ void CrossPointWebServer::handleUpload(UploadState& state) const {
 
     // Open file for writing - this can be slow due to FAT cluster allocation
     esp_task_wdt_reset();
-    if (!Storage.openFileForWrite("WEB", filePath, state.file)) {
-      state.error = "Failed to create file on SD card";
+    if (!state.writer.begin(filePath.c_str())) {
+      state.error = state.writer.getError();
       LOG_DBG("WEB", "[UPLOAD] FAILED to create file: %s", filePath.c_str());
       return;
     }
@@ -605,77 +759,71 @@ void CrossPointWebServer::handleUpload(UploadState& state) const {
 
     LOG_DBG("WEB", "[UPLOAD] File created successfully: %s", filePath.c_str());
   } else if (upload.status == UPLOAD_FILE_WRITE) {
-    if (state.file && state.error.isEmpty()) {
-      // Buffer incoming data and flush when buffer is full
-      // This reduces SD card write operations and improves throughput
-      const uint8_t* data = upload.buf;
-      size_t remaining = upload.currentSize;
-
-      while (remaining > 0) {
-        const size_t space = UploadState::UPLOAD_BUFFER_SIZE - state.bufferPos;
-        const size_t toCopy = (remaining < space) ? remaining : space;
-
-        memcpy(state.buffer.data() + state.bufferPos, data, toCopy);
-        state.bufferPos += toCopy;
-        data += toCopy;
-        remaining -= toCopy;
-
-        // Flush buffer when full
-        if (state.bufferPos >= UploadState::UPLOAD_BUFFER_SIZE) {
-          if (!flushUploadBuffer(state)) {
-            state.error = "Failed to write to SD card - disk may be full";
-            state.file.close();
-            return;
-          }
-        }
+    if (state.writer.isActive() && state.error.isEmpty()) {
+      // Blocks only while every buffer is waiting for the SD card, which holds the client back through TCP
+      if (!state.writer.write(upload.buf, upload.currentSize)) {
+        state.error = state.writer.getError();
+        state.writer.abort();
+        return;
       }
 
       state.size += upload.currentSize;
+      if (preIndexer) preIndexer->noteTransferActivity();
 
       // Log progress every 100KB
       if (state.size - lastLoggedSize >= 102400) {
         const unsigned long elapsed = millis() - uploadStartTime;
         const float kbps = (elapsed > 0) ? (state.size / 1024.0) / (elapsed / 1000.0) : 0;
         LOG_DBG("WEB", "[UPLOAD] %d bytes (%.1f KB), %.1f KB/s, %d writes", state.size, state.size / 1024.0, kbps,
-                writeCount);
+                state.writer.getWriteCount());
         lastLoggedSize = state.size;
       }
     }
   } else if (upload.status == UPLOAD_FILE_END) {
-    if (state.file) {
-      // Flush any remaining buffered data
-      if (!flushUploadBuffer(state)) {
-        state.error = "Failed to write final data to SD card";
+    if (state.writer.isActive()) {
+      // Optional file size and CRC-32, sent by the client as query parameters like the path. The request's
+      // Content-Length also counts the multipart framing, so it cannot stand in for the file size.
+      const size_t expectedSize = server->hasArg("size") ? strtoul(server->arg("size").c_str(), nullptr, 10) : 0;
+      uint32_t expectedCrc = 0;
+      const bool hasCrc = server->hasArg("crc");
+      if (hasCrc) {
+        expectedCrc = strtoul(server->arg("crc").c_str(), nullptr, 16);
+      }
+
+      // Writes out the buffered data and verifies it; a failed upload is removed
+      esp_task_wdt_reset();
+      if (!state.writer.finish(expectedSize, hasCrc ? &expectedCrc : nullptr)) {
+        state.error = state.writer.getError();
       }
-      state.file.close();
+      esp_task_wdt_reset();
+      // Listings taken during the upload showed the partial file
+      DirectoryIndex::invalidate(state.path.c_str());
 
       if (state.error.isEmpty()) {
         state.success = true;
         const unsigned long elapsed = millis() - uploadStartTime;
+        const unsigned long writeTime = state.writer.getWriteTimeMs();
         const float avgKbps = (elapsed > 0) ? (state.size / 1024.0) / (elapsed / 1000.0) : 0;
-        const float writePercent = (elapsed > 0) ? (totalWriteTime * 100.0 / elapsed) : 0;
+        const float writePercent = (elapsed > 0) ? (writeTime * 100.0 / elapsed) : 0;
         LOG_DBG("WEB", "[UPLOAD] Complete: %s (%d bytes in %lu ms, avg %.1f KB/s)", state.fileName.c_str(), state.size,
                 elapsed, avgKbps);
-        LOG_DBG("WEB", "[UPLOAD] Diagnostics: %d writes, total write time: %lu ms (%.1f%%)", writeCount, totalWriteTime,
-                writePercent);
+        LOG_DBG("WEB", "[UPLOAD] Diagnostics: %d writes, total write time: %lu ms (%.1f%% overlapped with receiving)",
+                state.writer.getWriteCount(), writeTime, writePercent);
 
         // Clear epub cache to prevent stale metadata issues when overwriting files
         String filePath = state.path;
         if (!filePath.endsWith("/")) filePath += "/";
         filePath += state.fileName;
         clearEpubCacheIfNeeded(filePath);
+        if (preIndexer) preIndexer->enqueue(filePath.c_str());
+      } else {
+        LOG_DBG("WEB", "[UPLOAD] Failed: %s (%s)", state.fileName.c_str(), state.error.c_str());
       }
     }
   } else if (upload.status == UPLOAD_FILE_ABORTED) {
-    state.bufferPos = 0;  // Discard buffered data
-    if (state.file) {
-      state.file.close();
-      // Try to delete the incomplete file
-      String filePath = state.path;
-      if (!filePath.endsWith("/")) filePath += "/";
-      filePath += state.fileName;
-      Storage.remove(filePath.c_str());
-    }
+    // Discards buffered data and deletes the incomplete file
+    state.writer.abort();
+    DirectoryIndex::invalidate(state.path.c_str());
     state.error = "Upload aborted";
     LOG_DBG("WEB", "Upload aborted");
   }
@@ -732,6 +880,9 @@ void CrossPointWebServer::handleCreateFolder() const {
 
   // Create the folder
   if (Storage.mkdir(folderPath.c_str())) {
+    DirectoryIndex::invalidate(parentPath.c_str());
+    // An index left behind by an earlier folder of the same name must not be reused
+    DirectoryIndex::invalidate(folderPath.c_str());
     LOG_DBG("WEB", "Folder created successfully: %s", folderPath.c_str());
     server->send(200, "text/plain", "Folder created: " + folderName);
   } else {
@@ -814,6 +965,8 @@ void CrossPointWebServer::handleRename() const {
   file.close();
 
   if (success) {
+    DirectoryIndex::invalidate(parentPath.c_str());
+    DirectoryIndex::invalidate(newPath.c_str());
     LOG_DBG("WEB", "Renamed file: %s -> %s", itemPath.c_str(), newPath.c_str());
     server->send(200, "text/plain", "Renamed successfully");
   } else {
@@ -907,6 +1060,8 @@ void CrossPointWebServer::handleMove() const {
   file.close();
 
   if (success) {
+    DirectoryIndex::invalidateParent(itemPath.c_str());
+    DirectoryIndex::invalidate(destPath.c_str());
     LOG_DBG("WEB", "Moved file: %s -> %s", itemPath.c_str(), newPath.c_str());
     server->send(200, "text/plain", "Moved successfully");
   } else {
@@ -1009,7 +1164,10 @@ void CrossPointWebServer::handleDelete() const {
       clearEpubCacheIfNeeded(itemPath);
     }
 
-    if (!success) {
+    if (success) {
+      DirectoryIndex::invalidate(itemPath.c_str());
+      DirectoryIndex::invalidateParent(itemPath.c_str());
+    } else {
       failedItems += itemPath + " (deletion failed); ";
       allSuccess = false;
     }
@@ -1196,23 +1354,21 @@ void CrossPointWebServer::wsEventCallback(uint8_t num, WStype_t type, uint8_t* p
 // Protocol:
 //   1. Client sends TEXT message: "START:<filename>:<size>:<path>"
 //   2. Client sends BINARY messages with file data chunks
-//   3. Server sends TEXT "PROGRESS:<received>:<total>" after each chunk
-//   4. Server sends TEXT "DONE" or "ERROR:<message>" when complete
+//   3. Client may send TEXT "CRC:<crc32 as 8 hex digits>" before the final chunk to have the file verified
+//   4. Server sends TEXT "PROGRESS:<received>:<total>" every 64KB
+//   5. Server sends TEXT "DONE" or "ERROR:<message>" once the file is written and verified
 void CrossPointWebServer::onWebSocketEvent(uint8_t num, WStype_t type, uint8_t* payload, size_t length) {
   switch (type) {
     case WStype_DISCONNECTED:
       LOG_DBG("WS", "Client %u disconnected", num);
-      // Clean up any in-progress upload
-      if (wsUploadInProgress && wsUploadFile) {
-        wsUploadFile.close();
-        // Delete incomplete file
-        String filePath = wsUploadPath;
-        if (!filePath.endsWith("/")) filePath += "/";
-        filePath += wsUploadFileName;
-        Storage.remove(filePath.c_str());
-        LOG_DBG("WS", "Deleted incomplete upload: %s", filePath.c_str());
+      // Clean up any in-progress upload, deleting the incomplete file
+      if (wsUploadInProgress) {
+        wsUploadWriter.abort();
+        DirectoryIndex::invalidate(wsUploadPath.c_str());
+        LOG_DBG("WS", "Deleted incomplete upload: %s", wsUploadFileName.c_str());
       }
       wsUploadInProgress = false;
+      wsUploadHasCrc = false;
       break;
 
     case WStype_CONNECTED: {
@@ -1225,7 +1381,10 @@ void CrossPointWebServer::onWebSocketEvent(uint8_t num, WStype_t type, uint8_t*
       String msg = String((char*)payload);
       LOG_DBG("WS", "Text from client %u: %s", num, msg.c_str());
 
-      if (msg.startsWith("START:")) {
+      if (msg.startsWith("CRC:")) {
+        wsUploadCrc = strtoul(msg.c_str() + 4, nullptr, 16);
+        wsUploadHasCrc = true;
+      } else if (msg.startsWith("START:")) {
         // Parse: START:<filename>:<size>:<path>
         int firstColon = msg.indexOf(':', 6);
         int secondColon = msg.indexOf(':', firstColon + 1);
@@ -1236,6 +1395,7 @@ void CrossPointWebServer::onWebSocketEvent(uint8_t num, WStype_t type, uint8_t*
           wsUploadPath = msg.substring(secondColon + 1);
           wsUploadReceived = 0;
           wsUploadStartTime = millis();
+          wsUploadHasCrc = false;
 
           // Ensure path is valid
           if (!wsUploadPath.startsWith("/")) wsUploadPath = "/" + wsUploadPath;
@@ -1259,14 +1419,16 @@ void CrossPointWebServer::onWebSocketEvent(uint8_t num, WStype_t type, uint8_t*
 
           // Open file for writing
           esp_task_wdt_reset();
-          if (!Storage.openFileForWrite("WS", filePath, wsUploadFile)) {
-            wsServer->sendTXT(num, "ERROR:Failed to create file");
+          if (!wsUploadWriter.begin(filePath.c_str())) {
+            sendWsUploadError(*wsServer, num);
             wsUploadInProgress = false;
+            wsUploadHasCrc = false;
             return;
           }
           esp_task_wdt_reset();
 
           wsUploadInProgress = true;
+          if (preIndexer) preIndexer->noteTransferActivity();
           wsServer->sendTXT(num, "READY");
         } else {
           wsServer->sendTXT(num, "ERROR:Invalid START format");
@@ -1276,24 +1438,24 @@ void CrossPointWebServer::onWebSocketEvent(uint8_t num, WStype_t type, uint8_t*
     }
 
     case WStype_BIN: {
-      if (!wsUploadInProgress || !wsUploadFile) {
+      if (!wsUploadInProgress) {
         wsServer->sendTXT(num, "ERROR:No upload in progress");
         return;
       }
 
-      // Write binary data directly to file
-      esp_task_wdt_reset();
-      size_t written = wsUploadFile.write(payload, length);
+      // Hand the chunk to the writer task; this only blocks while the SD card is behind
       esp_task_wdt_reset();
-
-      if (written != length) {
-        wsUploadFile.close();
+      if (!wsUploadWriter.write(payload, length)) {
+        sendWsUploadError(*wsServer, num);
+        wsUploadWriter.abort();
+        DirectoryIndex::invalidate(wsUploadPath.c_str());
         wsUploadInProgress = false;
-        wsServer->sendTXT(num, "ERROR:Write failed - disk full?");
+        wsUploadHasCrc = false;
         return;
       }
 
-      wsUploadReceived += written;
+      wsUploadReceived += length;
+      if (preIndexer) preIndexer->noteTransferActivity();
 
       // Send progress update (every 64KB or at end)
       static size_t lastProgressSent = 0;
@@ -1305,8 +1467,20 @@ void CrossPointWebServer::onWebSocketEvent(uint8_t num, WStype_t type, uint8_t*
 
       // Check if upload complete
       if (wsUploadReceived >= wsUploadSize) {
-        wsUploadFile.close();
         wsUploadInProgress = false;
+        lastProgressSent = 0;
+
+        // Writes out the buffered data and verifies size and checksum; a failed upload is removed
+        esp_task_wdt_reset();
+        const bool verified = wsUploadWriter.finish(wsUploadSize, wsUploadHasCrc ? &wsUploadCrc : nullptr);
+        esp_task_wdt_reset();
+        wsUploadHasCrc = false;
+        DirectoryIndex::invalidate(wsUploadPath.c_str());
+        if (!verified) {
+          LOG_DBG("WS", "Upload failed: %s (%s)", wsUploadFileName.c_str(), wsUploadWriter.getError());
+          sendWsUploadError(*wsServer, num);
+          return;
+        }
 
         wsLastCompleteName = wsUploadFileName;
         wsLastCompleteSize = wsUploadSize;
@@ -1315,17 +1489,17 @@ void CrossPointWebServer::onWebSocketEvent(uint8_t num, WStype_t type, uint8_t*
         unsigned long elapsed = millis() - wsUploadStartTime;
         float kbps = (elapsed > 0) ? (wsUploadSize / 1024.0) / (elapsed / 1000.0) : 0;
 
-        LOG_DBG("WS", "Upload complete: %s (%d bytes in %lu ms, %.1f KB/s)", wsUploadFileName.c_str(), wsUploadSize,
-                elapsed, kbps);
+        LOG_DBG("WS", "Upload complete: %s (%d bytes in %lu ms, %.1f KB/s, %lu ms writing)", wsUploadFileName.c_str(),
+                wsUploadSize, elapsed, kbps, wsUploadWriter.getWriteTimeMs());
 
         // Clear epub cache to prevent stale metadata issues when overwriting files
         String filePath = wsUploadPath;
         if (!filePath.endsWith("/")) filePath += "/";
         filePath += wsUploadFileName;
         clearEpubCacheIfNeeded(filePath);
+        if (preIndexer) preIndexer->enqueue(filePath.c_str());
 
         wsServer->sendTXT(num, "DONE");
-        lastProgressSent = 0;
       }
       break;
     }
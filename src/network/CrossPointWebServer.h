@@ -9,6 +9,10 @@
 #include <string>
 #include <vector>
 
+#include "UploadWriter.h"
+
+class BookPreIndexer;
+
 // Structure to hold file information
 struct FileInfo {
   String name;
@@ -31,21 +35,13 @@ class CrossPointWebServer {
 
   // Used by POST upload handler
   struct UploadState {
-    FsFile file;
+    // Batches received data into large SD writes made by its own task, so the socket keeps being read meanwhile
+    UploadWriter writer;
     String fileName;
     String path = "/";
     size_t size = 0;
     bool success = false;
     String error = "";
-
-    // Upload write buffer - batches small writes into larger SD card operations
-    // 4KB is a good balance: large enough to reduce syscall overhead, small enough
-    // to keep individual write times short and avoid watchdog issues
-    static constexpr size_t UPLOAD_BUFFER_SIZE = 4096;  // 4KB buffer
-    std::vector<uint8_t> buffer;
-    size_t bufferPos = 0;
-
-    UploadState() { buffer.resize(UPLOAD_BUFFER_SIZE); }
   } upload;
 
   CrossPointWebServer();
@@ -68,6 +64,9 @@ class CrossPointWebServer {
   // Get the port number
   uint16_t getPort() const { return port; }
 
+  // Queue completed uploads for background preparation; set before begin()
+  void setPreIndexer(BookPreIndexer* indexer) { preIndexer = indexer; }
+
  private:
   std::unique_ptr<WebServer> server = nullptr;
   std::unique_ptr<WebSocketsServer> wsServer = nullptr;
@@ -77,6 +76,10 @@ class CrossPointWebServer {
   uint16_t wsPort = 81;  // WebSocket port
   NetworkUDP udp;
   bool udpActive = false;
+  BookPreIndexer* preIndexer = nullptr;
+  uint32_t preIndexRevisionSent = 0;
+
+  void broadcastPreIndexStatus();
 
   // WebSocket upload state
   void onWebSocketEvent(uint8_t num, WStype_t type, uint8_t* payload, size_t length);
@@ -91,8 +94,10 @@ class CrossPointWebServer {
   void handleRoot() const;
   void handleNotFound() const;
   void handleStatus() const;
+  void handlePreIndexStatus() const;
   void handleFileList() const;
   void handleFileListData() const;
+  void handleFileListPage(const String& currentPath) const;
   void handleDownload() const;
   void handleUpload(UploadState& state) const;
   void handleUploadPost(UploadState& state) const;
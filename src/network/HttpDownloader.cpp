@@ -2,6 +2,7 @@
 
 #include <HTTPClient.h>
 #include <Logging.h>
+#include <MD5Builder.h>
 #include <NetworkClient.h>
 #include <NetworkClientSecure.h>
 #include <StreamString.h>
@@ -12,70 +13,136 @@
 #include <utility>
 
 #include "CrossPointSettings.h"
+#include "ResumableDownload.h"
 #include "util/UrlUtils.h"
 
 namespace {
-class FileWriteStream final : public Stream {
+const char* RESPONSE_HEADERS[] = {"ETag", "Last-Modified", "Content-Range"};
+
+// Use NetworkClientSecure for HTTPS, regular NetworkClient for HTTP
+std::unique_ptr<NetworkClient> makeClient(const std::string& url) {
+  if (UrlUtils::isHttpsUrl(url)) {
+    auto* secureClient = new NetworkClientSecure();
+    secureClient->setInsecure();
+    return std::unique_ptr<NetworkClient>(secureClient);
+  }
+  return std::unique_ptr<NetworkClient>(new NetworkClient());
+}
+
+void beginRequest(HTTPClient& http, NetworkClient& client, const std::string& url) {
+  http.begin(client, url.c_str());
+  http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
+  http.addHeader("User-Agent", "CrossPoint-ESP32-" CROSSPOINT_VERSION);
+
+  // Add Basic HTTP auth if credentials are configured
+  if (strlen(SETTINGS.opdsUsername) > 0 && strlen(SETTINGS.opdsPassword) > 0) {
+    std::string credentials = std::string(SETTINGS.opdsUsername) + ":" + SETTINGS.opdsPassword;
+    String encoded = base64::encode(credentials.c_str());
+    http.addHeader("Authorization", "Basic " + encoded);
+  }
+}
+
+// Write-through stream for HTTPClient::writeToStream that hands the body to a download sink
+class SinkStream final : public Stream {
  public:
-  FileWriteStream(FsFile& file, size_t total, HttpDownloader::ProgressCallback progress)
-      : file_(file), total_(total), progress_(std::move(progress)) {}
+  explicit SinkStream(const ResumableDownload::Transport::Sink& sink) : sink_(sink) {}
 
   size_t write(uint8_t byte) override { return write(&byte, 1); }
 
   size_t write(const uint8_t* buffer, size_t size) override {
-    // Write-through stream for HTTPClient::writeToStream with progress tracking.
-    const size_t written = file_.write(buffer, size);
-    if (written != size) {
-      writeOk_ = false;
-    }
-    downloaded_ += written;
-    if (progress_ && total_ > 0) {
-      progress_(downloaded_, total_);
+    if (!ok_ || !sink_(buffer, size)) {
+      ok_ = false;
+      return 0;
     }
-    return written;
+    return size;
   }
 
   int available() override { return 0; }
   int read() override { return -1; }
   int peek() override { return -1; }
-  void flush() override { file_.flush(); }
 
-  size_t downloaded() const { return downloaded_; }
-  bool ok() const { return writeOk_; }
+  bool ok() const { return ok_; }
+
+ private:
+  const ResumableDownload::Transport::Sink& sink_;
+  bool ok_ = true;
+};
+
+// One GET per request() over HTTPClient, with a fresh connection each time
+class HttpTransport final : public ResumableDownload::Transport {
+ public:
+  explicit HttpTransport(const std::string& url) : url_(url) {}
+  ~HttpTransport() override { end(); }
+
+  bool request(const size_t rangeStart, const std::string& ifRange, ResumableDownload::Response& response) override {
+    client_ = makeClient(url_);
+    http_.reset(new HTTPClient());
+    beginRequest(*http_, *client_, url_);
+    if (rangeStart > 0) {
+      http_->addHeader("Range", ("bytes=" + std::to_string(rangeStart) + "-").c_str());
+      if (!ifRange.empty()) {
+        http_->addHeader("If-Range", ifRange.c_str());
+      }
+    }
+    http_->collectHeaders(RESPONSE_HEADERS, sizeof(RESPONSE_HEADERS) / sizeof(RESPONSE_HEADERS[0]));
+
+    const int httpCode = http_->GET();
+    if (httpCode <= 0) {
+      LOG_ERR("HTTP", "Request failed: %s", HTTPClient::errorToString(httpCode).c_str());
+      return false;
+    }
+    response.status = httpCode;
+    response.contentLength = http_->getSize();
+    response.etag = http_->header("ETag").c_str();
+    response.lastModified = http_->header("Last-Modified").c_str();
+    response.contentRange = http_->header("Content-Range").c_str();
+    return true;
+  }
+
+  bool readBody(const Sink& sink) override {
+    // HTTPClient handles chunked decoding; a dropped connection shows up as a negative result
+    SinkStream stream(sink);
+    const int result = http_->writeToStream(&stream);
+    if (result < 0) {
+      LOG_ERR("HTTP", "writeToStream error: %d", result);
+    }
+    return result >= 0 && stream.ok();
+  }
+
+  void end() override {
+    if (http_) {
+      http_->end();
+      http_.reset();
+    }
+    client_.reset();
+  }
 
  private:
-  FsFile& file_;
-  size_t total_;
-  size_t downloaded_ = 0;
-  bool writeOk_ = true;
-  HttpDownloader::ProgressCallback progress_;
+  std::string url_;
+  std::unique_ptr<NetworkClient> client_;
+  std::unique_ptr<HTTPClient> http_;
 };
+
+bool md5Matches(FsFile& file, const std::string& expected) {
+  MD5Builder md5;
+  md5.begin();
+  uint8_t buffer[4096];
+  int read;
+  while ((read = file.read(buffer, sizeof(buffer))) > 0) {
+    md5.add(buffer, read);
+  }
+  md5.calculate();
+  return strcasecmp(md5.toString().c_str(), expected.c_str()) == 0;
+}
 }  // namespace
 
 bool HttpDownloader::fetchUrl(const std::string& url, Stream& outContent) {
-  // Use NetworkClientSecure for HTTPS, regular NetworkClient for HTTP
-  std::unique_ptr<NetworkClient> client;
-  if (UrlUtils::isHttpsUrl(url)) {
-    auto* secureClient = new NetworkClientSecure();
-    secureClient->setInsecure();
-    client.reset(secureClient);
-  } else {
-    client.reset(new NetworkClient());
-  }
+  std::unique_ptr<NetworkClient> client = makeClient(url);
   HTTPClient http;
 
   LOG_DBG("HTTP", "Fetching: %s", url.c_str());
 
-  http.begin(*client, url.c_str());
-  http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
-  http.addHeader("User-Agent", "CrossPoint-ESP32-" CROSSPOINT_VERSION);
-
-  // Add Basic HTTP auth if credentials are configured
-  if (strlen(SETTINGS.opdsUsername) > 0 && strlen(SETTINGS.opdsPassword) > 0) {
-    std::string credentials = std::string(SETTINGS.opdsUsername) + ":" + SETTINGS.opdsPassword;
-    String encoded = base64::encode(credentials.c_str());
-    http.addHeader("Authorization", "Basic " + encoded);
-  }
+  beginRequest(http, *client, url);
 
   const int httpCode = http.GET();
   if (httpCode != HTTP_CODE_OK) {
@@ -102,95 +169,28 @@ bool HttpDownloader::fetchUrl(const std::string& url, std::string& outContent) {
 }
 
 HttpDownloader::DownloadError HttpDownloader::downloadToFile(const std::string& url, const std::string& destPath,
-                                                             ProgressCallback progress) {
-  // Use NetworkClientSecure for HTTPS, regular NetworkClient for HTTP
-  std::unique_ptr<NetworkClient> client;
-  if (UrlUtils::isHttpsUrl(url)) {
-    auto* secureClient = new NetworkClientSecure();
-    secureClient->setInsecure();
-    client.reset(secureClient);
-  } else {
-    client.reset(new NetworkClient());
-  }
-  HTTPClient http;
-
+                                                             ProgressCallback progress,
+                                                             const std::string& expectedMd5) {
   LOG_DBG("HTTP", "Downloading: %s", url.c_str());
   LOG_DBG("HTTP", "Destination: %s", destPath.c_str());
 
-  http.begin(*client, url.c_str());
-  http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
-  http.addHeader("User-Agent", "CrossPoint-ESP32-" CROSSPOINT_VERSION);
-
-  // Add Basic HTTP auth if credentials are configured
-  if (strlen(SETTINGS.opdsUsername) > 0 && strlen(SETTINGS.opdsPassword) > 0) {
-    std::string credentials = std::string(SETTINGS.opdsUsername) + ":" + SETTINGS.opdsPassword;
-    String encoded = base64::encode(credentials.c_str());
-    http.addHeader("Authorization", "Basic " + encoded);
+  HttpTransport transport(url);
+  ResumableDownload download(url, destPath);
+  ResumableDownload::Verifier verify;
+  if (!expectedMd5.empty()) {
+    verify = [&expectedMd5](FsFile& file) { return md5Matches(file, expectedMd5); };
   }
 
-  const int httpCode = http.GET();
-  if (httpCode != HTTP_CODE_OK) {
-    LOG_ERR("HTTP", "Download failed: %d", httpCode);
-    http.end();
-    return HTTP_ERROR;
-  }
-
-  const int64_t reportedLength = http.getSize();
-  const size_t contentLength = reportedLength > 0 ? static_cast<size_t>(reportedLength) : 0;
-  if (contentLength > 0) {
-    LOG_DBG("HTTP", "Content-Length: %zu", contentLength);
-  } else {
-    LOG_DBG("HTTP", "Content-Length: unknown");
+  switch (download.run(transport, progress, verify)) {
+    case ResumableDownload::Result::OK:
+      LOG_DBG("HTTP", "Downloaded %zu bytes", download.received());
+      return OK;
+    case ResumableDownload::Result::FILE_ERROR:
+      return FILE_ERROR;
+    case ResumableDownload::Result::CHECKSUM_ERROR:
+      return CHECKSUM_ERROR;
+    case ResumableDownload::Result::HTTP_ERROR:
+      break;
   }
-
-  // Remove existing file if present
-  if (Storage.exists(destPath.c_str())) {
-    Storage.remove(destPath.c_str());
-  }
-
-  // Open file for writing
-  FsFile file;
-  if (!Storage.openFileForWrite("HTTP", destPath.c_str(), file)) {
-    LOG_ERR("HTTP", "Failed to open file for writing");
-    http.end();
-    return FILE_ERROR;
-  }
-
-  // Let HTTPClient handle chunked decoding and stream body bytes into the file.
-  FileWriteStream fileStream(file, contentLength, progress);
-  const int writeResult = http.writeToStream(&fileStream);
-
-  file.close();
-  http.end();
-
-  if (writeResult < 0) {
-    LOG_ERR("HTTP", "writeToStream error: %d", writeResult);
-    Storage.remove(destPath.c_str());
-    return HTTP_ERROR;
-  }
-
-  const size_t downloaded = fileStream.downloaded();
-  LOG_DBG("HTTP", "Downloaded %zu bytes", downloaded);
-
-  // Guard against partial writes even if HTTPClient completes.
-  if (!fileStream.ok()) {
-    LOG_ERR("HTTP", "Write failed during download");
-    Storage.remove(destPath.c_str());
-    return FILE_ERROR;
-  }
-
-  if (contentLength == 0 && downloaded == 0) {
-    LOG_ERR("HTTP", "Download failed: no data received");
-    Storage.remove(destPath.c_str());
-    return HTTP_ERROR;
-  }
-
-  // Verify download size if known
-  if (contentLength > 0 && downloaded != contentLength) {
-    LOG_ERR("HTTP", "Size mismatch: got %zu, expected %zu", downloaded, contentLength);
-    Storage.remove(destPath.c_str());
-    return HTTP_ERROR;
-  }
-
-  return OK;
+  return HTTP_ERROR;
 }
@@ -17,6 +17,7 @@ class HttpDownloader {
     HTTP_ERROR,
     FILE_ERROR,
     ABORTED,
+    CHECKSUM_ERROR,
   };
 
   /**
@@ -31,11 +32,14 @@ class HttpDownloader {
 
   /**
    * Download a file to the SD card.
+   * The body goes to `<destPath>.part` and is only moved into place once complete. Dropped connections are
+   * retried with Range requests, and a failed download is resumed by the next call for the same URL and path.
    * @param url The URL to download
    * @param destPath The destination path on SD card
    * @param progress Optional progress callback
+   * @param expectedMd5 Optional hex MD5 the file must match before it is moved into place
    * @return DownloadError indicating success or failure type
    */
   static DownloadError downloadToFile(const std::string& url, const std::string& destPath,
-                                      ProgressCallback progress = nullptr);
+                                      ProgressCallback progress = nullptr, const std::string& expectedMd5 = "");
 };
@@ -1,14 +1,31 @@
 #include "OtaUpdater.h"
 
 #include <ArduinoJson.h>
+#include <DeltaPatch.h>
+#include <HalStorage.h>
 #include <Logging.h>
+#include <mbedtls/base64.h>
+#include <mbedtls/pk.h>
 
+#include "ResumableDownload.h"
 #include "esp_http_client.h"
 #include "esp_https_ota.h"
+#include "esp_ota_ops.h"
 #include "esp_wifi.h"
 
+/*
+ * Base64 DER public key (SubjectPublicKeyInfo) of the ECDSA P-256 key release patches are signed with, see
+ * scripts/make_delta_patch.py. Delta updates are off unless a build sets it.
+ */
+#ifndef OTA_DELTA_PUBLIC_KEY
+#define OTA_DELTA_PUBLIC_KEY ""
+#endif
+
 namespace {
 constexpr char latestReleaseUrl[] = "https://api.github.com/repos/crosspoint-reader/crosspoint-reader/releases/latest";
+constexpr char deltaAssetName[] = "firmware-from-" CROSSPOINT_VERSION ".patch";
+constexpr char deltaPatchPath[] = "/.crosspoint/ota.patch";
+constexpr int maxRedirects = 5;
 
 /* This is buffer and size holder to keep upcoming data from latestReleaseUrl */
 char* local_buf;
@@ -58,6 +75,117 @@ esp_err_t event_handler(esp_http_client_event_t* event) {
 
   return ESP_OK;
 } /* event_handler */
+
+/*
+ * Patch download over esp_http_client with the certificate bundle. Kept apart from HttpDownloader, which sends the
+ * OPDS credentials and skips certificate checks.
+ */
+class PatchTransport final : public ResumableDownload::Transport {
+ public:
+  explicit PatchTransport(const std::string& url) : url(url) {}
+  ~PatchTransport() override { end(); }
+
+  bool request(const size_t rangeStart, const std::string& ifRange, ResumableDownload::Response& out) override {
+    esp_http_client_config_t config = {
+        .url = url.c_str(),
+        .timeout_ms = 15000,
+        .disable_auto_redirect = true,
+        .event_handler = onEvent,
+        .buffer_size = 8192,
+        .buffer_size_tx = 8192,
+        .user_data = this,
+        .skip_cert_common_name_check = true,
+        .crt_bundle_attach = esp_crt_bundle_attach,
+    };
+    client = esp_http_client_init(&config);
+    if (!client) {
+      return false;
+    }
+    esp_http_client_set_header(client, "User-Agent", "CrossPoint-ESP32-" CROSSPOINT_VERSION);
+    if (rangeStart > 0) {
+      const std::string range = "bytes=" + std::to_string(rangeStart) + "-";
+      esp_http_client_set_header(client, "Range", range.c_str());
+      if (!ifRange.empty()) {
+        esp_http_client_set_header(client, "If-Range", ifRange.c_str());
+      }
+    }
+
+    // Release assets redirect to a storage host
+    for (int redirects = 0;; redirects++) {
+      response = &out;
+      out = {};
+      esp_err_t err = esp_http_client_open(client, 0);
+      if (err != ESP_OK || esp_http_client_fetch_headers(client) < 0) {
+        LOG_ERR("OTA", "Patch request failed: %s", esp_err_to_name(err));
+        return false;
+      }
+      out.status = esp_http_client_get_status_code(client);
+      if (out.status < 300 || out.status >= 400 || out.status == 304 || redirects == maxRedirects) {
+        break;
+      }
+      esp_http_client_flush_response(client, nullptr);
+      esp_http_client_close(client);
+      if (esp_http_client_set_redirection(client) != ESP_OK) {
+        return false;
+      }
+    }
+    out.contentLength = esp_http_client_is_chunked_response(client) ? -1 : esp_http_client_get_content_length(client);
+    return true;
+  }
+
+  bool readBody(const Sink& sink) override {
+    uint8_t buffer[1024];
+    while (true) {
+      const int read = esp_http_client_read(client, reinterpret_cast<char*>(buffer), sizeof(buffer));
+      if (read < 0) return false;
+      if (read == 0) return esp_http_client_is_complete_data_received(client);
+      if (!sink(buffer, read)) return false;
+    }
+  }
+
+  void end() override {
+    if (client) {
+      esp_http_client_cleanup(client);
+      client = nullptr;
+    }
+    response = nullptr;
+  }
+
+ private:
+  static esp_err_t onEvent(esp_http_client_event_t* event) {
+    auto* self = static_cast<PatchTransport*>(event->user_data);
+    if (event->event_id != HTTP_EVENT_ON_HEADER || !self->response) return ESP_OK;
+    if (strcasecmp(event->header_key, "ETag") == 0) {
+      self->response->etag = event->header_value;
+    } else if (strcasecmp(event->header_key, "Last-Modified") == 0) {
+      self->response->lastModified = event->header_value;
+    } else if (strcasecmp(event->header_key, "Content-Range") == 0) {
+      self->response->contentRange = event->header_value;
+    }
+    return ESP_OK;
+  }
+
+  std::string url;
+  esp_http_client_handle_t client = nullptr;
+  ResumableDownload::Response* response = nullptr;
+};
+
+bool checkPatchSignature(const uint8_t* digest, const uint8_t* signature, const size_t size) {
+  uint8_t key[128];
+  size_t keySize = 0;
+  if (mbedtls_base64_decode(key, sizeof(key), &keySize, reinterpret_cast<const unsigned char*>(OTA_DELTA_PUBLIC_KEY),
+                            strlen(OTA_DELTA_PUBLIC_KEY)) != 0) {
+    LOG_ERR("OTA", "OTA_DELTA_PUBLIC_KEY is not valid base64");
+    return false;
+  }
+
+  mbedtls_pk_context pk;
+  mbedtls_pk_init(&pk);
+  const bool valid = mbedtls_pk_parse_public_key(&pk, key, keySize) == 0 &&
+                     mbedtls_pk_verify(&pk, MBEDTLS_MD_SHA256, digest, DeltaPatch::HASH_SIZE, signature, size) == 0;
+  mbedtls_pk_free(&pk);
+  return valid;
+}
 } /* namespace */
 
 OtaUpdater::OtaUpdaterError OtaUpdater::checkForUpdate() {
@@ -142,7 +270,9 @@ OtaUpdater::OtaUpdaterError OtaUpdater::checkForUpdate() {
       otaSize = doc["assets"][i]["size"].as<size_t>();
       totalSize = otaSize;
       updateAvailable = true;
-      break;
+    } else if (doc["assets"][i]["name"] == deltaAssetName) {
+      deltaUrl = doc["assets"][i]["browser_download_url"].as<std::string>();
+      deltaSize = doc["assets"][i]["size"].as<size_t>();
     }
   }
 
@@ -151,7 +281,7 @@ OtaUpdater::OtaUpdaterError OtaUpdater::checkForUpdate() {
     return NO_UPDATE;
   }
 
-  LOG_DBG("OTA", "Found update: %s", latestVersion.c_str());
+  LOG_DBG("OTA", "Found update: %s%s", latestVersion.c_str(), deltaUrl.empty() ? "" : " (delta patch)");
   return OK;
 }
 
@@ -205,10 +335,113 @@ OtaUpdater::OtaUpdaterError OtaUpdater::installUpdate() {
     return UPDATE_OLDER_ERROR;
   }
 
+  if (!deltaUrl.empty() && strlen(OTA_DELTA_PUBLIC_KEY) > 0) {
+    if (installDelta() == OK) {
+      return OK;
+    }
+    LOG_INF("OTA", "Delta update failed, downloading the full image");
+  }
+  return installFullImage();
+}
+
+OtaUpdater::OtaUpdaterError OtaUpdater::installDelta() {
+  render = false;
+  processedSize = 0;
+  totalSize = deltaSize;
+
+  /* The patch is kept on the card, so a dropped connection or a reboot resumes the download */
+  Storage.mkdir("/.crosspoint");
+  esp_wifi_set_ps(WIFI_PS_NONE);
+  ResumableDownload::Result downloadResult;
+  {
+    PatchTransport transport(deltaUrl);
+    ResumableDownload download(deltaUrl, deltaPatchPath);
+    downloadResult = download.run(transport, [this](const size_t downloaded, const size_t total) {
+      processedSize = downloaded;
+      totalSize = total;
+      render = true;
+    });
+  }
+  esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+  if (downloadResult != ResumableDownload::Result::OK) {
+    LOG_ERR("OTA", "Patch download failed: %d", static_cast<int>(downloadResult));
+    return HTTP_ERROR;
+  }
+
+  FsFile patchFile;
+  if (!Storage.openFileForRead("OTA", deltaPatchPath, patchFile)) {
+    return INTERNAL_UPDATE_ERROR;
+  }
+  DeltaPatch patch([&patchFile](uint8_t* buffer, const size_t size) { return patchFile.read(buffer, size); });
+
+  const esp_partition_t* running = esp_ota_get_running_partition();
+  const esp_partition_t* next = esp_ota_get_next_update_partition(nullptr);
+  const auto readRunning = [running](const size_t offset, uint8_t* buffer, const size_t size) {
+    return esp_partition_read(running, offset, buffer, size) == ESP_OK;
+  };
+
+  /* Signature first, then the running image, so a foreign or stale patch never touches the other partition */
+  DeltaPatch::Error err = patch.begin(checkPatchSignature);
+  if (err == DeltaPatch::Error::OK && (!running || !next || patch.header().sourceSize > running->size ||
+                                       patch.header().targetSize > next->size)) {
+    err = DeltaPatch::Error::BAD_HEADER;
+  }
+  if (err == DeltaPatch::Error::OK) {
+    err = patch.checkSource(readRunning);
+  }
+  if (err != DeltaPatch::Error::OK) {
+    LOG_ERR("OTA", "Patch rejected: %d", static_cast<int>(err));
+    patchFile.close();
+    Storage.remove(deltaPatchPath);
+    return INTERNAL_UPDATE_ERROR;
+  }
+
+  esp_ota_handle_t ota_handle = 0;
+  esp_err_t esp_err = esp_ota_begin(next, patch.header().targetSize, &ota_handle);
+  if (esp_err != ESP_OK) {
+    LOG_ERR("OTA", "esp_ota_begin Failed: %s", esp_err_to_name(esp_err));
+    patchFile.close();
+    return INTERNAL_UPDATE_ERROR;
+  }
+
+  processedSize = 0;
+  totalSize = patch.header().targetSize;
+  err = patch.apply(
+      readRunning,
+      [ota_handle](const uint8_t* data, const size_t size) { return esp_ota_write(ota_handle, data, size) == ESP_OK; },
+      [this](const size_t written, size_t) {
+        processedSize = written;
+        render = true;
+      });
+  patchFile.close();
+  Storage.remove(deltaPatchPath);
+
+  /* The rebuilt image hashed to the signed target hash, only now may it become bootable */
+  if (err != DeltaPatch::Error::OK) {
+    LOG_ERR("OTA", "Patch apply failed: %d", static_cast<int>(err));
+    esp_ota_abort(ota_handle);
+    return INTERNAL_UPDATE_ERROR;
+  }
+  esp_err = esp_ota_end(ota_handle);
+  if (esp_err == ESP_OK) {
+    esp_err = esp_ota_set_boot_partition(next);
+  }
+  if (esp_err != ESP_OK) {
+    LOG_ERR("OTA", "Activating patched image Failed: %s", esp_err_to_name(esp_err));
+    return INTERNAL_UPDATE_ERROR;
+  }
+
+  LOG_INF("OTA", "Update completed from a %zu byte patch", deltaSize);
+  return OK;
+}
+
+OtaUpdater::OtaUpdaterError OtaUpdater::installFullImage() {
   esp_https_ota_handle_t ota_handle = NULL;
   esp_err_t esp_err;
   /* Signal for OtaUpdateActivity */
   render = false;
+  processedSize = 0;
+  totalSize = otaSize;
 
   esp_http_client_config_t client_config = {
       .url = otaUrl.c_str(),
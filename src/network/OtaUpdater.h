@@ -8,6 +8,9 @@ class OtaUpdater {
   std::string latestVersion;
   std::string otaUrl;
   size_t otaSize = 0;
+  // Patch from the running version, when the release has one
+  std::string deltaUrl;
+  size_t deltaSize = 0;
   size_t processedSize = 0;
   size_t totalSize = 0;
   bool render = false;
@@ -35,5 +38,10 @@ class OtaUpdater {
   bool isUpdateNewer() const;
   const std::string& getLatestVersion() const;
   OtaUpdaterError checkForUpdate();
+  // Applies the release's delta patch when there is a signed one for this version, otherwise the full image
   OtaUpdaterError installUpdate();
+
+ private:
+  OtaUpdaterError installDelta();
+  OtaUpdaterError installFullImage();
 };
@@ -0,0 +1,319 @@
+#include "ResumableDownload.h"
+
+#include <Arduino.h>
+#include <Logging.h>
+#include <Serialization.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+namespace {
+constexpr uint8_t STATE_VERSION = 1;
+// Progress is made durable this often; a reboot loses at most this much of the download
+constexpr size_t CHECKPOINT_BYTES = 256 * 1024;
+constexpr unsigned long RETRY_DELAY_MS = 1000;
+
+// "bytes <first>-<last>/<total>" from a 206 response
+bool parseContentRange(const std::string& header, size_t& first, size_t& total) {
+  const char* p = header.c_str();
+  if (strncmp(p, "bytes ", 6) != 0) return false;
+  char* end;
+  first = strtoul(p + 6, &end, 10);
+  if (*end != '-') return false;
+  strtoul(end + 1, &end, 10);
+  if (*end != '/' || end[1] < '0' || end[1] > '9') return false;
+  total = strtoul(end + 1, &end, 10);
+  return *end == '\0';
+}
+}  // namespace
+
+ResumableDownload::ResumableDownload(std::string url, std::string destPath)
+    : url(std::move(url)), destPath(std::move(destPath)) {
+  partPath = this->destPath + ".part";
+  statePath = partPath + ".state";
+}
+
+ResumableDownload::~ResumableDownload() {
+  if (part) {
+    suspend();
+  }
+}
+
+ResumableDownload::Result ResumableDownload::run(Transport& transport, const ProgressCallback& progress,
+                                                 const Verifier& verify, const int maxAttempts) {
+  loadState();
+  if (resumable && receivedBytes == totalBytes) {
+    // Complete on an earlier attempt but never renamed
+    return finish(verify);
+  }
+
+  for (int attempt = 0; attempt < maxAttempts; attempt++) {
+    if (attempt > 0) {
+      delay(RETRY_DELAY_MS * attempt);
+    }
+
+    // If-Range needs a strong validator
+    const std::string& validator = !etag.empty() && etag.rfind("W/", 0) != 0 ? etag : lastModified;
+    const size_t rangeStart = resumable ? receivedBytes : 0;
+    Response response;
+    if (!transport.request(rangeStart, rangeStart > 0 ? validator : std::string(), response)) {
+      LOG_ERR("DL", "No response from %s", url.c_str());
+      transport.end();
+      continue;
+    }
+
+    switch (begin(response)) {
+      case Start::WRITE:
+        break;
+      case Start::COMPLETE:
+        transport.end();
+        return finish(verify);
+      case Start::RESTART:
+        transport.end();
+        continue;
+      case Start::HTTP_FAIL:
+        transport.end();
+        suspend();
+        return Result::HTTP_ERROR;
+      case Start::FILE_FAIL:
+        transport.end();
+        suspend();
+        return Result::FILE_ERROR;
+    }
+
+    const bool bodyOk = transport.readBody([this, &progress](const uint8_t* data, const size_t size) {
+      if (!write(data, size)) return false;
+      if (progress && totalBytes > 0) {
+        progress(receivedBytes, totalBytes);
+      }
+      return true;
+    });
+    transport.end();
+
+    if (writeFailed) {
+      suspend();
+      return Result::FILE_ERROR;
+    }
+    if (overrun) {
+      LOG_ERR("DL", "Server sent more than %zu bytes", totalBytes);
+      discard();
+      return Result::HTTP_ERROR;
+    }
+    if (totalBytes > 0 ? receivedBytes == totalBytes : bodyOk) {
+      return finish(verify);
+    }
+
+    LOG_DBG("DL", "Connection dropped at %zu of %zu bytes", receivedBytes, totalBytes);
+    suspend();
+  }
+
+  LOG_ERR("DL", "Giving up on %s after %d attempts", url.c_str(), maxAttempts);
+  return Result::HTTP_ERROR;
+}
+
+void ResumableDownload::discard() {
+  closePart();
+  Storage.remove(partPath.c_str());
+  Storage.remove(statePath.c_str());
+  etag.clear();
+  lastModified.clear();
+  totalBytes = 0;
+  receivedBytes = 0;
+  checkpointBytes = 0;
+  resumable = false;
+}
+
+void ResumableDownload::closePart() {
+  if (part) {
+    part.flush();
+    part.close();
+  }
+}
+
+void ResumableDownload::loadState() {
+  FsFile file;
+  if (!Storage.exists(statePath.c_str()) || !Storage.openFileForRead("DL", statePath, file)) {
+    discard();
+    return;
+  }
+
+  uint8_t version = 0;
+  std::string savedUrl;
+  uint64_t savedTotal = 0;
+  uint64_t savedBytes = 0;
+  const size_t stateSize = file.size();
+  // A record cut short by a reboot holds lengths that run past its end
+  size_t remaining = stateSize;
+  const auto readString = [&file, &remaining](std::string& value) {
+    uint32_t length = 0;
+    if (remaining < sizeof(length)) return false;
+    serialization::readPod(file, length);
+    remaining -= sizeof(length);
+    if (length > remaining) return false;
+    value.resize(length);
+    remaining -= length;
+    return file.read(value.data(), length) == static_cast<int>(length);
+  };
+  serialization::readPod(file, version);
+  remaining -= remaining > 0 ? sizeof(version) : 0;
+  const bool parsed = version == STATE_VERSION && readString(savedUrl) && readString(etag) &&
+                      readString(lastModified) && remaining == sizeof(savedTotal) + sizeof(savedBytes);
+  if (parsed) {
+    serialization::readPod(file, savedTotal);
+    serialization::readPod(file, savedBytes);
+  }
+  file.close();
+
+  if (!parsed || savedUrl != url || savedTotal == 0 || savedBytes > savedTotal) {
+    LOG_DBG("DL", "Discarding download state for %s", destPath.c_str());
+    discard();
+    return;
+  }
+
+  FsFile partFile;
+  if (!Storage.openFileForRead("DL", partPath, partFile)) {
+    discard();
+    return;
+  }
+  const size_t partSize = partFile.size();
+  partFile.close();
+
+  // Only trust bytes that were on the card when the state was written
+  totalBytes = savedTotal;
+  receivedBytes = partSize < savedBytes ? partSize : static_cast<size_t>(savedBytes);
+  checkpointBytes = receivedBytes;
+  resumable = true;
+  LOG_DBG("DL", "Resuming %s at %zu of %zu bytes", destPath.c_str(), receivedBytes, totalBytes);
+}
+
+void ResumableDownload::saveState() {
+  FsFile file;
+  if (!Storage.openFileForWrite("DL", statePath, file)) {
+    return;
+  }
+  serialization::writePod(file, STATE_VERSION);
+  serialization::writeString(file, url);
+  serialization::writeString(file, etag);
+  serialization::writeString(file, lastModified);
+  serialization::writePod(file, static_cast<uint64_t>(totalBytes));
+  serialization::writePod(file, static_cast<uint64_t>(receivedBytes));
+  file.close();
+}
+
+ResumableDownload::Start ResumableDownload::begin(const Response& response) {
+  writeFailed = false;
+  overrun = false;
+
+  if (response.status == 206 && resumable && receivedBytes > 0) {
+    size_t first = 0;
+    size_t total = 0;
+    if (!parseContentRange(response.contentRange, first, total) || first != receivedBytes || total != totalBytes ||
+        (!response.etag.empty() && response.etag != etag)) {
+      LOG_ERR("DL", "Range response doesn't continue the partial file, restarting");
+      discard();
+      return Start::RESTART;
+    }
+    part = Storage.open(partPath.c_str(), O_RDWR);
+    if (!part || !part.seekSet(receivedBytes)) {
+      LOG_ERR("DL", "Failed to reopen %s", partPath.c_str());
+      return Start::FILE_FAIL;
+    }
+    return Start::WRITE;
+  }
+
+  if (response.status == 200) {
+    // A fresh download, or the file changed on the server and If-Range sent all of it
+    etag = response.etag;
+    lastModified = response.lastModified;
+    totalBytes = response.contentLength > 0 ? static_cast<size_t>(response.contentLength) : 0;
+    receivedBytes = 0;
+    checkpointBytes = 0;
+    resumable = totalBytes > 0 && (!etag.empty() || !lastModified.empty());
+    if (!Storage.openFileForWrite("DL", partPath, part)) {
+      LOG_ERR("DL", "Failed to open %s for writing", partPath.c_str());
+      return Start::FILE_FAIL;
+    }
+    if (resumable) {
+      saveState();
+    } else {
+      Storage.remove(statePath.c_str());
+    }
+    return Start::WRITE;
+  }
+
+  if (response.status == 416 && resumable && receivedBytes > 0) {
+    if (receivedBytes == totalBytes) {
+      return Start::COMPLETE;
+    }
+    discard();
+    return Start::RESTART;
+  }
+
+  LOG_ERR("DL", "Download failed: HTTP %d", response.status);
+  return Start::HTTP_FAIL;
+}
+
+bool ResumableDownload::write(const uint8_t* data, const size_t size) {
+  if (totalBytes > 0 && receivedBytes + size > totalBytes) {
+    overrun = true;
+    return false;
+  }
+  if (part.write(data, size) != size) {
+    LOG_ERR("DL", "Write to %s failed", partPath.c_str());
+    writeFailed = true;
+    return false;
+  }
+  receivedBytes += size;
+  if (resumable && receivedBytes - checkpointBytes >= CHECKPOINT_BYTES) {
+    part.flush();
+    saveState();
+    checkpointBytes = receivedBytes;
+  }
+  return true;
+}
+
+void ResumableDownload::suspend() {
+  closePart();
+  if (resumable && receivedBytes > 0) {
+    saveState();
+    checkpointBytes = receivedBytes;
+  } else {
+    discard();
+  }
+}
+
+ResumableDownload::Result ResumableDownload::finish(const Verifier& verify) {
+  closePart();
+
+  if (totalBytes == 0 && receivedBytes == 0) {
+    LOG_ERR("DL", "Download failed: no data received");
+    discard();
+    return Result::HTTP_ERROR;
+  }
+
+  if (verify) {
+    FsFile file;
+    bool verified = false;
+    if (Storage.openFileForRead("DL", partPath, file)) {
+      verified = verify(file);
+      file.close();
+    }
+    if (!verified) {
+      LOG_ERR("DL", "Checksum mismatch for %s", destPath.c_str());
+      discard();
+      return Result::CHECKSUM_ERROR;
+    }
+  }
+
+  if (Storage.exists(destPath.c_str())) {
+    Storage.remove(destPath.c_str());
+  }
+  if (!Storage.rename(partPath.c_str(), destPath.c_str())) {
+    LOG_ERR("DL", "Failed to move %s into place", partPath.c_str());
+    return Result::FILE_ERROR;
+  }
+  Storage.remove(statePath.c_str());
+  LOG_DBG("DL", "Downloaded %zu bytes to %s", receivedBytes, destPath.c_str());
+  return Result::OK;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <HalStorage.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+/**
+ * Download of one URL to the SD card that survives dropped connections and reboots.
+ *
+ * The body is written to `<dest>.part`, and `<dest>.part.state` records the URL, the server's validators and how
+ * many bytes are safely on the card. A later attempt asks for the rest with `Range` and `If-Range`, so a changed
+ * file on the server restarts the download instead of splicing two versions together. The file is only renamed to
+ * `<dest>` once its length, and optionally its hash, have been checked.
+ *
+ * The HTTP side is a Transport so the logic runs the same against HTTPClient and the host tests.
+ */
+class ResumableDownload {
+ public:
+  enum class Result { OK, HTTP_ERROR, FILE_ERROR, CHECKSUM_ERROR };
+
+  struct Response {
+    int status = 0;
+    int64_t contentLength = -1;  // Body length, -1 when not sent
+    std::string etag;
+    std::string lastModified;
+    std::string contentRange;
+  };
+
+  class Transport {
+   public:
+    using Sink = std::function<bool(const uint8_t* data, size_t size)>;
+
+    virtual ~Transport() = default;
+    // Send a GET, from `rangeStart` when non-zero, and read the response headers. False when nothing came back.
+    virtual bool request(size_t rangeStart, const std::string& ifRange, Response& response) = 0;
+    // Stream the body into `sink`. False if the connection dropped or `sink` refused data.
+    virtual bool readBody(const Sink& sink) = 0;
+    virtual void end() = 0;
+  };
+
+  using ProgressCallback = std::function<void(size_t downloaded, size_t total)>;
+  // Check the complete `.part` file, opened for reading, before it is renamed into place
+  using Verifier = std::function<bool(FsFile& file)>;
+
+  ResumableDownload(std::string url, std::string destPath);
+  ~ResumableDownload();
+
+  ResumableDownload(const ResumableDownload&) = delete;
+  ResumableDownload& operator=(const ResumableDownload&) = delete;
+
+  // Fetch the file, resuming an earlier attempt and retrying dropped connections up to `maxAttempts` times.
+  // A partial file is kept on every failure except a checksum mismatch, so calling again picks up where this
+  // attempt stopped.
+  Result run(Transport& transport, const ProgressCallback& progress = nullptr, const Verifier& verify = nullptr,
+             int maxAttempts = 4);
+
+  // Bytes of the file on the card, including those from earlier attempts
+  size_t received() const { return receivedBytes; }
+  // Full file size, 0 while unknown
+  size_t total() const { return totalBytes; }
+
+  // Delete the partial file and its state
+  void discard();
+
+ private:
+  enum class Start { WRITE, COMPLETE, RESTART, HTTP_FAIL, FILE_FAIL };
+
+  std::string url;
+  std::string destPath;
+  std::string partPath;
+  std::string statePath;
+  std::string etag;
+  std::string lastModified;
+  size_t totalBytes = 0;
+  size_t receivedBytes = 0;
+  size_t checkpointBytes = 0;
+  bool resumable = false;  // Length and a validator are known, so a later attempt may continue the file
+  bool writeFailed = false;
+  bool overrun = false;  // The server sent more than it announced
+  FsFile part;
+
+  void closePart();
+  void loadState();
+  void saveState();
+  Start begin(const Response& response);
+  bool write(const uint8_t* data, size_t size);
+  void suspend();
+  Result finish(const Verifier& verify);
+};
@@ -0,0 +1,230 @@
+#include "UploadWriter.h"
+
+#include <Arduino.h>
+#include <Logging.h>
+#include <esp_rom_crc.h>
+#include <esp_task_wdt.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+// How long write() waits for the card before declaring it stalled; the watchdog is fed in between
+constexpr TickType_t BUFFER_WAIT_SLICE = pdMS_TO_TICKS(500);
+constexpr int MAX_BUFFER_WAIT_SLICES = 20;
+}  // namespace
+
+UploadWriter::~UploadWriter() {
+  if (isActive()) {
+    abort();
+  }
+}
+
+bool UploadWriter::begin(const std::string& uploadPath) {
+  if (isActive()) {
+    abort();
+  }
+  path = uploadPath;
+  fillBuffer = -1;
+  fillPos = 0;
+  bytesReceived = 0;
+  error = nullptr;
+  failed = false;
+  discarding = false;
+  bytesWritten = 0;
+  crc = 0;
+  writeTimeMs = 0;
+  writeCount = 0;
+
+  if (!Storage.openFileForWrite("UPW", path, file)) {
+    error = "Failed to create file on SD card";
+    return false;
+  }
+
+  freeBuffers = xQueueCreate(BUFFER_COUNT, sizeof(uint8_t));
+  filledBuffers = xQueueCreate(BUFFER_COUNT + 1, sizeof(Block));  // Room for a marker behind a full ring
+  drained = xSemaphoreCreateBinary();
+  bool ok = freeBuffers && filledBuffers && drained;
+  for (uint8_t i = 0; ok && i < BUFFER_COUNT; i++) {
+    buffers[i] = static_cast<uint8_t*>(malloc(BUFFER_SIZE));
+    ok = buffers[i] != nullptr && xQueueSend(freeBuffers, &i, 0) == pdTRUE;
+  }
+  // Above the main loop so queued buffers reach the card while the network side is busy
+  ok = ok && xTaskCreate(&taskTrampoline, "UploadWriter", 4096, this, 2, &task) == pdPASS;
+
+  if (!ok) {
+    LOG_ERR("UPW", "Failed to allocate upload buffers");
+    task = nullptr;
+    stopTask();
+    file.close();
+    Storage.remove(path.c_str());
+    error = "Not enough memory for upload";
+    return false;
+  }
+  return true;
+}
+
+bool UploadWriter::write(const uint8_t* data, size_t length) {
+  if (!isActive() || error) {
+    return false;
+  }
+  while (length > 0) {
+    if (failed) {
+      fail("Failed to write to SD card - disk may be full");
+      return false;
+    }
+    if (fillBuffer < 0 && !acquireBuffer()) {
+      return false;
+    }
+    const size_t toCopy = std::min(length, BUFFER_SIZE - fillPos);
+    memcpy(buffers[fillBuffer] + fillPos, data, toCopy);
+    fillPos += toCopy;
+    data += toCopy;
+    length -= toCopy;
+    bytesReceived += toCopy;
+    if (fillPos == BUFFER_SIZE && !submitFillBuffer()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool UploadWriter::finish(const size_t expectedSize, const uint32_t* expectedCrc) {
+  if (!isActive()) {
+    return false;
+  }
+  if (error) {
+    abort();
+    return false;
+  }
+
+  if (fillPos > 0 && !submitFillBuffer()) {
+    abort();
+    return false;
+  }
+  stopTask();  // Writes everything queued before stopping
+
+  file.flush();
+  const size_t fileSize = file.size();
+  file.close();
+
+  if (failed) {
+    error = "Failed to write to SD card - disk may be full";
+  } else if (bytesWritten != bytesReceived || fileSize != bytesReceived) {
+    error = "Upload incomplete on SD card";
+  } else if (expectedSize != 0 && bytesReceived != expectedSize) {
+    error = "Upload size mismatch";
+  } else if (expectedCrc && crc != *expectedCrc) {
+    error = "Upload checksum mismatch";
+  }
+
+  if (error) {
+    LOG_ERR("UPW", "%s: %s (%zu/%zu bytes, crc %08lx)", path.c_str(), error, bytesWritten, bytesReceived,
+            static_cast<unsigned long>(crc));
+    Storage.remove(path.c_str());
+    return false;
+  }
+  LOG_DBG("UPW", "%s: %zu bytes, crc %08lx, %zu writes in %lu ms", path.c_str(), bytesWritten,
+          static_cast<unsigned long>(crc), writeCount, writeTimeMs);
+  return true;
+}
+
+void UploadWriter::abort() {
+  if (!isActive()) {
+    return;
+  }
+  discarding = true;
+  stopTask();
+  file.close();
+  Storage.remove(path.c_str());
+  if (!error) {
+    error = "Upload aborted";
+  }
+  LOG_DBG("UPW", "Aborted %s after %zu bytes", path.c_str(), bytesReceived);
+}
+
+void UploadWriter::taskTrampoline(void* param) {
+  static_cast<UploadWriter*>(param)->taskLoop();
+  vTaskDelete(nullptr);
+}
+
+void UploadWriter::taskLoop() {
+  Block block{};
+  while (true) {
+    xQueueReceive(filledBuffers, &block, portMAX_DELAY);
+    if (block.buffer == STOP_MARKER) {
+      xSemaphoreGive(drained);
+      return;
+    }
+
+    // After a failure keep recycling buffers so the network side can notice and stop
+    if (!failed && !discarding) {
+      const uint8_t* data = buffers[block.buffer];
+      const unsigned long start = millis();
+      const size_t written = file.write(data, block.length);
+      writeTimeMs += millis() - start;
+      writeCount++;
+      crc = esp_rom_crc32_le(crc, data, written);
+      bytesWritten += written;
+      if (written != block.length) {
+        LOG_ERR("UPW", "SD write failed: %zu of %u bytes", written, block.length);
+        failed = true;
+      }
+    }
+    xQueueSend(freeBuffers, &block.buffer, portMAX_DELAY);
+  }
+}
+
+bool UploadWriter::acquireBuffer() {
+  uint8_t index = 0;
+  for (int slice = 0; slice < MAX_BUFFER_WAIT_SLICES; slice++) {
+    if (xQueueReceive(freeBuffers, &index, BUFFER_WAIT_SLICE) == pdTRUE) {
+      fillBuffer = index;
+      fillPos = 0;
+      return true;
+    }
+    esp_task_wdt_reset();
+    if (failed) {
+      break;
+    }
+  }
+  fail(failed ? "Failed to write to SD card - disk may be full" : "SD card stalled");
+  return false;
+}
+
+bool UploadWriter::submitFillBuffer() {
+  const Block block{static_cast<uint8_t>(fillBuffer), static_cast<uint16_t>(fillPos)};
+  xQueueSend(filledBuffers, &block, portMAX_DELAY);  // Never full: at most BUFFER_COUNT buffers are in flight
+  fillBuffer = -1;
+  fillPos = 0;
+  return true;
+}
+
+// Waits for everything queued to be written (or discarded), ends the task and releases the buffers
+void UploadWriter::stopTask() {
+  if (task) {
+    const Block stop{STOP_MARKER, 0};
+    xQueueSend(filledBuffers, &stop, portMAX_DELAY);
+    xSemaphoreTake(drained, portMAX_DELAY);
+    task = nullptr;
+  }
+  for (auto& buffer : buffers) {
+    free(buffer);
+    buffer = nullptr;
+  }
+  if (freeBuffers) vQueueDelete(freeBuffers);
+  if (filledBuffers) vQueueDelete(filledBuffers);
+  if (drained) vSemaphoreDelete(drained);
+  freeBuffers = nullptr;
+  filledBuffers = nullptr;
+  drained = nullptr;
+  fillBuffer = -1;
+  fillPos = 0;
+}
+
+void UploadWriter::fail(const char* message) {
+  if (!error) {
+    error = message;
+  }
+}
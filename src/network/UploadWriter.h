@@ -0,0 +1,93 @@
+#pragma once
+
+#include <HalStorage.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Streams an upload to the SD card through a ring of buffers drained by a dedicated writer task.
+ *
+ * The network side copies received data into the current buffer and carries on reading the socket while earlier
+ * buffers are being written, so an upload runs at the speed of the slower of network and card instead of both
+ * added together. When every buffer is waiting for the card, write() blocks, which stops the caller reading the
+ * socket and lets TCP flow control slow the sender down.
+ *
+ * The writer task keeps a CRC-32 of everything written. finish() drains the ring and verifies byte count, file
+ * size and (when the client supplied one) the CRC; any failure, like abort(), removes the partial file.
+ *
+ * Buffers and the task only exist between begin() and finish()/abort().
+ */
+class UploadWriter {
+ public:
+  static constexpr size_t BUFFER_COUNT = 3;
+  static constexpr size_t BUFFER_SIZE = 8192;
+
+  UploadWriter() = default;
+  ~UploadWriter();
+  UploadWriter(const UploadWriter&) = delete;
+  UploadWriter& operator=(const UploadWriter&) = delete;
+
+  // Create (or truncate) `path` and start the writer task
+  bool begin(const std::string& path);
+  // Queue data for writing; blocks while the card is behind. Returns false once the upload has failed.
+  bool write(const uint8_t* data, size_t length);
+  // Write everything queued, close the file and verify it. `expectedSize`/`expectedCrc` are checked when non-zero /
+  // non-null. On failure the file is removed and getError() says why.
+  bool finish(size_t expectedSize = 0, const uint32_t* expectedCrc = nullptr);
+  // Discard queued data and remove the partial file
+  void abort();
+
+  [[nodiscard]] bool isActive() const { return task != nullptr; }
+  [[nodiscard]] size_t getBytesReceived() const { return bytesReceived; }
+  // CRC-32 (IEEE) of the data written; complete after finish()
+  [[nodiscard]] uint32_t getCrc() const { return crc; }
+  [[nodiscard]] const char* getError() const { return error; }
+  // Time the writer task spent in SD writes, and how many it made
+  [[nodiscard]] unsigned long getWriteTimeMs() const { return writeTimeMs; }
+  [[nodiscard]] size_t getWriteCount() const { return writeCount; }
+
+ private:
+  // A filled buffer handed to the writer task, or a control marker
+  struct Block {
+    uint8_t buffer;
+    uint16_t length;
+  };
+  static constexpr uint8_t STOP_MARKER = 0xFF;  // Everything before it is written: signal `drained` and exit
+
+  FsFile file;
+  std::string path;
+  uint8_t* buffers[BUFFER_COUNT] = {};
+  QueueHandle_t freeBuffers = nullptr;
+  QueueHandle_t filledBuffers = nullptr;
+  SemaphoreHandle_t drained = nullptr;
+  TaskHandle_t task = nullptr;
+
+  // Network side
+  int fillBuffer = -1;
+  size_t fillPos = 0;
+  size_t bytesReceived = 0;
+  const char* error = nullptr;
+
+  // Writer task side; read by the network side only once the task has stopped
+  std::atomic<bool> failed{false};
+  std::atomic<bool> discarding{false};
+  size_t bytesWritten = 0;
+  uint32_t crc = 0;
+  unsigned long writeTimeMs = 0;
+  size_t writeCount = 0;
+
+  static void taskTrampoline(void* param);
+  void taskLoop();
+
+  bool acquireBuffer();
+  bool submitFillBuffer();
+  void stopTask();
+  void fail(const char* message);
+};
@@ -1,19 +1,45 @@
 #include "WebDAVHandler.h"
 
+#include <DirectoryIndex.h>
 #include <Epub.h>
 #include <FsHelpers.h>
 #include <HalStorage.h>
+#include <LibraryDb.h>
 #include <Logging.h>
 #include <esp_task_wdt.h>
 
+#include "BookPreIndexer.h"
+#include "WebDAVProtocol.h"
+
 namespace {
 const char* HIDDEN_ITEMS[] = {"System Volume Information", "XTCache"};
 constexpr size_t HIDDEN_ITEMS_COUNT = sizeof(HIDDEN_ITEMS) / sizeof(HIDDEN_ITEMS[0]);
 
-// RFC 1123 date format helper: "Sun, 06 Nov 1994 08:49:37 GMT"
-// ESP32 doesn't have real-time clock set by default, so we use a fixed epoch date
-// as a fallback. The date is not critical for WebDAV Class 1 operations.
-const char* FIXED_DATE = "Thu, 01 Jan 2024 00:00:00 GMT";
+// Dotfiles and the card's system folders are never listed or served
+bool isProtectedName(const char* name) {
+  if (name[0] == '.') return true;
+  for (size_t i = 0; i < HIDDEN_ITEMS_COUNT; i++) {
+    if (strcmp(name, HIDDEN_ITEMS[i]) == 0) return true;
+  }
+  return false;
+}
+
+// Appends the contents of the file at `path` to `out`
+bool copyContents(const String& path, FsFile& out) {
+  FsFile in;
+  if (!Storage.openFileForRead("DAV", path, in)) {
+    return false;
+  }
+  uint8_t buf[4096];
+  bool ok = true;
+  while (ok && in.available()) {
+    esp_task_wdt_reset();
+    const int bytesRead = in.read(buf, sizeof(buf));
+    ok = bytesRead > 0 && out.write(buf, bytesRead) == static_cast<size_t>(bytesRead);
+  }
+  in.close();
+  return ok;
+}
 }  // namespace
 
 // ── RequestHandler interface ─────────────────────────────────────────────────
@@ -47,40 +73,9 @@ bool WebDAVHandler::canRaw(WebServer& server, const String& uri) {
 void WebDAVHandler::raw(WebServer& server, const String& uri, HTTPRaw& raw) {
   (void)uri;
   if (raw.status == RAW_START) {
-    _putPath = getRequestPath(server);
-    if (isProtectedPath(_putPath)) {
-      _putOk = false;
-      return;
-    }
-
-    // Ensure parent directory exists
-    int lastSlash = _putPath.lastIndexOf('/');
-    if (lastSlash > 0) {
-      String parentPath = _putPath.substring(0, lastSlash);
-      if (!Storage.exists(parentPath.c_str())) {
-        _putOk = false;
-        return;
-      }
-    }
-
-    if (_putFile) _putFile.close();
-    _putExisted = Storage.exists(_putPath.c_str());
-
-    if (_putExisted) {
-      FsFile existing = Storage.open(_putPath.c_str());
-      if (existing && existing.isDirectory()) {
-        existing.close();
-        _putOk = false;
-        return;
-      }
-      if (existing) existing.close();
-    }
-
-    // Write to a temp file to avoid destroying the original on failed upload
-    String tempPath = _putPath + ".davtmp";
-    Storage.remove(tempPath.c_str());
-    _putOk = Storage.openFileForWrite("DAV", tempPath, _putFile);
-    LOG_DBG("DAV", "PUT START: %s", _putPath.c_str());
+    _putOk = beginPut(server);
+    if (_preIndexer) _preIndexer->noteTransferActivity();
+    LOG_DBG("DAV", "PUT START: %s%s", _putPath.c_str(), _putPartial ? " (partial)" : "");
 
   } else if (raw.status == RAW_WRITE) {
     if (_putFile && _putOk) {
@@ -89,10 +84,17 @@ void WebDAVHandler::raw(WebServer& server, const String& uri, HTTPRaw& raw) {
       if (written != raw.currentSize) {
         _putOk = false;
       }
+      _putWritten += written;
+      if (_preIndexer) _preIndexer->noteTransferActivity();
     }
 
   } else if (raw.status == RAW_END) {
     if (_putFile) _putFile.close();
+    if (_putOk && _putPartial && _putWritten != _putExpected) {
+      // A body shorter or longer than its Content-Range is a client error; the original stays untouched
+      _putOk = false;
+      _putFailStatus = 400;
+    }
     if (_putOk) {
       String tempPath = _putPath + ".davtmp";
       if (_putExisted) Storage.remove(_putPath.c_str());
@@ -105,16 +107,107 @@ void WebDAVHandler::raw(WebServer& server, const String& uri, HTTPRaw& raw) {
       }
       if (!_putOk) Storage.remove(tempPath.c_str());
     }
+    DirectoryIndex::invalidateParent(_putPath.c_str());
     LOG_DBG("DAV", "PUT END: %u bytes, ok=%d", raw.totalSize, _putOk);
 
   } else if (raw.status == RAW_ABORTED) {
     if (_putFile) _putFile.close();
     String tempPath = _putPath + ".davtmp";
     Storage.remove(tempPath.c_str());
+    DirectoryIndex::invalidateParent(_putPath.c_str());
     _putOk = false;
   }
 }
 
+bool WebDAVHandler::beginPut(WebServer& s) {
+  _putPath = getRequestPath(s);
+  _putFailStatus = 500;
+  _putPartial = false;
+  _putExpected = 0;
+  _putWritten = 0;
+  if (_putFile) _putFile.close();
+
+  if (isProtectedPath(_putPath)) {
+    _putFailStatus = 403;
+    return false;
+  }
+
+  // Ensure parent directory exists
+  int lastSlash = _putPath.lastIndexOf('/');
+  if (lastSlash > 0) {
+    String parentPath = _putPath.substring(0, lastSlash);
+    if (!Storage.exists(parentPath.c_str())) {
+      _putFailStatus = 409;
+      return false;
+    }
+  }
+
+  _putExisted = Storage.exists(_putPath.c_str());
+  uint32_t existingSize = 0;
+  char etag[32] = "";
+  if (_putExisted) {
+    FsFile existing = Storage.open(_putPath.c_str());
+    if (existing && existing.isDirectory()) {
+      existing.close();
+      _putFailStatus = 405;
+      return false;
+    }
+    if (existing) {
+      uint16_t date = 0;
+      uint16_t time = 0;
+      existing.getModifyDateTime(&date, &time);
+      existingSize = existing.size();
+      WebDAVProtocol::makeEtag(existingSize, date, time, etag, sizeof(etag));
+      existing.close();
+    }
+  }
+
+  // Conditional PUT: If-Match protects against overwriting someone else's change, If-None-Match: * against
+  // overwriting at all
+  const String ifMatch = s.header("If-Match");
+  const String ifNoneMatch = s.header("If-None-Match");
+  if ((!ifMatch.isEmpty() && (!_putExisted || !WebDAVProtocol::etagListMatches(ifMatch.c_str(), etag, false))) ||
+      (!ifNoneMatch.isEmpty() && _putExisted && WebDAVProtocol::etagListMatches(ifNoneMatch.c_str(), etag, true))) {
+    _putFailStatus = 412;
+    return false;
+  }
+
+  // Partial update of an existing file; the range may extend the file but not leave a hole in it
+  const String contentRange = s.header("Content-Range");
+  uint32_t first = 0;
+  uint32_t last = 0;
+  if (!contentRange.isEmpty()) {
+    if (!WebDAVProtocol::parseContentRange(contentRange.c_str(), first, last)) {
+      _putFailStatus = 400;
+      return false;
+    }
+    if (!_putExisted || first > existingSize) {
+      _putFailStatus = 416;
+      return false;
+    }
+  }
+
+  // Write to a temp file to avoid destroying the original on failed upload
+  String tempPath = _putPath + ".davtmp";
+  Storage.remove(tempPath.c_str());
+  if (!Storage.openFileForWrite("DAV", tempPath, _putFile)) {
+    return false;
+  }
+  if (contentRange.isEmpty()) {
+    return true;
+  }
+
+  // A partial update goes into a copy of the file, which replaces it like a full upload once the range is complete
+  if (!copyContents(_putPath, _putFile) || !_putFile.seekSet(first)) {
+    _putFile.close();
+    Storage.remove(tempPath.c_str());
+    return false;
+  }
+  _putPartial = true;
+  _putExpected = last - first + 1;
+  return true;
+}
+
 bool WebDAVHandler::handle(WebServer& server, HTTPMethod method, const String& uri) {
   (void)uri;
   switch (method) {
@@ -176,23 +269,34 @@ void WebDAVHandler::handlePropfind(WebServer& s) {
 
   LOG_DBG("DAV", "PROPFIND %s depth=%d", path.c_str(), depth);
 
+  // Listing a whole tree would hold the server for minutes on a big card (RFC 4918 §9.1)
+  if (depth < 0) {
+    s.send(403, "application/xml; charset=\"utf-8\"",
+           "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+           "<D:error xmlns:D=\"DAV:\"><D:propfind-finite-depth/></D:error>\n");
+    return;
+  }
+
   // Check if path exists
   if (!Storage.exists(path.c_str()) && path != "/") {
     s.send(404, "text/plain", "Not Found");
     return;
   }
 
+  char lastModified[32];
+  char etag[32];
+  WebDAVProtocol::MultistatusWriter writer([&s](const char* data, size_t length) { s.sendContent(data, length); });
+
   FsFile root = Storage.open(path.c_str());
   if (!root) {
     if (path == "/") {
       // Root should always work — send minimal response
       s.setContentLength(CONTENT_LENGTH_UNKNOWN);
       s.send(207, "application/xml; charset=\"utf-8\"", "");
-      s.sendContent(
-          "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
-          "<D:multistatus xmlns:D=\"DAV:\">\n");
-      sendPropEntry(s, "/", true, 0, FIXED_DATE);
-      s.sendContent("</D:multistatus>\n");
+      WebDAVProtocol::formatHttpDate(0, 0, lastModified, sizeof(lastModified));
+      writer.begin();
+      writer.addEntry("/", true, 0, lastModified, nullptr, nullptr);
+      writer.end();
       s.sendContent("");
       return;
     }
@@ -200,53 +304,46 @@ void WebDAVHandler::handlePropfind(WebServer& s) {
     return;
   }
 
-  bool isDir = root.isDirectory();
-
   s.setContentLength(CONTENT_LENGTH_UNKNOWN);
   s.send(207, "application/xml; charset=\"utf-8\"", "");
-  s.sendContent(
-      "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
-      "<D:multistatus xmlns:D=\"DAV:\">\n");
+  writer.begin();
 
   // Entry for the resource itself
-  if (isDir) {
-    sendPropEntry(s, path, true, 0, FIXED_DATE);
-  } else {
-    sendPropEntry(s, path, false, root.size(), FIXED_DATE);
+  uint16_t date = 0;
+  uint16_t time = 0;
+  root.getModifyDateTime(&date, &time);
+  WebDAVProtocol::formatHttpDate(date, time, lastModified, sizeof(lastModified));
+  if (!root.isDirectory()) {
+    WebDAVProtocol::makeEtag(root.size(), date, time, etag, sizeof(etag));
+    writer.addEntry(path.c_str(), false, root.size(), lastModified, etag, getMimeType(path).c_str());
     root.close();
-    s.sendContent("</D:multistatus>\n");
+    writer.end();
     s.sendContent("");
     return;
   }
+  writer.addEntry(path.c_str(), true, 0, lastModified, nullptr, nullptr);
+
+  // Children are written straight from the directory scan into the writer's buffer, so memory use does not grow
+  // with the folder
+  char childPath[600];
+  const size_t prefixLength = path == "/" ? 0 : path.length();
+  if (depth > 0 && prefixLength + 2 < sizeof(childPath)) {
+    memcpy(childPath, path.c_str(), prefixLength);
+    childPath[prefixLength] = '/';
+    char* name = childPath + prefixLength + 1;
+    const size_t nameSize = sizeof(childPath) - prefixLength - 1;
 
-  // If depth > 0 and it's a directory, list children
-  if (depth > 0) {
     FsFile file = root.openNextFile();
-    char name[500];
     while (file) {
-      file.getName(name, sizeof(name));
-      String fileName(name);
-
-      // Skip hidden/protected items
-      bool shouldHide = fileName.startsWith(".");
-      if (!shouldHide) {
-        for (size_t i = 0; i < HIDDEN_ITEMS_COUNT; i++) {
-          if (fileName.equals(HIDDEN_ITEMS[i])) {
-            shouldHide = true;
-            break;
-          }
-        }
-      }
-
-      if (!shouldHide) {
-        String childPath = path;
-        if (!childPath.endsWith("/")) childPath += "/";
-        childPath += fileName;
-
+      file.getName(name, nameSize);
+      if (!isProtectedName(name)) {
+        file.getModifyDateTime(&date, &time);
+        WebDAVProtocol::formatHttpDate(date, time, lastModified, sizeof(lastModified));
         if (file.isDirectory()) {
-          sendPropEntry(s, childPath, true, 0, FIXED_DATE);
+          writer.addEntry(childPath, true, 0, lastModified, nullptr, nullptr);
         } else {
-          sendPropEntry(s, childPath, false, file.size(), FIXED_DATE);
+          WebDAVProtocol::makeEtag(file.size(), date, time, etag, sizeof(etag));
+          writer.addEntry(childPath, false, file.size(), lastModified, etag, getMimeType(name).c_str());
         }
       }
 
@@ -258,43 +355,10 @@ void WebDAVHandler::handlePropfind(WebServer& s) {
   }
 
   root.close();
-  s.sendContent("</D:multistatus>\n");
+  writer.end();
   s.sendContent("");
 }
 
-void WebDAVHandler::sendPropEntry(WebServer& s, const String& path, bool isDir, size_t size,
-                                  const String& lastModified) const {
-  String href;
-  urlEncodePath(path, href);
-  // Ensure directory hrefs end with /
-  if (isDir && !href.endsWith("/")) href += "/";
-
-  String xml = "<D:response><D:href>";
-  xml += href;
-  xml += "</D:href><D:propstat><D:prop>";
-
-  if (isDir) {
-    xml += "<D:resourcetype><D:collection/></D:resourcetype>";
-  } else {
-    xml += "<D:resourcetype/>";
-    xml += "<D:getcontentlength>";
-    xml += String(size);
-    xml += "</D:getcontentlength>";
-    String mime = getMimeType(path);
-    xml += "<D:getcontenttype>";
-    xml += mime;
-    xml += "</D:getcontenttype>";
-  }
-
-  xml += "<D:getlastmodified>";
-  xml += lastModified;
-  xml += "</D:getlastmodified>";
-
-  xml += "</D:prop><D:status>HTTP/1.1 200 OK</D:status></D:propstat></D:response>\n";
-
-  s.sendContent(xml);
-}
-
 // ── GET ──────────────────────────────────────────────────────────────────────
 
 void WebDAVHandler::handleGet(WebServer& s) {
@@ -323,13 +387,93 @@ void WebDAVHandler::handleGet(WebServer& s) {
     return;
   }
 
+  sendFile(s, path, file, true);
+}
+
+void WebDAVHandler::sendFile(WebServer& s, const String& path, FsFile& file, const bool withBody) const {
+  const uint32_t size = file.size();
+  uint16_t date = 0;
+  uint16_t time = 0;
+  file.getModifyDateTime(&date, &time);
+  char etag[32];
+  char lastModified[32];
+  WebDAVProtocol::makeEtag(size, date, time, etag, sizeof(etag));
+  WebDAVProtocol::formatHttpDate(date, time, lastModified, sizeof(lastModified));
+
+  s.sendHeader("ETag", etag);
+  s.sendHeader("Last-Modified", lastModified);
+  s.sendHeader("Accept-Ranges", "bytes");
+
+  // Preconditions in RFC 9110 §13.2.2 order
+  const String ifMatch = s.header("If-Match");
+  if (!ifMatch.isEmpty() && !WebDAVProtocol::etagListMatches(ifMatch.c_str(), etag, false)) {
+    file.close();
+    s.send(412, "text/plain", "Precondition Failed");
+    return;
+  }
+  const String ifNoneMatch = s.header("If-None-Match");
+  const String ifModifiedSince = s.header("If-Modified-Since");
+  const bool notModified = ifNoneMatch.isEmpty()
+                               ? !ifModifiedSince.isEmpty() &&
+                                     WebDAVProtocol::notModifiedSince(ifModifiedSince.c_str(), date, time)
+                               : WebDAVProtocol::etagListMatches(ifNoneMatch.c_str(), etag, true);
+  if (notModified) {
+    file.close();
+    s.send(304);
+    return;
+  }
+
+  // A Range is ignored when If-Range names an older version, so the client gets the whole new file
+  WebDAVProtocol::ByteRange range;
+  range.length = size;
+  auto rangeResult = WebDAVProtocol::RangeResult::Full;
+  const String rangeHeader = s.header("Range");
+  if (!rangeHeader.isEmpty()) {
+    const String ifRange = s.header("If-Range");
+    if (ifRange.isEmpty() || WebDAVProtocol::ifRangeMatches(ifRange.c_str(), etag, lastModified)) {
+      rangeResult = WebDAVProtocol::parseRange(rangeHeader.c_str(), size, range);
+    }
+  }
+
+  char contentRange[48];
+  if (rangeResult == WebDAVProtocol::RangeResult::Unsatisfiable) {
+    file.close();
+    snprintf(contentRange, sizeof(contentRange), "bytes */%lu", static_cast<unsigned long>(size));
+    s.sendHeader("Content-Range", contentRange);
+    s.send(416, "text/plain", "Range Not Satisfiable");
+    return;
+  }
+
   String contentType = getMimeType(path);
-  s.setContentLength(file.size());
-  s.send(200, contentType.c_str(), "");
+  s.setContentLength(range.length);
+  if (rangeResult == WebDAVProtocol::RangeResult::Partial) {
+    snprintf(contentRange, sizeof(contentRange), "bytes %lu-%lu/%lu", static_cast<unsigned long>(range.start),
+             static_cast<unsigned long>(range.start + range.length - 1), static_cast<unsigned long>(size));
+    s.sendHeader("Content-Range", contentRange);
+    s.send(206, contentType.c_str(), "");
+  } else {
+    s.send(200, contentType.c_str(), "");
+  }
 
+  if (!withBody || (range.start > 0 && !file.seekSet(range.start))) {
+    file.close();
+    return;
+  }
+
+  // Streaming copy with 4KB buffer on stack
   NetworkClient client = s.client();
-  client.write(file);
+  uint8_t buf[4096];
+  uint32_t remaining = range.length;
+  while (remaining > 0 && client.connected()) {
+    esp_task_wdt_reset();
+    const int bytesRead = file.read(buf, remaining < sizeof(buf) ? remaining : sizeof(buf));
+    if (bytesRead <= 0 || client.write(buf, bytesRead) != static_cast<size_t>(bytesRead)) break;
+    remaining -= bytesRead;
+  }
   file.close();
+  if (remaining > 0) {
+    LOG_DBG("DAV", "GET %s stopped with %lu bytes unsent", path.c_str(), static_cast<unsigned long>(remaining));
+  }
 }
 
 // ── HEAD ─────────────────────────────────────────────────────────────────────
@@ -360,10 +504,7 @@ void WebDAVHandler::handleHead(WebServer& s) {
     return;
   }
 
-  String contentType = getMimeType(path);
-  s.setContentLength(file.size());
-  s.send(200, contentType.c_str(), "");
-  file.close();
+  sendFile(s, path, file, false);
 }
 
 // ── PUT ──────────────────────────────────────────────────────────────────────
@@ -381,11 +522,31 @@ void WebDAVHandler::handlePut(WebServer& s) {
   if (!_putOk) {
     String tempPath = path + ".davtmp";
     Storage.remove(tempPath.c_str());
-    s.send(500, "text/plain", "Write failed - incomplete upload or disk full");
+    switch (_putFailStatus) {
+      case 400:
+        s.send(400, "text/plain", "Bad Content-Range or body length");
+        break;
+      case 409:
+        s.send(409, "text/plain", "Parent directory does not exist");
+        break;
+      case 405:
+        s.send(405, "text/plain", "Is a directory");
+        break;
+      case 412:
+        s.send(412, "text/plain", "Precondition Failed");
+        break;
+      case 416:
+        s.send(416, "text/plain", "Range does not start within the file");
+        break;
+      default:
+        s.send(500, "text/plain", "Write failed - incomplete upload or disk full");
+        break;
+    }
     return;
   }
 
   clearEpubCacheIfNeeded(path);
+  if (_preIndexer) _preIndexer->enqueue(path.c_str());
   s.send(_putExisted ? 204 : 201);
   LOG_DBG("DAV", "PUT complete: %s", path.c_str());
 }
@@ -428,6 +589,8 @@ void WebDAVHandler::handleDelete(WebServer& s) {
     }
     file.close();
     if (Storage.rmdir(path.c_str())) {
+      DirectoryIndex::invalidate(path.c_str());
+      DirectoryIndex::invalidateParent(path.c_str());
       s.send(204);
     } else {
       s.send(500, "text/plain", "Failed to remove directory");
@@ -436,6 +599,7 @@ void WebDAVHandler::handleDelete(WebServer& s) {
     file.close();
     clearEpubCacheIfNeeded(path);
     if (Storage.remove(path.c_str())) {
+      DirectoryIndex::invalidateParent(path.c_str());
       s.send(204);
     } else {
       s.send(500, "text/plain", "Failed to delete file");
@@ -476,6 +640,8 @@ void WebDAVHandler::handleMkcol(WebServer& s) {
   }
 
   if (Storage.mkdir(path.c_str())) {
+    DirectoryIndex::invalidate(path.c_str());
+    DirectoryIndex::invalidateParent(path.c_str());
     s.send(201);
     LOG_DBG("DAV", "Created directory: %s", path.c_str());
   } else {
@@ -548,6 +714,9 @@ void WebDAVHandler::handleMove(WebServer& s) {
   file.close();
 
   if (success) {
+    DirectoryIndex::invalidateParent(srcPath.c_str());
+    DirectoryIndex::invalidate(dstPath.c_str());
+    DirectoryIndex::invalidateParent(dstPath.c_str());
     s.send(dstExists ? 204 : 201);
   } else {
     s.send(500, "text/plain", "Move failed");
@@ -640,6 +809,7 @@ void WebDAVHandler::handleCopy(WebServer& s) {
 
   srcFile.close();
   dstFile.close();
+  DirectoryIndex::invalidateParent(dstPath.c_str());
 
   if (copyOk) {
     s.send(dstExists ? 204 : 201);
@@ -788,7 +958,8 @@ int WebDAVHandler::getDepth(WebServer& s) const {
   String depth = s.header("Depth");
   if (depth == "0") return 0;
   if (depth == "1") return 1;
-  // "infinity" or missing → treat as 1 (Class 1 servers don't need to support infinity)
+  if (depth.equalsIgnoreCase("infinity")) return -1;
+  // Missing → treat as 1; RFC 4918 says infinity, but clients that leave it out only want the children
   return 1;
 }
 
@@ -803,6 +974,7 @@ void WebDAVHandler::clearEpubCacheIfNeeded(const String& path) const {
     Epub(path.c_str(), "/.crosspoint").clearCache();
     LOG_DBG("DAV", "Cleared epub cache for: %s", path.c_str());
   }
+  LibraryDb::remove(path.c_str());
 }
 
 String WebDAVHandler::getMimeType(const String& path) const {
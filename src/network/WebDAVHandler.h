@@ -3,8 +3,13 @@
 #include <HalStorage.h>
 #include <WebServer.h>
 
+class BookPreIndexer;
+
 class WebDAVHandler : public RequestHandler {
  public:
+  // Completed PUTs are queued on `preIndexer` when given
+  explicit WebDAVHandler(BookPreIndexer* preIndexer = nullptr) : _preIndexer(preIndexer) {}
+
   // RequestHandler interface
   bool canHandle(WebServer& server, HTTPMethod method, const String& uri) override;
   bool canRaw(WebServer& server, const String& uri) override;
@@ -17,6 +22,14 @@ class WebDAVHandler : public RequestHandler {
   String _putPath;
   bool _putOk = false;
   bool _putExisted = false;
+  // Status sent when the PUT fails for a reason other than the card
+  int _putFailStatus = 500;
+  // A Content-Range PUT writes the given bytes into the existing file in place
+  bool _putPartial = false;
+  uint32_t _putExpected = 0;
+  uint32_t _putWritten = 0;
+
+  BookPreIndexer* _preIndexer;
 
   // WebDAV method handlers
   void handleOptions(WebServer& s);
@@ -36,9 +49,11 @@ class WebDAVHandler : public RequestHandler {
   String getDestinationPath(WebServer& s) const;
   void urlEncodePath(const String& path, String& out) const;
   bool isProtectedPath(const String& path) const;
+  // 0, 1, or -1 for infinity
   int getDepth(WebServer& s) const;
   bool getOverwrite(WebServer& s) const;
   void clearEpubCacheIfNeeded(const String& path) const;
-  void sendPropEntry(WebServer& s, const String& href, bool isDir, size_t size, const String& lastModified) const;
+  bool beginPut(WebServer& s);
+  void sendFile(WebServer& s, const String& path, FsFile& file, bool withBody) const;
   String getMimeType(const String& path) const;
 };
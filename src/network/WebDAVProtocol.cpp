@@ -0,0 +1,302 @@
+#include "WebDAVProtocol.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace WebDAVProtocol {
+
+namespace {
+// Sent for files the card has no timestamp for; any fixed date works for WebDAV class 1 clients
+const char* FALLBACK_DATE = "Mon, 01 Jan 2024 00:00:00 GMT";
+constexpr uint32_t FALLBACK_SECONDS = 1704067200;
+const char* const MONTHS[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+bool isSpace(const char c) { return c == ' ' || c == '\t'; }
+
+const char* skipSpaces(const char* p) {
+  while (isSpace(*p)) p++;
+  return p;
+}
+
+// Reads a run of digits, saturating at UINT32_MAX. False if there is none.
+bool parseNumber(const char*& p, uint32_t& value) {
+  if (*p < '0' || *p > '9') return false;
+  uint64_t result = 0;
+  while (*p >= '0' && *p <= '9') {
+    if (result <= UINT32_MAX) {
+      result = result * 10 + static_cast<uint64_t>(*p - '0');
+    }
+    p++;
+  }
+  value = result > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(result);
+  return true;
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date
+int64_t daysFromCivil(int year, const unsigned month, const unsigned day) {
+  year -= month <= 2;
+  const int era = (year >= 0 ? year : year - 399) / 400;
+  const unsigned yearOfEra = static_cast<unsigned>(year - era * 400);
+  const unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  const unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return static_cast<int64_t>(era) * 146097 + dayOfEra - 719468;
+}
+
+// Three-letter month name, case-sensitive as the grammar has it; `month` is 1-based
+bool parseMonth(const char*& p, uint32_t& month) {
+  for (uint32_t i = 0; i < 12; i++) {
+    if (strncmp(p, MONTHS[i], 3) == 0) {
+      month = i + 1;
+      p += 3;
+      return true;
+    }
+  }
+  return false;
+}
+
+// "HH:MM:SS"
+bool parseTimeOfDay(const char*& p, uint32_t& hour, uint32_t& minute, uint32_t& second) {
+  return parseNumber(p, hour) && *p++ == ':' && parseNumber(p, minute) && *p++ == ':' && parseNumber(p, second);
+}
+}  // namespace
+
+void makeEtag(const uint32_t size, const uint16_t date, const uint16_t time, char* out, const size_t outSize) {
+  snprintf(out, outSize, "\"%lx-%lx\"", static_cast<unsigned long>(size),
+           static_cast<unsigned long>(static_cast<uint32_t>(date) << 16 | time));
+}
+
+bool etagListMatches(const char* list, const char* etag, const bool weak) {
+  const size_t etagLength = strlen(etag);
+  const char* p = list;
+  while (*p) {
+    while (isSpace(*p) || *p == ',') p++;
+    const char* item = p;
+    while (*p && *p != ',') p++;
+    const char* itemEnd = p;
+    while (itemEnd > item && isSpace(itemEnd[-1])) itemEnd--;
+
+    if (itemEnd - item == 1 && *item == '*') return true;
+    if (itemEnd - item > 2 && item[0] == 'W' && item[1] == '/') {
+      // A weak tag never matches strongly
+      if (!weak) continue;
+      item += 2;
+    }
+    if (static_cast<size_t>(itemEnd - item) == etagLength && strncmp(item, etag, etagLength) == 0) return true;
+  }
+  return false;
+}
+
+bool ifRangeMatches(const char* validator, const char* etag, const char* lastModified) {
+  validator = skipSpaces(validator);
+  size_t length = strlen(validator);
+  while (length > 0 && isSpace(validator[length - 1])) length--;
+
+  // If-Range only accepts strong tags; anything else is an HTTP date, which must be the exact one we sent
+  if (validator[0] == 'W' && validator[1] == '/') return false;
+  const char* expected = validator[0] == '"' ? etag : lastModified;
+  return strlen(expected) == length && strncmp(validator, expected, length) == 0;
+}
+
+void formatHttpDate(const uint16_t date, const uint16_t time, char* out, const size_t outSize) {
+  static const char* const DAYS[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+  static const int MONTH_OFFSETS[] = {0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4};
+
+  const int year = 1980 + (date >> 9);
+  const int month = (date >> 5) & 0x0F;
+  const int day = date & 0x1F;
+  if (date == 0 || month < 1 || month > 12 || day < 1) {
+    snprintf(out, outSize, "%s", FALLBACK_DATE);
+    return;
+  }
+
+  // Sakamoto's day-of-week, 0 = Sunday
+  const int y = year - (month < 3 ? 1 : 0);
+  const int weekday = (y + y / 4 - y / 100 + y / 400 + MONTH_OFFSETS[month - 1] + day) % 7;
+  snprintf(out, outSize, "%s, %02d %s %04d %02d:%02d:%02d GMT", DAYS[weekday], day, MONTHS[month - 1], year,
+           time >> 11, (time >> 5) & 0x3F, (time & 0x1F) * 2);
+}
+
+bool parseHttpDate(const char* text, uint32_t& seconds) {
+  const char* p = skipSpaces(text);
+  while ((*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z')) p++;  // Day name, which the date already implies
+
+  uint32_t day = 0;
+  uint32_t month = 0;
+  uint32_t year = 0;
+  uint32_t hour = 0;
+  uint32_t minute = 0;
+  uint32_t second = 0;
+  if (*p == ',') {
+    // IMF-fixdate "Sun, 06 Nov 1994 08:49:37 GMT" or RFC 850 "Sunday, 06-Nov-94 08:49:37 GMT"
+    p = skipSpaces(p + 1);
+    if (!parseNumber(p, day)) return false;
+    const char separator = *p;
+    if (separator != ' ' && separator != '-') return false;
+    p++;
+    if (!parseMonth(p, month) || *p++ != separator) return false;
+    const char* yearStart = p;
+    if (!parseNumber(p, year)) return false;
+    if (p - yearStart == 2) year += year < 70 ? 2000 : 1900;
+    p = skipSpaces(p);
+    if (!parseTimeOfDay(p, hour, minute, second)) return false;
+    p = skipSpaces(p);
+    if (strncmp(p, "GMT", 3) != 0) return false;
+  } else {
+    // asctime "Sun Nov  6 08:49:37 1994"
+    p = skipSpaces(p);
+    if (!parseMonth(p, month)) return false;
+    p = skipSpaces(p);
+    if (!parseNumber(p, day)) return false;
+    p = skipSpaces(p);
+    if (!parseTimeOfDay(p, hour, minute, second)) return false;
+    p = skipSpaces(p);
+    if (!parseNumber(p, year)) return false;
+  }
+  if (day < 1 || day > 31 || year < 1970 || year > 2105 || hour > 23 || minute > 59 || second > 60) return false;
+
+  const int64_t total = daysFromCivil(static_cast<int>(year), month, day) * 86400 + hour * 3600 + minute * 60 + second;
+  if (total < 0 || total > UINT32_MAX) return false;
+  seconds = static_cast<uint32_t>(total);
+  return true;
+}
+
+bool notModifiedSince(const char* ifModifiedSince, const uint16_t date, const uint16_t time) {
+  uint32_t since = 0;
+  if (!parseHttpDate(ifModifiedSince, since)) return false;
+
+  const int year = 1980 + (date >> 9);
+  const unsigned month = (date >> 5) & 0x0F;
+  const unsigned day = date & 0x1F;
+  uint32_t modified = FALLBACK_SECONDS;
+  if (date != 0 && month >= 1 && month <= 12 && day >= 1) {
+    modified = static_cast<uint32_t>(daysFromCivil(year, month, day) * 86400 + (time >> 11) * 3600 +
+                                     ((time >> 5) & 0x3F) * 60 + (time & 0x1F) * 2);
+  }
+  return modified <= since;
+}
+
+RangeResult parseRange(const char* header, const uint32_t size, ByteRange& range) {
+  const char* p = skipSpaces(header);
+  if (strncmp(p, "bytes=", 6) != 0) return RangeResult::Full;
+  p = skipSpaces(p + 6);
+  if (strchr(p, ',') != nullptr) return RangeResult::Full;
+
+  if (*p == '-') {
+    // Suffix range: the last N bytes
+    p++;
+    uint32_t suffix = 0;
+    if (!parseNumber(p, suffix) || *skipSpaces(p) != '\0') return RangeResult::Full;
+    if (suffix == 0 || size == 0) return RangeResult::Unsatisfiable;
+    range.start = suffix >= size ? 0 : size - suffix;
+    range.length = size - range.start;
+    return RangeResult::Partial;
+  }
+
+  uint32_t first = 0;
+  if (!parseNumber(p, first) || *p != '-') return RangeResult::Full;
+  p++;
+  uint32_t last = UINT32_MAX;
+  const bool hasLast = parseNumber(p, last);
+  if (*skipSpaces(p) != '\0' || (hasLast && last < first)) return RangeResult::Full;
+
+  if (first >= size) return RangeResult::Unsatisfiable;
+  if (last > size - 1) last = size - 1;
+  range.start = first;
+  range.length = last - first + 1;
+  return RangeResult::Partial;
+}
+
+bool parseContentRange(const char* header, uint32_t& first, uint32_t& last) {
+  const char* p = skipSpaces(header);
+  if (strncmp(p, "bytes ", 6) != 0) return false;
+  p = skipSpaces(p + 6);
+  if (!parseNumber(p, first) || *p != '-') return false;
+  p++;
+  if (!parseNumber(p, last) || *p != '/' || last < first) return false;
+  p++;
+  if (*p == '*') {
+    p++;
+  } else {
+    uint32_t total = 0;
+    if (!parseNumber(p, total) || last >= total) return false;
+  }
+  return *skipSpaces(p) == '\0';
+}
+
+void MultistatusWriter::begin() {
+  used = 0;
+  append(
+      "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+      "<D:multistatus xmlns:D=\"DAV:\">\n");
+}
+
+void MultistatusWriter::addEntry(const char* path, const bool isDirectory, const uint32_t size,
+                                 const char* lastModified, const char* etag, const char* contentType) {
+  append("<D:response><D:href>");
+  appendHref(path, isDirectory);
+  append("</D:href><D:propstat><D:prop>");
+
+  if (isDirectory) {
+    append("<D:resourcetype><D:collection/></D:resourcetype>");
+  } else {
+    char number[12];
+    snprintf(number, sizeof(number), "%lu", static_cast<unsigned long>(size));
+    append("<D:resourcetype/><D:getcontentlength>");
+    append(number);
+    append("</D:getcontentlength><D:getcontenttype>");
+    append(contentType);
+    append("</D:getcontenttype><D:getetag>");
+    append(etag);
+    append("</D:getetag>");
+  }
+
+  append("<D:getlastmodified>");
+  append(lastModified);
+  append("</D:getlastmodified></D:prop><D:status>HTTP/1.1 200 OK</D:status></D:propstat></D:response>\n");
+}
+
+void MultistatusWriter::end() {
+  append("</D:multistatus>\n");
+  flush();
+}
+
+void MultistatusWriter::append(const char* text) { append(text, strlen(text)); }
+
+void MultistatusWriter::append(const char* data, size_t length) {
+  while (length > 0) {
+    if (used == BUFFER_SIZE) flush();
+    const size_t count = length < BUFFER_SIZE - used ? length : BUFFER_SIZE - used;
+    memcpy(buffer + used, data, count);
+    used += count;
+    data += count;
+    length -= count;
+  }
+}
+
+void MultistatusWriter::appendHref(const char* path, const bool isDirectory) {
+  static const char HEX[] = "0123456789ABCDEF";
+  char last = '\0';
+  for (const char* p = path; *p; p++) {
+    const auto c = static_cast<unsigned char>(*p);
+    const bool plain = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' ||
+                       c == '.' || c == '_' || c == '~' || c == '/';
+    if (plain) {
+      append(p, 1);
+    } else {
+      const char escaped[3] = {'%', HEX[c >> 4], HEX[c & 0x0F]};
+      append(escaped, sizeof(escaped));
+    }
+    last = *p;
+  }
+  // Collections are listed with a trailing slash
+  if (isDirectory && last != '/') append("/", 1);
+}
+
+void MultistatusWriter::flush() {
+  if (used > 0) {
+    sink(buffer, used);
+    used = 0;
+  }
+}
+
+}  // namespace WebDAVProtocol
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+
+// HTTP/WebDAV details of the WebDAV server that don't depend on the web server itself: entity tags, dates, byte
+// ranges and the multistatus body writer.
+namespace WebDAVProtocol {
+
+// Strong entity tag of a file, derived from its size and FAT modification time, e.g. "\"4d2-58213a10\""
+void makeEtag(uint32_t size, uint16_t date, uint16_t time, char* out, size_t outSize);
+
+// Whether `etag` is in an If-Match / If-None-Match list ("*" matches any existing resource). If-None-Match compares
+// weakly (a W/ prefix is ignored), If-Match strongly.
+bool etagListMatches(const char* list, const char* etag, bool weak);
+
+// Whether an If-Range validator (an entity tag or an HTTP date) still describes the file
+bool ifRangeMatches(const char* validator, const char* etag, const char* lastModified);
+
+// RFC 1123 date of a FAT timestamp, e.g. "Mon, 01 Jan 2024 00:00:00 GMT". FAT times carry no zone and are sent as
+// GMT; files without a timestamp get a fixed date.
+void formatHttpDate(uint16_t date, uint16_t time, char* out, size_t outSize);
+
+// Seconds since 1970 of an HTTP date in any of the formats RFC 9110 §5.6.7 has recipients accept: IMF-fixdate,
+// RFC 850 and asctime. False if it doesn't parse.
+bool parseHttpDate(const char* text, uint32_t& seconds);
+
+// Whether an If-Modified-Since date is no earlier than the file's FAT timestamp, read as GMT like formatHttpDate()
+// sends it. Dates are compared as times, so a client may send back any date it likes; one that doesn't parse never
+// matches.
+bool notModifiedSince(const char* ifModifiedSince, uint16_t date, uint16_t time);
+
+enum class RangeResult : uint8_t { Full, Partial, Unsatisfiable };
+
+struct ByteRange {
+  uint32_t start = 0;
+  uint32_t length = 0;
+};
+
+// Resolve a Range header against a resource of `size` bytes. Only single ranges are served: multiple ranges and
+// headers that don't parse are answered with the full body, which RFC 9110 allows. `range` is set for Partial.
+RangeResult parseRange(const char* header, uint32_t size, ByteRange& range);
+
+// Parse the "bytes <first>-<last>/<total or *>" Content-Range of a partial PUT
+bool parseContentRange(const char* header, uint32_t& first, uint32_t& last);
+
+// Builds a 207 Multi-Status body in a fixed buffer and hands it to `sink` in segment-sized pieces, so listing a
+// folder costs the same memory whatever its size and goes out in few chunks.
+class MultistatusWriter {
+ public:
+  using Sink = std::function<void(const char* data, size_t length)>;
+
+  explicit MultistatusWriter(Sink sink) : sink(std::move(sink)) {}
+
+  void begin();
+  // `etag` and `contentType` are only listed for files
+  void addEntry(const char* path, bool isDirectory, uint32_t size, const char* lastModified, const char* etag,
+                const char* contentType);
+  // Closes the document and sends what is left
+  void end();
+
+ private:
+  // About one TCP segment once the chunked-encoding framing is added
+  static constexpr size_t BUFFER_SIZE = 1400;
+
+  Sink sink;
+  char buffer[BUFFER_SIZE];
+  size_t used = 0;
+
+  void append(const char* text);
+  void append(const char* data, size_t length);
+  // Percent-encodes everything but unreserved characters and '/', which also keeps the href valid XML
+  void appendHref(const char* path, bool isDirectory);
+  void flush();
+};
+
+}  // namespace WebDAVProtocol
@@ -0,0 +1,48 @@
+#include "BootProfiler.h"
+
+#include <Arduino.h>
+#include <Logging.h>
+
+BootProfiler::Mark BootProfiler::marks[MAX_MARKS] = {};
+int BootProfiler::count = 0;
+bool BootProfiler::finished = false;
+
+void BootProfiler::mark(const char* phase) {
+  if (finished) {
+    return;
+  }
+  // A full ring keeps the latest phases, which lead up to the first frame
+  marks[count % MAX_MARKS] = {phase, static_cast<uint32_t>(micros())};
+  count++;
+}
+
+void BootProfiler::frameShown() {
+  if (finished) {
+    return;
+  }
+  mark("first frame");
+  finished = true;
+  report();
+}
+
+void BootProfiler::report() {
+  if (count == 0) {
+    return;
+  }
+  const int first = count > MAX_MARKS ? count - MAX_MARKS : 0;
+  if (first > 0) {
+    LOG_INF("BOOT", "%d earliest phases dropped", first);
+  }
+  // Times count from reset, so the first phase includes the bootloader and static initialisation
+  uint32_t previous = 0;
+  for (int i = first; i < count; i++) {
+    const Mark& m = marks[i % MAX_MARKS];
+    const unsigned long at = m.us;
+    const unsigned long took = m.us - previous;
+    LOG_INF("BOOT", "%-20s at %6lu.%lu ms, took %lu.%lu ms", m.phase, at / 1000, at / 100 % 10, took / 1000,
+            took / 100 % 10);
+    previous = m.us;
+  }
+  const unsigned long total = previous;
+  LOG_INF("BOOT", "Boot to %s: %lu ms", finished ? "first frame" : "last phase", total / 1000);
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstdint>
+
+// Where boot time goes: setup() and the first screen after it mark the end of each phase, and once the first frame is
+// on screen the phases are logged with their durations. Marks go into a fixed ring and cost a micros() call, so they
+// can stay in release builds. Marks after the report are ignored; the serial command CMD:BOOT_PROFILE logs it again.
+class BootProfiler {
+ public:
+  static constexpr int MAX_MARKS = 24;
+
+  // Records the end of a boot phase; `phase` must be a string literal
+  static void mark(const char* phase);
+  // Called by the render task after each render; the first one after setup() ends the profile and logs it
+  static void frameShown();
+  static void report();
+  static bool isFinished() { return finished; }
+
+ private:
+  struct Mark {
+    const char* phase;
+    uint32_t us;
+  };
+  static Mark marks[MAX_MARKS];
+  static int count;
+  static bool finished;
+};
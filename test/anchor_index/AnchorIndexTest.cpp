@@ -0,0 +1,289 @@
+#include <HalStorage.h>
+#include <Serialization.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "lib/EpdFont/builtinFonts/bookerly_14_regular.h"
+#include "lib/Epub/Epub.h"
+#include "lib/Epub/Epub/Page.h"
+#include "lib/Epub/Epub/Section.h"
+#include "lib/Epub/Epub/converters/ImageDecoderFactory.h"
+#include "lib/GfxRenderer/GfxRenderer.h"
+
+// JPEGDEC and PNGdec are not built for the host; the test chapters have no images
+ImageToFramebufferDecoder* ImageDecoderFactory::getDecoder(const std::string&) { return nullptr; }
+bool ImageDecoderFactory::isFormatSupported(const std::string&) { return false; }
+
+namespace {
+
+constexpr int FONT_ID = 1;
+constexpr uint16_t VIEWPORT_WIDTH = 464;
+constexpr uint16_t VIEWPORT_HEIGHT = 740;
+constexpr int CHAPTERS = 600;  // past the spine size where the build switches to its hashed href index
+constexpr int NOTES = 5000;
+constexpr int NOTES_SPINE_INDEX = CHAPTERS;
+
+int failures = 0;
+std::string scratch;
+
+void check(const bool condition, const std::string& message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << std::endl;
+    failures++;
+  }
+}
+
+void writeFile(const std::string& path, const std::string& contents) {
+  FILE* f = fopen(path.c_str(), "w");
+  fwrite(contents.data(), 1, contents.size(), f);
+  fclose(f);
+}
+
+std::string chapterName(const int i) {
+  char name[32];
+  snprintf(name, sizeof(name), "ch%04d.xhtml", i);
+  return name;
+}
+
+// An endnotes chapter: each note names itself with a "marker<n>" word, and "twice" is used as an id two times
+std::string notesDocument() {
+  std::string doc = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<html xmlns=\"http://www.w3.org/1999/xhtml\"><body>\n"
+                    "<p id=\"twice\">First use of a repeated id.</p>\n";
+  for (int n = 0; n < NOTES; n++) {
+    doc += "<p id=\"n" + std::to_string(n) + "\">marker" + std::to_string(n) + " says the note text goes here.</p>\n";
+  }
+  return doc + "<p id=\"twice\">Second use of a repeated id.</p>\n</body></html>\n";
+}
+
+void writeEpub() {
+  const std::string dir = scratch + "/epub";
+  std::system(("mkdir -p '" + dir + "/META-INF' '" + dir + "/OEBPS/Text' '" + dir + "/OEBPS/Extra'").c_str());
+  writeFile(dir + "/mimetype", "application/epub+zip");
+  writeFile(dir + "/META-INF/container.xml",
+            "<?xml version=\"1.0\"?>\n<container version=\"1.0\" "
+            "xmlns=\"urn:oasis:names:tc:opendocument:xmlns:container\"><rootfiles><rootfile "
+            "full-path=\"OEBPS/content.opf\" media-type=\"application/oebps-package+xml\"/></rootfiles></container>\n");
+
+  std::string manifest = "<item id=\"ncx\" href=\"toc.ncx\" media-type=\"application/x-dtbncx+xml\"/>";
+  std::string spine;
+  for (int i = 0; i < CHAPTERS; i++) {
+    const std::string name = chapterName(i);
+    manifest += "<item id=\"c" + std::to_string(i) + "\" href=\"Text/" + name +
+                "\" media-type=\"application/xhtml+xml\"/>";
+    spine += "<itemref idref=\"c" + std::to_string(i) + "\"/>";
+    writeFile(dir + "/OEBPS/Text/" + name, "<html><body><p>Chapter " + std::to_string(i) + "</p></body></html>\n");
+  }
+  manifest += "<item id=\"notes\" href=\"Text/notes.xhtml\" media-type=\"application/xhtml+xml\"/>";
+  spine += "<itemref idref=\"notes\"/>";
+  writeFile(dir + "/OEBPS/Text/notes.xhtml", notesDocument());
+  // A later item sharing a file name with an earlier one, which links by file name resolve to the earlier
+  manifest += "<item id=\"extra\" href=\"Extra/ch0003.xhtml\" media-type=\"application/xhtml+xml\"/>";
+  spine += "<itemref idref=\"extra\"/>";
+  writeFile(dir + "/OEBPS/Extra/ch0003.xhtml", "<html><body><p>Extra</p></body></html>\n");
+
+  writeFile(dir + "/OEBPS/content.opf",
+            "<?xml version=\"1.0\"?>\n<package xmlns=\"http://www.idpf.org/2007/opf\" version=\"2.0\" "
+            "unique-identifier=\"id\"><metadata xmlns:dc=\"http://purl.org/dc/elements/1.1/\"><dc:title>Anchors"
+            "</dc:title><dc:language>en</dc:language><dc:identifier id=\"id\">anchors</dc:identifier></metadata>"
+            "<manifest>" +
+                manifest + "</manifest><spine toc=\"ncx\">" + spine + "</spine></package>\n");
+  writeFile(dir + "/OEBPS/toc.ncx",
+            "<?xml version=\"1.0\"?>\n<ncx xmlns=\"http://www.daisy.org/z3986/2005/ncx/\" version=\"2005-1\">"
+            "<navMap><navPoint id=\"n0\"><navLabel><text>Start</text></navLabel><content src=\"Text/ch0000.xhtml\"/>"
+            "</navPoint><navPoint id=\"n1\"><navLabel><text>Notes</text></navLabel>"
+            "<content src=\"Text/notes.xhtml\"/></navPoint></navMap></ncx>\n");
+  std::system(("cd '" + dir + "' && zip -qX0 ../book.epub mimetype && zip -qrX ../book.epub META-INF OEBPS").c_str());
+}
+
+// The spine scan links were resolved with before the filename index
+int linearResolve(const Epub& epub, const std::string& href) {
+  std::string target = href.substr(0, href.find('#'));
+  if (target.empty()) return -1;
+  const size_t targetSlash = target.find_last_of('/');
+  const std::string targetFilename = targetSlash != std::string::npos ? target.substr(targetSlash + 1) : target;
+  for (int i = 0; i < epub.getSpineItemsCount(); i++) {
+    const auto spineHref = epub.getSpineItem(i).href;
+    if (spineHref == target) return i;
+    const size_t spineSlash = spineHref.find_last_of('/');
+    const std::string spineFilename = spineSlash != std::string::npos ? spineHref.substr(spineSlash + 1) : spineHref;
+    if (spineFilename == targetFilename) return i;
+  }
+  return -1;
+}
+
+std::vector<std::string> linkHrefs(const Epub& epub) {
+  std::vector<std::string> hrefs;
+  for (int i = 0; i < epub.getSpineItemsCount(); i++) {
+    const std::string href = epub.getSpineItem(i).href;
+    hrefs.push_back(href);
+    hrefs.push_back("../Text/" + href.substr(href.find_last_of('/') + 1) + "#n" + std::to_string(i));
+  }
+  hrefs.push_back("missing.xhtml#n1");
+  hrefs.push_back("Text/ch9999.xhtml");
+  hrefs.push_back("#n5");
+  return hrefs;
+}
+
+std::string pageWords(Section& section, const int page) {
+  section.currentPage = page;
+  const auto p = section.loadPageFromSectionFile();
+  if (!p) return "";
+  std::string text;
+  for (const auto& element : p->elements) {
+    if (element->getTag() != TAG_PageLine) continue;
+    for (const auto& word : static_cast<const PageLine&>(*element).getBlock()->getWords()) {
+      text += word + " ";
+    }
+  }
+  return text;
+}
+
+void testResolveHref(const Epub& epub) {
+  check(epub.getSpineItemsCount() == CHAPTERS + 2, "every chapter is in the spine");
+  for (const auto& href : linkHrefs(epub)) {
+    check(epub.resolveHrefToSpineIndex(href) == linearResolve(epub, href), "href resolves as the spine scan: " + href);
+  }
+  check(epub.resolveHrefToSpineIndex("../Text/notes.xhtml#n12") == NOTES_SPINE_INDEX, "link into the notes chapter");
+  check(epub.resolveHrefToSpineIndex("Extra/ch0003.xhtml") == 3, "shared file name resolves to the first item");
+  check(epub.resolveHrefToSpineIndex("nowhere.xhtml") == -1, "unknown file is not resolved");
+}
+
+void testAnchorLookup(Section& section) {
+  int misplaced = 0;
+  for (int n = 0; n < NOTES; n++) {
+    // An anchor is recorded on the page being filled when its block starts, so a note that only fits on the
+    // next page is reached from the end of the page before it
+    const auto page = section.getPageForAnchor("n" + std::to_string(n));
+    const std::string marker = "marker" + std::to_string(n) + " ";
+    if (!page || (pageWords(section, *page).find(marker) == std::string::npos &&
+                  pageWords(section, *page + 1).find(marker) == std::string::npos)) {
+      misplaced++;
+    }
+  }
+  check(misplaced == 0, std::to_string(misplaced) + " note anchors point to a page without their note");
+  check(section.getPageForAnchor("twice") == 0, "repeated id resolves to its first use");
+  check(!section.getPageForAnchor("n" + std::to_string(NOTES)).has_value(), "unknown id is not found");
+  check(!section.getPageForAnchor("").has_value(), "empty id is not found");
+}
+
+double msSince(const std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The anchor map as it was written before: ids in document order, read through until one matches
+void writeLinearAnchorMap(const std::string& path, const std::vector<std::pair<std::string, uint16_t>>& anchors) {
+  FsFile f;
+  Storage.openFileForWrite("TST", path, f);
+  serialization::writePod(f, static_cast<uint16_t>(anchors.size()));
+  for (const auto& [anchor, page] : anchors) {
+    serialization::writeString(f, anchor);
+    serialization::writePod(f, page);
+  }
+  f.close();
+}
+
+std::optional<uint16_t> linearAnchorLookup(const std::string& path, const std::string& anchor) {
+  FsFile f;
+  if (!Storage.openFileForRead("TST", path, f)) return std::nullopt;
+  uint16_t count;
+  serialization::readPod(f, count);
+  for (uint16_t i = 0; i < count; i++) {
+    std::string key;
+    uint16_t page;
+    serialization::readString(f, key);
+    serialization::readPod(f, page);
+    if (key == anchor) return page;
+  }
+  return std::nullopt;
+}
+
+void bench(const Epub& epub, Section& section) {
+  using Clock = std::chrono::steady_clock;
+  const auto hrefs = linkHrefs(epub);
+  auto start = Clock::now();
+  for (const auto& href : hrefs) linearResolve(epub, href);
+  const double linearResolveMs = msSince(start) / hrefs.size();
+  start = Clock::now();
+  for (const auto& href : hrefs) epub.resolveHrefToSpineIndex(href);
+  const double indexedResolveMs = msSince(start) / hrefs.size();
+
+  std::vector<std::pair<std::string, uint16_t>> anchors;
+  for (int n = 0; n < NOTES; n++) {
+    const std::string id = "n" + std::to_string(n);
+    anchors.emplace_back(id, section.getPageForAnchor(id).value_or(0));
+  }
+  writeLinearAnchorMap("/linear_anchors.bin", anchors);
+  constexpr int STEP = 50;
+  start = Clock::now();
+  for (int n = 0; n < NOTES; n += STEP) linearAnchorLookup("/linear_anchors.bin", anchors[n].first);
+  const double linearAnchorMs = msSince(start) / (NOTES / STEP);
+  start = Clock::now();
+  for (int n = 0; n < NOTES; n += STEP) section.getPageForAnchor(anchors[n].first);
+  const double indexedAnchorMs = msSince(start) / (NOTES / STEP);
+
+  std::cout << std::fixed << std::setprecision(3) << "Cross-chapter link to one of " << epub.getSpineItemsCount()
+            << " spine items: spine scan " << linearResolveMs << " ms, filename index " << indexedResolveMs
+            << " ms\nAnchor among " << NOTES << " in one chapter: linear map " << linearAnchorMs
+            << " ms, sorted hash map " << indexedAnchorMs << " ms" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bool runBench = false;
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--bench") runBench = true;
+  }
+
+  char dir[] = "/tmp/anchor_index_XXXXXX";
+  if (!mkdtemp(dir)) {
+    std::cerr << "Failed to create scratch directory" << std::endl;
+    return 1;
+  }
+  scratch = dir;
+  Storage.setRoot(dir);
+  writeEpub();
+  Storage.mkdir("/cache");
+
+  HalDisplay display;
+  GfxRenderer renderer(display);
+  renderer.begin();
+  const EpdFont font(&bookerly_14_regular);
+  renderer.insertFont(FONT_ID, EpdFontFamily(&font));
+
+  auto epub = std::make_shared<Epub>("/book.epub", "/cache");
+  check(epub->load(true, true), "book loads");
+  testResolveHref(*epub);
+
+  {
+    // A reopened book reads the index back from book.bin
+    auto reopened = std::make_shared<Epub>("/book.epub", "/cache");
+    check(reopened->load(true, true), "book loads from its cache");
+    check(reopened->resolveHrefToSpineIndex("notes.xhtml") == NOTES_SPINE_INDEX, "index read back from the cache");
+  }
+
+  Section section(epub, NOTES_SPINE_INDEX, renderer);
+  check(section.createSectionFile(FONT_ID, 1.0f, false, 0, VIEWPORT_WIDTH, VIEWPORT_HEIGHT, false, false, 0),
+        "notes chapter is laid out");
+  check(section.pageCount > 100, "notes chapter has many pages (" + std::to_string(section.pageCount) + ")");
+  testAnchorLookup(section);
+  if (runBench) bench(*epub, section);
+
+  std::system(("rm -rf '" + scratch + "'").c_str());
+
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All anchor index tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,305 @@
+#include <DeltaPatch.h>
+#include <mbedtls/sha256.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+
+// DeltaPatch and InflateReader allocate with malloc, so count malloc rather than operator new
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+}
+
+namespace heap {
+long live = 0;
+long peak = 0;
+
+void note(const long change) {
+  live += change;
+  peak = std::max(peak, live);
+}
+
+// Peak heap above the current level while `fn` runs
+template <typename Fn>
+size_t peakDuring(Fn fn) {
+  const long base = live;
+  peak = live;
+  fn();
+  return static_cast<size_t>(peak - base);
+}
+}  // namespace heap
+
+extern "C" {
+void* malloc(const size_t size) {
+  void* ptr = __libc_malloc(size);
+  if (ptr) heap::note(static_cast<long>(malloc_usable_size(ptr)));
+  return ptr;
+}
+void* calloc(const size_t count, const size_t size) {
+  void* ptr = __libc_calloc(count, size);
+  if (ptr) heap::note(static_cast<long>(malloc_usable_size(ptr)));
+  return ptr;
+}
+void* realloc(void* ptr, const size_t size) {
+  const long before = ptr ? static_cast<long>(malloc_usable_size(ptr)) : 0;
+  void* moved = __libc_realloc(ptr, size);
+  if (moved) heap::note(static_cast<long>(malloc_usable_size(moved)) - before);
+  return moved;
+}
+void free(void* ptr) {
+  if (ptr) heap::note(-static_cast<long>(malloc_usable_size(ptr)));
+  __libc_free(ptr);
+}
+}
+#define HEAP_TRACKED 1
+#endif
+
+namespace {
+
+int failures = 0;
+bool bench = false;
+
+void check(const bool condition, const std::string& message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << std::endl;
+    failures++;
+  }
+}
+
+constexpr size_t FIXED_HEADER_SIZE = 80;
+constexpr char TEST_KEY[] = "delta-patch-test-key";
+
+std::vector<uint8_t> readFile(const char* path) {
+  std::vector<uint8_t> data;
+  FILE* file = fopen(path, "rb");
+  if (!file) return data;
+  uint8_t buffer[4096];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) data.insert(data.end(), buffer, buffer + read);
+  fclose(file);
+  return data;
+}
+
+// Stand-in for the device's ECDSA check: the "signature" is SHA-256(key || digest). The script signs with openssl,
+// which the host test doesn't link, so the test signs the patches itself.
+std::vector<uint8_t> testSignature(const uint8_t* digest) {
+  std::vector<uint8_t> keyed(TEST_KEY, TEST_KEY + strlen(TEST_KEY));
+  keyed.insert(keyed.end(), digest, digest + DeltaPatch::HASH_SIZE);
+  std::vector<uint8_t> signature(DeltaPatch::HASH_SIZE);
+  mbedtls_sha256(keyed.data(), keyed.size(), signature.data(), 0);
+  return signature;
+}
+
+bool checkTestSignature(const uint8_t* digest, const uint8_t* signature, const size_t size) {
+  const auto expected = testSignature(digest);
+  return size == expected.size() && memcmp(signature, expected.data(), size) == 0;
+}
+
+// Replace the patch's signature with the test one
+std::vector<uint8_t> signPatch(const std::vector<uint8_t>& patch) {
+  const size_t oldSignatureSize = patch[FIXED_HEADER_SIZE] | patch[FIXED_HEADER_SIZE + 1] << 8;
+  uint8_t digest[DeltaPatch::HASH_SIZE];
+  mbedtls_sha256(patch.data(), FIXED_HEADER_SIZE, digest, 0);
+  const auto signature = testSignature(digest);
+
+  std::vector<uint8_t> signedPatch(patch.begin(), patch.begin() + FIXED_HEADER_SIZE);
+  signedPatch.push_back(static_cast<uint8_t>(signature.size()));
+  signedPatch.push_back(0);
+  signedPatch.insert(signedPatch.end(), signature.begin(), signature.end());
+  signedPatch.insert(signedPatch.end(), patch.begin() + FIXED_HEADER_SIZE + 2 + oldSignatureSize, patch.end());
+  return signedPatch;
+}
+
+struct Run {
+  DeltaPatch::Error begin = DeltaPatch::Error::OK;
+  DeltaPatch::Error source = DeltaPatch::Error::OK;
+  DeltaPatch::Error apply = DeltaPatch::Error::OK;
+  std::vector<uint8_t> output;
+  size_t largestSourceRead = 0;
+  size_t largestWrite = 0;
+  size_t peakHeap = 0;
+};
+
+// Apply `patch` to `source` the way the updater does, handing the patch over in short reads of `maxRead` bytes
+Run applyPatch(const std::vector<uint8_t>& patch, const std::vector<uint8_t>& source, const size_t maxRead,
+               const uint32_t seed = 1) {
+  Run run;
+  size_t patchPos = 0;
+  std::mt19937 rng(seed);
+  DeltaPatch delta([&](uint8_t* buffer, const size_t size) {
+    const size_t read = std::min({size, patch.size() - patchPos,
+                                  static_cast<size_t>(std::uniform_int_distribution<size_t>(1, maxRead)(rng))});
+    memcpy(buffer, patch.data() + patchPos, read);
+    patchPos += read;
+    return static_cast<int>(read);
+  });
+  const auto readSource = [&](const size_t offset, uint8_t* buffer, const size_t size) {
+    run.largestSourceRead = std::max(run.largestSourceRead, size);
+    if (offset + size > source.size()) return false;
+    memcpy(buffer, source.data() + offset, size);
+    return true;
+  };
+  const auto writeTarget = [&](const uint8_t* data, const size_t size) {
+    run.largestWrite = std::max(run.largestWrite, size);
+    run.output.insert(run.output.end(), data, data + size);
+    return true;
+  };
+
+  run.begin = delta.begin(checkTestSignature);
+  if (run.begin != DeltaPatch::Error::OK) return run;
+  run.source = delta.checkSource(readSource);
+  if (run.source != DeltaPatch::Error::OK) return run;
+  // Reserve up front so the output buffer doesn't count as patcher memory
+  run.output.reserve(delta.header().targetSize);
+#ifdef HEAP_TRACKED
+  run.peakHeap = heap::peakDuring([&] { run.apply = delta.apply(readSource, writeTarget); });
+#else
+  run.apply = delta.apply(readSource, writeTarget);
+#endif
+  return run;
+}
+
+void testApply(const std::vector<uint8_t>& oldImage, const std::vector<uint8_t>& newImage,
+               const std::vector<uint8_t>& patch) {
+  const auto signedPatch = signPatch(patch);
+
+  const auto run = applyPatch(signedPatch, oldImage, 4096);
+  check(run.begin == DeltaPatch::Error::OK, "signed patch accepted");
+  check(run.source == DeltaPatch::Error::OK, "old image matches the patch source");
+  check(run.apply == DeltaPatch::Error::OK, "patch applies");
+  check(run.output == newImage, "patched image equals the new image");
+  check(run.largestSourceRead <= 2048 && run.largestWrite <= 2048, "source and target are streamed in small chunks");
+#ifdef HEAP_TRACKED
+  // 32KB inflate window plus the patcher's own buffers, however large the image
+  check(run.peakHeap < 44 * 1024, "peak heap while applying is bounded: " + std::to_string(run.peakHeap));
+#endif
+  check(patch.size() * 4 < newImage.size(), "patch is a fraction of the image: " + std::to_string(patch.size()));
+
+  // The patch file arrives in whatever pieces the SD card hands back
+  for (uint32_t seed = 1; seed <= 5; seed++) {
+    check(applyPatch(signedPatch, oldImage, 7, seed).output == newImage, "byte-sized patch reads give the same image");
+  }
+
+  if (bench) {
+    const auto start = std::chrono::steady_clock::now();
+    constexpr int ROUNDS = 20;
+    for (int i = 0; i < ROUNDS; i++) applyPatch(signedPatch, oldImage, 4096);
+    const auto micros =
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    printf("image %zu bytes, patch %zu bytes (%.1f%%), peak heap %zu bytes, %.2f ms per apply\n", newImage.size(),
+           patch.size(), patch.size() * 100.0 / newImage.size(), run.peakHeap, micros / 1000.0 / ROUNDS);
+  }
+}
+
+void testSignature(const std::vector<uint8_t>& oldImage, const std::vector<uint8_t>& patch) {
+  const auto signedPatch = signPatch(patch);
+
+  // The generator leaves the signature empty without a key; the device never applies such a patch
+  check(applyPatch(patch, oldImage, 4096).begin == DeltaPatch::Error::BAD_SIGNATURE, "unsigned patch rejected");
+
+  auto tampered = signedPatch;
+  tampered[16 + DeltaPatch::HASH_SIZE] ^= 0x01;  // First byte of the target hash
+  check(applyPatch(tampered, oldImage, 4096).begin == DeltaPatch::Error::BAD_SIGNATURE,
+        "patch with an edited header rejected");
+
+  tampered = signedPatch;
+  tampered[FIXED_HEADER_SIZE + 2] ^= 0x01;
+  check(applyPatch(tampered, oldImage, 4096).begin == DeltaPatch::Error::BAD_SIGNATURE,
+        "patch with an edited signature rejected");
+
+  tampered = signedPatch;
+  tampered[0] = 'X';
+  check(applyPatch(tampered, oldImage, 4096).begin == DeltaPatch::Error::BAD_HEADER, "wrong magic rejected");
+
+  tampered.assign(signedPatch.begin(), signedPatch.begin() + 40);
+  check(applyPatch(tampered, oldImage, 4096).begin == DeltaPatch::Error::BAD_HEADER, "short header rejected");
+}
+
+void testWrongSource(const std::vector<uint8_t>& oldImage, const std::vector<uint8_t>& newImage,
+                     const std::vector<uint8_t>& patch) {
+  const auto signedPatch = signPatch(patch);
+
+  const auto run = applyPatch(signedPatch, newImage, 4096);
+  check(run.begin == DeltaPatch::Error::OK && run.source == DeltaPatch::Error::SOURCE_MISMATCH,
+        "patch refuses a running image it wasn't made from");
+  check(run.output.empty(), "nothing written for the wrong source");
+
+  auto edited = oldImage;
+  edited[edited.size() / 2] ^= 0x80;
+  check(applyPatch(signedPatch, edited, 4096).source == DeltaPatch::Error::SOURCE_MISMATCH,
+        "one changed byte in the running image is caught");
+
+  // Shorter than the header says: the source read fails before hashing completes
+  edited.assign(oldImage.begin(), oldImage.end() - 100);
+  check(applyPatch(signedPatch, edited, 4096).source == DeltaPatch::Error::READ_ERROR, "short source reported");
+}
+
+void testCorruptBody(const std::vector<uint8_t>& oldImage, const std::vector<uint8_t>& patch) {
+  const auto signedPatch = signPatch(patch);
+  const size_t bodyStart = FIXED_HEADER_SIZE + 2 + DeltaPatch::HASH_SIZE;
+
+  // The body isn't covered by the signature, so damage to it must still be caught before the image is used
+  std::mt19937 rng(99);
+  for (int i = 0; i < 50; i++) {
+    auto damaged = signedPatch;
+    const size_t pos = std::uniform_int_distribution<size_t>(bodyStart, damaged.size() - 1)(rng);
+    damaged[pos] ^= static_cast<uint8_t>(1 << (i % 8));
+    const auto run = applyPatch(damaged, oldImage, 4096);
+    check(run.apply != DeltaPatch::Error::OK, "damaged body at " + std::to_string(pos) + " is not accepted");
+  }
+
+  auto truncated = signedPatch;
+  truncated.resize(bodyStart + (truncated.size() - bodyStart) / 2);
+  const auto run = applyPatch(truncated, oldImage, 4096);
+  check(run.apply == DeltaPatch::Error::CORRUPT, "truncated patch reported as corrupt");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--bench") {
+      bench = true;
+    } else {
+      files.emplace_back(argv[i]);
+    }
+  }
+  if (files.size() != 3) {
+    std::cerr << "usage: DeltaPatchTest <old image> <new image> <patch> [--bench]" << std::endl;
+    return 2;
+  }
+
+  const auto oldImage = readFile(files[0].c_str());
+  const auto newImage = readFile(files[1].c_str());
+  const auto patch = readFile(files[2].c_str());
+  if (oldImage.empty() || newImage.empty() || patch.size() <= FIXED_HEADER_SIZE + 2) {
+    std::cerr << "Failed to read the test images" << std::endl;
+    return 2;
+  }
+
+  testApply(oldImage, newImage, patch);
+  testSignature(oldImage, patch);
+  testWrongSource(oldImage, newImage, patch);
+  testCorruptBody(oldImage, patch);
+
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All delta patch tests passed" << std::endl;
+  return 0;
+}
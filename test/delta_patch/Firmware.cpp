@@ -0,0 +1,96 @@
+// Stand-in firmware for the delta patch test: run_delta_patch_test.sh builds it twice, with FIRMWARE_VARIANT 1 and
+// 2, to get two images that differ the way consecutive releases do (a changed string, a new function that shifts
+// the code after it, an edited table).
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifndef FIRMWARE_VARIANT
+#define FIRMWARE_VARIANT 1
+#endif
+
+namespace {
+#if FIRMWARE_VARIANT == 1
+constexpr char VERSION[] = "1.4.0";
+#else
+constexpr char VERSION[] = "1.4.1";
+#endif
+
+const unsigned short GLYPH_WIDTHS[] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30,
+    31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58,
+#if FIRMWARE_VARIANT == 2
+    61, 62, 63, 64,
+#endif
+    59, 60, 61, 62, 63, 64, 65, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76, 77, 78, 79, 80, 81, 82, 83, 84, 85, 86,
+};
+
+#if FIRMWARE_VARIANT == 2
+int hyphenPenalty(const std::string& word) {
+  int penalty = 0;
+  for (const char c : word) penalty += (c == '-') ? 10 : (c >= 'A' && c <= 'Z') ? 3 : 1;
+  return penalty;
+}
+#endif
+
+std::vector<std::string> wrapWords(const std::string& text, const size_t width) {
+  std::vector<std::string> lines;
+  std::string line;
+  size_t start = 0;
+  while (start < text.size()) {
+    size_t end = text.find(' ', start);
+    if (end == std::string::npos) end = text.size();
+    const std::string word = text.substr(start, end - start);
+    if (!line.empty() && line.size() + word.size() + 1 > width) {
+      lines.push_back(line);
+      line.clear();
+    }
+    if (!line.empty()) line += ' ';
+    line += word;
+    start = end + 1;
+  }
+  if (!line.empty()) lines.push_back(line);
+  return lines;
+}
+
+std::map<std::string, int> countWords(const std::vector<std::string>& lines) {
+  std::map<std::string, int> counts;
+  for (const auto& line : lines) {
+    size_t start = 0;
+    while (start < line.size()) {
+      size_t end = line.find(' ', start);
+      if (end == std::string::npos) end = line.size();
+      counts[line.substr(start, end - start)]++;
+      start = end + 1;
+    }
+  }
+  return counts;
+}
+
+int measure(const std::string& text) {
+  int width = 0;
+  for (const unsigned char c : text) width += GLYPH_WIDTHS[c % (sizeof(GLYPH_WIDTHS) / sizeof(GLYPH_WIDTHS[0]))];
+  return width;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string text = "It was the best of times, it was the worst of times, it was the age of wisdom";
+  for (int i = 1; i < argc; i++) text += std::string(" ") + argv[i];
+
+  auto lines = wrapWords(text, 24);
+  std::sort(lines.begin(), lines.end());
+  for (const auto& line : lines) printf("%4d %s\n", measure(line), line.c_str());
+  for (const auto& [word, count] : countWords(lines)) {
+#if FIRMWARE_VARIANT == 2
+    printf("%s: %d (%d)\n", word.c_str(), count, hyphenPenalty(word));
+#else
+    printf("%s: %d\n", word.c_str(), count);
+#endif
+  }
+  printf("CrossPoint %s\n", VERSION);
+  return 0;
+}
@@ -0,0 +1,405 @@
+#include <HalStorage.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "Dictionary.h"
+
+// Heap accounting: every allocation carries its size so peak usage can be measured around a call
+namespace heap {
+std::atomic<size_t> live{0};
+std::atomic<size_t> peak{0};
+
+void* allocate(const size_t size) {
+  auto* block = static_cast<size_t*>(std::malloc(size + sizeof(std::max_align_t)));
+  if (!block) throw std::bad_alloc();
+  *block = size;
+  const size_t now = live += size;
+  size_t seen = peak;
+  while (now > seen && !peak.compare_exchange_weak(seen, now)) {
+  }
+  return reinterpret_cast<char*>(block) + sizeof(std::max_align_t);
+}
+
+void release(void* ptr) {
+  if (!ptr) return;
+  auto* block = reinterpret_cast<size_t*>(static_cast<char*>(ptr) - sizeof(std::max_align_t));
+  live -= *block;
+  std::free(block);
+}
+
+// Peak heap above the current level while `fn` runs
+template <typename Fn>
+size_t peakDuring(Fn fn) {
+  const size_t base = live;
+  peak = base;
+  fn();
+  return peak - base;
+}
+}  // namespace heap
+
+void* operator new(const size_t size) { return heap::allocate(size); }
+void* operator new[](const size_t size) { return heap::allocate(size); }
+void operator delete(void* ptr) noexcept { heap::release(ptr); }
+void operator delete[](void* ptr) noexcept { heap::release(ptr); }
+void operator delete(void* ptr, size_t) noexcept { heap::release(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { heap::release(ptr); }
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+int failures = 0;
+bool bench = false;
+
+// Big enough that a whole-index approach would not fit the device's RAM
+constexpr size_t HEADWORDS = 500000;
+// Where Dictionary keeps the samples, so dictionaries opened here are already prepared for it
+constexpr char CACHE[] = "/.crosspoint/dictionaries";
+
+void check(const bool condition, const std::string& message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << std::endl;
+    failures++;
+  }
+}
+
+double msSince(const Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void removeTree(const std::string& hostDir) {
+  const std::string command = "rm -rf '" + hostDir + "'";
+  check(std::system(command.c_str()) == 0, "remove " + hostDir);
+}
+
+bool writeFile(const std::string& path, const std::string& data) {
+  FILE* f = std::fopen(Storage.hostPath(path).c_str(), "wb");
+  if (!f) return false;
+  const bool ok = std::fwrite(data.data(), 1, data.size(), f) == data.size();
+  std::fclose(f);
+  return ok;
+}
+
+void appendBigEndian(std::string& out, const uint32_t value) {
+  for (int shift = 24; shift >= 0; shift -= 8) out += static_cast<char>((value >> shift) & 0xFF);
+}
+
+struct Headword {
+  std::string word;
+  std::string definition;
+};
+
+// Writes `<basePath>.ifo`, `.idx` and `.dict` for `entries`, which are put in StarDict order first
+void writeDictionary(const std::string& basePath, std::vector<Headword> entries, const std::string& sameTypeSequence) {
+  std::sort(entries.begin(), entries.end(), [](const Headword& a, const Headword& b) {
+    return StarDict::compare(a.word.c_str(), b.word.c_str()) < 0;
+  });
+  std::string idx;
+  std::string dict;
+  for (const auto& entry : entries) {
+    idx += entry.word;
+    idx += '\0';
+    appendBigEndian(idx, static_cast<uint32_t>(dict.size()));
+    appendBigEndian(idx, static_cast<uint32_t>(entry.definition.size()));
+    dict += entry.definition;
+  }
+  std::string ifo = "StarDict's dict ifo file\nversion=2.4.2\n";
+  ifo += "bookname=" + basePath.substr(basePath.find_last_of('/') + 1) + "\n";
+  ifo += "wordcount=" + std::to_string(entries.size()) + "\n";
+  ifo += "idxfilesize=" + std::to_string(idx.size()) + "\n";
+  if (!sameTypeSequence.empty()) ifo += "sametypesequence=" + sameTypeSequence + "\n";
+  check(writeFile(basePath + ".ifo", ifo) && writeFile(basePath + ".idx", idx) && writeFile(basePath + ".dict", dict),
+        "write " + basePath);
+}
+
+std::string definitionOf(const std::string& word, const size_t n) {
+  std::string definition = "Definition of " + word + ".";
+  // Some definitions are long enough to cross a dictzip chunk boundary
+  if (n % 401 == 0) {
+    while (definition.size() < 3000) definition += " More about " + word + " (" + std::to_string(n) + ").";
+  }
+  return definition;
+}
+
+// Distinct pseudo-random headwords plus a few real words the other tests rely on
+std::vector<Headword> syntheticHeadwords() {
+  std::vector<std::string> words = {"apple", "Apple", "run", "stop", "city", "happy", "homme", "\xC3\xA9""cole",
+                                    "aardvark", "zyzzyva", "Zz"};
+  uint32_t state = 12345;
+  while (words.size() < HEADWORDS) {
+    state = state * 1103515245 + 12345;
+    const int length = 4 + (state >> 16) % 8;
+    std::string word;
+    for (int i = 0; i < length; i++) {
+      state = state * 1103515245 + 12345;
+      word += static_cast<char>('a' + (state >> 16) % 26);
+    }
+    // Odd words capitalized, so case-insensitive order interleaves cases as real dictionaries do
+    if (words.size() % 7 == 0) word[0] = static_cast<char>(word[0] - 'a' + 'A');
+    words.push_back(word);
+  }
+  std::sort(words.begin(), words.end());
+  words.erase(std::unique(words.begin(), words.end()), words.end());
+
+  std::vector<Headword> entries;
+  entries.reserve(words.size());
+  for (size_t i = 0; i < words.size(); i++) entries.push_back({words[i], definitionOf(words[i], i)});
+  return entries;
+}
+
+void testCandidates() {
+  const auto has = [](const std::vector<std::string>& forms, const std::string& form) {
+    return std::find(forms.begin(), forms.end(), form) != forms.end();
+  };
+
+  auto forms = Dictionary::candidates("Running,", "en-US");
+  check(!forms.empty() && forms[0] == "Running", "punctuation trimmed first");
+  check(has(forms, "running") && has(forms, "run"), "running -> run");
+  check(has(Dictionary::candidates("stopped", "en"), "stop"), "stopped -> stop");
+  check(has(Dictionary::candidates("cities", "en"), "city"), "cities -> city");
+  check(has(Dictionary::candidates("happier", "en"), "happy"), "happier -> happy");
+  check(has(Dictionary::candidates("Bob\xE2\x80\x99s", "en"), "Bob"), "possessive dropped");
+  check(has(Dictionary::candidates("\xE2\x80\x9CHello\xE2\x80\x9D", "en"), "Hello"), "curly quotes trimmed");
+  check(has(Dictionary::candidates("dic\xC2\xADtion\xC2\xAD""ary", "en"), "dictionary"), "soft hyphens removed");
+  check(has(Dictionary::candidates("l\xE2\x80\x99homme", "fr"), "homme"), "French elision dropped");
+  check(!has(Dictionary::candidates("l'homme", "en"), "homme"), "elision only for French and Italian");
+  check(has(Dictionary::candidates("\xC3\x89""COLE", "fr"), "\xC3\xA9""cole"), "Latin-1 lowercased");
+  check(has(Dictionary::candidates("\xD0\x9C\xD0\x98\xD0\xA0", "ru"), "\xD0\xBC\xD0\xB8\xD1\x80"),
+        "Cyrillic lowercased");
+  check(has(Dictionary::candidates("H\xC3\xA4usern", "de"), "h\xC3\xA4user"), "German dative plural");
+  check(has(Dictionary::candidates("chevaux", "fr"), "cheval"), "French plural");
+  check(Dictionary::candidates("\xE2\x80\x94", "en").empty(), "punctuation alone has no forms");
+  forms = Dictionary::candidates("dogs", "xx");
+  check(forms.size() == 1 && forms[0] == "dogs", "unknown language: no suffix rules");
+}
+
+// Every 97th headword, plus the last, must come back with its definition
+void checkAllSampled(const StarDict& dictionary, const std::vector<Headword>& sorted, const std::string& label) {
+  size_t wrong = 0;
+  const auto lookUp = [&](const Headword& headword) {
+    StarDict::Entry entry;
+    if (!dictionary.lookup(headword.word, entry) || entry.headword != headword.word ||
+        entry.definition != headword.definition) {
+      if (wrong++ < 5) std::cerr << "  " << label << ": lookup of '" << headword.word << "' failed" << std::endl;
+    }
+  };
+  for (size_t i = 0; i < sorted.size(); i += 97) lookUp(sorted[i]);
+  lookUp(sorted.back());
+  check(wrong == 0, label + ": sampled headwords found");
+}
+
+void testLookups(const std::vector<Headword>& entries) {
+  std::vector<Headword> sorted = entries;
+  std::sort(sorted.begin(), sorted.end(), [](const Headword& a, const Headword& b) {
+    return StarDict::compare(a.word.c_str(), b.word.c_str()) < 0;
+  });
+
+  StarDict plain("/dictionaries/big");
+  int built = 0;
+  size_t retained = 0;
+  const auto openStart = Clock::now();
+  const size_t openPeak = heap::peakDuring([&] {
+    const size_t before = heap::live;
+    check(plain.open(CACHE, [&built] { built++; }), "open plain dictionary");
+    retained = heap::live - before;
+  });
+  const double openMs = msSince(openStart);
+  check(built == 1, "sample built on first open");
+  check(plain.getName() == "big" && plain.getWordCount() == sorted.size(), "info read");
+  // A few KB of keys for half a million headwords
+  check(retained < 8 * 1024, "sample RAM " + std::to_string(retained) + " bytes");
+
+  checkAllSampled(plain, sorted, "plain");
+
+  StarDict::Entry entry;
+  check(plain.lookup("Apple", entry) && entry.headword == "Apple", "exact case preferred");
+  check(plain.lookup("apple", entry) && entry.headword == "apple", "exact case preferred, lower");
+  check(plain.lookup("APPLE", entry) && (entry.headword == "apple" || entry.headword == "Apple"), "case variant found");
+  check(plain.lookup("ZYZZYVA", entry) && entry.headword == "zyzzyva", "upper-cased lookup");
+  check(!plain.lookup("aaa", entry), "word before the first headword");
+  check(!plain.lookup("zzzzzzzzzzzz", entry), "word after the last headword");
+  check(!plain.lookup("applf", entry), "missing word");
+  check(!plain.lookup("", entry), "empty word");
+
+  StarDict reopened("/dictionaries/big");
+  built = 0;
+  check(reopened.open(CACHE, [&built] { built++; }) && built == 0, "sample reused on second open");
+  check(reopened.lookup("homme", entry) && entry.definition == "Definition of homme.", "lookup after reopen");
+
+  // Same data dictzip-compressed
+  StarDict compressed("/dz/big");
+  check(compressed.open(CACHE), "open dictzip dictionary");
+  checkAllSampled(compressed, sorted, "dictzip");
+  size_t crossing = 0;
+  for (const auto& headword : sorted) {
+    if (headword.definition.size() < 1000) continue;
+    StarDict::Entry longEntry;
+    if (compressed.lookup(headword.word, longEntry) && longEntry.definition == headword.definition) crossing++;
+    if (crossing == 50) break;
+  }
+  check(crossing == 50, "long dictzip definitions read whole");
+
+  // Latency of lookups spread over the whole dictionary
+  const int LOOKUPS = 2000;
+  const auto run = [&](const StarDict& dictionary) {
+    int found = 0;
+    const auto start = Clock::now();
+    for (int i = 0; i < LOOKUPS; i++) {
+      const auto& headword = sorted[(static_cast<size_t>(i) * 7919) % sorted.size()];
+      StarDict::Entry result;
+      found += dictionary.lookup(headword.word, result);
+    }
+    check(found == LOOKUPS, "all timed lookups found");
+    return msSince(start) / LOOKUPS;
+  };
+  double plainMs = 0;
+  double compressedMs = 0;
+  const size_t plainPeak = heap::peakDuring([&] { plainMs = run(plain); });
+  const size_t compressedPeak = heap::peakDuring([&] { compressedMs = run(compressed); });
+  check(plainMs < 2.0, "plain lookup " + std::to_string(plainMs) + " ms");
+  check(compressedMs < 5.0, "dictzip lookup " + std::to_string(compressedMs) + " ms");
+  // Only the definition; the dictzip inflate window is malloc'd by InflateReader and not counted here
+  check(plainPeak < 16 * 1024, "plain lookup heap " + std::to_string(plainPeak));
+  check(compressedPeak < 16 * 1024, "dictzip lookup heap " + std::to_string(compressedPeak));
+
+  if (bench) {
+    std::cout << sorted.size() << " headwords: sample built in " << openMs << " ms (peak heap " << openPeak
+              << " B, " << retained << " B kept)" << std::endl;
+    std::cout << "  lookup: " << plainMs << " ms plain (peak heap " << plainPeak << " B), " << compressedMs
+              << " ms dictzip (peak heap " << compressedPeak << " B)" << std::endl;
+  }
+}
+
+void testStaleSample() {
+  writeDictionary("/dictionaries/small", {{"one", "1"}, {"two", "2"}}, "m");
+  StarDict first("/dictionaries/small");
+  check(first.open(CACHE), "open small dictionary");
+
+  // A replaced dictionary with a different index must not be read through the old sample
+  writeDictionary("/dictionaries/small", {{"one", "1"}, {"three", "3"}, {"two", "2"}}, "m");
+  StarDict second("/dictionaries/small");
+  int built = 0;
+  StarDict::Entry entry;
+  check(second.open(CACHE, [&built] { built++; }) && built == 1, "stale sample rebuilt");
+  check(second.lookup("three", entry) && entry.definition == "3", "lookup in rebuilt sample");
+}
+
+void testDefinitionTypes() {
+  writeDictionary("/dictionaries/markup",
+                  {{"html", "<b>bold</b> &amp; <i>plain</i><br>second&nbsp;line<p>third &#233;&#x74;&eacute;</p>"},
+                   {"spaces", "<div>  lots\n   of   space  </div>"}},
+                  "h");
+  StarDict markup("/dictionaries/markup");
+  StarDict::Entry entry;
+  check(markup.open(CACHE), "open markup dictionary");
+  check(markup.lookup("html", entry) && entry.definition == "bold & plain\nsecond line\nthird \xC3\xA9t&eacute;",
+        "HTML reduced to text: '" + entry.definition + "'");
+  check(markup.lookup("spaces", entry) && entry.definition == "lots of space", "whitespace collapsed");
+
+  // Without sametypesequence every field carries its type
+  std::string typed = "t";
+  typed += std::string("t\xC9\x99st") + '\0';
+  typed += "m";
+  typed += std::string("a trial") + '\0';
+  typed += "P";
+  appendBigEndian(typed, 3);
+  typed += "PNG";
+  typed += "m";
+  typed += std::string("an exam") + '\0';
+  writeDictionary("/dictionaries/typed", {{"test", typed}}, "");
+  StarDict fields("/dictionaries/typed");
+  check(fields.open(CACHE), "open typed dictionary");
+  check(fields.lookup("test", entry) && entry.definition == "[t\xC9\x99st]\na trial\nan exam",
+        "typed fields: '" + entry.definition + "'");
+
+  // With a sequence of two, the first field is NUL-terminated and the last runs to the end
+  writeDictionary("/dictionaries/sequence", {{"word", std::string("w\xC9\x9C:d") + '\0' + "a unit of language"}}, "tm");
+  StarDict sequence("/dictionaries/sequence");
+  check(sequence.open(CACHE), "open sequence dictionary");
+  check(sequence.lookup("word", entry) && entry.definition == "[w\xC9\x9C:d]\na unit of language",
+        "sametypesequence fields: '" + entry.definition + "'");
+}
+
+void testDictionaries() {
+  Dictionary dictionaries;
+  std::vector<std::string> prepared;
+  check(dictionaries.open([&prepared](const std::string& name) { prepared.push_back(name); }),
+        "open dictionary directory");
+  check(prepared.empty(), "samples already built");
+
+  Dictionary::Result result;
+  check(dictionaries.lookup("Cities", "en-GB", result) && result.headword == "city" && result.dictionary == "big",
+        "inflected word found through its base form");
+  check(dictionaries.lookup("\xE2\x80\x9Cstopped,\xE2\x80\x9D", "en", result) && result.headword == "stop",
+        "punctuated inflected word");
+  check(dictionaries.lookup("L\xE2\x80\x99homme", "fr", result) && result.headword == "homme", "elided word");
+  check(dictionaries.lookup("three", "en", result) && result.dictionary == "small", "second dictionary searched");
+  check(!dictionaries.lookup("qqqqqqqqqq", "en", result), "unknown word");
+
+  // A new dictionary gets its sample built on open
+  writeDictionary("/dictionaries/extra", {{"extra", "more"}}, "m");
+  Dictionary withExtra;
+  prepared.clear();
+  check(withExtra.open([&prepared](const std::string& name) { prepared.push_back(name); }), "reopen directory");
+  check(prepared.size() == 1 && prepared[0] == "extra", "progress names the dictionary being prepared");
+
+  Dictionary none;
+  removeTree(Storage.hostPath("/dictionaries"));
+  check(!none.open() && none.empty(), "no dictionaries");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--bench") bench = true;
+  }
+
+  char scratch[] = "/tmp/dictionary-test-XXXXXX";
+  if (!mkdtemp(scratch)) {
+    std::cerr << "Failed to create scratch directory" << std::endl;
+    return 1;
+  }
+  Storage.setRoot(scratch);
+  Storage.mkdir("/.crosspoint");
+  Storage.mkdir("/dictionaries");
+  Storage.mkdir("/dz");
+
+  const auto entries = syntheticHeadwords();
+  writeDictionary("/dictionaries/big", entries, "m");
+  const std::string compress = std::string("python3 '") + DICTZIP_SCRIPT + "' '" +
+                               Storage.hostPath("/dictionaries/big.dict") + "' '" +
+                               Storage.hostPath("/dz/big.dict.dz") + "' > /dev/null";
+  check(std::system(compress.c_str()) == 0, "dictzip compress");
+  for (const char* extension : {".ifo", ".idx"}) {
+    const std::string copy = std::string("cp '") + Storage.hostPath("/dictionaries/big") + extension + "' '" +
+                             Storage.hostPath("/dz/big") + extension + "'";
+    check(std::system(copy.c_str()) == 0, "copy index");
+  }
+
+  testCandidates();
+  testLookups(entries);
+  testStaleSample();
+  testDefinitionTypes();
+  testDictionaries();
+  removeTree(scratch);
+
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All dictionary tests passed" << std::endl;
+  return 0;
+}
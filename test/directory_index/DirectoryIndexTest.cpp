@@ -0,0 +1,502 @@
+#include <HalStorage.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "lib/DirectoryIndex/DirectoryIndex.h"
+
+// Heap accounting: every allocation carries its size so peak usage can be measured around a call
+namespace heap {
+std::atomic<size_t> live{0};
+std::atomic<size_t> peak{0};
+
+void* allocate(const size_t size) {
+  auto* block = static_cast<size_t*>(std::malloc(size + sizeof(std::max_align_t)));
+  if (!block) throw std::bad_alloc();
+  *block = size;
+  const size_t now = live += size;
+  size_t seen = peak;
+  while (now > seen && !peak.compare_exchange_weak(seen, now)) {
+  }
+  return reinterpret_cast<char*>(block) + sizeof(std::max_align_t);
+}
+
+void release(void* ptr) {
+  if (!ptr) return;
+  auto* block = reinterpret_cast<size_t*>(static_cast<char*>(ptr) - sizeof(std::max_align_t));
+  live -= *block;
+  std::free(block);
+}
+
+// Peak heap above the current level while `fn` runs
+template <typename Fn>
+size_t peakDuring(Fn fn) {
+  const size_t base = live;
+  peak = base;
+  fn();
+  return peak - base;
+}
+}  // namespace heap
+
+void* operator new(const size_t size) { return heap::allocate(size); }
+void* operator new[](const size_t size) { return heap::allocate(size); }
+void operator delete(void* ptr) noexcept { heap::release(ptr); }
+void operator delete[](void* ptr) noexcept { heap::release(ptr); }
+void operator delete(void* ptr, size_t) noexcept { heap::release(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { heap::release(ptr); }
+
+namespace {
+
+int failures = 0;
+bool bench = false;
+
+void check(const bool condition, const std::string& message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << std::endl;
+    failures++;
+  }
+}
+
+using Clock = std::chrono::steady_clock;
+
+double msSince(const Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+bool hideDotFiles(const char* name, bool) { return name[0] != '.'; }
+const DirectoryIndex::Filter VISIBLE{0, hideDotFiles};
+bool isEpub(const char* name) {
+  const size_t length = strlen(name);
+  return length >= 5 && strcasecmp(name + length - 5, ".epub") == 0;
+}
+const DirectoryIndex::Filter EPUBS_FIRST{1, hideDotFiles, isEpub};
+
+bool less(const std::string& a, const std::string& b) {
+  return DirectoryIndex::nameLess(a.data(), a.size(), b.data(), b.size());
+}
+
+void makeFile(const std::string& path, const size_t size, const time_t modified) {
+  const std::string hostPath = Storage.hostPath(path);
+  FILE* f = std::fopen(hostPath.c_str(), "wb");
+  if (size > 0) {
+    std::fseek(f, static_cast<long>(size - 1), SEEK_SET);
+    std::fputc(0, f);
+  }
+  std::fclose(f);
+  const timeval times[2] = {{modified, 0}, {modified, 0}};
+  utimes(hostPath.c_str(), times);
+}
+
+std::vector<DirectoryIndex::Entry> readAll(DirectoryIndex& index, const DirectoryIndex::SortKey key,
+                                           const bool descending, const uint32_t pageSize = 7) {
+  std::vector<DirectoryIndex::Entry> entries;
+  for (uint32_t position = 0; position < index.size(); position += pageSize) {
+    index.read(key, descending, position, pageSize, [&](const DirectoryIndex::Entry& e) { entries.push_back(e); });
+  }
+  return entries;
+}
+
+std::vector<std::string> names(const std::vector<DirectoryIndex::Entry>& entries) {
+  std::vector<std::string> result;
+  for (const auto& e : entries) result.push_back(e.name);
+  return result;
+}
+
+void removeTree(const std::string& hostDir) {
+  const std::string command = "rm -rf '" + hostDir + "'";
+  check(std::system(command.c_str()) == 0, "remove " + hostDir);
+}
+
+void testNameOrder() {
+  check(less("Vol 2", "Vol 10"), "numbers compare by value");
+  check(!less("Vol 10", "Vol 2"), "numbers compare by value (reversed)");
+  check(less("apple", "Banana"), "case-insensitive");
+  check(less("file007b", "file7c"), "leading zeros ignored");
+  check(less("abc", "abcd"), "prefix first");
+  check(!less("abc", "abc"), "strict ordering");
+}
+
+void testFatTime() {
+  // 2024-03-15 13:45:30
+  const uint32_t modified = static_cast<uint32_t>((2024 - 1980) << 9 | 3 << 5 | 15) << 16 | (13 << 11 | 45 << 5 | 15);
+  check(DirectoryIndex::fatToUnixTime(modified) == 1710510330, "FAT timestamp converts to Unix time");
+  check(DirectoryIndex::fatToUnixTime(0) == 0, "unset timestamp");
+}
+
+void testSmallDirectory() {
+  const std::string dir = "/books";
+  Storage.mkdir(dir.c_str());
+  Storage.mkdir("/books/Series 10");
+  Storage.mkdir("/books/Series 9");
+  makeFile(dir + "/Book 2.epub", 300, 1700000000);
+  makeFile(dir + "/book 10.epub", 100, 1700000600);
+  makeFile(dir + "/Atlas.pdf", 200, 1600000000);
+  makeFile(dir + "/.hidden", 50, 1700000000);
+
+  DirectoryIndex index;
+  check(index.open(dir + "/", VISIBLE), "index small directory");
+  check(index.size() == 5, "hidden entries filtered");
+  check(index.folderCount() == 2, "folder count");
+  check(index.totalFileSize() == 600, "total size of listed files");
+
+  const auto byName = names(readAll(index, DirectoryIndex::SortKey::Name, false, 2));
+  check(byName == std::vector<std::string>{"Series 9", "Series 10", "Atlas.pdf", "Book 2.epub", "book 10.epub"},
+        "name order, folders first");
+  const auto byNameDesc = names(readAll(index, DirectoryIndex::SortKey::Name, true, 3));
+  check(byNameDesc == std::vector<std::string>{"Series 10", "Series 9", "book 10.epub", "Book 2.epub", "Atlas.pdf"},
+        "descending keeps folders first");
+  const auto bySize = names(readAll(index, DirectoryIndex::SortKey::Size, false));
+  check(std::vector<std::string>(bySize.begin() + 2, bySize.end()) ==
+            std::vector<std::string>{"book 10.epub", "Atlas.pdf", "Book 2.epub"},
+        "size order");
+  const auto byModified = readAll(index, DirectoryIndex::SortKey::Modified, true);
+  check(byModified[2].name == "book 10.epub" && byModified[4].name == "Atlas.pdf", "newest first");
+  check(DirectoryIndex::fatToUnixTime(byModified[4].modified) == 1600000000 - timezone, "modified time kept");
+  check(byModified[0].isDirectory && !byModified[2].isDirectory, "folder flag kept");
+
+  std::vector<DirectoryIndex::Entry> window;
+  check(index.read(DirectoryIndex::SortKey::Name, false, 4, 10,
+                   [&](const DirectoryIndex::Entry& e) { window.push_back(e); }) == 1,
+        "read stops at the end");
+  check(window.size() == 1 && window[0].size == 100, "last entry with its size");
+  const uint32_t generation = index.getGeneration();
+  index.close();
+
+  // Without invalidation the index is reused as is
+  makeFile(dir + "/New.epub", 10, 1700000000);
+  check(index.open(dir, VISIBLE) && index.size() == 5 && index.getGeneration() == generation, "index reused");
+  index.close();
+
+  DirectoryIndex::invalidateParent(dir + "/New.epub");
+  check(index.open(dir, VISIBLE) && index.size() == 6, "invalidated index rebuilt");
+  check(index.getGeneration() != generation, "rebuilt index has a new generation");
+  index.close();
+
+  // A different filter gets its own index
+  check(index.open(dir, DirectoryIndex::Filter{1, nullptr}) && index.size() == 7, "unfiltered index");
+  index.close();
+
+  DirectoryIndex empty;
+  Storage.mkdir("/empty");
+  check(empty.open("/empty", VISIBLE) && empty.size() == 0, "empty directory");
+  check(!empty.open("/missing", VISIBLE), "missing directory");
+}
+
+void testLargeDirectory() {
+  constexpr int FILES = 10000;
+  constexpr int FOLDERS = 50;
+  const std::string dir = "/large";
+  Storage.mkdir(dir.c_str());
+
+  std::vector<std::string> expected;
+  srand(42);
+  for (int i = 0; i < FOLDERS; i++) {
+    const std::string name = "Author " + std::to_string(rand() % 1000) + " " + std::to_string(i);
+    Storage.mkdir((dir + "/" + name).c_str());
+  }
+  for (int i = 0; i < FILES; i++) {
+    const std::string name = "Some Fairly Long Book Title Number " + std::to_string(rand() % 100000) + " - " +
+                             std::to_string(i) + ".epub";
+    makeFile(dir + "/" + name, static_cast<size_t>(rand() % 5000), 1600000000 + (rand() % 100000) * 60);
+    expected.push_back(name);
+  }
+  std::sort(expected.begin(), expected.end(), less);
+
+  DirectoryIndex index;
+  double buildMs = 0;
+  const size_t buildHeap = heap::peakDuring([&] {
+    const auto start = Clock::now();
+    check(index.open(dir, VISIBLE), "index large directory");
+    buildMs = msSince(start);
+  });
+  check(index.size() == FILES + FOLDERS, "all entries indexed");
+  check(buildHeap < 48 * 1024, "index built in bounded memory (" + std::to_string(buildHeap) + " bytes)");
+
+  const auto byName = readAll(index, DirectoryIndex::SortKey::Name, false, 100);
+  bool foldersFirst = true;
+  for (int i = 0; i < FOLDERS; i++) foldersFirst &= byName[i].isDirectory;
+  check(foldersFirst, "folders first");
+  std::vector<std::string> fileNames;
+  for (size_t i = FOLDERS; i < byName.size(); i++) fileNames.push_back(byName[i].name);
+  check(fileNames == expected, "name order matches an in-memory sort");
+
+  const auto bySize = readAll(index, DirectoryIndex::SortKey::Size, false, 100);
+  const auto byModified = readAll(index, DirectoryIndex::SortKey::Modified, true, 100);
+  bool sizeSorted = true;
+  bool modifiedSorted = true;
+  for (size_t i = FOLDERS + 1; i < bySize.size(); i++) {
+    sizeSorted &= bySize[i - 1].size <= bySize[i].size;
+    modifiedSorted &= byModified[i - 1].modified >= byModified[i].modified;
+  }
+  check(sizeSorted && bySize.size() == byName.size(), "size order");
+  check(modifiedSorted && byModified.size() == byName.size(), "modified order");
+  index.close();
+
+  // What the listing API does per request: open the index, then either answer 304 or render one page
+  std::string response;
+  response.reserve(32 * 1024);
+  double pageMs = 0;
+  double notModifiedMs = 0;
+  const size_t pageHeap = heap::peakDuring([&] {
+    auto start = Clock::now();
+    DirectoryIndex page;
+    check(page.open(dir, VISIBLE), "reopen index");
+    notModifiedMs = msSince(start);
+    start = Clock::now();
+    page.read(DirectoryIndex::SortKey::Modified, true, 5000, 100, [&](const DirectoryIndex::Entry& e) {
+      response += "{\"name\":\"" + e.name + "\",\"size\":" + std::to_string(e.size) +
+                  ",\"modified\":" + std::to_string(DirectoryIndex::fatToUnixTime(e.modified)) + "},";
+    });
+    pageMs = msSince(start) + notModifiedMs;
+  });
+  check(!response.empty(), "page rendered");
+  check(pageHeap < 16 * 1024, "page served in little memory (" + std::to_string(pageHeap) + " bytes)");
+
+  if (bench) {
+    std::cout << FILES + FOLDERS << " entries: index built in " << buildMs << " ms, peak heap " << buildHeap
+              << " bytes" << std::endl;
+    std::cout << "cached index opened (304 path) in " << notModifiedMs << " ms" << std::endl;
+    std::cout << "100-entry page by date in " << pageMs << " ms, peak heap " << pageHeap << " bytes (response "
+              << response.size() << " bytes)" << std::endl;
+  }
+}
+
+void testValidation() {
+  const std::string dir = "/validated";
+  Storage.mkdir(dir.c_str());
+  makeFile(dir + "/a.epub", 10, 1700000000);
+  makeFile(dir + "/b.epub", 20, 1700000000);
+
+  DirectoryIndex index;
+  check(index.open(dir, VISIBLE) && index.size() == 2, "index built without validation");
+  const uint32_t generation = index.getGeneration();
+
+  // Entries the filter leaves out don't make the index stale
+  makeFile(dir + "/.metadata", 5, 1700000000);
+  check(index.open(dir, VISIBLE, true) && index.getGeneration() == generation, "filtered entry ignored");
+
+  // Once validated, an index is trusted until it is invalidated
+  makeFile(dir + "/c.epub", 30, 1700000000);
+  check(index.open(dir, VISIBLE, true) && index.size() == 2, "validated index not rescanned");
+  DirectoryIndex::invalidate(dir);
+  check(index.open(dir, VISIBLE, true) && index.size() == 3, "invalidated index rebuilt");
+  index.close();
+
+  // An entry added behind the index's back
+  const std::string added = "/added";
+  Storage.mkdir(added.c_str());
+  makeFile(added + "/a.epub", 10, 1700000000);
+  check(index.open(added, VISIBLE) && index.size() == 1, "index added directory");
+  makeFile(added + "/b.epub", 10, 1700000000);
+  check(index.open(added, VISIBLE, true) && index.size() == 2, "added entry found by validation");
+
+  // Same entries, one rewritten: only its modify time differs
+  const std::string retimed = "/retimed";
+  Storage.mkdir(retimed.c_str());
+  makeFile(retimed + "/a.epub", 10, 1700000000);
+  makeFile(retimed + "/b.epub", 10, 1700000000);
+  check(index.open(retimed, VISIBLE), "index retimed directory");
+  const uint32_t retimedGeneration = index.getGeneration();
+  makeFile(retimed + "/b.epub", 10, 1700086400);
+  check(index.open(retimed, VISIBLE, true) && index.getGeneration() != retimedGeneration,
+        "changed modify time found by validation");
+  const auto entries = readAll(index, DirectoryIndex::SortKey::Name, false);
+  check(entries.size() == 2 && DirectoryIndex::fatToUnixTime(entries[1].modified) == 1700086400 - timezone,
+        "rebuilt index has the new modify time");
+  index.close();
+
+  check(!index.open("/missing", VISIBLE, true) && index.size() == 0, "missing directory lists nothing");
+}
+
+void testFind() {
+  const std::string dir = "/find";
+  Storage.mkdir(dir.c_str());
+  Storage.mkdir("/find/Series 9");
+  Storage.mkdir("/find/Series 10");
+  Storage.mkdir("/find/Notes");
+  makeFile(dir + "/Notes.epub", 1, 1700000000);
+  makeFile(dir + "/file7.epub", 1, 1700000000);
+  makeFile(dir + "/file07.epub", 1, 1700000000);
+  makeFile(dir + "/file007.epub", 1, 1700000000);
+  makeFile(dir + "/Zebra.epub", 1, 1700000000);
+
+  DirectoryIndex index;
+  check(index.open(dir, VISIBLE), "index find directory");
+  const auto all = readAll(index, DirectoryIndex::SortKey::Name, false);
+  bool found = true;
+  for (uint32_t i = 0; i < all.size(); i++) {
+    found &= index.find(all[i].name, all[i].isDirectory) == i;
+  }
+  check(found, "every entry found at its position");
+  check(index.find("Notes", true) < index.folderCount(), "folder found among folders");
+  check(index.find("Notes", false) == index.size(), "folder isn't found as a file");
+  check(index.find("Notes.epub", true) == index.size(), "file isn't found as a folder");
+  check(index.find("file7.epub", false) != index.find("file07.epub", false), "names sorting as equal told apart");
+  check(index.find("FILE7.epub", false) == index.size(), "lookup is exact");
+  check(index.find("missing.epub", false) == index.size(), "missing entry");
+  check(index.find("", false) == index.size(), "empty name");
+  index.close();
+  check(index.find("Zebra.epub", false) == index.size(), "closed index finds nothing");
+}
+
+void testLeadingFiles() {
+  const std::string dir = "/leading";
+  Storage.mkdir(dir.c_str());
+  Storage.mkdir("/leading/Comics");
+  makeFile(dir + "/Atlas.pdf", 50, 1700000900);
+  makeFile(dir + "/Book 2.epub", 300, 1700000000);
+  makeFile(dir + "/book 10.EPUB", 100, 1700000600);
+  makeFile(dir + "/notes.txt", 400, 1600000000);
+
+  DirectoryIndex index;
+  check(index.open(dir, EPUBS_FIRST), "index with leading files");
+  const auto byName = names(readAll(index, DirectoryIndex::SortKey::Name, false));
+  check(byName == std::vector<std::string>{"Comics", "Book 2.epub", "book 10.EPUB", "Atlas.pdf", "notes.txt"},
+        "leading files after folders, ahead of the rest");
+  const auto byNameDesc = names(readAll(index, DirectoryIndex::SortKey::Name, true, 2));
+  check(byNameDesc == std::vector<std::string>{"Comics", "book 10.EPUB", "Book 2.epub", "notes.txt", "Atlas.pdf"},
+        "descending reverses within each group");
+  const auto bySize = names(readAll(index, DirectoryIndex::SortKey::Size, false));
+  check(bySize == std::vector<std::string>{"Comics", "book 10.EPUB", "Book 2.epub", "Atlas.pdf", "notes.txt"},
+        "size order within each group");
+  const auto byModified = names(readAll(index, DirectoryIndex::SortKey::Modified, true, 3));
+  check(byModified == std::vector<std::string>{"Comics", "book 10.EPUB", "Book 2.epub", "Atlas.pdf", "notes.txt"},
+        "newest first within each group");
+
+  const auto all = readAll(index, DirectoryIndex::SortKey::Name, false);
+  bool found = true;
+  for (uint32_t i = 0; i < all.size(); i++) {
+    found &= index.find(all[i].name, all[i].isDirectory) == i;
+  }
+  check(found, "entries of every group found at their position");
+  index.close();
+
+  check(index.open(dir, VISIBLE), "index without leading files");
+  check(names(readAll(index, DirectoryIndex::SortKey::Name, false)) ==
+            std::vector<std::string>{"Comics", "Atlas.pdf", "Book 2.epub", "book 10.EPUB", "notes.txt"},
+        "one file group without a leading filter");
+  index.close();
+}
+
+// What the on-device browser does when a folder opens, before and after the index: the old code listed the folder
+// into strings and sorted them every time; now the index is opened (built the first time, validated once per boot)
+// and only the visible window is read.
+void testBrowserOpen() {
+  const auto books = [](const char* name, bool isDirectory) {
+    const size_t length = strlen(name);
+    return isDirectory || (length > 5 && strcmp(name + length - 5, ".epub") == 0);
+  };
+  const DirectoryIndex::Filter browser{2, books};
+  constexpr uint32_t WINDOW = 32;
+
+  for (const int files : {100, 1000, 10000}) {
+    const std::string dir = "/browse" + std::to_string(files);
+    Storage.mkdir(dir.c_str());
+    srand(files);
+    for (int i = 0; i < files; i++) {
+      const std::string name = "Book " + std::to_string(rand() % 100000) + " - " + std::to_string(i);
+      makeFile(dir + "/" + name + (i % 10 == 0 ? ".jpg" : ".epub"), 100, 1700000000);
+    }
+
+    std::vector<std::string> listed;
+    double listMs = 0;
+    const size_t listHeap = heap::peakDuring([&] {
+      const auto start = Clock::now();
+      FsFile root = Storage.open(dir.c_str());
+      char name[500];
+      for (auto file = root.openNextFile(); file; file = root.openNextFile()) {
+        file.getName(name, sizeof(name));
+        if (books(name, file.isDirectory())) listed.emplace_back(name);
+        file.close();
+      }
+      root.close();
+      std::sort(listed.begin(), listed.end(), less);
+      listMs = msSince(start);
+    });
+
+    DirectoryIndex index;
+    double buildMs = 0;
+    double validateMs = 0;
+    double reopenMs = 0;
+    const size_t buildHeap = heap::peakDuring([&] {
+      const auto start = Clock::now();
+      check(index.open(dir, browser), "build browser index");
+      buildMs = msSince(start);
+    });
+    const size_t validateHeap = heap::peakDuring([&] {
+      const auto start = Clock::now();
+      check(index.open(dir, browser, true), "validate browser index");
+      validateMs = msSince(start);
+    });
+    std::vector<std::string> window;
+    const size_t reopenHeap = heap::peakDuring([&] {
+      const auto start = Clock::now();
+      check(index.open(dir, browser, true), "reopen browser index");
+      index.read(DirectoryIndex::SortKey::Name, false, index.size() / 2, WINDOW,
+                 [&](const DirectoryIndex::Entry& e) { window.push_back(e.name); });
+      reopenMs = msSince(start);
+    });
+    check(index.size() == listed.size(), "index lists what the browser listed");
+    const auto windowStart = listed.begin() + static_cast<long>(listed.size() / 2);
+    const auto windowEnd = windowStart + std::min<long>(WINDOW, listed.end() - windowStart);
+    check(window == std::vector<std::string>(windowStart, windowEnd), "window matches the sorted list");
+    check(validateHeap < 4 * 1024, "validation in bounded memory (" + std::to_string(validateHeap) + " bytes)");
+    check(reopenHeap < 4 * 1024, "window read in bounded memory (" + std::to_string(reopenHeap) + " bytes)");
+    index.close();
+
+    if (bench) {
+      printf("%5d files: sorted list %7.2f ms %7zu B | build %7.2f ms %6zu B | validate %6.2f ms %5zu B | "
+             "validated reopen + window %5.3f ms %5zu B\n",
+             files, listMs, listHeap, buildMs, buildHeap, validateMs, validateHeap, reopenMs, reopenHeap);
+    }
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--bench") bench = true;
+  }
+  tzset();
+
+  char scratch[] = "/tmp/directory_index_XXXXXX";
+  if (!mkdtemp(scratch)) {
+    std::cerr << "Failed to create scratch directory" << std::endl;
+    return 1;
+  }
+  Storage.setRoot(scratch);
+  Storage.mkdir("/.crosspoint");
+
+  testNameOrder();
+  testFatTime();
+  testSmallDirectory();
+  testLargeDirectory();
+  testValidation();
+  testFind();
+  testLeadingFiles();
+  testBrowserOpen();
+
+  removeTree(scratch);
+
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All directory index tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+// Minimal host stand-in for the Arduino core, enough for GfxRenderer and its font dependencies.
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+inline unsigned long millis() {
+  using namespace std::chrono;
+  return static_cast<unsigned long>(duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+inline unsigned long micros() {
+  using namespace std::chrono;
+  return static_cast<unsigned long>(duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+inline void delay(unsigned long) {}
+
+inline void yield() {}
+
+// Heap checks before large allocations; the host always has room
+struct HostEsp {
+  uint32_t getFreeHeap() const { return 320 * 1024; }
+};
+inline HostEsp ESP;
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <cstdint>
+#include <cstring>
+
+// Host framebuffer stand-in for lib/hal/HalDisplay.h. Drawing lands in a plain RAM buffer, refreshes are counted
+// instead of driving a panel, and the grayscale planes are kept so tests can compare what would be sent.
+class HalDisplay {
+ public:
+  enum RefreshMode { FULL_REFRESH, HALF_REFRESH, FAST_REFRESH };
+
+  static constexpr uint16_t DISPLAY_WIDTH = 800;
+  static constexpr uint16_t DISPLAY_HEIGHT = 480;
+  static constexpr uint16_t DISPLAY_WIDTH_BYTES = DISPLAY_WIDTH / 8;
+  static constexpr uint32_t BUFFER_SIZE = DISPLAY_WIDTH_BYTES * DISPLAY_HEIGHT;
+
+  void begin() {}
+
+  void clearScreen(const uint8_t color = 0xFF) const { memset(frameBuffer, color, BUFFER_SIZE); }
+  void drawImage(const uint8_t*, uint16_t, uint16_t, uint16_t, uint16_t, bool = false) const {}
+  void drawImageTransparent(const uint8_t*, uint16_t, uint16_t, uint16_t, uint16_t, bool = false) const {}
+
+  void displayBuffer(RefreshMode = FAST_REFRESH, bool = false) {
+    memcpy(shownBw, frameBuffer, BUFFER_SIZE);
+    refreshCount++;
+  }
+  void displayGrayBuffer(bool = false) { grayRefreshCount++; }
+
+  uint8_t* getFrameBuffer() const { return frameBuffer; }
+
+  void copyGrayscaleLsbBuffers(const uint8_t* lsbBuffer) { memcpy(lsb, lsbBuffer, BUFFER_SIZE); }
+  void copyGrayscaleMsbBuffers(const uint8_t* msbBuffer) { memcpy(msb, msbBuffer, BUFFER_SIZE); }
+  void cleanupGrayscaleBuffers(const uint8_t*) {}
+
+  int refreshCount = 0;
+  int grayRefreshCount = 0;
+  uint8_t shownBw[BUFFER_SIZE] = {};
+  uint8_t lsb[BUFFER_SIZE] = {};
+  uint8_t msb[BUFFER_SIZE] = {};
+
+ private:
+  mutable uint8_t frameBuffer[BUFFER_SIZE] = {};
+};
@@ -0,0 +1,206 @@
+#pragma once
+
+// Host stand-in for lib/hal/HalStorage.h backed by stdio. SD card paths ("/.crosspoint/...") are resolved under a
+// scratch directory set with Storage.setRoot(), and FAT modify stamps are derived from the host file's mtime.
+// HalStorageSim slows down or fails writes to model a real SD card.
+#include <Arduino.h>
+#include <Print.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <thread>
+
+struct HalStorageSim {
+  // Added to every write() call, plus a per-KiB cost, to model SD card latency and bandwidth
+  static inline std::atomic<unsigned> writeLatencyUs{0};
+  static inline std::atomic<unsigned> writeUsPerKiB{0};
+  // Writes stop short once this many bytes have been written in total (disk full); 0 disables
+  static inline std::atomic<size_t> writeLimit{0};
+  static inline std::atomic<size_t> bytesWritten{0};
+
+  static void reset() {
+    writeLatencyUs = 0;
+    writeUsPerKiB = 0;
+    writeLimit = 0;
+    bytesWritten = 0;
+  }
+
+  // Returns how many of `count` bytes may be written
+  static size_t beginWrite(const size_t count) {
+    const unsigned delayUs = writeLatencyUs + static_cast<unsigned>(count * writeUsPerKiB / 1024);
+    if (delayUs > 0) std::this_thread::sleep_for(std::chrono::microseconds(delayUs));
+    size_t allowed = count;
+    if (writeLimit > 0) {
+      const size_t used = bytesWritten;
+      allowed = used >= writeLimit ? 0 : std::min(count, writeLimit - used);
+    }
+    bytesWritten += allowed;
+    return allowed;
+  }
+};
+
+class HalFile : public Print {
+ public:
+  HalFile() = default;
+  HalFile(const HalFile&) = delete;
+  HalFile& operator=(const HalFile&) = delete;
+  HalFile(HalFile&& other) noexcept : fp(other.fp), dir(other.dir), hostPath(std::move(other.hostPath)) {
+    other.fp = nullptr;
+    other.dir = nullptr;
+  }
+  HalFile& operator=(HalFile&& other) noexcept {
+    if (this != &other) {
+      close();
+      fp = other.fp;
+      dir = other.dir;
+      hostPath = std::move(other.hostPath);
+      other.fp = nullptr;
+      other.dir = nullptr;
+    }
+    return *this;
+  }
+  ~HalFile() override { close(); }
+
+  bool open(const std::string& path, const char* mode) {
+    close();
+    fp = std::fopen(path.c_str(), mode);
+    hostPath = path;
+    return fp != nullptr;
+  }
+
+  // Files are opened read-only, directories for listing
+  bool openAny(const std::string& path) {
+    struct stat st = {};
+    if (stat(path.c_str(), &st) != 0) return false;
+    if (!S_ISDIR(st.st_mode)) return open(path, "rb");
+    close();
+    dir = opendir(path.c_str());
+    hostPath = path;
+    return dir != nullptr;
+  }
+
+  bool isDirectory() const { return dir != nullptr; }
+  void rewindDirectory() {
+    if (dir) rewinddir(dir);
+  }
+  HalFile openNextFile() {
+    HalFile next;
+    while (dir) {
+      const dirent* entry = readdir(dir);
+      if (!entry) break;
+      if (std::strcmp(entry->d_name, ".") == 0 || std::strcmp(entry->d_name, "..") == 0) continue;
+      if (next.openAny(hostPath + "/" + entry->d_name)) break;
+    }
+    return next;
+  }
+  size_t getName(char* name, const size_t len) const {
+    const std::string base = hostPath.substr(hostPath.find_last_of('/') + 1);
+    const size_t n = std::min(base.size(), len - 1);
+    std::memcpy(name, base.data(), n);
+    name[n] = '\0';
+    return n;
+  }
+
+  int read(void* buf, const size_t count) { return fp ? static_cast<int>(std::fread(buf, 1, count, fp)) : -1; }
+  int read() { return fp ? std::fgetc(fp) : -1; }
+  size_t write(const void* buf, const size_t count) {
+    return fp ? std::fwrite(buf, 1, HalStorageSim::beginWrite(count), fp) : 0;
+  }
+  size_t write(const uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* buf, const size_t count) override { return write(static_cast<const void*>(buf), count); }
+  bool seek(const size_t pos) { return fp && std::fseek(fp, static_cast<long>(pos), SEEK_SET) == 0; }
+  bool seekSet(const size_t pos) { return seek(pos); }
+  bool seekCur(const int64_t offset) { return fp && std::fseek(fp, static_cast<long>(offset), SEEK_CUR) == 0; }
+  size_t position() const { return fp ? static_cast<size_t>(std::ftell(fp)) : 0; }
+  int available() const { return fp ? static_cast<int>(fileSize() - position()) : 0; }
+  size_t size() const { return fileSize(); }
+  size_t fileSize() const {
+    if (!fp) return 0;
+    std::fflush(fp);
+    struct stat st = {};
+    return fstat(fileno(fp), &st) == 0 ? static_cast<size_t>(st.st_size) : 0;
+  }
+
+  bool getModifyDateTime(uint16_t* pdate, uint16_t* ptime) const {
+    struct stat st = {};
+    if (!isOpen() || stat(hostPath.c_str(), &st) != 0) return false;
+    std::tm tm = {};
+    localtime_r(&st.st_mtime, &tm);
+    *pdate = static_cast<uint16_t>((tm.tm_year - 80) << 9 | (tm.tm_mon + 1) << 5 | tm.tm_mday);
+    *ptime = static_cast<uint16_t>(tm.tm_hour << 11 | tm.tm_min << 5 | tm.tm_sec / 2);
+    return true;
+  }
+
+  void flush() override {
+    if (fp) std::fflush(fp);
+  }
+  bool close() {
+    if (fp) std::fclose(fp);
+    if (dir) closedir(dir);
+    fp = nullptr;
+    dir = nullptr;
+    return true;
+  }
+  bool isOpen() const { return fp != nullptr || dir != nullptr; }
+  explicit operator bool() const { return isOpen(); }
+
+ private:
+  std::FILE* fp = nullptr;
+  DIR* dir = nullptr;
+  std::string hostPath;
+};
+
+using FsFile = HalFile;
+
+class HalStorage {
+ public:
+  void setRoot(std::string dir) { root = std::move(dir); }
+  std::string hostPath(const std::string& path) const { return root + path; }
+
+  bool exists(const char* path) const {
+    struct stat st = {};
+    return stat(hostPath(path).c_str(), &st) == 0;
+  }
+  bool remove(const char* path) const { return std::remove(hostPath(path).c_str()) == 0; }
+  bool mkdir(const char* path) const { return ::mkdir(hostPath(path).c_str(), 0755) == 0; }
+  bool removeDir(const char* path) const { return std::system(("rm -rf '" + hostPath(path) + "'").c_str()) == 0; }
+  // O_RDWR opens an existing file for update; anything else opens read-only
+  HalFile open(const char* path, const int oflag = O_RDONLY) const {
+    HalFile file;
+    if (oflag & O_RDWR) {
+      file.open(hostPath(path), "r+b");
+    } else {
+      file.openAny(hostPath(path));
+    }
+    return file;
+  }
+  bool rename(const char* oldPath, const char* newPath) const {
+    return std::rename(hostPath(oldPath).c_str(), hostPath(newPath).c_str()) == 0;
+  }
+
+  bool openFileForRead(const char*, const std::string& path, HalFile& file) const {
+    return file.open(hostPath(path), "rb");
+  }
+  bool openFileForWrite(const char*, const std::string& path, HalFile& file) const {
+    return file.open(hostPath(path), "wb");
+  }
+
+  static HalStorage& getInstance() {
+    static HalStorage instance;
+    return instance;
+  }
+
+ private:
+  std::string root = ".";
+};
+
+#define Storage HalStorage::getInstance()
@@ -0,0 +1,6 @@
+#pragma once
+
+// Host stand-in for lib/Logging: logging is compiled out.
+#define LOG_DBG(origin, format, ...)
+#define LOG_ERR(origin, format, ...)
+#define LOG_INF(origin, format, ...)
@@ -0,0 +1,17 @@
+#pragma once
+
+// Minimal host stand-in for the Arduino Print interface, enough for the streaming parsers.
+#include <cstddef>
+#include <cstdint>
+
+class Print {
+ public:
+  virtual ~Print() = default;
+  virtual size_t write(uint8_t) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (size-- && write(*buffer++)) n++;
+    return n;
+  }
+  virtual void flush() {}
+};
@@ -0,0 +1,17 @@
+#pragma once
+
+// Minimal host stand-in for the Arduino String, enough for FsHelpers and MD5Builder.
+#include <cstddef>
+#include <string>
+
+class String {
+ public:
+  String() = default;
+  String(const char* text) : value(text ? text : "") {}
+
+  const char* c_str() const { return value.c_str(); }
+  size_t length() const { return value.size(); }
+
+ private:
+  std::string value;
+};
@@ -0,0 +1,17 @@
+#pragma once
+
+// Host stand-in for the ESP ROM CRC routines. esp_rom_crc32_le() follows zlib's crc32(): pass the previous result
+// (0 to start) to continue a running CRC.
+#include <cstddef>
+#include <cstdint>
+
+inline uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, const size_t len) {
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= buf[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+    }
+  }
+  return ~crc;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+// Host stand-in for the subset of FreeRTOS used by firmware code under test, backed by std::thread. Ticks are
+// milliseconds; queues, semaphores and tasks behave like their FreeRTOS counterparts for a single process.
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using TickType_t = uint32_t;
+using BaseType_t = int;
+using UBaseType_t = unsigned;
+
+#define portMAX_DELAY 0xffffffffu
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define pdMS_TO_TICKS(ms) (static_cast<TickType_t>(ms))
+
+namespace host_rtos {
+
+// Fixed-size item queue; also backs semaphores (zero-size items)
+struct Queue {
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<std::vector<uint8_t>> items;
+  size_t capacity;
+  size_t itemSize;
+
+  Queue(const size_t capacity, const size_t itemSize) : capacity(capacity), itemSize(itemSize) {}
+
+  template <typename Pred>
+  bool waitFor(std::unique_lock<std::mutex>& lock, const TickType_t ticks, Pred pred) {
+    if (ticks == portMAX_DELAY) {
+      changed.wait(lock, pred);
+      return true;
+    }
+    return changed.wait_for(lock, std::chrono::milliseconds(ticks), pred);
+  }
+
+  bool send(const void* item, const TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!waitFor(lock, ticks, [this] { return items.size() < capacity; })) return false;
+    const auto* bytes = static_cast<const uint8_t*>(item);
+    items.emplace_back(bytes, bytes + itemSize);
+    changed.notify_all();
+    return true;
+  }
+
+  bool receive(void* out, const TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!waitFor(lock, ticks, [this] { return !items.empty(); })) return false;
+    if (itemSize > 0) std::memcpy(out, items.front().data(), itemSize);
+    items.pop_front();
+    changed.notify_all();
+    return true;
+  }
+};
+
+}  // namespace host_rtos
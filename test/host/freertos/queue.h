@@ -0,0 +1,20 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+using QueueHandle_t = host_rtos::Queue*;
+
+inline QueueHandle_t xQueueCreate(const UBaseType_t length, const UBaseType_t itemSize) {
+  return new host_rtos::Queue(length, itemSize);
+}
+inline BaseType_t xQueueSend(QueueHandle_t queue, const void* item, const TickType_t ticks) {
+  return queue->send(item, ticks) ? pdTRUE : pdFALSE;
+}
+inline BaseType_t xQueueReceive(QueueHandle_t queue, void* out, const TickType_t ticks) {
+  return queue->receive(out, ticks) ? pdTRUE : pdFALSE;
+}
+inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  std::lock_guard<std::mutex> lock(queue->mutex);
+  return static_cast<UBaseType_t>(queue->items.size());
+}
+inline void vQueueDelete(QueueHandle_t queue) { delete queue; }
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "queue.h"
+
+using SemaphoreHandle_t = host_rtos::Queue*;
+
+inline SemaphoreHandle_t xSemaphoreCreateBinary() { return new host_rtos::Queue(1, 0); }
+inline SemaphoreHandle_t xSemaphoreCreateMutex() {
+  auto* mutex = new host_rtos::Queue(1, 0);
+  mutex->send(nullptr, 0);  // Mutexes start available
+  return mutex;
+}
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, const TickType_t ticks) {
+  return semaphore->receive(nullptr, ticks) ? pdTRUE : pdFALSE;
+}
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  return semaphore->send(nullptr, 0) ? pdTRUE : pdFALSE;
+}
+inline void vSemaphoreDelete(SemaphoreHandle_t semaphore) { delete semaphore; }
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <pthread.h>
+
+#include "FreeRTOS.h"
+
+using TaskHandle_t = void*;
+using TaskFunction_t = void (*)(void*);
+
+// Tasks run on detached threads; stack size and priority are ignored
+inline BaseType_t xTaskCreate(TaskFunction_t function, const char*, uint32_t, void* param, UBaseType_t,
+                              TaskHandle_t* handle) {
+  std::thread thread(function, param);
+  if (handle) *handle = reinterpret_cast<TaskHandle_t>(thread.native_handle());
+  thread.detach();
+  return pdPASS;
+}
+
+// Only self-deletion is supported, which is how firmware tasks end
+inline void vTaskDelete(TaskHandle_t) { pthread_exit(nullptr); }
+
+inline void vTaskDelay(const TickType_t ticks) { std::this_thread::sleep_for(std::chrono::milliseconds(ticks)); }
@@ -0,0 +1,287 @@
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "lib/GfxRenderer/ImageDownscaler.h"
+
+namespace {
+
+using Format = ImageDownscaler::OutputFormat;
+using Dither = ImageDownscaler::Dither;
+using Source = ImageDownscaler::SourceFormat;
+
+int failures = 0;
+
+void check(const bool condition, const std::string& message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << std::endl;
+    failures++;
+  }
+}
+
+struct Image {
+  int width = 0;
+  int height = 0;
+  std::vector<uint8_t> pixels;  // one packed row after another
+};
+
+// Deterministic test pattern: diagonal gradient with a checkerboard and a hard edge, so box filtering, edge
+// weights and dithering all leave a fingerprint in the output.
+Image makePattern(const int width, const int height) {
+  Image img;
+  img.width = width;
+  img.height = height;
+  img.pixels.resize(static_cast<size_t>(width) * height);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      int value = (x * 255 / (width > 1 ? width - 1 : 1) + y * 255 / (height > 1 ? height - 1 : 1)) / 2;
+      if (((x / 7) + (y / 5)) % 2 == 0) value = 255 - value;
+      if (x > width * 2 / 3) value = (y & 1) ? 0 : 255;
+      img.pixels[static_cast<size_t>(y) * width + x] = static_cast<uint8_t>(value);
+    }
+  }
+  return img;
+}
+
+Image scale(const Image& src, const int dstWidth, const int dstHeight, const Format format, const Dither dither,
+            const Source sourceFormat = Source::Gray8, const std::vector<uint8_t>* rawRows = nullptr,
+            const int rawRowBytes = 0) {
+  Image out;
+  out.width = dstWidth;
+  out.height = dstHeight;
+  ImageDownscaler scaler(src.width, src.height, dstWidth, dstHeight, format, dither);
+  const int rowBytes = ImageDownscaler::packedRowBytes(dstWidth, format);
+  out.pixels.reserve(static_cast<size_t>(rowBytes) * dstHeight);
+  int expectedY = 0;
+  const bool ok = scaler.begin([&](const uint8_t* row, const int y) {
+    check(y == expectedY++, "rows must be emitted in order");
+    out.pixels.insert(out.pixels.end(), row, row + rowBytes);
+  });
+  check(ok, "begin() failed");
+  for (int y = 0; y < src.height; y++) {
+    const uint8_t* row = rawRows ? rawRows->data() + static_cast<size_t>(y) * rawRowBytes
+                                 : src.pixels.data() + static_cast<size_t>(y) * src.width;
+    check(scaler.pushRow(row, sourceFormat), "pushRow() failed");
+  }
+  check(!scaler.pushRow(src.pixels.data(), Source::Gray8), "pushRow() past the last source row must fail");
+  check(scaler.isComplete(), "all output rows must be emitted");
+  check(static_cast<int>(out.pixels.size()) == rowBytes * dstHeight, "unexpected output size");
+  return out;
+}
+
+// Floating point area-average reference
+double referencePixel(const Image& src, const int dstWidth, const int dstHeight, const int ox, const int oy) {
+  const double sx = static_cast<double>(src.width) / dstWidth;
+  const double sy = static_cast<double>(src.height) / dstHeight;
+  const double x0 = ox * sx, x1 = (ox + 1) * sx;
+  const double y0 = oy * sy, y1 = (oy + 1) * sy;
+  double sum = 0, area = 0;
+  for (int y = static_cast<int>(y0); y < src.height && y < y1; y++) {
+    const double wy = std::min<double>(y + 1, y1) - std::max<double>(y, y0);
+    for (int x = static_cast<int>(x0); x < src.width && x < x1; x++) {
+      const double wx = std::min<double>(x + 1, x1) - std::max<double>(x, x0);
+      sum += src.pixels[static_cast<size_t>(y) * src.width + x] * wx * wy;
+      area += wx * wy;
+    }
+  }
+  return sum / area;
+}
+
+uint32_t fnv1a(const std::vector<uint8_t>& data) {
+  uint32_t hash = 2166136261u;
+  for (const uint8_t b : data) {
+    hash ^= b;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+void testUniformImagesStayUniform() {
+  const int sizes[][4] = {{640, 960, 480, 800}, {1000, 1000, 333, 777}, {37, 53, 17, 29}, {100, 80, 240, 190}};
+  for (const auto& s : sizes) {
+    for (const int value : {0, 1, 85, 128, 254, 255}) {
+      Image src;
+      src.width = s[0];
+      src.height = s[1];
+      src.pixels.assign(static_cast<size_t>(s[0]) * s[1], static_cast<uint8_t>(value));
+      const Image out = scale(src, s[2], s[3], Format::EightBit, Dither::None);
+      bool uniform = true;
+      for (const uint8_t p : out.pixels) uniform &= p == value;
+      check(uniform, "uniform " + std::to_string(value) + " image changed value at " + std::to_string(s[0]) + "x" +
+                         std::to_string(s[1]) + " -> " + std::to_string(s[2]) + "x" + std::to_string(s[3]));
+    }
+  }
+}
+
+void testMatchesFloatReference() {
+  const int sizes[][4] = {{1200, 1600, 480, 800}, {800, 600, 123, 97}, {64, 64, 32, 32}, {50, 70, 120, 150}};
+  for (const auto& s : sizes) {
+    const Image src = makePattern(s[0], s[1]);
+    const Image out = scale(src, s[2], s[3], Format::EightBit, Dither::None);
+    double maxError = 0;
+    for (int y = 0; y < s[3]; y++) {
+      for (int x = 0; x < s[2]; x++) {
+        const double ref = referencePixel(src, s[2], s[3], x, y);
+        maxError = std::max(maxError, std::fabs(ref - out.pixels[static_cast<size_t>(y) * s[2] + x]));
+      }
+    }
+    check(maxError <= 1.0, "area average deviates from reference by " + std::to_string(maxError) + " at " +
+                               std::to_string(s[0]) + "x" + std::to_string(s[1]) + " -> " + std::to_string(s[2]) +
+                               "x" + std::to_string(s[3]));
+  }
+}
+
+void testIdentityIsLossless() {
+  const Image src = makePattern(97, 31);
+  const Image out = scale(src, 97, 31, Format::EightBit, Dither::None);
+  check(out.pixels == src.pixels, "1:1 scaling must be lossless");
+}
+
+void testSourceFormats() {
+  const Image src = makePattern(45, 23);
+  const Image expected = scale(src, 20, 10, Format::EightBit, Dither::None);
+
+  std::vector<uint8_t> rgb, bgra;
+  for (const uint8_t p : src.pixels) {
+    rgb.insert(rgb.end(), {p, p, p});
+    bgra.insert(bgra.end(), {p, p, p, 0x7F});
+  }
+  const Image fromRgb = scale(src, 20, 10, Format::EightBit, Dither::None, Source::Rgb888, &rgb, 45 * 3);
+  const Image fromBgra = scale(src, 20, 10, Format::EightBit, Dither::None, Source::Bgra8888, &bgra, 45 * 4);
+  // Gray -> RGB -> luma loses at most one level per pixel
+  for (size_t i = 0; i < expected.pixels.size(); i++) {
+    check(std::abs(fromRgb.pixels[i] - expected.pixels[i]) <= 1, "Rgb888 source mismatch");
+    check(std::abs(fromBgra.pixels[i] - expected.pixels[i]) <= 1, "Bgra8888 source mismatch");
+  }
+
+  // 1-bit source: white columns on the left half only
+  Image bw;
+  bw.width = 16;
+  bw.height = 4;
+  bw.pixels.assign(64, 0);
+  std::vector<uint8_t> rows(4 * 2, 0);
+  for (int y = 0; y < 4; y++) rows[y * 2] = 0xFF;
+  const Image fromBits = scale(bw, 2, 1, Format::EightBit, Dither::None, Source::Gray1, &rows, 2);
+  check(fromBits.pixels[0] == 255 && fromBits.pixels[1] == 0, "Gray1 source decoded incorrectly");
+}
+
+// Golden fingerprints of the quantized/dithered output. Update only after inspecting the images visually
+// (write them out with --dump <dir>) when the filter or dithering is changed on purpose.
+struct GoldenCase {
+  const char* name;
+  int srcWidth, srcHeight, dstWidth, dstHeight;
+  Format format;
+  Dither dither;
+  uint32_t hash;
+};
+
+const GoldenCase kGoldenCases[] = {
+    {"cover_2bit_atkinson", 600, 900, 480, 720, Format::TwoBit, Dither::Atkinson, 0x8ca09ef7u},
+    {"cover_2bit_fs", 600, 900, 480, 720, Format::TwoBit, Dither::FloydSteinberg, 0xaf4470abu},
+    {"cover_2bit_plain", 600, 900, 480, 720, Format::TwoBit, Dither::None, 0x3a05b4a9u},
+    {"thumb_1bit_atkinson", 600, 900, 144, 240, Format::OneBit, Dither::Atkinson, 0x3ad4827cu},
+    {"thumb_1bit_noise", 600, 900, 144, 240, Format::OneBit, Dither::None, 0x96bd54c8u},
+    {"upscale_8bit", 90, 60, 200, 133, Format::EightBit, Dither::None, 0xf646d4c5u},
+};
+
+void writePgm(const std::string& path, const Image& img, const Format format) {
+  FILE* f = fopen(path.c_str(), "wb");
+  if (!f) return;
+  fprintf(f, "P5\n%d %d\n255\n", img.width, img.height);
+  const int rowBytes = ImageDownscaler::packedRowBytes(img.width, format);
+  for (int y = 0; y < img.height; y++) {
+    for (int x = 0; x < img.width; x++) {
+      const uint8_t* row = img.pixels.data() + static_cast<size_t>(y) * rowBytes;
+      uint8_t v = row[x];
+      if (format == Format::OneBit) v = ((row[x >> 3] >> (7 - (x & 7))) & 1) * 255;
+      if (format == Format::TwoBit) v = ((row[x >> 2] >> (6 - ((x & 3) * 2))) & 3) * 85;
+      fputc(v, f);
+    }
+  }
+  fclose(f);
+}
+
+void testGoldenImages(const char* dumpDir, const bool update) {
+  for (const auto& c : kGoldenCases) {
+    const Image src = makePattern(c.srcWidth, c.srcHeight);
+    const Image out = scale(src, c.dstWidth, c.dstHeight, c.format, c.dither);
+    const uint32_t hash = fnv1a(out.pixels);
+    if (dumpDir) writePgm(std::string(dumpDir) + "/" + c.name + ".pgm", out, c.format);
+    if (update) {
+      std::cout << "    {\"" << c.name << "\", ..., 0x" << std::hex << std::setw(8) << std::setfill('0') << hash
+                << std::dec << "u}," << std::endl;
+      continue;
+    }
+    std::ostringstream msg;
+    msg << "golden image " << c.name << " changed (hash 0x" << std::hex << hash << ")";
+    check(hash == c.hash, msg.str());
+  }
+}
+
+void runBenchmark() {
+  constexpr int srcWidth = 1600;
+  constexpr int srcHeight = 2400;
+  const Image src = makePattern(srcWidth, srcHeight);
+  const struct {
+    int dstWidth, dstHeight;
+  } targets[] = {{1600, 2400}, {800, 1200}, {480, 720}, {200, 300}, {100, 150}};
+
+  std::cout << "Throughput (" << srcWidth << "x" << srcHeight << " Gray8 source, best of 5):" << std::endl;
+  for (const auto& t : targets) {
+    for (const Format format : {Format::OneBit, Format::TwoBit}) {
+      double best = 1e9;
+      for (int run = 0; run < 5; run++) {
+        ImageDownscaler scaler(srcWidth, srcHeight, t.dstWidth, t.dstHeight, format, Dither::Atkinson);
+        volatile uint32_t sink = 0;
+        scaler.begin([&](const uint8_t* row, int) { sink = sink + row[0]; });
+        const auto start = std::chrono::steady_clock::now();
+        for (int y = 0; y < srcHeight; y++) {
+          scaler.pushRow(src.pixels.data() + static_cast<size_t>(y) * srcWidth, Source::Gray8);
+        }
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, ms);
+      }
+      const double mpix = static_cast<double>(srcWidth) * srcHeight / 1e6;
+      std::cout << "  scale " << std::fixed << std::setprecision(2) << static_cast<double>(srcWidth) / t.dstWidth
+                << ":1 -> " << t.dstWidth << "x" << t.dstHeight << (format == Format::OneBit ? " 1-bit" : " 2-bit")
+                << ": " << std::setprecision(1) << best << " ms (" << mpix / (best / 1000.0) << " MPix/s)"
+                << std::endl;
+    }
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  bool bench = false;
+  bool update = false;
+  const char* dumpDir = nullptr;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--bench") bench = true;
+    if (arg == "--update-golden") update = true;
+    if (arg == "--dump" && i + 1 < argc) dumpDir = argv[++i];
+  }
+
+  testUniformImagesStayUniform();
+  testMatchesFloatReference();
+  testIdentityIsLossless();
+  testSourceFormats();
+  testGoldenImages(dumpDir, update);
+
+  if (bench) runBenchmark();
+
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All image downscaler tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// Minimal host stand-in for lib/hal/HalStorage.h. The image downscaler tests only need the FsFile type to be
+// declared for Bitmap.h; nothing here touches storage.
+class HalFile {};
+using FsFile = HalFile;
@@ -0,0 +1,253 @@
+#include <HalStorage.h>
+#include <MD5Builder.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "lib/KOReaderSync/KOReaderDocumentId.h"
+#include "lib/KOReaderSync/KOReaderDocumentIdCache.h"
+
+namespace {
+
+int failures = 0;
+bool bench = false;
+
+void check(const bool condition, const std::string& message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << std::endl;
+    failures++;
+  }
+}
+
+// Bytes of the generated test books; `seed` keeps books of the same size apart
+std::vector<uint8_t> bookBytes(const size_t size, const uint32_t seed = 0) {
+  std::vector<uint8_t> data(size);
+  for (size_t i = 0; i < size; i++) data[i] = static_cast<uint8_t>(i * 31 + 7 + seed * 13);
+  return data;
+}
+
+void writeFile(const std::string& path, const std::vector<uint8_t>& data) {
+  FILE* file = fopen(Storage.hostPath(path).c_str(), "wb");
+  if (!data.empty()) fwrite(data.data(), 1, data.size(), file);
+  fclose(file);
+}
+
+void setModifyTime(const std::string& path, const time_t when) {
+  const utimbuf times = {when, when};
+  utime(Storage.hostPath(path).c_str(), &times);
+}
+
+time_t modifyTime(const std::string& path) {
+  struct stat st = {};
+  ::stat(Storage.hostPath(path).c_str(), &st);
+  return st.st_mtime;
+}
+
+std::string md5Hex(const std::string& text) {
+  MD5Builder md5;
+  md5.begin();
+  md5.add(text.c_str());
+  md5.calculate();
+  return md5.toString().c_str();
+}
+
+// util.partialMD5 from KOReader, line for line:
+//   for i = -1, 10 do file:seek("set", lshift(step, 2*i)); sample = file:read(size); if sample then update(sample)
+//   else break end end
+// LuaJIT's bit.lshift works on 32 bits and masks the shift count, so i = -1 seeks to 1024 << 30 = 0.
+std::string referenceDocumentId(const std::string& path) {
+  FILE* file = fopen(Storage.hostPath(path).c_str(), "rb");
+  if (!file) return "";
+  MD5Builder md5;
+  md5.begin();
+  uint8_t sample[1024];
+  for (int i = -1; i <= 10; i++) {
+    const uint32_t offset = static_cast<uint32_t>(1024u << ((2 * i) & 31));
+    fseek(file, offset, SEEK_SET);
+    const size_t read = fread(sample, 1, sizeof(sample), file);
+    if (read == 0) break;
+    md5.add(sample, read);
+  }
+  fclose(file);
+  md5.calculate();
+  return md5.toString().c_str();
+}
+
+void testMd5() {
+  check(md5Hex("") == "d41d8cd98f00b204e9800998ecf8427e", "MD5 of the empty string");
+  check(md5Hex("abc") == "900150983cd24fb0d6963f7d28e17f72", "MD5 of abc");
+  check(md5Hex("12345678901234567890123456789012345678901234567890123456789012345678901234567890") ==
+            "57edf4a22be3c955ac49da2e2107b67a",
+        "MD5 across blocks");
+  check(KOReaderDocumentId::calculateFromFilename("/books/Moby Dick.epub") == md5Hex("Moby Dick.epub"),
+        "filename ID hashes the name only");
+}
+
+void testMatchesKOReader() {
+  // Sizes around each sample offset, up to past the 4MB one
+  const size_t sizes[] = {0, 1, 255, 1024, 1025, 4096, 4097, 5000, 16384, 70000, 262145, 1048577, 4194304 + 1500};
+  for (const size_t size : sizes) {
+    const std::string path = "/book_" + std::to_string(size) + ".epub";
+    writeFile(path, bookBytes(size));
+    const std::string expected = referenceDocumentId(path);
+    check(KOReaderDocumentId::calculate(path) == expected, "ID matches KOReader for size " + std::to_string(size));
+    check(KOReaderDocumentIdCache::get(path) == expected,
+          "cached ID matches KOReader for size " + std::to_string(size));
+    check(KOReaderDocumentIdCache::lookup(path) == expected, "lookup after get for size " + std::to_string(size));
+  }
+
+  // Pinned with Python's hashlib, independent of the MD5 above
+  const std::string pinned = "/pinned.epub";
+  writeFile(pinned, bookBytes(300000));
+  check(KOReaderDocumentIdCache::get(pinned) == "3840df5dc77bb7f3d6d4b67e0979ed0b", "pinned document ID");
+}
+
+void testStaleEntries() {
+  const std::string path = "/stale.epub";
+  writeFile(path, bookBytes(20000, 1));
+  setModifyTime(path, 1700000000);
+  const std::string original = KOReaderDocumentIdCache::get(path);
+  check(!original.empty(), "ID computed");
+
+  // Same size and stamp but different bytes: a hit proves the book itself isn't read
+  writeFile(path, bookBytes(20000, 2));
+  setModifyTime(path, 1700000000);
+  check(KOReaderDocumentIdCache::lookup(path) == original, "lookup doesn't read the book");
+  check(KOReaderDocumentIdCache::get(path) == original, "get serves the cached ID without reading the book");
+
+  // A new modify stamp invalidates the entry
+  setModifyTime(path, 1700000100);
+  check(KOReaderDocumentIdCache::lookup(path).empty(), "changed modify time is a miss");
+  const std::string updated = KOReaderDocumentIdCache::get(path);
+  check(updated == referenceDocumentId(path) && updated != original, "changed book gets a new ID");
+  check(KOReaderDocumentIdCache::lookup(path) == updated, "new ID replaces the old entry");
+
+  // So does a new size, even with the stamp restored
+  const time_t stamp = modifyTime(path);
+  writeFile(path, bookBytes(20001, 2));
+  setModifyTime(path, stamp);
+  check(KOReaderDocumentIdCache::lookup(path).empty(), "changed size is a miss");
+
+  check(KOReaderDocumentIdCache::lookup("/never-seen.epub").empty(), "missing book is a miss");
+  check(KOReaderDocumentIdCache::get("/never-seen.epub").empty(), "missing book has no ID");
+}
+
+void testPrecompute() {
+  Storage.mkdir("/library");
+  Storage.mkdir("/library/series");
+  Storage.mkdir("/.hidden");
+  writeFile("/library/a.epub", bookBytes(3000, 3));
+  writeFile("/library/series/b.EPUB", bookBytes(9000, 4));
+  writeFile("/library/notes.txt", bookBytes(100, 5));
+  writeFile("/.hidden/c.epub", bookBytes(3000, 6));
+
+  std::vector<std::string> seen;
+  const size_t computed = KOReaderDocumentIdCache::precompute("/", [&seen](size_t, const std::string& path) {
+    seen.push_back(path);
+    return true;
+  });
+  check(KOReaderDocumentIdCache::lookup("/library/a.epub") == referenceDocumentId("/library/a.epub"),
+        "precompute caches books in folders");
+  check(KOReaderDocumentIdCache::lookup("/library/series/b.EPUB") == referenceDocumentId("/library/series/b.EPUB"),
+        "precompute walks nested folders and matches extensions in any case");
+  check(KOReaderDocumentIdCache::lookup("/.hidden/c.epub").empty(), "precompute skips hidden folders");
+  check(std::find(seen.begin(), seen.end(), "/library/notes.txt") == seen.end(), "precompute only visits EPUBs");
+  check(computed >= 2, "precompute computed the new books");
+  check(KOReaderDocumentIdCache::precompute("/") == 0, "second precompute has nothing to do");
+
+  size_t calls = 0;
+  KOReaderDocumentIdCache::precompute("/library", [&calls](size_t, const std::string&) { return ++calls < 1; });
+  check(calls == 1, "precompute stops when the callback says so");
+}
+
+void testCapacity() {
+  // More books than slots: every lookup is either a miss or the right ID
+  Storage.mkdir("/many");
+  constexpr int BOOKS = 3000;
+  for (int i = 0; i < BOOKS; i++) {
+    writeFile("/many/" + std::to_string(i) + ".epub", bookBytes(64, 100 + i));
+  }
+  KOReaderDocumentIdCache::precompute("/many");
+
+  int hits = 0;
+  int wrong = 0;
+  for (int i = 0; i < BOOKS; i++) {
+    const std::string path = "/many/" + std::to_string(i) + ".epub";
+    const std::string id = KOReaderDocumentIdCache::lookup(path);
+    if (id.empty()) continue;
+    hits++;
+    if (id != referenceDocumentId(path)) wrong++;
+  }
+  check(wrong == 0, "no lookup returns another book's ID");
+  check(hits >= 1500, "most books stay cached past capacity: " + std::to_string(hits));
+  if (bench) {
+    printf("%d of %d books cached after overfilling the table\n", hits, BOOKS);
+  }
+}
+
+void testDamagedCache() {
+  writeFile("/.crosspoint/koreader_ids.bin", bookBytes(100));
+  const std::string path = "/damaged.epub";
+  writeFile(path, bookBytes(5000, 7));
+  check(KOReaderDocumentIdCache::lookup(path).empty(), "damaged cache is a miss");
+  check(KOReaderDocumentIdCache::get(path) == referenceDocumentId(path), "damaged cache is rebuilt on store");
+  check(KOReaderDocumentIdCache::lookup(path) == referenceDocumentId(path), "rebuilt cache serves lookups");
+}
+
+void benchLookup() {
+  const std::string path = "/book_4195804.epub";
+  KOReaderDocumentIdCache::get(path);
+  constexpr int ROUNDS = 2000;
+  const auto time = [](const std::function<void()>& fn) {
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; i++) fn();
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / ROUNDS;
+  };
+  const double calculate = time([&] { KOReaderDocumentId::calculate(path); });
+  const double lookup = time([&] { KOReaderDocumentIdCache::lookup(path); });
+  printf("calculate %.1f us, cached lookup %.1f us\n", calculate, lookup);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--bench") bench = true;
+  }
+
+  char scratch[] = "/tmp/koreader_document_id_XXXXXX";
+  if (!mkdtemp(scratch)) {
+    std::cerr << "Failed to create scratch directory" << std::endl;
+    return 1;
+  }
+  Storage.setRoot(scratch);
+  Storage.mkdir("/.crosspoint");
+
+  testMd5();
+  testMatchesKOReader();
+  testStaleEntries();
+  testPrecompute();
+  testCapacity();
+  testDamagedCache();
+  if (bench) benchLookup();
+
+  std::system((std::string("rm -rf ") + scratch).c_str());
+
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All KOReader document ID tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,337 @@
+#include <HalStorage.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "lib/DirectoryIndex/DirectoryIndex.h"
+#include "lib/LibraryDb/LibraryDb.h"
+
+// Heap accounting: every allocation carries its size so peak usage can be measured around a call
+namespace heap {
+std::atomic<size_t> live{0};
+std::atomic<size_t> peak{0};
+
+void* allocate(const size_t size) {
+  auto* block = static_cast<size_t*>(std::malloc(size + sizeof(std::max_align_t)));
+  if (!block) throw std::bad_alloc();
+  *block = size;
+  const size_t now = live += size;
+  size_t seen = peak;
+  while (now > seen && !peak.compare_exchange_weak(seen, now)) {
+  }
+  return reinterpret_cast<char*>(block) + sizeof(std::max_align_t);
+}
+
+void release(void* ptr) {
+  if (!ptr) return;
+  auto* block = reinterpret_cast<size_t*>(static_cast<char*>(ptr) - sizeof(std::max_align_t));
+  live -= *block;
+  std::free(block);
+}
+
+// Peak heap above the current level while `fn` runs
+template <typename Fn>
+size_t peakDuring(Fn fn) {
+  const size_t base = live;
+  peak = base;
+  fn();
+  return peak - base;
+}
+}  // namespace heap
+
+void* operator new(const size_t size) { return heap::allocate(size); }
+void* operator new[](const size_t size) { return heap::allocate(size); }
+void operator delete(void* ptr) noexcept { heap::release(ptr); }
+void operator delete[](void* ptr) noexcept { heap::release(ptr); }
+void operator delete(void* ptr, size_t) noexcept { heap::release(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { heap::release(ptr); }
+
+namespace {
+
+int failures = 0;
+bool bench = false;
+
+void check(const bool condition, const std::string& message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << std::endl;
+    failures++;
+  }
+}
+
+using Clock = std::chrono::steady_clock;
+
+double msSince(const Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void removeTree(const std::string& hostDir) {
+  const std::string command = "rm -rf '" + hostDir + "'";
+  check(std::system(command.c_str()) == 0, "remove " + hostDir);
+}
+
+// Each test starts from an empty library
+void resetLibrary() {
+  removeTree(Storage.hostPath("/.crosspoint/library"));
+  check(LibraryDb::count() == 0, "library empty after reset");
+}
+
+LibraryDb::Book makeBook(const std::string& path, const std::string& title, const std::string& author = "",
+                         const std::string& series = "") {
+  LibraryDb::Book book;
+  book.path = path;
+  book.title = title;
+  book.author = author;
+  book.series = series;
+  book.language = "en";
+  book.thumbBmpPath = "/.crosspoint/epub_1/thumb_[HEIGHT].bmp";
+  return book;
+}
+
+std::vector<std::string> titles(const LibraryDb::SortKey key, const bool descending, const uint32_t pageSize = 3) {
+  std::vector<std::string> result;
+  for (uint32_t position = 0;; position += pageSize) {
+    const uint32_t read = LibraryDb::query(key, descending, position, pageSize,
+                                           [&](const LibraryDb::Book& book) { result.push_back(book.title); });
+    if (read < pageSize) break;
+  }
+  return result;
+}
+
+using Titles = std::vector<std::string>;
+
+void testPutAndFind() {
+  resetLibrary();
+  check(LibraryDb::put(makeBook("/books/a.epub", "Alpha", "Zed", "Saga")), "put new book");
+  check(LibraryDb::count() == 1, "one book");
+
+  LibraryDb::Book book;
+  check(LibraryDb::find("/books/a.epub", book), "find book");
+  check(book.title == "Alpha" && book.author == "Zed" && book.series == "Saga" && book.language == "en",
+        "metadata round trip");
+  check(book.thumbBmpPath == "/.crosspoint/epub_1/thumb_[HEIGHT].bmp", "thumbnail path kept with placeholder");
+  check(book.lastOpened == 0 && book.progressPercent == 0, "new book never opened");
+  check(!LibraryDb::find("/books/missing.epub", book), "unknown book not found");
+
+  check(LibraryDb::setProgress("/books/a.epub", 42), "set progress");
+  const uint32_t revision = LibraryDb::getRevision();
+  check(LibraryDb::put(makeBook("/books/a.epub", "Alpha (2nd ed.)", "Zed", "Saga"), true), "replace metadata");
+  check(LibraryDb::getRevision() != revision, "revision bumped");
+  check(LibraryDb::count() == 1, "replacing doesn't add");
+  check(LibraryDb::find("/books/a.epub", book) && book.title == "Alpha (2nd ed.)", "title replaced");
+  check(book.progressPercent == 42, "progress kept on replace");
+  check(book.lastOpened > 0, "marked opened");
+  check(!LibraryDb::setProgress("/books/missing.epub", 10), "progress of unknown book refused");
+}
+
+void testOrders() {
+  resetLibrary();
+  LibraryDb::put(makeBook("/b/3.epub", "Vol 10", "Brown", "Rivers"));
+  LibraryDb::put(makeBook("/b/1.epub", "Vol 2", "adams", "Rivers"));
+  LibraryDb::put(makeBook("/b/2.epub", "apple", "Brown", ""));
+  LibraryDb::put(makeBook("/b/4.epub", "Banana", "Carter", "Abyss"));
+  LibraryDb::put(makeBook("/b/5.epub", "cherry", "adams", "Abyss"));
+
+  check(titles(LibraryDb::SortKey::Title, false) == Titles{"apple", "Banana", "cherry", "Vol 2", "Vol 10"},
+        "title order, natural and case-insensitive");
+  check(titles(LibraryDb::SortKey::Title, true) == Titles{"Vol 10", "Vol 2", "cherry", "Banana", "apple"},
+        "title order descending");
+  check(titles(LibraryDb::SortKey::Author, false) == Titles{"cherry", "Vol 2", "apple", "Vol 10", "Banana"},
+        "author order, then title");
+  check(titles(LibraryDb::SortKey::Series, false) == Titles{"apple", "Banana", "cherry", "Vol 2", "Vol 10"},
+        "series order, then title");
+
+  // Changing the title moves the book in the title order and within its author and series
+  LibraryDb::put(makeBook("/b/2.epub", "Zucchini", "Brown", ""));
+  check(titles(LibraryDb::SortKey::Title, false) == Titles{"Banana", "cherry", "Vol 2", "Vol 10", "Zucchini"},
+        "title order after retitle");
+  check(titles(LibraryDb::SortKey::Author, false) == Titles{"cherry", "Vol 2", "Vol 10", "Zucchini", "Banana"},
+        "author order after retitle");
+
+  // Opening order
+  LibraryDb::put(makeBook("/b/4.epub", "Banana", "Carter", "Abyss"), true);
+  LibraryDb::put(makeBook("/b/1.epub", "Vol 2", "adams", "Rivers"), true);
+  LibraryDb::put(makeBook("/b/4.epub", "Banana", "Carter", "Abyss"), true);
+  Titles opened;
+  LibraryDb::query(LibraryDb::SortKey::LastOpened, true, 0, 10, [&](const LibraryDb::Book& book) {
+    if (book.lastOpened > 0) opened.push_back(book.title);
+  });
+  check(opened == (Titles{"Banana", "Vol 2"}), "most recently opened first");
+  check(titles(LibraryDb::SortKey::Title, false).size() == 5, "reopening doesn't duplicate");
+}
+
+void testRemove() {
+  resetLibrary();
+  for (int i = 0; i < 20; i++) {
+    LibraryDb::put(makeBook("/r/" + std::to_string(i) + ".epub", "Book " + std::to_string(i)), i % 3 == 0);
+  }
+  const std::string booksFile = Storage.hostPath("/.crosspoint/library/books.bin");
+  FILE* f = std::fopen(booksFile.c_str(), "rb");
+  std::fseek(f, 0, SEEK_END);
+  const long sizeBefore = std::ftell(f);
+  std::fclose(f);
+
+  check(LibraryDb::remove("/r/3.epub"), "remove opened book");
+  check(LibraryDb::remove("/r/4.epub"), "remove book");
+  check(!LibraryDb::remove("/r/4.epub"), "removing twice fails");
+  check(LibraryDb::count() == 18, "two books removed");
+  LibraryDb::Book book;
+  check(!LibraryDb::find("/r/3.epub", book), "removed book not found");
+  const Titles all = titles(LibraryDb::SortKey::Title, false);
+  check(all.size() == 18 && std::find(all.begin(), all.end(), "Book 3") == all.end(), "removed from title order");
+  Titles opened;
+  LibraryDb::query(LibraryDb::SortKey::LastOpened, true, 0, 20, [&](const LibraryDb::Book& b) {
+    if (b.lastOpened > 0) opened.push_back(b.title);
+  });
+  check(opened == (Titles{"Book 18", "Book 15", "Book 12", "Book 9", "Book 6", "Book 0"}), "removed from recents");
+
+  LibraryDb::put(makeBook("/r/new1.epub", "New 1"));
+  LibraryDb::put(makeBook("/r/new2.epub", "New 2"));
+  f = std::fopen(booksFile.c_str(), "rb");
+  std::fseek(f, 0, SEEK_END);
+  check(std::ftell(f) == sizeBefore, "freed slots reused");
+  std::fclose(f);
+  check(LibraryDb::count() == 20 && LibraryDb::find("/r/new2.epub", book), "new books after reuse");
+}
+
+void testLongFields() {
+  resetLibrary();
+  // 2-byte characters straddling the 127-byte title limit
+  std::string title = "A";
+  while (title.size() < 200) title += "\xC3\xA9";
+  check(LibraryDb::put(makeBook("/long.epub", title)), "long title accepted");
+  LibraryDb::Book book;
+  check(LibraryDb::find("/long.epub", book), "find long title book");
+  check(book.title.size() == 127 && title.compare(0, book.title.size(), book.title) == 0,
+        "title cut on a character boundary (" + std::to_string(book.title.size()) + " bytes)");
+  check(!LibraryDb::put(makeBook("/" + std::string(300, 'p') + ".epub", "Too long")), "overlong path refused");
+  check(LibraryDb::count() == 1, "refused book not stored");
+}
+
+void testInterruptedUpdate() {
+  resetLibrary();
+  for (int i = 0; i < 10; i++) {
+    LibraryDb::put(makeBook("/d/" + std::to_string(i) + ".epub", "Title " + std::to_string(9 - i)), true);
+  }
+  const Titles expected = titles(LibraryDb::SortKey::Title, false);
+
+  // A power loss in the middle of an update: dirty flag set, title index half shifted
+  FILE* f = std::fopen(Storage.hostPath("/.crosspoint/library/books.bin").c_str(), "r+b");
+  std::fseek(f, 5, SEEK_SET);
+  std::fputc(1, f);
+  std::fclose(f);
+  f = std::fopen(Storage.hostPath("/.crosspoint/library/title.idx").c_str(), "r+b");
+  std::vector<char> garbage(60, '\x7F');
+  std::fwrite(garbage.data(), 1, garbage.size(), f);
+  std::fclose(f);
+
+  check(titles(LibraryDb::SortKey::Title, false) == expected, "indexes rebuilt after interrupted update");
+  check(LibraryDb::count() == 10, "all books kept");
+  LibraryDb::Book book;
+  check(LibraryDb::find("/d/7.epub", book) && book.title == "Title 2", "records intact");
+  Titles opened;
+  LibraryDb::query(LibraryDb::SortKey::LastOpened, true, 0, 2,
+                   [&](const LibraryDb::Book& b) { opened.push_back(b.title); });
+  check(opened == (Titles{"Title 0", "Title 1"}), "opening order rebuilt");
+
+  // A damaged header starts a new library rather than reading garbage
+  f = std::fopen(Storage.hostPath("/.crosspoint/library/books.bin").c_str(), "r+b");
+  std::fputc(0, f);
+  std::fclose(f);
+  check(LibraryDb::count() == 0, "damaged library not read");
+  check(LibraryDb::put(makeBook("/d/0.epub", "Again")) && LibraryDb::count() == 1, "library started over");
+}
+
+void testLargeLibrary() {
+  resetLibrary();
+  const int BOOKS = bench ? 3000 : 1000;
+  std::vector<std::string> expected;
+  const auto start = Clock::now();
+  size_t putHeap = 0;
+  for (int i = 0; i < BOOKS; i++) {
+    // Scatter the insert positions across every order
+    const int n = (i * 7919) % BOOKS;
+    const std::string title = "Title " + std::to_string(n);
+    expected.push_back(title);
+    const auto book = makeBook("/lib/" + std::to_string(n) + ".epub", title, "Author " + std::to_string(n % 97),
+                               n % 5 ? "Series " + std::to_string(n % 31) : "");
+    putHeap = std::max(putHeap, heap::peakDuring([&] { LibraryDb::put(book, n % 10 == 0); }));
+  }
+  const double putMs = msSince(start);
+  check(LibraryDb::count() == static_cast<uint32_t>(BOOKS), "all books stored");
+  check(putHeap < 2 * 1024, "put in bounded memory (" + std::to_string(putHeap) + " bytes)");
+
+  std::sort(expected.begin(), expected.end(), [](const std::string& a, const std::string& b) {
+    return DirectoryIndex::nameLess(a.data(), a.size(), b.data(), b.size());
+  });
+  check(titles(LibraryDb::SortKey::Title, false, 50) == expected, "large title order");
+
+  std::vector<LibraryDb::Book> recents;
+  double recentsMs = 0;
+  const size_t recentsHeap = heap::peakDuring([&] {
+    const auto recentsStart = Clock::now();
+    LibraryDb::query(LibraryDb::SortKey::LastOpened, true, 0, 10,
+                     [&](const LibraryDb::Book& book) { recents.push_back(book); });
+    recentsMs = msSince(recentsStart);
+  });
+  check(recents.size() == 10 && recents.front().lastOpened > recents.back().lastOpened, "recents from a large library");
+  check(recentsHeap < 8 * 1024, "recents read in bounded memory (" + std::to_string(recentsHeap) + " bytes)");
+
+  Titles page;
+  double pageMs = 0;
+  const size_t pageHeap = heap::peakDuring([&] {
+    const auto pageStart = Clock::now();
+    LibraryDb::query(LibraryDb::SortKey::Author, false, BOOKS / 2, 20,
+                     [&](const LibraryDb::Book& book) { page.push_back(book.title); });
+    pageMs = msSince(pageStart);
+  });
+  check(page.size() == 20, "author page from the middle");
+  check(pageHeap < 8 * 1024, "page read in bounded memory (" + std::to_string(pageHeap) + " bytes)");
+
+  if (bench) {
+    printf("%d books: %.3f ms per put (peak heap %zu B) | 10 recents %.3f ms, %zu B | 20-book author page %.3f ms, "
+           "%zu B\n",
+           BOOKS, putMs / BOOKS, putHeap, recentsMs, recentsHeap, pageMs, pageHeap);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--bench") bench = true;
+  }
+
+  char scratch[] = "/tmp/library_db_XXXXXX";
+  if (!mkdtemp(scratch)) {
+    std::cerr << "Failed to create scratch directory" << std::endl;
+    return 1;
+  }
+  Storage.setRoot(scratch);
+
+  testPutAndFind();
+  testOrders();
+  testRemove();
+  testLongFields();
+  testInterruptedUpdate();
+  testLargeLibrary();
+
+  removeTree(scratch);
+
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All library database tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "lib/Epub/Epub/parsers/NoteTextParser.h"
+
+namespace {
+
+int failures = 0;
+bool bench = false;
+
+void check(const bool condition, const std::string& message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << std::endl;
+    failures++;
+  }
+}
+
+struct Result {
+  std::map<std::string, std::string> notes;
+  size_t found = 0;
+  size_t bytesFed = 0;
+};
+
+// Feeds the document in small chunks, as readItemContentsToStream does, counting what the parser still looked at
+Result parse(const std::string& xhtml, const std::vector<std::string>& ids, const size_t chunk = 256) {
+  Result result;
+  NoteTextParser parser(ids,
+                        [&result](const std::string& id, std::string text) { result.notes[id] = std::move(text); });
+  check(parser.setup(), "parser set up");
+  for (size_t offset = 0; offset < xhtml.size(); offset += chunk) {
+    if (parser.foundCount() >= ids.size()) break;
+    const size_t size = std::min(chunk, xhtml.size() - offset);
+    parser.write(reinterpret_cast<const uint8_t*>(xhtml.data()) + offset, size);
+    result.bytesFed = offset + size;
+  }
+  parser.finish();
+  result.found = parser.foundCount();
+  return result;
+}
+
+std::string note(const Result& result, const std::string& id) {
+  const auto it = result.notes.find(id);
+  return it == result.notes.end() ? "<missing>" : it->second;
+}
+
+std::string document(const std::string& body) {
+  return "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+         "<html xmlns=\"http://www.w3.org/1999/xhtml\" xmlns:epub=\"http://www.idpf.org/2007/ops\">\n"
+         "<head><title>Notes</title></head>\n<body>\n" +
+         body + "\n</body>\n</html>\n";
+}
+
+void testEpub3Footnotes() {
+  const std::string xhtml = document(
+      "<p>Text with a note<a epub:type=\"noteref\" href=\"#fn1\" id=\"r1\">1</a> and another"
+      "<a epub:type=\"noteref\" href=\"#fn2\" id=\"r2\">2</a>.</p>\n"
+      "<aside epub:type=\"footnote\" id=\"fn1\">\n"
+      "  <p><a epub:type=\"backlink\" href=\"#r1\">1.</a> The <em>first</em>   note,\n  wrapped.</p>\n"
+      "</aside>\n"
+      "<aside epub:type=\"footnote\" id=\"fn2\" role=\"doc-footnote\">\n"
+      "  <p>Second note, first paragraph.</p>\n  <p>Second paragraph&#160;&amp; more.</p>\n"
+      "  <p><a role=\"doc-backlink\" href=\"#r2\">Back</a></p>\n"
+      "</aside>\n");
+
+  const auto result = parse(xhtml, {"fn1", "fn2"});
+  check(result.found == 2, "both EPUB 3 footnotes found");
+  check(note(result, "fn1") == "The first note, wrapped.",
+        "footnote text collapsed, back link dropped: '" + note(result, "fn1") + "'");
+  check(note(result, "fn2") == "Second note, first paragraph.\nSecond paragraph\xC2\xA0& more.",
+        "paragraphs kept as lines, entities decoded: '" + note(result, "fn2") + "'");
+}
+
+void testClassicEndnotes() {
+  // Calibre and older EPUB 2 books: the id sits on the note number, which links back to the reference
+  const std::string xhtml = document(
+      "<h2>Notes</h2>\n"
+      "<p class=\"note\"><a id=\"n1\" href=\"ch01.xhtml#r1\">1</a> See the <i>preface</i>.</p>\n"
+      "<p class=\"note\"><a id=\"n2\" href=\"ch01.xhtml#r2\">2</a> Quoted from a letter, 1851. <a "
+      "href=\"ch01.xhtml#r2\">\xE2\x86\xA9\xEF\xB8\x8E</a></p>\n"
+      "<div id=\"n3\"><span>3</span> Block <br/>with a break.</div>\n");
+
+  const auto result = parse(xhtml, {"n2", "n1", "n3"});
+  check(result.found == 3, "all classic endnotes found");
+  check(note(result, "n1") == "1 See the preface.",
+        "inline id takes the enclosing paragraph: '" + note(result, "n1") + "'");
+  check(note(result, "n2") == "2 Quoted from a letter, 1851.", "trailing arrow stripped: '" + note(result, "n2") + "'");
+  check(note(result, "n3") == "3 Block\nwith a break.", "br becomes a line break: '" + note(result, "n3") + "'");
+}
+
+void testStopsEarly() {
+  std::string body = "<p id=\"first\">Only note.</p>\n";
+  for (int i = 0; i < 2000; i++) body += "<p>Filler paragraph " + std::to_string(i) + " that nobody asked for.</p>\n";
+  const std::string xhtml = document(body);
+
+  const auto result = parse(xhtml, {"first"});
+  check(note(result, "first") == "Only note.", "note before the filler");
+  check(result.bytesFed < 4096, "parsing stopped once every note was found (" + std::to_string(result.bytesFed) + ")");
+}
+
+void testTruncation() {
+  std::string longText;
+  while (longText.size() < NoteTextParser::MAX_TEXT_BYTES * 2) longText += "Gr\xC3\xBC\xC3\x9F" "e ";
+  const auto result = parse(document("<aside id=\"long\">" + longText + "</aside>"), {"long"});
+  const std::string text = note(result, "long");
+  check(text.size() <= NoteTextParser::MAX_TEXT_BYTES, "note cut to the limit (" + std::to_string(text.size()) + ")");
+  check(text.size() > NoteTextParser::MAX_TEXT_BYTES - 8, "note cut close to the limit");
+  check(text.compare(text.size() - 3, 3, "\xE2\x80\xA6") == 0, "cut note ends with an ellipsis");
+  // No half characters before the ellipsis
+  const unsigned char before = static_cast<unsigned char>(text[text.size() - 4]);
+  check(before < 0x80 || (before & 0xC0) == 0x80, "cut on a character boundary");
+}
+
+void testMissingAndEmpty() {
+  const std::string xhtml = document("<p id=\"empty\"><a href=\"#x\" role=\"doc-backlink\">Back</a></p>\n<p>Text</p>");
+  const auto result = parse(xhtml, {"empty", "absent"});
+  check(result.notes.empty(), "no text reported for an empty note or a missing id");
+  check(result.found == 1, "empty note still counted as found");
+
+  const auto broken = parse("<html><body><p id=\"a\">Unclosed <b>tag</p></body></html>", {"a"});
+  check(broken.notes.empty(), "malformed document reports nothing");
+}
+
+void testNoteLabels() {
+  for (const char* label : {"1", "12", "[3]", "(14)", "iv", "xii", "*", "**", "†", "‡", "§"}) {
+    check(NoteTextParser::looksLikeNoteLabel(label), std::string("note label: ") + label);
+  }
+  for (const char* label : {"", "[]", "1234", "a", "Next", "see", "iviv x", "Ch.2", "A1", "*a", "cc cc"}) {
+    check(!NoteTextParser::looksLikeNoteLabel(label), std::string("not a note label: ") + label);
+  }
+}
+
+void benchParse() {
+  std::string body;
+  for (int i = 0; i < 5000; i++) body += "<p>Paragraph " + std::to_string(i) + " of a long chapter of endnotes.</p>\n";
+  std::vector<std::string> ids;
+  for (int i = 0; i < 200; i++) {
+    ids.push_back("note" + std::to_string(i));
+    body += "<aside epub:type=\"footnote\" id=\"note" + std::to_string(i) + "\"><p>Note " + std::to_string(i) +
+            " text, a sentence or two long, as notes usually are.</p></aside>\n";
+  }
+  const std::string xhtml = document(body);
+
+  const auto start = std::chrono::steady_clock::now();
+  const auto result = parse(xhtml, ids, 1024);
+  const double millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  printf("%zu notes from %zu bytes in %.2f ms\n", result.notes.size(), xhtml.size(), millis);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--bench") bench = true;
+  }
+
+  testEpub3Footnotes();
+  testClassicEndnotes();
+  testStopsEarly();
+  testTruncation();
+  testMissingAndEmpty();
+  testNoteLabels();
+  if (bench) benchParse();
+
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All note text tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,360 @@
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "lib/OpdsParser/OpdsEntryWindow.h"
+#include "lib/OpdsParser/OpdsParser.h"
+
+// Heap accounting: every allocation carries its size so peak usage can be measured around a call. expat allocates
+// through malloc and is not counted; its buffers are fixed per parser.
+namespace heap {
+std::atomic<size_t> live{0};
+std::atomic<size_t> peak{0};
+
+void* allocate(const size_t size) {
+  auto* block = static_cast<size_t*>(std::malloc(size + sizeof(std::max_align_t)));
+  if (!block) throw std::bad_alloc();
+  *block = size;
+  const size_t now = live += size;
+  size_t seen = peak;
+  while (now > seen && !peak.compare_exchange_weak(seen, now)) {
+  }
+  return reinterpret_cast<char*>(block) + sizeof(std::max_align_t);
+}
+
+void release(void* ptr) {
+  if (!ptr) return;
+  auto* block = reinterpret_cast<size_t*>(static_cast<char*>(ptr) - sizeof(std::max_align_t));
+  live -= *block;
+  std::free(block);
+}
+
+// Peak heap above the current level while `fn` runs
+template <typename Fn>
+size_t peakDuring(Fn fn) {
+  const size_t base = live;
+  peak = base;
+  fn();
+  return peak - base;
+}
+}  // namespace heap
+
+void* operator new(const size_t size) { return heap::allocate(size); }
+void* operator new[](const size_t size) { return heap::allocate(size); }
+void operator delete(void* ptr) noexcept { heap::release(ptr); }
+void operator delete[](void* ptr) noexcept { heap::release(ptr); }
+void operator delete(void* ptr, size_t) noexcept { heap::release(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { heap::release(ptr); }
+
+namespace {
+
+int failures = 0;
+bool bench = false;
+
+void check(const bool condition, const std::string& message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << std::endl;
+    failures++;
+  }
+}
+
+using Clock = std::chrono::steady_clock;
+
+double msSince(const Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+constexpr int AUTHORS = 12;
+
+std::string authorName(const size_t index) { return "Author Number " + std::to_string(index % AUTHORS); }
+std::string bookTitle(const size_t index) {
+  return "A Book With A Reasonably Long Title, Volume " + std::to_string(index);
+}
+std::string bookHref(const size_t index) { return "/opds/books/" + std::to_string(index) + "/download.epub"; }
+
+// Atom feed of `count` books numbered from `first`, with the pagination links the server would send
+std::string writeFeed(const std::string& path, const size_t first, const size_t count, const std::string& next,
+                      const std::string& previous) {
+  FILE* file = fopen(path.c_str(), "wb");
+  fputs("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<feed xmlns=\"http://www.w3.org/2005/Atom\">\n", file);
+  fputs("<title>Catalog</title>\n<link rel=\"self\" href=\"/opds/all\" type=\"application/atom+xml\"/>\n", file);
+  if (!next.empty()) fprintf(file, "<link rel=\"next\" href=\"%s\" type=\"application/atom+xml\"/>\n", next.c_str());
+  if (!previous.empty()) {
+    fprintf(file, "<link rel=\"previous\" href=\"%s\" type=\"application/atom+xml\"/>\n", previous.c_str());
+  }
+  for (size_t i = first; i < first + count; i++) {
+    fprintf(file,
+            "<entry><title>%s</title><id>urn:uuid:%08zx-0000-4000-8000-000000000000</id>"
+            "<author><name>%s</name></author><summary>Some description of the book that nobody reads on the device"
+            "</summary><link rel=\"related\" href=\"/opds/related/%zu\" type=\"application/atom+xml\"/>"
+            "<link rel=\"http://opds-spec.org/acquisition\" href=\"%s\" type=\"application/epub+zip\"/></entry>\n",
+            bookTitle(i).c_str(), i, authorName(i).c_str(), i, bookHref(i).c_str());
+  }
+  fputs("</feed>\n", file);
+  fclose(file);
+  return path;
+}
+
+// Parse a document from disk in 1KB chunks, the way the device reads its cached copy
+bool parseFile(const std::string& path, OpdsParser& parser) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) return false;
+  uint8_t buffer[1024];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    parser.write(buffer, read);
+  }
+  fclose(file);
+  parser.flush();
+  return static_cast<bool>(parser);
+}
+
+// Fill `window` from feed position `first` across documents holding `counts[i]` entries each, as OpdsFeedPages does
+void loadWindow(OpdsEntryWindow& window, const std::vector<std::string>& paths, const std::vector<size_t>& counts,
+                const size_t first) {
+  window.reset(first);
+  size_t firstEntry = 0;
+  for (size_t i = 0; i < paths.size(); i++) {
+    const size_t pageFirst = firstEntry;
+    firstEntry += counts[i];
+    if (pageFirst + counts[i] <= first) continue;
+    bool full = false;
+    OpdsParser parser;
+    parser.setEntryHandler([&](const size_t local, const OpdsEntry& entry) {
+      if (!full && pageFirst + local == window.first() + window.size()) {
+        full = !window.add(entry);
+      }
+    });
+    parseFile(paths[i], parser);
+    if (full) break;
+  }
+}
+
+bool entryIs(const OpdsEntryWindow& window, const size_t index) {
+  const OpdsEntry entry = window.at(index);
+  return entry.type == OpdsEntryType::BOOK && entry.title == bookTitle(index) && entry.author == authorName(index) &&
+         entry.href == bookHref(index) && entry.id.empty();
+}
+
+void testPaginationLinks(const std::string& dir) {
+  const std::string path = writeFeed(dir + "/links.xml", 0, 5, "/opds/all?page=3", "/opds/all?page=1");
+  OpdsParser parser;
+  check(parseFile(path, parser), "small feed parses");
+  check(parser.getEntries().size() == 5, "entries are collected without a handler");
+  check(parser.getEntryCount() == 5, "entry count matches collected entries");
+  check(parser.getNextLink() == "/opds/all?page=3", "rel=next link is read from the feed");
+  check(parser.getPreviousLink() == "/opds/all?page=1", "rel=previous link is read from the feed");
+  check(parser.getEntries()[2].href == bookHref(2), "entry links are not taken as pagination links");
+
+  const std::string last = writeFeed(dir + "/last.xml", 0, 3, "", "");
+  OpdsParser lastParser;
+  parseFile(last, lastParser);
+  check(lastParser.getNextLink().empty(), "last page has no next link");
+
+  // "prev" is used by some servers instead of "previous"
+  FILE* file = fopen((dir + "/prev.xml").c_str(), "wb");
+  fputs("<feed xmlns=\"http://www.w3.org/2005/Atom\"><link rel=\"prev\" href=\"/p1\"/></feed>", file);
+  fclose(file);
+  OpdsParser prevParser;
+  parseFile(dir + "/prev.xml", prevParser);
+  check(prevParser.getPreviousLink() == "/p1", "rel=prev is accepted as the previous link");
+}
+
+void testHandlerStreamsLargeFeed(const std::string& dir) {
+  constexpr size_t COUNT = 20000;
+  const std::string path = writeFeed(dir + "/large.xml", 0, COUNT, "/opds/all?page=2", "");
+  FILE* file = fopen(path.c_str(), "rb");
+  fseek(file, 0, SEEK_END);
+  const long bytes = ftell(file);
+  fclose(file);
+
+  size_t seen = 0;
+  bool ordered = true;
+  const auto start = Clock::now();
+  const size_t streamedPeak = heap::peakDuring([&] {
+    OpdsParser parser;
+    parser.setEntryHandler([&](const size_t index, const OpdsEntry& entry) {
+      ordered = ordered && index == seen && entry.title == bookTitle(index);
+      seen++;
+    });
+    check(parseFile(path, parser), "large feed parses");
+    check(parser.getEntries().empty(), "entries handed to the handler are not collected");
+    check(parser.getEntryCount() == COUNT, "entry count covers the whole feed");
+    check(parser.getNextLink() == "/opds/all?page=2", "next link is found in a large feed");
+  });
+  const double streamedMs = msSince(start);
+  check(seen == COUNT && ordered, "handler sees every entry in order");
+  check(streamedPeak < 16 * 1024, "streaming a large feed uses bounded memory (" + std::to_string(streamedPeak) + ")");
+
+  if (bench) {
+    size_t collectedPeak = heap::peakDuring([&] {
+      OpdsParser parser;
+      parseFile(path, parser);
+    });
+    printf("%zu entries, %ld bytes: streamed %.1f ms peak %zu B, collected peak %zu B\n", COUNT, bytes, streamedMs,
+           streamedPeak, collectedPeak);
+  }
+}
+
+void testWindow(const std::string& dir) {
+  constexpr size_t CAPACITY = 69;
+  const std::vector<std::string> paths = {writeFeed(dir + "/p0.xml", 0, 50, "/p1", ""),
+                                          writeFeed(dir + "/p1.xml", 50, 50, "/p2", "/p0"),
+                                          writeFeed(dir + "/p2.xml", 100, 50, "", "/p1")};
+  const std::vector<size_t> counts = {50, 50, 50};
+
+  OpdsEntryWindow window(CAPACITY, 16 * 1024);
+  loadWindow(window, paths, counts, 0);
+  check(window.first() == 0 && window.size() == CAPACITY, "window fills from the first document into the next");
+  check(entryIs(window, 0) && entryIs(window, 49) && entryIs(window, 50) && entryIs(window, 68),
+        "entries keep their feed positions across documents");
+  check(!window.contains(69), "window stops at its capacity");
+
+  loadWindow(window, paths, counts, 120);
+  check(window.first() == 120 && window.size() == 30, "window near the end holds what is left");
+  check(window.contains(149) && entryIs(window, 149) && !window.contains(119), "tail window has the right entries");
+
+  loadWindow(window, paths, counts, 40);
+  check(window.contains(40) && window.contains(108) && entryIs(window, 75), "window spans three documents");
+
+  // Authors repeat on every page, so they are stored once per window
+  size_t rawBytes = 0;
+  for (size_t i = 40; i < 40 + CAPACITY; i++) {
+    rawBytes += bookTitle(i).size() + authorName(i).size() + bookHref(i).size();
+  }
+  check(window.arenaUsed() < rawBytes, "repeated authors are stored once");
+  size_t titleAndHref = 0;
+  for (size_t i = 40; i < 40 + CAPACITY; i++) titleAndHref += bookTitle(i).size() + bookHref(i).size();
+  size_t authorsOnce = 0;
+  for (int a = 0; a < AUTHORS; a++) authorsOnce += authorName(a).size();
+  check(window.arenaUsed() == titleAndHref + authorsOnce, "arena holds each distinct string once");
+}
+
+// Parse `path` from the entry at byte `offset` the way OpdsFeedPages resumes at a checkpoint: the document up to
+// `prologEnd`, then the rest from the offset
+bool parseFrom(const std::string& path, const size_t prologEnd, const size_t offset, OpdsParser& parser) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) return false;
+  std::vector<uint8_t> prolog(prologEnd);
+  const bool ok = fread(prolog.data(), 1, prologEnd, file) == prologEnd && fseek(file, offset, SEEK_SET) == 0;
+  parser.write(prolog.data(), prolog.size());
+  uint8_t buffer[1024];
+  size_t read;
+  while (ok && (read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    parser.write(buffer, read);
+  }
+  fclose(file);
+  parser.flush();
+  return ok && static_cast<bool>(parser);
+}
+
+void testResumeAtEntry(const std::string& dir) {
+  constexpr size_t COUNT = 5000;
+  constexpr size_t INTERVAL = 16;
+  const std::string path = writeFeed(dir + "/resume.xml", 0, COUNT, "/opds/all?page=2", "");
+
+  std::vector<size_t> offsets;
+  OpdsParser parser;
+  parser.setEntryHandler([&](const size_t index, const OpdsEntry&) {
+    if (index % INTERVAL == 0) offsets.push_back(parser.getEntryOffset());
+  });
+  check(parseFile(path, parser), "feed with checkpoints parses");
+  check(offsets.size() == (COUNT + INTERVAL - 1) / INTERVAL, "an offset for every checkpoint");
+  check(parser.getPrologEnd() > 0 && parser.getPrologEnd() < offsets[0], "prolog ends before the first entry");
+
+  bool resumed = true;
+  for (const size_t checkpoint : {size_t{0}, size_t{1}, size_t{150}, offsets.size() - 1}) {
+    size_t seen = 0;
+    OpdsParser from;
+    from.setEntryHandler([&](const size_t local, const OpdsEntry& entry) {
+      resumed = resumed && entry.title == bookTitle(checkpoint * INTERVAL + local) &&
+                entry.href == bookHref(checkpoint * INTERVAL + local);
+      seen++;
+    });
+    resumed = parseFrom(path, parser.getPrologEnd(), offsets[checkpoint], from) && resumed;
+    resumed = resumed && seen == COUNT - checkpoint * INTERVAL;
+  }
+  check(resumed, "parse resumed at a checkpoint continues with the same entries");
+
+  if (bench) {
+    // The last window of the feed: from the start of the document, and from its checkpoint
+    const size_t target = COUNT - 30;
+    auto start = Clock::now();
+    {
+      OpdsParser full;
+      full.setEntryHandler([](size_t, const OpdsEntry&) {});
+      parseFile(path, full);
+    }
+    const double fromStartMs = msSince(start);
+    start = Clock::now();
+    {
+      OpdsParser from;
+      from.setEntryHandler([](size_t, const OpdsEntry&) {});
+      parseFrom(path, parser.getPrologEnd(), offsets[target / INTERVAL], from);
+    }
+    printf("window at entry %zu of %zu: %.2f ms from the start, %.2f ms from its checkpoint\n", target, COUNT,
+           fromStartMs, msSince(start));
+  }
+}
+
+void testArenaLimit() {
+  OpdsEntryWindow window(10, 100);
+  OpdsEntry entry;
+  entry.type = OpdsEntryType::BOOK;
+  entry.title = std::string(40, 't');
+  entry.author = "Same";
+  entry.href = std::string(40, 'h');
+  check(window.add(entry), "first entry fits");
+  entry.title = std::string(40, 'u');
+  entry.href = std::string(40, 'i');
+  check(!window.add(entry), "entry that overflows the arena is refused");
+  check(window.size() == 1 && window.arenaUsed() == 84, "refused entry leaves nothing in the arena");
+
+  // A repeat of stored strings costs nothing
+  entry.title = std::string(40, 't');
+  entry.href = std::string(40, 'h');
+  check(window.add(entry) && window.arenaUsed() == 84, "entry made of stored strings fits a full arena");
+
+  OpdsEntryWindow small(2, 1024);
+  small.reset(7);
+  check(small.add(entry) && small.add(entry) && !small.add(entry), "window refuses entries beyond its capacity");
+  check(small.contains(8) && !small.contains(9) && !small.contains(6), "positions start at the reset index");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--bench") bench = true;
+  }
+
+  char dirTemplate[] = "/tmp/opds_window_XXXXXX";
+  const std::string dir = mkdtemp(dirTemplate);
+
+  testPaginationLinks(dir);
+  testHandlerStreamsLargeFeed(dir);
+  testWindow(dir);
+  testResumeAtEntry(dir);
+  testArenaLimit();
+
+  for (const char* name : {"links", "last", "prev", "large", "p0", "p1", "p2"}) {
+    unlink((dir + "/" + name + ".xml").c_str());
+  }
+  rmdir(dir.c_str());
+
+  if (failures == 0) {
+    std::cout << "All OPDS window tests passed" << std::endl;
+    return 0;
+  }
+  std::cerr << failures << " test(s) failed" << std::endl;
+  return 1;
+}
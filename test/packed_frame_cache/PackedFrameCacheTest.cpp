@@ -0,0 +1,388 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "lib/GfxRenderer/Bitmap.h"
+#include "lib/GfxRenderer/GfxRenderer.h"
+#include "lib/GfxRenderer/PackedFrameCache.h"
+
+namespace {
+
+int failures = 0;
+
+void check(const bool condition, const std::string& message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << std::endl;
+    failures++;
+  }
+}
+
+void put16(std::vector<uint8_t>& out, const uint16_t v) {
+  out.push_back(v & 0xFF);
+  out.push_back(v >> 8);
+}
+
+void put32(std::vector<uint8_t>& out, const uint32_t v) {
+  for (int i = 0; i < 4; i++) out.push_back((v >> (8 * i)) & 0xFF);
+}
+
+// Write a bottom-up 24-bit BMP with a diagonal gradient and a dark frame, the common shape of user sleep images
+void writeTestBmp(const std::string& hostPath, const int width, const int height) {
+  const int rowBytes = (width * 3 + 3) & ~3;
+  std::vector<uint8_t> data;
+  data.reserve(54 + static_cast<size_t>(rowBytes) * height);
+  put16(data, 0x4D42);
+  put32(data, 54 + rowBytes * height);
+  put32(data, 0);
+  put32(data, 54);
+  put32(data, 40);
+  put32(data, width);
+  put32(data, height);
+  put16(data, 1);
+  put16(data, 24);
+  put32(data, 0);
+  put32(data, rowBytes * height);
+  put32(data, 2835);
+  put32(data, 2835);
+  put32(data, 0);
+  put32(data, 0);
+  for (int y = height - 1; y >= 0; y--) {
+    for (int x = 0; x < width; x++) {
+      const bool frame = x < 20 || y < 20 || x >= width - 20 || y >= height - 20;
+      const uint8_t v = frame ? 0 : static_cast<uint8_t>((x * 255 / width + y * 255 / height) / 2);
+      data.push_back(v);
+      data.push_back(static_cast<uint8_t>(v / 2 + 64));
+      data.push_back(static_cast<uint8_t>(255 - v));
+    }
+    for (int p = width * 3; p < rowBytes; p++) data.push_back(0);
+  }
+  std::FILE* f = std::fopen(hostPath.c_str(), "wb");
+  std::fwrite(data.data(), 1, data.size(), f);
+  std::fclose(f);
+}
+
+// Mirrors SleepActivity's decode path: BMP decode + drawBitmap per plane, capturing into `cache` when given
+bool renderDecoded(GfxRenderer& renderer, const std::string& path, PackedFrameCache* cache) {
+  FsFile file;
+  if (!Storage.openFileForRead("TEST", path, file)) return false;
+  if (cache && !cache->stampSource(file)) cache = nullptr;
+  Bitmap bitmap(file, true);
+  if (bitmap.parseHeaders() != BmpReaderError::Ok) return false;
+
+  const int w = renderer.getScreenWidth();
+  const int h = renderer.getScreenHeight();
+  renderer.clearScreen();
+  renderer.drawBitmap(bitmap, 0, 0, w, h);
+  if (cache && !cache->beginWrite(PackedFrameCache::MAX_PLANES)) cache = nullptr;
+  if (cache) cache->writePlane(renderer.getFrameBuffer());
+  renderer.displayBuffer(HalDisplay::HALF_REFRESH);
+
+  bitmap.rewindToData();
+  renderer.clearScreen(0x00);
+  renderer.setRenderMode(GfxRenderer::GRAYSCALE_LSB);
+  renderer.drawBitmap(bitmap, 0, 0, w, h);
+  if (cache) cache->writePlane(renderer.getFrameBuffer());
+  renderer.copyGrayscaleLsbBuffers();
+
+  bitmap.rewindToData();
+  renderer.clearScreen(0x00);
+  renderer.setRenderMode(GfxRenderer::GRAYSCALE_MSB);
+  renderer.drawBitmap(bitmap, 0, 0, w, h);
+  if (cache) cache->writePlane(renderer.getFrameBuffer());
+  renderer.copyGrayscaleMsbBuffers();
+
+  renderer.displayGrayBuffer();
+  renderer.setRenderMode(GfxRenderer::BW);
+  return !cache || cache->commit();
+}
+
+// Mirrors SleepActivity::renderCachedSleepScreen
+bool renderCached(GfxRenderer& renderer, const std::string& path, PackedFrameCache& cache) {
+  FsFile file;
+  if (!Storage.openFileForRead("TEST", path, file) || !cache.stampSource(file) || !cache.open()) return false;
+  uint8_t* frameBuffer = renderer.getFrameBuffer();
+  if (!cache.readPlane(frameBuffer)) return false;
+  renderer.displayBuffer(HalDisplay::HALF_REFRESH);
+  if (cache.getPlaneCount() == PackedFrameCache::MAX_PLANES) {
+    if (!cache.readPlane(frameBuffer)) return false;
+    renderer.copyGrayscaleLsbBuffers();
+    if (!cache.readPlane(frameBuffer)) return false;
+    renderer.copyGrayscaleMsbBuffers();
+    renderer.displayGrayBuffer();
+  }
+  cache.close();
+  return true;
+}
+
+struct Shown {
+  std::vector<uint8_t> bw, lsb, msb;
+};
+
+Shown capture(const HalDisplay& display) {
+  const auto n = HalDisplay::BUFFER_SIZE;
+  return {{display.shownBw, display.shownBw + n}, {display.lsb, display.lsb + n}, {display.msb, display.msb + n}};
+}
+
+double elapsedMs(const std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void testRoundTrip(HalDisplay& display, GfxRenderer& renderer, const std::string& source) {
+  const std::string cachePath = PackedFrameCache::pathFor("", source);
+  PackedFrameCache writer(cachePath, 1);
+  check(renderDecoded(renderer, source, &writer), "decode + capture");
+  check(Storage.exists(cachePath.c_str()), "cache file written");
+  check(!Storage.exists((cachePath + ".tmp").c_str()), "temporary file moved into place");
+  const Shown decoded = capture(display);
+
+  display.clearScreen(0xAA);
+  memset(display.shownBw, 0, HalDisplay::BUFFER_SIZE);
+  memset(display.lsb, 0, HalDisplay::BUFFER_SIZE);
+  memset(display.msb, 0, HalDisplay::BUFFER_SIZE);
+  const int refreshes = display.refreshCount;
+  const int grayRefreshes = display.grayRefreshCount;
+
+  PackedFrameCache reader(cachePath, 1);
+  check(renderCached(renderer, source, reader), "cached render");
+  const Shown cached = capture(display);
+  check(cached.bw == decoded.bw, "BW plane identical to decoded render");
+  check(cached.lsb == decoded.lsb, "LSB plane identical to decoded render");
+  check(cached.msb == decoded.msb, "MSB plane identical to decoded render");
+  check(display.refreshCount == refreshes + 1 && display.grayRefreshCount == grayRefreshes + 1,
+        "same refresh sequence as decoded render");
+}
+
+void testInvalidation(GfxRenderer& renderer, const std::string& source) {
+  const std::string cachePath = PackedFrameCache::pathFor("", source);
+  FsFile file;
+
+  {
+    PackedFrameCache cache(cachePath, 2);
+    Storage.openFileForRead("TEST", source, file);
+    check(cache.stampSource(file) && !cache.open(), "variant mismatch is a miss");
+    file.close();
+  }
+
+  {
+    // Truncate the cache: header is intact but the planes are short
+    std::vector<uint8_t> bytes(64 + HalDisplay::BUFFER_SIZE);
+    FsFile cacheFile;
+    Storage.openFileForRead("TEST", cachePath, cacheFile);
+    const int n = cacheFile.read(bytes.data(), bytes.size());
+    cacheFile.close();
+    const std::string truncatedPath = cachePath + ".short";
+    Storage.openFileForWrite("TEST", truncatedPath, cacheFile);
+    cacheFile.write(bytes.data(), n);
+    cacheFile.close();
+    PackedFrameCache cache(truncatedPath, 1);
+    Storage.openFileForRead("TEST", source, file);
+    check(cache.stampSource(file) && !cache.open(), "truncated cache is a miss");
+    file.close();
+    Storage.remove(truncatedPath.c_str());
+  }
+
+  {
+    // An interrupted write leaves neither a cache file nor a temporary behind
+    const std::string partialPath = cachePath + ".partial";
+    PackedFrameCache cache(partialPath, 1);
+    Storage.openFileForRead("TEST", source, file);
+    cache.stampSource(file);
+    file.close();
+    check(cache.beginWrite(PackedFrameCache::MAX_PLANES), "begin write");
+    check(cache.writePlane(renderer.getFrameBuffer()), "write one plane");
+    check(!cache.commit(), "commit with missing planes fails");
+    check(!Storage.exists(partialPath.c_str()) && !Storage.exists((partialPath + ".tmp").c_str()),
+          "incomplete write cleaned up");
+  }
+
+  {
+    // Replacing the source image (different size) invalidates the cache
+    writeTestBmp(Storage.hostPath(source), 472, 792);
+    PackedFrameCache cache(cachePath, 1);
+    Storage.openFileForRead("TEST", source, file);
+    check(cache.stampSource(file) && !cache.open(), "changed source is a miss");
+    file.close();
+  }
+}
+
+// A page of text in the BW plane: short dark runs on white lines, like a rendered reader page
+void drawTextLikePage(GfxRenderer& renderer) {
+  renderer.clearScreen();
+  const int w = renderer.getScreenWidth();
+  const int h = renderer.getScreenHeight();
+  for (int y = 40; y + 16 < h - 40; y += 28) {
+    int x = 30 + (y % 3) * 12;
+    for (int word = 0; x < w - 30; word++) {
+      const int width = 18 + (word * 37 + y) % 60;
+      renderer.fillRect(x, y + (word % 2), std::min(width, w - 30 - x), 14, true);
+      x += width + 9;
+    }
+  }
+}
+
+// Run and literal lengths around the 128-byte PackBits limits, which a page of text never hits
+void fillCodeBoundaries(uint8_t* frameBuffer) {
+  size_t out = 0;
+  uint8_t value = 0;
+  for (const size_t length : {1, 2, 3, 127, 128, 129, 130, 255, 256, 257}) {
+    memset(frameBuffer + out, value++, length);
+    out += length;
+    for (size_t i = 0; i < length; i++) frameBuffer[out + i] = static_cast<uint8_t>(i * 7 + 1);
+    out += length;
+  }
+  for (; out < HalDisplay::BUFFER_SIZE; out++) frameBuffer[out] = static_cast<uint8_t>(out * 131 >> 3);
+}
+
+size_t fileSize(const std::string& path) {
+  FsFile file;
+  if (!Storage.openFileForRead("TEST", path, file)) return 0;
+  const size_t size = file.fileSize();
+  file.close();
+  return size;
+}
+
+void testPackedPlanes(GfxRenderer& renderer, const std::string& source, const bool bench) {
+  const std::string cachePath = PackedFrameCache::pathFor("", source) + ".packed";
+  const auto n = HalDisplay::BUFFER_SIZE;
+  uint8_t* frameBuffer = renderer.getFrameBuffer();
+  FsFile file;
+
+  drawTextLikePage(renderer);
+  const std::vector<uint8_t> text(frameBuffer, frameBuffer + n);
+  fillCodeBoundaries(frameBuffer);
+  const std::vector<uint8_t> boundaries(frameBuffer, frameBuffer + n);
+  renderDecoded(renderer, source, nullptr);
+  const std::vector<uint8_t> image(frameBuffer, frameBuffer + n);
+
+  {
+    PackedFrameCache writer(cachePath, 1);
+    Storage.openFileForRead("TEST", source, file);
+    writer.stampSource(file);
+    file.close();
+    check(writer.beginWrite(PackedFrameCache::MAX_PLANES, true), "begin packed write");
+    check(writer.writePlane(text.data()) && writer.writePlane(boundaries.data()) && writer.writePlane(image.data()),
+          "write packed planes");
+    check(writer.commit(), "commit packed cache");
+  }
+
+  {
+    PackedFrameCache reader(cachePath, 1);
+    Storage.openFileForRead("TEST", source, file);
+    check(reader.stampSource(file) && reader.open(), "open packed cache");
+    file.close();
+    check(reader.readPlane(frameBuffer) && std::equal(text.begin(), text.end(), frameBuffer), "text plane round trip");
+    check(reader.readPlane(frameBuffer) && std::equal(boundaries.begin(), boundaries.end(), frameBuffer),
+          "run and literal boundaries round trip");
+    check(reader.readPlane(frameBuffer) && std::equal(image.begin(), image.end(), frameBuffer),
+          "dithered plane round trip");
+    check(!reader.readPlane(frameBuffer), "no plane past the last");
+  }
+
+  {
+    PackedFrameCache writer(cachePath, 1);
+    Storage.openFileForRead("TEST", source, file);
+    writer.stampSource(file);
+    file.close();
+    writer.beginWrite(1, true);
+    writer.writePlane(text.data());
+    writer.commit();
+    const size_t packedSize = fileSize(cachePath);
+    check(packedSize > 0 && packedSize < n, "text page packs smaller than the frame");
+    if (bench) {
+      std::cout << "Text page BW plane: " << n << " bytes raw, " << packedSize << " bytes packed" << std::endl;
+    }
+
+    // A plane whose codes claim more bytes than the file holds is rejected rather than read past
+    std::vector<uint8_t> bytes(packedSize);
+    Storage.openFileForRead("TEST", cachePath, file);
+    file.read(bytes.data(), bytes.size());
+    file.close();
+    bytes.resize(bytes.size() - 16);
+    Storage.openFileForWrite("TEST", cachePath, file);
+    file.write(bytes.data(), bytes.size());
+    file.close();
+    PackedFrameCache reader(cachePath, 1);
+    Storage.openFileForRead("TEST", source, file);
+    check(reader.stampSource(file) && reader.open(), "open cut packed cache");
+    file.close();
+    check(!reader.readPlane(frameBuffer), "cut packed plane is a miss");
+  }
+  Storage.remove(cachePath.c_str());
+}
+
+void runBenchmark(GfxRenderer& renderer, const std::string& source) {
+  constexpr int runs = 10;
+  const std::string cachePath = PackedFrameCache::pathFor("", source);
+
+  double decodeBest = 1e9;
+  for (int run = 0; run < runs; run++) {
+    const auto start = std::chrono::steady_clock::now();
+    renderDecoded(renderer, source, nullptr);
+    decodeBest = std::min(decodeBest, elapsedMs(start));
+  }
+
+  PackedFrameCache writer(cachePath, 1);
+  renderDecoded(renderer, source, &writer);
+
+  double cachedBest = 1e9;
+  for (int run = 0; run < runs; run++) {
+    PackedFrameCache reader(cachePath, 1);
+    const auto start = std::chrono::steady_clock::now();
+    renderCached(renderer, source, reader);
+    cachedBest = std::min(cachedBest, elapsedMs(start));
+  }
+
+  std::cout << "Sleep screen latency, 480x800 24-bit BMP with grayscale, excluding panel refresh (best of " << runs
+            << "):" << std::endl;
+  std::cout << std::fixed << std::setprecision(2) << "  decode + drawBitmap: " << decodeBest << " ms" << std::endl;
+  std::cout << "  packed frame cache:  " << cachedBest << " ms (" << std::setprecision(1) << decodeBest / cachedBest
+            << "x)" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  bool bench = false;
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--bench") bench = true;
+  }
+
+  char scratch[] = "/tmp/packed_frame_cache_XXXXXX";
+  if (!mkdtemp(scratch)) {
+    std::cerr << "Failed to create scratch directory" << std::endl;
+    return 1;
+  }
+  Storage.setRoot(scratch);
+
+  HalDisplay display;
+  GfxRenderer renderer(display);
+  renderer.begin();
+
+  const std::string source = "/sleep.bmp";
+  writeTestBmp(Storage.hostPath(source), 480, 800);
+
+  testRoundTrip(display, renderer, source);
+  testPackedPlanes(renderer, source, bench);
+  if (bench) runBenchmark(renderer, source);
+  testInvalidation(renderer, source);
+
+  std::remove(Storage.hostPath(source).c_str());
+  std::remove(Storage.hostPath(PackedFrameCache::pathFor("", source)).c_str());
+  rmdir(scratch);
+
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All packed frame cache tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,365 @@
+#include <HalStorage.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "src/network/ResumableDownload.h"
+
+namespace {
+
+int failures = 0;
+bool bench = false;
+
+void check(const bool condition, const std::string& message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << std::endl;
+    failures++;
+  }
+}
+
+constexpr char URL[] = "http://books.local/opds/book.epub";
+constexpr char DEST[] = "/book.epub";
+
+std::vector<uint8_t> randomBody(const size_t size, const uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::vector<uint8_t> body(size);
+  for (auto& byte : body) byte = static_cast<uint8_t>(rng());
+  return body;
+}
+
+// In-process stand-in for an HTTP server that honours Range and If-Range and drops connections part way through a
+// body. HTTPClient only exists on the device, so this plays the transport the downloader would drive.
+class FlakyServer final : public ResumableDownload::Transport {
+ public:
+  std::vector<uint8_t> body;
+  std::string etag = "\"v1\"";
+  std::string lastModified = "Tue, 03 Mar 2026 10:00:00 GMT";
+  bool sendLength = true;
+  bool honourRange = true;
+  size_t extraBytes = 0;   // Sent past the announced length
+  double dropChance = 0;   // Chance that a response is cut at a random offset
+  int refuseRequests = 0;  // Requests that get no response at all
+  std::mt19937 rng{1234};
+
+  int requests = 0;
+  int rangeRequests = 0;
+  size_t servedBytes = 0;
+  std::string lastIfRange;
+
+  bool request(const size_t rangeStart, const std::string& ifRange, ResumableDownload::Response& response) override {
+    requests++;
+    lastIfRange = ifRange;
+    if (refuseRequests > 0) {
+      refuseRequests--;
+      return false;
+    }
+    response = ResumableDownload::Response{};
+    response.etag = etag;
+    response.lastModified = lastModified;
+
+    const bool validatorMatches = ifRange.empty() || ifRange == etag || ifRange == lastModified;
+    if (rangeStart > 0 && honourRange && validatorMatches) {
+      rangeRequests++;
+      if (rangeStart >= body.size()) {
+        response.status = 416;
+        bodyBegin = bodyEnd = 0;
+        return true;
+      }
+      response.status = 206;
+      response.contentLength = static_cast<int64_t>(body.size() - rangeStart);
+      response.contentRange = "bytes " + std::to_string(rangeStart) + "-" + std::to_string(body.size() - 1) + "/" +
+                               std::to_string(body.size());
+      bodyBegin = rangeStart;
+    } else {
+      response.status = 200;
+      response.contentLength = sendLength ? static_cast<int64_t>(body.size()) : -1;
+      bodyBegin = 0;
+    }
+    bodyEnd = body.size() + extraBytes;
+    return true;
+  }
+
+  bool readBody(const Sink& sink) override {
+    size_t stop = bodyEnd;
+    const bool drop = std::uniform_real_distribution<double>(0, 1)(rng) < dropChance;
+    if (drop && bodyEnd > bodyBegin) {
+      stop = bodyBegin + std::uniform_int_distribution<size_t>(0, bodyEnd - bodyBegin - 1)(rng);
+    }
+    std::vector<uint8_t> chunk;
+    for (size_t pos = bodyBegin; pos < stop;) {
+      const size_t size = std::min(stop - pos, std::uniform_int_distribution<size_t>(1, 4096)(rng));
+      chunk.assign(size, 0);
+      for (size_t i = 0; i < size; i++) chunk[i] = pos + i < body.size() ? body[pos + i] : 0xAA;
+      servedBytes += size;
+      if (!sink(chunk.data(), size)) return false;
+      pos += size;
+    }
+    return !drop;
+  }
+
+  void end() override {}
+
+ private:
+  size_t bodyBegin = 0;
+  size_t bodyEnd = 0;
+};
+
+std::vector<uint8_t> readFile(const char* path) {
+  std::vector<uint8_t> data;
+  FILE* file = fopen(Storage.hostPath(path).c_str(), "rb");
+  if (!file) return data;
+  uint8_t buffer[4096];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) data.insert(data.end(), buffer, buffer + read);
+  fclose(file);
+  return data;
+}
+
+void writeFile(const char* path, const std::vector<uint8_t>& data) {
+  FILE* file = fopen(Storage.hostPath(path).c_str(), "wb");
+  fwrite(data.data(), 1, data.size(), file);
+  fclose(file);
+}
+
+bool leftovers() {
+  return Storage.exists((std::string(DEST) + ".part").c_str()) ||
+         Storage.exists((std::string(DEST) + ".part.state").c_str());
+}
+
+void reset() {
+  Storage.remove(DEST);
+  Storage.remove((std::string(DEST) + ".part").c_str());
+  Storage.remove((std::string(DEST) + ".part.state").c_str());
+}
+
+// FNV-1a over a file, standing in for the MD5 check on the device
+uint32_t fnv(FsFile& file) {
+  uint32_t hash = 2166136261u;
+  uint8_t buffer[1024];
+  int read;
+  while ((read = file.read(buffer, sizeof(buffer))) > 0) {
+    for (int i = 0; i < read; i++) hash = (hash ^ buffer[i]) * 16777619u;
+  }
+  return hash;
+}
+
+uint32_t fnv(const std::vector<uint8_t>& data) {
+  uint32_t hash = 2166136261u;
+  for (const uint8_t byte : data) hash = (hash ^ byte) * 16777619u;
+  return hash;
+}
+
+void testCleanDownload() {
+  reset();
+  FlakyServer server;
+  server.body = randomBody(300 * 1024, 1);
+  ResumableDownload download(URL, DEST);
+  size_t lastProgress = 0;
+  const auto result = download.run(server, [&](const size_t downloaded, size_t) { lastProgress = downloaded; });
+  check(result == ResumableDownload::Result::OK, "clean download succeeds");
+  check(readFile(DEST) == server.body, "clean download has the server's bytes");
+  check(!leftovers(), "clean download leaves no partial file or state");
+  check(server.requests == 1 && server.servedBytes == server.body.size(), "clean download is a single request");
+  check(lastProgress == server.body.size(), "progress reaches the full size");
+}
+
+void testRandomDisconnects() {
+  for (uint32_t seed = 1; seed <= 20; seed++) {
+    reset();
+    FlakyServer server;
+    server.body = randomBody(1024 * 1024 + seed * 777, seed);
+    server.dropChance = 0.8;
+    server.rng.seed(seed);
+    ResumableDownload download(URL, DEST);
+    const auto result = download.run(server, nullptr, nullptr, 100);
+    check(result == ResumableDownload::Result::OK, "download survives disconnects (seed " + std::to_string(seed) + ")");
+    check(readFile(DEST) == server.body, "resumed file matches the server (seed " + std::to_string(seed) + ")");
+    check(server.servedBytes == server.body.size(), "no byte is fetched twice (seed " + std::to_string(seed) + ")");
+    check(!leftovers(), "resumed download cleans up (seed " + std::to_string(seed) + ")");
+    if (bench) {
+      printf("seed %2u: %d requests, %d ranged\n", seed, server.requests, server.rangeRequests);
+    }
+  }
+}
+
+void testResumeAcrossReboot() {
+  reset();
+  FlakyServer server;
+  server.body = randomBody(2 * 1024 * 1024, 7);
+  server.dropChance = 1;
+  {
+    ResumableDownload download(URL, DEST);
+    check(download.run(server, nullptr, nullptr, 1) == ResumableDownload::Result::HTTP_ERROR,
+          "download gives up when out of attempts");
+  }
+  check(!Storage.exists(DEST), "destination only appears once complete");
+  const std::vector<uint8_t> partial = readFile("/book.epub.part");
+  check(!partial.empty() && Storage.exists("/book.epub.part.state"), "partial file and state are kept");
+
+  // Bytes that reached the card after the last state write aren't trusted
+  std::vector<uint8_t> torn = partial;
+  torn.insert(torn.end(), 5000, 0x55);
+  writeFile("/book.epub.part", torn);
+
+  server.dropChance = 0;
+  const size_t servedBefore = server.servedBytes;
+  ResumableDownload resumed(URL, DEST);
+  check(resumed.run(server) == ResumableDownload::Result::OK, "new download object resumes the partial file");
+  check(server.lastIfRange == server.etag, "resume sends the ETag as If-Range");
+  check(server.servedBytes - servedBefore == server.body.size() - partial.size(), "resume asks only for the rest");
+  check(readFile(DEST) == server.body, "torn tail is overwritten with the server's bytes");
+}
+
+void testChangedFileRestarts() {
+  reset();
+  FlakyServer server;
+  server.body = randomBody(600 * 1024, 11);
+  server.dropChance = 1;
+  ResumableDownload(URL, DEST).run(server, nullptr, nullptr, 1);
+  check(Storage.exists("/book.epub.part"), "first attempt leaves a partial file");
+
+  server.body = randomBody(500 * 1024, 12);
+  server.etag = "\"v2\"";
+  server.lastModified = "Wed, 04 Mar 2026 10:00:00 GMT";
+  server.dropChance = 0;
+  check(ResumableDownload(URL, DEST).run(server) == ResumableDownload::Result::OK, "changed file downloads again");
+  check(readFile(DEST) == server.body, "changed file is not spliced onto the old one");
+}
+
+void testWeakEtagUsesLastModified() {
+  reset();
+  FlakyServer server;
+  server.body = randomBody(400 * 1024, 13);
+  server.etag = "W/\"weak\"";
+  server.dropChance = 1;
+  ResumableDownload(URL, DEST).run(server, nullptr, nullptr, 1);
+  server.dropChance = 0;
+  check(ResumableDownload(URL, DEST).run(server) == ResumableDownload::Result::OK, "weak ETag download resumes");
+  check(server.lastIfRange == server.lastModified, "weak ETag falls back to Last-Modified for If-Range");
+  check(readFile(DEST) == server.body, "weak ETag resume has the right bytes");
+}
+
+void testServerIgnoresRange() {
+  reset();
+  FlakyServer server;
+  server.body = randomBody(700 * 1024, 17);
+  server.honourRange = false;
+  server.dropChance = 0.7;
+  server.rng.seed(17);
+  check(ResumableDownload(URL, DEST).run(server, nullptr, nullptr, 50) == ResumableDownload::Result::OK,
+        "server without Range support still completes");
+  check(readFile(DEST) == server.body, "full responses replace the partial file");
+}
+
+void testUnknownLength() {
+  reset();
+  FlakyServer server;
+  server.body = randomBody(200 * 1024, 19);
+  server.sendLength = false;
+  server.dropChance = 1;
+  ResumableDownload(URL, DEST).run(server, nullptr, nullptr, 1);
+  check(!leftovers(), "a download without Content-Length isn't kept for resuming");
+  server.dropChance = 0;
+  check(ResumableDownload(URL, DEST).run(server) == ResumableDownload::Result::OK, "unknown length completes");
+  check(readFile(DEST) == server.body, "unknown length download has the right bytes");
+}
+
+void testChecksum() {
+  reset();
+  FlakyServer server;
+  server.body = randomBody(300 * 1024, 23);
+  server.dropChance = 0.5;
+  const uint32_t expected = fnv(server.body);
+  check(ResumableDownload(URL, DEST).run(server, nullptr, [&](FsFile& file) { return fnv(file) == expected; }, 50) ==
+            ResumableDownload::Result::OK,
+        "matching checksum is accepted");
+  check(readFile(DEST) == server.body, "verified file is moved into place");
+
+  std::vector<uint8_t> old = {'o', 'l', 'd'};
+  writeFile(DEST, old);
+  server.dropChance = 0;
+  check(ResumableDownload(URL, DEST).run(server, nullptr, [](FsFile&) { return false; }) ==
+            ResumableDownload::Result::CHECKSUM_ERROR,
+        "checksum mismatch is reported");
+  check(readFile(DEST) == old, "checksum mismatch leaves the existing file alone");
+  check(!leftovers(), "checksum mismatch discards the partial file");
+}
+
+void testBrokenResponses() {
+  reset();
+  FlakyServer server;
+  server.body = randomBody(100 * 1024, 29);
+  server.extraBytes = 10;
+  check(ResumableDownload(URL, DEST).run(server) == ResumableDownload::Result::HTTP_ERROR,
+        "body longer than Content-Length is rejected");
+  check(!Storage.exists(DEST) && !leftovers(), "overlong body leaves nothing behind");
+
+  reset();
+  server.extraBytes = 0;
+  server.refuseRequests = 2;
+  check(ResumableDownload(URL, DEST).run(server) == ResumableDownload::Result::OK, "failed connects are retried");
+
+  // A state record cut short is ignored
+  reset();
+  server.dropChance = 1;
+  ResumableDownload(URL, DEST).run(server, nullptr, nullptr, 1);
+  std::vector<uint8_t> state = readFile("/book.epub.part.state");
+  state.resize(state.size() / 2);
+  writeFile("/book.epub.part.state", state);
+  server.dropChance = 0;
+  const int rangedBefore = server.rangeRequests;
+  check(ResumableDownload(URL, DEST).run(server) == ResumableDownload::Result::OK, "torn state restarts cleanly");
+  check(server.rangeRequests == rangedBefore, "torn state isn't used for a range request");
+  check(readFile(DEST) == server.body, "restart after torn state has the right bytes");
+
+  // A state record for another URL is ignored
+  reset();
+  server.dropChance = 1;
+  ResumableDownload("http://books.local/other.epub", DEST).run(server, nullptr, nullptr, 1);
+  server.dropChance = 0;
+  check(ResumableDownload(URL, DEST).run(server) == ResumableDownload::Result::OK &&
+            server.rangeRequests == rangedBefore,
+        "partial file of another URL isn't resumed");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--bench") bench = true;
+  }
+
+  char scratch[] = "/tmp/resumable_download_XXXXXX";
+  if (!mkdtemp(scratch)) {
+    std::cerr << "Failed to create scratch directory" << std::endl;
+    return 1;
+  }
+  Storage.setRoot(scratch);
+
+  testCleanDownload();
+  testRandomDisconnects();
+  testResumeAcrossReboot();
+  testChangedFileRestarts();
+  testWeakEtagUsesLastModified();
+  testServerIgnoresRange();
+  testUnknownLength();
+  testChecksum();
+  testBrokenResponses();
+
+  reset();
+  rmdir(scratch);
+
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All resumable download tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,39 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+BUILD_DIR="$ROOT_DIR/build/delta_patch"
+BINARY="$BUILD_DIR/DeltaPatchTest"
+
+mkdir -p "$BUILD_DIR"
+
+# Two builds of the same program stand in for consecutive firmware releases
+for VARIANT in 1 2; do
+  c++ -std=c++20 -O2 -DFIRMWARE_VARIANT="$VARIANT" "$ROOT_DIR/test/delta_patch/Firmware.cpp" \
+    -o "$BUILD_DIR/firmware$VARIANT.bin"
+done
+python3 "$ROOT_DIR/scripts/make_delta_patch.py" "$BUILD_DIR/firmware1.bin" "$BUILD_DIR/firmware2.bin" \
+  "$BUILD_DIR/firmware.patch"
+
+SOURCES=(
+  "$ROOT_DIR/test/delta_patch/DeltaPatchTest.cpp"
+  "$ROOT_DIR/lib/DeltaPatch/DeltaPatch.cpp"
+  "$ROOT_DIR/lib/InflateReader/InflateReader.cpp"
+)
+
+CXXFLAGS=(
+  -std=c++20
+  -O2
+  -Wall
+  # Host stand-ins for logging and mbedtls; must come before lib/hal
+  -I"$ROOT_DIR/test/host"
+  -I"$ROOT_DIR/lib/DeltaPatch"
+  -I"$ROOT_DIR/lib/InflateReader"
+  -I"$ROOT_DIR/lib/uzlib/src"
+)
+
+# Only the raw inflate entry points are used, so drop the checksum helpers uzlib references
+cc -O2 -ffunction-sections -c "$ROOT_DIR/lib/uzlib/src/tinflate.c" -o "$BUILD_DIR/tinflate.o"
+c++ "${CXXFLAGS[@]}" -ffunction-sections "${SOURCES[@]}" "$BUILD_DIR/tinflate.o" -Wl,--gc-sections -o "$BINARY"
+
+"$BINARY" "$BUILD_DIR/firmware1.bin" "$BUILD_DIR/firmware2.bin" "$BUILD_DIR/firmware.patch" "$@"
@@ -0,0 +1,35 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+BUILD_DIR="$ROOT_DIR/build/dictionary"
+BINARY="$BUILD_DIR/DictionaryTest"
+
+mkdir -p "$BUILD_DIR"
+
+SOURCES=(
+  "$ROOT_DIR/test/dictionary/DictionaryTest.cpp"
+  "$ROOT_DIR/lib/Dictionary/Dictionary.cpp"
+  "$ROOT_DIR/lib/InflateReader/InflateReader.cpp"
+  "$ROOT_DIR/lib/Utf8/Utf8.cpp"
+)
+
+CXXFLAGS=(
+  -std=c++20
+  -O2
+  -Wall
+  # Host stand-ins for Arduino, logging, the watchdog and the SD card
+  -I"$ROOT_DIR/test/host"
+  -I"$ROOT_DIR/lib/Dictionary"
+  -I"$ROOT_DIR/lib/InflateReader"
+  -I"$ROOT_DIR/lib/Utf8"
+  -I"$ROOT_DIR/lib/uzlib/src"
+  # The test compresses its synthetic dictionary the way users are told to
+  -DDICTZIP_SCRIPT="\"$ROOT_DIR/scripts/dictzip.py\""
+)
+
+# Only the raw inflate entry points are used, so drop the checksum helpers uzlib references
+cc -O2 -ffunction-sections -c "$ROOT_DIR/lib/uzlib/src/tinflate.c" -o "$BUILD_DIR/tinflate.o"
+c++ "${CXXFLAGS[@]}" -ffunction-sections "${SOURCES[@]}" "$BUILD_DIR/tinflate.o" -Wl,--gc-sections -o "$BINARY"
+
+"$BINARY" "$@"
@@ -0,0 +1,27 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+BUILD_DIR="$ROOT_DIR/build/directory_index"
+BINARY="$BUILD_DIR/DirectoryIndexTest"
+
+mkdir -p "$BUILD_DIR"
+
+SOURCES=(
+  "$ROOT_DIR/test/directory_index/DirectoryIndexTest.cpp"
+  "$ROOT_DIR/lib/DirectoryIndex/DirectoryIndex.cpp"
+)
+
+CXXFLAGS=(
+  -std=c++20
+  -O2
+  -Wall
+  -I"$ROOT_DIR"
+  # Host stand-ins for logging, ESP-IDF and the SD card; must come before lib/hal
+  -I"$ROOT_DIR/test/host"
+  -I"$ROOT_DIR/lib/Serialization"
+)
+
+c++ "${CXXFLAGS[@]}" "${SOURCES[@]}" -o "$BINARY"
+
+"$BINARY" "$@"
@@ -0,0 +1,31 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+BUILD_DIR="$ROOT_DIR/build/image_downscaler"
+BINARY="$BUILD_DIR/ImageDownscalerTest"
+
+mkdir -p "$BUILD_DIR"
+
+SOURCES=(
+  "$ROOT_DIR/test/image_downscaler/ImageDownscalerTest.cpp"
+  "$ROOT_DIR/lib/GfxRenderer/ImageDownscaler.cpp"
+  "$ROOT_DIR/lib/GfxRenderer/BitmapHelpers.cpp"
+)
+
+CXXFLAGS=(
+  -std=c++20
+  -O2
+  -Wall
+  -Wextra
+  -pedantic
+  -I"$ROOT_DIR"
+  -I"$ROOT_DIR/lib/GfxRenderer"
+  # Host stand-ins for the Arduino/SdFat headers pulled in through Bitmap.h
+  -I"$ROOT_DIR/test/image_downscaler/host"
+)
+
+c++ "${CXXFLAGS[@]}" "${SOURCES[@]}" -o "$BINARY"
+
+# Pass --bench for the throughput benchmark, --dump <dir> to write PGM output images
+"$BINARY" "$@"
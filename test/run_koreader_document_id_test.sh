@@ -0,0 +1,29 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+BUILD_DIR="$ROOT_DIR/build/koreader_document_id"
+BINARY="$BUILD_DIR/KOReaderDocumentIdTest"
+
+mkdir -p "$BUILD_DIR"
+
+SOURCES=(
+  "$ROOT_DIR/test/koreader_document_id/KOReaderDocumentIdTest.cpp"
+  "$ROOT_DIR/lib/KOReaderSync/KOReaderDocumentId.cpp"
+  "$ROOT_DIR/lib/KOReaderSync/KOReaderDocumentIdCache.cpp"
+  "$ROOT_DIR/lib/FsHelpers/FsHelpers.cpp"
+)
+
+CXXFLAGS=(
+  -std=c++20
+  -O2
+  -Wall
+  -I"$ROOT_DIR"
+  # Host stand-ins for logging, MD5Builder and the SD card; must come before lib/hal
+  -I"$ROOT_DIR/test/host"
+  -I"$ROOT_DIR/lib/FsHelpers"
+)
+
+c++ "${CXXFLAGS[@]}" "${SOURCES[@]}" -o "$BINARY"
+
+"$BINARY" "$@"
@@ -0,0 +1,29 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+BUILD_DIR="$ROOT_DIR/build/library_db"
+BINARY="$BUILD_DIR/LibraryDbTest"
+
+mkdir -p "$BUILD_DIR"
+
+SOURCES=(
+  "$ROOT_DIR/test/library_db/LibraryDbTest.cpp"
+  "$ROOT_DIR/lib/LibraryDb/LibraryDb.cpp"
+  "$ROOT_DIR/lib/DirectoryIndex/DirectoryIndex.cpp"
+)
+
+CXXFLAGS=(
+  -std=c++20
+  -O2
+  -Wall
+  -I"$ROOT_DIR"
+  # Host stand-ins for logging, ESP-IDF and the SD card; must come before lib/hal
+  -I"$ROOT_DIR/test/host"
+  -I"$ROOT_DIR/lib/Serialization"
+  -I"$ROOT_DIR/lib/DirectoryIndex"
+)
+
+c++ "${CXXFLAGS[@]}" "${SOURCES[@]}" -o "$BINARY"
+
+"$BINARY" "$@"
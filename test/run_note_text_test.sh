@@ -0,0 +1,43 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+BUILD_DIR="$ROOT_DIR/build/note_text"
+BINARY="$BUILD_DIR/NoteTextTest"
+
+mkdir -p "$BUILD_DIR"
+
+# Same expat configuration as platformio.ini
+EXPAT_FLAGS=(
+  -DXML_GE=0
+  -DXML_CONTEXT_BYTES=1024
+  -I"$ROOT_DIR/lib/expat"
+)
+
+EXPAT_OBJECTS=()
+for source in xmlparse xmlrole xmltok; do
+  cc -O2 "${EXPAT_FLAGS[@]}" -c "$ROOT_DIR/lib/expat/$source.c" -o "$BUILD_DIR/$source.o"
+  EXPAT_OBJECTS+=("$BUILD_DIR/$source.o")
+done
+
+SOURCES=(
+  "$ROOT_DIR/test/note_text/NoteTextTest.cpp"
+  "$ROOT_DIR/lib/Epub/Epub/parsers/NoteTextParser.cpp"
+  "$ROOT_DIR/lib/Epub/Epub/htmlEntities.cpp"
+  "$ROOT_DIR/lib/Utf8/Utf8.cpp"
+)
+
+CXXFLAGS=(
+  -std=c++20
+  -O2
+  -Wall
+  -I"$ROOT_DIR"
+  # Host stand-ins for Arduino and logging
+  -I"$ROOT_DIR/test/host"
+  -I"$ROOT_DIR/lib/Utf8"
+  "${EXPAT_FLAGS[@]}"
+)
+
+c++ "${CXXFLAGS[@]}" "${SOURCES[@]}" "${EXPAT_OBJECTS[@]}" -o "$BINARY"
+
+"$BINARY" "$@"
@@ -0,0 +1,48 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+BUILD_DIR="$ROOT_DIR/build/search_index"
+BINARY="$BUILD_DIR/SearchIndexTest"
+
+mkdir -p "$BUILD_DIR"
+
+# Same expat configuration as platformio.ini
+EXPAT_FLAGS=(
+  -DXML_GE=0
+  -DXML_CONTEXT_BYTES=1024
+  -I"$ROOT_DIR/lib/expat"
+)
+
+EXPAT_OBJECTS=()
+for source in xmlparse xmlrole xmltok; do
+  cc -O2 "${EXPAT_FLAGS[@]}" -c "$ROOT_DIR/lib/expat/$source.c" -o "$BUILD_DIR/$source.o"
+  EXPAT_OBJECTS+=("$BUILD_DIR/$source.o")
+done
+
+SOURCES=(
+  "$ROOT_DIR/test/search_index/SearchIndexTest.cpp"
+  "$ROOT_DIR/lib/Epub/Epub/SearchIndex.cpp"
+  "$ROOT_DIR/lib/Epub/Epub/XPathMap.cpp"
+  "$ROOT_DIR/lib/Epub/Epub/htmlEntities.cpp"
+  "$ROOT_DIR/lib/Epub/Epub/hyphenation/HyphenationCommon.cpp"
+  "$ROOT_DIR/lib/Utf8/Utf8.cpp"
+)
+
+CXXFLAGS=(
+  -std=c++20
+  -O2
+  -Wall
+  -I"$ROOT_DIR"
+  # Host stand-ins for Arduino, logging, the watchdog and the SD card
+  -I"$ROOT_DIR/test/host"
+  -I"$ROOT_DIR/lib/Serialization"
+  -I"$ROOT_DIR/lib/Utf8"
+  "${EXPAT_FLAGS[@]}"
+  # Chapters are read straight out of the bundled books
+  -DTEST_EPUB_DIR="\"$ROOT_DIR/test/epubs\""
+)
+
+c++ "${CXXFLAGS[@]}" "${SOURCES[@]}" "${EXPAT_OBJECTS[@]}" -o "$BINARY"
+
+"$BINARY" "$@"
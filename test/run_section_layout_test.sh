@@ -0,0 +1,72 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+BUILD_DIR="$ROOT_DIR/build/section_layout"
+BINARY="$BUILD_DIR/SectionLayoutTest"
+
+mkdir -p "$BUILD_DIR"
+
+# Same expat configuration as platformio.ini
+EXPAT_FLAGS=(
+  -DXML_GE=0
+  -DXML_CONTEXT_BYTES=1024
+  -I"$ROOT_DIR/lib/expat"
+)
+
+OBJECTS=()
+for source in xmlparse xmlrole xmltok; do
+  cc -O2 "${EXPAT_FLAGS[@]}" -c "$ROOT_DIR/lib/expat/$source.c" -o "$BUILD_DIR/$source.o"
+  OBJECTS+=("$BUILD_DIR/$source.o")
+done
+# ZipFile and the font decompressor only inflate through the raw entry points
+cc -O2 -ffunction-sections -c "$ROOT_DIR/lib/uzlib/src/tinflate.c" -o "$BUILD_DIR/tinflate.o"
+cc -O2 -c "$ROOT_DIR/lib/picojpeg/picojpeg.c" -o "$BUILD_DIR/picojpeg.o"
+OBJECTS+=("$BUILD_DIR/tinflate.o" "$BUILD_DIR/picojpeg.o")
+
+# The whole EPUB pipeline except the JPEG and PNG framebuffer decoders, which the test stubs out
+SOURCES=(
+  "$ROOT_DIR/test/section_layout/SectionLayoutTest.cpp"
+  "$ROOT_DIR/lib/Epub/Epub.cpp"
+  "$ROOT_DIR"/lib/Epub/Epub/*.cpp
+  "$ROOT_DIR"/lib/Epub/Epub/parsers/*.cpp
+  "$ROOT_DIR"/lib/Epub/Epub/blocks/*.cpp
+  "$ROOT_DIR"/lib/Epub/Epub/css/*.cpp
+  "$ROOT_DIR"/lib/Epub/Epub/hyphenation/*.cpp
+  "$ROOT_DIR/lib/Epub/Epub/converters/ImageToFramebufferDecoder.cpp"
+  "$ROOT_DIR"/lib/GfxRenderer/*.cpp
+  "$ROOT_DIR"/lib/EpdFont/*.cpp
+  "$ROOT_DIR/lib/ZipFile/ZipFile.cpp"
+  "$ROOT_DIR/lib/InflateReader/InflateReader.cpp"
+  "$ROOT_DIR/lib/JpegToBmpConverter/JpegToBmpConverter.cpp"
+  "$ROOT_DIR/lib/PngToBmpConverter/PngToBmpConverter.cpp"
+  "$ROOT_DIR/lib/FsHelpers/FsHelpers.cpp"
+  "$ROOT_DIR/lib/Utf8/Utf8.cpp"
+)
+
+CXXFLAGS=(
+  -std=c++20
+  -O2
+  -Wall
+  -I"$ROOT_DIR"
+  # Host stand-ins for the Arduino core, logging, SD card and display; must come before lib/hal
+  -I"$ROOT_DIR/test/host"
+  -I"$ROOT_DIR/lib/Epub"
+  -I"$ROOT_DIR/lib/GfxRenderer"
+  -I"$ROOT_DIR/lib/EpdFont"
+  -I"$ROOT_DIR/lib/Serialization"
+  -I"$ROOT_DIR/lib/Utf8"
+  -I"$ROOT_DIR/lib/FsHelpers"
+  -I"$ROOT_DIR/lib/ZipFile"
+  -I"$ROOT_DIR/lib/InflateReader"
+  -I"$ROOT_DIR/lib/JpegToBmpConverter"
+  -I"$ROOT_DIR/lib/PngToBmpConverter"
+  -I"$ROOT_DIR/lib/picojpeg"
+  -I"$ROOT_DIR/lib/uzlib/src"
+  "${EXPAT_FLAGS[@]}"
+)
+
+c++ "${CXXFLAGS[@]}" -ffunction-sections "${SOURCES[@]}" "${OBJECTS[@]}" -Wl,--gc-sections -o "$BINARY"
+
+# Pass --bench for the time to the first page of a long chapter, laid out in full or only up to that page
+"$BINARY" "$@"
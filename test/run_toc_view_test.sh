@@ -0,0 +1,62 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+BUILD_DIR="$ROOT_DIR/build/toc_view"
+BINARY="$BUILD_DIR/TocViewTest"
+
+mkdir -p "$BUILD_DIR"
+
+# Same expat configuration as platformio.ini
+EXPAT_FLAGS=(
+  -DXML_GE=0
+  -DXML_CONTEXT_BYTES=1024
+  -I"$ROOT_DIR/lib/expat"
+)
+
+EXPAT_OBJECTS=()
+for source in xmlparse xmlrole xmltok; do
+  cc -O2 "${EXPAT_FLAGS[@]}" -c "$ROOT_DIR/lib/expat/$source.c" -o "$BUILD_DIR/$source.o"
+  EXPAT_OBJECTS+=("$BUILD_DIR/$source.o")
+done
+# ZipFile only inflates through the raw entry points
+cc -O2 -ffunction-sections -c "$ROOT_DIR/lib/uzlib/src/tinflate.c" -o "$BUILD_DIR/tinflate.o"
+
+SOURCES=(
+  "$ROOT_DIR/test/toc_view/TocViewTest.cpp"
+  "$ROOT_DIR/lib/Epub/Epub/TocView.cpp"
+  "$ROOT_DIR/lib/Epub/Epub/BookMetadataCache.cpp"
+  "$ROOT_DIR/lib/Epub/Epub/parsers/TocNcxParser.cpp"
+  "$ROOT_DIR/lib/Epub/Epub/parsers/TocNavParser.cpp"
+  "$ROOT_DIR/lib/Epub/Epub/SearchIndex.cpp"
+  "$ROOT_DIR/lib/Epub/Epub/XPathMap.cpp"
+  "$ROOT_DIR/lib/Epub/Epub/htmlEntities.cpp"
+  "$ROOT_DIR/lib/Epub/Epub/hyphenation/HyphenationCommon.cpp"
+  "$ROOT_DIR/lib/FsHelpers/FsHelpers.cpp"
+  "$ROOT_DIR/lib/ZipFile/ZipFile.cpp"
+  "$ROOT_DIR/lib/InflateReader/InflateReader.cpp"
+  "$ROOT_DIR/lib/Utf8/Utf8.cpp"
+)
+
+CXXFLAGS=(
+  -std=c++20
+  -O2
+  -Wall
+  -I"$ROOT_DIR"
+  # Host stand-ins for Arduino, logging, the watchdog and the SD card
+  -I"$ROOT_DIR/test/host"
+  -I"$ROOT_DIR/lib/Serialization"
+  -I"$ROOT_DIR/lib/Utf8"
+  -I"$ROOT_DIR/lib/FsHelpers"
+  -I"$ROOT_DIR/lib/ZipFile"
+  -I"$ROOT_DIR/lib/InflateReader"
+  -I"$ROOT_DIR/lib/uzlib/src"
+  # ZipFile.h gets Print from the Arduino core on the device
+  -include "$ROOT_DIR/test/host/Print.h"
+  "${EXPAT_FLAGS[@]}"
+)
+
+c++ "${CXXFLAGS[@]}" -ffunction-sections "${SOURCES[@]}" "${EXPAT_OBJECTS[@]}" "$BUILD_DIR/tinflate.o" \
+  -Wl,--gc-sections -o "$BINARY"
+
+"$BINARY" "$@"
@@ -0,0 +1,27 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+BUILD_DIR="$ROOT_DIR/build/xtc_parser"
+BINARY="$BUILD_DIR/XtcParserTest"
+
+mkdir -p "$BUILD_DIR"
+
+SOURCES=(
+  "$ROOT_DIR/test/xtc_parser/XtcParserTest.cpp"
+  "$ROOT_DIR/lib/Xtc/Xtc/XtcParser.cpp"
+)
+
+CXXFLAGS=(
+  -std=c++20
+  -O2
+  -Wall
+  -I"$ROOT_DIR"
+  # Host stand-ins for logging and the SD card
+  -I"$ROOT_DIR/test/host"
+)
+
+c++ "${CXXFLAGS[@]}" "${SOURCES[@]}" -o "$BINARY"
+
+# Pass --bench for page table lookup cost
+"$BINARY" "$@"
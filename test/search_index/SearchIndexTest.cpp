@@ -0,0 +1,531 @@
+#include <HalStorage.h>
+#include <expat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "lib/Epub/Epub/SearchIndex.h"
+#include "lib/Epub/Epub/XPathMap.h"
+
+// Heap accounting: every allocation carries its size so peak usage can be measured around a call
+namespace heap {
+std::atomic<size_t> live{0};
+std::atomic<size_t> peak{0};
+
+void* allocate(const size_t size) {
+  auto* block = static_cast<size_t*>(std::malloc(size + sizeof(std::max_align_t)));
+  if (!block) throw std::bad_alloc();
+  *block = size;
+  const size_t now = live += size;
+  size_t seen = peak;
+  while (now > seen && !peak.compare_exchange_weak(seen, now)) {
+  }
+  return reinterpret_cast<char*>(block) + sizeof(std::max_align_t);
+}
+
+void release(void* ptr) {
+  if (!ptr) return;
+  auto* block = reinterpret_cast<size_t*>(static_cast<char*>(ptr) - sizeof(std::max_align_t));
+  live -= *block;
+  std::free(block);
+}
+
+// Peak heap above the current level while `fn` runs
+template <typename Fn>
+size_t peakDuring(Fn fn) {
+  const size_t base = live;
+  peak = base;
+  fn();
+  return peak - base;
+}
+}  // namespace heap
+
+void* operator new(const size_t size) { return heap::allocate(size); }
+void* operator new[](const size_t size) { return heap::allocate(size); }
+void operator delete(void* ptr) noexcept { heap::release(ptr); }
+void operator delete[](void* ptr) noexcept { heap::release(ptr); }
+void operator delete(void* ptr, size_t) noexcept { heap::release(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { heap::release(ptr); }
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using Words = std::vector<std::string>;
+
+int failures = 0;
+bool bench = false;
+
+constexpr char INDEX_DIR[] = "/search";
+const char* BOOKS[] = {"test_jpeg_images.epub", "test_kerning_ligature.epub", "test_mixed_images.epub",
+                       "test_png_images.epub", "test_tables.epub"};
+
+void check(const bool condition, const std::string& message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << std::endl;
+    failures++;
+  }
+}
+
+double msSince(const Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+std::string runCommand(const std::string& command) {
+  std::string output;
+  FILE* pipe = popen(command.c_str(), "r");
+  if (!pipe) return output;
+  char buffer[4096];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), pipe)) > 0) output.append(buffer, read);
+  pclose(pipe);
+  return output;
+}
+
+std::string epubPath(const std::string& name) { return std::string(TEST_EPUB_DIR) + "/" + name; }
+
+std::string readEntry(const std::string& epub, const std::string& entry) {
+  return runCommand("unzip -p '" + epubPath(epub) + "' '" + entry + "'");
+}
+
+std::vector<std::string> chapterEntries(const std::string& epub) {
+  std::vector<std::string> entries;
+  const std::string listing = runCommand("unzip -Z1 '" + epubPath(epub) + "'");
+  size_t start = 0;
+  while (start < listing.size()) {
+    size_t end = listing.find('\n', start);
+    if (end == std::string::npos) end = listing.size();
+    const std::string entry = listing.substr(start, end - start);
+    if (entry.size() > 6 && (entry.compare(entry.size() - 6, 6, ".xhtml") == 0 ||
+                             entry.compare(entry.size() - 5, 5, ".html") == 0)) {
+      entries.push_back(entry);
+    }
+    start = end + 1;
+  }
+  return entries;
+}
+
+void removeTree(const std::string& hostDir) {
+  const std::string command = "rm -rf '" + hostDir + "'";
+  check(std::system(command.c_str()) == 0, "remove " + hostDir);
+}
+
+size_t fileSize(const std::string& hostPath) {
+  FILE* f = std::fopen(hostPath.c_str(), "rb");
+  if (!f) return 0;
+  std::fseek(f, 0, SEEK_END);
+  const auto size = static_cast<size_t>(std::ftell(f));
+  std::fclose(f);
+  return size;
+}
+
+size_t indexSize() {
+  return fileSize(Storage.hostPath("/search/terms.bin")) + fileSize(Storage.hostPath("/search/postings.bin")) +
+         fileSize(Storage.hostPath("/search/text.bin"));
+}
+
+// Writes each chapter to the builder in pieces, as the book's zip stream does
+bool buildIndex(const std::vector<std::string>& chapters) {
+  SearchIndexBuilder builder(INDEX_DIR);
+  if (!builder.begin()) return false;
+  for (size_t i = 0; i < chapters.size(); i++) {
+    const auto& xhtml = chapters[i];
+    if (builder.beginItem(static_cast<uint16_t>(i), xhtml.size())) {
+      for (size_t pos = 0; pos < xhtml.size(); pos += 1000) {
+        const size_t length = std::min<size_t>(1000, xhtml.size() - pos);
+        builder.write(reinterpret_cast<const uint8_t*>(xhtml.data()) + pos, length);
+      }
+    }
+    builder.endItem();
+  }
+  return builder.finish();
+}
+
+std::vector<std::string> bookChapters(const std::string& epub) {
+  std::vector<std::string> chapters;
+  for (const auto& entry : chapterEntries(epub)) chapters.push_back(readEntry(epub, entry));
+  return chapters;
+}
+
+std::string xhtml(const std::string& body) {
+  return "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+         "<!DOCTYPE html PUBLIC \"-//W3C//DTD XHTML 1.1//EN\" \"http://www.w3.org/TR/xhtml11/DTD/xhtml11.dtd\">\n"
+         "<html xmlns=\"http://www.w3.org/1999/xhtml\"><head><title>Title words</title></head>\n<body>" +
+         body + "</body></html>";
+}
+
+// Offsets the section's XPath map gives the body characters of a chapter, and the body text with one space between
+// words, so tests can tell where a word should be
+struct Reference {
+  XPathMap map;
+  bool inBody = false;
+  std::vector<uint32_t> offsets;  // per byte of `text`
+  std::string text;
+
+  static void XMLCALL onStart(void* userData, const XML_Char* name, const XML_Char**) {
+    auto* self = static_cast<Reference*>(userData);
+    self->map.startElement(name);
+    if (strcmp(name, "body") == 0) self->inBody = true;
+    self->text += ' ';
+    self->offsets.push_back(0);
+  }
+
+  static void XMLCALL onEnd(void* userData, const XML_Char* name) {
+    auto* self = static_cast<Reference*>(userData);
+    self->map.endElement();
+    if (strcmp(name, "body") == 0) self->inBody = false;
+  }
+
+  static void XMLCALL onText(void* userData, const XML_Char* s, const int len) {
+    auto* self = static_cast<Reference*>(userData);
+    for (int i = 0; i < len; i++) {
+      self->map.character(s[i]);
+      if (!self->inBody) continue;
+      self->text += s[i];
+      self->offsets.push_back(self->map.lastOffset());
+    }
+  }
+
+  explicit Reference(const std::string& xhtml) {
+    XML_Parser parser = XML_ParserCreate(nullptr);
+    XML_SetUserData(parser, this);
+    XML_SetElementHandler(parser, onStart, onEnd);
+    XML_SetCharacterDataHandler(parser, onText);
+    XML_Parse(parser, xhtml.data(), static_cast<int>(xhtml.size()), 1);
+    XML_ParserFree(parser);
+  }
+
+  // Offset of the `n`th (0-based) appearance of `needle` in the body text
+  uint32_t offsetOf(const std::string& needle, const int n = 0) const {
+    size_t pos = 0;
+    for (int i = 0; i <= n; i++) {
+      pos = text.find(needle, i == 0 ? 0 : pos + 1);
+      if (pos == std::string::npos) return UINT32_MAX;
+    }
+    return offsets[pos];
+  }
+};
+
+void testNormalize() {
+  check(SearchIndex::normalize("Hello, WORLD!") == (Words{"hello", "world"}), "case folded, punctuation dropped");
+  check(SearchIndex::normalize("na\xC3\xAFve Caf\xC3\xA9 \xC3\x89T\xC3\x89") == (Words{"naive", "cafe", "ete"}),
+        "accents stripped");
+  check(SearchIndex::normalize("\xC5\x81\xC3\xB3\x64\xC5\xBA") == (Words{"lodz"}), "Latin Extended-A stripped");
+  check(SearchIndex::normalize("co\xC2\xAD" "op\xE2\x80\x8B" "eration") == (Words{"cooperation"}),
+        "soft hyphen and zero-width space join");
+  check(SearchIndex::normalize("cafe\xCC\x81") == (Words{"cafe"}), "combining accent dropped");
+  check(SearchIndex::normalize("well-known \xE2\x80\x9Cquote\xE2\x80\x9D") == (Words{"well", "known", "quote"}),
+        "hyphens and curly quotes break words");
+  check(SearchIndex::normalize("\xD0\x9C\xD0\x98\xD0\xA0 \xCE\xA3\xCE\x9F\xCE\xA6\xCE\x99\xCE\x91") ==
+            (Words{"\xD0\xBC\xD0\xB8\xD1\x80", "\xCF\x83\xCE\xBF\xCF\x86\xCE\xB9\xCE\xB1"}),
+        "Cyrillic and Greek folded");
+  check(SearchIndex::normalize("\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E") ==
+            (Words{"\xE6\x97\xA5", "\xE6\x9C\xAC", "\xE8\xAA\x9E"}),
+        "ideographs are words of their own");
+  check(SearchIndex::normalize(std::string(60, 'x')) == (Words{std::string(SearchIndex::MAX_TERM_BYTES, 'x')}),
+        "long words cut");
+  check(SearchIndex::normalize(" \xE2\x80\x94 ").empty(), "no words in punctuation");
+}
+
+void testQueries() {
+  removeTree(Storage.hostPath(INDEX_DIR));
+  const std::vector<std::string> chapters = {
+      xhtml("<h1>Chapter One</h1><p>The quick brown fox jumps over the lazy dog.</p>\n"
+            "<p>Co&shy;operation is <i>key</i>; co\xC3\xB6peration too.</p>"),
+      xhtml("<p>A <b>Fox</b> again,<br/>the fox.</p><p>Cooperative foxes.</p>"),
+  };
+  check(buildIndex(chapters), "index built");
+  check(SearchIndex::exists(INDEX_DIR), "index exists");
+  const SearchIndex index(INDEX_DIR);
+
+  auto hits = index.find("quick brown", 10);
+  check(hits.size() == 1 && hits[0].spineIndex == 0, "phrase found");
+  if (hits.size() == 1) {
+    const Reference reference(chapters[0]);
+    check(hits[0].charOffset == reference.offsetOf("quick"), "offset counted as the XPath map does");
+    check(index.snippet(hits[0]) == "The quick brown fox jumps over the lazy dog.", "snippet is the paragraph");
+  }
+  check(index.find("QUICK", 10).size() == 1, "query case folded");
+  check(index.find("brown quick", 10).empty(), "phrase word order matters");
+  check(index.find("quick fox", 10).empty(), "phrase words are adjacent");
+  check(index.find("zebra", 10).empty(), "unknown word");
+  check(index.find("", 10).empty() && index.find("!?", 10).empty(), "empty query");
+
+  hits = index.find("cooperation", 10);
+  check(hits.size() == 2, "soft hyphen and diaeresis both match: " + std::to_string(hits.size()));
+  if (hits.size() == 2) {
+    const Reference reference(chapters[0]);
+    check(hits[0].charOffset == reference.offsetOf("Co"), "hyphenated word starts at its first letter");
+    check(index.snippet(hits[1]).find("co\xC3\xB6peration too.") != std::string::npos, "snippet keeps the original");
+  }
+
+  hits = index.find("coop", 10);
+  check(hits.size() == 3 && hits[2].spineIndex == 1, "last word matches as a prefix");
+  hits = index.find("the fox", 10);
+  check(hits.size() == 1 && hits[0].spineIndex == 1, "phrase across a line break");
+
+  hits = index.find("fox", 10);
+  check(hits.size() == 4, "all occurrences in book order, foxes too: " + std::to_string(hits.size()));
+  if (hits.size() == 4) {
+    check(hits[0].spineIndex == 0 && hits[1].spineIndex == 1 && hits[2].spineIndex == 1, "spine order");
+    const Reference reference(chapters[1]);
+    check(hits[1].charOffset == reference.offsetOf("Fox") && hits[2].charOffset == reference.offsetOf("fox."),
+          "offsets restart in each spine item");
+    check(index.snippet(hits[1]) == "A Fox again, the fox.", "inline markup and line breaks flattened");
+    check(index.snippet(hits[1], 2, 5) == "\xE2\x80\xA6" "Fox\xE2\x80\xA6", "long text cut at words");
+
+    // A layout that breaks the page before the second "fox" puts each hit on its own page
+    XPathMap map("/scratch.xpath");
+    XML_Parser parser = XML_ParserCreate(nullptr);
+    XML_SetUserData(parser, &map);
+    XML_SetElementHandler(
+        parser,
+        [](void* data, const XML_Char* name, const XML_Char**) { static_cast<XPathMap*>(data)->startElement(name); },
+        [](void* data, const XML_Char*) { static_cast<XPathMap*>(data)->endElement(); });
+    XML_SetCharacterDataHandler(
+        parser, [](void* data, const XML_Char* s, const int len) { static_cast<XPathMap*>(data)->text(s, len); });
+    XML_Parse(parser, chapters[1].data(), static_cast<int>(chapters[1].size()), 1);
+    XML_ParserFree(parser);
+    map.markPage(0, 0);
+    map.markPage(1, reference.offsetOf("fox."));
+    FsFile file;
+    Storage.openFileForWrite("TEST", "/section.bin", file);
+    check(map.write(file), "map written");
+    file.close();
+    for (int i = 1; i <= 2; i++) {
+      Storage.openFileForRead("TEST", "/section.bin", file);
+      const auto page = XPathMap::findPageForOffset(file, hits[i].charOffset);
+      file.close();
+      check(page.has_value() && *page == i - 1, "hit " + std::to_string(i) + " on page " + std::to_string(i - 1));
+    }
+  }
+  check(index.find("fox", 2).size() == 2, "limit respected");
+}
+
+// Broken chapters are left out, broken or missing indexes find nothing
+void testFailures() {
+  removeTree(Storage.hostPath(INDEX_DIR));
+  check(!SearchIndex::exists(INDEX_DIR), "no index yet");
+  check(SearchIndex(INDEX_DIR).find("word", 10).empty(), "missing index finds nothing");
+
+  check(buildIndex({xhtml("<p>before</p>"), "<html><body><p>broken <b>markup</p></body></html>",
+                    xhtml("<p>after</p>")}),
+        "index built around a broken chapter");
+  const SearchIndex index(INDEX_DIR);
+  check(index.find("before", 10).size() == 1 && index.find("after", 10).size() == 1, "other chapters indexed");
+  check(index.find("after", 10)[0].spineIndex == 2, "spine numbering kept");
+
+  // A truncated terms file is not taken for an index
+  const std::string terms = Storage.hostPath("/search/terms.bin");
+  FILE* f = std::fopen(terms.c_str(), "wb");
+  std::fwrite("SIDX", 1, 4, f);
+  std::fclose(f);
+  check(!SearchIndex::exists(INDEX_DIR), "truncated index rejected");
+  check(index.find("before", 10).empty(), "truncated index finds nothing");
+
+  // A build given up part way, as when pre-indexing is cancelled, leaves neither index nor scratch files
+  {
+    check(buildIndex({xhtml("<p>kept</p>")}), "index to replace");
+    SearchIndexBuilder abandoned(INDEX_DIR);
+    const std::string chapter = xhtml("<p>abandoned text</p>");
+    check(abandoned.begin() && abandoned.beginItem(0, chapter.size()), "begin build to abandon");
+    abandoned.write(reinterpret_cast<const uint8_t*>(chapter.data()), chapter.size());
+    abandoned.endItem();
+    abandoned.abandon();
+    check(!SearchIndex::exists(INDEX_DIR), "abandoned build leaves no index");
+    bool scratchLeft = false;
+    for (const char* name : {"/search/names.tmp", "/search/runs.tmp", "/search/merge.tmp", "/search/text.bin"}) {
+      scratchLeft |= Storage.exists(name);
+    }
+    check(!scratchLeft, "abandoned build leaves no scratch files");
+  }
+
+  // Building where the directory can't be created fails cleanly
+  SearchIndexBuilder builder("/missing/dir/search");
+  check(!builder.begin(), "unwritable directory fails");
+  check(!builder.finish(), "failed build finishes false");
+}
+
+// Enough text for dozens of sorted runs and two merge rounds; counts checked against a plain tally
+void testManyRuns() {
+  removeTree(Storage.hostPath(INDEX_DIR));
+  const Words vocabulary = {"alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+                            "india", "juliet", "kilo",  "lima",  "mike", "november", "oscar", "papa"};
+  std::vector<std::string> chapters;
+  std::vector<int> counts(vocabulary.size());
+  uint32_t state = 12345;
+  for (int chapter = 0; chapter < 40; chapter++) {
+    std::string body;
+    for (int paragraph = 0; paragraph < 30; paragraph++) {
+      body += "<p>";
+      for (int word = 0; word < 100; word++) {
+        state = state * 1103515245 + 12345;
+        const size_t pick = (state >> 16) % vocabulary.size();
+        // Numbered words too, so every run holds many terms
+        body += vocabulary[pick] + " w" + std::to_string(state % 5000) + " ";
+        counts[pick]++;
+      }
+      body += "</p>\n";
+    }
+    chapters.push_back(xhtml(body));
+  }
+
+  check(buildIndex(chapters), "large index built");
+  const SearchIndex index(INDEX_DIR);
+  for (size_t i = 0; i < vocabulary.size(); i++) {
+    const auto hits = index.find(vocabulary[i], 100000);
+    check(static_cast<int>(hits.size()) == counts[i], vocabulary[i] + " found " + std::to_string(hits.size()) +
+                                                          " times, expected " + std::to_string(counts[i]));
+    bool ordered = true;
+    for (size_t h = 1; h < hits.size(); h++) {
+      if (hits[h].spineIndex < hits[h - 1].spineIndex ||
+          (hits[h].spineIndex == hits[h - 1].spineIndex && hits[h].charOffset <= hits[h - 1].charOffset)) {
+        ordered = false;
+      }
+    }
+    check(ordered, vocabulary[i] + " hits in book order");
+  }
+  // w499 and w4990 to w4999: few enough terms for the prefix to expand to all of them
+  size_t phrases = 0;
+  for (const auto& chapter : chapters) {
+    for (size_t pos = chapter.find("kilo w499"); pos != std::string::npos; pos = chapter.find("kilo w499", pos + 1)) {
+      phrases++;
+    }
+  }
+  check(phrases > 0 && index.find("kilo w499", 100000).size() == phrases, "phrase ending in a prefix");
+}
+
+// Every word of the bundled books is found where the text has it
+void testBundledBooks() {
+  for (const char* book : BOOKS) {
+    removeTree(Storage.hostPath(INDEX_DIR));
+    const auto chapters = bookChapters(book);
+    check(buildIndex(chapters), std::string("index built for ") + book);
+    const SearchIndex index(INDEX_DIR);
+
+    // Tally each word the way a reader would find it: in the body text, normalised
+    std::vector<Words> chapterWords;
+    for (const auto& chapter : chapters) {
+      chapterWords.push_back(SearchIndex::normalize(Reference(chapter).text));
+    }
+    int checked = 0;
+    for (size_t c = 0; c < chapterWords.size() && checked < 40; c++) {
+      for (size_t w = 0; w < chapterWords[c].size() && checked < 40; w += 13) {
+        const std::string& word = chapterWords[c][w];
+        int expected = 0;
+        for (const auto& words : chapterWords) {
+          expected += static_cast<int>(std::count(words.begin(), words.end(), word));
+        }
+        // The query matches longer words as well; only hits starting with exactly the word count
+        const auto hits = index.find(word, 100000);
+        int exact = 0;
+        for (const auto& hit : hits) {
+          const auto snippetWords = SearchIndex::normalize(index.snippet(hit, 0, word.size() + 8));
+          if (!snippetWords.empty() && snippetWords[0] == word) exact++;
+        }
+        check(exact == expected, std::string(book) + ": '" + word + "' found " + std::to_string(exact) +
+                                     " times, expected " + std::to_string(expected));
+        checked++;
+      }
+    }
+    check(checked > 0, std::string("words checked in ") + book);
+  }
+}
+
+void benchBooks() {
+  printf("%-28s %8s %9s %8s %8s %10s %10s %9s %9s\n", "book", "epub B", "index B", "ratio", "text B", "build ms",
+         "build heap", "word ms", "phrase ms");
+  for (const char* book : BOOKS) {
+    removeTree(Storage.hostPath(INDEX_DIR));
+    const auto chapters = bookChapters(book);
+    const auto start = Clock::now();
+    const size_t buildHeap = heap::peakDuring([&] { buildIndex(chapters); });
+    const double buildMs = msSince(start);
+    const size_t epubSize = fileSize(epubPath(book));
+    const size_t size = indexSize();
+
+    const SearchIndex index(INDEX_DIR);
+    constexpr int ROUNDS = 100;
+    auto queryStart = Clock::now();
+    for (int i = 0; i < ROUNDS; i++) index.find("the", 50);
+    const double wordMs = msSince(queryStart) / ROUNDS;
+    queryStart = Clock::now();
+    for (int i = 0; i < ROUNDS; i++) index.find("of the", 50);
+    const double phraseMs = msSince(queryStart) / ROUNDS;
+    printf("%-28s %8zu %9zu %7.2fx %8zu %10.1f %10zu %9.3f %9.3f\n", book, epubSize, size,
+           static_cast<double>(size) / static_cast<double>(epubSize), fileSize(Storage.hostPath("/search/text.bin")),
+           buildMs, buildHeap, wordMs, phraseMs);
+  }
+
+  // A novel-length book: 120k words, of which 5000 distinct
+  removeTree(Storage.hostPath(INDEX_DIR));
+  std::vector<std::string> chapters;
+  uint32_t state = 1;
+  size_t xhtmlBytes = 0;
+  for (int chapter = 0; chapter < 40; chapter++) {
+    std::string body;
+    for (int paragraph = 0; paragraph < 100; paragraph++) {
+      body += "<p>";
+      for (int word = 0; word < 30; word++) {
+        state = state * 1103515245 + 12345;
+        // Skewed like natural text: a few words are very common
+        const uint32_t r = (state >> 8) % 5000;
+        body += "w" + std::to_string(r * r / 5000) + (word % 12 == 11 ? ". " : " ");
+      }
+      body += "</p>\n";
+    }
+    chapters.push_back(xhtml(body));
+    xhtmlBytes += chapters.back().size();
+  }
+  const auto start = Clock::now();
+  const size_t buildHeap = heap::peakDuring([&] { buildIndex(chapters); });
+  const double buildMs = msSince(start);
+  const SearchIndex index(INDEX_DIR);
+  std::vector<SearchIndex::Hit> hits;
+  const auto queryStart = Clock::now();
+  const size_t queryHeap = heap::peakDuring([&] { hits = index.find("w0 w1", 50); });
+  const double queryMs = msSince(queryStart);
+  printf("120k words: %zu B of XHTML, index %zu B, built in %.1f ms (peak heap %zu B) | phrase query %.3f ms, %zu B, "
+         "%zu hits\n",
+         xhtmlBytes, indexSize(), buildMs, buildHeap, queryMs, queryHeap, hits.size());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--bench") bench = true;
+  }
+
+  char scratch[] = "/tmp/search-index-test-XXXXXX";
+  if (!mkdtemp(scratch)) {
+    std::cerr << "Failed to create scratch directory" << std::endl;
+    return 1;
+  }
+  Storage.setRoot(scratch);
+
+  testNormalize();
+  testQueries();
+  testFailures();
+  testManyRuns();
+  testBundledBooks();
+  if (bench) benchBooks();
+  removeTree(scratch);
+
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All search index tests passed" << std::endl;
+  return 0;
+}
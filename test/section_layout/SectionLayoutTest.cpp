@@ -0,0 +1,295 @@
+#include <HalStorage.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "lib/EpdFont/builtinFonts/bookerly_14_regular.h"
+#include "lib/Epub/Epub.h"
+#include "lib/Epub/Epub/Page.h"
+#include "lib/Epub/Epub/Section.h"
+#include "lib/Epub/Epub/converters/ImageDecoderFactory.h"
+#include "lib/GfxRenderer/GfxRenderer.h"
+
+// JPEGDEC and PNGdec are not built for the host; the test chapters have no images
+ImageToFramebufferDecoder* ImageDecoderFactory::getDecoder(const std::string&) { return nullptr; }
+bool ImageDecoderFactory::isFormatSupported(const std::string&) { return false; }
+
+namespace {
+
+constexpr int FONT_ID = 1;
+constexpr uint16_t VIEWPORT_WIDTH = 464;
+constexpr uint16_t VIEWPORT_HEIGHT = 740;
+constexpr int PARAGRAPHS = 2400;  // about 600 KB of XHTML, a long chapter
+constexpr int ANCHOR_EVERY = 100;
+
+int failures = 0;
+std::string scratch;
+
+void check(const bool condition, const std::string& message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << std::endl;
+    failures++;
+  }
+}
+
+void writeFile(const std::string& path, const std::string& contents) {
+  FILE* f = fopen(path.c_str(), "w");
+  fwrite(contents.data(), 1, contents.size(), f);
+  fclose(f);
+}
+
+// Deterministic prose paragraphs; every ANCHOR_EVERY-th one carries an id to jump to
+std::string chapterDocument() {
+  static const char* const WORDS[] = {"the",   "reader",  "turned", "a",      "page", "of",      "light",
+                                      "and",   "quietly", "ink",    "screen", "long", "chapter", "through",
+                                      "words", "evening", "river",  "paper",  "slow", "margin"};
+  std::string doc =
+      "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<html xmlns=\"http://www.w3.org/1999/xhtml\"><head><title>Long"
+      "</title></head><body>\n";
+  uint32_t seed = 7;
+  for (int p = 0; p < PARAGRAPHS; p++) {
+    doc += p % ANCHOR_EVERY == 0 ? "<p id=\"p" + std::to_string(p) + "\">" : "<p>";
+    const int words = 30 + static_cast<int>(seed % 25);
+    for (int w = 0; w < words; w++) {
+      seed = seed * 1664525u + 1013904223u;
+      if (w > 0) doc += ' ';
+      doc += WORDS[(seed >> 16) % (sizeof(WORDS) / sizeof(WORDS[0]))];
+    }
+    doc += ".</p>\n";
+  }
+  return doc + "</body></html>\n";
+}
+
+void writeEpub() {
+  const std::string dir = scratch + "/epub";
+  std::system(("mkdir -p '" + dir + "/META-INF' '" + dir + "/OEBPS'").c_str());
+  writeFile(dir + "/mimetype", "application/epub+zip");
+  writeFile(dir + "/META-INF/container.xml",
+            "<?xml version=\"1.0\"?>\n<container version=\"1.0\" "
+            "xmlns=\"urn:oasis:names:tc:opendocument:xmlns:container\"><rootfiles><rootfile "
+            "full-path=\"OEBPS/content.opf\" media-type=\"application/oebps-package+xml\"/></rootfiles></container>\n");
+  writeFile(dir + "/OEBPS/content.opf",
+            "<?xml version=\"1.0\"?>\n<package xmlns=\"http://www.idpf.org/2007/opf\" version=\"2.0\" "
+            "unique-identifier=\"id\"><metadata xmlns:dc=\"http://purl.org/dc/elements/1.1/\"><dc:title>Layout"
+            "</dc:title><dc:language>en</dc:language><dc:identifier id=\"id\">layout</dc:identifier></metadata>"
+            "<manifest><item id=\"ncx\" href=\"toc.ncx\" media-type=\"application/x-dtbncx+xml\"/>"
+            "<item id=\"short\" href=\"short.xhtml\" media-type=\"application/xhtml+xml\"/>"
+            "<item id=\"long\" href=\"long.xhtml\" media-type=\"application/xhtml+xml\"/></manifest>"
+            "<spine toc=\"ncx\"><itemref idref=\"short\"/><itemref idref=\"long\"/></spine></package>\n");
+  writeFile(dir + "/OEBPS/toc.ncx",
+            "<?xml version=\"1.0\"?>\n<ncx xmlns=\"http://www.daisy.org/z3986/2005/ncx/\" version=\"2005-1\">"
+            "<navMap><navPoint id=\"n0\"><navLabel><text>Short</text></navLabel><content src=\"short.xhtml\"/>"
+            "</navPoint><navPoint id=\"n1\"><navLabel><text>Long</text></navLabel><content src=\"long.xhtml\"/>"
+            "</navPoint></navMap></ncx>\n");
+  writeFile(dir + "/OEBPS/short.xhtml", "<html><body><p>Short chapter</p></body></html>\n");
+  writeFile(dir + "/OEBPS/long.xhtml", chapterDocument());
+  std::system(("cd '" + dir + "' && zip -qX0 ../book.epub mimetype && zip -qrX ../book.epub META-INF OEBPS").c_str());
+}
+
+bool begin(Section& section) {
+  return section.beginSectionFile(FONT_ID, 1.0f, false, 0, VIEWPORT_WIDTH, VIEWPORT_HEIGHT, false, false, 0);
+}
+
+bool create(Section& section) {
+  return section.createSectionFile(FONT_ID, 1.0f, false, 0, VIEWPORT_WIDTH, VIEWPORT_HEIGHT, false, false, 0);
+}
+
+bool load(Section& section) {
+  return section.loadSectionFile(FONT_ID, 1.0f, false, 0, VIEWPORT_WIDTH, VIEWPORT_HEIGHT, false, false, 0);
+}
+
+// The words and positions of a page's lines, to compare layouts
+std::string pageText(Section& section, const int page) {
+  section.currentPage = page;
+  const auto p = section.loadPageFromSectionFile();
+  if (!p) return "<missing>";
+  std::string text;
+  for (const auto& element : p->elements) {
+    text += std::to_string(element->yPos) + ":";
+    if (element->getTag() != TAG_PageLine) continue;
+    for (const auto& word : static_cast<const PageLine&>(*element).getBlock()->getWords()) {
+      text += word + " ";
+    }
+    text += "\n";
+  }
+  return text;
+}
+
+std::vector<std::string> allPages(Section& section) {
+  std::vector<std::string> pages;
+  for (int i = 0; i < section.pageCount; i++) pages.push_back(pageText(section, i));
+  return pages;
+}
+
+double msSince(const std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void testPartialLayoutMatchesFull(const std::shared_ptr<Epub>& epub, GfxRenderer& renderer,
+                                  const std::vector<std::string>& full) {
+  Section section(epub, 1, renderer);
+  check(begin(section), "layout begins");
+  check(section.continueSectionFile([&section] { return section.pageCount > 5; }), "layout stops at page 5");
+  check(section.isPartial(), "file is partial after stopping");
+  check(section.pageCount >= 6 && section.pageCount < full.size(), "only the pages up to the target are laid out");
+  check(section.layoutProgress() > 0 && section.layoutProgress() < 0.2f, "a small share of the chapter is parsed");
+  check(pageText(section, 5) == full[5], "page 5 of a partial file matches the full layout");
+  const int estimate = section.estimatedPageCount();
+  check(estimate > section.pageCount && estimate > static_cast<int>(full.size()) / 2 &&
+            estimate < static_cast<int>(full.size()) * 2,
+        "page count estimate is in the range of the full count (" + std::to_string(estimate) + " vs " +
+            std::to_string(full.size()) + ")");
+
+  // Another reader of the cache, e.g. the search screen, sees no usable file while it is partial
+  {
+    Section other(epub, 1, renderer);
+    check(!load(other), "partial file is not loaded");
+  }
+  check(pageText(section, 0) == full[0], "partial file survives another reader's load attempt");
+
+  // Background slices, as the reader's loop runs them
+  int slices = 0;
+  while (section.isPartial()) {
+    const int before = section.pageCount;
+    check(section.continueSectionFile([&section, before] { return section.pageCount >= before + 3; }),
+          "layout continues");
+    slices++;
+  }
+  check(slices > 10, "layout resumed in slices");
+  check(section.pageCount == full.size(), "resumed layout has the full page count");
+  check(allPages(section) == full, "resumed layout matches the full layout page for page");
+  check(section.layoutProgress() == 1.0f && section.estimatedPageCount() == section.pageCount,
+        "complete file reports its page count");
+
+  Section reloaded(epub, 1, renderer);
+  check(load(reloaded) && reloaded.pageCount == full.size(), "completed file loads");
+  check(reloaded.getPageForAnchor("p1200") == section.getPageForAnchor("p1200"), "anchor map written on completion");
+}
+
+void testStopAtAnchor(const std::shared_ptr<Epub>& epub, GfxRenderer& renderer, const uint16_t anchorPage) {
+  Section section(epub, 1, renderer);
+  check(begin(section), "anchor layout begins");
+  check(section.continueSectionFile([&section] { return section.getPageForAnchor("p1200").has_value(); }),
+        "layout stops at the anchor");
+  check(section.isPartial(), "stopped before the end of the chapter");
+  check(section.getPageForAnchor("p1200") == anchorPage, "anchor lands on the same page as in the full layout");
+  check(!section.getPageForAnchor("p2300").has_value(), "anchors past the laid out pages are not found yet");
+}
+
+void testAbandon(const std::shared_ptr<Epub>& epub, GfxRenderer& renderer) {
+  const std::string sectionPath = epub->getCachePath() + "/sections/1.bin";
+  const std::string tmpPath = epub->getCachePath() + "/.tmp_1.html";
+  {
+    Section section(epub, 1, renderer);
+    check(begin(section), "layout to abandon begins");
+    section.continueSectionFile([&section] { return section.pageCount > 0; });
+    check(Storage.exists(sectionPath.c_str()) && Storage.exists(tmpPath.c_str()), "files exist while laying out");
+  }
+  check(!Storage.exists(sectionPath.c_str()), "abandoned section file is removed");
+  check(!Storage.exists(tmpPath.c_str()), "abandoned temp chapter is removed");
+}
+
+void benchFirstPage(const std::shared_ptr<Epub>& epub, GfxRenderer& renderer, const size_t pages) {
+  using Clock = std::chrono::steady_clock;
+  constexpr int RUNS = 5;
+  double fullMs = 0, firstMs = 0, middleMs = 0, firstTotalMs = 0;
+  for (int run = 0; run < RUNS; run++) {
+    {
+      Section section(epub, 1, renderer);
+      const auto start = Clock::now();
+      create(section);
+      fullMs += msSince(start);
+    }
+    {
+      Section section(epub, 1, renderer);
+      auto start = Clock::now();
+      begin(section);
+      section.continueSectionFile([&section] { return section.pageCount > 0; });
+      pageText(section, 0);
+      firstMs += msSince(start);
+      // The rest in 40 ms slices, as loop() lays it out
+      while (section.isPartial()) {
+        const auto slice = Clock::now();
+        section.continueSectionFile([slice] { return msSince(slice) >= 40; });
+      }
+      firstTotalMs += msSince(start);
+    }
+    {
+      Section section(epub, 1, renderer);
+      const auto start = Clock::now();
+      begin(section);
+      const uint16_t target = pages / 2;
+      section.continueSectionFile([&section, target] { return section.pageCount > target; });
+      pageText(section, target);
+      middleMs += msSince(start);
+    }
+  }
+  std::cout << std::fixed << std::setprecision(1) << "Chapter of " << pages << " pages, mean of " << RUNS
+            << " runs:\n  full layout before the first page: " << fullMs / RUNS
+            << " ms\n  partial layout to page 1: " << firstMs / RUNS << " ms (" << firstTotalMs / RUNS
+            << " ms until complete)\n  partial layout to page " << pages / 2 + 1 << ": " << middleMs / RUNS << " ms"
+            << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bool bench = false;
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--bench") bench = true;
+  }
+
+  char dir[] = "/tmp/section_layout_XXXXXX";
+  if (!mkdtemp(dir)) {
+    std::cerr << "Failed to create scratch directory" << std::endl;
+    return 1;
+  }
+  scratch = dir;
+  Storage.setRoot(dir);
+  writeEpub();
+  Storage.mkdir("/cache");
+
+  HalDisplay display;
+  GfxRenderer renderer(display);
+  renderer.begin();
+  const EpdFont font(&bookerly_14_regular);
+  renderer.insertFont(FONT_ID, EpdFontFamily(&font));
+
+  auto epub = std::make_shared<Epub>("/book.epub", "/cache");
+  check(epub->load(true, true), "book loads");
+
+  std::vector<std::string> full;
+  uint16_t anchorPage = 0;
+  {
+    Section section(epub, 1, renderer);
+    check(create(section), "full layout");
+    check(!section.isPartial(), "full layout is complete");
+    check(section.pageCount > 100, "long chapter has many pages (" + std::to_string(section.pageCount) + ")");
+    full = allPages(section);
+    anchorPage = section.getPageForAnchor("p1200").value_or(0);
+    check(anchorPage > 0, "anchor is found in the full layout");
+  }
+
+  if (!full.empty()) {
+    testPartialLayoutMatchesFull(epub, renderer, full);
+    testStopAtAnchor(epub, renderer, anchorPage);
+    testAbandon(epub, renderer);
+    if (bench) benchFirstPage(epub, renderer, full.size());
+  }
+
+  std::system(("rm -rf '" + scratch + "'").c_str());
+
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All section layout tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,258 @@
+#include <HalStorage.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "lib/Epub/Epub/BookMetadataCache.h"
+#include "lib/Epub/Epub/TocView.h"
+#include "lib/Epub/Epub/parsers/TocNavParser.h"
+#include "lib/Epub/Epub/parsers/TocNcxParser.h"
+
+namespace {
+
+int failures = 0;
+bool bench = false;
+std::string scratch;
+
+void check(const bool condition, const std::string& message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << std::endl;
+    failures++;
+  }
+}
+
+constexpr int ENTRIES = 10000;
+constexpr int CHAPTERS = 100;
+constexpr int CHILDREN = 4;  // every fifth entry is a level 1 entry with four level 2 entries under it
+const std::string BASE_PATH = "OEBPS/";
+
+// Headword-like titles in alphabetical blocks, as in a dictionary's TOC; one carries accents
+std::string titleOf(const int i) {
+  static const char* SYLLABLES[] = {"ba", "ce", "di", "fo", "gu", "la", "me", "no", "pi", "ro", "su", "te"};
+  if (i == 1600) return "\xC3\x89" "clair au caf\xC3\xA9 1600";
+  std::string title(1, static_cast<char>('A' + i * 26 / ENTRIES));
+  title += SYLLABLES[i % 12];
+  title += SYLLABLES[(i / 12) % 12];
+  return title + " " + std::to_string(i);
+}
+
+uint8_t levelOf(const int i) { return i % (CHILDREN + 1) == 0 ? 1 : 2; }
+
+std::string hrefOf(const int i) {
+  return "ch" + std::to_string(i * CHAPTERS / ENTRIES) + ".xhtml#e" + std::to_string(i);
+}
+
+std::string ncxDocument() {
+  std::string doc =
+      "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<ncx xmlns=\"http://www.daisy.org/z3986/2005/ncx/\" "
+      "version=\"2005-1\">\n<head/>\n<docTitle><text>Dictionary</text></docTitle>\n<navMap>\n";
+  for (int i = 0; i < ENTRIES; i++) {
+    doc += "<navPoint id=\"np" + std::to_string(i) + "\"><navLabel><text>" + titleOf(i) +
+           "</text></navLabel><content src=\"" + hrefOf(i) + "\"/>";
+    // A level 1 entry stays open around its children
+    if (levelOf(i) == 2) doc += "</navPoint>\n";
+    if ((i + 1) % (CHILDREN + 1) == 0) doc += "</navPoint>\n";
+  }
+  return doc + "</navMap>\n</ncx>\n";
+}
+
+std::string navDocument() {
+  std::string doc =
+      "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<html xmlns=\"http://www.w3.org/1999/xhtml\" "
+      "xmlns:epub=\"http://www.idpf.org/2007/ops\">\n<head><title>Contents</title></head>\n<body>\n"
+      "<nav epub:type=\"toc\"><ol>\n";
+  for (int i = 0; i < ENTRIES; i++) {
+    doc += "<li><a href=\"" + hrefOf(i) + "\">" + titleOf(i) + "</a>";
+    doc += levelOf(i) == 1 ? "<ol>" : "</li>";
+    if ((i + 1) % (CHILDREN + 1) == 0) doc += "</ol></li>\n";
+  }
+  return doc + "</ol></nav>\n</body>\n</html>\n";
+}
+
+// A stand-in EPUB holding the chapters, which book.bin needs for its size table
+void writeEpub() {
+  const std::string dir = scratch + "/epub";
+  std::system(("mkdir -p '" + dir + "/OEBPS'").c_str());
+  for (int c = 0; c < CHAPTERS; c++) {
+    FILE* f = fopen((dir + "/OEBPS/ch" + std::to_string(c) + ".xhtml").c_str(), "w");
+    fputs("<html><body><p>Chapter</p></body></html>", f);
+    fclose(f);
+  }
+  std::system(("cd '" + dir + "' && zip -qr ../book.epub OEBPS").c_str());
+}
+
+template <typename Parser>
+bool buildCache(BookMetadataCache& cache, const std::string& document) {
+  cache.beginWrite();
+  cache.beginContentOpfPass();
+  for (int c = 0; c < CHAPTERS; c++) cache.createSpineEntry(BASE_PATH + "ch" + std::to_string(c) + ".xhtml");
+  cache.endContentOpfPass();
+  cache.beginTocPass();
+  {
+    Parser parser(BASE_PATH, document.size(), &cache);
+    if (!parser.setup()) return false;
+    for (size_t offset = 0; offset < document.size(); offset += 1024) {
+      const size_t size = std::min<size_t>(1024, document.size() - offset);
+      parser.write(reinterpret_cast<const uint8_t*>(document.data()) + offset, size);
+    }
+  }
+  cache.endTocPass();
+  cache.endWrite();
+  BookMetadataCache::BookMetadata metadata;
+  metadata.title = "Dictionary";
+  const bool built = cache.buildBookBin("/book.epub", metadata);
+  cache.cleanupTmpFiles();
+  return built && cache.load();
+}
+
+void checkEntries(BookMetadataCache& cache, const std::string& name) {
+  check(cache.getTocCount() == ENTRIES, name + ": all entries read (" + std::to_string(cache.getTocCount()) + ")");
+  TocView toc(cache);
+  check(toc.size() == ENTRIES, name + ": view size");
+
+  // Forwards, backwards and in jumps, as the list scrolls and pages
+  std::vector<int> order;
+  for (int i = 0; i < ENTRIES; i++) order.push_back(i);
+  for (int i = ENTRIES - 1; i >= 0; i -= 3) order.push_back(i);
+  for (int i = 0; i < 200; i++) order.push_back((i * 7919) % ENTRIES);
+  int mismatches = 0;
+  for (const int i : order) {
+    const auto& item = toc.item(i);
+    if (item.title != titleOf(i) || item.level != levelOf(i) || item.spineIndex != i * CHAPTERS / ENTRIES) {
+      if (mismatches++ < 3) {
+        std::cerr << "  " << name << " entry " << i << ": '" << item.title << "' level " << int(item.level)
+                  << " spine " << item.spineIndex << std::endl;
+      }
+    }
+  }
+  check(mismatches == 0, name + ": windowed entries match the TOC");
+  check(toc.item(ENTRIES).title.empty() && toc.item(-1).title.empty(), name + ": out of range entries are empty");
+}
+
+int firstWithLetter(const char letter) {
+  for (int i = 0; i < ENTRIES; i++) {
+    if (i != 1600 && titleOf(i)[0] == letter) return i;
+  }
+  return -1;
+}
+
+void testJumpToLetter(BookMetadataCache& cache) {
+  TocView toc(cache);
+  check(toc.findInitial("m", 0) == firstWithLetter('M'), "jump to M");
+  check(toc.findInitial("M", firstWithLetter('M')) == firstWithLetter('M') + 1, "jump again moves to the next M");
+  check(toc.findInitial("a", ENTRIES - 1) == 0, "jump wraps around");
+  check(toc.findInitial("\xC3\xA9", 0) == firstWithLetter('E'), "accented letter matches its base letter");
+  check(toc.findInitial("e", 1599) == 1600, "title starting with an accented letter found");
+  check(toc.findInitial("?", 0) == -1, "no title starts with punctuation");
+}
+
+void testSearch(BookMetadataCache& cache) {
+  TocView toc(cache);
+  auto matches = toc.search("CAFE", 10);
+  check(matches.size() == 1 && matches[0].tocIndex == 1600, "accent- and case-insensitive title search");
+  if (!matches.empty()) {
+    check(matches[0].item.title == titleOf(1600) && matches[0].item.level == levelOf(1600), "match keeps its entry");
+  }
+
+  // Q titles run from 6154 to 6537, so the ones numbered 62xx
+  matches = toc.search("q 62", 200);
+  check(matches.size() == 100, "every word matches as a prefix (" + std::to_string(matches.size()) + ")");
+  for (size_t i = 0; i < matches.size(); i++) {
+    check(matches[i].tocIndex == 6200 + static_cast<int>(i), "prefix match " + titleOf(matches[i].tocIndex));
+  }
+
+  matches = toc.search("m", 25);
+  check(matches.size() == 25 && matches[0].tocIndex == firstWithLetter('M'), "search stops at the limit, in order");
+  check(toc.search("zzz", 10).empty(), "no matches");
+  check(toc.search("  ", 10).empty(), "empty query");
+}
+
+double millisSince(const std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void benchBrowsing(BookMetadataCache& cache) {
+  constexpr int PAGE_ITEMS = 23;  // rows of the chapter list in portrait
+  size_t chars = 0;
+
+  // Every screen of the list, drawn the way the chapter list used to: one LUT lookup and seek per row
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < ENTRIES; i++) chars += cache.getTocEntry(i).title.size();
+  const double perRow = millisSince(start);
+
+  // The same screens through the view, down the list and back up, as the chapter list draws them
+  TocView toc(cache);
+  const auto drawPage = [&toc, &chars](const int page) {
+    toc.prefetch(page * PAGE_ITEMS, PAGE_ITEMS);
+    const int end = std::min(ENTRIES, (page + 1) * PAGE_ITEMS);
+    for (int i = page * PAGE_ITEMS; i < end; i++) chars += toc.item(i).title.size();
+  };
+  start = std::chrono::steady_clock::now();
+  for (int page = 0; page <= ENTRIES / PAGE_ITEMS; page++) drawPage(page);
+  const double windowed = millisSince(start);
+
+  start = std::chrono::steady_clock::now();
+  for (int page = ENTRIES / PAGE_ITEMS; page >= 0; page--) drawPage(page);
+  const double windowedBack = millisSince(start);
+
+  start = std::chrono::steady_clock::now();
+  const int jump = toc.findInitial("q", 0);
+  const double firstJump = millisSince(start);
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 26; i++) chars += toc.findInitial(std::string(1, static_cast<char>('a' + i)), jump);
+  const double laterJumps = millisSince(start) / 26;
+
+  start = std::chrono::steady_clock::now();
+  const auto matches = toc.search("m 48", 200);
+  const double search = millisSince(start);
+
+  printf("%d entries: per-row reads %.1f ms, windowed %.1f ms forward / %.1f ms backward\n", ENTRIES, perRow,
+         windowed, windowedBack);
+  printf("first letter jump %.1f ms, later jumps %.3f ms, title search %.1f ms (%zu matches); %zu chars\n",
+         firstJump, laterJumps, search, matches.size(), chars);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--bench") bench = true;
+  }
+
+  char dir[] = "/tmp/toc_view_XXXXXX";
+  if (!mkdtemp(dir)) {
+    std::cerr << "Failed to create scratch directory" << std::endl;
+    return 1;
+  }
+  scratch = dir;
+  Storage.setRoot(dir);
+  writeEpub();
+
+  Storage.mkdir("/ncx");
+  BookMetadataCache ncxCache("/ncx");
+  check(buildCache<TocNcxParser>(ncxCache, ncxDocument()), "book.bin built from the NCX");
+  checkEntries(ncxCache, "ncx");
+
+  Storage.mkdir("/nav");
+  BookMetadataCache navCache("/nav");
+  check(buildCache<TocNavParser>(navCache, navDocument()), "book.bin built from the nav document");
+  checkEntries(navCache, "nav");
+
+  testJumpToLetter(ncxCache);
+  testSearch(navCache);
+  if (bench) benchBrowsing(ncxCache);
+
+  std::system(("rm -rf '" + scratch + "'").c_str());
+
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All TOC view tests passed" << std::endl;
+  return 0;
+}
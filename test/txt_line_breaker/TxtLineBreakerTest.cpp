@@ -0,0 +1,324 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "lib/EpdFont/builtinFonts/bookerly_14_regular.h"
+#include "lib/Epub/Epub/hyphenation/Hyphenator.h"
+#include "lib/GfxRenderer/GfxRenderer.h"
+#include "lib/Txt/TxtLineBreaker.h"
+
+namespace {
+
+constexpr int FONT_ID = 1;
+constexpr size_t CHUNK_SIZE = 8 * 1024;  // TxtReaderActivity's read chunk
+
+int failures = 0;
+
+void check(const bool condition, const std::string& message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << std::endl;
+    failures++;
+  }
+}
+
+int advance(const GfxRenderer& renderer, const std::string& text) {
+  return renderer.getTextAdvanceX(FONT_ID, text.c_str(), EpdFontFamily::REGULAR);
+}
+
+size_t codepointCount(const std::string& text) {
+  size_t count = 0;
+  for (const char c : text) count += (c & 0xC0) != 0x80;
+  return count;
+}
+
+// Deterministic prose: words of varying length, some accented, single spaces
+std::string makeProse(const size_t bytes, uint32_t seed) {
+  static const char* const words[] = {"the", "reader",          "turned", "a",     "page",   "naïve",
+                                      "café", "extraordinarily", "of",     "light", "Ωμέγα", "and",
+                                      "quietly", "unbelievable", "—",      "ink",   "through", "screen"};
+  std::string text;
+  text.reserve(bytes + 32);
+  while (text.size() < bytes) {
+    seed = seed * 1664525u + 1013904223u;
+    if (!text.empty()) text.push_back(' ');
+    text += words[(seed >> 16) % (sizeof(words) / sizeof(words[0]))];
+  }
+  return text;
+}
+
+// Word-by-word greedy wrapping that measures every candidate line from scratch
+std::vector<std::string> referenceWrap(const GfxRenderer& renderer, const std::string& text, const int maxWidth) {
+  std::vector<std::string> lines;
+  std::string line;
+  size_t pos = 0;
+  while (pos < text.size()) {
+    size_t end = text.find(' ', pos);
+    if (end == std::string::npos) end = text.size();
+    const std::string word = text.substr(pos, end - pos);
+    pos = end + 1;
+
+    if (!line.empty() && advance(renderer, line + " " + word) <= maxWidth) {
+      line += " " + word;
+      continue;
+    }
+    if (!line.empty()) lines.push_back(line);
+    line = word;
+    // Oversized word: split at the last codepoint that fits
+    while (advance(renderer, line) > maxWidth) {
+      size_t cut = 0;
+      for (size_t i = 1; i <= line.size(); i++) {
+        if (i < line.size() && (line[i] & 0xC0) == 0x80) continue;
+        if (advance(renderer, line.substr(0, i)) > maxWidth) break;
+        cut = i;
+      }
+      if (cut == 0) cut = 1;
+      lines.push_back(line.substr(0, cut));
+      line = line.substr(cut);
+    }
+  }
+  if (!line.empty()) lines.push_back(line);
+  return lines;
+}
+
+std::vector<std::string> wrapAll(const TxtLineBreaker& breaker, const std::string& text) {
+  std::vector<std::string> lines;
+  breaker.wrap(text.data(), text.size(), SIZE_MAX, false, lines);
+  return lines;
+}
+
+void testMatchesReference(const GfxRenderer& renderer) {
+  for (const int width : {120, 300, 464}) {
+    const TxtLineBreaker breaker(renderer, FONT_ID, width, false);
+    const std::string text = makeProse(6000, width);
+    check(wrapAll(breaker, text) == referenceWrap(renderer, text, width),
+          "width " + std::to_string(width) + " matches greedy reference");
+  }
+
+  const std::string unbroken(700, 'm');
+  const TxtLineBreaker breaker(renderer, FONT_ID, 200, false);
+  check(wrapAll(breaker, unbroken) == referenceWrap(renderer, unbroken, 200), "unbroken run splits by width");
+}
+
+void testLinesAreSourceSlices(const GfxRenderer& renderer) {
+  const std::string text = "  Indented   start, double  spaces and e\xCC\x81 combining marks: " + makeProse(3000, 9) +
+                           "     trailing";
+  const TxtLineBreaker breaker(renderer, FONT_ID, 250, false);
+
+  bool slices = true, fits = true, boundaries = true;
+  size_t pos = 0;
+  while (pos < text.size()) {
+    std::vector<std::string> lines;
+    const size_t consumed = breaker.wrap(text.data() + pos, text.size() - pos, 1, false, lines);
+    if (lines.size() != 1 || consumed == 0) {
+      slices = false;
+      break;
+    }
+    slices = slices && text.compare(pos, lines[0].size(), lines[0]) == 0;
+    fits = fits && (advance(renderer, lines[0]) <= 250 || codepointCount(lines[0]) == 1);
+    pos += consumed;
+    boundaries = boundaries && (pos >= text.size() || (text[pos] & 0xC0) != 0x80);
+  }
+  check(slices, "every line is a slice of the source");
+  check(fits, "every line fits the width");
+  check(boundaries, "lines never start inside a UTF-8 sequence");
+}
+
+void testHyphenation(const GfxRenderer& renderer) {
+  const std::string text = makeProse(4000, 77);
+  const TxtLineBreaker plain(renderer, FONT_ID, 160, false);
+  const TxtLineBreaker hyphenated(renderer, FONT_ID, 160, true, "en");
+  const auto plainLines = wrapAll(plain, text);
+  const auto hyphenatedLines = wrapAll(hyphenated, text);
+
+  size_t hyphens = 0;
+  bool fits = true;
+  std::string rebuilt;
+  for (const auto& line : hyphenatedLines) {
+    fits = fits && advance(renderer, line) <= 160;
+    if (!line.empty() && line.back() == '-') {
+      hyphens++;
+      rebuilt += line.substr(0, line.size() - 1);
+    } else {
+      rebuilt += line + " ";
+    }
+  }
+  rebuilt.pop_back();
+  check(hyphens > 0, "hyphenation splits long words");
+  check(fits, "hyphenated lines fit the width");
+  check(rebuilt == text, "hyphenated lines rebuild the source");
+  check(hyphenatedLines.size() < plainLines.size(), "hyphenation packs lines tighter");
+  bool plainHasHyphen = false;
+  for (const auto& line : plainLines) plainHasHyphen = plainHasHyphen || (!line.empty() && line.back() == '-');
+  check(!plainHasHyphen, "no hyphens without hyphenation");
+
+  // Breaks follow the breaker's language, not whatever the last EPUB layout selected
+  Hyphenator::setPreferredLanguage("de");
+  check(wrapAll(hyphenated, text) == hyphenatedLines, "same breaks after another book set its language");
+  const TxtLineBreaker german(renderer, FONT_ID, 160, true, "de");
+  Hyphenator::setPreferredLanguage("en");
+  check(wrapAll(german, text) != hyphenatedLines, "language picks the hyphenation patterns");
+}
+
+// Mirrors TxtReaderActivity::loadPageAtOffset, reading 8KB chunks from an in-memory file
+size_t loadPage(const TxtLineBreaker& breaker, const std::string& file, const size_t offset, const int linesPerPage,
+                std::vector<std::string>& outLines) {
+  outLines.clear();
+  const size_t chunkSize = std::min(CHUNK_SIZE, file.size() - offset);
+  const char* buffer = file.data() + offset;
+  size_t pos = 0;
+  while (pos < chunkSize && static_cast<int>(outLines.size()) < linesPerPage) {
+    size_t lineEnd = pos;
+    while (lineEnd < chunkSize && buffer[lineEnd] != '\n') lineEnd++;
+    const bool lineComplete = lineEnd < chunkSize || offset + lineEnd >= file.size();
+    const size_t displayLen = lineEnd - pos;
+    const size_t maxLines = linesPerPage - outLines.size();
+    size_t consumed = breaker.wrap(buffer + pos, displayLen, maxLines, !lineComplete, outLines);
+    if (consumed == 0 && outLines.empty()) consumed = breaker.wrap(buffer + pos, displayLen, maxLines, false, outLines);
+    if (consumed < displayLen || !lineComplete) {
+      pos += consumed;
+      break;
+    }
+    pos = lineEnd + 1;
+  }
+  return std::min(offset + pos, file.size());
+}
+
+// The page-by-page layout must not depend on where the 8KB chunks happen to end
+void testChunkIndependence(const GfxRenderer& renderer) {
+  const std::string text = makeProse(60000, 5);
+  const TxtLineBreaker breaker(renderer, FONT_ID, 464, false);
+  const auto expected = wrapAll(breaker, text);
+
+  std::vector<std::string> paged, page;
+  size_t offset = 0;
+  while (offset < text.size()) {
+    const size_t next = loadPage(breaker, text, offset, 23, page);
+    if (next <= offset) break;
+    paged.insert(paged.end(), page.begin(), page.end());
+    offset = next;
+  }
+  check(paged == expected, "paged layout matches wrapping the whole paragraph");
+
+  std::vector<std::string> held;
+  check(breaker.wrap(text.data(), 20, 10, true, held) == 0 && held.empty(), "cut-off tail is held back");
+  const size_t consumed = breaker.wrap(text.data(), 200, 10, true, held);
+  const bool prefixOfFullLayout = std::equal(held.begin(), held.end(), expected.begin());
+  check(consumed > 0 && consumed < 200 && !held.empty() && prefixOfFullLayout,
+        "complete lines before a cut-off tail are emitted");
+}
+
+// The wrapping loop TxtReaderActivity used before: shrink the candidate and re-measure it from scratch
+size_t legacyLoadPage(const GfxRenderer& renderer, const std::string& file, const size_t offset,
+                      const int viewportWidth, const int linesPerPage, std::vector<std::string>& outLines) {
+  outLines.clear();
+  const size_t chunkSize = std::min(CHUNK_SIZE, file.size() - offset);
+  std::string line = file.substr(offset, chunkSize);
+  size_t lineBytePos = 0;
+  while (!line.empty() && static_cast<int>(outLines.size()) < linesPerPage) {
+    if (renderer.getTextWidth(FONT_ID, line.c_str()) <= viewportWidth) {
+      outLines.push_back(line);
+      lineBytePos = chunkSize;
+      break;
+    }
+    size_t breakPos = line.length();
+    while (breakPos > 0 && renderer.getTextWidth(FONT_ID, line.substr(0, breakPos).c_str()) > viewportWidth) {
+      size_t spacePos = line.rfind(' ', breakPos - 1);
+      if (spacePos != std::string::npos && spacePos > 0) {
+        breakPos = spacePos;
+      } else {
+        breakPos--;
+        while (breakPos > 0 && (line[breakPos] & 0xC0) == 0x80) breakPos--;
+      }
+    }
+    if (breakPos == 0) breakPos = 1;
+    outLines.push_back(line.substr(0, breakPos));
+    size_t skipChars = breakPos;
+    if (breakPos < line.length() && line[breakPos] == ' ') skipChars++;
+    lineBytePos += skipChars;
+    line = line.substr(skipChars);
+  }
+  return offset + lineBytePos;
+}
+
+double elapsedMs(const std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void runBenchmark(const GfxRenderer& renderer) {
+  constexpr int viewportWidth = 464;
+  const int linesPerPage = 740 / renderer.getLineHeight(FONT_ID);
+  const std::string file = makeProse(5 * 1024 * 1024, 2024);
+  const size_t middle = file.find(' ', file.size() / 2) + 1;
+  const TxtLineBreaker breaker(renderer, FONT_ID, viewportWidth, false);
+  std::vector<std::string> lines;
+
+  auto start = std::chrono::steady_clock::now();
+  legacyLoadPage(renderer, file, middle, viewportWidth, linesPerPage, lines);
+  const double legacyMs = elapsedMs(start);
+
+  constexpr int runs = 10;
+  double pageMs = 1e9;
+  for (int run = 0; run < runs; run++) {
+    start = std::chrono::steady_clock::now();
+    loadPage(breaker, file, middle, linesPerPage, lines);
+    pageMs = std::min(pageMs, elapsedMs(start));
+  }
+
+  const TxtLineBreaker hyphenated(renderer, FONT_ID, viewportWidth, true, "en");
+  double hyphenatedMs = 1e9;
+  for (int run = 0; run < runs; run++) {
+    start = std::chrono::steady_clock::now();
+    loadPage(hyphenated, file, middle, linesPerPage, lines);
+    hyphenatedMs = std::min(hyphenatedMs, elapsedMs(start));
+  }
+
+  start = std::chrono::steady_clock::now();
+  size_t offset = 0;
+  int pages = 0;
+  while (offset < file.size()) {
+    offset = loadPage(breaker, file, offset, linesPerPage, lines);
+    pages++;
+  }
+  const double indexMs = elapsedMs(start);
+
+  std::cout << "5 MB single-paragraph TXT, " << viewportWidth << " px wide, " << linesPerPage
+            << " lines per page:" << std::endl;
+  std::cout << std::fixed << std::setprecision(3) << "  page load, shrinking re-measure: " << legacyMs << " ms"
+            << std::endl;
+  std::cout << "  page load, single pass:         " << pageMs << " ms (" << std::setprecision(0)
+            << legacyMs / pageMs << "x)" << std::endl;
+  std::cout << std::setprecision(3) << "  page load, single pass + hyph.: " << hyphenatedMs << " ms" << std::endl;
+  std::cout << std::setprecision(0) << "  full page index: " << pages << " pages in " << indexMs << " ms" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  bool bench = false;
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--bench") bench = true;
+  }
+
+  HalDisplay display;
+  GfxRenderer renderer(display);
+  renderer.begin();
+  const EpdFont font(&bookerly_14_regular);
+  renderer.insertFont(FONT_ID, EpdFontFamily(&font));
+
+  testMatchesReference(renderer);
+  testLinesAreSourceSlices(renderer);
+  testHyphenation(renderer);
+  testChunkIndependence(renderer);
+  if (bench) runBenchmark(renderer);
+
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All TXT line breaker tests passed" << std::endl;
+  return 0;
+}
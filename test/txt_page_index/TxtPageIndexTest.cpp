@@ -0,0 +1,155 @@
+#include <HalStorage.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include "lib/Txt/TxtPageIndex.h"
+
+namespace {
+
+int failures = 0;
+
+void check(const bool condition, const std::string& message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << std::endl;
+    failures++;
+  }
+}
+
+const std::string INDEX_PATH = "/index.bin";
+
+TxtPageIndex::Layout testLayout() {
+  TxtPageIndex::Layout layout;
+  layout.fileSize = 100000;
+  layout.viewportWidth = 464;
+  layout.linesPerPage = 28;
+  layout.fontId = 1234;
+  layout.screenMargin = 5;
+  layout.paragraphAlignment = 0;
+  layout.hyphenation = 1;
+  layout.hyphenationLanguage = 'e' | 'n' << 8;
+  return layout;
+}
+
+// Pages of a fixed 1000 bytes stand in for the reader's layout
+constexpr uint32_t PAGE_BYTES = 1000;
+
+void testLookup() {
+  TxtPageIndex index(INDEX_PATH);
+  index.reset(testLayout());
+  for (uint32_t page = 1; page < 10; page++) index.addPage(page * PAGE_BYTES);
+
+  check(index.pageCount() == 10, "ten pages known");
+  check(index.lastPageOffset() == 9 * PAGE_BYTES, "last page offset");
+  check(index.pageAtOffset(0) == 0, "offset 0 is on page 0");
+  check(index.pageAtOffset(PAGE_BYTES - 1) == 0, "last byte of page 0");
+  check(index.pageAtOffset(PAGE_BYTES) == 1, "first byte of page 1");
+  check(index.pageAtOffset(50000) == 9, "offsets past the index map to the last known page");
+  check(index.isPageStart(3 * PAGE_BYTES), "page start recognised");
+  check(!index.isPageStart(3 * PAGE_BYTES + 1), "mid-page offset is not a page start");
+
+  // Out of order or duplicate breaks are ignored
+  index.addPage(5 * PAGE_BYTES);
+  index.addPage(9 * PAGE_BYTES);
+  check(index.pageCount() == 10, "non-increasing page breaks ignored");
+
+  // 9 pages cover 9000 bytes of a 100000 byte file
+  check(index.estimatedPageCount() == 100, "page count extrapolated while partial");
+  index.markComplete();
+  check(index.estimatedPageCount() == 10, "exact page count once complete");
+  index.addPage(10 * PAGE_BYTES);
+  check(index.pageCount() == 10, "no pages added after completion");
+}
+
+void testCheckpointResume() {
+  const auto layout = testLayout();
+
+  // First session stops part way through
+  {
+    TxtPageIndex index(INDEX_PATH);
+    index.reset(layout);
+    for (uint32_t page = 1; page < 40; page++) index.addPage(page * PAGE_BYTES);
+    check(index.save(), "partial checkpoint saved");
+  }
+
+  // Next session resumes from the last known page and finishes
+  {
+    TxtPageIndex index(INDEX_PATH);
+    check(index.load(layout), "partial checkpoint loaded");
+    check(!index.isComplete(), "checkpoint still partial");
+    check(index.pageCount() == 40, "checkpoint pages restored");
+    check(index.lastPageOffset() == 39 * PAGE_BYTES, "indexing resumes after the checkpoint");
+    for (uint32_t offset = index.lastPageOffset() + PAGE_BYTES; offset < layout.fileSize; offset += PAGE_BYTES) {
+      index.addPage(offset);
+    }
+    index.markComplete();
+    check(index.save(), "complete index saved");
+  }
+
+  TxtPageIndex index(INDEX_PATH);
+  check(index.load(layout), "complete index loaded");
+  check(index.isComplete(), "completion persisted");
+  check(index.pageCount() == 100, "all pages restored");
+  check(index.pageOffset(57) == 57 * PAGE_BYTES, "page offset restored");
+}
+
+void testRejectsStaleCache() {
+  const auto layout = testLayout();
+  {
+    TxtPageIndex index(INDEX_PATH);
+    index.reset(layout);
+    for (uint32_t page = 1; page < 20; page++) index.addPage(page * PAGE_BYTES);
+    index.save();
+  }
+
+  auto otherFont = layout;
+  otherFont.fontId++;
+  TxtPageIndex index(INDEX_PATH);
+  check(!index.load(otherFont), "checkpoint for another font rejected");
+  check(index.pageCount() == 1 && index.lastPageOffset() == 0, "rejected checkpoint starts over");
+
+  auto otherLanguage = layout;
+  otherLanguage.hyphenationLanguage = 'd' | 'e' << 8;
+  check(!index.load(otherLanguage), "checkpoint hyphenated in another language rejected");
+
+  auto edited = layout;
+  edited.fileSize++;
+  check(!index.load(edited), "checkpoint for a changed file rejected");
+
+  // A checkpoint cut short by power loss must not be trusted
+  const std::string hostPath = Storage.hostPath(INDEX_PATH);
+  check(truncate(hostPath.c_str(), 40) == 0, "truncate checkpoint");
+  check(!index.load(layout), "truncated checkpoint rejected");
+  check(index.pageCount() == 1, "truncated checkpoint starts over");
+
+  std::remove(hostPath.c_str());
+  check(!index.load(layout), "missing checkpoint");
+}
+
+}  // namespace
+
+int main() {
+  char scratch[] = "/tmp/txt_page_index_XXXXXX";
+  if (!mkdtemp(scratch)) {
+    std::cerr << "Failed to create scratch directory" << std::endl;
+    return 1;
+  }
+  Storage.setRoot(scratch);
+
+  testLookup();
+  testCheckpointResume();
+  testRejectsStaleCache();
+
+  std::remove(Storage.hostPath(INDEX_PATH).c_str());
+  rmdir(scratch);
+
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All TXT page index tests passed" << std::endl;
+  return 0;
+}
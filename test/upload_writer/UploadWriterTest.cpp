@@ -0,0 +1,312 @@
+#include <HalStorage.h>
+#include <esp_rom_crc.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/network/UploadWriter.h"
+
+namespace {
+
+int failures = 0;
+bool bench = false;
+
+void check(const bool condition, const std::string& message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << std::endl;
+    failures++;
+  }
+}
+
+using Clock = std::chrono::steady_clock;
+
+double msSince(const Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+const std::string UPLOAD_PATH = "/upload.epub";
+
+std::vector<uint8_t> makePayload(const size_t size) {
+  std::vector<uint8_t> payload(size);
+  uint32_t state = 12345;
+  for (auto& byte : payload) {
+    state = state * 1103515245 + 12345;
+    byte = static_cast<uint8_t>(state >> 16);
+  }
+  return payload;
+}
+
+uint32_t crcOf(const std::vector<uint8_t>& data) { return esp_rom_crc32_le(0, data.data(), data.size()); }
+
+std::vector<uint8_t> readUpload() {
+  std::vector<uint8_t> data;
+  FILE* f = std::fopen(Storage.hostPath(UPLOAD_PATH).c_str(), "rb");
+  if (!f) return data;
+  uint8_t chunk[4096];
+  size_t n;
+  while ((n = std::fread(chunk, 1, sizeof(chunk), f)) > 0) data.insert(data.end(), chunk, chunk + n);
+  std::fclose(f);
+  return data;
+}
+
+// Streams `payload` through a local socket pair one TCP segment at a time. The sender waits `sendGapUs` between
+// segments to model the link speed; the receiver hands each chunk to `consume`, like the web server does.
+struct LoopbackResult {
+  double totalMs = 0;
+  double senderMs = 0;
+  bool ok = false;
+};
+
+template <typename Consume>
+LoopbackResult runLoopback(const std::vector<uint8_t>& payload, const unsigned sendGapUs, Consume consume) {
+  int fds[2];
+  LoopbackResult result;
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+    check(false, "socketpair");
+    return result;
+  }
+  // Smallest socket buffers the kernel allows (a few segments, like the device's TCP window), so a receiver that
+  // stops reading soon stalls the sender
+  const int socketBuffer = 1;
+  setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &socketBuffer, sizeof(socketBuffer));
+  setsockopt(fds[1], SOL_SOCKET, SO_RCVBUF, &socketBuffer, sizeof(socketBuffer));
+
+  const auto start = Clock::now();
+  std::thread sender([&] {
+    constexpr size_t CHUNK = 1460;
+    for (size_t pos = 0; pos < payload.size(); pos += CHUNK) {
+      const size_t len = std::min(CHUNK, payload.size() - pos);
+      size_t sent = 0;
+      while (sent < len) {
+        const ssize_t n = send(fds[0], payload.data() + pos + sent, len - sent, 0);
+        if (n <= 0) return;
+        sent += static_cast<size_t>(n);
+      }
+      if (sendGapUs > 0) std::this_thread::sleep_for(std::chrono::microseconds(sendGapUs));
+    }
+    result.senderMs = msSince(start);
+    shutdown(fds[0], SHUT_WR);
+  });
+
+  result.ok = true;
+  uint8_t chunk[1460];  // One TCP segment at a time, as WiFiClient delivers it
+  ssize_t n;
+  while ((n = recv(fds[1], chunk, sizeof(chunk), 0)) > 0) {
+    if (!consume(chunk, static_cast<size_t>(n))) {
+      result.ok = false;
+      break;
+    }
+  }
+  close(fds[1]);
+  sender.join();
+  close(fds[0]);
+  result.totalMs = msSince(start);
+  return result;
+}
+
+// SD card model for the timing tests: fixed cost per write call plus bandwidth
+void slowCard() {
+  HalStorageSim::reset();
+  HalStorageSim::writeLatencyUs = 1000;
+  HalStorageSim::writeUsPerKiB = 500;
+}
+
+void testCrcMatchesZlib() {
+  const char* text = "123456789";
+  check(esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(text), 9) == 0xCBF43926, "CRC-32 check value");
+  const uint32_t first = esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(text), 4);
+  check(esp_rom_crc32_le(first, reinterpret_cast<const uint8_t*>(text) + 4, 5) == 0xCBF43926, "CRC-32 continues");
+}
+
+void testStreamsUploadIntact() {
+  HalStorageSim::reset();
+  const auto payload = makePayload(300 * 1024 + 123);  // Not a multiple of the buffer size
+  const uint32_t expectedCrc = crcOf(payload);
+
+  UploadWriter writer;
+  check(writer.begin(UPLOAD_PATH), "begin");
+  check(writer.isActive(), "active after begin");
+  const auto result = runLoopback(payload, 0, [&](const uint8_t* data, size_t len) { return writer.write(data, len); });
+  check(result.ok, "all chunks accepted");
+  check(writer.finish(payload.size(), &expectedCrc), "finish verifies size and CRC");
+  check(!writer.isActive(), "inactive after finish");
+  check(writer.getError() == nullptr, "no error");
+  check(writer.getBytesReceived() == payload.size(), "byte count");
+  check(writer.getCrc() == expectedCrc, "running CRC");
+  check(readUpload() == payload, "file content matches upload");
+  check(writer.getWriteCount() == (payload.size() + UploadWriter::BUFFER_SIZE - 1) / UploadWriter::BUFFER_SIZE,
+        "one SD write per full buffer");
+}
+
+void testOverlapsNetworkAndCard() {
+  const auto payload = makePayload(512 * 1024);
+  constexpr unsigned SEND_GAP_US = 700;  // ~2 MB/s link
+
+  // Baseline: the previous synchronous path, which wrote each full buffer before reading the socket again
+  slowCard();
+  double syncMs = 0;
+  {
+    FsFile file;
+    check(Storage.openFileForWrite("TEST", UPLOAD_PATH, file), "open for synchronous baseline");
+    std::vector<uint8_t> buffer(UploadWriter::BUFFER_SIZE);
+    size_t bufferPos = 0;
+    const auto result = runLoopback(payload, SEND_GAP_US, [&](const uint8_t* data, size_t len) {
+      while (len > 0) {
+        const size_t toCopy = std::min(len, buffer.size() - bufferPos);
+        memcpy(buffer.data() + bufferPos, data, toCopy);
+        bufferPos += toCopy;
+        data += toCopy;
+        len -= toCopy;
+        if (bufferPos == buffer.size()) {
+          if (file.write(buffer.data(), bufferPos) != bufferPos) return false;
+          bufferPos = 0;
+        }
+      }
+      return true;
+    });
+    if (bufferPos > 0) file.write(buffer.data(), bufferPos);
+    file.close();
+    syncMs = result.totalMs;
+    check(result.ok, "synchronous baseline completes");
+  }
+
+  slowCard();
+  UploadWriter writer;
+  check(writer.begin(UPLOAD_PATH), "begin buffered");
+  const auto start = Clock::now();
+  const auto result =
+      runLoopback(payload, SEND_GAP_US, [&](const uint8_t* data, size_t len) { return writer.write(data, len); });
+  const uint32_t expectedCrc = crcOf(payload);
+  check(result.ok && writer.finish(payload.size(), &expectedCrc), "buffered upload completes");
+  const double bufferedMs = msSince(start);
+  check(readUpload() == payload, "buffered content matches");
+
+  // Card and network each take roughly 300 ms here: overlapped they should take little more than one of them
+  check(bufferedMs < syncMs * 0.85, "buffered upload overlaps network and card (" + std::to_string(bufferedMs) +
+                                       " ms vs " + std::to_string(syncMs) + " ms)");
+  if (bench) {
+    const double kib = payload.size() / 1024.0;
+    std::cout << "synchronous: " << syncMs << " ms (" << kib / syncMs * 1000 << " KiB/s)" << std::endl;
+    std::cout << "buffered:    " << bufferedMs << " ms (" << kib / bufferedMs * 1000 << " KiB/s), "
+              << writer.getWriteCount() << " writes taking " << writer.getWriteTimeMs() << " ms" << std::endl;
+  }
+  HalStorageSim::reset();
+}
+
+void testSlowCardThrottlesSender() {
+  HalStorageSim::reset();
+  HalStorageSim::writeLatencyUs = 20000;  // 8 KiB every 20 ms, far below the unpaced sender
+  const auto payload = makePayload(256 * 1024);
+
+  UploadWriter writer;
+  check(writer.begin(UPLOAD_PATH), "begin");
+  const auto result = runLoopback(payload, 0, [&](const uint8_t* data, size_t len) { return writer.write(data, len); });
+  check(result.ok && writer.finish(payload.size()), "throttled upload completes");
+  check(readUpload() == payload, "throttled content matches");
+  // Only the buffer ring and the socket buffers can run ahead of the card, so the sender finishes late too
+  check(result.senderMs > result.totalMs * 0.5, "sender held back by the card (" + std::to_string(result.senderMs) +
+                                                    " of " + std::to_string(result.totalMs) + " ms)");
+  HalStorageSim::reset();
+}
+
+void testRejectsCorruptUpload() {
+  HalStorageSim::reset();
+  const auto payload = makePayload(40000);
+  const uint32_t wrongCrc = crcOf(payload) ^ 1;
+
+  UploadWriter writer;
+  check(writer.begin(UPLOAD_PATH), "begin");
+  check(writer.write(payload.data(), payload.size()), "write");
+  check(!writer.finish(payload.size(), &wrongCrc), "CRC mismatch rejected");
+  check(writer.getError() != nullptr && std::string(writer.getError()).find("checksum") != std::string::npos,
+        "checksum error reported");
+  check(!Storage.exists(UPLOAD_PATH.c_str()), "corrupt upload removed");
+
+  check(writer.begin(UPLOAD_PATH), "writer reusable");
+  check(writer.write(payload.data(), payload.size()), "write again");
+  check(!writer.finish(payload.size() + 1), "size mismatch rejected");
+  check(!Storage.exists(UPLOAD_PATH.c_str()), "short upload removed");
+}
+
+void testDiskFull() {
+  HalStorageSim::reset();
+  HalStorageSim::writeLimit = 20000;
+  const auto payload = makePayload(128 * 1024);
+
+  UploadWriter writer;
+  check(writer.begin(UPLOAD_PATH), "begin");
+  bool accepted = true;
+  for (size_t pos = 0; pos < payload.size() && accepted; pos += 1000) {
+    accepted = writer.write(payload.data() + pos, std::min<size_t>(1000, payload.size() - pos));
+  }
+  check(!accepted, "writes refused once the card is full");
+  check(!writer.finish(), "finish reports failure");
+  check(writer.getError() != nullptr && std::string(writer.getError()).find("full") != std::string::npos,
+        "disk full reported");
+  check(!Storage.exists(UPLOAD_PATH.c_str()), "partial upload removed");
+  HalStorageSim::reset();
+}
+
+void testAbort() {
+  HalStorageSim::reset();
+  HalStorageSim::writeLatencyUs = 5000;
+  const auto payload = makePayload(64 * 1024);
+
+  UploadWriter writer;
+  check(writer.begin(UPLOAD_PATH), "begin");
+  check(writer.write(payload.data(), payload.size()), "write");
+  writer.abort();
+  check(!writer.isActive(), "inactive after abort");
+  check(!Storage.exists(UPLOAD_PATH.c_str()), "aborted upload removed");
+  check(!writer.write(payload.data(), 10), "write after abort refused");
+
+  // Destroying an active writer aborts it
+  {
+    UploadWriter scoped;
+    check(scoped.begin(UPLOAD_PATH), "begin scoped");
+    check(scoped.write(payload.data(), payload.size()), "write scoped");
+  }
+  check(!Storage.exists(UPLOAD_PATH.c_str()), "abandoned upload removed");
+  HalStorageSim::reset();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--bench") bench = true;
+  }
+
+  char scratch[] = "/tmp/upload_writer_XXXXXX";
+  if (!mkdtemp(scratch)) {
+    std::cerr << "Failed to create scratch directory" << std::endl;
+    return 1;
+  }
+  Storage.setRoot(scratch);
+
+  testCrcMatchesZlib();
+  testStreamsUploadIntact();
+  testOverlapsNetworkAndCard();
+  testSlowCardThrottlesSender();
+  testRejectsCorruptUpload();
+  testDiskFull();
+  testAbort();
+
+  std::remove(Storage.hostPath(UPLOAD_PATH).c_str());
+  rmdir(scratch);
+
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All upload writer tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+
+#include "src/network/WebDAVProtocol.h"
+
+// Heap accounting: every allocation carries its size so peak usage can be measured around a call
+namespace heap {
+std::atomic<size_t> live{0};
+std::atomic<size_t> peak{0};
+
+void* allocate(const size_t size) {
+  auto* block = static_cast<size_t*>(std::malloc(size + sizeof(std::max_align_t)));
+  if (!block) throw std::bad_alloc();
+  *block = size;
+  const size_t now = live += size;
+  size_t seen = peak;
+  while (now > seen && !peak.compare_exchange_weak(seen, now)) {
+  }
+  return reinterpret_cast<char*>(block) + sizeof(std::max_align_t);
+}
+
+void release(void* ptr) {
+  if (!ptr) return;
+  auto* block = reinterpret_cast<size_t*>(static_cast<char*>(ptr) - sizeof(std::max_align_t));
+  live -= *block;
+  std::free(block);
+}
+
+// Peak heap above the current level while `fn` runs
+template <typename Fn>
+size_t peakDuring(Fn fn) {
+  const size_t base = live;
+  peak = base;
+  fn();
+  return peak - base;
+}
+}  // namespace heap
+
+void* operator new(const size_t size) { return heap::allocate(size); }
+void* operator new[](const size_t size) { return heap::allocate(size); }
+void operator delete(void* ptr) noexcept { heap::release(ptr); }
+void operator delete[](void* ptr) noexcept { heap::release(ptr); }
+void operator delete(void* ptr, size_t) noexcept { heap::release(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { heap::release(ptr); }
+
+namespace {
+
+using WebDAVProtocol::ByteRange;
+using WebDAVProtocol::RangeResult;
+
+int failures = 0;
+bool bench = false;
+
+void check(const bool condition, const std::string& message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << std::endl;
+    failures++;
+  }
+}
+
+using Clock = std::chrono::steady_clock;
+
+double msSince(const Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+size_t countOccurrences(const std::string& haystack, const char* needle) {
+  size_t count = 0;
+  for (size_t at = haystack.find(needle); at != std::string::npos; at = haystack.find(needle, at + 1)) count++;
+  return count;
+}
+
+void checkRange(const char* header, const uint32_t size, const RangeResult expected, const uint32_t start = 0,
+                const uint32_t length = 0) {
+  ByteRange range;
+  const RangeResult result = WebDAVProtocol::parseRange(header, size, range);
+  check(result == expected, std::string("range result for '") + header + "'");
+  if (result == RangeResult::Partial && expected == RangeResult::Partial) {
+    check(range.start == start && range.length == length,
+          std::string("range bounds for '") + header + "': got " + std::to_string(range.start) + "+" +
+              std::to_string(range.length));
+  }
+}
+
+// Examples from RFC 9110 §14.1.2 plus the malformed and edge cases clients actually send
+void testRanges() {
+  checkRange("bytes=0-499", 10000, RangeResult::Partial, 0, 500);
+  checkRange("bytes=500-999", 10000, RangeResult::Partial, 500, 500);
+  checkRange("bytes=-500", 10000, RangeResult::Partial, 9500, 500);
+  checkRange("bytes=9500-", 10000, RangeResult::Partial, 9500, 500);
+  checkRange("bytes=0-", 10000, RangeResult::Partial, 0, 10000);
+  checkRange("bytes=9990-99999", 10000, RangeResult::Partial, 9990, 10);
+  checkRange("bytes=-20000", 10000, RangeResult::Partial, 0, 10000);
+  checkRange(" bytes= 100-199 ", 10000, RangeResult::Partial, 100, 100);
+  checkRange("bytes=0-99999999999999", 10000, RangeResult::Partial, 0, 10000);
+
+  checkRange("bytes=10000-", 10000, RangeResult::Unsatisfiable);
+  checkRange("bytes=20000-30000", 10000, RangeResult::Unsatisfiable);
+  checkRange("bytes=-0", 10000, RangeResult::Unsatisfiable);
+  checkRange("bytes=0-", 0, RangeResult::Unsatisfiable);
+  checkRange("bytes=-5", 0, RangeResult::Unsatisfiable);
+
+  checkRange("bytes=0-0,-1", 10000, RangeResult::Full);
+  checkRange("bytes=500-400", 10000, RangeResult::Full);
+  checkRange("items=0-1", 10000, RangeResult::Full);
+  checkRange("bytes=abc", 10000, RangeResult::Full);
+  checkRange("bytes=-", 10000, RangeResult::Full);
+  checkRange("bytes=1-2x", 10000, RangeResult::Full);
+  checkRange("", 10000, RangeResult::Full);
+
+  uint32_t first = 0;
+  uint32_t last = 0;
+  check(WebDAVProtocol::parseContentRange("bytes 0-499/1234", first, last) && first == 0 && last == 499,
+        "content range with total");
+  check(WebDAVProtocol::parseContentRange("bytes 500-999/*", first, last) && first == 500 && last == 999,
+        "content range with unknown total");
+  check(!WebDAVProtocol::parseContentRange("bytes 0-499/400", first, last), "content range beyond total");
+  check(!WebDAVProtocol::parseContentRange("bytes 9-1/*", first, last), "reversed content range");
+  check(!WebDAVProtocol::parseContentRange("bytes */1234", first, last), "unsatisfied-range form");
+  check(!WebDAVProtocol::parseContentRange("bytes=0-1/2", first, last), "Range syntax in Content-Range");
+}
+
+void testEtags() {
+  // 2024-03-05 14:30:20 in FAT format
+  const uint16_t date = (44 << 9) | (3 << 5) | 5;
+  const uint16_t time = (14 << 11) | (30 << 5) | 10;
+  char etag[32];
+  WebDAVProtocol::makeEtag(1234, date, time, etag, sizeof(etag));
+  check(std::string(etag) == "\"4d2-586573ca\"", std::string("etag format: ") + etag);
+
+  char other[32];
+  WebDAVProtocol::makeEtag(1235, date, time, other, sizeof(other));
+  check(strcmp(etag, other) != 0, "size changes the etag");
+  WebDAVProtocol::makeEtag(1234, date, time + 1, other, sizeof(other));
+  check(strcmp(etag, other) != 0, "modification time changes the etag");
+
+  check(WebDAVProtocol::etagListMatches("\"4d2-586573ca\"", etag, false), "single tag matches");
+  check(WebDAVProtocol::etagListMatches("\"x\", \"4d2-586573ca\" ,\"y\"", etag, false), "tag in a list matches");
+  check(WebDAVProtocol::etagListMatches(" * ", etag, false), "star matches");
+  check(!WebDAVProtocol::etagListMatches("\"4d2-586573cb\"", etag, true), "other tag does not match");
+  check(WebDAVProtocol::etagListMatches("W/\"4d2-586573ca\"", etag, true), "weak comparison ignores W/");
+  check(!WebDAVProtocol::etagListMatches("W/\"4d2-586573ca\"", etag, false), "strong comparison rejects W/");
+  check(!WebDAVProtocol::etagListMatches("", etag, true), "empty list matches nothing");
+
+  char lastModified[32];
+  WebDAVProtocol::formatHttpDate(date, time, lastModified, sizeof(lastModified));
+  check(std::string(lastModified) == "Tue, 05 Mar 2024 14:30:20 GMT", std::string("http date: ") + lastModified);
+  WebDAVProtocol::formatHttpDate((20 << 9) | (2 << 5) | 29, 0, lastModified, sizeof(lastModified));
+  check(std::string(lastModified) == "Tue, 29 Feb 2000 00:00:00 GMT", std::string("leap day: ") + lastModified);
+  WebDAVProtocol::formatHttpDate(0, 0, lastModified, sizeof(lastModified));
+  check(std::string(lastModified) == "Mon, 01 Jan 2024 00:00:00 GMT", std::string("no timestamp: ") + lastModified);
+
+  WebDAVProtocol::formatHttpDate(date, time, lastModified, sizeof(lastModified));
+  check(WebDAVProtocol::ifRangeMatches("\"4d2-586573ca\"", etag, lastModified), "If-Range with current tag");
+  check(!WebDAVProtocol::ifRangeMatches("\"4d2-0\"", etag, lastModified), "If-Range with old tag");
+  check(!WebDAVProtocol::ifRangeMatches("W/\"4d2-586573ca\"", etag, lastModified), "If-Range with weak tag");
+  check(WebDAVProtocol::ifRangeMatches("Tue, 05 Mar 2024 14:30:20 GMT", etag, lastModified), "If-Range with date");
+  check(!WebDAVProtocol::ifRangeMatches("Tue, 05 Mar 2024 14:30:18 GMT", etag, lastModified),
+        "If-Range with older date");
+
+  uint32_t seconds = 0;
+  check(WebDAVProtocol::parseHttpDate("Sun, 06 Nov 1994 08:49:37 GMT", seconds) && seconds == 784111777,
+        "IMF-fixdate parses");
+  check(WebDAVProtocol::parseHttpDate("Sunday, 06-Nov-94 08:49:37 GMT", seconds) && seconds == 784111777,
+        "RFC 850 date parses");
+  check(WebDAVProtocol::parseHttpDate("Sun Nov  6 08:49:37 1994", seconds) && seconds == 784111777,
+        "asctime date parses");
+  check(WebDAVProtocol::parseHttpDate("Tue, 29 Feb 2000 00:00:00 GMT", seconds) && seconds == 951782400, "leap day");
+  check(!WebDAVProtocol::parseHttpDate("", seconds), "empty date");
+  check(!WebDAVProtocol::parseHttpDate("yesterday", seconds), "garbage date");
+  check(!WebDAVProtocol::parseHttpDate("Sun, 06 Foo 1994 08:49:37 GMT", seconds), "unknown month");
+  check(!WebDAVProtocol::parseHttpDate("Sun, 06 Nov 1994 08:49 GMT", seconds), "truncated time");
+
+  check(WebDAVProtocol::notModifiedSince("Tue, 05 Mar 2024 14:30:20 GMT", date, time), "If-Modified-Since, same date");
+  check(WebDAVProtocol::notModifiedSince("Wed, 06 Mar 2024 09:00:00 GMT", date, time),
+        "If-Modified-Since, later date");
+  check(WebDAVProtocol::notModifiedSince("Tuesday, 05-Mar-24 14:30:20 GMT", date, time),
+        "If-Modified-Since in another format");
+  check(!WebDAVProtocol::notModifiedSince("Tue, 05 Mar 2024 14:30:19 GMT", date, time),
+        "If-Modified-Since, earlier date");
+  check(!WebDAVProtocol::notModifiedSince("not a date", date, time), "unparsable If-Modified-Since");
+  check(WebDAVProtocol::notModifiedSince("Mon, 01 Jan 2024 00:00:00 GMT", 0, 0), "file without a timestamp");
+}
+
+void testMultistatus() {
+  std::string body;
+  size_t chunks = 0;
+  size_t largestChunk = 0;
+  WebDAVProtocol::MultistatusWriter writer([&](const char* data, const size_t length) {
+    body.append(data, length);
+    chunks++;
+    largestChunk = std::max(largestChunk, length);
+  });
+
+  writer.begin();
+  writer.addEntry("/", true, 0, "Mon, 01 Jan 2024 00:00:00 GMT", nullptr, nullptr);
+  writer.addEntry("/Books/a b&<c>#?.epub", false, 42, "Mon, 01 Jan 2024 00:00:00 GMT", "\"2a-0\"",
+                  "application/epub+zip");
+  writer.addEntry("/Books/Caf\xC3\xA9", true, 0, "Mon, 01 Jan 2024 00:00:00 GMT", nullptr, nullptr);
+  writer.end();
+
+  check(body.rfind("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<D:multistatus xmlns:D=\"DAV:\">\n", 0) == 0,
+        "multistatus prologue");
+  check(body.size() >= 17 && body.compare(body.size() - 17, 17, "</D:multistatus>\n") == 0, "multistatus epilogue");
+  check(body.find("<D:href>/</D:href>") != std::string::npos, "root href");
+  check(body.find("<D:href>/Books/a%20b%26%3Cc%3E%23%3F.epub</D:href>") != std::string::npos,
+        "file href is percent-encoded");
+  check(body.find("<D:href>/Books/Caf%C3%A9/</D:href>") != std::string::npos,
+        "folder href is encoded with a trailing slash");
+  check(body.find("<D:getcontentlength>42</D:getcontentlength>") != std::string::npos, "content length");
+  check(body.find("<D:getetag>\"2a-0\"</D:getetag>") != std::string::npos, "etag property");
+  check(countOccurrences(body, "<D:collection/>") == 2, "two collections");
+  check(chunks == 1, "small listing is sent as one chunk");
+
+  // A big folder: memory stays flat and chunks stay segment-sized
+  constexpr int ENTRIES = 10000;
+  body.clear();
+  body.reserve(8 * 1024 * 1024);
+  chunks = 0;
+  largestChunk = 0;
+  char path[64];
+  const auto start = Clock::now();
+  const size_t peak = heap::peakDuring([&] {
+    writer.begin();
+    writer.addEntry("/Library", true, 0, "Mon, 01 Jan 2024 00:00:00 GMT", nullptr, nullptr);
+    for (int i = 0; i < ENTRIES; i++) {
+      snprintf(path, sizeof(path), "/Library/Book number %05d.epub", i);
+      writer.addEntry(path, false, 100000 + i, "Tue, 05 Mar 2024 14:30:20 GMT", "\"186a0-586573ca\"",
+                      "application/epub+zip");
+    }
+    writer.end();
+  });
+  const double elapsed = msSince(start);
+
+  check(peak == 0, "writing entries allocates nothing, got " + std::to_string(peak) + " bytes");
+  check(countOccurrences(body, "<D:response>") == ENTRIES + 1, "every entry is written");
+  check(countOccurrences(body, "</D:response>") == ENTRIES + 1, "every entry is closed");
+  check(largestChunk <= 1400, "chunks fit a segment, largest " + std::to_string(largestChunk));
+  check(chunks <= body.size() / 1400 + 1, "chunks are filled, " + std::to_string(chunks) + " sent");
+
+  if (bench) {
+    std::cout << "PROPFIND body for " << ENTRIES << " entries: " << body.size() << " bytes in " << chunks
+              << " chunks (one per entry before: " << ENTRIES + 1 << "), " << elapsed << " ms, peak heap " << peak
+              << " B" << std::endl;
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--bench") bench = true;
+  }
+
+  testRanges();
+  testEtags();
+  testMultistatus();
+
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All WebDAV protocol tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,370 @@
+#include <HalStorage.h>
+#include <expat.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "lib/Epub/Epub/XPathMap.h"
+
+namespace {
+
+int failures = 0;
+bool bench = false;
+
+void check(const bool condition, const std::string& message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << std::endl;
+    failures++;
+  }
+}
+
+std::string runCommand(const std::string& command) {
+  std::string output;
+  FILE* pipe = popen(command.c_str(), "r");
+  if (!pipe) return output;
+  char buffer[4096];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), pipe)) > 0) output.append(buffer, read);
+  pclose(pipe);
+  return output;
+}
+
+std::string epubPath(const std::string& name) { return std::string(TEST_EPUB_DIR) + "/" + name; }
+
+std::string readEntry(const std::string& epub, const std::string& entry) {
+  return runCommand("unzip -p '" + epubPath(epub) + "' '" + entry + "'");
+}
+
+std::vector<std::string> chapterEntries(const std::string& epub) {
+  std::vector<std::string> entries;
+  const std::string listing = runCommand("unzip -Z1 '" + epubPath(epub) + "'");
+  size_t start = 0;
+  while (start < listing.size()) {
+    size_t end = listing.find('\n', start);
+    if (end == std::string::npos) end = listing.size();
+    const std::string entry = listing.substr(start, end - start);
+    if (entry.size() > 6 && (entry.compare(entry.size() - 6, 6, ".xhtml") == 0 ||
+                             entry.compare(entry.size() - 5, 5, ".html") == 0)) {
+      entries.push_back(entry);
+    }
+    start = end + 1;
+  }
+  return entries;
+}
+
+// Stands in for ChapterHtmlSlimParser: feeds the map like the parser does and lays words out onto pages, breaking
+// every `wordsPerPage` words and before each word in `breakBefore` (matched in order, first occurrence each)
+struct Layout {
+  XPathMap map{"/scratch.xpath"};
+  int wordsPerPage = 0;
+  std::vector<std::string> breakBefore;
+  size_t nextBreak = 0;
+
+  bool inBody = false;
+  bool bodySeen = false;
+  std::string word;
+  uint32_t wordOffset = 0;
+  int wordsOnPage = 0;
+  uint16_t page = 0;
+  std::vector<std::string> pageFirstWords;
+
+  void flushWord() {
+    if (word.empty()) return;
+    const bool forced = nextBreak < breakBefore.size() && word == breakBefore[nextBreak];
+    if (forced) nextBreak++;
+    if (wordsOnPage > 0 && (forced || (wordsPerPage > 0 && wordsOnPage >= wordsPerPage))) {
+      page++;
+      wordsOnPage = 0;
+    }
+    if (wordsOnPage == 0) {
+      map.markPage(page, wordOffset);
+      pageFirstWords.push_back(word);
+    }
+    wordsOnPage++;
+    word.clear();
+  }
+
+  static void XMLCALL onStart(void* userData, const XML_Char* name, const XML_Char**) {
+    auto* self = static_cast<Layout*>(userData);
+    self->map.startElement(name);
+    self->flushWord();
+    if (strcmp(name, "body") == 0 && !self->bodySeen) self->inBody = self->bodySeen = true;
+  }
+
+  static void XMLCALL onEnd(void* userData, const XML_Char* name) {
+    auto* self = static_cast<Layout*>(userData);
+    self->map.endElement();
+    self->flushWord();
+    if (strcmp(name, "body") == 0) self->inBody = false;
+  }
+
+  static void XMLCALL onText(void* userData, const XML_Char* s, const int len) {
+    auto* self = static_cast<Layout*>(userData);
+    for (int i = 0; i < len; i++) {
+      self->map.character(s[i]);
+      if (!self->inBody) continue;
+      if (s[i] == ' ' || s[i] == '\n' || s[i] == '\r' || s[i] == '\t') {
+        self->flushWord();
+        continue;
+      }
+      if (self->word.empty()) self->wordOffset = self->map.lastOffset();
+      self->word += s[i];
+    }
+  }
+
+  bool parse(const std::string& xhtml) {
+    XML_Parser parser = XML_ParserCreate(nullptr);
+    XML_SetUserData(parser, this);
+    XML_SetElementHandler(parser, onStart, onEnd);
+    XML_SetCharacterDataHandler(parser, onText);
+    const bool ok = XML_Parse(parser, xhtml.data(), static_cast<int>(xhtml.size()), 1) != XML_STATUS_ERROR;
+    XML_ParserFree(parser);
+    flushWord();
+    return ok;
+  }
+};
+
+// Writes the map behind some filler, like the pages and LUT of a section file, and returns its offset
+uint32_t writeSection(Layout& layout, const std::string& path) {
+  FsFile file;
+  Storage.openFileForWrite("TEST", path, file);
+  const char filler[] = "pages and lookup tables come first";
+  file.write(filler, sizeof(filler));
+  const uint32_t offset = file.position();
+  const bool written = layout.map.write(file);
+  file.close();
+  return written ? offset : 0;
+}
+
+struct Section {
+  std::string path;
+  uint32_t offset = 0;
+  int spineIndex = 0;
+
+  std::optional<uint16_t> page(const std::string& xpath) const {
+    FsFile file;
+    Storage.openFileForRead("TEST", path, file);
+    file.seek(offset);
+    auto result = XPathMap::findPage(file, xpath);
+    file.close();
+    return result;
+  }
+
+  std::string xpath(const uint16_t page) const {
+    FsFile file;
+    Storage.openFileForRead("TEST", path, file);
+    file.seek(offset);
+    auto result = XPathMap::findXPath(file, spineIndex, page);
+    file.close();
+    return result;
+  }
+};
+
+Section layOut(Layout& layout, const std::string& epub, const std::string& entry, const int spineIndex) {
+  check(layout.parse(readEntry(epub, entry)), "parse " + epub + " " + entry);
+  Section section{"/section.bin", 0, spineIndex};
+  section.offset = writeSection(layout, section.path);
+  check(section.offset != 0, "map written for " + epub + " " + entry);
+  return section;
+}
+
+void checkPage(const Section& section, const std::string& xpath, const int expected) {
+  const auto page = section.page(xpath);
+  check(page.has_value() && *page == expected,
+        xpath + " lands on page " + std::to_string(expected) + ", got " + (page ? std::to_string(*page) : "none"));
+}
+
+void checkXPath(const Section& section, const uint16_t page, const std::string& expected) {
+  const std::string xpath = section.xpath(page);
+  check(xpath == expected, "page " + std::to_string(page) + " is " + expected + ", got " + xpath);
+}
+
+// Chapter 1 of the kerning book: a heading split by <br/>, entities, and <i> runs inside paragraphs
+void testInlineMarkup() {
+  Layout layout;
+  layout.breakBefore = {"The", "\xe2\x80\x9c" "AWAY", "floor", "Purveyors", "leaned"};
+  const Section section = layOut(layout, "test_kerning_ligature.epub", "OEBPS/chapter1.xhtml", 2);
+  check(layout.pageFirstWords.size() == 6, "kerning chapter laid out on six pages");
+
+  // What KOReader reports with the first word of each page at the top of the screen
+  checkXPath(section, 0, "/body/DocFragment[3]/body/h1/text()[1].0");
+  checkXPath(section, 1, "/body/DocFragment[3]/body/h1/text()[2].0");
+  checkXPath(section, 2, "/body/DocFragment[3]/body/p[1]/text().206");
+  checkXPath(section, 3, "/body/DocFragment[3]/body/p[2]/text()[2].18");
+  checkXPath(section, 4, "/body/DocFragment[3]/body/p[2]/i[2]/text().0");
+  checkXPath(section, 5, "/body/DocFragment[3]/body/p[7]/text().3");
+  check(section.xpath(6).empty(), "no xpointer past the last page");
+
+  // Positions anywhere on a page resolve to it, down to the character
+  checkPage(section, "/body/DocFragment[3]/body/p[1]/text().50", 1);
+  checkPage(section, "/body/DocFragment[3]/body/p[1]/text().205", 1);
+  checkPage(section, "/body/DocFragment[3]/body/p[1]/text().206", 2);
+  checkPage(section, "/body/DocFragment[3]/body/p[2]/i/text().0", 2);
+  checkPage(section, "/body/DocFragment[3]/body/p[2]/text()[2].17", 2);
+  checkPage(section, "/body/DocFragment[3]/body/p[5]", 4);
+  checkPage(section, "/body/DocFragment[3]/body/p[7]/text().0", 4);
+  checkPage(section, "/body/DocFragment[3]/body/p[7]/text().3", 5);
+
+  // Explicit [1] indices mean the same as none
+  checkPage(section, "/body/DocFragment[3]/body[1]/h1[1]/text()[2].0", 1);
+  checkPage(section, "/body/DocFragment[3]/body/p[2]/i[1]/text()[1].0", 2);
+  // A text node we don't know falls back to its element, a missing element to nothing
+  checkPage(section, "/body/DocFragment[3]/body/p[2]/text()[9].0", 2);
+  check(!section.page("/body/DocFragment[3]/body/p[9]/text().0"), "missing paragraph has no page");
+  check(!section.page("/body/DocFragment[3]/body/section/p"), "unknown tag has no page");
+  check(!section.page("/body/DocFragment[3]"), "fragment alone has no page");
+  check(!section.page("/html/body/p"), "non-KOReader path has no page");
+}
+
+// Tables nest several levels of block containers with whitespace-only text between them
+void testNestedBlocks() {
+  Layout layout;
+  layout.breakBefore = {"second"};
+  const Section section = layOut(layout, "test_tables.epub", "EPUB/text/ch002.xhtml", 4);
+  checkXPath(section, 0, "/body/DocFragment[5]/body/section/h1/text().0");
+  checkXPath(section, 1, "/body/DocFragment[5]/body/section/table/tbody/tr/td[2]/text().12");
+  checkPage(section, "/body/DocFragment[5]/body/section/table/tbody/tr/td[1]/text().0", 0);
+  checkPage(section, "/body/DocFragment[5]/body/section/table/tbody/tr/td[2]/text().11", 0);
+  checkPage(section, "/body/DocFragment[5]/body/section/table/tbody/tr/td[2]/text().12", 1);
+}
+
+// Images are elements without text; pointing at one lands on the page of the text that follows it
+void testImages() {
+  Layout layout;
+  layout.breakBefore = {"PNG"};
+  const Section section = layOut(layout, "test_mixed_images.epub", "OEBPS/chapter4.xhtml", 3);
+  checkXPath(section, 1, "/body/DocFragment[4]/body/p[2]/text().0");
+  checkPage(section, "/body/DocFragment[4]/body/p[1]/text().5", 0);
+  checkPage(section, "/body/DocFragment[4]/body/img[1]", 1);
+  checkPage(section, "/body/DocFragment[4]/body/img[2]", 1);
+  checkPage(section, "/body/DocFragment[4]/body/p[3]/text().5", 1);
+}
+
+// Every page of every bundled chapter converts to an xpointer and back to the same page
+void testRoundTrips() {
+  const char* books[] = {"test_jpeg_images.epub", "test_kerning_ligature.epub", "test_mixed_images.epub",
+                         "test_png_images.epub", "test_tables.epub"};
+  int pages = 0;
+  for (const char* book : books) {
+    const auto entries = chapterEntries(book);
+    check(!entries.empty(), std::string("chapters found in ") + book);
+    for (size_t i = 0; i < entries.size(); i++) {
+      Layout layout;
+      layout.wordsPerPage = 7;
+      const Section section = layOut(layout, book, entries[i], static_cast<int>(i));
+      for (uint16_t page = 0; page < layout.pageFirstWords.size(); page++) {
+        const std::string xpath = section.xpath(page);
+        const auto back = section.page(xpath);
+        check(back.has_value() && *back == page, std::string(book) + " " + entries[i] + " page " +
+                                                     std::to_string(page) + " round trip through " + xpath);
+        check(XPathMap::spineIndexOf(xpath) == static_cast<int>(i), "xpointer names its spine item");
+        pages++;
+      }
+    }
+  }
+  check(pages > 100, "round trips cover the bundled books: " + std::to_string(pages));
+}
+
+void testSpineIndex() {
+  check(XPathMap::spineIndexOf("/body/DocFragment[1]/body/p/text().0") == 0, "DocFragment is 1-based");
+  check(XPathMap::spineIndexOf("/body/DocFragment[12]/body") == 11, "multi-digit DocFragment");
+  check(XPathMap::spineIndexOf("/body/DocFragment[0]/body") == -1, "DocFragment 0 is invalid");
+  check(XPathMap::spineIndexOf("/body/DocFragment/body") == -1, "DocFragment needs an index");
+  check(XPathMap::spineIndexOf("") == -1, "empty xpointer");
+}
+
+void testFailures() {
+  // A scratch file that can't be created leaves nothing to write
+  XPathMap broken("/missing/dir/scratch.xpath");
+  broken.startElement("body");
+  broken.text("words", 5);
+  broken.endElement();
+  broken.markPage(0, 0);
+  FsFile file;
+  Storage.openFileForWrite("TEST", "/broken.bin", file);
+  check(!broken.write(file), "unwritable scratch file fails the map");
+  check(file.position() == 0, "failed map writes nothing");
+  file.close();
+
+  // Documents without a body have no map either
+  XPathMap empty("/empty.xpath");
+  empty.startElement("html");
+  empty.endElement();
+  Storage.openFileForWrite("TEST", "/empty.bin", file);
+  check(!empty.write(file), "no body, no map");
+  file.close();
+
+  // Truncated tables are rejected instead of read past their end
+  Layout layout;
+  layout.wordsPerPage = 5;
+  Section section = layOut(layout, "test_kerning_ligature.epub", "OEBPS/chapter2.xhtml", 0);
+  const std::string bytes = runCommand("head -c 200 '" + Storage.hostPath(section.path) + "'");
+  FILE* truncated = fopen(Storage.hostPath("/truncated.bin").c_str(), "wb");
+  fwrite(bytes.data(), 1, bytes.size(), truncated);
+  fclose(truncated);
+  section.path = "/truncated.bin";
+  check(section.xpath(0).empty(), "truncated map has no xpointers");
+  check(!section.page("/body/DocFragment[1]/body/p/text().0"), "truncated map has no pages");
+}
+
+void benchLookups() {
+  Layout layout;
+  layout.wordsPerPage = 120;
+  const Section section = layOut(layout, "test_kerning_ligature.epub", "OEBPS/chapter8.xhtml", 7);
+  FsFile file;
+  Storage.openFileForRead("TEST", section.path, file);
+  const size_t tableSize = file.size() - section.offset;
+  file.close();
+
+  constexpr int ROUNDS = 200;
+  const uint16_t lastPage = static_cast<uint16_t>(layout.pageFirstWords.size() - 1);
+  const std::string xpath = section.xpath(lastPage);
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < ROUNDS; i++) {
+    section.xpath(lastPage);
+    section.page(xpath);
+  }
+  const double micros =
+      std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / ROUNDS;
+  printf("%zu byte map for %zu pages, %.1f us per lookup pair\n", tableSize, layout.pageFirstWords.size(), micros);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--bench") bench = true;
+  }
+
+  char scratch[] = "/tmp/xpath_map_XXXXXX";
+  if (!mkdtemp(scratch)) {
+    std::cerr << "Failed to create scratch directory" << std::endl;
+    return 1;
+  }
+  Storage.setRoot(scratch);
+
+  testInlineMarkup();
+  testNestedBlocks();
+  testImages();
+  testRoundTrips();
+  testSpineIndex();
+  testFailures();
+  check(!Storage.exists("/scratch.xpath"), "scratch file removed");
+  if (bench) benchLookups();
+
+  std::system((std::string("rm -rf ") + scratch).c_str());
+
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All XPath map tests passed" << std::endl;
+  return 0;
+}
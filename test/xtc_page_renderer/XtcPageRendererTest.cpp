@@ -0,0 +1,215 @@
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "lib/GfxRenderer/GfxRenderer.h"
+#include "lib/Xtc/Xtc/XtcPageRenderer.h"
+
+namespace {
+
+int failures = 0;
+
+void check(const bool condition, const std::string& message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << std::endl;
+    failures++;
+  }
+}
+
+const char* orientationName(const GfxRenderer::Orientation o) {
+  switch (o) {
+    case GfxRenderer::Portrait:
+      return "portrait";
+    case GfxRenderer::LandscapeClockwise:
+      return "landscape-cw";
+    case GfxRenderer::PortraitInverted:
+      return "portrait-inverted";
+    case GfxRenderer::LandscapeCounterClockwise:
+      return "landscape-ccw";
+  }
+  return "?";
+}
+
+// Deterministic page content: noise with a few solid regions so both bit planes carry every value
+std::vector<uint8_t> makePage(const uint16_t width, const uint16_t height, const uint8_t bitDepth, uint32_t seed) {
+  std::vector<uint8_t> page(xtc::pageBufferSize(width, height, bitDepth));
+  for (size_t i = 0; i < page.size(); i++) {
+    seed = seed * 1664525u + 1013904223u;
+    page[i] = static_cast<uint8_t>(seed >> 24);
+    if (i % 997 < 40) page[i] = 0x00;
+    if (i % 1499 < 30) page[i] = 0xFF;
+  }
+  return page;
+}
+
+// Reference: the per-pixel drawing XtcReaderActivity used before the bulk blit
+uint8_t referencePixel(const uint8_t* page, const uint16_t width, const uint16_t height, const uint8_t bitDepth,
+                       const uint16_t x, const uint16_t y) {
+  if (bitDepth == 2) {
+    const size_t planeSize = (static_cast<size_t>(width) * height + 7) / 8;
+    const size_t colBytes = (height + 7) / 8;
+    const size_t byteOffset = (width - 1 - x) * colBytes + y / 8;
+    const size_t bitInByte = 7 - (y % 8);
+    return ((page[byteOffset] >> bitInByte) & 1) << 1 | ((page[planeSize + byteOffset] >> bitInByte) & 1);
+  }
+  const size_t rowBytes = (width + 7) / 8;
+  return ((page[y * rowBytes + x / 8] >> (7 - (x % 8))) & 1) ? 0 : 3;
+}
+
+void drawReference(const GfxRenderer& renderer, const uint8_t* page, const uint16_t width, const uint16_t height,
+                   const uint8_t bitDepth, const GfxRenderer::RenderMode pass) {
+  renderer.clearScreen(pass == GfxRenderer::BW ? 0xFF : 0x00);
+  for (uint16_t y = 0; y < height; y++) {
+    for (uint16_t x = 0; x < width; x++) {
+      const uint8_t pv = referencePixel(page, width, height, bitDepth, x, y);
+      if (pass == GfxRenderer::BW && pv >= 1) {
+        renderer.drawPixel(x, y, true);
+      } else if (pass == GfxRenderer::GRAYSCALE_LSB && pv == 1) {
+        renderer.drawPixel(x, y, false);
+      } else if (pass == GfxRenderer::GRAYSCALE_MSB && (pv == 1 || pv == 2)) {
+        renderer.drawPixel(x, y, false);
+      }
+    }
+  }
+}
+
+std::vector<uint8_t> snapshot(const GfxRenderer& renderer) {
+  return {renderer.getFrameBuffer(), renderer.getFrameBuffer() + HalDisplay::BUFFER_SIZE};
+}
+
+void testMatchesReference(GfxRenderer& renderer) {
+  const GfxRenderer::Orientation orientations[] = {GfxRenderer::Portrait, GfxRenderer::LandscapeClockwise,
+                                                   GfxRenderer::PortraitInverted,
+                                                   GfxRenderer::LandscapeCounterClockwise};
+  const GfxRenderer::RenderMode passes[] = {GfxRenderer::BW, GfxRenderer::GRAYSCALE_LSB, GfxRenderer::GRAYSCALE_MSB};
+
+  for (const auto orientation : orientations) {
+    renderer.setOrientation(orientation);
+    const auto width = static_cast<uint16_t>(renderer.getScreenWidth());
+    const auto height = static_cast<uint16_t>(renderer.getScreenHeight());
+    for (const uint8_t bitDepth : {1, 2}) {
+      const auto page = makePage(width, height, bitDepth, 42 + bitDepth);
+      for (const auto pass : passes) {
+        if (bitDepth == 1 && pass != GfxRenderer::BW) continue;
+        drawReference(renderer, page.data(), width, height, bitDepth, pass);
+        const auto expected = snapshot(renderer);
+        renderer.clearScreen(0x5A);
+        xtc::drawPage(renderer, page.data(), width, height, bitDepth, pass);
+        check(snapshot(renderer) == expected, std::string(orientationName(orientation)) +
+                                                  (bitDepth == 2 ? " XTH" : " XTG") + " pass " +
+                                                  std::to_string(static_cast<int>(pass)) + " matches drawPixel");
+      }
+    }
+  }
+
+  // Pages that do not match the screen fall back to per-pixel drawing
+  renderer.setOrientation(GfxRenderer::Portrait);
+  const auto page = makePage(400, 600, 2, 7);
+  drawReference(renderer, page.data(), 400, 600, 2, GfxRenderer::BW);
+  const auto expected = snapshot(renderer);
+  xtc::drawPage(renderer, page.data(), 400, 600, 2, GfxRenderer::BW);
+  check(snapshot(renderer) == expected, "undersized page falls back to drawPixel");
+}
+
+double elapsedMs(const std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// One page turn as XtcReaderActivity performs it: BW pass, and for XTH the LSB, MSB and BW restore passes
+template <typename DrawFn>
+void turnPage(const GfxRenderer& renderer, const uint8_t* page, const uint16_t width, const uint16_t height,
+              const uint8_t bitDepth, DrawFn draw) {
+  draw(renderer, page, width, height, bitDepth, GfxRenderer::BW);
+  renderer.displayBuffer();
+  if (bitDepth == 2) {
+    draw(renderer, page, width, height, bitDepth, GfxRenderer::GRAYSCALE_LSB);
+    renderer.copyGrayscaleLsbBuffers();
+    draw(renderer, page, width, height, bitDepth, GfxRenderer::GRAYSCALE_MSB);
+    renderer.copyGrayscaleMsbBuffers();
+    renderer.displayGrayBuffer();
+    draw(renderer, page, width, height, bitDepth, GfxRenderer::BW);
+  }
+}
+
+void runBenchmark(GfxRenderer& renderer) {
+  constexpr int runs = 10;
+  char scratch[] = "/tmp/xtc_page_renderer_XXXXXX";
+  const int fd = mkstemp(scratch);
+  if (fd < 0) return;
+  close(fd);
+
+  renderer.setOrientation(GfxRenderer::Portrait);
+  const uint16_t width = renderer.getScreenWidth();
+  const uint16_t height = renderer.getScreenHeight();
+
+  std::cout << "Page turn latency, " << width << "x" << height
+            << " portrait page, excluding panel refresh (best of " << runs << "):" << std::endl;
+  for (const uint8_t bitDepth : {1, 2}) {
+    const auto page = makePage(width, height, bitDepth, 99);
+    std::FILE* f = std::fopen(scratch, "wb");
+    std::fwrite(page.data(), 1, page.size(), f);
+    std::fclose(f);
+
+    // Page read as XtcParser::loadPage does it: seek + one read into a page buffer
+    std::vector<uint8_t> buffer(page.size());
+    const auto loadPage = [&]() {
+      std::FILE* in = std::fopen(scratch, "rb");
+      const size_t n = std::fread(buffer.data(), 1, buffer.size(), in);
+      std::fclose(in);
+      return n;
+    };
+
+    double before = 1e9, miss = 1e9, hit = 1e9;
+    for (int run = 0; run < runs; run++) {
+      auto start = std::chrono::steady_clock::now();
+      loadPage();
+      turnPage(renderer, buffer.data(), width, height, bitDepth, drawReference);
+      before = std::min(before, elapsedMs(start));
+
+      start = std::chrono::steady_clock::now();
+      loadPage();
+      turnPage(renderer, buffer.data(), width, height, bitDepth, xtc::drawPage);
+      miss = std::min(miss, elapsedMs(start));
+
+      // Prefetched: the page is already in the second buffer when the turn starts
+      start = std::chrono::steady_clock::now();
+      turnPage(renderer, buffer.data(), width, height, bitDepth, xtc::drawPage);
+      hit = std::min(hit, elapsedMs(start));
+    }
+    std::cout << std::fixed << std::setprecision(2) << "  " << (bitDepth == 2 ? "XTCH" : "XTC ")
+              << ": drawPixel " << before << " ms, blit " << miss << " ms, blit + prefetch hit " << hit << " ms"
+              << std::endl;
+  }
+  std::remove(scratch);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  bool bench = false;
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--bench") bench = true;
+  }
+
+  HalDisplay display;
+  GfxRenderer renderer(display);
+  renderer.begin();
+
+  testMatchesReference(renderer);
+  if (bench) runBenchmark(renderer);
+
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All XTC page renderer tests passed" << std::endl;
+  return 0;
+}
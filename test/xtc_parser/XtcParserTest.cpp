@@ -0,0 +1,232 @@
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+
+#include "lib/Xtc/Xtc/XtcParser.h"
+
+// Track live heap bytes so the page table's memory ceiling can be checked independently of page count
+namespace {
+size_t liveBytes = 0;
+size_t peakBytes = 0;
+}  // namespace
+
+void* operator new(const size_t size) {
+  auto* p = static_cast<size_t*>(std::malloc(size + sizeof(size_t)));
+  if (!p) throw std::bad_alloc();
+  *p = size;
+  liveBytes += size;
+  peakBytes = std::max(peakBytes, liveBytes);
+  return p + 1;
+}
+
+void operator delete(void* ptr) noexcept {
+  if (!ptr) return;
+  auto* p = static_cast<size_t*>(ptr) - 1;
+  liveBytes -= *p;
+  std::free(p);
+}
+
+void operator delete(void* ptr, size_t) noexcept { operator delete(ptr); }
+
+namespace {
+
+using xtc::XtcParser;
+
+int failures = 0;
+
+void check(const bool condition, const std::string& message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << std::endl;
+    failures++;
+  }
+}
+
+constexpr uint16_t PAGE_WIDTH = 16;
+constexpr uint16_t PAGE_HEIGHT = 8;
+constexpr size_t PAGE_DATA = (PAGE_WIDTH + 7) / 8 * PAGE_HEIGHT;
+
+// Every page's bitmap encodes its own index so lookups can be verified end to end
+void pagePayload(const uint32_t page, uint8_t out[PAGE_DATA]) {
+  for (size_t i = 0; i < PAGE_DATA; i++) out[i] = static_cast<uint8_t>((page >> (8 * (i % 4))) + i);
+}
+
+uint64_t pageOffset(const uint32_t pageCount, const uint32_t page) {
+  return sizeof(xtc::XtcHeader) + static_cast<uint64_t>(pageCount) * sizeof(xtc::PageTableEntry) +
+         static_cast<uint64_t>(page) * (sizeof(xtc::XtgPageHeader) + PAGE_DATA);
+}
+
+// Write a synthetic 1-bit XTC with tiny pages: header, page table, then XTG pages
+void writeXtc(const std::string& path, const uint16_t pageCount, const bool truncateTable = false) {
+  std::FILE* f = std::fopen(path.c_str(), "wb");
+  xtc::XtcHeader header = {};
+  header.magic = xtc::XTC_MAGIC;
+  header.versionMajor = 1;
+  header.pageCount = pageCount;
+  header.pageTableOffset = sizeof(xtc::XtcHeader);
+  header.dataOffset = pageOffset(pageCount, 0);
+  std::fwrite(&header, sizeof(header), 1, f);
+
+  const uint32_t tableEntries = truncateTable ? pageCount / 2 : pageCount;
+  for (uint32_t page = 0; page < tableEntries; page++) {
+    xtc::PageTableEntry entry = {};
+    entry.dataOffset = pageOffset(pageCount, page);
+    entry.dataSize = sizeof(xtc::XtgPageHeader) + PAGE_DATA;
+    entry.width = PAGE_WIDTH;
+    entry.height = PAGE_HEIGHT;
+    std::fwrite(&entry, sizeof(entry), 1, f);
+  }
+  if (truncateTable) {
+    std::fclose(f);
+    return;
+  }
+
+  for (uint32_t page = 0; page < pageCount; page++) {
+    xtc::XtgPageHeader pageHeader = {};
+    pageHeader.magic = xtc::XTG_MAGIC;
+    pageHeader.width = PAGE_WIDTH;
+    pageHeader.height = PAGE_HEIGHT;
+    pageHeader.dataSize = PAGE_DATA;
+    uint8_t payload[PAGE_DATA];
+    pagePayload(page, payload);
+    std::fwrite(&pageHeader, sizeof(pageHeader), 1, f);
+    std::fwrite(payload, sizeof(payload), 1, f);
+  }
+  std::fclose(f);
+}
+
+bool pageMatches(XtcParser& parser, const uint32_t page) {
+  uint8_t buffer[PAGE_DATA];
+  uint8_t expected[PAGE_DATA];
+  pagePayload(page, expected);
+  return parser.loadPage(page, buffer, sizeof(buffer)) == PAGE_DATA && memcmp(buffer, expected, PAGE_DATA) == 0;
+}
+
+void testLargeBook(const std::string& path, const bool bench) {
+  constexpr uint16_t pageCount = UINT16_MAX;  // format limit: the header stores the page count in 16 bits
+  writeXtc(path, pageCount);
+
+  const size_t baseline = liveBytes;
+  peakBytes = liveBytes;
+  XtcParser parser;
+  check(parser.open(path.c_str()) == xtc::XtcError::OK, "open 65535-page book");
+  check(parser.getPageCount() == pageCount, "page count");
+  check(parser.getWidth() == PAGE_WIDTH && parser.getHeight() == PAGE_HEIGHT, "default size from first page");
+
+  // Sequential scan: every entry is correct and each window is read exactly once
+  bool allInfoCorrect = true;
+  for (uint32_t page = 0; page < pageCount; page++) {
+    xtc::PageInfo info;
+    if (!parser.getPageInfo(page, info) || info.offset != pageOffset(pageCount, page) || info.width != PAGE_WIDTH) {
+      allInfoCorrect = false;
+    }
+  }
+  check(allInfoCorrect, "sequential getPageInfo matches the page table");
+  const uint32_t windows = (pageCount + XtcParser::PAGE_TABLE_WINDOW - 1) / XtcParser::PAGE_TABLE_WINDOW;
+  check(parser.getPageTableWindowLoads() == windows, "sequential scan reads each window once");
+
+  xtc::PageInfo info;
+  check(!parser.getPageInfo(pageCount, info), "getPageInfo past the end fails");
+  uint8_t buffer[PAGE_DATA];
+  check(parser.loadPage(pageCount, buffer, sizeof(buffer)) == 0 &&
+            parser.getLastError() == xtc::XtcError::PAGE_OUT_OF_RANGE,
+        "loadPage past the end reports PAGE_OUT_OF_RANGE");
+
+  // Random access: page data is correct
+  std::mt19937 rng(1234);
+  std::uniform_int_distribution<uint32_t> pick(0, pageCount - 1);
+  bool allPagesCorrect = true;
+  for (int i = 0; i < 2000; i++) {
+    allPagesCorrect = pageMatches(parser, pick(rng)) && allPagesCorrect;
+  }
+  check(allPagesCorrect, "random loadPage returns the right page");
+
+  // Page turns within cached windows never touch the page table on disk
+  const uint32_t before = parser.getPageTableWindowLoads();
+  for (int turn = 0; turn < 1000; turn++) {
+    pageMatches(parser, 30000 + turn % 200);
+  }
+  check(parser.getPageTableWindowLoads() - before <= 200 / XtcParser::PAGE_TABLE_WINDOW + 1,
+        "page turns reuse cached windows");
+
+  const size_t heapUsed = peakBytes - baseline;
+  const size_t fullTable = static_cast<size_t>(pageCount) * sizeof(xtc::PageInfo);
+  check(sizeof(XtcParser) + heapUsed < 8 * 1024, "page table memory stays under 8KB");
+  std::cout << "65535 pages: parser object " << sizeof(XtcParser) << " bytes, peak heap " << heapUsed
+            << " bytes (full in-memory table would be " << fullTable << " bytes)" << std::endl;
+
+  if (bench) {
+    constexpr int lookups = 200000;
+    auto start = std::chrono::steady_clock::now();
+    volatile uint32_t sink = 0;
+    for (int i = 0; i < lookups; i++) {
+      parser.getPageInfo(30000 + i % 64, info);
+      sink = sink + info.offset;
+    }
+    const double hitNs =
+        std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / lookups;
+
+    const uint32_t loadsBefore = parser.getPageTableWindowLoads();
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < lookups / 10; i++) {
+      parser.getPageInfo(pick(rng), info);
+      sink = sink + info.offset;
+    }
+    const double randomNs =
+        std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (lookups / 10);
+    std::cout << std::fixed << std::setprecision(1) << "getPageInfo: " << hitNs << " ns cached, " << randomNs
+              << " ns uniformly random (" << parser.getPageTableWindowLoads() - loadsBefore << " window reads for "
+              << lookups / 10 << " lookups)" << std::endl;
+  }
+  parser.close();
+}
+
+void testSmallAndBrokenBooks(const std::string& path) {
+  writeXtc(path, 3);
+  XtcParser parser;
+  check(parser.open(path.c_str()) == xtc::XtcError::OK, "open 3-page book");
+  check(pageMatches(parser, 0) && pageMatches(parser, 2), "small book pages");
+  xtc::PageInfo info;
+  check(!parser.getPageInfo(3, info), "small book bounds");
+  parser.close();
+
+  writeXtc(path, 1000, true);
+  check(parser.open(path.c_str()) == xtc::XtcError::READ_ERROR, "truncated page table is rejected at open");
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  bool bench = false;
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--bench") bench = true;
+  }
+
+  char scratch[] = "/tmp/xtc_parser_XXXXXX";
+  const int fd = mkstemp(scratch);
+  if (fd < 0) {
+    std::cerr << "Failed to create scratch file" << std::endl;
+    return 1;
+  }
+  close(fd);
+  Storage.setRoot("");
+
+  testLargeBook(scratch, bench);
+  testSmallAndBrokenBooks(scratch);
+  std::remove(scratch);
+
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All XTC parser tests passed" << std::endl;
+  return 0;
+}